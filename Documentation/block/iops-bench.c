@@ -0,0 +1,180 @@
+/*
+ * iops-bench.c - random direct reads from many threads, in I/Os per second
+ *
+ * Build:	gcc -O2 -Wall -o iops-bench iops-bench.c -lpthread
+ *
+ *   iops-bench [-t threads] [-b blocksize] [-s seconds] [-a] device
+ *
+ *	-t	number of threads, each with one read in flight (default 1)
+ *	-b	size of each read in bytes (default 4096)
+ *	-s	how long to run (default 10)
+ *	-a	bind thread n to cpu n
+ *
+ * Each thread reads blocksize bytes at random aligned offsets of the
+ * device with O_DIRECT, so every read goes through the block layer.
+ * Against null_blk (see null_blk.txt) that is all it measures.  The total
+ * and per-thread rates are printed at the end.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <linux/fs.h>
+
+#define MAX_THREADS	256
+
+static const char *device;
+static int nr_threads = 1;
+static int blocksize = 4096;
+static int seconds = 10;
+static int affinity;
+static volatile int stop;
+static unsigned long long nr_blocks;
+
+struct worker {
+	pthread_t thread;
+	int index;
+	unsigned long long ios;
+	int error;
+};
+
+static struct worker workers[MAX_THREADS];
+
+static void *worker_fn(void *data)
+{
+	struct worker *w = data;
+	unsigned int seed = w->index * 7919 + 1;
+	void *buf;
+	int fd;
+
+	if (affinity) {
+		cpu_set_t mask;
+
+		CPU_ZERO(&mask);
+		CPU_SET(w->index, &mask);
+		if (sched_setaffinity(0, sizeof(mask), &mask))
+			perror("sched_setaffinity");
+	}
+
+	if (posix_memalign(&buf, 4096, blocksize)) {
+		w->error = ENOMEM;
+		return NULL;
+	}
+
+	fd = open(device, O_RDONLY | O_DIRECT);
+	if (fd < 0) {
+		w->error = errno;
+		return NULL;
+	}
+
+	while (!stop) {
+		unsigned long long block;
+
+		block = ((unsigned long long) rand_r(&seed) << 31 |
+			 rand_r(&seed)) % nr_blocks;
+		if (pread(fd, buf, blocksize, block * blocksize) != blocksize) {
+			w->error = errno ? errno : EIO;
+			break;
+		}
+		w->ios++;
+	}
+
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: iops-bench [-t threads] [-b blocksize] "
+		"[-s seconds] [-a] device\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long size, total = 0;
+	struct timeval start, end;
+	double elapsed;
+	int fd, i, c;
+
+	while ((c = getopt(argc, argv, "t:b:s:a")) != -1) {
+		switch (c) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'b':
+			blocksize = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'a':
+			affinity = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || nr_threads < 1 || nr_threads > MAX_THREADS ||
+	    blocksize < 512 || blocksize % 512 || seconds < 1)
+		usage();
+	device = argv[optind];
+
+	fd = open(device, O_RDONLY);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &size)) {
+		perror(device);
+		return 1;
+	}
+	close(fd);
+	nr_blocks = size / blocksize;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s: device too small\n", device);
+		return 1;
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].index = i;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	gettimeofday(&end, NULL);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_usec - start.tv_usec) / 1000000.0;
+
+	for (i = 0; i < nr_threads; i++) {
+		if (workers[i].error) {
+			fprintf(stderr, "thread %d: %s\n", i,
+				strerror(workers[i].error));
+			return 1;
+		}
+		total += workers[i].ios;
+	}
+
+	printf("%s: %d threads, %d byte reads, %.0f IOPS "
+	       "(%.0f per thread), %.1f MB/s\n",
+	       device, nr_threads, blocksize, total / elapsed,
+	       total / elapsed / nr_threads,
+	       total * (double) blocksize / elapsed / (1024 * 1024));
+	return 0;
+}
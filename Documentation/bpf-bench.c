@@ -0,0 +1,298 @@
+/*
+ * bpf-bench.c - per-packet cost of socket filters, interpreted and compiled
+ *
+ * Build:	gcc -O2 -Wall -o bpf-bench bpf-bench.c
+ *
+ *   bpf-bench [-n packets] [-s sockets] [filter...]
+ *
+ *	filter	any of the programs below, as tcpdump -dd prints them for
+ *		an ethernet device (default all of them):
+ *		arp	"arp"
+ *		host	"host 192.168.1.1"
+ *		udp53	"udp port 53"
+ *		srcdst	"ip src 127.0.0.1 and udp dst port 53"
+ *
+ *	-n	UDP packets to send (default 200000)
+ *	-s	packet sockets to attach the filter to (default 8)
+ *
+ * Sends UDP packets from 127.0.0.1 to a port on 127.0.0.1 that is not 53,
+ * first with no packet sockets open, then with packet sockets on the
+ * loopback device that have the filter attached.  None of the filters
+ * accept the packets, so the extra time taken is that of running the
+ * filter and getting to it.  Prints that in ns per filter run, once with
+ * /proc/sys/net/core/bpf_jit_enable set to 0 and once with it set to 1;
+ * see Documentation/networking/filter.txt.  Kernels without the JIT only
+ * get the first.  Must be run as root, on an otherwise idle machine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#define JIT_SYSCTL	"/proc/sys/net/core/bpf_jit_enable"
+
+static struct sock_filter arp[] = {
+	{ 0x28, 0, 0, 0x0000000c },
+	{ 0x15, 0, 1, 0x00000806 },
+	{ 0x06, 0, 0, 0x00040000 },
+	{ 0x06, 0, 0, 0x00000000 },
+};
+
+static struct sock_filter host[] = {
+	{ 0x28, 0, 0, 0x0000000c },
+	{ 0x15, 0, 4, 0x00000800 },
+	{ 0x20, 0, 0, 0x0000001a },
+	{ 0x15, 8, 0, 0xc0a80101 },
+	{ 0x20, 0, 0, 0x0000001e },
+	{ 0x15, 6, 7, 0xc0a80101 },
+	{ 0x15, 1, 0, 0x00000806 },
+	{ 0x15, 0, 5, 0x00008035 },
+	{ 0x20, 0, 0, 0x0000001c },
+	{ 0x15, 2, 0, 0xc0a80101 },
+	{ 0x20, 0, 0, 0x00000026 },
+	{ 0x15, 0, 1, 0xc0a80101 },
+	{ 0x06, 0, 0, 0x00040000 },
+	{ 0x06, 0, 0, 0x00000000 },
+};
+
+static struct sock_filter udp53[] = {
+	{ 0x28, 0, 0, 0x0000000c },
+	{ 0x15, 0, 6, 0x000086dd },
+	{ 0x30, 0, 0, 0x00000014 },
+	{ 0x15, 0, 15, 0x00000011 },
+	{ 0x28, 0, 0, 0x00000036 },
+	{ 0x15, 12, 0, 0x00000035 },
+	{ 0x28, 0, 0, 0x00000038 },
+	{ 0x15, 10, 11, 0x00000035 },
+	{ 0x15, 0, 10, 0x00000800 },
+	{ 0x30, 0, 0, 0x00000017 },
+	{ 0x15, 0, 8, 0x00000011 },
+	{ 0x28, 0, 0, 0x00000014 },
+	{ 0x45, 6, 0, 0x00001fff },
+	{ 0xb1, 0, 0, 0x0000000e },
+	{ 0x48, 0, 0, 0x0000000e },
+	{ 0x15, 2, 0, 0x00000035 },
+	{ 0x48, 0, 0, 0x00000010 },
+	{ 0x15, 0, 1, 0x00000035 },
+	{ 0x06, 0, 0, 0x00040000 },
+	{ 0x06, 0, 0, 0x00000000 },
+};
+
+static struct sock_filter srcdst[] = {
+	{ 0x28, 0, 0, 0x0000000c },
+	{ 0x15, 0, 10, 0x00000800 },
+	{ 0x20, 0, 0, 0x0000001a },
+	{ 0x15, 0, 8, 0x7f000001 },
+	{ 0x30, 0, 0, 0x00000017 },
+	{ 0x15, 0, 6, 0x00000011 },
+	{ 0x28, 0, 0, 0x00000014 },
+	{ 0x45, 4, 0, 0x00001fff },
+	{ 0xb1, 0, 0, 0x0000000e },
+	{ 0x48, 0, 0, 0x00000010 },
+	{ 0x15, 0, 1, 0x00000035 },
+	{ 0x06, 0, 0, 0x00040000 },
+	{ 0x06, 0, 0, 0x00000000 },
+};
+
+#define PROG(name)	{ #name, name, sizeof(name) / sizeof(name[0]) }
+
+static struct {
+	const char *name;
+	struct sock_filter *insns;
+	unsigned short len;
+} progs[] = {
+	PROG(arp),
+	PROG(host),
+	PROG(udp53),
+	PROG(srcdst),
+};
+
+#define NPROGS	(sizeof(progs) / sizeof(progs[0]))
+
+static long packets = 200000;
+static int nsocks = 8;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* returns -1 if there is no JIT */
+static int get_jit(void)
+{
+	char c = 0;
+	int fd;
+
+	fd = open(JIT_SYSCTL, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (read(fd, &c, 1) != 1)
+		die(JIT_SYSCTL);
+	close(fd);
+	return c - '0';
+}
+
+static void set_jit(int on)
+{
+	char c = '0' + on;
+	int fd;
+
+	fd = open(JIT_SYSCTL, O_WRONLY);
+	if (fd < 0 || write(fd, &c, 1) != 1)
+		die(JIT_SYSCTL);
+	close(fd);
+}
+
+/* seconds to send packets UDP packets over the loopback device */
+static double send_packets(void)
+{
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	char buf[64], rbuf[64];
+	double start, elapsed;
+	int tx, rx;
+	long i;
+
+	rx = socket(AF_INET, SOCK_DGRAM, 0);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rx < 0 || tx < 0)
+		die("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(rx, (struct sockaddr *) &addr, sizeof(addr)) ||
+	    getsockname(rx, (struct sockaddr *) &addr, &alen) ||
+	    connect(tx, (struct sockaddr *) &addr, sizeof(addr)))
+		die("bind");
+	if (addr.sin_port == htons(53))
+		die("port 53");
+	memset(buf, 0, sizeof(buf));
+
+	start = now();
+	for (i = 0; i < packets; i++) {
+		if (send(tx, buf, sizeof(buf), 0) != sizeof(buf))
+			die("send");
+		if (recv(rx, rbuf, sizeof(rbuf), 0) < 0)
+			die("recv");
+	}
+	elapsed = now() - start;
+
+	close(tx);
+	close(rx);
+	return elapsed;
+}
+
+/* seconds to send packets with prog attached to nsocks packet sockets */
+static double run(int p)
+{
+	struct sock_fprog fprog = { progs[p].len, progs[p].insns };
+	struct sockaddr_ll sll;
+	double elapsed;
+	int fds[nsocks], i;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_IP);
+	sll.sll_ifindex = if_nametoindex("lo");
+	if (!sll.sll_ifindex)
+		die("lo");
+
+	for (i = 0; i < nsocks; i++) {
+		fds[i] = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+		if (fds[i] < 0)
+			die("packet socket");
+		if (setsockopt(fds[i], SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+			       sizeof(fprog)))
+			die("SO_ATTACH_FILTER");
+		if (bind(fds[i], (struct sockaddr *) &sll, sizeof(sll)))
+			die("bind packet socket");
+	}
+	elapsed = send_packets();
+	for (i = 0; i < nsocks; i++)
+		close(fds[i]);
+	return elapsed;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: bpf-bench [-n packets] [-s sockets] "
+		"[arp|host|udp53|srcdst...]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int want[NPROGS], jit, c, p;
+	double base, runs;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			packets = atol(optarg);
+			break;
+		case 's':
+			nsocks = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (packets < 1 || nsocks < 1)
+		usage();
+
+	for (p = 0; p < NPROGS; p++)
+		want[p] = optind == argc;
+	for (; optind < argc; optind++) {
+		for (p = 0; p < NPROGS; p++)
+			if (!strcmp(argv[optind], progs[p].name))
+				break;
+		if (p == NPROGS)
+			usage();
+		want[p] = 1;
+	}
+
+	/* warm up, then take the time without any filters */
+	send_packets();
+	base = send_packets();
+	runs = (double)packets * nsocks;
+	printf("%ld packets, %.0f ns each without filters\n", packets,
+	       base * 1e9 / packets);
+	printf("filter  insns  interpreted ns  compiled ns\n");
+
+	jit = get_jit();
+	for (p = 0; p < NPROGS; p++) {
+		if (!want[p])
+			continue;
+		if (jit >= 0)
+			set_jit(0);
+		printf("%-6s  %5d  %14.1f", progs[p].name, progs[p].len,
+		       (run(p) - base) * 1e9 / runs);
+		if (jit >= 0) {
+			set_jit(1);
+			printf("  %11.1f", (run(p) - base) * 1e9 / runs);
+		}
+		printf("\n");
+	}
+	if (jit >= 0)
+		set_jit(jit);
+	return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * dcache-bench.c - stat() and open() storm on the dentry cache
+ *
+ * Build:	gcc -O2 -Wall -o dcache-bench dcache-bench.c
+ *
+ *   dcache-bench [-d directory] [-p processes] [-f files] [-t seconds]
+ *
+ *	-d	where to create the test directory (default /tmp)
+ *	-p	processes to run at once (default: one per CPU)
+ *	-f	files in the test directory (default 1000)
+ *	-t	seconds per run (default 5)
+ *
+ * Creates a directory of empty files, then has every process walk the
+ * same names over and over for each of three loads: stat() of the files,
+ * open() and close() of them, and stat() of names that don't exist
+ * (negative dentries).  Everything is in the dcache after the first
+ * pass, so the runs measure path walk and dput() alone, and how they
+ * scale: each load runs first in one process, then in all of them.
+ * Prints calls per second, in total and per process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+enum { LOAD_STAT, LOAD_OPEN, LOAD_ENOENT };
+
+static const char *load_names[] = { "stat", "open", "enoent" };
+
+static const char *topdir = "/tmp";
+static char dir[4096];
+static int procs;
+static int files = 1000;
+static int seconds = 5;
+
+static volatile int stop;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void on_alarm(int sig)
+{
+	stop = 1;
+}
+
+static void file_name(char *buf, size_t len, int load, int i)
+{
+	snprintf(buf, len, "%s/%s%d", dir, load == LOAD_ENOENT ? "x" : "f", i);
+}
+
+static void make_files(void)
+{
+	char name[4200];
+	int i, fd;
+
+	snprintf(dir, sizeof(dir), "%s/dcache-bench.%d", topdir, getpid());
+	if (mkdir(dir, 0700))
+		die(dir);
+	for (i = 0; i < files; i++) {
+		file_name(name, sizeof(name), LOAD_STAT, i);
+		fd = open(name, O_CREAT | O_WRONLY, 0600);
+		if (fd < 0)
+			die(name);
+		close(fd);
+	}
+}
+
+static void remove_files(void)
+{
+	char name[4200];
+	int i;
+
+	for (i = 0; i < files; i++) {
+		file_name(name, sizeof(name), LOAD_STAT, i);
+		unlink(name);
+	}
+	rmdir(dir);
+}
+
+/* calls made in seconds, by one process */
+static unsigned long run_one(int load, int seed)
+{
+	char name[4200];
+	unsigned long calls = 0;
+	struct stat st;
+	int i = seed % files, fd;
+
+	signal(SIGALRM, on_alarm);
+	alarm(seconds);
+	while (!stop) {
+		file_name(name, sizeof(name), load, i);
+		switch (load) {
+		case LOAD_STAT:
+			if (stat(name, &st))
+				die(name);
+			break;
+		case LOAD_OPEN:
+			fd = open(name, O_RDONLY);
+			if (fd < 0)
+				die(name);
+			close(fd);
+			break;
+		case LOAD_ENOENT:
+			if (!stat(name, &st))
+				die("enoent");
+			break;
+		}
+		calls++;
+		if (++i == files)
+			i = 0;
+	}
+	return calls;
+}
+
+/* calls per second of nr processes running load at once */
+static double run(int load, int nr)
+{
+	unsigned long *calls, total = 0;
+	double start;
+	int i;
+
+	calls = mmap(NULL, nr * sizeof(*calls), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (calls == MAP_FAILED)
+		die("mmap");
+
+	fflush(stdout);
+	start = now();
+	for (i = 0; i < nr; i++) {
+		switch (fork()) {
+		case -1:
+			die("fork");
+		case 0:
+			calls[i] = run_one(load, i * files / nr);
+			_exit(0);
+		}
+	}
+	for (i = 0; i < nr; i++)
+		if (wait(NULL) < 0)
+			die("wait");
+	start = now() - start;
+
+	for (i = 0; i < nr; i++)
+		total += calls[i];
+	munmap(calls, nr * sizeof(*calls));
+	return total / start;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: dcache-bench [-d directory] [-p processes] "
+		"[-f files] [-t seconds]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	double one, all;
+	int c, load;
+
+	procs = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "d:p:f:t:")) != -1) {
+		switch (c) {
+		case 'd':
+			topdir = optarg;
+			break;
+		case 'p':
+			procs = atoi(optarg);
+			break;
+		case 'f':
+			files = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || procs < 1 || files < 1 || seconds < 1)
+		usage();
+
+	make_files();
+	printf("%d files, %d processes, %d seconds per run\n",
+	       files, procs, seconds);
+	for (load = LOAD_STAT; load <= LOAD_ENOENT; load++) {
+		one = run(load, 1);
+		all = run(load, procs);
+		printf("%-6s  1 process %10.0f/s   %d processes %10.0f/s "
+		       "(%.0f/s each)\n", load_names[load], one, procs, all,
+		       all / procs);
+	}
+	remove_files();
+	return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * ext3-bench.c - streaming writes and unlinks of large files, and fsync
+ *		  latency
+ *
+ * Build:	gcc -O2 -Wall -o ext3-bench ext3-bench.c
+ *
+ *   ext3-bench [-s size_mb] [-b bufsize] [-j jobs] [-n count] [-k]
+ *		write|unlink|fsync dir
+ *
+ *	write	each job writes a file of its own in dir from start to end
+ *		with write()s of bufsize, then fsync()s it
+ *	unlink	writes the files as above, syncs, then unlink()s them all
+ *	fsync	each job appends bufsize bytes to a file of its own and
+ *		fsync()s it, count times, the way a database writes its log
+ *
+ *	-s	megabytes per file (default 256)
+ *	-b	bytes per write() (default 4096)
+ *	-j	number of jobs writing at once (default 1)
+ *	-n	appends per job for fsync (default 1000)
+ *	-k	keep the files, e.g. to look at them with filefrag
+ *
+ * Compare a filesystem mounted with no options, with -o extents and with
+ * -o extents,delalloc; see Documentation/filesystems/ext3.txt.  Several
+ * jobs writing at once show how well each keeps its files contiguous.
+ * Prints MB/s for write, and the time taken for unlink.
+ *
+ * fsync measures the cost of a journal commit: compare no options with
+ * -o journal_async_commit, on a disk with barriers on and off.  Prints
+ * the mean time an fsync() took.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static long long size_mb = 256;
+static int bufsize = 4096, jobs = 1, count = 1000, keep;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void file_name(char *name, const char *dir, int job)
+{
+	sprintf(name, "%s/ext3-bench.%d", dir, job);
+}
+
+static void write_file(const char *dir, int job)
+{
+	long long left = size_mb << 20;
+	char name[4096];
+	char *buf;
+	ssize_t n;
+	int fd;
+
+	buf = malloc(bufsize);
+	if (!buf)
+		die("malloc");
+	memset(buf, job + 1, bufsize);
+	file_name(name, dir, job);
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die(name);
+	while (left > 0) {
+		n = write(fd, buf, left < bufsize ? left : bufsize);
+		if (n <= 0)
+			die("write");
+		left -= n;
+	}
+	if (fsync(fd))
+		die("fsync");
+	close(fd);
+}
+
+static void fsync_file(const char *dir, int job)
+{
+	char name[4096];
+	char *buf;
+	int fd, i;
+
+	buf = malloc(bufsize);
+	if (!buf)
+		die("malloc");
+	memset(buf, job + 1, bufsize);
+	file_name(name, dir, job);
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (fd < 0)
+		die(name);
+	for (i = 0; i < count; i++) {
+		if (write(fd, buf, bufsize) != bufsize)
+			die("write");
+		if (fsync(fd))
+			die("fsync");
+	}
+	close(fd);
+}
+
+/* run fn() in each of the jobs at once */
+static void run_jobs(void (*fn)(const char *, int), const char *dir)
+{
+	int i, status;
+
+	for (i = 0; i < jobs; i++) {
+		switch (fork()) {
+		case -1:
+			die("fork");
+		case 0:
+			fn(dir, i);
+			exit(0);
+		}
+	}
+	for (i = 0; i < jobs; i++) {
+		if (wait(&status) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			exit(1);
+	}
+}
+
+static void unlink_files(const char *dir)
+{
+	char name[4096];
+	int i;
+
+	for (i = 0; i < jobs; i++) {
+		file_name(name, dir, i);
+		if (unlink(name))
+			die(name);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: ext3-bench [-s size_mb] [-b bufsize] "
+		"[-j jobs] [-n count] [-k] write|unlink|fsync dir\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mode, *dir;
+	double start, elapsed;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:b:j:n:k")) != -1) {
+		switch (c) {
+		case 's':
+			size_mb = atoll(optarg);
+			break;
+		case 'b':
+			bufsize = atoi(optarg);
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 2 || size_mb < 1 || bufsize < 1 || jobs < 1 ||
+	    count < 1)
+		usage();
+	mode = argv[optind];
+	dir = argv[optind + 1];
+
+	if (!strcmp(mode, "write")) {
+		start = now();
+		run_jobs(write_file, dir);
+		elapsed = now() - start;
+		printf("write: %d x %lld MB, %.1f MB/s\n", jobs, size_mb,
+		       jobs * size_mb / elapsed);
+		if (!keep)
+			unlink_files(dir);
+	} else if (!strcmp(mode, "unlink")) {
+		run_jobs(write_file, dir);
+		sync();
+		start = now();
+		unlink_files(dir);
+		sync();
+		elapsed = now() - start;
+		printf("unlink: %d x %lld MB, %.3f s\n", jobs, size_mb,
+		       elapsed);
+	} else if (!strcmp(mode, "fsync")) {
+		start = now();
+		run_jobs(fsync_file, dir);
+		elapsed = now() - start;
+		printf("fsync: %d x %d, %.3f ms per fsync\n", jobs, count,
+		       elapsed * 1000 / count);
+		if (!keep)
+			unlink_files(dir);
+	} else
+		usage();
+	return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * hrtimer-bench.c - how late are timers delivered to user space
+ *
+ * Build:	gcc -O2 -Wall -o hrtimer-bench hrtimer-bench.c -lrt
+ *
+ * Run the same command line on a kernel with and without high-resolution
+ * timers (CONFIG_HIGH_RES_TIMERS, or "highres=off"), see
+ * Documentation/hrtimers.txt.
+ *
+ *   hrtimer-bench [-f] nanosleep [interval_us] [seconds]
+ *	relative nanosleep() of interval_us, measured against
+ *	CLOCK_MONOTONIC
+ *
+ *   hrtimer-bench [-f] abs [interval_us] [seconds]
+ *	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME) on a strictly
+ *	periodic schedule
+ *
+ *   hrtimer-bench [-f] timer [interval_us] [seconds]
+ *	periodic POSIX timer on CLOCK_MONOTONIC, delivered as a signal
+ *	and picked up with sigwaitinfo()
+ *
+ *	-f	run at SCHED_FIFO priority 99 with all memory locked, to
+ *		leave out the scheduling latency as far as possible
+ *
+ * The latency is the time between the expiry time asked for and the
+ * moment the task runs again. The result is printed on one line:
+ * samples, min, average, 99th percentile and max latency in usecs, and
+ * the number of timer overruns for the POSIX timer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#define MAX_SAMPLES	1000000
+#define NSEC_PER_SEC	1000000000LL
+
+static long long lat[MAX_SAMPLES];
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void ns_to_ts(long long ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *what, long long interval, int n,
+		   long overruns)
+{
+	long long sum = 0;
+	int i;
+
+	if (!n) {
+		printf("%s: no samples\n", what);
+		return;
+	}
+	qsort(lat, n, sizeof(lat[0]), cmp_ll);
+	for (i = 0; i < n; i++)
+		sum += lat[i];
+	printf("%s: interval %lldus samples %d min %.1f avg %.1f p99 %.1f "
+	       "max %.1f (us) overruns %ld\n", what, interval / 1000, n,
+	       lat[0] / 1000.0, sum / n / 1000.0, lat[n * 99 / 100] / 1000.0,
+	       lat[n - 1] / 1000.0, overruns);
+}
+
+static int bench_nanosleep(long long interval, long long end)
+{
+	struct timespec ts;
+	long long t0, t1;
+	int n = 0;
+
+	ns_to_ts(interval, &ts);
+	while (n < MAX_SAMPLES) {
+		t0 = now_ns();
+		if (t0 >= end)
+			break;
+		nanosleep(&ts, NULL);
+		t1 = now_ns();
+		lat[n++] = t1 - t0 - interval;
+	}
+	report("nanosleep", interval, n, 0);
+	return 0;
+}
+
+static int bench_abs(long long interval, long long end)
+{
+	struct timespec ts;
+	long long next;
+	int n = 0;
+
+	next = now_ns() + interval;
+	while (n < MAX_SAMPLES && next < end) {
+		ns_to_ts(next, &ts);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		lat[n++] = now_ns() - next;
+		next += interval;
+	}
+	report("abs", interval, n, 0);
+	return 0;
+}
+
+static int bench_timer(long long interval, long long end)
+{
+	struct sigevent sev;
+	struct itimerspec its;
+	siginfo_t info;
+	sigset_t set;
+	timer_t timer;
+	long long next;
+	long overruns = 0;
+	int n = 0, orun;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGRTMIN);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = SIGRTMIN;
+	if (timer_create(CLOCK_MONOTONIC, &sev, &timer) < 0) {
+		perror("timer_create");
+		return 1;
+	}
+
+	next = now_ns() + interval;
+	ns_to_ts(next, &its.it_value);
+	ns_to_ts(interval, &its.it_interval);
+	if (timer_settime(timer, TIMER_ABSTIME, &its, NULL) < 0) {
+		perror("timer_settime");
+		return 1;
+	}
+
+	while (n < MAX_SAMPLES && next < end) {
+		if (sigwaitinfo(&set, &info) < 0)
+			continue;
+		lat[n++] = now_ns() - next;
+		/* expiries missed while we did not pick up the signal */
+		orun = timer_getoverrun(timer);
+		if (orun > 0)
+			overruns += orun;
+		next += interval * (1 + (orun > 0 ? orun : 0));
+	}
+	timer_delete(timer);
+	report("timer", interval, n, overruns);
+	return 0;
+}
+
+static void go_fifo(void)
+{
+	struct sched_param sp = { .sched_priority = 99 };
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		perror("mlockall");
+	if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0)
+		perror("sched_setscheduler");
+}
+
+int main(int argc, char **argv)
+{
+	long long interval, end;
+	const char *mode;
+	int seconds;
+
+	if (argc > 1 && !strcmp(argv[1], "-f")) {
+		go_fifo();
+		argc--;
+		argv++;
+	}
+	if (argc < 2)
+		goto usage;
+
+	mode = argv[1];
+	interval = (argc > 2 ? atoll(argv[2]) : 100) * 1000;
+	seconds = argc > 3 ? atoi(argv[3]) : 10;
+	if (interval <= 0 || seconds <= 0)
+		goto usage;
+	end = now_ns() + seconds * NSEC_PER_SEC;
+
+	if (!strcmp(mode, "nanosleep"))
+		return bench_nanosleep(interval, end);
+	if (!strcmp(mode, "abs"))
+		return bench_abs(interval, end);
+	if (!strcmp(mode, "timer"))
+		return bench_timer(interval, end);
+usage:
+	fprintf(stderr, "usage: %s [-f] nanosleep|abs|timer "
+		"[interval_us] [seconds]\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,350 @@
+/*
+ * io_ring-bench.c - operations per second, system calls against io_ring
+ *
+ * Build:	gcc -O2 -Wall -o io_ring-bench io_ring-bench.c
+ *
+ *   io_ring-bench [-d depth] [-b batch] [-s seconds] sync file
+ *	pread() of 4k blocks from random offsets of file, one system
+ *	call each
+ *
+ *   io_ring-bench [-d depth] [-b batch] [-s seconds] [-q] ring file
+ *	the same reads as IORING_OP_READV, depth of them in flight,
+ *	submitted and reaped batch at a time
+ *
+ *   io_ring-bench [-d depth] [-b batch] [-s seconds] [-q] nop
+ *	IORING_OP_NOP, to measure the ring itself
+ *
+ *	-q	submit through the sq thread (IORING_SETUP_SQPOLL, needs
+ *		CAP_SYS_ADMIN)
+ *
+ * Read the file once beforehand (cat file > /dev/null) so it is in the
+ * page cache, see Documentation/io_ring.txt.  Prints operations and
+ * system calls per second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+/* from include/linux/io_ring.h */
+#ifndef __NR_io_ring_setup
+#define __NR_io_ring_setup	310
+#define __NR_io_ring_enter	311
+#endif
+
+struct io_ring_sqe {
+	unsigned char		opcode;
+	unsigned char		flags;
+	unsigned short		resv1;
+	int			fd;
+	unsigned long long	off;
+	unsigned long long	addr;
+	unsigned int		len;
+	unsigned int		op_flags;
+	unsigned long long	user_data;
+	unsigned long long	resv2[3];
+};
+
+struct io_ring_cqe {
+	unsigned long long	user_data;
+	int			res;
+	unsigned int		flags;
+};
+
+struct io_sqring_offsets {
+	unsigned int head, tail, ring_mask, ring_entries, flags, dropped;
+	unsigned int array, resv1;
+	unsigned long long resv2;
+};
+
+struct io_cqring_offsets {
+	unsigned int head, tail, ring_mask, ring_entries, overflow, cqes;
+	unsigned long long resv[2];
+};
+
+struct io_ring_params {
+	unsigned int sq_entries, cq_entries, flags;
+	unsigned int sq_thread_cpu, sq_thread_idle, resv[5];
+	struct io_sqring_offsets sq_off;
+	struct io_cqring_offsets cq_off;
+};
+
+#define IORING_OP_NOP		0
+#define IORING_OP_READV		1
+#define IORING_OFF_SQ_RING	0ULL
+#define IORING_OFF_CQ_RING	0x8000000ULL
+#define IORING_OFF_SQES		0x10000000ULL
+#define IORING_SQ_NEED_WAKEUP	(1U << 0)
+#define IORING_SETUP_SQPOLL	(1U << 0)
+#define IORING_ENTER_GETEVENTS	(1U << 0)
+#define IORING_ENTER_SQ_WAKEUP	(1U << 1)
+
+#define barrier()	__asm__ __volatile__("" ::: "memory")
+#define mb()		__sync_synchronize()
+
+#define BS		4096
+
+static int depth = 32, batch = 8, seconds = 5, sqpoll;
+static int fd = -1;
+static unsigned long long nr_blocks;
+static unsigned long long ops, syscalls;
+
+static struct {
+	int fd;
+	unsigned int *head, *tail, *mask, *flags, *array;
+	struct io_ring_sqe *sqes;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_ring_cqe *cqes;
+} ring;
+
+static struct iovec *iovs;
+
+static int stop;
+
+static int done(void)
+{
+	static struct timeval end;
+	static unsigned int calls;
+	struct timeval now;
+
+	if (!end.tv_sec) {
+		gettimeofday(&end, NULL);
+		end.tv_sec += seconds;
+	}
+	if ((++calls & 1023) == 0) {
+		gettimeofday(&now, NULL);
+		stop = now.tv_sec > end.tv_sec ||
+		       (now.tv_sec == end.tv_sec && now.tv_usec >= end.tv_usec);
+	}
+	return stop;
+}
+
+static unsigned long long random_offset(void)
+{
+	return ((unsigned long long) random() % nr_blocks) * BS;
+}
+
+static void run_sync(void)
+{
+	char *buf = malloc(BS);
+
+	while (!done()) {
+		if (pread(fd, buf, BS, random_offset()) < 0) {
+			perror("pread");
+			exit(1);
+		}
+		ops++;
+		syscalls++;
+	}
+}
+
+static void setup_ring(void)
+{
+	struct io_ring_params p;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	if (sqpoll)
+		p.flags = IORING_SETUP_SQPOLL;
+	ring.fd = syscall(__NR_io_ring_setup, depth, &p);
+	if (ring.fd < 0) {
+		perror("io_ring_setup");
+		exit(1);
+	}
+
+	sq = mmap(NULL, p.sq_off.array + p.sq_entries * 4,
+		  PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd,
+		  IORING_OFF_SQ_RING);
+	cq = mmap(NULL, p.cq_off.cqes + p.cq_entries * 16,
+		  PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd,
+		  IORING_OFF_CQ_RING);
+	ring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_ring_sqe),
+			 PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd,
+			 IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || ring.sqes == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	ring.head = sq + p.sq_off.head;
+	ring.tail = sq + p.sq_off.tail;
+	ring.mask = sq + p.sq_off.ring_mask;
+	ring.flags = sq + p.sq_off.flags;
+	ring.array = sq + p.sq_off.array;
+	ring.cq_head = cq + p.cq_off.head;
+	ring.cq_tail = cq + p.cq_off.tail;
+	ring.cq_mask = cq + p.cq_off.ring_mask;
+	ring.cqes = cq + p.cq_off.cqes;
+	depth = p.sq_entries;
+
+	iovs = calloc(depth, sizeof(*iovs));
+}
+
+/* queue one sqe in slot idx, which is free */
+static void queue(int idx, int op)
+{
+	struct io_ring_sqe *sqe = &ring.sqes[idx];
+	unsigned int tail = *ring.tail;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op;
+	sqe->user_data = idx;
+	if (op == IORING_OP_READV) {
+		if (!iovs[idx].iov_base) {
+			iovs[idx].iov_base = malloc(BS);
+			iovs[idx].iov_len = BS;
+		}
+		sqe->fd = fd;
+		sqe->off = random_offset();
+		sqe->addr = (unsigned long) &iovs[idx];
+		sqe->len = 1;
+	}
+	ring.array[tail & *ring.mask] = idx;
+	barrier();
+	*ring.tail = tail + 1;
+}
+
+/*
+ * With the sq thread, only wake it if it went to sleep, and reap the cq
+ * by polling it rather than waiting in the kernel
+ */
+static int enter(unsigned int to_submit, unsigned int min_complete)
+{
+	unsigned int flags = IORING_ENTER_GETEVENTS;
+	int ret;
+
+	if (sqpoll) {
+		mb();
+		if (!(*ring.flags & IORING_SQ_NEED_WAKEUP))
+			return to_submit;
+		flags = IORING_ENTER_SQ_WAKEUP;
+		min_complete = 0;
+	}
+	ret = syscall(__NR_io_ring_enter, ring.fd, to_submit, min_complete,
+		      flags);
+	syscalls++;
+	if (ret < 0 && errno != EBUSY && errno != EINTR) {
+		perror("io_ring_enter");
+		exit(1);
+	}
+	return ret;
+}
+
+static void run_ring(int op)
+{
+	int *free_slots = malloc(depth * sizeof(int));
+	int nr_free = depth, i;
+
+	for (i = 0; i < depth; i++)
+		free_slots[i] = i;
+
+	while (!done()) {
+		unsigned int head, tail;
+
+		while (nr_free)
+			queue(free_slots[--nr_free], op);
+		/* also whatever an EBUSY left behind */
+		enter(*ring.tail - *ring.head, batch < depth ? batch : depth);
+
+		head = *ring.cq_head;
+		tail = *ring.cq_tail;
+		barrier();
+		while (head != tail) {
+			struct io_ring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+
+			if (cqe->res < 0) {
+				fprintf(stderr, "op failed: %s\n",
+					strerror(-cqe->res));
+				exit(1);
+			}
+			free_slots[nr_free++] = cqe->user_data;
+			head++;
+			ops++;
+		}
+		barrier();
+		*ring.cq_head = head;
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: io_ring-bench [-d depth] [-b batch] "
+		"[-s seconds] [-q] sync|ring file | nop\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct timeval start, end;
+	double elapsed;
+	const char *mode;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:b:s:q")) != -1) {
+		switch (c) {
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'q':
+			sqpoll = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind >= argc || depth < 1 || batch < 1 || seconds < 1)
+		usage();
+	mode = argv[optind++];
+
+	if (strcmp(mode, "nop")) {
+		struct stat st;
+
+		if (optind >= argc)
+			usage();
+		fd = open(argv[optind], O_RDONLY);
+		if (fd < 0 || fstat(fd, &st)) {
+			perror(argv[optind]);
+			return 1;
+		}
+		nr_blocks = st.st_size / BS;
+		if (!nr_blocks) {
+			fprintf(stderr, "%s: smaller than %d bytes\n",
+				argv[optind], BS);
+			return 1;
+		}
+	}
+
+	gettimeofday(&start, NULL);
+	if (!strcmp(mode, "sync")) {
+		run_sync();
+	} else if (!strcmp(mode, "ring")) {
+		setup_ring();
+		run_ring(IORING_OP_READV);
+	} else if (!strcmp(mode, "nop")) {
+		setup_ring();
+		run_ring(IORING_OP_NOP);
+	} else
+		usage();
+	gettimeofday(&end, NULL);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_usec - start.tv_usec) / 1000000.0;
+	printf("%s: %.0f ops/s, %.0f syscalls/s, %.2f ops per syscall\n",
+	       mode, ops / elapsed, syscalls / elapsed,
+	       syscalls ? (double) ops / syscalls : 0.0);
+	return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * packet-tx-bench.c - packet socket transmit cost, sendto() against the tx ring
+ *
+ * Build:	gcc -O2 -Wall -o packet-tx-bench packet-tx-bench.c
+ *
+ *   packet-tx-bench [-i interface] [-n packets] [-s size] [-f frames]
+ *
+ *	-i	device to send on (default lo)
+ *	-n	frames to send (default 1000000)
+ *	-s	frame size in bytes, link level header included (default 1500)
+ *	-f	frames in the tx ring (default 256)
+ *
+ * Sends ethernet frames of an unused ethertype, first with one sendto()
+ * per frame, then from a PACKET_TX_RING of TPACKET_V2 frames with one
+ * send() per batch of frames filled in; see
+ * Documentation/networking/packet_mmap.txt.  Prints the time taken per
+ * frame both ways.  Frames longer than 256 bytes are sent from the ring
+ * without being copied when the device can do scatter/gather, as the
+ * loopback device can.  Must be run as root.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#define BENCH_ETH_P	0x88b5		/* IEEE local experimental */
+
+static long packets = 1000000;
+static int size = 1500;
+static int frames = 256;
+static const char *ifname = "lo";
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int open_socket(void)
+{
+	struct sockaddr_ll sll;
+	int fd;
+
+	fd = socket(PF_PACKET, SOCK_RAW, 0);
+	if (fd < 0)
+		die("packet socket");
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(BENCH_ETH_P);
+	sll.sll_ifindex = if_nametoindex(ifname);
+	if (!sll.sll_ifindex)
+		die(ifname);
+	if (bind(fd, (struct sockaddr *) &sll, sizeof(sll)))
+		die("bind");
+	return fd;
+}
+
+static void fill_frame(unsigned char *buf)
+{
+	struct ethhdr *eth = (struct ethhdr *) buf;
+
+	memset(buf, 0x5a, size);
+	memset(eth->h_dest, 0xff, ETH_ALEN);
+	memset(eth->h_source, 0, ETH_ALEN);
+	eth->h_proto = htons(BENCH_ETH_P);
+}
+
+/* seconds to send packets frames with sendto() */
+static double run_sendto(void)
+{
+	unsigned char buf[size];
+	double start;
+	long i;
+	int fd;
+
+	fd = open_socket();
+	fill_frame(buf);
+
+	start = now();
+	for (i = 0; i < packets; i++) {
+		if (send(fd, buf, size, 0) != size)
+			die("send");
+	}
+	start = now() - start;
+
+	close(fd);
+	return start;
+}
+
+/* seconds to send packets frames from a tx ring */
+static double run_ring(void)
+{
+	struct tpacket_req req;
+	struct pollfd pfd;
+	int version = TPACKET_V2;
+	unsigned int data_off, frame_size, i;
+	unsigned char *ring;
+	double start;
+	long queued, sent;
+	int fd;
+
+	fd = open_socket();
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version,
+		       sizeof(version)))
+		die("PACKET_VERSION");
+
+	/* frame data starts where the rx ring has its struct sockaddr_ll */
+	data_off = TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+	frame_size = TPACKET_ALIGN(data_off + size);
+
+	memset(&req, 0, sizeof(req));
+	req.tp_frame_size = frame_size;
+	req.tp_block_size = getpagesize();
+	while (req.tp_block_size < frame_size)
+		req.tp_block_size <<= 1;
+	req.tp_block_nr = (frames * frame_size + req.tp_block_size - 1) /
+			  req.tp_block_size;
+	req.tp_frame_nr = req.tp_block_nr * (req.tp_block_size / frame_size);
+	if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)))
+		die("PACKET_TX_RING");
+
+	ring = mmap(NULL, req.tp_block_size * req.tp_block_nr,
+		    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ring == MAP_FAILED)
+		die("mmap");
+
+#define FRAME(i)	(ring + ((i) / (req.tp_block_size / frame_size)) * \
+			 req.tp_block_size + \
+			 ((i) % (req.tp_block_size / frame_size)) * frame_size)
+
+	for (i = 0; i < req.tp_frame_nr; i++)
+		fill_frame(FRAME(i) + data_off);
+
+	pfd.fd = fd;
+	pfd.events = POLLOUT;
+
+	start = now();
+	i = 0;
+	for (queued = sent = 0; sent < packets; ) {
+		struct tpacket2_hdr *h = (struct tpacket2_hdr *) FRAME(i);
+
+		/* fill in up to half the ring, then have it all sent */
+		if (queued < packets && h->tp_status == TP_STATUS_AVAILABLE) {
+			h->tp_len = size;
+			__sync_synchronize();
+			h->tp_status = TP_STATUS_SEND_REQUEST;
+			queued++;
+			i = (i + 1) % req.tp_frame_nr;
+			if (queued - sent < req.tp_frame_nr / 2 &&
+			    queued < packets)
+				continue;
+		} else if (h->tp_status == TP_STATUS_WRONG_FORMAT) {
+			fprintf(stderr, "frame %u: wrong format\n", i);
+			exit(1);
+		}
+		if (queued > sent) {
+			if (send(fd, NULL, 0, 0) < 0)
+				die("send");
+			sent = queued;
+		} else if (poll(&pfd, 1, -1) < 0)
+			die("poll");
+	}
+	/* wait for the last frames to leave */
+	for (i = 0; i < req.tp_frame_nr; i++) {
+		while (((struct tpacket2_hdr *) FRAME(i))->tp_status !=
+		       TP_STATUS_AVAILABLE)
+			poll(&pfd, 1, 1);
+	}
+	start = now() - start;
+
+	munmap(ring, req.tp_block_size * req.tp_block_nr);
+	close(fd);
+	return start;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: packet-tx-bench [-i interface] [-n packets] "
+		"[-s size] [-f frames]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	double t;
+	int c;
+
+	while ((c = getopt(argc, argv, "i:n:s:f:")) != -1) {
+		switch (c) {
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'n':
+			packets = atol(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || packets < 1 || size < ETH_ZLEN || frames < 2)
+		usage();
+
+	printf("%ld frames of %d bytes on %s\n", packets, size, ifname);
+	t = run_sendto();
+	printf("sendto   %8.1f ns/frame\n", t * 1e9 / packets);
+	t = run_ring();
+	printf("tx ring  %8.1f ns/frame\n", t * 1e9 / packets);
+	return 0;
+}
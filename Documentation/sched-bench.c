@@ -0,0 +1,294 @@
+/*
+ * sched-bench.c - wakeup latency, fairness and throughput of the CPU
+ *		   scheduler, for comparing the scheduling classes
+ *
+ * Build:	gcc -O2 -Wall -o sched-bench sched-bench.c -lm
+ *
+ * Run the same command line once on a kernel booted normally and once
+ * on one booted with "sched=fair" (see Documentation/sched-design-CFS.txt).
+ *
+ *   sched-bench latency [hogs] [seconds]
+ *	Starts [hogs] CPU-bound processes (default: 2 per CPU) and measures
+ *	how late a task sleeping for 1ms at a time gets back on the CPU
+ *	(this includes the timer granularity, which is the same for both).
+ *
+ *   sched-bench fair [hogs] [seconds]
+ *	Runs [hogs] CPU-bound processes, half of them at nice 0 and half at
+ *	nice 5 if [hogs] is negative, and reports how evenly the CPU time
+ *	was distributed among the processes of each nice level.
+ *
+ *   sched-bench hackbench [groups] [loops]
+ *	hackbench-style messaging load: each group has 20 senders and 20
+ *	receivers talking over socketpairs; reports the time taken.
+ *
+ * Each result is printed on a line of its own, so that runs can be
+ * collected and compared with a simple script.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#define MAX_SAMPLES	100000
+#define GROUP_SIZE	20
+#define DATA_SIZE	100
+
+static volatile int stop;
+
+static unsigned long long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void on_alarm(int sig)
+{
+	stop = 1;
+}
+
+static int nr_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n > 0 ? n : 1;
+}
+
+/*
+ * Spin until told to stop, counting loops in *count.
+ */
+static void hog(volatile unsigned long *count, int nice_level)
+{
+	if (nice_level)
+		setpriority(PRIO_PROCESS, 0, nice_level);
+	while (!stop)
+		(*count)++;
+	exit(0);
+}
+
+static pid_t start_hog(volatile unsigned long *count, int nice_level,
+		       int seconds)
+{
+	pid_t pid = fork();
+
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (!pid) {
+		signal(SIGALRM, on_alarm);
+		alarm(seconds);
+		hog(count, nice_level);
+	}
+	return pid;
+}
+
+static void reap(int n)
+{
+	while (n-- > 0)
+		wait(NULL);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int bench_latency(int hogs, int seconds)
+{
+	static unsigned long long lat[MAX_SAMPLES];
+	struct timespec ts = { 0, 1000000 };
+	unsigned long long t0, t1, sum = 0;
+	volatile unsigned long *counts;
+	int i, n = 0;
+
+	counts = mmap(NULL, sizeof(long) * hogs, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (counts == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	for (i = 0; i < hogs; i++)
+		start_hog(&counts[i], 0, seconds);
+
+	signal(SIGALRM, on_alarm);
+	alarm(seconds);
+	while (!stop && n < MAX_SAMPLES) {
+		t0 = now_us();
+		nanosleep(&ts, NULL);
+		t1 = now_us();
+		/* only count the time beyond the 1ms asked for */
+		lat[n++] = t1 - t0 > 1000 ? t1 - t0 - 1000 : 0;
+	}
+	reap(hogs);
+
+	qsort(lat, n, sizeof(lat[0]), cmp_ull);
+	for (i = 0; i < n; i++)
+		sum += lat[i];
+	printf("latency: hogs %d samples %d min %llu avg %llu "
+	       "p99 %llu max %llu (us)\n", hogs, n, lat[0], sum / n,
+	       lat[n * 99 / 100], lat[n - 1]);
+	return 0;
+}
+
+static void spread(const char *what, volatile unsigned long *c, int n)
+{
+	double sum = 0, sq = 0, mean, dev;
+	unsigned long min = ~0UL, max = 0;
+	int i;
+
+	if (!n)
+		return;
+	for (i = 0; i < n; i++) {
+		sum += c[i];
+		sq += (double)c[i] * c[i];
+		if (c[i] < min)
+			min = c[i];
+		if (c[i] > max)
+			max = c[i];
+	}
+	mean = sum / n;
+	dev = sqrt(sq / n - mean * mean);
+	printf("fair: %s tasks %d mean %.0f min %lu max %lu "
+	       "stddev %.2f%%\n", what, n, mean, min, max,
+	       mean ? 100.0 * dev / mean : 0.0);
+}
+
+static int bench_fair(int hogs, int seconds)
+{
+	volatile unsigned long *counts;
+	int mixed = hogs < 0, i, low;
+
+	if (mixed)
+		hogs = -hogs;
+	low = mixed ? hogs / 2 : hogs;
+
+	counts = mmap(NULL, sizeof(long) * hogs, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (counts == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	for (i = 0; i < hogs; i++)
+		start_hog(&counts[i], i < low ? 0 : 5, seconds);
+	reap(hogs);
+
+	spread("nice0", counts, low);
+	if (mixed) {
+		double l = 0, h = 0;
+
+		spread("nice5", counts + low, hogs - low);
+		for (i = 0; i < low; i++)
+			l += counts[i];
+		for (i = low; i < hogs; i++)
+			h += counts[i];
+		printf("fair: nice0/nice5 cpu ratio %.2f\n",
+		       h ? (l / low) / (h / (hogs - low)) : 0.0);
+	}
+	return 0;
+}
+
+static void sender(int *fds, int loops)
+{
+	char data[DATA_SIZE];
+	int i, j;
+
+	memset(data, 0, sizeof(data));
+	for (i = 0; i < loops; i++)
+		for (j = 0; j < GROUP_SIZE; j++)
+			if (write(fds[j], data, sizeof(data)) != sizeof(data)) {
+				perror("write");
+				exit(1);
+			}
+	exit(0);
+}
+
+static void receiver(int fd, int total)
+{
+	char data[DATA_SIZE];
+	int got;
+
+	while (total > 0) {
+		got = read(fd, data, sizeof(data));
+		if (got <= 0) {
+			perror("read");
+			exit(1);
+		}
+		total -= got;
+	}
+	exit(0);
+}
+
+static int bench_hackbench(int groups, int loops)
+{
+	unsigned long long t0, t1;
+	int g, i, fds[GROUP_SIZE], sv[2];
+
+	t0 = now_us();
+	for (g = 0; g < groups; g++) {
+		for (i = 0; i < GROUP_SIZE; i++) {
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+				perror("socketpair");
+				return 1;
+			}
+			if (!fork()) {
+				close(sv[1]);
+				receiver(sv[0], GROUP_SIZE * loops * DATA_SIZE);
+			}
+			close(sv[0]);
+			fds[i] = sv[1];
+		}
+		for (i = 0; i < GROUP_SIZE; i++)
+			if (!fork())
+				sender(fds, loops);
+		for (i = 0; i < GROUP_SIZE; i++)
+			close(fds[i]);
+	}
+	reap(groups * GROUP_SIZE * 2);
+	t1 = now_us();
+
+	printf("hackbench: groups %d loops %d time %.3f s\n", groups, loops,
+	       (t1 - t0) / 1000000.0);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int a1, a2;
+
+	if (argc < 2)
+		goto usage;
+
+	if (!strcmp(argv[1], "latency")) {
+		a1 = argc > 2 ? atoi(argv[2]) : 2 * nr_cpus();
+		a2 = argc > 3 ? atoi(argv[3]) : 10;
+		return bench_latency(a1, a2);
+	}
+	if (!strcmp(argv[1], "fair")) {
+		a1 = argc > 2 ? atoi(argv[2]) : 2 * nr_cpus();
+		a2 = argc > 3 ? atoi(argv[3]) : 10;
+		return bench_fair(a1, a2);
+	}
+	if (!strcmp(argv[1], "hackbench")) {
+		a1 = argc > 2 ? atoi(argv[2]) : 10;
+		a2 = argc > 3 ? atoi(argv[3]) : 100;
+		return bench_hackbench(a1, a2);
+	}
+usage:
+	fprintf(stderr, "usage: %s latency|fair|hackbench [n] [secs|loops]\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,185 @@
+/*
+ * slab-bench.c - kmalloc()/kfree() cost seen from user space, freeing on
+ *		  the allocating CPU and on another one
+ *
+ * Build:	gcc -O2 -Wall -o slab-bench slab-bench.c
+ *
+ *   slab-bench [-n messages] [-a cpu] [-b cpu]
+ *
+ *	-n	messages per size and run (default 1000000)
+ *	-a	CPU that allocates (default 0)
+ *	-b	CPU that frees in the cross CPU run (default 1)
+ *
+ * Every datagram sent on an AF_UNIX socket is an skb: its head comes
+ * from kmalloc() at the size of the message plus the skb overhead, the
+ * struct sk_buff from the skbuff_head_cache, and both are freed by the
+ * receiver.  The sizes used, from 32 to 4000 bytes, each go through a
+ * different kmalloc cache.
+ *
+ *   ping-pong	one process on cpu a sends a datagram to itself and
+ *		receives it: the objects are freed right after being
+ *		allocated, on the same CPU
+ *   cross	a process on cpu a sends, one on cpu b receives, with up
+ *		to net.unix.max_dgram_qlen datagrams in flight: every
+ *		object is freed on a CPU other than the one it came from
+ *
+ * Prints the time per message.  Run it on kernels built with
+ * CONFIG_SLAB and with CONFIG_SLUB to compare the two allocators.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static long messages = 1000000;
+static int cpu_a = 0, cpu_b = 1;
+
+static const int sizes[] = { 32, 200, 900, 4000 };
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void bind_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		die("sched_setaffinity");
+}
+
+static void socket_pair(int sv[2])
+{
+	int bufsize = 4 << 20;
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv))
+		die("socketpair");
+	/* the socket buffers shouldn't be what limits the cross run */
+	setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+	setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+}
+
+/* seconds for messages allocations freed on the same cpu */
+static double run_pingpong(int size)
+{
+	char buf[size];
+	double start;
+	int sv[2];
+	long i;
+
+	socket_pair(sv);
+	memset(buf, 0, size);
+	bind_cpu(cpu_a);
+
+	start = now();
+	for (i = 0; i < messages; i++) {
+		if (send(sv[0], buf, size, 0) != size)
+			die("send");
+		if (recv(sv[1], buf, size, 0) != size)
+			die("recv");
+	}
+	start = now() - start;
+
+	close(sv[0]);
+	close(sv[1]);
+	return start;
+}
+
+/* seconds for messages allocations freed on another cpu */
+static double run_cross(int size)
+{
+	char buf[size];
+	double start;
+	int sv[2], status;
+	long i;
+	pid_t pid;
+
+	socket_pair(sv);
+	memset(buf, 0, size);
+
+	start = now();
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (!pid) {
+		bind_cpu(cpu_b);
+		close(sv[0]);
+		for (i = 0; i < messages; i++)
+			if (recv(sv[1], buf, size, 0) != size)
+				die("recv");
+		_exit(0);
+	}
+	bind_cpu(cpu_a);
+	close(sv[1]);
+	for (i = 0; i < messages; i++)
+		if (send(sv[0], buf, size, 0) != size)
+			die("send");
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid");
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		exit(1);
+	start = now() - start;
+
+	close(sv[0]);
+	return start;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: slab-bench [-n messages] [-a cpu] [-b cpu]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	double t;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "n:a:b:")) != -1) {
+		switch (c) {
+		case 'n':
+			messages = atol(optarg);
+			break;
+		case 'a':
+			cpu_a = atoi(optarg);
+			break;
+		case 'b':
+			cpu_b = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || messages < 1 || cpu_a < 0 || cpu_b < 0)
+		usage();
+
+	printf("%ld messages, allocating on cpu %d, cross frees on cpu %d\n",
+	       messages, cpu_a, cpu_b);
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		t = run_pingpong(sizes[i]);
+		printf("%4d bytes  ping-pong %8.1f ns/msg", sizes[i],
+		       t * 1e9 / messages);
+		fflush(stdout);
+		t = run_cross(sizes[i]);
+		printf("   cross %8.1f ns/msg\n", t * 1e9 / messages);
+	}
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * splice-bench.c - file to socket throughput: read/write, sendfile, splice
+ *
+ * Build:	gcc -O2 -Wall -o splice-bench splice-bench.c
+ *
+ *   splice-bench [-s seconds] [-b bufsize] copy|sendfile|splice file
+ *
+ *	copy		read() into a buffer, write() to the socket
+ *	sendfile	sendfile() from the file to the socket
+ *	splice		splice() from the file into a pipe and from the pipe
+ *			to the socket
+ *
+ *	-s	how long to run (default 5)
+ *	-b	bytes per read() or splice() (default 65536)
+ *
+ * The file is sent over and over to a child process that drains a TCP
+ * connection on the loopback device.  Read the file once beforehand
+ * (cat file > /dev/null) so it is in the page cache; see
+ * Documentation/splice.txt.  Prints MB/s and the cpu time used by the
+ * sender.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+/* from include/asm-i386/unistd.h and include/linux/pipe_fs_i.h */
+#ifndef __NR_splice
+#define __NR_splice		312
+#endif
+#ifndef SPLICE_F_MORE
+#define SPLICE_F_MORE		0x04
+#endif
+
+static int seconds = 5, bufsize = 65536;
+static off_t file_size;
+static volatile int stop;
+
+static void alarm_handler(int sig)
+{
+	stop = 1;
+}
+
+static long do_splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out,
+		      size_t len, unsigned int flags)
+{
+	return syscall(__NR_splice, fd_in, off_in, fd_out, off_out, len, flags);
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* connect a TCP socket to a child that reads and discards everything */
+static int setup_sink(void)
+{
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	int lfd, fd, one = 1;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		die("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) ||
+	    listen(lfd, 1) ||
+	    getsockname(lfd, (struct sockaddr *) &addr, &alen))
+		die("listen");
+
+	if (!fork()) {
+		char *buf = malloc(1 << 20);
+		int cfd = accept(lfd, NULL, NULL);
+
+		if (cfd < 0)
+			die("accept");
+		while (read(cfd, buf, 1 << 20) > 0)
+			;
+		exit(0);
+	}
+	close(lfd);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+		die("connect");
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+/* each returns the number of bytes sent, one pass over the file */
+static long long send_copy(int fd, int sock)
+{
+	static char *buf;
+	long long total = 0;
+	ssize_t n, m, done;
+
+	if (!buf)
+		buf = malloc(bufsize);
+	lseek(fd, 0, SEEK_SET);
+	while (!stop && (n = read(fd, buf, bufsize)) > 0) {
+		for (done = 0; done < n; done += m) {
+			m = write(sock, buf + done, n - done);
+			if (m <= 0)
+				die("write");
+		}
+		total += n;
+	}
+	return total;
+}
+
+static long long send_sendfile(int fd, int sock)
+{
+	long long total = 0;
+	off_t off = 0;
+	ssize_t n;
+
+	while (!stop && off < file_size) {
+		n = sendfile(sock, fd, &off, file_size - off);
+		if (n <= 0)
+			die("sendfile");
+		total += n;
+	}
+	return total;
+}
+
+static long long send_splice(int fd, int sock)
+{
+	static int p[2] = { -1, -1 };
+	long long total = 0;
+	loff_t off = 0;
+	long n, m;
+
+	if (p[0] < 0 && pipe(p))
+		die("pipe");
+	while (!stop && off < file_size) {
+		n = do_splice(fd, &off, p[1], NULL, bufsize, SPLICE_F_MORE);
+		if (n <= 0)
+			die("splice from file");
+		while (n > 0) {
+			m = do_splice(p[0], NULL, sock, NULL, n, SPLICE_F_MORE);
+			if (m <= 0)
+				die("splice to socket");
+			n -= m;
+			total += m;
+		}
+	}
+	return total;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: splice-bench [-s seconds] [-b bufsize] "
+		"copy|sendfile|splice file\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	long long (*fn)(int, int);
+	long long total = 0;
+	struct timeval start, end;
+	struct rusage ru;
+	struct stat st;
+	double elapsed, cpu;
+	const char *mode;
+	int fd, sock, c;
+
+	while ((c = getopt(argc, argv, "s:b:")) != -1) {
+		switch (c) {
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			bufsize = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 2 || seconds < 1 || bufsize < 1)
+		usage();
+	mode = argv[optind];
+	if (!strcmp(mode, "copy"))
+		fn = send_copy;
+	else if (!strcmp(mode, "sendfile"))
+		fn = send_sendfile;
+	else if (!strcmp(mode, "splice"))
+		fn = send_splice;
+	else
+		usage();
+
+	fd = open(argv[optind + 1], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st))
+		die(argv[optind + 1]);
+	file_size = st.st_size;
+	if (!file_size) {
+		fprintf(stderr, "%s: empty\n", argv[optind + 1]);
+		return 1;
+	}
+
+	sock = setup_sink();
+	signal(SIGALRM, alarm_handler);
+	alarm(seconds);
+
+	gettimeofday(&start, NULL);
+	while (!stop)
+		total += fn(fd, sock);
+	gettimeofday(&end, NULL);
+
+	close(sock);
+	wait(NULL);
+
+	getrusage(RUSAGE_SELF, &ru);
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_usec - start.tv_usec) / 1000000.0;
+	cpu = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+	      (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000.0;
+	printf("%s: %.1f MB/s, sender cpu %.0f%%\n", mode,
+	       total / elapsed / (1024 * 1024), 100.0 * cpu / elapsed);
+	return 0;
+}
@@ -27,6 +27,7 @@
 #include <linux/sysdev.h>
 #include <linux/cpu.h>
 #include <linux/module.h>
+#include <linux/clockchips.h>
 
 #include <asm/atomic.h>
 #include <asm/smp.h>
@@ -36,6 +37,7 @@
 #include <asm/arch_hooks.h>
 #include <asm/hpet.h>
 #include <asm/i8253.h>
+#include <asm/timer.h>
 
 #include <mach_apic.h>
 #include <mach_ipi.h>
@@ -1059,6 +1061,67 @@ static int __init calibrate_APIC_clock(void)
 
 static unsigned int calibration_result;
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+/*
+ * The local APIC timer is the clock event device of its cpu: it
+ * delivers the tick in periodic mode, and is programmed for the next
+ * hrtimer event in oneshot mode (see kernel/hrtimer.c).
+ */
+static DEFINE_PER_CPU(struct clock_event_device, lapic_events);
+
+static void lapic_timer_setup(enum clock_event_mode mode,
+			      struct clock_event_device *evt)
+{
+	unsigned long flags, v;
+
+	local_irq_save(flags);
+	switch (mode) {
+	case CLOCK_EVT_MODE_PERIODIC:
+		__setup_APIC_LVTT(calibration_result);
+		break;
+	case CLOCK_EVT_MODE_ONESHOT:
+		v = apic_read(APIC_LVTT);
+		apic_write_around(APIC_LVTT, v & ~APIC_LVT_TIMER_PERIODIC);
+		apic_write_around(APIC_TMICT, 0);
+		break;
+	case CLOCK_EVT_MODE_UNUSED:
+	case CLOCK_EVT_MODE_SHUTDOWN:
+		v = apic_read(APIC_LVTT);
+		apic_write_around(APIC_LVTT, v | APIC_LVT_MASKED);
+		break;
+	}
+	local_irq_restore(flags);
+}
+
+static int lapic_next_event(unsigned long delta,
+			    struct clock_event_device *evt)
+{
+	apic_write_around(APIC_TMICT, delta);
+	return 0;
+}
+
+static void __devinit setup_APIC_clockevent(void)
+{
+	struct clock_event_device *evt = &__get_cpu_var(lapic_events);
+
+	evt->name = "lapic";
+	evt->features = CLOCK_EVT_FEAT_PERIODIC | CLOCK_EVT_FEAT_ONESHOT;
+	evt->rating = 100;
+	evt->shift = 32;
+	evt->mult = div_sc(calibration_result / APIC_DIVISOR, TICK_NSEC,
+			   evt->shift);
+	evt->max_delta_ns = clockevent_delta2ns(0x7FFFFFFF, evt);
+	evt->min_delta_ns = clockevent_delta2ns(0xF, evt);
+	evt->set_next_event = lapic_next_event;
+	evt->set_mode = lapic_timer_setup;
+	evt->event_handler = smp_local_timer_interrupt;
+	evt->mode = CLOCK_EVT_MODE_PERIODIC;
+	clockevents_register_device(evt);
+}
+#else
+static inline void setup_APIC_clockevent(void) { }
+#endif
+
 void __init setup_boot_APIC_clock(void)
 {
 	unsigned long flags;
@@ -1068,6 +1131,7 @@ void __init setup_boot_APIC_clock(void)
 	local_irq_save(flags);
 
 	calibration_result = calibrate_APIC_clock();
+	setup_APIC_clockevent();
 	/*
 	 * Now set up the timer for real.
 	 */
@@ -1078,6 +1142,7 @@ void __init setup_boot_APIC_clock(void)
 
 void __devinit setup_secondary_APIC_clock(void)
 {
+	setup_APIC_clockevent();
 	setup_APIC_timer(calibration_result);
 }
 
@@ -1130,6 +1195,22 @@ void switch_ipi_to_APIC_timer(void *cpumask)
 }
 EXPORT_SYMBOL(switch_ipi_to_APIC_timer);
 
+/*
+ * Let the local APIC timer interrupt come every @ticks jiffies instead
+ * of every jiffy, while the tick is stopped on an idle cpu. Writing the
+ * initial count restarts the count down. Returns the number of ticks
+ * programmed.
+ */
+unsigned int reprogram_APIC_timer(unsigned int ticks)
+{
+	unsigned int clocks = calibration_result / APIC_DIVISOR;
+
+	if (ticks > 0xffffffffU / clocks)
+		ticks = 0xffffffffU / clocks;
+	apic_write_around(APIC_TMICT, clocks * ticks);
+	return ticks;
+}
+
 #undef APIC_DIVISOR
 
 /*
@@ -1190,7 +1271,12 @@ fastcall void smp_apic_timer_interrupt(struct pt_regs *regs)
 	 * interrupt lock, which is the WrongThing (tm) to do.
 	 */
 	irq_enter();
+	start_hz_timer(regs, -1);
+#ifdef CONFIG_HIGH_RES_TIMERS
+	__get_cpu_var(lapic_events).event_handler(regs);
+#else
 	smp_local_timer_interrupt(regs);
+#endif
 	irq_exit();
 }
 
@@ -57,6 +57,7 @@
 
 #include <asm/tlbflush.h>
 #include <asm/cpu.h>
+#include <asm/timer.h>
 
 asmlinkage void ret_from_fork(void) __asm__("ret_from_fork");
 
@@ -107,9 +108,10 @@ void default_idle(void)
 		smp_mb__after_clear_bit();
 		while (!need_resched()) {
 			local_irq_disable();
-			if (!need_resched())
+			if (!need_resched()) {
+				stop_hz_timer();
 				safe_halt();
-			else
+			} else
 				local_irq_enable();
 		}
 		set_thread_flag(TIF_POLLING_NRFLAG);
@@ -195,8 +197,18 @@ void cpu_idle(void)
 				play_dead();
 
 			__get_cpu_var(irq_stat).idle_timestamp = jiffies;
+#ifdef CONFIG_NO_IDLE_HZ
+			local_irq_disable();
+			stop_hz_timer();
+			local_irq_enable();
+#endif
 			idle();
 		}
+#ifdef CONFIG_NO_IDLE_HZ
+		local_irq_disable();
+		start_hz_timer(NULL, -1);
+		local_irq_enable();
+#endif
 		preempt_enable_no_resched();
 		schedule();
 		preempt_disable();
@@ -243,6 +255,11 @@ static void mwait_idle(void)
 	local_irq_enable();
 
 	while (!need_resched()) {
+#ifdef CONFIG_NO_IDLE_HZ
+		local_irq_disable();
+		stop_hz_timer();
+		local_irq_enable();
+#endif
 		__monitor((void *)&current_thread_info()->flags, 0, 0);
 		smp_mb();
 		if (need_resched())
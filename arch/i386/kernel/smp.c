@@ -23,6 +23,7 @@
 
 #include <asm/mtrr.h>
 #include <asm/tlbflush.h>
+#include <asm/timer.h>
 #include <mach_apic.h>
 
 /*
@@ -314,6 +315,7 @@ fastcall void smp_invalidate_interrupt(struct pt_regs *regs)
 	unsigned long cpu;
 
 	cpu = get_cpu();
+	start_hz_timer(regs, -1);
 
 	if (!cpu_isset(cpu, flush_cpumask))
 		goto out;
@@ -600,6 +602,7 @@ void smp_send_stop(void)
 fastcall void smp_reschedule_interrupt(struct pt_regs *regs)
 {
 	ack_APIC_irq();
+	start_hz_timer(regs, -1);
 }
 
 fastcall void smp_call_function_interrupt(struct pt_regs *regs)
@@ -619,6 +622,7 @@ fastcall void smp_call_function_interrupt(struct pt_regs *regs)
 	 * At this point the info structure may be out of scope unless wait==1
 	 */
 	irq_enter();
+	start_hz_timer(regs, -1);
 	(*func)(info);
 	irq_exit();
 
@@ -46,6 +46,8 @@
 #include <linux/bcd.h>
 #include <linux/efi.h>
 #include <linux/mca.h>
+#include <linux/rcupdate.h>
+#include <linux/kernel_stat.h>
 
 #include <asm/io.h>
 #include <asm/smp.h>
@@ -241,6 +243,248 @@ unsigned long profile_pc(struct pt_regs *regs)
 EXPORT_SYMBOL(profile_pc);
 #endif
 
+#ifdef CONFIG_NO_IDLE_HZ
+/*
+ * Dynamic tick: stop the HZ timer while a cpu is idle.
+ *
+ * A cpu going idle marks itself in nohz_cpu_mask and programs its
+ * local APIC timer for its next timer event, as found by
+ * next_timer_interrupt(). Once the last cpu goes idle the PIT, which
+ * drives jiffies, is switched to a single count that ends on a tick
+ * boundary at the first event of all cpus (at most 0xffff PIT clocks,
+ * about 55ms). The first interrupt on an idle cpu restarts the tick:
+ * the PIT goes back to rate generator mode in phase with the old tick
+ * boundaries, and if no timer interrupt is due the tick is run right
+ * away, so that the lost tick compensation of the time source brings
+ * jiffies up to date before any handler looks at them.
+ *
+ * This needs a time source that compensates for lost ticks (TSC, PM
+ * timer, cyclone), so it is not done with the PIT or HPET as time
+ * source. /proc/sys/kernel/hz_timer = 1 keeps the tick running.
+ */
+int sysctl_hz_timer = 0;
+
+static DEFINE_SPINLOCK(dyntick_lock);
+static DEFINE_PER_CPU(unsigned long, dyntick_next);
+
+static int pit_stretched;		/* PIT in one-shot mode */
+static int pit_reload_latch;		/* PIT counts a partial tick */
+static unsigned int pit_count;		/* one-shot count programmed ... */
+static unsigned int pit_first;		/* ... of which up to the next tick */
+static unsigned long pit_length;	/* length of the count in usecs */
+static unsigned long long pit_stamp;	/* monotonic_clock() at that time */
+
+/* treat a one-shot count as expired this many usecs before its end */
+#define PIT_EXPIRY_MARGIN	50
+
+static int dyntick_started;
+
+static int __init start_dyntick(void)
+{
+	dyntick_started = 1;
+	return 0;
+}
+late_initcall(start_dyntick);
+
+static inline int dyntick_usable(void)
+{
+	if (sysctl_hz_timer || !dyntick_started)
+		return 0;
+	if (cur_timer == &timer_pit || cur_timer == &timer_none)
+		return 0;
+#ifdef CONFIG_HPET_TIMER
+	if (is_hpet_enabled())
+		return 0;
+#endif
+#ifdef CONFIG_SMP
+	/* the other cpus get their ticks from the PIT otherwise */
+	if (!using_apic_timer)
+		return 0;
+#endif
+	return 1;
+}
+
+/* called with i8253_lock held */
+static unsigned int pit_read_count(void)
+{
+	unsigned int count;
+
+	outb_p(0x00, PIT_MODE);		/* latch the count */
+	count = inb_p(PIT_CH0);
+	count |= inb_p(PIT_CH0) << 8;
+	return count;
+}
+
+/* called with i8253_lock held */
+static void pit_write_count(unsigned int mode, unsigned int count)
+{
+	outb_p(mode, PIT_MODE);
+	outb_p(count & 0xff, PIT_CH0);
+	outb(count >> 8, PIT_CH0);
+}
+
+/*
+ * Let the PIT skip the next @ticks - 1 ticks: one-shot mode (mode 0),
+ * counting down to the tick boundary @ticks ticks from now.
+ * Called with dyntick_lock held.
+ */
+static void pit_stretch(unsigned long ticks)
+{
+	unsigned int first, count;
+
+	spin_lock(&i8253_lock);
+	first = pit_read_count();
+	if (!first || first > LATCH) {
+		spin_unlock(&i8253_lock);
+		return;
+	}
+	if (ticks > (0xffff - first) / LATCH + 1)
+		ticks = (0xffff - first) / LATCH + 1;
+	if (ticks < 2) {
+		spin_unlock(&i8253_lock);
+		return;
+	}
+	count = first + (ticks - 1) * LATCH;
+	pit_write_count(0x30, count);
+	pit_reload_latch = 0;
+	spin_unlock(&i8253_lock);
+
+	pit_stamp = cur_timer->monotonic_clock();
+	pit_count = count;
+	pit_first = first;
+	pit_length = count * 1000 / (CLOCK_TICK_RATE / 1000);
+	pit_stretched = 1;
+}
+
+/*
+ * Put the PIT back into rate generator mode, counting down to the next
+ * boundary of the ticks it skipped; the timer interrupt reloads the full
+ * LATCH. Returns 1 if the one-shot count has not expired yet, that is
+ * no timer interrupt is pending. Called with dyntick_lock held.
+ */
+static int pit_restore(int irq)
+{
+	unsigned int count, elapsed, left;
+	unsigned long long now;
+	int expired;
+
+	now = cur_timer->monotonic_clock();
+	expired = irq == 0 || now - pit_stamp >=
+		(unsigned long long)(pit_length - PIT_EXPIRY_MARGIN) * 1000;
+
+	spin_lock(&i8253_lock);
+	count = pit_read_count();
+	if (!expired && count > pit_count)
+		expired = 1;
+	if (expired)
+		elapsed = pit_count + ((0x10000 - count) & 0xffff);
+	else
+		elapsed = pit_count - count;
+	if (elapsed < pit_first)
+		left = pit_first - elapsed;
+	else
+		left = LATCH - (elapsed - pit_first) % LATCH;
+	pit_write_count(0x34, left);
+	pit_reload_latch = 1;
+	spin_unlock(&i8253_lock);
+
+	pit_stretched = 0;
+	return !expired;
+}
+
+/* called from the timer interrupt with xtime_lock held */
+static void pit_reload(void)
+{
+	spin_lock(&i8253_lock);
+	if (pit_reload_latch) {
+		pit_write_count(0x34, LATCH);
+		pit_reload_latch = 0;
+	}
+	spin_unlock(&i8253_lock);
+}
+
+/*
+ * Stop the HZ tick on the current CPU until its next timer event.
+ * Only the idle loop may call this function, with interrupts disabled.
+ */
+void stop_hz_timer(void)
+{
+	int cpu = smp_processor_id();
+	struct dyntick_stat *ds = &per_cpu(dyntick_stats, cpu);
+	unsigned long next, ticks;
+	int i;
+
+	if (cpu_isset(cpu, nohz_cpu_mask) || !dyntick_usable())
+		return;
+
+	ds->idle_calls++;
+	if (need_resched() || rcu_pending(cpu) || local_softirq_pending())
+		return;
+	next = next_timer_interrupt();
+	ticks = next - jiffies;
+	if ((long)ticks < 2)
+		return;
+
+	spin_lock(&dyntick_lock);
+	cpu_set(cpu, nohz_cpu_mask);
+	per_cpu(dyntick_next, cpu) = next;
+	ds->stop_jiffies = jiffies;
+	ds->idle_sleeps++;
+#ifdef CONFIG_X86_LOCAL_APIC
+	if (!hrtimer_stop_sched_tick(ticks) && using_apic_timer)
+		reprogram_APIC_timer(ticks);
+#endif
+	if (cpus_equal(nohz_cpu_mask, cpu_online_map)) {
+		for_each_cpu_mask(i, nohz_cpu_mask)
+			if (time_before(per_cpu(dyntick_next, i), next))
+				next = per_cpu(dyntick_next, i);
+		pit_stretch(next - jiffies);
+	}
+	spin_unlock(&dyntick_lock);
+}
+
+/*
+ * Restart the HZ tick on the current CPU, from the interrupt that
+ * ended its idle sleep (@irq is -1 for anything but a device irq) or
+ * from the idle loop. Called with interrupts disabled.
+ */
+void start_hz_timer(struct pt_regs *regs, int irq)
+{
+	int cpu = smp_processor_id();
+	struct dyntick_stat *ds;
+	unsigned long skipped;
+	int run_tick = 0;
+
+	if (!cpu_isset(cpu, nohz_cpu_mask))
+		return;
+
+	spin_lock(&dyntick_lock);
+	cpu_clear(cpu, nohz_cpu_mask);
+	if (pit_stretched)
+		run_tick = pit_restore(irq);
+	spin_unlock(&dyntick_lock);
+#ifdef CONFIG_X86_LOCAL_APIC
+	if (!hrtimer_restart_sched_tick() && using_apic_timer)
+		reprogram_APIC_timer(1);
+#endif
+
+	if (run_tick) {
+		write_seqlock(&xtime_lock);
+		cur_timer->mark_offset();
+		do_timer(regs ? regs : task_pt_regs(current));
+		write_sequnlock(&xtime_lock);
+	}
+
+	/* the ticks this cpu did not get were idle time */
+	ds = &per_cpu(dyntick_stats, cpu);
+	skipped = jiffies - ds->stop_jiffies;
+	ds->ticks_skipped += skipped;
+	if (skipped > 1)
+		account_system_time(current, hardirq_count(),
+				    jiffies_to_cputime(skipped - 1));
+}
+#endif /* CONFIG_NO_IDLE_HZ */
+
 /*
  * timer_interrupt() needs to keep up the real-time clock,
  * as well as call the "do_timer()" routine every clocktick
@@ -297,6 +541,10 @@ irqreturn_t timer_interrupt(int irq, void *dev_id, struct pt_regs *regs)
 	 */
 	write_seqlock(&xtime_lock);
 
+#ifdef CONFIG_NO_IDLE_HZ
+	if (unlikely(pit_reload_latch))
+		pit_reload();
+#endif
 	cur_timer->mark_offset();
  
 	do_timer_interrupt(irq, regs);
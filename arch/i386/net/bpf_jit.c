@@ -0,0 +1,660 @@
+/*
+ * Just-in-time compiler for socket filters on i386 and x86_64
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * sk_attach_filter() hands every filter that passed sk_chk_filter() to
+ * bpf_jit_compile(), which turns it into a function with the prototype
+ * of sk_run_filter() and returning the same for every packet.  Filters
+ * that cannot be compiled are left to the interpreter.
+ *
+ * A lives in %eax and X in %ebx.  Filters that load packet data keep
+ * skb->data in %esi and the length of the linear part of the skb in %edi,
+ * so that loads from there are inline; loads from anywhere else call
+ * bpf_jit_load().  %ecx and %edx are scratch.  %ebp points at a frame
+ * holding the skb, the result of bpf_jit_load() and M[].
+ *
+ * The x86_64 code is the i386 code with a REX.W prefix on instructions
+ * dealing with pointers: A and X are 32 bit either way.
+ */
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/skbuff.h>
+#include <linux/filter.h>
+
+int bpf_jit_enable;
+
+struct bpf_jit_image {
+	struct work_struct	work;	/* frees the image */
+	u8			code[0];
+};
+
+#ifdef CONFIG_X86_64
+#define REX_W		0x48
+#define JIT_FRAME_SIZE	88	/* keeps %rsp 16 byte aligned for calls */
+#else
+#define REX_W		0
+#define JIT_FRAME_SIZE	72
+#endif
+
+/* The frame, below the saved %ebx, %esi and %edi */
+#define W		((int)sizeof(long))
+#define SKB_OFF		(-4 * W)
+#define RES_OFF		(SKB_OFF - 4)
+#define MEM_OFF(k)	(RES_OFF - 4 * (BPF_MEMWORDS - (int)(k)))
+
+/* lea -3W(%ebp),%esp; pop %edi; pop %esi; pop %ebx; pop %ebp; ret */
+#define EPILOGUE_LEN	((REX_W ? 1 : 0) + 8)
+/* xor %eax,%eax; jmp epilogue */
+#define RET0_LEN	4
+
+/* More than the code of any one filter instruction */
+#define BPF_MAX_INSN_SIZE	128
+#define BPF_JIT_PASSES		10
+
+enum {
+	X86_EAX, X86_ECX, X86_EDX, X86_EBX, X86_ESP, X86_EBP, X86_ESI, X86_EDI
+};
+
+/* Condition codes, as in jcc; cc ^ 1 is the opposite condition */
+#define X86_JB		0x2
+#define X86_JAE		0x3
+#define X86_JE		0x4
+#define X86_JNE		0x5
+#define X86_JBE		0x6
+#define X86_JA		0x7
+
+static inline u8 *emit_code(u8 *ptr, u32 bytes, unsigned int len)
+{
+	if (len == 1)
+		*ptr = bytes;
+	else if (len == 2)
+		*(u16 *)ptr = bytes;
+	else
+		*(u32 *)ptr = bytes;
+	return ptr + len;
+}
+
+#define EMIT(bytes, len) \
+	do { prog = emit_code(prog, bytes, len); } while (0)
+
+#define EMIT1(b1)		EMIT(b1, 1)
+#define EMIT2(b1, b2)		EMIT((b1) + ((b2) << 8), 2)
+#define EMIT3(b1, b2, b3)	EMIT((b1) + ((b2) << 8) + ((b3) << 16), 3)
+#define EMIT4(b1, b2, b3, b4) \
+	EMIT((b1) + ((b2) << 8) + ((b3) << 16) + ((b4) << 24), 4)
+#define EMIT1_off32(b1, off)	do { EMIT1(b1); EMIT(off, 4); } while (0)
+#define EMIT2_off32(b1, b2, off) do { EMIT2(b1, b2); EMIT(off, 4); } while (0)
+
+/* Prefix for instructions on pointers */
+#define EMIT_PTR()		do { if (REX_W) EMIT1(REX_W); } while (0)
+
+static inline int is_imm8(int value)
+{
+	return value <= 127 && value >= -128;
+}
+
+/* op reg,disp(base) or op disp(base),reg; base is never %esp */
+static u8 *emit_mem(u8 *prog, u8 op, int reg, int base, int disp)
+{
+	if (is_imm8(disp))
+		EMIT3(op, 0x40 | reg << 3 | base, (u8)disp);
+	else
+		EMIT2_off32(op, 0x80 | reg << 3 | base, disp);
+	return prog;
+}
+
+static u8 *emit_jmp(u8 *prog, int off)
+{
+	if (is_imm8(off))
+		EMIT2(0xeb, (u8)off);
+	else
+		EMIT1_off32(0xe9, off);
+	return prog;
+}
+
+static u8 *emit_jcc(u8 *prog, int cc, int off)
+{
+	if (is_imm8(off))
+		EMIT2(0x70 | cc, (u8)off);
+	else
+		EMIT2_off32(0x0f, 0x80 | cc, off);
+	return prog;
+}
+
+/* mov $imm,%reg */
+static u8 *emit_mov_imm(u8 *prog, int reg, u32 imm)
+{
+	if (imm == 0)
+		EMIT2(0x31, 0xc0 | reg << 3 | reg);	/* xor %reg,%reg */
+	else
+		EMIT1_off32(0xb8 | reg, imm);
+	return prog;
+}
+
+/*
+ * Call bpf_jit_load(skb, %edx, size, &res), preserving %ebx, %esi and
+ * %edi; the result is left in %eax.
+ */
+static u8 *emit_load_call(u8 *prog, unsigned int size)
+{
+	unsigned long func = (unsigned long)bpf_jit_load;
+
+#ifdef CONFIG_X86_64
+	EMIT2(0x56, 0x57);			/* push %rsi; push %rdi */
+	EMIT2(0x89, 0xd6);			/* mov %edx,%esi */
+	EMIT4(0x48, 0x8b, 0x7d, (u8)SKB_OFF);	/* mov SKB_OFF(%rbp),%rdi */
+	EMIT1_off32(0xba, size);		/* mov $size,%edx */
+	EMIT4(0x48, 0x8d, 0x4d, (u8)RES_OFF);	/* lea RES_OFF(%rbp),%rcx */
+	EMIT2(0x48, 0xb8);			/* mov $func,%rax */
+	EMIT((u32)func, 4);
+	EMIT((u32)(func >> 32), 4);
+	EMIT2(0xff, 0xd0);			/* call *%rax */
+	EMIT2(0x5f, 0x5e);			/* pop %rdi; pop %rsi */
+#else
+	/* bpf_jit_load() is asmlinkage: everything goes on the stack */
+	EMIT3(0x8d, 0x4d, (u8)RES_OFF);		/* lea RES_OFF(%ebp),%ecx */
+	/* push %ecx; push $size; push %edx */
+	EMIT4(0x51, 0x6a, size, 0x52);
+	EMIT3(0xff, 0x75, (u8)SKB_OFF);		/* push SKB_OFF(%ebp) */
+	EMIT1_off32(0xb8, func);		/* mov $func,%eax */
+	EMIT2(0xff, 0xd0);			/* call *%eax */
+	EMIT3(0x83, 0xc4, 16);			/* add $16,%esp */
+#endif
+	return prog;
+}
+
+/* Packet loads are the only instructions needing skb->data */
+static int bpf_jit_seen_data(struct sk_filter *fp)
+{
+	int i;
+
+	for (i = 0; i < fp->len; i++) {
+		switch (fp->insns[i].code) {
+		case BPF_LD|BPF_W|BPF_ABS:
+		case BPF_LD|BPF_H|BPF_ABS:
+		case BPF_LD|BPF_B|BPF_ABS:
+		case BPF_LD|BPF_W|BPF_IND:
+		case BPF_LD|BPF_H|BPF_IND:
+		case BPF_LD|BPF_B|BPF_IND:
+		case BPF_LDX|BPF_B|BPF_MSH:
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static u8 *emit_prologue(u8 *prog, int seen_data)
+{
+	EMIT1(0x55);				/* push %ebp */
+	EMIT_PTR(); EMIT2(0x89, 0xe5);		/* mov %esp,%ebp */
+	EMIT3(0x53, 0x56, 0x57);		/* push %ebx, %esi, %edi */
+	EMIT_PTR(); EMIT3(0x83, 0xec, JIT_FRAME_SIZE); /* sub $FRAME,%esp */
+
+	/* The skb goes to %edx, and from there to the frame */
+#ifdef CONFIG_X86_64
+	EMIT3(0x48, 0x89, 0xfa);		/* mov %rdi,%rdx */
+#elif defined(CONFIG_REGPARM)
+	EMIT2(0x89, 0xc2);			/* mov %eax,%edx */
+#else
+	EMIT3(0x8b, 0x55, 8);			/* mov 8(%ebp),%edx */
+#endif
+	EMIT_PTR(); EMIT3(0x89, 0x55, (u8)SKB_OFF); /* mov %edx,SKB_OFF(%ebp) */
+
+	if (seen_data) {
+		/* %edi = skb->len - skb->data_len; %esi = skb->data */
+		prog = emit_mem(prog, 0x8b, X86_EDI, X86_EDX,
+				offsetof(struct sk_buff, len));
+		prog = emit_mem(prog, 0x2b, X86_EDI, X86_EDX,
+				offsetof(struct sk_buff, data_len));
+		EMIT_PTR();
+		prog = emit_mem(prog, 0x8b, X86_ESI, X86_EDX,
+				offsetof(struct sk_buff, data));
+	}
+
+	/* A and X start out as 0, as in sk_run_filter() */
+	EMIT4(0x31, 0xc0, 0x31, 0xdb);		/* zero %eax and %ebx */
+	return prog;
+}
+
+/*
+ * One pass over the filter, emitting into image if it is not NULL.
+ *
+ * addrs[i] is where the code of instruction i ended in the last pass,
+ * and is used for jumps forward; the first pass starts from an
+ * overestimate.  Sets *changed if any instruction moved, and returns the
+ * length of the code, or 0 if the filter cannot be compiled.  Once
+ * nothing moves, addrs[] is exact.
+ */
+static unsigned int bpf_jit_pass(struct sk_filter *fp, u8 *image,
+				 unsigned int *addrs, int seen_data,
+				 int *changed)
+{
+	u8 temp[BPF_MAX_INSN_SIZE];
+	unsigned int proglen, start, epilogue, ret0;
+	u8 *prog, *slow, *slow2, *over;
+	int i, cc, size, off;
+
+	epilogue = addrs[fp->len - 1];
+	ret0 = epilogue + EPILOGUE_LEN;
+	*changed = 0;
+
+	prog = emit_prologue(temp, seen_data);
+	proglen = prog - temp;
+	if (image)
+		memcpy(image, temp, proglen);
+
+/* Offset of prog in the image */
+#define CUR_OFF()	(start + (prog - temp))
+/* Jump to ret0 from the middle of an instruction's code */
+#define EMIT_JCC_RET0(cc) do {					\
+	off = ret0 - (CUR_OFF() + 6);					\
+	EMIT2_off32(0x0f, 0x80 | (cc), off);				\
+} while (0)
+
+	for (i = 0; i < fp->len; i++) {
+		struct sock_filter *f = &fp->insns[i];
+		u32 K = f->k;
+
+		start = proglen;
+		prog = temp;
+
+		switch (f->code) {
+		case BPF_ALU|BPF_ADD|BPF_X:
+			EMIT2(0x01, 0xd8);		/* add %ebx,%eax */
+			break;
+		case BPF_ALU|BPF_SUB|BPF_X:
+			EMIT2(0x29, 0xd8);		/* sub %ebx,%eax */
+			break;
+		case BPF_ALU|BPF_AND|BPF_X:
+			EMIT2(0x21, 0xd8);		/* and %ebx,%eax */
+			break;
+		case BPF_ALU|BPF_OR|BPF_X:
+			EMIT2(0x09, 0xd8);		/* or %ebx,%eax */
+			break;
+		case BPF_ALU|BPF_ADD|BPF_K:
+		case BPF_ALU|BPF_SUB|BPF_K:
+		case BPF_ALU|BPF_AND|BPF_K:
+		case BPF_ALU|BPF_OR|BPF_K: {
+			/* the /digit of op $imm,%eax, and its short form */
+			static const u8 digit[] = {
+				[BPF_ADD >> 4] = 0, [BPF_SUB >> 4] = 5,
+				[BPF_AND >> 4] = 4, [BPF_OR >> 4] = 1,
+			};
+			int d = digit[BPF_OP(f->code) >> 4];
+
+			if (is_imm8(K))
+				EMIT3(0x83, 0xc0 | d << 3, (u8)K);
+			else
+				EMIT1_off32(0x05 | d << 3, K);
+			break;
+		}
+		case BPF_ALU|BPF_MUL|BPF_X:
+			EMIT3(0x0f, 0xaf, 0xc3);	/* imul %ebx,%eax */
+			break;
+		case BPF_ALU|BPF_MUL|BPF_K:
+			/* imul $K,%eax,%eax */
+			if (is_imm8(K))
+				EMIT3(0x6b, 0xc0, (u8)K);
+			else
+				EMIT2_off32(0x69, 0xc0, K);
+			break;
+		case BPF_ALU|BPF_DIV|BPF_X:
+			EMIT2(0x85, 0xdb);		/* test %ebx,%ebx */
+			EMIT_JCC_RET0(X86_JE);
+			EMIT2(0x31, 0xd2);		/* xor %edx,%edx */
+			EMIT2(0xf7, 0xf3);		/* div %ebx */
+			break;
+		case BPF_ALU|BPF_DIV|BPF_K:
+			/* sk_chk_filter() made sure K is not 0 */
+			if ((K & (K - 1)) == 0) {
+				if (K != 1)		/* shr $log2(K),%eax */
+					EMIT3(0xc1, 0xe8, ffs(K) - 1);
+				break;
+			}
+			prog = emit_mov_imm(prog, X86_ECX, K);
+			EMIT2(0x31, 0xd2);		/* xor %edx,%edx */
+			EMIT2(0xf7, 0xf1);		/* div %ecx */
+			break;
+		case BPF_ALU|BPF_LSH|BPF_X:
+			/* mov %ebx,%ecx; shl %cl,%eax */
+			EMIT4(0x89, 0xd9, 0xd3, 0xe0);
+			break;
+		case BPF_ALU|BPF_RSH|BPF_X:
+			/* mov %ebx,%ecx; shr %cl,%eax */
+			EMIT4(0x89, 0xd9, 0xd3, 0xe8);
+			break;
+		case BPF_ALU|BPF_LSH|BPF_K:
+			if (K)
+				EMIT3(0xc1, 0xe0, (u8)K); /* shl $K,%eax */
+			break;
+		case BPF_ALU|BPF_RSH|BPF_K:
+			if (K)
+				EMIT3(0xc1, 0xe8, (u8)K); /* shr $K,%eax */
+			break;
+		case BPF_ALU|BPF_NEG:
+			EMIT2(0xf7, 0xd8);		/* neg %eax */
+			break;
+
+		case BPF_RET|BPF_K:
+			prog = emit_mov_imm(prog, X86_EAX, K);
+			/* fall through */
+		case BPF_RET|BPF_A:
+			/* Nothing to jump over for the last instruction */
+			off = epilogue - addrs[i];
+			if (off)
+				prog = emit_jmp(prog, off);
+			break;
+
+		case BPF_MISC|BPF_TAX:
+			EMIT2(0x89, 0xc3);		/* mov %eax,%ebx */
+			break;
+		case BPF_MISC|BPF_TXA:
+			EMIT2(0x89, 0xd8);		/* mov %ebx,%eax */
+			break;
+		case BPF_LD|BPF_IMM:
+			prog = emit_mov_imm(prog, X86_EAX, K);
+			break;
+		case BPF_LDX|BPF_IMM:
+			prog = emit_mov_imm(prog, X86_EBX, K);
+			break;
+		case BPF_LD|BPF_MEM:
+			EMIT3(0x8b, 0x45, (u8)MEM_OFF(K)); /* mov M[K],%eax */
+			break;
+		case BPF_LDX|BPF_MEM:
+			EMIT3(0x8b, 0x5d, (u8)MEM_OFF(K)); /* mov M[K],%ebx */
+			break;
+		case BPF_ST:
+			EMIT3(0x89, 0x45, (u8)MEM_OFF(K)); /* mov %eax,M[K] */
+			break;
+		case BPF_STX:
+			EMIT3(0x89, 0x5d, (u8)MEM_OFF(K)); /* mov %ebx,M[K] */
+			break;
+		case BPF_LD|BPF_W|BPF_LEN:
+		case BPF_LDX|BPF_W|BPF_LEN:
+			/* mov SKB_OFF(%ebp),%edx; mov skb->len,%eax or %ebx */
+			EMIT_PTR(); EMIT3(0x8b, 0x55, (u8)SKB_OFF);
+			prog = emit_mem(prog, 0x8b,
+					f->code == (BPF_LD|BPF_W|BPF_LEN) ?
+					X86_EAX : X86_EBX, X86_EDX,
+					offsetof(struct sk_buff, len));
+			break;
+
+		case BPF_LD|BPF_W|BPF_ABS:
+		case BPF_LD|BPF_H|BPF_ABS:
+		case BPF_LD|BPF_B|BPF_ABS:
+		case BPF_LD|BPF_W|BPF_IND:
+		case BPF_LD|BPF_H|BPF_IND:
+		case BPF_LD|BPF_B|BPF_IND:
+			size = BPF_SIZE(f->code) == BPF_W ? 4 :
+			       BPF_SIZE(f->code) == BPF_H ? 2 : 1;
+			slow = slow2 = over = NULL;
+
+			if (BPF_MODE(f->code) == BPF_IND) {
+				/* inline if X + K <= headlen - size */
+				if (K)		/* lea K(%ebx),%edx */
+					prog = emit_mem(prog, 0x8d, X86_EDX,
+							X86_EBX, K);
+				else
+					EMIT2(0x89, 0xda); /* mov %ebx,%edx */
+				EMIT2(0x89, 0xf9);	/* mov %edi,%ecx */
+				EMIT3(0x83, 0xe9, size); /* sub $size,%ecx */
+				EMIT2(0x70 | X86_JB, 0);
+				slow = prog;
+				EMIT2(0x39, 0xca);	/* cmp %ecx,%edx */
+				EMIT2(0x70 | X86_JA, 0);
+				slow2 = prog;
+				/* mov (%esi,%edx),%eax etc. */
+				if (size == 4)
+					EMIT3(0x8b, 0x04, 0x16);
+				else
+					EMIT4(0x0f, size == 2 ? 0xb7 : 0xb6,
+					      0x04, 0x16);
+			} else if ((int)K >= 0) {
+				/* inline if K + size <= headlen */
+				if (is_imm8(K + size))
+					EMIT3(0x83, 0xff, K + size);
+				else	/* cmp $(K + size),%edi */
+					EMIT2_off32(0x81, 0xff, K + size);
+				EMIT2(0x70 | X86_JB, 0);
+				slow = prog;
+				/* mov K(%esi),%eax etc. */
+				if (size != 4)
+					EMIT1(0x0f);
+				prog = emit_mem(prog, size == 4 ? 0x8b :
+						size == 2 ? 0xb7 : 0xb6,
+						X86_EAX, X86_ESI, K);
+			}
+
+			if (slow) {
+				if (size == 4)
+					EMIT2(0x0f, 0xc8); /* bswap %eax */
+				else if (size == 2)	/* rol $8,%ax */
+					EMIT4(0x66, 0xc1, 0xc0, 0x08);
+				EMIT2(0xeb, 0);		/* jmp past slow path */
+				over = prog;
+				slow[-1] = prog - slow;
+				if (slow2)
+					slow2[-1] = prog - slow2;
+			}
+
+			if (BPF_MODE(f->code) != BPF_IND)
+				prog = emit_mov_imm(prog, X86_EDX, K);
+			prog = emit_load_call(prog, size);
+			EMIT2(0x85, 0xc0);		/* test %eax,%eax */
+			EMIT_JCC_RET0(X86_JNE);
+			EMIT3(0x8b, 0x45, (u8)RES_OFF);	/* mov res,%eax */
+			if (over)
+				over[-1] = prog - over;
+			break;
+
+		case BPF_LDX|BPF_B|BPF_MSH:
+			/* sk_run_filter() has no ancillary data here */
+			if ((int)K < 0 && (int)K >= SKF_AD_OFF) {
+				off = ret0 - (CUR_OFF() + 5);
+				EMIT1_off32(0xe9, off);	/* jmp ret0 */
+				break;
+			}
+			over = NULL;
+			if ((int)K >= 0) {
+				if (is_imm8(K + 1))	/* cmp $(K + 1),%edi */
+					EMIT3(0x83, 0xff, K + 1);
+				else
+					EMIT2_off32(0x81, 0xff, K + 1);
+				EMIT2(0x70 | X86_JB, 0);
+				slow = prog;
+				/* movzbl K(%esi),%ebx */
+				EMIT1(0x0f);
+				prog = emit_mem(prog, 0xb6, X86_EBX, X86_ESI,
+						K);
+				EMIT2(0xeb, 0);
+				over = prog;
+				slow[-1] = prog - slow;
+			}
+			/* A is kept in %ebx, which the call preserves */
+			EMIT2(0x89, 0xc3);		/* mov %eax,%ebx */
+			prog = emit_mov_imm(prog, X86_EDX, K);
+			prog = emit_load_call(prog, 1);
+			/* mov %eax,%ecx; mov %ebx,%eax */
+			EMIT4(0x89, 0xc1, 0x89, 0xd8);
+			EMIT2(0x85, 0xc9);		/* test %ecx,%ecx */
+			EMIT_JCC_RET0(X86_JNE);
+			EMIT3(0x8b, 0x5d, (u8)RES_OFF);	/* mov res,%ebx */
+			if (over)
+				over[-1] = prog - over;
+			EMIT3(0x83, 0xe3, 0x0f);	/* and $0xf,%ebx */
+			EMIT3(0xc1, 0xe3, 0x02);	/* shl $2,%ebx */
+			break;
+
+		case BPF_JMP|BPF_JA:
+			if (K) {
+				off = addrs[i + K] - addrs[i];
+				prog = emit_jmp(prog, off);
+			}
+			break;
+
+		case BPF_JMP|BPF_JGT|BPF_K:
+		case BPF_JMP|BPF_JGE|BPF_K:
+		case BPF_JMP|BPF_JEQ|BPF_K:
+		case BPF_JMP|BPF_JSET|BPF_K:
+		case BPF_JMP|BPF_JGT|BPF_X:
+		case BPF_JMP|BPF_JGE|BPF_X:
+		case BPF_JMP|BPF_JEQ|BPF_X:
+		case BPF_JMP|BPF_JSET|BPF_X: {
+			int t_off, f_off;
+
+			if (f->jt == f->jf) {
+				if (f->jt)
+					prog = emit_jmp(prog, addrs[i + f->jt] -
+							      addrs[i]);
+				break;
+			}
+
+			switch (BPF_OP(f->code)) {
+			case BPF_JGT:
+				cc = X86_JA;
+				break;
+			case BPF_JGE:
+				cc = X86_JAE;
+				break;
+			case BPF_JEQ:
+				cc = X86_JE;
+				break;
+			default:
+				cc = X86_JNE;
+				break;
+			}
+
+			if (BPF_SRC(f->code) == BPF_X) {
+				if (BPF_OP(f->code) == BPF_JSET)
+					EMIT2(0x85, 0xd8); /* test %ebx,%eax */
+				else
+					EMIT2(0x39, 0xd8); /* cmp %ebx,%eax */
+			} else if (BPF_OP(f->code) == BPF_JSET) {
+				if (K <= 0xff)
+					EMIT2(0xa8, K);	/* test $K,%al */
+				else
+					EMIT1_off32(0xa9, K); /* test $K,%eax */
+			} else {
+				if (is_imm8(K))		/* cmp $K,%eax */
+					EMIT3(0x83, 0xf8, (u8)K);
+				else
+					EMIT1_off32(0x3d, K);
+			}
+
+			t_off = addrs[i + f->jt] - addrs[i];
+			f_off = addrs[i + f->jf] - addrs[i];
+			if (f->jt && f->jf) {
+				t_off += is_imm8(f_off) ? 2 : 5;
+				prog = emit_jcc(prog, cc, t_off);
+				prog = emit_jmp(prog, f_off);
+			} else if (f->jt)
+				prog = emit_jcc(prog, cc, t_off);
+			else
+				prog = emit_jcc(prog, cc ^ 1, f_off);
+			break;
+		}
+
+		default:
+			/* Left to the interpreter */
+			return 0;
+		}
+
+		if (image)
+			memcpy(image + proglen, temp, prog - temp);
+		proglen += prog - temp;
+		if (addrs[i] != proglen)
+			*changed = 1;
+		addrs[i] = proglen;
+	}
+#undef EMIT_JCC_RET0
+#undef CUR_OFF
+
+	prog = temp;
+	EMIT_PTR(); EMIT3(0x8d, 0x65, (u8)(-3 * W)); /* lea -3W(%ebp),%esp */
+	EMIT4(0x5f, 0x5e, 0x5b, 0x5d);		/* pop %edi, %esi, %ebx, %ebp */
+	EMIT1(0xc3);				/* ret */
+	EMIT2(0x31, 0xc0);			/* ret0: xor %eax,%eax */
+	EMIT2(0xeb, (u8)-(EPILOGUE_LEN + RET0_LEN)); /* jmp epilogue */
+	if (image)
+		memcpy(image + proglen, temp, prog - temp);
+	return proglen + (prog - temp);
+}
+
+/**
+ *	bpf_jit_compile - compile a socket filter to native code
+ *	@fp: filter that passed sk_chk_filter()
+ *
+ * Points fp->bpf_func at the compiled filter if net.core.bpf_jit_enable
+ * is set and memory can be had for it; otherwise fp stays with
+ * sk_run_filter().
+ */
+void bpf_jit_compile(struct sk_filter *fp)
+{
+	struct bpf_jit_image *image;
+	unsigned int *addrs, proglen = 0;
+	int seen_data, changed, pass, i;
+
+	if (!bpf_jit_enable)
+		return;
+
+	addrs = kmalloc(fp->len * sizeof(*addrs), GFP_KERNEL);
+	if (addrs == NULL)
+		return;
+
+	/*
+	 * Start from an overestimate: the code can then only get shorter
+	 * from one pass to the next, until it stops moving.
+	 */
+	for (i = 0; i < fp->len; i++)
+		addrs[i] = (i + 2) * BPF_MAX_INSN_SIZE;
+
+	seen_data = bpf_jit_seen_data(fp);
+	for (pass = 0; pass < BPF_JIT_PASSES; pass++) {
+		proglen = bpf_jit_pass(fp, NULL, addrs, seen_data, &changed);
+		if (!proglen || !changed)
+			break;
+	}
+	if (!proglen || changed)
+		goto out;
+
+	image = vmalloc_exec(sizeof(*image) + proglen);
+	if (image == NULL)
+		goto out;
+	bpf_jit_pass(fp, image->code, addrs, seen_data, &changed);
+	fp->bpf_func = (void *)image->code;
+out:
+	kfree(addrs);
+}
+
+static void bpf_jit_free_image(void *image)
+{
+	vfree(image);
+}
+
+/**
+ *	bpf_jit_free - free the code bpf_jit_compile() made of a filter
+ *	@fp: filter being freed
+ */
+void bpf_jit_free(struct sk_filter *fp)
+{
+	struct bpf_jit_image *image;
+
+	if (fp->bpf_func == sk_run_filter)
+		return;
+
+	/* Filters can be freed in softirq context, vfree() cannot be */
+	image = (struct bpf_jit_image *)((unsigned long)fp->bpf_func -
+					 offsetof(struct bpf_jit_image, code));
+	INIT_WORK(&image->work, bpf_jit_free_image, image);
+	schedule_work(&image->work);
+}
@@ -244,6 +244,7 @@ static inline void stop_hz_timer(void)
 	if (sysctl_hz_timer != 0)
 		return;
 
+	__get_cpu_var(dyntick_stats).idle_calls++;
 	cpu_set(smp_processor_id(), nohz_cpu_mask);
 
 	/*
@@ -260,6 +261,8 @@ static inline void stop_hz_timer(void)
 	 * for the next event.
 	 */
 	next = next_timer_interrupt();
+	__get_cpu_var(dyntick_stats).idle_sleeps++;
+	__get_cpu_var(dyntick_stats).stop_jiffies = jiffies;
 	do {
 		seq = read_seqbegin_irqsave(&xtime_lock, flags);
 		timer = (__u64)(next - jiffies) + jiffies_64;
@@ -284,6 +287,8 @@ static inline void start_hz_timer(void)
 		return;
 	account_ticks(task_pt_regs(current));
 	cpu_clear(smp_processor_id(), nohz_cpu_mask);
+	__get_cpu_var(dyntick_stats).ticks_skipped +=
+		jiffies - __get_cpu_var(dyntick_stats).stop_jiffies;
 }
 
 static int nohz_idle_notify(struct notifier_block *self,
@@ -0,0 +1,518 @@
+/*
+ * Multi-queue block layer
+ *
+ * A request_queue_t set up with blk_mq_init_queue() has no elevator and
+ * no queue_lock on the I/O path.  Each cpu submits into its own software
+ * queue (struct blk_mq_ctx), and each software queue is mapped onto one
+ * of the hardware dispatch queues (struct blk_mq_hw_ctx) the driver
+ * registered.  Requests are preallocated per hardware queue and found
+ * through their tag, which the driver hands to the hardware.
+ *
+ * See Documentation/block/blk-mq.txt
+ */
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/interrupt.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+
+#include "blk.h"
+
+static inline struct blk_mq_ctx *__blk_mq_get_ctx(request_queue_t *q,
+						  unsigned int cpu)
+{
+	return per_cpu_ptr(q->queue_ctx, cpu);
+}
+
+/**
+ * blk_mq_map_queue - default cpu to hardware queue mapping
+ * @q:		the queue
+ * @cpu:	the submitting cpu
+ *
+ * Uses the table set up by blk_mq_init_queue(), which spreads the
+ * possible cpus evenly over the hardware queues.
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(request_queue_t *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+/*
+ * Tags are a bitmap per hardware queue; a set bit is a request in use.
+ */
+static int __blk_mq_get_tag(struct blk_mq_hw_ctx *hctx)
+{
+	int tag;
+
+	do {
+		tag = find_first_zero_bit(hctx->tag_map, hctx->queue_depth);
+		if (tag >= hctx->queue_depth)
+			return -1;
+	} while (test_and_set_bit(tag, hctx->tag_map));
+
+	return tag;
+}
+
+static struct request *blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					    struct blk_mq_ctx *ctx, int rw,
+					    gfp_t gfp_mask)
+{
+	struct request *rq;
+	int tag;
+
+	tag = __blk_mq_get_tag(hctx);
+	if (unlikely(tag < 0)) {
+		DEFINE_WAIT(wait);
+
+		if (!(gfp_mask & __GFP_WAIT))
+			return NULL;
+
+		for (;;) {
+			prepare_to_wait_exclusive(&hctx->tag_wait, &wait,
+						  TASK_UNINTERRUPTIBLE);
+			tag = __blk_mq_get_tag(hctx);
+			if (tag >= 0)
+				break;
+			/* make sure what was bounced back gets going */
+			blk_mq_run_hw_queue(hctx, 0);
+			io_schedule();
+		}
+		finish_wait(&hctx->tag_wait, &wait);
+	}
+
+	rq = hctx->rqs[tag];
+	memset(rq, 0, sizeof(*rq));
+	INIT_LIST_HEAD(&rq->queuelist);
+	INIT_LIST_HEAD(&rq->donelist);
+	rq->flags = rw;
+	rq->rq_status = RQ_ACTIVE;
+	rq->ref_count = 1;
+	rq->q = hctx->queue;
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+
+	return rq;
+}
+
+static void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = rq->q->mq_ops->map_queue(rq->q, rq->mq_ctx->cpu);
+
+	rq->rq_status = RQ_INACTIVE;
+	smp_mb__before_clear_bit();
+	clear_bit(rq->tag, hctx->tag_map);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&hctx->tag_wait))
+		wake_up(&hctx->tag_wait);
+}
+
+/**
+ * blk_mq_end_io - end all I/O on a request and free it
+ * @rq:		the request
+ * @error:	0, or a negative errno
+ *
+ * May be called from any context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	struct gendisk *disk = rq->rq_disk;
+	struct bio *bio = rq->bio;
+	unsigned int bytes = 0;
+
+	while (bio) {
+		struct bio *next = bio->bi_next;
+
+		bio->bi_next = NULL;
+		bytes += bio->bi_size;
+		bio_endio(bio, bio->bi_size, error);
+		bio = next;
+	}
+
+	if (disk && blk_fs_request(rq)) {
+		const int rw = rq_data_dir(rq);
+		unsigned long flags;
+
+		/*
+		 * No queue_lock here, and a completion from interrupt
+		 * context may update the same per-cpu counters: stay on
+		 * this cpu with interrupts off while they are changed.
+		 */
+		local_irq_save(flags);
+		__disk_stat_add(disk, sectors[rw], bytes >> 9);
+		__disk_stat_inc(disk, ios[rw]);
+		__disk_stat_add(disk, ticks[rw], jiffies - rq->start_time);
+		local_irq_restore(flags);
+	}
+
+	blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+/**
+ * blk_mq_complete_request - end I/O on a request from interrupt context
+ * @rq:		the request
+ *
+ * Defers the completion to BLOCK_SOFTIRQ, which calls ->complete of the
+ * queue's blk_mq_ops.  Hardware queues are meant to have their interrupt
+ * bound to the cpus in hctx->cpumask, so the completion runs on, or close
+ * to, the cpu that submitted the request and still has its data cache
+ * hot.
+ */
+void blk_mq_complete_request(struct request *rq)
+{
+	blk_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+/*
+ * Hand everything queued on the software queues of this hardware queue
+ * to the driver.  Requests it cannot take now are kept on hctx->dispatch
+ * and go first the next time round.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	request_queue_t *q = hctx->queue;
+	LIST_HEAD(rq_list);
+	int bit;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	for (bit = find_first_bit(hctx->ctx_map, hctx->nr_ctx);
+	     bit < hctx->nr_ctx;
+	     bit = find_next_bit(hctx->ctx_map, hctx->nr_ctx, bit + 1)) {
+		struct blk_mq_ctx *ctx = hctx->ctxs[bit];
+
+		clear_bit(bit, hctx->ctx_map);
+		spin_lock(&ctx->lock);
+		list_splice_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		struct request *rq = list_entry_rq(rq_list.next);
+		int ret;
+
+		list_del_init(&rq->queuelist);
+		rq->flags |= REQ_STARTED;
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK)
+			continue;
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			rq->flags &= ~REQ_STARTED;
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+		rq->errors = -EIO;
+		blk_mq_end_io(rq, -EIO);
+	}
+
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+static void blk_mq_run_work_fn(void *data)
+{
+	__blk_mq_run_hw_queue(data);
+}
+
+/**
+ * blk_mq_run_hw_queue - start the requests queued for a hardware queue
+ * @hctx:	the hardware queue
+ * @async:	leave it to kblockd
+ *
+ * Runs from kblockd when called from interrupt context.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, int async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (async || in_interrupt())
+		kblockd_schedule_work(&hctx->run_work);
+	else
+		__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+/**
+ * blk_mq_stop_hw_queue - stop feeding requests to a hardware queue
+ * @hctx:	the hardware queue
+ *
+ * Typically called by ->queue_rq before returning BLK_MQ_RQ_QUEUE_BUSY,
+ * paired with blk_mq_start_hw_queue() once the hardware has room again.
+ */
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	blk_mq_run_hw_queue(hctx, 0);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(request_queue_t *q, int async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_and_clear_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static int blk_mq_make_request(request_queue_t *q, struct bio *bio)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	int rw = bio_data_dir(bio);
+	int cpu;
+
+	blk_queue_bounce(q, &bio);
+
+	/* requests are not ordered against each other here */
+	if (unlikely(bio_barrier(bio))) {
+		bio_endio(bio, bio->bi_size, -EOPNOTSUPP);
+		return 0;
+	}
+
+	cpu = get_cpu();
+	ctx = __blk_mq_get_ctx(q, cpu);
+	hctx = q->mq_ops->map_queue(q, cpu);
+	put_cpu();
+
+	rq = blk_mq_alloc_request(hctx, ctx, rw, GFP_NOIO);
+	init_request_from_bio(rq, bio);
+
+	spin_lock(&ctx->lock);
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	set_bit(ctx->index_hw, hctx->ctx_map);
+	spin_unlock(&ctx->lock);
+
+	blk_mq_run_hw_queue(hctx, 0);
+	return 0;
+}
+
+/*
+ * Spread the possible cpus evenly over the hardware queues, keeping
+ * neighbouring cpu numbers (usually siblings) on the same queue.
+ */
+static void blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues)
+{
+	unsigned int nr_cpus = num_possible_cpus();
+	unsigned int i = 0;
+	int cpu;
+
+	for_each_cpu(cpu) {
+		map[cpu] = (i * nr_queues) / nr_cpus;
+		i++;
+	}
+}
+
+static int blk_mq_init_hw_ctx(request_queue_t *q, struct blk_mq_hw_ctx *hctx,
+			      struct blk_mq_reg *reg, unsigned int index)
+{
+	unsigned int rq_size = sizeof(struct request) + reg->cmd_size;
+	int node = reg->numa_node;
+	int i;
+
+	memset(hctx, 0, sizeof(*hctx));
+	spin_lock_init(&hctx->lock);
+	INIT_LIST_HEAD(&hctx->dispatch);
+	INIT_WORK(&hctx->run_work, blk_mq_run_work_fn, hctx);
+	init_waitqueue_head(&hctx->tag_wait);
+	hctx->queue = q;
+	hctx->queue_num = index;
+	hctx->queue_depth = reg->queue_depth;
+
+	hctx->ctxs = kmalloc(NR_CPUS * sizeof(void *), GFP_KERNEL);
+	hctx->ctx_map = kmalloc(BITS_TO_LONGS(NR_CPUS) * sizeof(long),
+				GFP_KERNEL);
+	hctx->tag_map = kmalloc(BITS_TO_LONGS(reg->queue_depth) * sizeof(long),
+				GFP_KERNEL);
+	hctx->rqs = kmalloc(reg->queue_depth * sizeof(void *), GFP_KERNEL);
+	if (hctx->rqs)
+		memset(hctx->rqs, 0, reg->queue_depth * sizeof(void *));
+	if (!hctx->ctxs || !hctx->ctx_map || !hctx->tag_map || !hctx->rqs)
+		return -ENOMEM;
+
+	memset(hctx->ctx_map, 0, BITS_TO_LONGS(NR_CPUS) * sizeof(long));
+	memset(hctx->tag_map, 0, BITS_TO_LONGS(reg->queue_depth) * sizeof(long));
+
+	for (i = 0; i < reg->queue_depth; i++) {
+		hctx->rqs[i] = kmalloc_node(rq_size, GFP_KERNEL, node);
+		if (!hctx->rqs[i])
+			return -ENOMEM;
+		memset(hctx->rqs[i], 0, rq_size);
+	}
+
+	return 0;
+}
+
+static void blk_mq_free_hw_ctx(struct blk_mq_hw_ctx *hctx)
+{
+	int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+	kfree(hctx->tag_map);
+	kfree(hctx->ctx_map);
+	kfree(hctx->ctxs);
+	kfree(hctx);
+}
+
+/**
+ * blk_mq_init_queue - set up a multi-queue request_queue_t
+ * @reg:	hardware queues and their depth, driver operations
+ * @driver_data: stored in q->queuedata
+ *
+ * Description:
+ *    Requests bypass the elevator and the queue_lock: they are queued on
+ *    the submitting cpu's software queue and handed to ->queue_rq of the
+ *    hardware queue that cpu maps to, one request per bio.  Release the
+ *    queue with blk_cleanup_queue().
+ **/
+request_queue_t *blk_mq_init_queue(struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	request_queue_t *q;
+	unsigned int i;
+	int cpu;
+
+	if (!reg->nr_hw_queues || !reg->ops->queue_rq ||
+	    !reg->queue_depth || reg->queue_depth > BLK_MQ_MAX_DEPTH)
+		return NULL;
+
+	if (reg->nr_hw_queues > num_possible_cpus())
+		reg->nr_hw_queues = num_possible_cpus();
+	if (!reg->ops->map_queue)
+		reg->ops->map_queue = blk_mq_map_queue;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return NULL;
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	spin_lock_init(&q->__queue_lock);
+	q->queue_lock = &q->__queue_lock;
+	q->queuedata = driver_data;
+	q->nr_requests = reg->queue_depth * reg->nr_hw_queues;
+	q->softirq_done_fn = reg->ops->complete;
+	q->mq_ops = reg->ops;
+
+	q->mq_map = kmalloc(NR_CPUS * sizeof(unsigned int), GFP_KERNEL);
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->queue_hw_ctx = kmalloc(reg->nr_hw_queues * sizeof(void *),
+				  GFP_KERNEL);
+	if (!q->mq_map || !q->queue_ctx || !q->queue_hw_ctx)
+		goto err;
+
+	memset(q->mq_map, 0, NR_CPUS * sizeof(unsigned int));
+	memset(q->queue_hw_ctx, 0, reg->nr_hw_queues * sizeof(void *));
+	blk_mq_update_queue_map(q->mq_map, reg->nr_hw_queues);
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctx = kmalloc_node(sizeof(*hctx), GFP_KERNEL, reg->numa_node);
+		if (!hctx)
+			goto err;
+		q->queue_hw_ctx[i] = hctx;
+		q->nr_hw_queues++;
+		if (blk_mq_init_hw_ctx(q, hctx, reg, i))
+			goto err;
+	}
+
+	for_each_cpu(cpu) {
+		struct blk_mq_ctx *ctx = __blk_mq_get_ctx(q, cpu);
+
+		memset(ctx, 0, sizeof(*ctx));
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+
+		hctx = q->mq_ops->map_queue(q, cpu);
+		cpu_set(cpu, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i)) {
+			/* only undo those which were set up */
+			q->nr_hw_queues = i;
+			goto err_hctx;
+		}
+	}
+
+	return q;
+
+err_hctx:
+	queue_for_each_hw_ctx(q, hctx, i)
+		if (reg->ops->exit_hctx)
+			reg->ops->exit_hctx(hctx, i);
+	q->nr_hw_queues = reg->nr_hw_queues;
+err:
+	q->mq_ops = NULL;
+	queue_for_each_hw_ctx(q, hctx, i)
+		if (hctx)
+			blk_mq_free_hw_ctx(hctx);
+	kfree(q->queue_hw_ctx);
+	if (q->queue_ctx)
+		free_percpu(q->queue_ctx);
+	kfree(q->mq_map);
+	blk_cleanup_queue(q);
+	return NULL;
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called from blk_cleanup_queue(), after kblockd was flushed.  The driver
+ * must have ended all requests.
+ */
+void blk_mq_free_queue(request_queue_t *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+		blk_mq_free_hw_ctx(hctx);
+	}
+
+	kfree(q->queue_hw_ctx);
+	free_percpu(q->queue_ctx);
+	kfree(q->mq_map);
+	q->mq_ops = NULL;
+}
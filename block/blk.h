@@ -0,0 +1,13 @@
+#ifndef BLK_INTERNAL_H
+#define BLK_INTERNAL_H
+
+/*
+ * block layer internal definitions, shared between ll_rw_blk.c and
+ * blk-mq.c
+ */
+
+void init_request_from_bio(struct request *req, struct bio *bio);
+
+void blk_mq_free_queue(request_queue_t *q);
+
+#endif
@@ -34,10 +34,11 @@
  */
 #include <scsi/scsi_cmnd.h>
 
+#include "blk.h"
+
 static void blk_unplug_work(void *data);
 static void blk_unplug_timeout(unsigned long data);
 static void drive_stat_acct(struct request *rq, int nr_sectors, int new_io);
-static void init_request_from_bio(struct request *req, struct bio *bio);
 static int __make_request(request_queue_t *q, struct bio *bio);
 
 /*
@@ -249,7 +250,8 @@ void blk_queue_make_request(request_queue_t * q, make_request_fn * mfn)
 	blk_queue_max_hw_segments(q, MAX_HW_SEGMENTS);
 	q->make_request_fn = mfn;
 	q->backing_dev_info.ra_pages = (VM_MAX_READAHEAD * 1024) / PAGE_CACHE_SIZE;
-	q->backing_dev_info.state = 0;
+	clear_bit(BDI_write_congested, &q->backing_dev_info.state);
+	clear_bit(BDI_read_congested, &q->backing_dev_info.state);
 	q->backing_dev_info.capabilities = BDI_CAP_MAP_COPY;
 	blk_queue_max_sectors(q, SAFE_MAX_SECTORS);
 	blk_queue_hardsect_size(q, 512);
@@ -1753,12 +1755,17 @@ void blk_cleanup_queue(request_queue_t * q)
 
 	blk_sync_queue(q);
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
 
 	if (q->queue_tags)
 		__blk_queue_free_tags(q);
 
+	bdi_destroy(&q->backing_dev_info);
+
 	kmem_cache_free(requestq_cachep, q);
 }
 
@@ -1803,6 +1810,7 @@ request_queue_t *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 
 	q->backing_dev_info.unplug_io_fn = blk_backing_dev_unplug;
 	q->backing_dev_info.unplug_io_data = q;
+	bdi_init(&q->backing_dev_info);
 
 	return q;
 }
@@ -2752,7 +2760,7 @@ static inline int attempt_front_merge(request_queue_t *q, struct request *rq)
 	return 0;
 }
 
-static void init_request_from_bio(struct request *req, struct bio *bio)
+void init_request_from_bio(struct request *req, struct bio *bio)
 {
 	req->flags |= REQ_CMD;
 
@@ -3715,6 +3723,35 @@ static ssize_t queue_max_hw_sectors_show(struct request_queue *q, char *page)
 }
 
 
+static ssize_t queue_bdi_kb_show(char *page, unsigned long pages)
+{
+	return sprintf(page, "%llu\n",
+		       (unsigned long long)pages << (PAGE_CACHE_SHIFT - 10));
+}
+
+static ssize_t queue_dirty_show(struct request_queue *q, char *page)
+{
+	return queue_bdi_kb_show(page,
+			bdi_stat(&q->backing_dev_info, BDI_RECLAIMABLE));
+}
+
+static ssize_t queue_writeback_show(struct request_queue *q, char *page)
+{
+	return queue_bdi_kb_show(page,
+			bdi_stat(&q->backing_dev_info, BDI_WRITEBACK));
+}
+
+static ssize_t queue_written_show(struct request_queue *q, char *page)
+{
+	return queue_bdi_kb_show(page,
+			bdi_stat(&q->backing_dev_info, BDI_WRITTEN));
+}
+
+static ssize_t queue_dirty_thresh_show(struct request_queue *q, char *page)
+{
+	return queue_bdi_kb_show(page, bdi_dirty_thresh(&q->backing_dev_info));
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -3738,6 +3775,26 @@ static struct queue_sysfs_entry queue_max_hw_sectors_entry = {
 	.show = queue_max_hw_sectors_show,
 };
 
+static struct queue_sysfs_entry queue_dirty_entry = {
+	.attr = {.name = "dirty_kb", .mode = S_IRUGO },
+	.show = queue_dirty_show,
+};
+
+static struct queue_sysfs_entry queue_writeback_entry = {
+	.attr = {.name = "writeback_kb", .mode = S_IRUGO },
+	.show = queue_writeback_show,
+};
+
+static struct queue_sysfs_entry queue_written_entry = {
+	.attr = {.name = "written_kb", .mode = S_IRUGO },
+	.show = queue_written_show,
+};
+
+static struct queue_sysfs_entry queue_dirty_thresh_entry = {
+	.attr = {.name = "dirty_thresh_kb", .mode = S_IRUGO },
+	.show = queue_dirty_thresh_show,
+};
+
 static struct queue_sysfs_entry queue_iosched_entry = {
 	.attr = {.name = "scheduler", .mode = S_IRUGO | S_IWUSR },
 	.show = elv_iosched_show,
@@ -3750,6 +3807,10 @@ static struct attribute *default_attrs[] = {
 	&queue_max_hw_sectors_entry.attr,
 	&queue_max_sectors_entry.attr,
 	&queue_iosched_entry.attr,
+	&queue_dirty_entry.attr,
+	&queue_writeback_entry.attr,
+	&queue_written_entry.attr,
+	&queue_dirty_thresh_entry.attr,
 	NULL,
 };
 
@@ -3801,6 +3862,10 @@ int blk_register_queue(struct gendisk *disk)
 	if (!q || !q->request_fn)
 		return -ENXIO;
 
+	/* names the flusher thread, if it is not running yet */
+	strlcpy(q->backing_dev_info.name, disk->disk_name,
+		sizeof(q->backing_dev_info.name));
+
 	q->kobj.parent = kobject_get(&disk->kobj);
 	if (!q->kobj.parent)
 		return -EBUSY;
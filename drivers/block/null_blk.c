@@ -0,0 +1,371 @@
+/*
+ * null_blk.c - a block device that completes I/O without doing any
+ *
+ * Every read and write succeeds without touching the data, so the cost
+ * of an I/O is the cost of the block layer and the completion path
+ * alone.  Meant for measuring those, see Documentation/block/null_blk.txt.
+ *
+ * queue_mode picks how requests reach the driver:
+ *	0	bio based, the driver's own make_request function
+ *	1	request_fn with an elevator and the queue_lock
+ *	2	multi-queue (blk-mq), submit_queues hardware queues
+ *
+ * irqmode picks how they complete:
+ *	0	right away, in the submitting context
+ *	1	from BLOCK_SOFTIRQ, like a driver using blk_complete_request()
+ *	2	from a per-cpu hrtimer completion_nsec later, like a device
+ *		raising an interrupt
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/bio.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/percpu.h>
+
+enum {
+	NULL_Q_BIO	= 0,
+	NULL_Q_RQ	= 1,
+	NULL_Q_MQ	= 2,
+};
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+	NULL_IRQ_TIMER		= 2,
+};
+
+struct nullb {
+	struct list_head list;
+	unsigned int index;
+	request_queue_t *q;
+	struct gendisk *disk;
+	spinlock_t lock;		/* queue_lock for NULL_Q_RQ */
+};
+
+/*
+ * Requests and bios waiting for the timer of this cpu
+ */
+struct completion_queue {
+	struct list_head rq_list;
+	struct bio *bio_head;
+	struct bio *bio_tail;
+	struct hrtimer timer;
+};
+
+static DEFINE_PER_CPU(struct completion_queue, completion_queues);
+
+static LIST_HEAD(nullb_list);
+static int null_major;
+
+static int queue_mode = NULL_Q_MQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "0: bio based, 1: request_fn, 2: multi-queue (default)");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "0: complete inline, 1: softirq (default), 2: timer");
+
+static int submit_queues;
+module_param(submit_queues, int, S_IRUGO);
+MODULE_PARM_DESC(submit_queues, "Hardware queues in multi-queue mode (default: one per online cpu)");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Tags per hardware queue (default 64)");
+
+static int nr_devices = 2;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices (default 2)");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size of each device in GB (default 250)");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Logical block size in bytes (default 512)");
+
+static unsigned long completion_nsec = 10000;
+module_param(completion_nsec, ulong, S_IRUGO);
+MODULE_PARM_DESC(completion_nsec, "Completion delay in timer mode, in nsecs (default 10000)");
+
+static void null_end_rq(struct request *rq)
+{
+	request_queue_t *q = rq->q;
+	unsigned long flags;
+
+	if (queue_mode == NULL_Q_MQ) {
+		blk_mq_end_io(rq, 0);
+		return;
+	}
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	if (!end_that_request_first(rq, 1, rq->hard_nr_sectors))
+		end_that_request_last(rq, 1);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static int null_timer_fn(void *data)
+{
+	struct completion_queue *cq = data;
+	struct bio *bio;
+	LIST_HEAD(rq_list);
+	unsigned long flags;
+
+	local_irq_save(flags);
+	list_splice_init(&cq->rq_list, &rq_list);
+	bio = cq->bio_head;
+	cq->bio_head = cq->bio_tail = NULL;
+	local_irq_restore(flags);
+
+	while (!list_empty(&rq_list)) {
+		struct request *rq = list_entry_rq(rq_list.next);
+
+		list_del_init(&rq->queuelist);
+		null_end_rq(rq);
+	}
+
+	while (bio) {
+		struct bio *next = bio->bi_next;
+
+		bio->bi_next = NULL;
+		bio_endio(bio, bio->bi_size, 0);
+		bio = next;
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Queue for the timer of the submitting cpu: it completes there
+ */
+static void null_timer_add(struct request *rq, struct bio *bio)
+{
+	struct completion_queue *cq;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	cq = &__get_cpu_var(completion_queues);
+	if (rq)
+		list_add_tail(&rq->queuelist, &cq->rq_list);
+	else {
+		if (cq->bio_tail)
+			cq->bio_tail->bi_next = bio;
+		else
+			cq->bio_head = bio;
+		cq->bio_tail = bio;
+	}
+	if (!hrtimer_active(&cq->timer))
+		hrtimer_start(&cq->timer, ktime_set(0, completion_nsec),
+			      HRTIMER_REL);
+	local_irq_restore(flags);
+}
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	null_end_rq(rq);
+}
+
+static void null_handle_rq(struct request *rq)
+{
+	switch (irqmode) {
+	case NULL_IRQ_SOFTIRQ:
+		blk_complete_request(rq);
+		break;
+	case NULL_IRQ_TIMER:
+		null_timer_add(rq, NULL);
+		break;
+	default:
+		null_end_rq(rq);
+		break;
+	}
+}
+
+static int null_queue_bio(request_queue_t *q, struct bio *bio)
+{
+	/* there is no softirq completion for bios: only the timer defers */
+	if (irqmode == NULL_IRQ_TIMER)
+		null_timer_add(NULL, bio);
+	else
+		bio_endio(bio, bio->bi_size, 0);
+	return 0;
+}
+
+static void null_request_fn(request_queue_t *q)
+{
+	struct request *rq;
+
+	while ((rq = elv_next_request(q)) != NULL) {
+		blkdev_dequeue_request(rq);
+		spin_unlock_irq(q->queue_lock);
+		null_handle_rq(rq);
+		spin_lock_irq(q->queue_lock);
+	}
+}
+
+static int null_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	null_handle_rq(rq);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static struct blk_mq_ops null_mq_ops = {
+	.queue_rq	= null_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.complete	= null_softirq_done_fn,
+};
+
+static struct block_device_operations null_fops = {
+	.owner =	THIS_MODULE,
+};
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del(&nullb->list);
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	put_disk(nullb->disk);
+	kfree(nullb);
+}
+
+static int null_add_dev(unsigned int index)
+{
+	struct gendisk *disk;
+	struct nullb *nullb;
+	sector_t size;
+
+	nullb = kmalloc(sizeof(*nullb), GFP_KERNEL);
+	if (!nullb)
+		return -ENOMEM;
+	memset(nullb, 0, sizeof(*nullb));
+	spin_lock_init(&nullb->lock);
+	nullb->index = index;
+
+	if (queue_mode == NULL_Q_MQ) {
+		struct blk_mq_reg reg = {
+			.ops		= &null_mq_ops,
+			.nr_hw_queues	= submit_queues,
+			.queue_depth	= hw_queue_depth,
+			.numa_node	= -1,
+		};
+
+		nullb->q = blk_mq_init_queue(&reg, nullb);
+	} else if (queue_mode == NULL_Q_BIO) {
+		nullb->q = blk_alloc_queue(GFP_KERNEL);
+		if (nullb->q) {
+			blk_queue_make_request(nullb->q, null_queue_bio);
+			nullb->q->queuedata = nullb;
+		}
+	} else {
+		nullb->q = blk_init_queue(null_request_fn, &nullb->lock);
+		if (nullb->q) {
+			blk_queue_softirq_done(nullb->q, null_softirq_done_fn);
+			nullb->q->queuedata = nullb;
+		}
+	}
+	if (!nullb->q)
+		goto out_free;
+
+	/* no data is ever touched, so there is nothing to bounce */
+	blk_queue_bounce_limit(nullb->q, BLK_BOUNCE_ANY);
+	blk_queue_hardsect_size(nullb->q, bs);
+
+	disk = nullb->disk = alloc_disk(1);
+	if (!disk)
+		goto out_cleanup;
+
+	size = (sector_t) gb << (30 - 9);
+	set_capacity(disk, size);
+
+	disk->major = null_major;
+	disk->first_minor = index;
+	disk->fops = &null_fops;
+	disk->private_data = nullb;
+	disk->queue = nullb->q;
+	sprintf(disk->disk_name, "nullb%d", index);
+	sprintf(disk->devfs_name, "nullb%d", index);
+
+	list_add_tail(&nullb->list, &nullb_list);
+	add_disk(disk);
+	return 0;
+
+out_cleanup:
+	blk_cleanup_queue(nullb->q);
+out_free:
+	kfree(nullb);
+	return -ENOMEM;
+}
+
+static int __init null_init(void)
+{
+	int cpu;
+	int i;
+
+	if (queue_mode < NULL_Q_BIO || queue_mode > NULL_Q_MQ)
+		queue_mode = NULL_Q_MQ;
+	if (irqmode < NULL_IRQ_NONE || irqmode > NULL_IRQ_TIMER)
+		irqmode = NULL_IRQ_SOFTIRQ;
+	if (submit_queues <= 0 || submit_queues > num_possible_cpus())
+		submit_queues = num_online_cpus();
+	if (hw_queue_depth <= 0 || hw_queue_depth > BLK_MQ_MAX_DEPTH)
+		hw_queue_depth = 64;
+	if (bs != 512 && bs != 1024 && bs != 2048 && bs != 4096) {
+		printk(KERN_WARNING "null_blk: invalid block size %d, using 512\n",
+		       bs);
+		bs = 512;
+	}
+
+	for_each_cpu(cpu) {
+		struct completion_queue *cq = &per_cpu(completion_queues, cpu);
+
+		INIT_LIST_HEAD(&cq->rq_list);
+		cq->bio_head = cq->bio_tail = NULL;
+		hrtimer_init(&cq->timer, CLOCK_MONOTONIC, HRTIMER_REL);
+		cq->timer.function = null_timer_fn;
+		cq->timer.data = cq;
+	}
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	for (i = 0; i < nr_devices; i++) {
+		if (null_add_dev(i)) {
+			while (!list_empty(&nullb_list))
+				null_del_dev(list_entry(nullb_list.next,
+							struct nullb, list));
+			unregister_blkdev(null_major, "nullb");
+			return -ENOMEM;
+		}
+	}
+
+	printk(KERN_INFO "null_blk: %d devices, queue_mode %d, irqmode %d\n",
+	       nr_devices, queue_mode, irqmode);
+	return 0;
+}
+
+static void __exit null_exit(void)
+{
+	int cpu;
+
+	while (!list_empty(&nullb_list))
+		null_del_dev(list_entry(nullb_list.next, struct nullb, list));
+	unregister_blkdev(null_major, "nullb");
+
+	for_each_cpu(cpu)
+		hrtimer_cancel(&per_cpu(completion_queues, cpu).timer);
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_LICENSE("GPL");
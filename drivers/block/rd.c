@@ -338,6 +338,7 @@ static struct backing_dev_info rd_file_backing_dev_info = {
 	.ra_pages	= 0,	/* No readahead */
 	.capabilities	= BDI_CAP_MAP_COPY,	/* Does contribute to dirty memory */
 	.unplug_io_fn	= default_unplug_io_fn,
+	.name		= "ram",
 };
 
 static int rd_open(struct inode *inode, struct file *filp)
@@ -413,6 +414,7 @@ static void __exit rd_cleanup(void)
 	}
 	devfs_remove("rd");
 	unregister_blkdev(RAMDISK_MAJOR, "ramdisk");
+	bdi_destroy(&rd_file_backing_dev_info);
 }
 
 /*
@@ -465,6 +467,8 @@ static int __init rd_init(void)
 		add_disk(rd_disks[i]);
 	}
 
+	bdi_init(&rd_file_backing_dev_info);
+
 	/* rd_size is given in kB */
 	printk("RAMDISK driver initialized: "
 		"%d RAM disks of %dK size %d blocksize\n",
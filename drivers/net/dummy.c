@@ -37,6 +37,18 @@
 #include <linux/moduleparam.h>
 
 static int numdummies = 1;
+static int numtxqs = 1;
+
+/* Counted per transmit queue, so that the queues do not share a line */
+struct dummy_tx_stats {
+	unsigned long		packets;
+	unsigned long		bytes;
+} ____cacheline_aligned_in_smp;
+
+struct dummy_priv {
+	struct net_device_stats	stats;
+	struct dummy_tx_stats	tx[0];
+};
 
 static int dummy_xmit(struct sk_buff *skb, struct net_device *dev);
 static struct net_device_stats *dummy_get_stats(struct net_device *dev);
@@ -77,10 +89,11 @@ static void __init dummy_setup(struct net_device *dev)
 
 static int dummy_xmit(struct sk_buff *skb, struct net_device *dev)
 {
-	struct net_device_stats *stats = netdev_priv(dev);
+	struct dummy_priv *priv = netdev_priv(dev);
+	struct dummy_tx_stats *tx = &priv->tx[skb->queue_mapping];
 
-	stats->tx_packets++;
-	stats->tx_bytes+=skb->len;
+	tx->packets++;
+	tx->bytes += skb->len;
 
 	dev_kfree_skb(skb);
 	return 0;
@@ -88,7 +101,16 @@ static int dummy_xmit(struct sk_buff *skb, struct net_device *dev)
 
 static struct net_device_stats *dummy_get_stats(struct net_device *dev)
 {
-	return netdev_priv(dev);
+	struct dummy_priv *priv = netdev_priv(dev);
+	unsigned int i;
+
+	priv->stats.tx_packets = 0;
+	priv->stats.tx_bytes = 0;
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		priv->stats.tx_packets += priv->tx[i].packets;
+		priv->stats.tx_bytes += priv->tx[i].bytes;
+	}
+	return &priv->stats;
 }
 
 static struct net_device **dummies;
@@ -96,14 +118,17 @@ static struct net_device **dummies;
 /* Number of dummy devices to be set up by this module. */
 module_param(numdummies, int, 0);
 MODULE_PARM_DESC(numdummies, "Number of dummy pseudo devices");
+module_param(numtxqs, int, 0);
+MODULE_PARM_DESC(numtxqs, "Number of transmit queues of each device");
 
 static int __init dummy_init_one(int index)
 {
 	struct net_device *dev_dummy;
 	int err;
 
-	dev_dummy = alloc_netdev(sizeof(struct net_device_stats),
-				 "dummy%d", dummy_setup);
+	dev_dummy = alloc_netdev_mq(sizeof(struct dummy_priv) +
+				    numtxqs * sizeof(struct dummy_tx_stats),
+				    "dummy%d", dummy_setup, numtxqs);
 
 	if (!dev_dummy)
 		return -ENOMEM;
@@ -127,6 +152,9 @@ static void dummy_free_one(int index)
 static int __init dummy_init_module(void)
 { 
 	int i, err = 0;
+
+	if (numtxqs < 1)
+		return -EINVAL;
 	dummies = kmalloc(numdummies * sizeof(void *), GFP_KERNEL); 
 	if (!dummies)
 		return -ENOMEM; 
@@ -42,6 +42,7 @@
 #include <linux/bitops.h>
 #include <linux/mpage.h>
 #include <linux/bit_spinlock.h>
+#include <linux/workqueue.h>
 
 static int fsync_buffers_list(spinlock_t *lock, struct list_head *list);
 static void invalidate_bh_lrus(void);
@@ -269,12 +270,12 @@ void thaw_bdev(struct block_device *bdev, struct super_block *sb)
 EXPORT_SYMBOL(thaw_bdev);
 
 /*
- * sync everything.  Start out by waking pdflush, because that writes back
- * all queues in parallel.
+ * sync everything.  Start out by waking the flusher threads, because they
+ * write back all queues in parallel.
  */
 static void do_sync(unsigned long wait)
 {
-	wakeup_pdflush(0);
+	wakeup_flusher_threads(0);
 	sync_inodes(0);		/* All mappings, inodes and their blockdevs */
 	DQUOT_SYNC(NULL);
 	sync_supers();		/* Write the superblocks */
@@ -293,9 +294,16 @@ asmlinkage long sys_sync(void)
 	return 0;
 }
 
+static void do_emergency_sync(void *unused)
+{
+	do_sync(0);
+}
+
+static DECLARE_WORK(emergency_sync_work, do_emergency_sync, NULL);
+
 void emergency_sync(void)
 {
-	pdflush_operation(do_sync, 0);
+	schedule_work(&emergency_sync_work);
 }
 
 /*
@@ -327,21 +335,17 @@ int file_fsync(struct file *filp, struct dentry *dentry, int datasync)
 	return ret;
 }
 
-static long do_fsync(unsigned int fd, int datasync)
+/*
+ * fsync(2) on a file the caller holds a reference to
+ */
+long vfs_fsync(struct file *file, int datasync)
 {
-	struct file * file;
 	struct address_space *mapping;
 	int ret, err;
 
-	ret = -EBADF;
-	file = fget(fd);
-	if (!file)
-		goto out;
-
-	ret = -EINVAL;
 	if (!file->f_op || !file->f_op->fsync) {
 		/* Why?  We can still call filemap_fdatawrite */
-		goto out_putf;
+		return -EINVAL;
 	}
 
 	mapping = file->f_mapping;
@@ -362,10 +366,19 @@ static long do_fsync(unsigned int fd, int datasync)
 	if (!ret)
 		ret = err;
 	current->flags &= ~PF_SYNCWRITE;
+	return ret;
+}
 
-out_putf:
+static long do_fsync(unsigned int fd, int datasync)
+{
+	struct file * file;
+	long ret;
+
+	file = fget(fd);
+	if (!file)
+		return -EBADF;
+	ret = vfs_fsync(file, datasync);
 	fput(file);
-out:
 	return ret;
 }
 
@@ -486,14 +499,14 @@ void invalidate_bdev(struct block_device *bdev, int destroy_dirty_buffers)
 }
 
 /*
- * Kick pdflush then try to free up some ZONE_NORMAL memory.
+ * Kick the flusher threads then try to free up some ZONE_NORMAL memory.
  */
 static void free_more_memory(void)
 {
 	struct zone **zones;
 	pg_data_t *pgdat;
 
-	wakeup_pdflush(1024);
+	wakeup_flusher_threads(1024);
 	yield();
 
 	for_each_pgdat(pgdat) {
@@ -857,8 +870,11 @@ int __set_page_dirty_buffers(struct page *page)
 	if (!TestSetPageDirty(page)) {
 		write_lock_irq(&mapping->tree_lock);
 		if (page->mapping) {	/* Race with truncate? */
-			if (mapping_cap_account_dirty(mapping))
+			if (mapping_cap_account_dirty(mapping)) {
 				inc_page_state(nr_dirty);
+				inc_bdi_stat(mapping->backing_dev_info,
+						BDI_RECLAIMABLE);
+			}
 			radix_tree_tag_set(&mapping->page_tree,
 						page_index(page),
 						PAGECACHE_TAG_DIRTY);
@@ -40,6 +40,7 @@ int sysctl_vfs_cache_pressure = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
  __cacheline_aligned_in_smp DEFINE_SPINLOCK(dcache_lock);
+static __cacheline_aligned_in_smp DEFINE_SPINLOCK(dcache_lru_lock);
 static seqlock_t rename_lock __cacheline_aligned_in_smp = SEQLOCK_UNLOCKED;
 
 EXPORT_SYMBOL(dcache_lock);
@@ -64,11 +65,114 @@ static unsigned int d_hash_shift;
 static struct hlist_head *dentry_hashtable;
 static LIST_HEAD(dentry_unused);
 
+/*
+ * Hash chain updates are serialised by a small array of spinlocks
+ * hashed on the address of the chain head, instead of dcache_lock.
+ * The same lock covers a superblock's s_anon list.  Lookups walk the
+ * chains under RCU and never take these.
+ */
+#define D_HASH_LOCK_BITS	8
+
+static struct dcache_hash_lock {
+	spinlock_t lock;
+} ____cacheline_aligned_in_smp dcache_hash_locks[1 << D_HASH_LOCK_BITS];
+
 /* Statistics gathering. */
 struct dentry_stat_t dentry_stat = {
 	.age_limit = 45,
 };
 
+static inline struct hlist_head *d_hash(struct dentry *parent,
+					unsigned long hash)
+{
+	hash += ((unsigned long) parent ^ GOLDEN_RATIO_PRIME) / L1_CACHE_BYTES;
+	hash = hash ^ ((hash ^ GOLDEN_RATIO_PRIME) >> D_HASHBITS);
+	return dentry_hashtable + (hash & D_HASHMASK);
+}
+
+static inline spinlock_t *d_hash_lock(struct hlist_head *head)
+{
+	return &dcache_hash_locks[hash_ptr(head, D_HASH_LOCK_BITS)].lock;
+}
+
+/*
+ * The chain a hashed dentry lives on.  Caller holds dentry->d_lock,
+ * which keeps d_parent and d_name.hash stable.
+ */
+static inline struct hlist_head *d_hash_head(struct dentry *dentry)
+{
+	if (dentry->d_flags & DCACHE_ANON_HASH)
+		return &dentry->d_sb->s_anon;
+	return d_hash(dentry->d_parent, dentry->d_name.hash);
+}
+
+/*
+ * dentry_unused and dentry_stat.nr_unused are protected by dcache_lru_lock.
+ * A dentry only goes on or comes off the list with its d_lock held too,
+ * so list_empty(&dentry->d_lru) is stable under d_lock.
+ *
+ * Lock order: dcache_lock -> dentry->d_lock -> dcache_lru_lock.
+ */
+static void dentry_lru_add(struct dentry *dentry)
+{
+	spin_lock(&dcache_lru_lock);
+	list_add(&dentry->d_lru, &dentry_unused);
+	dentry_stat.nr_unused++;
+	spin_unlock(&dcache_lru_lock);
+}
+
+/* Put the dentry at the end of the list that prune_dcache() frees first */
+static void dentry_lru_move_tail(struct dentry *dentry)
+{
+	spin_lock(&dcache_lru_lock);
+	if (list_empty(&dentry->d_lru)) {
+		list_add_tail(&dentry->d_lru, &dentry_unused);
+		dentry_stat.nr_unused++;
+	} else
+		list_move_tail(&dentry->d_lru, &dentry_unused);
+	spin_unlock(&dcache_lru_lock);
+}
+
+static void dentry_lru_del_init(struct dentry *dentry)
+{
+	if (!list_empty(&dentry->d_lru)) {
+		spin_lock(&dcache_lru_lock);
+		list_del_init(&dentry->d_lru);
+		dentry_stat.nr_unused--;
+		spin_unlock(&dcache_lru_lock);
+	}
+}
+
+/**
+ * __d_drop - unhash a dentry
+ * @dentry: dentry to drop
+ *
+ * Caller must hold dentry->d_lock.  See d_drop().
+ */
+void __d_drop(struct dentry *dentry)
+{
+	if (!(dentry->d_flags & DCACHE_UNHASHED)) {
+		spinlock_t *lock = d_hash_lock(d_hash_head(dentry));
+
+		spin_lock(lock);
+		dentry->d_flags |= DCACHE_UNHASHED;
+		dentry->d_flags &= ~DCACHE_ANON_HASH;
+		hlist_del_rcu(&dentry->d_hash);
+		spin_unlock(lock);
+	}
+}
+
+/* Caller holds entry->d_lock */
+static void __d_rehash(struct dentry * entry, struct hlist_head *list)
+{
+	spinlock_t *lock = d_hash_lock(list);
+
+	spin_lock(lock);
+	entry->d_flags &= ~DCACHE_UNHASHED;
+	hlist_add_head_rcu(&entry->d_hash, list);
+	spin_unlock(lock);
+}
+
 static void d_callback(struct rcu_head *head)
 {
 	struct dentry * dentry = container_of(head, struct dentry, d_u.d_rcu);
@@ -141,6 +245,10 @@ static void dentry_iput(struct dentry * dentry)
  * they too may now get deleted.
  *
  * no dcache lock, please.
+ *
+ * Dropping the last reference to a hashed dentry that has no ->d_delete()
+ * only puts it on the unused list, which needs nothing but its d_lock.
+ * dcache_lock is taken only when the dentry may have to be killed.
  */
 
 void dput(struct dentry *dentry)
@@ -151,6 +259,25 @@ void dput(struct dentry *dentry)
 repeat:
 	if (atomic_read(&dentry->d_count) == 1)
 		might_sleep();
+	if (!dentry->d_op || !dentry->d_op->d_delete) {
+		if (!atomic_dec_and_lock(&dentry->d_count, &dentry->d_lock))
+			return;
+		if (!d_unhashed(dentry)) {
+			if (list_empty(&dentry->d_lru)) {
+				dentry->d_flags |= DCACHE_REFERENCED;
+				dentry_lru_add(dentry);
+			}
+			spin_unlock(&dentry->d_lock);
+			return;
+		}
+		/*
+		 * Unreachable, so it has to go, and that needs dcache_lock
+		 * which nests outside d_lock.  Give the reference back and
+		 * drop it again the slow way.
+		 */
+		atomic_inc(&dentry->d_count);
+		spin_unlock(&dentry->d_lock);
+	}
 	if (!atomic_dec_and_lock(&dentry->d_count, &dcache_lock))
 		return;
 
@@ -173,8 +300,7 @@ repeat:
 		goto kill_it;
   	if (list_empty(&dentry->d_lru)) {
   		dentry->d_flags |= DCACHE_REFERENCED;
-  		list_add(&dentry->d_lru, &dentry_unused);
-  		dentry_stat.nr_unused++;
+		dentry_lru_add(dentry);
   	}
  	spin_unlock(&dentry->d_lock);
 	spin_unlock(&dcache_lock);
@@ -189,10 +315,7 @@ kill_it: {
 		/* If dentry was on d_lru list
 		 * delete it from there
 		 */
-  		if (!list_empty(&dentry->d_lru)) {
-  			list_del(&dentry->d_lru);
-  			dentry_stat.nr_unused--;
-  		}
+		dentry_lru_del_init(dentry);
   		list_del(&dentry->d_u.d_child);
 		dentry_stat.nr_dentry--;	/* For d_free, below */
 		/*drops the locks, at that point nobody can reach this dentry */
@@ -263,15 +386,15 @@ int d_invalidate(struct dentry * dentry)
 	return 0;
 }
 
-/* This should be called _only_ with dcache_lock held */
+/*
+ * This should be called _only_ with dcache_lock held.  Like __d_lookup(),
+ * it leaves the dentry on dentry_unused; prune_dcache() skips and removes
+ * in-use dentries it finds there.
+ */
 
 static inline struct dentry * __dget_locked(struct dentry *dentry)
 {
 	atomic_inc(&dentry->d_count);
-	if (!list_empty(&dentry->d_lru)) {
-		dentry_stat.nr_unused--;
-		list_del_init(&dentry->d_lru);
-	}
 	return dentry;
 }
 
@@ -399,15 +522,27 @@ static void prune_dcache(int count)
 
 		cond_resched_lock(&dcache_lock);
 
+		spin_lock(&dcache_lru_lock);
 		tmp = dentry_unused.prev;
-		if (tmp == &dentry_unused)
+		if (tmp == &dentry_unused) {
+			spin_unlock(&dcache_lru_lock);
 			break;
+		}
+		dentry = list_entry(tmp, struct dentry, d_lru);
+		/*
+		 * d_lock nests outside dcache_lru_lock.  If somebody holds
+		 * it, rotate the dentry to the head and carry on.
+		 */
+		if (!spin_trylock(&dentry->d_lock)) {
+			list_move(tmp, &dentry_unused);
+			spin_unlock(&dcache_lru_lock);
+			continue;
+		}
 		list_del_init(tmp);
 		prefetch(dentry_unused.prev);
  		dentry_stat.nr_unused--;
-		dentry = list_entry(tmp, struct dentry, d_lru);
+		spin_unlock(&dcache_lru_lock);
 
- 		spin_lock(&dentry->d_lock);
 		/*
 		 * We found an inuse dentry which was not removed from
 		 * dentry_unused because of laziness during lookup.  Do not free
@@ -420,8 +555,7 @@ static void prune_dcache(int count)
 		/* If the dentry was recently referenced, don't free it. */
 		if (dentry->d_flags & DCACHE_REFERENCED) {
 			dentry->d_flags &= ~DCACHE_REFERENCED;
- 			list_add(&dentry->d_lru, &dentry_unused);
- 			dentry_stat.nr_unused++;
+			dentry_lru_add(dentry);
  			spin_unlock(&dentry->d_lock);
 			continue;
 		}
@@ -462,32 +596,41 @@ void shrink_dcache_sb(struct super_block * sb)
 	 * superblock to the most recent end of the unused list.
 	 */
 	spin_lock(&dcache_lock);
+	spin_lock(&dcache_lru_lock);
 	list_for_each_safe(tmp, next, &dentry_unused) {
 		dentry = list_entry(tmp, struct dentry, d_lru);
 		if (dentry->d_sb != sb)
 			continue;
-		list_del(tmp);
-		list_add(tmp, &dentry_unused);
+		list_move(tmp, &dentry_unused);
 	}
 
 	/*
 	 * Pass two ... free the dentries for this superblock.
+	 * dcache_lru_lock has to be dropped to take each d_lock
+	 * in order, so every dentry restarts the walk.
 	 */
 repeat:
 	list_for_each_safe(tmp, next, &dentry_unused) {
 		dentry = list_entry(tmp, struct dentry, d_lru);
 		if (dentry->d_sb != sb)
 			continue;
+		if (!spin_trylock(&dentry->d_lock)) {
+			spin_unlock(&dcache_lru_lock);
+			cpu_relax();
+			spin_lock(&dcache_lru_lock);
+			goto repeat;
+		}
 		dentry_stat.nr_unused--;
 		list_del_init(tmp);
-		spin_lock(&dentry->d_lock);
-		if (atomic_read(&dentry->d_count)) {
+		spin_unlock(&dcache_lru_lock);
+		if (atomic_read(&dentry->d_count))
 			spin_unlock(&dentry->d_lock);
-			continue;
-		}
-		prune_one_dentry(dentry);
+		else
+			prune_one_dentry(dentry);
+		spin_lock(&dcache_lru_lock);
 		goto repeat;
 	}
+	spin_unlock(&dcache_lru_lock);
 	spin_unlock(&dcache_lock);
 }
 
@@ -572,19 +715,17 @@ resume:
 		struct dentry *dentry = list_entry(tmp, struct dentry, d_u.d_child);
 		next = tmp->next;
 
-		if (!list_empty(&dentry->d_lru)) {
-			dentry_stat.nr_unused--;
-			list_del_init(&dentry->d_lru);
-		}
 		/* 
 		 * move only zero ref count dentries to the end 
 		 * of the unused list for prune_dcache
 		 */
+		spin_lock(&dentry->d_lock);
 		if (!atomic_read(&dentry->d_count)) {
-			list_add(&dentry->d_lru, dentry_unused.prev);
-			dentry_stat.nr_unused++;
+			dentry_lru_move_tail(dentry);
 			found++;
-		}
+		} else
+			dentry_lru_del_init(dentry);
+		spin_unlock(&dentry->d_lock);
 
 		/*
 		 * We can return to the caller if we have found some (this
@@ -644,35 +785,38 @@ void shrink_dcache_parent(struct dentry * parent)
  *
  * Prune the dentries that are anonymous
  *
- * parsing d_hash list does not hlist_for_each_entry_rcu() as it
- * done under dcache_lock.
+ * The d_hash list is walked with hlist_for_each_entry_rcu() since
+ * dentries can be unhashed from it without dcache_lock.
  *
  */
 void shrink_dcache_anon(struct hlist_head *head)
 {
 	struct hlist_node *lp;
+	struct dentry *this;
 	int found;
 	do {
 		found = 0;
-		spin_lock(&dcache_lock);
-		hlist_for_each(lp, head) {
-			struct dentry *this = hlist_entry(lp, struct dentry, d_hash);
-			if (!list_empty(&this->d_lru)) {
-				dentry_stat.nr_unused--;
-				list_del_init(&this->d_lru);
-			}
-
+		rcu_read_lock();
+		hlist_for_each_entry_rcu(this, lp, head, d_hash) {
 			/* 
 			 * move only zero ref count dentries to the end 
-			 * of the unused list for prune_dcache
+			 * of the unused list for prune_dcache.  One that
+			 * was unhashed after we found it is being killed,
+			 * and must not go back on the list.
 			 */
+			spin_lock(&this->d_lock);
+			if (d_unhashed(this)) {
+				spin_unlock(&this->d_lock);
+				continue;
+			}
 			if (!atomic_read(&this->d_count)) {
-				list_add_tail(&this->d_lru, &dentry_unused);
-				dentry_stat.nr_unused++;
+				dentry_lru_move_tail(this);
 				found++;
-			}
+			} else
+				dentry_lru_del_init(this);
+			spin_unlock(&this->d_lock);
 		}
-		spin_unlock(&dcache_lock);
+		rcu_read_unlock();
 		prune_dcache(found);
 	} while(found);
 }
@@ -880,14 +1024,6 @@ struct dentry * d_alloc_root(struct inode * root_inode)
 	return res;
 }
 
-static inline struct hlist_head *d_hash(struct dentry *parent,
-					unsigned long hash)
-{
-	hash += ((unsigned long) parent ^ GOLDEN_RATIO_PRIME) / L1_CACHE_BYTES;
-	hash = hash ^ ((hash ^ GOLDEN_RATIO_PRIME) >> D_HASHBITS);
-	return dentry_hashtable + (hash & D_HASHMASK);
-}
-
 /**
  * d_alloc_anon - allocate an anonymous dentry
  * @inode: inode to allocate the dentry for
@@ -935,10 +1071,9 @@ struct dentry * d_alloc_anon(struct inode *inode)
 		res->d_sb = inode->i_sb;
 		res->d_parent = res;
 		res->d_inode = inode;
-		res->d_flags |= DCACHE_DISCONNECTED;
-		res->d_flags &= ~DCACHE_UNHASHED;
+		res->d_flags |= DCACHE_DISCONNECTED | DCACHE_ANON_HASH;
 		list_add(&res->d_alias, &inode->i_dentry);
-		hlist_add_head(&res->d_hash, &inode->i_sb->s_anon);
+		__d_rehash(res, &inode->i_sb->s_anon);
 		spin_unlock(&res->d_lock);
 
 		inode = NULL; /* don't drop reference */
@@ -1018,8 +1153,8 @@ struct dentry *d_splice_alias(struct inode *inode, struct dentry *dentry)
  * lookup is going on.
  *
  * dentry_unused list is not updated even if lookup finds the required dentry
- * in there. It is updated in places such as prune_dcache, shrink_dcache_sb,
- * select_parent and __dget_locked. This laziness saves lookup from dcache_lock
+ * in there. It is updated in places such as prune_dcache, shrink_dcache_sb
+ * and select_parent. This laziness saves lookup from dcache_lru_lock
  * acquisition.
  *
  * d_lookup() is protected against the concurrent renames in some unrelated
@@ -1115,6 +1250,7 @@ int d_validate(struct dentry *dentry, struct dentry *dparent)
 {
 	struct hlist_head *base;
 	struct hlist_node *lhp;
+	struct dentry *this;
 
 	/* Check whether the ptr might be valid at all.. */
 	if (!kmem_ptr_validate(dentry_cache, dentry))
@@ -1124,17 +1260,20 @@ int d_validate(struct dentry *dentry, struct dentry *dparent)
 		goto out;
 
 	spin_lock(&dcache_lock);
+	rcu_read_lock();
 	base = d_hash(dparent, dentry->d_name.hash);
-	hlist_for_each(lhp,base) { 
-		/* hlist_for_each_entry_rcu() not required for d_hash list
-		 * as it is parsed under dcache_lock
+	hlist_for_each_entry_rcu(this, lhp, base, d_hash) { 
+		/* hlist_for_each_entry_rcu() is required for d_hash list
+		 * as it is changed without dcache_lock
 		 */
-		if (dentry == hlist_entry(lhp, struct dentry, d_hash)) {
+		if (dentry == this) {
 			__dget_locked(dentry);
+			rcu_read_unlock();
 			spin_unlock(&dcache_lock);
 			return 1;
 		}
 	}
+	rcu_read_unlock();
 	spin_unlock(&dcache_lock);
 out:
 	return 0;
@@ -1185,13 +1324,6 @@ void d_delete(struct dentry * dentry)
 	fsnotify_nameremove(dentry, isdir);
 }
 
-static void __d_rehash(struct dentry * entry, struct hlist_head *list)
-{
-
- 	entry->d_flags &= ~DCACHE_UNHASHED;
- 	hlist_add_head_rcu(&entry->d_hash, list);
-}
-
 /**
  * d_rehash	- add an entry back to the hash
  * @entry: dentry to add to the hash
@@ -1201,13 +1333,9 @@ static void __d_rehash(struct dentry * entry, struct hlist_head *list)
  
 void d_rehash(struct dentry * entry)
 {
-	struct hlist_head *list = d_hash(entry->d_parent, entry->d_name.hash);
-
-	spin_lock(&dcache_lock);
 	spin_lock(&entry->d_lock);
-	__d_rehash(entry, list);
+	__d_rehash(entry, d_hash(entry->d_parent, entry->d_name.hash));
 	spin_unlock(&entry->d_lock);
-	spin_unlock(&dcache_lock);
 }
 
 #define do_switch(x,y) do { \
@@ -1284,8 +1412,6 @@ static void switch_names(struct dentry *dentry, struct dentry *target)
 
 void d_move(struct dentry * dentry, struct dentry * target)
 {
-	struct hlist_head *list;
-
 	if (!dentry->d_inode)
 		printk(KERN_WARNING "VFS: moving negative dcache entry\n");
 
@@ -1302,15 +1428,12 @@ void d_move(struct dentry * dentry, struct dentry * target)
 		spin_lock(&target->d_lock);
 	}
 
-	/* Move the dentry to the target hash queue, if on different bucket */
-	if (dentry->d_flags & DCACHE_UNHASHED)
-		goto already_unhashed;
-
-	hlist_del_rcu(&dentry->d_hash);
-
-already_unhashed:
-	list = d_hash(target->d_parent, target->d_name.hash);
-	__d_rehash(dentry, list);
+	/*
+	 * Move the dentry to the target hash queue.  The old and new
+	 * chains may share a lock, so they are taken one at a time.
+	 */
+	__d_drop(dentry);
+	__d_rehash(dentry, d_hash(target->d_parent, target->d_name.hash));
 
 	/* Unhash the target: dput() will then get rid of it */
 	__d_drop(target);
@@ -1648,6 +1771,9 @@ static void __init dcache_init_early(void)
 {
 	int loop;
 
+	for (loop = 0; loop < (1 << D_HASH_LOCK_BITS); loop++)
+		spin_lock_init(&dcache_hash_locks[loop].lock);
+
 	/* If hashes are distributed across NUMA nodes, defer
 	 * hash allocation until vmalloc space is available.
 	 */
@@ -1744,6 +1870,7 @@ void __init vfs_caches_init(unsigned long mempages)
 	chrdev_init();
 }
 
+EXPORT_SYMBOL(__d_drop);
 EXPORT_SYMBOL(d_alloc);
 EXPORT_SYMBOL(d_alloc_anon);
 EXPORT_SYMBOL(d_alloc_root);
@@ -659,23 +659,22 @@ static int dqinit_needed(struct inode *inode, int type)
 /* This routine is guarded by dqonoff_sem semaphore */
 static void add_dquot_ref(struct super_block *sb, int type)
 {
-	struct list_head *p;
+	struct file *filp;
 
 restart:
-	file_list_lock();
-	list_for_each(p, &sb->s_files) {
-		struct file *filp = list_entry(p, struct file, f_u.fu_list);
+	file_sb_list_lock_all();
+	do_file_list_for_each_entry(sb, filp) {
 		struct inode *inode = filp->f_dentry->d_inode;
 		if (filp->f_mode & FMODE_WRITE && dqinit_needed(inode, type)) {
 			struct dentry *dentry = dget(filp->f_dentry);
-			file_list_unlock();
+			file_sb_list_unlock_all();
 			sb->dq_op->initialize(inode, type);
 			dput(dentry);
 			/* As we may have blocked we had better restart... */
 			goto restart;
 		}
-	}
-	file_list_unlock();
+	} while_file_list_for_each_entry;
+	file_sb_list_unlock_all();
 }
 
 /* Return 0 if dqput() won't block (note that 1 doesn't necessarily mean blocking) */
@@ -650,12 +650,18 @@ claim_block(spinlock_t *lock, int block, struct buffer_head *bh)
  * If we failed to allocate the desired block then we may end up crossing to a
  * new bitmap.  In that case we must release write access to the old one via
  * ext3_journal_release_buffer(), else we'll run out of credits.
+ *
+ * Once the first block is claimed, the blocks following it are claimed too
+ * while they are free, up to *count blocks in all and without leaving the
+ * window.  *count is set to the number of blocks claimed.
  */
 static int
 ext3_try_to_allocate(struct super_block *sb, handle_t *handle, int group,
-	struct buffer_head *bitmap_bh, int goal, struct ext3_reserve_window *my_rsv)
+	struct buffer_head *bitmap_bh, int goal, unsigned long *count,
+	struct ext3_reserve_window *my_rsv)
 {
 	int group_first_block, start, end;
+	unsigned long num = 0;
 
 	/* we do allocation within the reservation window if we have a window */
 	if (my_rsv) {
@@ -713,8 +719,18 @@ repeat:
 			goto fail_access;
 		goto repeat;
 	}
-	return goal;
+	num++;
+	goal++;
+	while (num < *count && goal < end &&
+	       ext3_test_allocatable(goal, bitmap_bh) &&
+	       claim_block(sb_bgl_lock(EXT3_SB(sb), group), goal, bitmap_bh)) {
+		num++;
+		goal++;
+	}
+	*count = num;
+	return goal - num;
 fail_access:
+	*count = num;
 	return -1;
 }
 
@@ -999,6 +1015,37 @@ retry:
 	goto retry;
 }
 
+/*
+ * Grow the reservation window by @size blocks, or up to the next window if
+ * that is nearer, so that a multi-block request can be met from it.  It is
+ * only an optimisation, so give up if the lock is busy.
+ */
+static void try_to_extend_reservation(struct ext3_reserve_window_node *my_rsv,
+			struct super_block *sb, int size)
+{
+	struct ext3_reserve_window_node *next_rsv;
+	struct rb_node *next;
+	spinlock_t *rsv_lock = &EXT3_SB(sb)->s_rsv_window_lock;
+
+	if (!spin_trylock(rsv_lock))
+		return;
+
+	next = rb_next(&my_rsv->rsv_node);
+
+	if (!next)
+		my_rsv->rsv_end += size;
+	else {
+		next_rsv = rb_entry(next, struct ext3_reserve_window_node,
+				    rsv_node);
+
+		if ((next_rsv->rsv_start - my_rsv->rsv_end - 1) >= size)
+			my_rsv->rsv_end += size;
+		else
+			my_rsv->rsv_end = next_rsv->rsv_start - 1;
+	}
+	spin_unlock(rsv_lock);
+}
+
 /*
  * This is the main function used to allocate a new block and its reservation
  * window.
@@ -1024,9 +1071,10 @@ static int
 ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 			unsigned int group, struct buffer_head *bitmap_bh,
 			int goal, struct ext3_reserve_window_node * my_rsv,
-			int *errp)
+			unsigned long *count, int *errp)
 {
 	unsigned long group_first_block;
+	unsigned long num;
 	int ret = 0;
 	int fatal;
 
@@ -1051,7 +1099,8 @@ ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 	 * or last attempt to allocate a block with reservation turned on failed
 	 */
 	if (my_rsv == NULL ) {
-		ret = ext3_try_to_allocate(sb, handle, group, bitmap_bh, goal, NULL);
+		ret = ext3_try_to_allocate(sb, handle, group, bitmap_bh, goal,
+					   count, NULL);
 		goto out;
 	}
 	/*
@@ -1081,6 +1130,10 @@ ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 	while (1) {
 		if (rsv_is_empty(&my_rsv->rsv_window) || (ret < 0) ||
 			!goal_in_my_reservation(&my_rsv->rsv_window, goal, group, sb)) {
+			/* make the new window big enough for the request */
+			if (my_rsv->rsv_goal_size < *count)
+				my_rsv->rsv_goal_size = min_t(unsigned long,
+					*count, EXT3_MAX_RESERVE_BLOCKS);
 			ret = alloc_new_reservation(my_rsv, goal, sb,
 							group, bitmap_bh);
 			if (ret < 0)
@@ -1088,14 +1141,23 @@ ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 
 			if (!goal_in_my_reservation(&my_rsv->rsv_window, goal, group, sb))
 				goal = -1;
+		} else if (goal >= 0) {
+			int curr = my_rsv->rsv_end -
+					(goal + group_first_block) + 1;
+
+			if (curr < *count)
+				try_to_extend_reservation(my_rsv, sb,
+							*count - curr);
 		}
 		if ((my_rsv->rsv_start >= group_first_block + EXT3_BLOCKS_PER_GROUP(sb))
 		    || (my_rsv->rsv_end < group_first_block))
 			BUG();
+		num = *count;
 		ret = ext3_try_to_allocate(sb, handle, group, bitmap_bh, goal,
-					   &my_rsv->rsv_window);
+					   &num, &my_rsv->rsv_window);
 		if (ret >= 0) {
-			my_rsv->rsv_alloc_hit++;
+			my_rsv->rsv_alloc_hit += num;
+			*count = num;
 			break;				/* succeed */
 		}
 	}
@@ -1116,18 +1178,43 @@ out:
 	return ret;
 }
 
-static int ext3_has_free_blocks(struct ext3_sb_info *sbi)
+/*
+ * Blocks reserved for delayed allocation count as used: they will be
+ * allocated at writeback, with a few more for the extent tree.
+ */
+static int ext3_has_free_blocks(struct ext3_sb_info *sbi, unsigned long nblocks)
 {
-	int free_blocks, root_blocks;
+	long free_blocks, dirty_blocks, root_blocks;
 
 	free_blocks = percpu_counter_read_positive(&sbi->s_freeblocks_counter);
+	dirty_blocks = percpu_counter_read(&sbi->s_dirtyblocks_counter);
 	root_blocks = le32_to_cpu(sbi->s_es->s_r_blocks_count);
-	if (free_blocks < root_blocks + 1 && !capable(CAP_SYS_RESOURCE) &&
+	if (dirty_blocks > 0)
+		free_blocks -= dirty_blocks + dirty_blocks / 64;
+	if (free_blocks < root_blocks + (long)nblocks &&
+		!capable(CAP_SYS_RESOURCE) &&
 		sbi->s_resuid != current->fsuid &&
 		(sbi->s_resgid == 0 || !in_group_p (sbi->s_resgid))) {
 		return 0;
 	}
-	return 1;
+	return free_blocks >= (long)nblocks;
+}
+
+/*
+ * Reserve @nblocks for delayed allocation.  ext3_release_blocks() gives
+ * them back, when they are allocated or the dirty data is thrown away.
+ */
+int ext3_claim_free_blocks(struct ext3_sb_info *sbi, unsigned long nblocks)
+{
+	if (!ext3_has_free_blocks(sbi, nblocks))
+		return -ENOSPC;
+	percpu_counter_mod(&sbi->s_dirtyblocks_counter, nblocks);
+	return 0;
+}
+
+void ext3_release_blocks(struct ext3_sb_info *sbi, unsigned long nblocks)
+{
+	percpu_counter_mod(&sbi->s_dirtyblocks_counter, -(long)nblocks);
 }
 
 /*
@@ -1138,7 +1225,7 @@ static int ext3_has_free_blocks(struct ext3_sb_info *sbi)
  */
 int ext3_should_retry_alloc(struct super_block *sb, int *retries)
 {
-	if (!ext3_has_free_blocks(EXT3_SB(sb)) || (*retries)++ > 3)
+	if (!ext3_has_free_blocks(EXT3_SB(sb), 1) || (*retries)++ > 3)
 		return 0;
 
 	jbd_debug(1, "%s: retrying operation after ENOSPC\n", sb->s_id);
@@ -1147,15 +1234,25 @@ int ext3_should_retry_alloc(struct super_block *sb, int *retries)
 }
 
 /*
- * ext3_new_block uses a goal block to assist allocation.  If the goal is
+ * ext3_new_blocks uses a goal block to assist allocation.  If the goal is
  * free, or there is a free block within 32 blocks of the goal, that block
  * is allocated.  Otherwise a forward search is made for a free block; within 
  * each block group the search first looks for an entire free byte in the block
  * bitmap, and then for any free bit if that fails.
- * This function also updates quota and i_blocks field.
+ *
+ * Up to *count blocks are allocated, all contiguous, starting at the block
+ * returned; *count is set to the number actually allocated, which is at
+ * least one on success.  This costs the same journal credits as allocating
+ * a single block: one bitmap and one group descriptor.  A request the
+ * inode's quota can't hold in full is cut down to fit.
+ *
+ * This function also updates quota and i_blocks field, unless @delayed:
+ * the blocks are then for delayed buffers, which write() already charged
+ * to quota.
  */
-int ext3_new_block(handle_t *handle, struct inode *inode,
-			unsigned long goal, int *errp)
+int ext3_new_blocks(handle_t *handle, struct inode *inode,
+			unsigned long goal, unsigned long *count, int *errp,
+			int delayed)
 {
 	struct buffer_head *bitmap_bh = NULL;
 	struct buffer_head *gdp_bh;
@@ -1178,6 +1275,7 @@ int ext3_new_block(handle_t *handle, struct inode *inode,
 	static int goal_hits, goal_attempts;
 #endif
 	unsigned long ngroups;
+	unsigned long num = *count;	/* blocks wanted, then allocated */
 
 	*errp = -ENOSPC;
 	sb = inode->i_sb;
@@ -1187,12 +1285,18 @@ int ext3_new_block(handle_t *handle, struct inode *inode,
 	}
 
 	/*
-	 * Check quota for allocation of this block.
+	 * Check quota for allocation of these blocks.  If the whole request
+	 * doesn't fit, halve it until it does rather than fail an allocation
+	 * the remaining quota still has room for.
 	 */
-	if (DQUOT_ALLOC_BLOCK(inode, 1)) {
-		*errp = -EDQUOT;
-		return 0;
+	while (!delayed && DQUOT_ALLOC_BLOCK(inode, num)) {
+		if (num == 1) {
+			*errp = -EDQUOT;
+			return 0;
+		}
+		num >>= 1;
 	}
+	*count = num;
 
 	sbi = EXT3_SB(sb);
 	es = EXT3_SB(sb)->s_es;
@@ -1209,7 +1313,7 @@ int ext3_new_block(handle_t *handle, struct inode *inode,
 	if (block_i && ((windowsz = block_i->rsv_window_node.rsv_goal_size) > 0))
 		my_rsv = &block_i->rsv_window_node;
 
-	if (!ext3_has_free_blocks(sbi)) {
+	if (!ext3_has_free_blocks(sbi, 1)) {
 		*errp = -ENOSPC;
 		goto out;
 	}
@@ -1243,8 +1347,10 @@ retry:
 		bitmap_bh = read_block_bitmap(sb, group_no);
 		if (!bitmap_bh)
 			goto io_error;
+		num = *count;
 		ret_block = ext3_try_to_allocate_with_rsv(sb, handle, group_no,
-					bitmap_bh, ret_block, my_rsv, &fatal);
+					bitmap_bh, ret_block, my_rsv,
+					&num, &fatal);
 		if (fatal)
 			goto out;
 		if (ret_block >= 0)
@@ -1280,8 +1386,9 @@ retry:
 		bitmap_bh = read_block_bitmap(sb, group_no);
 		if (!bitmap_bh)
 			goto io_error;
+		num = *count;
 		ret_block = ext3_try_to_allocate_with_rsv(sb, handle, group_no,
-					bitmap_bh, -1, my_rsv, &fatal);
+					bitmap_bh, -1, my_rsv, &num, &fatal);
 		if (fatal)
 			goto out;
 		if (ret_block >= 0) 
@@ -1316,13 +1423,15 @@ allocated:
 	target_block = ret_block + group_no * EXT3_BLOCKS_PER_GROUP(sb)
 				+ le32_to_cpu(es->s_first_data_block);
 
-	if (target_block == le32_to_cpu(gdp->bg_block_bitmap) ||
-	    target_block == le32_to_cpu(gdp->bg_inode_bitmap) ||
+	if (in_range(le32_to_cpu(gdp->bg_block_bitmap), target_block, num) ||
+	    in_range(le32_to_cpu(gdp->bg_inode_bitmap), target_block, num) ||
 	    in_range(target_block, le32_to_cpu(gdp->bg_inode_table),
+		      EXT3_SB(sb)->s_itb_per_group) ||
+	    in_range(target_block + num - 1, le32_to_cpu(gdp->bg_inode_table),
 		      EXT3_SB(sb)->s_itb_per_group))
 		ext3_error(sb, "ext3_new_block",
 			    "Allocating block in system zone - "
-			    "block = %u", target_block);
+			    "blocks from %u, length %lu", target_block, num);
 
 	performed_allocation = 1;
 
@@ -1355,7 +1464,7 @@ allocated:
 	/* ret_block was blockgroup-relative.  Now it becomes fs-relative */
 	ret_block = target_block;
 
-	if (ret_block >= le32_to_cpu(es->s_blocks_count)) {
+	if (ret_block + num - 1 >= le32_to_cpu(es->s_blocks_count)) {
 		ext3_error(sb, "ext3_new_block",
 			    "block(%d) >= blocks count(%d) - "
 			    "block_group = %d, es == %p ", ret_block,
@@ -1373,9 +1482,9 @@ allocated:
 
 	spin_lock(sb_bgl_lock(sbi, group_no));
 	gdp->bg_free_blocks_count =
-			cpu_to_le16(le16_to_cpu(gdp->bg_free_blocks_count) - 1);
+			cpu_to_le16(le16_to_cpu(gdp->bg_free_blocks_count) - num);
 	spin_unlock(sb_bgl_lock(sbi, group_no));
-	percpu_counter_mod(&sbi->s_freeblocks_counter, -1);
+	percpu_counter_mod(&sbi->s_freeblocks_counter, -num);
 
 	BUFFER_TRACE(gdp_bh, "journal_dirty_metadata for group descriptor");
 	err = ext3_journal_dirty_metadata(handle, gdp_bh);
@@ -1388,6 +1497,9 @@ allocated:
 
 	*errp = 0;
 	brelse(bitmap_bh);
+	if (!delayed)
+		DQUOT_FREE_BLOCK(inode, *count - num);
+	*count = num;
 	return ret_block;
 
 io_error:
@@ -1400,12 +1512,20 @@ out:
 	/*
 	 * Undo the block allocation
 	 */
-	if (!performed_allocation)
-		DQUOT_FREE_BLOCK(inode, 1);
+	if (!performed_allocation && !delayed)
+		DQUOT_FREE_BLOCK(inode, *count);
 	brelse(bitmap_bh);
 	return 0;
 }
 
+int ext3_new_block(handle_t *handle, struct inode *inode,
+			unsigned long goal, int *errp)
+{
+	unsigned long count = 1;
+
+	return ext3_new_blocks(handle, inode, goal, &count, errp, 0);
+}
+
 unsigned long ext3_count_free_blocks(struct super_block *sb)
 {
 	unsigned long desc_count;
@@ -0,0 +1,961 @@
+/*
+ *  linux/fs/ext3/extents.c
+ *
+ * Extent-mapped files.
+ *
+ * A regular file created while the filesystem is mounted with -o extents
+ * gets EXT3_EXTENTS_FL and maps its blocks with a tree of extents
+ * (include/linux/ext3_extents.h) instead of direct and indirect blocks.
+ * A contiguous run of up to 32768 blocks costs one 12-byte entry, so a big
+ * file needs a handful of metadata blocks rather than one indirect block
+ * per thousand data blocks, and truncating it frees whole runs at a time.
+ *
+ * Changes to the tree, and lookups which miss the per-inode extent cache,
+ * are serialised by the inode's truncate_sem, as changes to the indirect
+ * tree are.  As with the indirect tree, the tree on disk must be consistent
+ * whenever a transaction can commit, so that truncate can be restarted
+ * from the orphan list after a crash.
+ */
+
+#include <linux/config.h>
+#include <linux/time.h>
+#include <linux/fs.h>
+#include <linux/jbd.h>
+#include <linux/ext3_fs.h>
+#include <linux/ext3_jbd.h>
+#include <linux/ext3_extents.h>
+#include <linux/buffer_head.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+
+#define EXT_MAX_BLOCK	0xffffffffUL
+
+/* capacity of the root in i_data and of a tree block; both entry kinds
+ * are 12 bytes */
+static inline int ext3_ext_space_root(struct inode *inode)
+{
+	return (sizeof(EXT3_I(inode)->i_data) -
+		sizeof(struct ext3_extent_header)) / sizeof(struct ext3_extent);
+}
+
+static inline int ext3_ext_space_block(struct inode *inode)
+{
+	return (inode->i_sb->s_blocksize - sizeof(struct ext3_extent_header)) /
+		sizeof(struct ext3_extent);
+}
+
+static int ext3_ext_check_header(struct inode *inode,
+		struct ext3_extent_header *eh, int depth, int root)
+{
+	int max = root ? ext3_ext_space_root(inode) :
+			 ext3_ext_space_block(inode);
+	const char *error_msg;
+
+	if (le16_to_cpu(eh->eh_magic) != EXT3_EXT_MAGIC)
+		error_msg = "invalid magic";
+	else if (le16_to_cpu(eh->eh_depth) != depth)
+		error_msg = "unexpected depth";
+	else if (le16_to_cpu(eh->eh_max) == 0 || le16_to_cpu(eh->eh_max) > max)
+		error_msg = "invalid eh_max";
+	else if (le16_to_cpu(eh->eh_entries) > le16_to_cpu(eh->eh_max))
+		error_msg = "invalid eh_entries";
+	else if (depth && !eh->eh_entries)
+		error_msg = "empty index node";
+	else
+		return 0;
+
+	ext3_error(inode->i_sb, "ext3_ext_check_header",
+		   "bad extent header in inode #%lu: %s - magic %x, "
+		   "entries %u, max %u, depth %u (expected %d)",
+		   inode->i_ino, error_msg, le16_to_cpu(eh->eh_magic),
+		   le16_to_cpu(eh->eh_entries), le16_to_cpu(eh->eh_max),
+		   le16_to_cpu(eh->eh_depth), depth);
+	return -EIO;
+}
+
+/*
+ * Sanity check the root of an inode just read from disk.
+ */
+int ext3_ext_check_inode(struct inode *inode)
+{
+	int depth = ext_depth(inode);
+
+	if (depth > EXT3_EXT_MAX_DEPTH) {
+		ext3_error(inode->i_sb, "ext3_ext_check_inode",
+			   "inode #%lu: extent tree too deep (%d)",
+			   inode->i_ino, depth);
+		return -EIO;
+	}
+	return ext3_ext_check_header(inode, ext_inode_hdr(inode), depth, 1);
+}
+
+void ext3_ext_tree_init(struct inode *inode)
+{
+	struct ext3_extent_header *eh = ext_inode_hdr(inode);
+
+	eh->eh_magic = cpu_to_le16(EXT3_EXT_MAGIC);
+	eh->eh_entries = 0;
+	eh->eh_max = cpu_to_le16(ext3_ext_space_root(inode));
+	eh->eh_depth = 0;
+	eh->eh_generation = 0;
+}
+
+/*
+ * The extent cache
+ */
+void ext3_ext_invalidate_cache(struct inode *inode)
+{
+	struct ext3_inode_info *ei = EXT3_I(inode);
+
+	spin_lock(&ei->i_cached_lock);
+	ei->i_cached_len = 0;
+	spin_unlock(&ei->i_cached_lock);
+}
+
+static void ext3_ext_put_in_cache(struct inode *inode, unsigned long block,
+				  unsigned long len, unsigned long start)
+{
+	struct ext3_inode_info *ei = EXT3_I(inode);
+
+	spin_lock(&ei->i_cached_lock);
+	ei->i_cached_block = block;
+	ei->i_cached_len = len;
+	ei->i_cached_start = start;
+	spin_unlock(&ei->i_cached_lock);
+}
+
+/*
+ * If @block is in the cached extent, return 1 with its physical block in
+ * *start and the number of blocks mapped from it on in *len.
+ */
+static int ext3_ext_in_cache(struct inode *inode, unsigned long block,
+			     unsigned long *start, unsigned long *len)
+{
+	struct ext3_inode_info *ei = EXT3_I(inode);
+	int ret = 0;
+
+	spin_lock(&ei->i_cached_lock);
+	if (ei->i_cached_len && block >= ei->i_cached_block &&
+	    block - ei->i_cached_block < ei->i_cached_len) {
+		*start = ei->i_cached_start + (block - ei->i_cached_block);
+		*len = ei->i_cached_len - (block - ei->i_cached_block);
+		ret = 1;
+	}
+	spin_unlock(&ei->i_cached_lock);
+	return ret;
+}
+
+/*
+ * Lookup
+ */
+static void ext3_ext_drop_refs(struct ext3_ext_path *path)
+{
+	int depth = path->p_depth;
+	int i;
+
+	for (i = 0; i <= depth; i++, path++) {
+		if (path->p_bh) {
+			brelse(path->p_bh);
+			path->p_bh = NULL;
+		}
+	}
+}
+
+/* the last index whose range starts at or before @block, else the first */
+static void ext3_ext_binsearch_idx(struct ext3_ext_path *path,
+				   unsigned long block)
+{
+	struct ext3_extent_header *eh = path->p_hdr;
+	struct ext3_extent_idx *l, *r, *m;
+
+	l = EXT_FIRST_INDEX(eh) + 1;
+	r = EXT_LAST_INDEX(eh);
+	while (l <= r) {
+		m = l + (r - l) / 2;
+		if (block < le32_to_cpu(m->ei_block))
+			r = m - 1;
+		else
+			l = m + 1;
+	}
+	path->p_idx = l - 1;
+}
+
+/* the last extent starting at or before @block, else the first, else NULL */
+static void ext3_ext_binsearch(struct ext3_ext_path *path, unsigned long block)
+{
+	struct ext3_extent_header *eh = path->p_hdr;
+	struct ext3_extent *l, *r, *m;
+
+	if (!eh->eh_entries) {
+		path->p_ext = NULL;
+		return;
+	}
+	l = EXT_FIRST_EXTENT(eh) + 1;
+	r = EXT_LAST_EXTENT(eh);
+	while (l <= r) {
+		m = l + (r - l) / 2;
+		if (block < le32_to_cpu(m->ee_block))
+			r = m - 1;
+		else
+			l = m + 1;
+	}
+	path->p_ext = l - 1;
+}
+
+/*
+ * Walk from the root to the leaf which should hold @block.  @path must
+ * have room for EXT3_EXT_MAX_DEPTH + 1 levels; path[0].p_depth is the
+ * depth of the tree.  Release it with ext3_ext_drop_refs().
+ */
+static int ext3_ext_find_extent(struct inode *inode, unsigned long block,
+				struct ext3_ext_path *path)
+{
+	struct ext3_extent_header *eh = ext_inode_hdr(inode);
+	struct buffer_head *bh;
+	int depth = ext_depth(inode);
+	int i, err;
+
+	err = ext3_ext_check_inode(inode);
+	if (err)
+		return err;
+
+	memset(path, 0, sizeof(*path) * (depth + 1));
+	path[0].p_hdr = eh;
+	path[0].p_depth = depth;
+
+	for (i = 0; i < depth; i++) {
+		ext3_ext_binsearch_idx(path + i, block);
+		path[i + 1].p_block = idx_pblock(path[i].p_idx);
+		path[i + 1].p_depth = depth - i - 1;
+		bh = sb_bread(inode->i_sb, path[i + 1].p_block);
+		if (!bh) {
+			err = -EIO;
+			goto err;
+		}
+		path[i + 1].p_bh = bh;
+		eh = ext_block_hdr(bh);
+		path[i + 1].p_hdr = eh;
+		err = ext3_ext_check_header(inode, eh, depth - i - 1, 0);
+		if (err)
+			goto err;
+	}
+	ext3_ext_binsearch(path + depth, block);
+	return 0;
+
+err:
+	ext3_ext_drop_refs(path);
+	return err;
+}
+
+/*
+ * The first allocated block after @block, which the lookup in @path went
+ * to, or EXT_MAX_BLOCK if there is none.
+ */
+static unsigned long ext3_ext_next_allocated_block(struct ext3_ext_path *path,
+						   unsigned long block)
+{
+	int depth = path->p_depth;
+	struct ext3_extent *ex = path[depth].p_ext;
+	int i;
+
+	if (ex) {
+		if (block < le32_to_cpu(ex->ee_block))
+			return le32_to_cpu(ex->ee_block);
+		if (ex != EXT_LAST_EXTENT(path[depth].p_hdr))
+			return le32_to_cpu(ex[1].ee_block);
+	}
+	for (i = depth - 1; i >= 0; i--)
+		if (path[i].p_idx != EXT_LAST_INDEX(path[i].p_hdr))
+			return le32_to_cpu(path[i].p_idx[1].ei_block);
+	return EXT_MAX_BLOCK;
+}
+
+/*
+ * Where to look for a block to map @block: right after (or before) the
+ * extent next to it, so that the file stays contiguous; else near the leaf;
+ * else in the inode's group, coloured by pid like ext3_find_near().
+ */
+static unsigned long ext3_ext_find_goal(struct inode *inode,
+				struct ext3_ext_path *path, unsigned long block)
+{
+	struct super_block *sb = inode->i_sb;
+	int depth = path->p_depth;
+	struct ext3_extent *ex = path[depth].p_ext;
+	unsigned long bg_start;
+	unsigned long colour;
+
+	if (ex) {
+		unsigned long eblock = le32_to_cpu(ex->ee_block);
+		unsigned long estart = ext_pblock(ex);
+
+		if (block >= eblock)
+			return estart + (block - eblock);
+		if (estart > eblock - block)
+			return estart - (eblock - block);
+		return estart;
+	}
+	if (path[depth].p_bh)
+		return path[depth].p_bh->b_blocknr;
+
+	bg_start = (EXT3_I(inode)->i_block_group * EXT3_BLOCKS_PER_GROUP(sb)) +
+		le32_to_cpu(EXT3_SB(sb)->s_es->s_first_data_block);
+	colour = (current->pid % 16) * (EXT3_BLOCKS_PER_GROUP(sb) / 16);
+	return bg_start + colour;
+}
+
+/*
+ * Modifying the tree
+ */
+static int ext3_ext_get_access(handle_t *handle, struct ext3_ext_path *path)
+{
+	/* the root lives in the inode, which ext3_ext_dirty() journals */
+	if (path->p_bh)
+		return ext3_journal_get_write_access(handle, path->p_bh);
+	return 0;
+}
+
+static int ext3_ext_dirty(handle_t *handle, struct inode *inode,
+			  struct ext3_ext_path *path)
+{
+	if (path->p_bh)
+		return ext3_journal_dirty_metadata(handle, path->p_bh);
+	return ext3_mark_inode_dirty(handle, inode);
+}
+
+/*
+ * Allocate and set up an empty tree block at @depth.  The caller fills it
+ * in and journals it.
+ */
+static struct buffer_head *ext3_ext_new_block(handle_t *handle,
+		struct inode *inode, unsigned long goal, int depth, int *err)
+{
+	struct ext3_extent_header *eh;
+	struct buffer_head *bh;
+	unsigned long newblock;
+
+	newblock = ext3_new_block(handle, inode, goal, err);
+	if (!newblock)
+		return NULL;
+
+	bh = sb_getblk(inode->i_sb, newblock);
+	if (!bh) {
+		*err = -EIO;
+		goto fail;
+	}
+	lock_buffer(bh);
+	BUFFER_TRACE(bh, "call get_create_access");
+	*err = ext3_journal_get_create_access(handle, bh);
+	if (*err) {
+		unlock_buffer(bh);
+		brelse(bh);
+		goto fail;
+	}
+	memset(bh->b_data, 0, bh->b_size);
+	eh = ext_block_hdr(bh);
+	eh->eh_magic = cpu_to_le16(EXT3_EXT_MAGIC);
+	eh->eh_max = cpu_to_le16(ext3_ext_space_block(inode));
+	eh->eh_depth = cpu_to_le16(depth);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+	return bh;
+
+fail:
+	ext3_free_blocks(handle, inode, newblock, 1);
+	return NULL;
+}
+
+/*
+ * Insert an index entry for the node at @ptr, covering from @logical on,
+ * after the entry the lookup in @curp went through.  There must be room.
+ */
+static int ext3_ext_insert_index(handle_t *handle, struct inode *inode,
+				 struct ext3_ext_path *curp,
+				 unsigned long logical, unsigned long ptr)
+{
+	struct ext3_extent_header *eh = curp->p_hdr;
+	struct ext3_extent_idx *ix = curp->p_idx + 1;
+	int len;
+	int err;
+
+	err = ext3_ext_get_access(handle, curp);
+	if (err)
+		return err;
+
+	len = EXT_LAST_INDEX(eh) - ix + 1;
+	if (len > 0)
+		memmove(ix + 1, ix, len * sizeof(struct ext3_extent_idx));
+	ix->ei_block = cpu_to_le32(logical);
+	ext3_idx_store_pblock(ix, ptr);
+	ix->ei_unused = 0;
+	eh->eh_entries = cpu_to_le16(le16_to_cpu(eh->eh_entries) + 1);
+
+	return ext3_ext_dirty(handle, inode, curp);
+}
+
+/*
+ * The leaf in @path has no room for @newext, nor have the index nodes
+ * below level @at, which has.  Give each of the full levels a new node for
+ * everything right of the insertion point, and hook the new nodes in at
+ * @at.  When appending, which is the common case, nothing moves and the
+ * new leaf starts out empty.
+ *
+ * All new blocks are allocated before anything is changed, so failing
+ * to allocate leaves the tree as it was.
+ */
+static int ext3_ext_split(handle_t *handle, struct inode *inode,
+			  struct ext3_ext_path *path,
+			  struct ext3_extent *newext, int at)
+{
+	struct buffer_head *bh[EXT3_EXT_MAX_DEPTH + 1];
+	int depth = ext_depth(inode);
+	struct ext3_extent_header *eh = path[depth].p_hdr;
+	struct ext3_extent *ex = path[depth].p_ext;
+	struct ext3_extent_header *neh;
+	unsigned long border;
+	unsigned long goal;
+	int i, m, err = 0;
+
+	if (ex != EXT_LAST_EXTENT(eh))
+		border = le32_to_cpu(ex[1].ee_block);
+	else
+		border = le32_to_cpu(newext->ee_block);
+
+	memset(bh, 0, sizeof(bh));
+	goal = ext3_ext_find_goal(inode, path, le32_to_cpu(newext->ee_block));
+	for (i = depth; i > at; i--) {
+		bh[i] = ext3_ext_new_block(handle, inode, goal,
+					   depth - i, &err);
+		if (!bh[i])
+			goto fail;
+	}
+
+	/* the new leaf gets the extents right of the insertion point */
+	neh = ext_block_hdr(bh[depth]);
+	m = EXT_LAST_EXTENT(eh) - ex;
+	if (m) {
+		memmove(EXT_FIRST_EXTENT(neh), ex + 1,
+			m * sizeof(struct ext3_extent));
+		neh->eh_entries = cpu_to_le16(m);
+	}
+	err = ext3_journal_dirty_metadata(handle, bh[depth]);
+	if (err)
+		goto out;
+	if (m) {
+		err = ext3_ext_get_access(handle, path + depth);
+		if (err)
+			goto out;
+		eh->eh_entries = cpu_to_le16(le16_to_cpu(eh->eh_entries) - m);
+		err = ext3_ext_dirty(handle, inode, path + depth);
+		if (err)
+			goto out;
+	}
+
+	/* each new index node points at the new node below it first */
+	for (i = depth - 1; i > at; i--) {
+		struct ext3_extent_idx *ix = path[i].p_idx;
+		struct ext3_extent_idx *first;
+
+		neh = ext_block_hdr(bh[i]);
+		first = EXT_FIRST_INDEX(neh);
+		first->ei_block = cpu_to_le32(border);
+		ext3_idx_store_pblock(first, bh[i + 1]->b_blocknr);
+		m = EXT_LAST_INDEX(path[i].p_hdr) - ix;
+		if (m)
+			memmove(first + 1, ix + 1,
+				m * sizeof(struct ext3_extent_idx));
+		neh->eh_entries = cpu_to_le16(m + 1);
+		err = ext3_journal_dirty_metadata(handle, bh[i]);
+		if (err)
+			goto out;
+		if (m) {
+			err = ext3_ext_get_access(handle, path + i);
+			if (err)
+				goto out;
+			path[i].p_hdr->eh_entries =
+			    cpu_to_le16(le16_to_cpu(path[i].p_hdr->eh_entries) - m);
+			err = ext3_ext_dirty(handle, inode, path + i);
+			if (err)
+				goto out;
+		}
+	}
+
+	err = ext3_ext_insert_index(handle, inode, path + at, border,
+				    bh[at + 1]->b_blocknr);
+out:
+	for (i = at + 1; i <= depth; i++)
+		brelse(bh[i]);
+	return err;
+
+fail:
+	for (i = at + 1; i <= depth; i++) {
+		if (!bh[i])
+			continue;
+		ext3_forget(handle, 1, inode, bh[i], bh[i]->b_blocknr);
+		ext3_free_blocks(handle, inode, bh[i]->b_blocknr, 1);
+	}
+	return err;
+}
+
+/*
+ * Every level of the tree is full: move the root's entries to a new block
+ * and make the root an index with that block as its only entry.  The tree
+ * gets one level deeper.
+ */
+static int ext3_ext_grow_indepth(handle_t *handle, struct inode *inode,
+				 struct ext3_ext_path *path,
+				 struct ext3_extent *newext)
+{
+	struct ext3_extent_header *root = ext_inode_hdr(inode);
+	struct ext3_extent_header *neh;
+	struct ext3_extent_idx *ix;
+	struct buffer_head *bh;
+	int depth = ext_depth(inode);
+	unsigned long goal;
+	int err;
+
+	if (depth >= EXT3_EXT_MAX_DEPTH) {
+		ext3_error(inode->i_sb, "ext3_ext_grow_indepth",
+			   "inode #%lu: extent tree too deep", inode->i_ino);
+		return -EIO;
+	}
+
+	goal = ext3_ext_find_goal(inode, path, le32_to_cpu(newext->ee_block));
+	bh = ext3_ext_new_block(handle, inode, goal, depth, &err);
+	if (!bh)
+		return err;
+
+	neh = ext_block_hdr(bh);
+	memmove(EXT_FIRST_INDEX(neh), EXT_FIRST_INDEX(root),
+		le16_to_cpu(root->eh_entries) * sizeof(struct ext3_extent_idx));
+	neh->eh_entries = root->eh_entries;
+	err = ext3_journal_dirty_metadata(handle, bh);
+	if (err)
+		goto out;
+
+	ix = EXT_FIRST_INDEX(root);
+	if (depth)
+		ix->ei_block = EXT_FIRST_INDEX(neh)->ei_block;
+	else
+		ix->ei_block = EXT_FIRST_EXTENT(neh)->ee_block;
+	ext3_idx_store_pblock(ix, bh->b_blocknr);
+	ix->ei_unused = 0;
+	root->eh_entries = cpu_to_le16(1);
+	root->eh_max = cpu_to_le16(ext3_ext_space_root(inode));
+	root->eh_depth = cpu_to_le16(depth + 1);
+	err = ext3_mark_inode_dirty(handle, inode);
+out:
+	brelse(bh);
+	return err;
+}
+
+static int ext3_can_extents_be_merged(struct ext3_extent *ex1,
+				      struct ext3_extent *ex2)
+{
+	unsigned long len1 = le16_to_cpu(ex1->ee_len);
+	unsigned long len2 = le16_to_cpu(ex2->ee_len);
+
+	if (le32_to_cpu(ex1->ee_block) + len1 != le32_to_cpu(ex2->ee_block))
+		return 0;
+	if (len1 + len2 > EXT3_EXT_MAX_LEN)
+		return 0;
+	return ext_pblock(ex1) + len1 == ext_pblock(ex2);
+}
+
+/*
+ * Add @newext, which must not overlap anything mapped, to the tree.  The
+ * lookup in @path is for its first block, and is redone if the tree has to
+ * be split or grown.
+ */
+static int ext3_ext_insert_extent(handle_t *handle, struct inode *inode,
+				  struct ext3_ext_path *path,
+				  struct ext3_extent *newext)
+{
+	unsigned long block = le32_to_cpu(newext->ee_block);
+	struct ext3_extent_header *eh;
+	struct ext3_extent *ex, *nearex;
+	int depth, len, at;
+	int err;
+
+repeat:
+	depth = ext_depth(inode);
+	eh = path[depth].p_hdr;
+	ex = path[depth].p_ext;
+
+	/* the usual case: the new blocks follow on from the extent before */
+	if (ex && ext3_can_extents_be_merged(ex, newext)) {
+		err = ext3_ext_get_access(handle, path + depth);
+		if (err)
+			return err;
+		ex->ee_len = cpu_to_le16(le16_to_cpu(ex->ee_len) +
+					 le16_to_cpu(newext->ee_len));
+		return ext3_ext_dirty(handle, inode, path + depth);
+	}
+
+	if (le16_to_cpu(eh->eh_entries) < le16_to_cpu(eh->eh_max)) {
+		err = ext3_ext_get_access(handle, path + depth);
+		if (err)
+			return err;
+		if (!ex)
+			nearex = EXT_FIRST_EXTENT(eh);
+		else if (block > le32_to_cpu(ex->ee_block))
+			nearex = ex + 1;
+		else
+			nearex = ex;
+		len = EXT_LAST_EXTENT(eh) - nearex + 1;
+		if (len > 0)
+			memmove(nearex + 1, nearex,
+				len * sizeof(struct ext3_extent));
+		*nearex = *newext;
+		eh->eh_entries = cpu_to_le16(le16_to_cpu(eh->eh_entries) + 1);
+		return ext3_ext_dirty(handle, inode, path + depth);
+	}
+
+	/* the leaf is full: split below the lowest level with room */
+	for (at = depth - 1; at >= 0; at--)
+		if (le16_to_cpu(path[at].p_hdr->eh_entries) <
+		    le16_to_cpu(path[at].p_hdr->eh_max))
+			break;
+	if (at >= 0)
+		err = ext3_ext_split(handle, inode, path, newext, at);
+	else
+		err = ext3_ext_grow_indepth(handle, inode, path, newext);
+	if (err)
+		return err;
+
+	ext3_ext_drop_refs(path);
+	err = ext3_ext_find_extent(inode, block, path);
+	if (err)
+		return err;
+	goto repeat;
+}
+
+/*
+ * Map up to @max_blocks blocks from @iblock on.  Returns how many blocks
+ * from @iblock on are mapped to the contiguous run of disk blocks starting
+ * at bh_result->b_blocknr, 0 for a hole when !@create, or an error.
+ *
+ * With @create a hole is filled from one call to ext3_new_blocks(), which
+ * gives as many contiguous blocks as it can, up to the end of the hole.
+ * The new blocks are added to the extent before them when they follow on
+ * from it, so a file written sequentially keeps few, long extents.
+ * @create is EXT3_CREATE_DELAYED for the blocks of delayed buffers, whose
+ * quota is already charged.
+ *
+ * `handle' can be NULL if create is zero.
+ */
+int ext3_ext_get_blocks(handle_t *handle, struct inode *inode, sector_t iblock,
+			unsigned long max_blocks, struct buffer_head *bh_result,
+			int create, int extend_disksize)
+{
+	struct ext3_inode_info *ei = EXT3_I(inode);
+	struct ext3_ext_path *path;
+	struct ext3_extent *ex;
+	struct ext3_extent newex;
+	unsigned long block = iblock;
+	unsigned long start = 0, len, next;
+	int depth;
+	int err;
+
+	J_ASSERT(handle != NULL || create == 0);
+
+	clear_buffer_new(bh_result);
+	if (iblock >= EXT_MAX_BLOCK)
+		return -EIO;
+	if (ext3_ext_in_cache(inode, block, &start, &len))
+		goto mapped;
+
+	path = kmalloc(sizeof(struct ext3_ext_path) * (EXT3_EXT_MAX_DEPTH + 1),
+		       GFP_NOFS);
+	if (!path)
+		return -ENOMEM;
+
+	down(&ei->truncate_sem);
+	err = ext3_ext_find_extent(inode, block, path);
+	if (err)
+		goto out_free;
+
+	depth = path->p_depth;
+	ex = path[depth].p_ext;
+	if (ex && block >= le32_to_cpu(ex->ee_block) &&
+	    block - le32_to_cpu(ex->ee_block) < le16_to_cpu(ex->ee_len)) {
+		unsigned long eblock = le32_to_cpu(ex->ee_block);
+
+		start = ext_pblock(ex) + (block - eblock);
+		len = le16_to_cpu(ex->ee_len) - (block - eblock);
+		ext3_ext_put_in_cache(inode, eblock, le16_to_cpu(ex->ee_len),
+				      ext_pblock(ex));
+		goto out;
+	}
+
+	/* A hole */
+	len = 0;
+	if (!create)
+		goto out;
+
+	if (S_ISREG(inode->i_mode) && !ei->i_block_alloc_info)
+		ext3_init_block_alloc_info(inode);
+
+	next = ext3_ext_next_allocated_block(path, block);
+	len = max_blocks;
+	if (len > next - block)
+		len = next - block;
+	if (len > EXT3_EXT_MAX_LEN)
+		len = EXT3_EXT_MAX_LEN;
+
+	start = ext3_new_blocks(handle, inode,
+				ext3_ext_find_goal(inode, path, block),
+				&len, &err, create == EXT3_CREATE_DELAYED);
+	if (!start) {
+		len = 0;
+		goto out;
+	}
+
+	newex.ee_block = cpu_to_le32(block);
+	newex.ee_len = cpu_to_le16(len);
+	ext3_ext_store_pblock(&newex, start);
+	err = ext3_ext_insert_extent(handle, inode, path, &newex);
+	if (err) {
+		if (create == EXT3_CREATE_DELAYED) {
+			int freed;
+
+			/* the buffers stay delayed, and keep their quota */
+			ext3_free_blocks_sb(handle, inode->i_sb, start, len,
+					    &freed);
+		} else
+			ext3_free_blocks(handle, inode, start, len);
+		len = 0;
+		goto out;
+	}
+
+	/*
+	 * i_disksize growing is protected by truncate_sem, as in
+	 * ext3_get_block_handle().
+	 */
+	if (extend_disksize && inode->i_size > ei->i_disksize)
+		ei->i_disksize = inode->i_size;
+	err = ext3_mark_inode_dirty(handle, inode);
+	ext3_ext_put_in_cache(inode, block, len, start);
+	set_buffer_new(bh_result);
+out:
+	ext3_ext_drop_refs(path);
+out_free:
+	up(&ei->truncate_sem);
+	kfree(path);
+	if (err)
+		return err;
+	if (!len)
+		return 0;
+mapped:
+	map_bh(bh_result, inode->i_sb, start);
+	return len < max_blocks ? len : max_blocks;
+}
+
+/*
+ * Truncate
+ */
+
+/* credits to free @len blocks of one extent and update its leaf */
+static int ext3_ext_rm_credits(struct inode *inode, unsigned long len)
+{
+	int groups = len / EXT3_BLOCKS_PER_GROUP(inode->i_sb) + 2;
+
+	/* bitmap and descriptor per group, leaf, inode, superblock */
+	return 2 * groups + 3 + 2 * EXT3_QUOTA_TRANS_BLOCKS(inode->i_sb);
+}
+
+/*
+ * Make sure the handle has @needed credits.  If it cannot be extended, the
+ * node being changed (@bh, or the inode for the root) is journalled, the
+ * transaction restarted, and write access to @bh taken again.
+ */
+static int ext3_ext_truncate_extend_restart(handle_t *handle,
+		struct inode *inode, struct buffer_head *bh, int needed)
+{
+	int err;
+
+	if (handle->h_buffer_credits >= needed)
+		return 0;
+	if (!ext3_journal_extend(handle, needed))
+		return 0;
+
+	if (bh) {
+		err = ext3_journal_dirty_metadata(handle, bh);
+		if (err)
+			return err;
+	}
+	err = ext3_mark_inode_dirty(handle, inode);
+	if (err)
+		return err;
+	jbd_debug(2, "restarting handle %p\n", handle);
+	err = ext3_journal_restart(handle, needed);
+	if (err)
+		return err;
+	if (bh)
+		return ext3_journal_get_write_access(handle, bh);
+	return 0;
+}
+
+/*
+ * Release the blocks of an extent being removed.  Their buffers only need
+ * forgetting if the data went through the journal.
+ */
+static void ext3_ext_free_data(handle_t *handle, struct inode *inode,
+			       unsigned long start, unsigned long count)
+{
+	if (ext3_should_journal_data(inode)) {
+		unsigned long i;
+
+		for (i = 0; i < count; i++)
+			ext3_forget(handle, 0, inode,
+				    sb_find_get_block(inode->i_sb, start + i),
+				    start + i);
+	}
+	ext3_free_blocks(handle, inode, start, count);
+}
+
+static int ext3_ext_rm_leaf(handle_t *handle, struct inode *inode,
+			    struct buffer_head *bh,
+			    struct ext3_extent_header *eh, unsigned long start)
+{
+	struct ext3_extent *ex = EXT_LAST_EXTENT(eh);
+	int err = 0;
+
+	if (bh) {
+		err = ext3_journal_get_write_access(handle, bh);
+		if (err)
+			return err;
+	}
+
+	/* from the right; every extent passed is the last one left */
+	for (; ex >= EXT_FIRST_EXTENT(eh); ex--) {
+		unsigned long eblock = le32_to_cpu(ex->ee_block);
+		unsigned long elen = le16_to_cpu(ex->ee_len);
+		unsigned long count;
+
+		if (eblock + elen <= start)
+			break;
+		err = ext3_ext_truncate_extend_restart(handle, inode, bh,
+					ext3_ext_rm_credits(inode, elen));
+		if (err)
+			break;
+
+		if (eblock >= start) {
+			count = elen;
+			eh->eh_entries =
+				cpu_to_le16(le16_to_cpu(eh->eh_entries) - 1);
+		} else {
+			count = eblock + elen - start;
+			ex->ee_len = cpu_to_le16(elen - count);
+		}
+		ext3_ext_free_data(handle, inode,
+				   ext_pblock(ex) + elen - count, count);
+		if (eblock < start)
+			break;
+	}
+
+	if (bh) {
+		int err2 = ext3_journal_dirty_metadata(handle, bh);
+
+		if (!err)
+			err = err2;
+	} else {
+		int err2 = ext3_mark_inode_dirty(handle, inode);
+
+		if (!err)
+			err = err2;
+	}
+	return err;
+}
+
+/*
+ * Remove everything from @start on below the node @eh at @depth, whose
+ * buffer is @bh (NULL for the root).  Children left empty are unlinked and
+ * freed.
+ */
+static int ext3_ext_rm_node(handle_t *handle, struct inode *inode,
+			    struct buffer_head *bh,
+			    struct ext3_extent_header *eh, int depth,
+			    unsigned long start)
+{
+	struct ext3_extent_idx *ix;
+	int err = 0;
+
+	if (depth == 0)
+		return ext3_ext_rm_leaf(handle, inode, bh, eh, start);
+
+	for (ix = EXT_LAST_INDEX(eh); ix >= EXT_FIRST_INDEX(eh); ix--) {
+		unsigned long cblock = idx_pblock(ix);
+		struct buffer_head *cbh;
+		struct ext3_extent_header *ceh;
+
+		cbh = sb_bread(inode->i_sb, cblock);
+		if (!cbh)
+			return -EIO;
+		ceh = ext_block_hdr(cbh);
+		err = ext3_ext_check_header(inode, ceh, depth - 1, 0);
+		if (!err)
+			err = ext3_ext_rm_node(handle, inode, cbh, ceh,
+					       depth - 1, start);
+		if (err || ceh->eh_entries) {
+			/* this child still maps blocks before @start */
+			brelse(cbh);
+			break;
+		}
+
+		err = ext3_ext_truncate_extend_restart(handle, inode, NULL,
+					ext3_ext_rm_credits(inode, 1));
+		if (!err && bh)
+			err = ext3_journal_get_write_access(handle, bh);
+		if (err) {
+			brelse(cbh);
+			break;
+		}
+		eh->eh_entries = cpu_to_le16(le16_to_cpu(eh->eh_entries) - 1);
+		if (bh)
+			err = ext3_journal_dirty_metadata(handle, bh);
+		else
+			err = ext3_mark_inode_dirty(handle, inode);
+		ext3_forget(handle, 1, inode, cbh, cblock);
+		ext3_free_blocks(handle, inode, cblock, 1);
+		if (err || le32_to_cpu(ix->ei_block) <= start)
+			break;
+	}
+	return err;
+}
+
+/*
+ * Remove the blocks from @start to the end of the file.  Called from
+ * ext3_truncate() with truncate_sem held and the inode on the orphan list.
+ */
+void ext3_ext_truncate(handle_t *handle, struct inode *inode,
+		       unsigned long start)
+{
+	struct ext3_extent_header *eh = ext_inode_hdr(inode);
+	int depth = ext_depth(inode);
+
+	ext3_ext_invalidate_cache(inode);
+	if (ext3_ext_check_inode(inode))
+		return;
+	if (ext3_ext_rm_node(handle, inode, NULL, eh, depth, start))
+		return;
+
+	/* all gone: make the root an empty leaf again */
+	if (depth && !eh->eh_entries) {
+		ext3_ext_tree_init(inode);
+		ext3_mark_inode_dirty(handle, inode);
+	}
+}
+
+/*
+ * Journal credits for mapping @num runs of new blocks.  Each run takes a
+ * bitmap and a group descriptor for the data; it may split every level of
+ * the tree, changing a node and allocating one (with its bitmap and
+ * descriptor) per level; and the root may grow.  Plus the inode and the
+ * superblock.
+ */
+int ext3_ext_writepage_trans_blocks(struct inode *inode, int num)
+{
+	int levels = ext_depth(inode) + 1;
+
+	return num * (2 + 4 * levels + 3) + 2;
+}
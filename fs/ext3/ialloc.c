@@ -409,6 +409,21 @@ static int find_group_other(struct super_block *sb, struct inode *parent)
 	return -1;
 }
 
+/*
+ * Older kernels must not mount a filesystem with extent-mapped files, so
+ * flag it on the first one.
+ */
+static void ext3_set_extents_feature(handle_t *handle, struct super_block *sb)
+{
+	if (EXT3_HAS_INCOMPAT_FEATURE(sb, EXT3_FEATURE_INCOMPAT_EXTENTS))
+		return;
+	if (ext3_journal_get_write_access(handle, EXT3_SB(sb)->s_sbh) == 0) {
+		EXT3_SET_INCOMPAT_FEATURE(sb, EXT3_FEATURE_INCOMPAT_EXTENTS);
+		sb->s_dirt = 1;
+		ext3_journal_dirty_metadata(handle, EXT3_SB(sb)->s_sbh);
+	}
+}
+
 /*
  * There are two policies for allocating an inode.  If the new inode is
  * a directory, then a forward search is made for a block group with both
@@ -571,6 +586,13 @@ got:
 	/* dirsync only applies to directories */
 	if (!S_ISDIR(mode))
 		ei->i_flags &= ~EXT3_DIRSYNC_FL;
+	/* with -o extents, new regular files are extent-mapped */
+	ei->i_flags &= ~EXT3_EXTENTS_FL;
+	if (S_ISREG(mode) && test_opt(sb, EXTENTS)) {
+		ei->i_flags |= EXT3_EXTENTS_FL;
+		ext3_ext_tree_init(inode);
+		ext3_set_extents_feature(handle, sb);
+	}
 #ifdef EXT3_FRAGMENTS
 	ei->i_faddr = 0;
 	ei->i_frag_no = 0;
@@ -40,6 +40,7 @@
 #include "acl.h"
 
 static int ext3_writepage_trans_blocks(struct inode *inode);
+static struct address_space_operations ext3_da_aops;
 
 /*
  * Test whether an inode is a fast symlink.
@@ -682,11 +683,18 @@ ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
 	unsigned long goal;
 	int left;
 	int boundary = 0;
-	const int depth = ext3_block_to_path(inode, iblock, offsets, &boundary);
+	int depth;
 	struct ext3_inode_info *ei = EXT3_I(inode);
 
 	J_ASSERT(handle != NULL || create == 0);
 
+	if (ei->i_flags & EXT3_EXTENTS_FL) {
+		err = ext3_ext_get_blocks(handle, inode, iblock, 1, bh_result,
+					  create, extend_disksize);
+		return err < 0 ? err : 0;
+	}
+
+	depth = ext3_block_to_path(inode, iblock, offsets, &boundary);
 	if (depth == 0)
 		goto out;
 
@@ -841,6 +849,17 @@ ext3_direct_io_get_blocks(struct inode *inode, sector_t iblock,
 	}
 
 get_block:
+	if (ret == 0 && (EXT3_I(inode)->i_flags & EXT3_EXTENTS_FL)) {
+		/* map as much of the request as one extent covers */
+		ret = ext3_ext_get_blocks(handle, inode, iblock, max_blocks,
+					  bh_result, create, 0);
+		if (ret > 0) {
+			bh_result->b_size = ret << inode->i_blkbits;
+			return 0;
+		}
+		bh_result->b_size = (1 << inode->i_blkbits);
+		return ret;
+	}
 	if (ret == 0)
 		ret = ext3_get_block_handle(handle, inode, iblock,
 					bh_result, create, 0);
@@ -1157,6 +1176,10 @@ static sector_t ext3_bmap(struct address_space *mapping, sector_t block)
 	journal_t *journal;
 	int err;
 
+	/* delayed blocks have nowhere to be yet */
+	if (mapping->a_ops == &ext3_da_aops)
+		filemap_write_and_wait(mapping);
+
 	if (EXT3_I(inode)->i_state & EXT3_STATE_JDATA) {
 		/* 
 		 * This is a REALLY heavyweight approach, but the use of
@@ -1453,6 +1476,378 @@ static int ext3_releasepage(struct page *page, gfp_t wait)
 	return journal_try_to_free_buffers(journal, page, wait);
 }
 
+/*
+ * Delayed allocation
+ *
+ * With -o delalloc, write() into a hole of an extent-mapped file only
+ * reserves space: the buffer is marked delayed and gets no block.  Blocks
+ * are allocated when the page is written back, and then for the whole run
+ * of delayed buffers starting in the page at once, so a file written
+ * sequentially gets a few large allocations rather than one per block, and
+ * a short-lived file gets none at all.
+ *
+ * The reservation is one block per delayed buffer, in s_dirtyblocks_counter,
+ * and the block is charged to quota right away, so that write() fails with
+ * EDQUOT as it would without delalloc; allocating it later does not charge
+ * it again, and throwing the buffer away gives it back.  i_disksize only
+ * covers allocated blocks, so that a crash cannot leave the on-disk size
+ * pointing past data that never got a block.
+ */
+
+/* most pages to take from the pagecache after the one being written */
+#define EXT3_DA_MAX_PAGES	32
+
+static int ext3_da_get_block_prep(struct inode *inode, sector_t iblock,
+				  struct buffer_head *bh_result, int create)
+{
+	int ret;
+
+	ret = ext3_ext_get_blocks(NULL, inode, iblock, 1, bh_result, 0, 0);
+	if (ret)
+		return ret < 0 ? ret : 0;
+
+	/* A hole: reserve a block, and map it to one nothing is cached for */
+	ret = ext3_claim_free_blocks(EXT3_SB(inode->i_sb), 1);
+	if (ret)
+		return ret;
+	if (DQUOT_ALLOC_BLOCK(inode, 1)) {
+		ext3_release_blocks(EXT3_SB(inode->i_sb), 1);
+		return -EDQUOT;
+	}
+	map_bh(bh_result, inode->i_sb, ~0UL);
+	set_buffer_new(bh_result);
+	set_buffer_delay(bh_result);
+	return 0;
+}
+
+static int ext3_da_prepare_write(struct file *file, struct page *page,
+				 unsigned from, unsigned to)
+{
+	struct inode *inode = page->mapping->host;
+	int retries = 0;
+	int ret;
+
+retry:
+	ret = block_prepare_write(page, from, to, ext3_da_get_block_prep);
+	if (ret == -ENOSPC && ext3_should_retry_alloc(inode->i_sb, &retries))
+		goto retry;
+	return ret;
+}
+
+static int ext3_da_commit_write(struct file *file, struct page *page,
+				unsigned from, unsigned to)
+{
+	struct inode *inode = page->mapping->host;
+	struct buffer_head *bh = page_buffers(page);
+	loff_t new_i_size;
+	unsigned offset;
+
+	/* if the write ends in a delayed buffer, writeback moves i_disksize */
+	new_i_size = ((loff_t)page->index << PAGE_CACHE_SHIFT) + to;
+	for (offset = bh->b_size; offset < to; offset += bh->b_size)
+		bh = bh->b_this_page;
+	if (!buffer_delay(bh) && new_i_size > EXT3_I(inode)->i_disksize) {
+		EXT3_I(inode)->i_disksize = new_i_size;
+		mark_inode_dirty(inode);
+	}
+	return generic_commit_write(file, page, from, to);
+}
+
+static int ext3_bh_delay(handle_t *handle, struct buffer_head *bh)
+{
+	return buffer_delay(bh);
+}
+
+/* delayed buffers at the start of @page, up to the first one that isn't */
+static int ext3_da_leading_delayed(struct page *page)
+{
+	struct buffer_head *head = page_buffers(page);
+	struct buffer_head *bh = head;
+	int n = 0;
+
+	do {
+		if (!buffer_delay(bh))
+			break;
+		n++;
+		bh = bh->b_this_page;
+	} while (bh != head);
+	return n;
+}
+
+/*
+ * Lock and return in @pages the pages after @index that continue a run of
+ * delayed buffers, for as long as each one is full of them.  Pages which
+ * cannot be locked without waiting are left for their own writepage.
+ * Returns the number of pages; *len is increased by their delayed buffers.
+ */
+static int ext3_da_grab_pages(struct address_space *mapping,
+			      unsigned long index, struct page **pages,
+			      unsigned long *len)
+{
+	int bpp = PAGE_CACHE_SIZE >> mapping->host->i_blkbits;
+	int nr_pages = 0;
+	int n;
+
+	while (nr_pages < EXT3_DA_MAX_PAGES) {
+		struct page *page = find_get_page(mapping, ++index);
+
+		if (!page)
+			break;
+		if (TestSetPageLocked(page)) {
+			page_cache_release(page);
+			break;
+		}
+		if (page->mapping != mapping || !PageDirty(page) ||
+		    PageWriteback(page) || !page_has_buffers(page) ||
+		    !(n = ext3_da_leading_delayed(page))) {
+			unlock_page(page);
+			page_cache_release(page);
+			break;
+		}
+		pages[nr_pages++] = page;
+		*len += n;
+		if (n < bpp)
+			break;
+	}
+	return nr_pages;
+}
+
+/*
+ * Allocate the @len blocks from @block on for the delayed buffers from @bh
+ * on, which carry on from @page into @pages.  The first @own buffers are
+ * in @page, and must be done; the rest are left delayed if the transaction
+ * runs out of room.  Returns the number of blocks mapped, or an error if
+ * not all of the first @own could be.
+ */
+static long ext3_da_map_run(handle_t *handle, struct page *page,
+			    struct page **pages, struct buffer_head *bh,
+			    sector_t block, unsigned long len,
+			    unsigned long own)
+{
+	struct inode *inode = page->mapping->host;
+	struct ext3_sb_info *sbi = EXT3_SB(inode->i_sb);
+	int needed = ext3_ext_writepage_trans_blocks(inode, 1) +
+			2 * EXT3_QUOTA_TRANS_BLOCKS(inode->i_sb);
+	unsigned long done = 0;
+	int ret = 0;
+
+	while (done < len) {
+		struct buffer_head map;
+		unsigned long n = len - done;
+		unsigned long i;
+
+		if (handle->h_buffer_credits < needed &&
+		    ext3_journal_extend(handle, needed)) {
+			ret = -ENOSPC;
+			break;
+		}
+
+		/*
+		 * Hand back the reservation first, or the allocator would
+		 * count these blocks as taken.
+		 */
+		ext3_release_blocks(sbi, n);
+		map.b_state = 0;
+		ret = ext3_ext_get_blocks(handle, inode, block + done, n,
+					  &map, EXT3_CREATE_DELAYED, 0);
+		if (ret <= 0) {
+			percpu_counter_mod(&sbi->s_dirtyblocks_counter, n);
+			if (!ret)
+				ret = -EIO;
+			break;
+		}
+		if (ret < n)
+			percpu_counter_mod(&sbi->s_dirtyblocks_counter,
+					   n - ret);
+
+		for (i = 0; i < ret; i++) {
+			map_bh(bh, inode->i_sb, map.b_blocknr + i);
+			clear_buffer_delay(bh);
+			unmap_underlying_metadata(bh->b_bdev, bh->b_blocknr);
+			if (ext3_should_order_data(inode))
+				ext3_journal_dirty_data(handle, bh);
+			if (done + i + 1 == len)
+				break;
+			bh = bh->b_this_page;
+			if (bh == page_buffers(page)) {
+				page = *pages++;
+				bh = page_buffers(page);
+			}
+		}
+		done += ret;
+		ret = 0;
+	}
+	if (ret && done < own)
+		return ret;
+	return done;
+}
+
+/*
+ * Allocate blocks for the delayed buffers of the locked @page.  A run of
+ * them reaching the end of the page carries on into the pages after it, so
+ * that a sequential writer's data is allocated a run at a time.  *end is
+ * set past the last block mapped.
+ */
+static int ext3_da_map_blocks(handle_t *handle, struct page *page,
+			      sector_t *end)
+{
+	struct address_space *mapping = page->mapping;
+	struct page *pages[EXT3_DA_MAX_PAGES];
+	struct buffer_head *head, *bh;
+	unsigned int bbits = mapping->host->i_blkbits;
+	sector_t block = (sector_t)page->index << (PAGE_CACHE_SHIFT - bbits);
+	int nr_pages = 0;
+	long ret = 0;
+	int i;
+
+	head = bh = page_buffers(page);
+	do {
+		struct buffer_head *next = bh;
+		unsigned long own = 0;
+		unsigned long len;
+
+		if (!buffer_delay(bh)) {
+			block++;
+			bh = bh->b_this_page;
+			continue;
+		}
+		do {
+			own++;
+			next = next->b_this_page;
+		} while (next != head && buffer_delay(next));
+		len = own;
+		if (next == head)
+			nr_pages = ext3_da_grab_pages(mapping, page->index,
+						      pages, &len);
+
+		ret = ext3_da_map_run(handle, page, pages, bh, block, len, own);
+		if (ret < 0)
+			break;
+		*end = block + ret;
+		block += own;
+		bh = next;
+	} while (bh != head);
+
+	for (i = 0; i < nr_pages; i++) {
+		unlock_page(pages[i]);
+		page_cache_release(pages[i]);
+	}
+	return ret < 0 ? ret : 0;
+}
+
+static int ext3_da_writepage_trans_blocks(struct inode *inode)
+{
+	int bpp = ext3_journal_blocks_per_page(inode);
+
+	/* a run per block of the page, and one more into the next pages */
+	return ext3_ext_writepage_trans_blocks(inode, bpp + 1) +
+		2 * EXT3_QUOTA_TRANS_BLOCKS(inode->i_sb);
+}
+
+/*
+ * Allocate the page's delayed blocks, then write it out as the ordered or
+ * writeback writepage would.  A page without delayed buffers goes straight
+ * to those.
+ */
+static int ext3_da_writepage(struct page *page,
+			     struct writeback_control *wbc)
+{
+	struct inode *inode = page->mapping->host;
+	struct ext3_inode_info *ei = EXT3_I(inode);
+	struct buffer_head *page_bufs;
+	handle_t *handle = NULL;
+	sector_t end = 0;
+	int ret = 0;
+	int err;
+
+	J_ASSERT(PageLocked(page));
+
+	if (!page_has_buffers(page) ||
+	    !walk_page_buffers(NULL, page_buffers(page), 0,
+			       PAGE_CACHE_SIZE, NULL, ext3_bh_delay)) {
+		if (ext3_should_order_data(inode))
+			return ext3_ordered_writepage(page, wbc);
+		return ext3_writeback_writepage(page, wbc);
+	}
+
+	if (ext3_journal_current_handle())
+		goto out_fail;
+
+	handle = ext3_journal_start(inode,
+				    ext3_da_writepage_trans_blocks(inode));
+	if (IS_ERR(handle)) {
+		ret = PTR_ERR(handle);
+		goto out_fail;
+	}
+
+	ret = ext3_da_map_blocks(handle, page, &end);
+	if (end) {
+		loff_t disksize = (loff_t)end << inode->i_blkbits;
+
+		if (disksize > i_size_read(inode))
+			disksize = i_size_read(inode);
+		down(&ei->truncate_sem);
+		if (disksize > ei->i_disksize)
+			ei->i_disksize = disksize;
+		up(&ei->truncate_sem);
+		err = ext3_mark_inode_dirty(handle, inode);
+		if (!ret)
+			ret = err;
+	}
+	if (ret) {
+		ext3_journal_stop(handle);
+		goto out_fail;
+	}
+
+	page_bufs = page_buffers(page);
+	walk_page_buffers(handle, page_bufs, 0,
+			PAGE_CACHE_SIZE, NULL, bget_one);
+
+	ret = block_write_full_page(page, ext3_get_block, wbc);
+
+	/* as in ext3_ordered_writepage() */
+	if (ret == 0 && ext3_should_order_data(inode))
+		ret = walk_page_buffers(handle, page_bufs, 0, PAGE_CACHE_SIZE,
+					NULL, journal_dirty_data_fn);
+	walk_page_buffers(handle, page_bufs, 0,
+			PAGE_CACHE_SIZE, NULL, bput_one);
+	err = ext3_journal_stop(handle);
+	if (!ret)
+		ret = err;
+	return ret;
+
+out_fail:
+	redirty_page_for_writepage(wbc, page);
+	unlock_page(page);
+	return ret;
+}
+
+static int ext3_da_invalidatepage(struct page *page, unsigned long offset)
+{
+	struct inode *inode = page->mapping->host;
+	struct buffer_head *head, *bh;
+	unsigned long curr_off = 0;
+	int nr = 0;
+
+	/* give back the reservations of the delayed buffers thrown away */
+	if (page_has_buffers(page)) {
+		head = bh = page_buffers(page);
+		do {
+			if (curr_off >= offset && buffer_delay(bh)) {
+				clear_buffer_delay(bh);
+				nr++;
+			}
+			curr_off += bh->b_size;
+			bh = bh->b_this_page;
+		} while (bh != head);
+	}
+	if (nr) {
+		ext3_release_blocks(EXT3_SB(inode->i_sb), nr);
+		DQUOT_FREE_BLOCK(inode, nr);
+	}
+	return ext3_invalidatepage(page, offset);
+}
+
 /*
  * If the O_DIRECT write will extend the file then add this inode to the
  * orphan list.  So recovery will truncate it back to the original size
@@ -1589,9 +1984,27 @@ static struct address_space_operations ext3_journalled_aops = {
 	.releasepage	= ext3_releasepage,
 };
 
+static struct address_space_operations ext3_da_aops = {
+	.readpage	= ext3_readpage,
+	.readpages	= ext3_readpages,
+	.writepage	= ext3_da_writepage,
+	.sync_page	= block_sync_page,
+	.prepare_write	= ext3_da_prepare_write,
+	.commit_write	= ext3_da_commit_write,
+	.bmap		= ext3_bmap,
+	.invalidatepage	= ext3_da_invalidatepage,
+	.releasepage	= ext3_releasepage,
+	.direct_IO	= ext3_direct_IO,
+	.migratepage	= buffer_migrate_page,
+};
+
 void ext3_set_aops(struct inode *inode)
 {
-	if (ext3_should_order_data(inode))
+	if (test_opt(inode->i_sb, DELALLOC) &&
+	    (EXT3_I(inode)->i_flags & EXT3_EXTENTS_FL) &&
+	    !ext3_should_journal_data(inode))
+		inode->i_mapping->a_ops = &ext3_da_aops;
+	else if (ext3_should_order_data(inode))
 		inode->i_mapping->a_ops = &ext3_ordered_aops;
 	else if (ext3_should_writeback_data(inode))
 		inode->i_mapping->a_ops = &ext3_writeback_aops;
@@ -1694,7 +2107,8 @@ static int ext3_block_truncate_page(handle_t *handle, struct page *page,
 	if (ext3_should_journal_data(inode)) {
 		err = ext3_journal_dirty_metadata(handle, bh);
 	} else {
-		if (ext3_should_order_data(inode))
+		/* a delayed buffer has no block to order yet */
+		if (ext3_should_order_data(inode) && !buffer_delay(bh))
 			err = ext3_journal_dirty_data(handle, bh);
 		mark_buffer_dirty(bh);
 	}
@@ -2089,10 +2503,11 @@ void ext3_truncate(struct inode * inode)
 	Indirect chain[4];
 	Indirect *partial;
 	__le32 nr = 0;
-	int n;
+	int n = 0;
 	long last_block;
 	unsigned blocksize = inode->i_sb->s_blocksize;
 	struct page *page;
+	int extents = ei->i_flags & EXT3_EXTENTS_FL;
 
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode) ||
 	    S_ISLNK(inode->i_mode)))
@@ -2133,9 +2548,11 @@ void ext3_truncate(struct inode * inode)
 	if (page)
 		ext3_block_truncate_page(handle, page, mapping, inode->i_size);
 
-	n = ext3_block_to_path(inode, last_block, offsets, NULL);
-	if (n == 0)
-		goto out_stop;	/* error */
+	if (!extents) {
+		n = ext3_block_to_path(inode, last_block, offsets, NULL);
+		if (n == 0)
+			goto out_stop;	/* error */
+	}
 
 	/*
 	 * OK.  This truncate is going to happen.  We add the inode to the
@@ -2164,6 +2581,11 @@ void ext3_truncate(struct inode * inode)
 	 */
 	down(&ei->truncate_sem);
 
+	if (extents) {
+		ext3_ext_truncate(handle, inode, last_block);
+		goto discard;
+	}
+
 	if (n == 1) {		/* direct blocks */
 		ext3_free_data(handle, inode, NULL, i_data+offsets[0],
 			       i_data + EXT3_NDIR_BLOCKS);
@@ -2227,6 +2649,7 @@ do_indirects:
 			;
 	}
 
+discard:
 	ext3_discard_reservation(inode);
 
 	up(&ei->truncate_sem);
@@ -2515,6 +2938,11 @@ void ext3_read_inode(struct inode * inode)
 	for (block = 0; block < EXT3_N_BLOCKS; block++)
 		ei->i_data[block] = raw_inode->i_block[block];
 	INIT_LIST_HEAD(&ei->i_orphan);
+	ei->i_cached_len = 0;
+	if ((ei->i_flags & EXT3_EXTENTS_FL) && ext3_ext_check_inode(inode)) {
+		brelse (bh);
+		goto bad_inode;
+	}
 
 	if (inode->i_ino >= EXT3_FIRST_INO(inode->i_sb) + 1 &&
 	    EXT3_INODE_SIZE(inode->i_sb) > EXT3_GOOD_OLD_INODE_SIZE) {
@@ -2867,7 +3295,12 @@ static int ext3_writepage_trans_blocks(struct inode *inode)
 	int indirects = (EXT3_NDIR_BLOCKS % bpp) ? 5 : 3;
 	int ret;
 
-	if (ext3_should_journal_data(inode))
+	if (EXT3_I(inode)->i_flags & EXT3_EXTENTS_FL) {
+		/* a run per block, at worst */
+		ret = ext3_ext_writepage_trans_blocks(inode, bpp);
+		if (ext3_should_journal_data(inode))
+			ret += bpp;
+	} else if (ext3_should_journal_data(inode))
 		ret = 3 * (bpp + indirects) + 2;
 	else
 		ret = 2 * (bpp + indirects) + 2;
@@ -3044,6 +3477,13 @@ int ext3_change_inode_journal_flag(struct inode *inode, int val)
 	if (is_journal_aborted(journal) || IS_RDONLY(inode))
 		return -EROFS;
 
+	/* delayed blocks need their allocation before the aops change */
+	if (inode->i_mapping->a_ops == &ext3_da_aops) {
+		err = filemap_write_and_wait(inode->i_mapping);
+		if (err)
+			return err;
+	}
+
 	journal_lock_updates(journal);
 	journal_flush(journal);
 
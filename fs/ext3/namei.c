@@ -143,6 +143,52 @@ struct dx_map_entry
 	u32 offs;
 };
 
+/*
+ * Each htree directory may have a small cache of the leaf blocks which
+ * dx_probe found, so that looking up or adding a name need not walk the
+ * index blocks again.  A slot holds the hash range [lo, hi) which the
+ * index maps to one leaf, kept as lo and hi - 1 so that a slot is 12
+ * bytes and the largest cache fits in a 16KB kmalloc; slots are picked
+ * by the top bits of the hash looked up, and each keeps the leaf most
+ * recently found for its part of the hash space.  The index only changes
+ * when a leaf is split, and do_split drops the whole cache then.
+ */
+#define DX_CACHE_BITS		6	/* slots for an index of one level */
+#define DX_CACHE_BITS_INDIRECT	10	/* and for two levels */
+
+struct dx_cache_slot
+{
+	u32 lo;
+	u32 last;		/* hi - 1, 0 if the slot is empty */
+	u32 block;
+};
+
+struct ext3_dx_cache
+{
+	unsigned bits;
+	unsigned hash_version;
+	struct dx_cache_slot slots[0];
+};
+
+/*
+ * Drop the cache, and have any dx_probe running meanwhile keep what it
+ * finds out of the next one.  do_split calls this both before and after
+ * changing the index, as ext3_get_parent probes without i_mutex.
+ */
+void ext3_dx_cache_free(struct inode *dir)
+{
+	struct ext3_dx_cache *cache;
+
+	/* the index changes go before the new i_dx_gen */
+	smp_wmb();
+	spin_lock(&dir->i_lock);
+	cache = EXT3_I(dir)->i_dx_cache;
+	EXT3_I(dir)->i_dx_cache = NULL;
+	EXT3_I(dir)->i_dx_gen++;
+	spin_unlock(&dir->i_lock);
+	kfree(cache);
+}
+
 #ifdef CONFIG_EXT3_INDEX
 static inline unsigned dx_get_block (struct dx_entry *entry);
 static void dx_set_block (struct dx_entry *entry, unsigned value);
@@ -317,6 +363,108 @@ struct stats dx_show_entries(struct dx_hash_info *hinfo, struct inode *dir,
 }
 #endif /* DX_DEBUG */
 
+/*
+ * Remember the leaf which dx_probe reached through frames[0..frame], and
+ * the range of hashes the index sends to it.  @gen is the i_dx_gen the
+ * probe started from: if the cache was dropped since, the index may have
+ * changed under the probe and what it found is not kept.
+ */
+static void dx_cache_fill(struct inode *dir, struct dx_hash_info *hinfo,
+			  struct dx_frame *frames, struct dx_frame *frame,
+			  unsigned int gen)
+{
+	struct ext3_dx_cache *cache, *new = NULL;
+	struct dx_cache_slot *slot;
+	struct dx_frame *p;
+	unsigned bits;
+	int stale;
+	u32 lo = 0;
+	u64 hi = 1ULL << 32;
+
+	for (p = frames; p <= frame; p++) {
+		if (p->at != p->entries)
+			lo = dx_get_hash(p->at);
+		if (p->at + 1 < p->entries + dx_get_count(p->entries))
+			hi = dx_get_hash(p->at + 1);
+	}
+
+	bits = frame == frames ? DX_CACHE_BITS : DX_CACHE_BITS_INDIRECT;
+
+	/*
+	 * ext3_get_parent() gets here without i_mutex, so do_split() may
+	 * free the cache under us: look at it under i_lock only.
+	 */
+	spin_lock(&dir->i_lock);
+	if (EXT3_I(dir)->i_dx_gen != gen) {
+		spin_unlock(&dir->i_lock);
+		return;
+	}
+	cache = EXT3_I(dir)->i_dx_cache;
+	stale = !cache || cache->bits != bits ||
+		cache->hash_version != hinfo->hash_version;
+	spin_unlock(&dir->i_lock);
+
+	if (stale) {
+		new = kzalloc(sizeof(*new) + (sizeof(*slot) << bits), GFP_NOFS);
+		if (!new)
+			return;
+		new->bits = bits;
+		new->hash_version = hinfo->hash_version;
+	}
+
+	spin_lock(&dir->i_lock);
+	if (EXT3_I(dir)->i_dx_gen != gen)
+		goto out;
+	if (new) {
+		cache = EXT3_I(dir)->i_dx_cache;
+		EXT3_I(dir)->i_dx_cache = new;
+		new = cache;
+	}
+	cache = EXT3_I(dir)->i_dx_cache;
+	if (cache && cache->bits == bits &&
+	    cache->hash_version == hinfo->hash_version) {
+		slot = &cache->slots[hinfo->hash >> (32 - bits)];
+		slot->lo = lo;
+		slot->last = hi ? hi - 1 : 0;
+		slot->block = dx_get_block(frame->at);
+	}
+out:
+	spin_unlock(&dir->i_lock);
+	kfree(new);
+}
+
+/*
+ * Look for the leaf which must hold dentry's name in the cache.  A name
+ * whose hash is just below the end of the range may have collisions
+ * continuing into the next leaf, so that case still needs dx_probe.
+ * Returns 1 and the leaf block if found.
+ */
+static int dx_cache_lookup(struct inode *dir, struct dentry *dentry,
+			   unsigned long *block)
+{
+	struct ext3_dx_cache *cache;
+	struct dx_cache_slot *slot;
+	struct dx_hash_info hinfo;
+	int found = 0;
+
+	if (!EXT3_I(dir)->i_dx_cache)
+		return 0;
+	spin_lock(&dir->i_lock);
+	cache = EXT3_I(dir)->i_dx_cache;
+	if (cache) {
+		hinfo.hash_version = cache->hash_version;
+		hinfo.seed = EXT3_SB(dir->i_sb)->s_hash_seed;
+		ext3fs_dirhash(dentry->d_name.name, dentry->d_name.len, &hinfo);
+		slot = &cache->slots[hinfo.hash >> (32 - cache->bits)];
+		if (slot->lo <= hinfo.hash && hinfo.hash < slot->last) {
+			*block = slot->block;
+			found = 1;
+		}
+	}
+	spin_unlock(&dir->i_lock);
+	return found;
+}
+
 /*
  * Probe for a directory leaf block to search.
  *
@@ -335,11 +483,15 @@ dx_probe(struct dentry *dentry, struct inode *dir,
 	struct dx_root *root;
 	struct buffer_head *bh;
 	struct dx_frame *frame = frame_in;
+	unsigned int gen;
 	u32 hash;
 
 	frame->bh = NULL;
 	if (dentry)
 		dir = dentry->d_parent->d_inode;
+	/* read before the index: see dx_cache_fill() */
+	gen = EXT3_I(dir)->i_dx_gen;
+	smp_rmb();
 	if (!(bh = ext3_bread (NULL,dir, 0, 0, err)))
 		goto fail;
 	root = (struct dx_root *) bh->b_data;
@@ -419,7 +571,10 @@ dx_probe(struct dentry *dentry, struct inode *dir,
 		frame->bh = bh;
 		frame->entries = entries;
 		frame->at = at;
-		if (!indirect--) return frame;
+		if (!indirect--) {
+			dx_cache_fill(dir, hinfo, frame_in, frame, gen);
+			return frame;
+		}
 		if (!(bh = ext3_bread (NULL,dir, dx_get_block(at), 0, err)))
 			goto fail2;
 		at = entries = ((struct dx_node *) bh->b_data)->entries;
@@ -432,6 +587,7 @@ fail2:
 		frame--;
 	}
 fail:
+	ext3_dx_cache_free(dir);
 	return NULL;
 }
 
@@ -936,6 +1092,18 @@ static struct buffer_head * ext3_dx_find_entry(struct dentry *dentry,
 	sb = dir->i_sb;
 	/* NFS may look up ".." - look at dx_root directory block */
 	if (namelen > 2 || name[0] != '.'||(name[1] != '.' && name[1] != '\0')){
+		if (dx_cache_lookup(dir, dentry, &block) &&
+		    (bh = ext3_bread(NULL, dir, block, 0, err))) {
+			retval = search_dirblock(bh, dir, dentry,
+				block << EXT3_BLOCK_SIZE_BITS(sb), res_dir);
+			if (retval == 1)
+				return bh;
+			brelse(bh);
+			if (retval == 0) {
+				*err = -ENOENT;
+				return NULL;
+			}
+		}
 		if (!(frame = dx_probe(dentry, NULL, &hinfo, frames, err)))
 			return NULL;
 	} else {
@@ -1115,6 +1283,7 @@ static struct ext3_dir_entry_2 *do_split(handle_t *handle, struct inode *dir,
 	struct ext3_dir_entry_2 *de = NULL, *de2;
 	int	err;
 
+	ext3_dx_cache_free(dir);
 	bh2 = ext3_append (handle, dir, &newblock, error);
 	if (!(bh2)) {
 		brelse(*bh);
@@ -1175,6 +1344,7 @@ static struct ext3_dir_entry_2 *do_split(handle_t *handle, struct inode *dir,
 	brelse (bh2);
 	dxtrace(dx_show_index ("frame", frame->entries));
 errout:
+	ext3_dx_cache_free(dir);
 	return de;
 }
 #endif
@@ -1436,8 +1606,17 @@ static int ext3_dx_add_entry(handle_t *handle, struct dentry *dentry,
 	struct inode *dir = dentry->d_parent->d_inode;
 	struct super_block * sb = dir->i_sb;
 	struct ext3_dir_entry_2 *de;
+	unsigned long block;
 	int err;
 
+	if (dx_cache_lookup(dir, dentry, &block)) {
+		if (!(bh = ext3_bread(handle, dir, block, 0, &err)))
+			return err;
+		err = add_dirent_to_buf(handle, dentry, inode, NULL, bh);
+		if (err != -ENOSPC)
+			return err;
+		brelse(bh);
+	}
 	frame = dx_probe(dentry, NULL, &hinfo, frames, &err);
 	if (!frame)
 		return err;
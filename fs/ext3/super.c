@@ -47,6 +47,7 @@ static int ext3_load_journal(struct super_block *, struct ext3_super_block *,
 			     unsigned long journal_devnum);
 static int ext3_create_journal(struct super_block *, struct ext3_super_block *,
 			       int);
+static void ext3_set_journal_features(struct super_block *sb);
 static void ext3_commit_super (struct super_block * sb,
 			       struct ext3_super_block * es,
 			       int sync);
@@ -406,6 +407,7 @@ static void ext3_put_super (struct super_block * sb)
 	percpu_counter_destroy(&sbi->s_freeblocks_counter);
 	percpu_counter_destroy(&sbi->s_freeinodes_counter);
 	percpu_counter_destroy(&sbi->s_dirs_counter);
+	percpu_counter_destroy(&sbi->s_dirtyblocks_counter);
 	brelse(sbi->s_sbh);
 #ifdef CONFIG_QUOTA
 	for (i = 0; i < MAXQUOTAS; i++)
@@ -453,6 +455,9 @@ static struct inode *ext3_alloc_inode(struct super_block *sb)
 	ei->i_default_acl = EXT3_ACL_NOT_CACHED;
 #endif
 	ei->i_block_alloc_info = NULL;
+	ei->i_dx_cache = NULL;
+	ei->i_dx_gen = 0;
+	ei->i_cached_len = 0;
 	ei->vfs_inode.i_version = 1;
 	return &ei->vfs_inode;
 }
@@ -473,6 +478,7 @@ static void init_once(void * foo, kmem_cache_t * cachep, unsigned long flags)
 		init_rwsem(&ei->xattr_sem);
 #endif
 		init_MUTEX(&ei->truncate_sem);
+		spin_lock_init(&ei->i_cached_lock);
 		inode_init_once(&ei->vfs_inode);
 	}
 }
@@ -512,6 +518,7 @@ static void ext3_clear_inode(struct inode *inode)
 	ext3_discard_reservation(inode);
 	EXT3_I(inode)->i_block_alloc_info = NULL;
 	kfree(rsv);
+	ext3_dx_cache_free(inode);
 }
 
 static inline void ext3_show_quota_options(struct seq_file *seq, struct super_block *sb)
@@ -548,6 +555,15 @@ static int ext3_show_options(struct seq_file *seq, struct vfsmount *vfs)
 	else if (test_opt(sb, DATA_FLAGS) == EXT3_MOUNT_WRITEBACK_DATA)
 		seq_puts(seq, ",data=writeback");
 
+	if (test_opt(sb, EXTENTS))
+		seq_puts(seq, ",extents");
+	if (test_opt(sb, DELALLOC))
+		seq_puts(seq, ",delalloc");
+	if (test_opt(sb, JOURNAL_ASYNC_COMMIT))
+		seq_puts(seq, ",journal_async_commit");
+	else if (test_opt(sb, JOURNAL_CHECKSUM))
+		seq_puts(seq, ",journal_checksum");
+
 	ext3_show_quota_options(seq, sb);
 
 	return 0;
@@ -634,7 +650,8 @@ enum {
 	Opt_usrjquota, Opt_grpjquota, Opt_offusrjquota, Opt_offgrpjquota,
 	Opt_jqfmt_vfsold, Opt_jqfmt_vfsv0, Opt_quota, Opt_noquota,
 	Opt_ignore, Opt_barrier, Opt_err, Opt_resize, Opt_usrquota,
-	Opt_grpquota
+	Opt_grpquota, Opt_extents, Opt_noextents, Opt_delalloc, Opt_nodelalloc,
+	Opt_journal_checksum, Opt_journal_async_commit
 };
 
 static match_table_t tokens = {
@@ -683,6 +700,12 @@ static match_table_t tokens = {
 	{Opt_quota, "quota"},
 	{Opt_usrquota, "usrquota"},
 	{Opt_barrier, "barrier=%u"},
+	{Opt_extents, "extents"},
+	{Opt_noextents, "noextents"},
+	{Opt_delalloc, "delalloc"},
+	{Opt_nodelalloc, "nodelalloc"},
+	{Opt_journal_checksum, "journal_checksum"},
+	{Opt_journal_async_commit, "journal_async_commit"},
 	{Opt_err, NULL},
 	{Opt_resize, "resize"},
 };
@@ -1011,6 +1034,25 @@ clear_qf_name:
 		case Opt_nobh:
 			set_opt(sbi->s_mount_opt, NOBH);
 			break;
+		case Opt_extents:
+			set_opt(sbi->s_mount_opt, EXTENTS);
+			break;
+		case Opt_noextents:
+			clear_opt(sbi->s_mount_opt, EXTENTS);
+			break;
+		case Opt_delalloc:
+			set_opt(sbi->s_mount_opt, DELALLOC);
+			break;
+		case Opt_nodelalloc:
+			clear_opt(sbi->s_mount_opt, DELALLOC);
+			break;
+		case Opt_journal_checksum:
+			set_opt(sbi->s_mount_opt, JOURNAL_CHECKSUM);
+			break;
+		case Opt_journal_async_commit:
+			set_opt(sbi->s_mount_opt, JOURNAL_ASYNC_COMMIT);
+			set_opt(sbi->s_mount_opt, JOURNAL_CHECKSUM);
+			break;
 		default:
 			printk (KERN_ERR
 				"EXT3-fs: Unrecognized mount option \"%s\" "
@@ -1581,6 +1623,7 @@ static int ext3_fill_super (struct super_block *sb, void *data, int silent)
 	percpu_counter_init(&sbi->s_freeblocks_counter);
 	percpu_counter_init(&sbi->s_freeinodes_counter);
 	percpu_counter_init(&sbi->s_dirs_counter);
+	percpu_counter_init(&sbi->s_dirtyblocks_counter);
 	bgl_lock_init(&sbi->s_blockgroup_lock);
 
 	for (i = 0; i < db_count; i++) {
@@ -1676,6 +1719,9 @@ static int ext3_fill_super (struct super_block *sb, void *data, int silent)
 		break;
 	}
 
+	if (!(sb->s_flags & MS_RDONLY))
+		ext3_set_journal_features(sb);
+
 	if (test_opt(sb, NOBH)) {
 		if (sb->s_blocksize_bits != PAGE_CACHE_SHIFT) {
 			printk(KERN_WARNING "EXT3-fs: Ignoring nobh option "
@@ -1689,6 +1735,18 @@ static int ext3_fill_super (struct super_block *sb, void *data, int silent)
 			clear_opt(sbi->s_mount_opt, NOBH);
 		}
 	}
+	if (test_opt(sb, DELALLOC)) {
+		if (!test_opt(sb, EXTENTS)) {
+			printk(KERN_WARNING "EXT3-fs: Ignoring delalloc option - "
+				"it needs the extents option\n");
+			clear_opt(sbi->s_mount_opt, DELALLOC);
+		}
+		if (test_opt(sb, DATA_FLAGS) == EXT3_MOUNT_JOURNAL_DATA) {
+			printk(KERN_WARNING "EXT3-fs: Ignoring delalloc option - "
+				"it is not supported with journal mode\n");
+			clear_opt(sbi->s_mount_opt, DELALLOC);
+		}
+	}
 	/*
 	 * The journal_load will have done any necessary log recovery,
 	 * so we can safely mount the rest of the filesystem now.
@@ -1787,6 +1845,41 @@ static void ext3_init_journal_params(struct super_block *sb, journal_t *journal)
 	spin_unlock(&journal->j_state_lock);
 }
 
+/*
+ * Record the journal_checksum and journal_async_commit options in the
+ * journal superblock.  Recovery goes by what the superblock says, so it
+ * has to be on disk before the first commit written the new way.
+ */
+static void ext3_set_journal_features(struct super_block *sb)
+{
+	journal_t *journal = EXT3_SB(sb)->s_journal;
+	journal_superblock_t *jsb = journal->j_superblock;
+	__be32 compat = jsb->s_feature_compat;
+	__be32 incompat = jsb->s_feature_incompat;
+
+	if (test_opt(sb, JOURNAL_ASYNC_COMMIT)) {
+		if (!journal_set_features(journal, JFS_FEATURE_COMPAT_CHECKSUM,
+				0, JFS_FEATURE_INCOMPAT_ASYNC_COMMIT))
+			printk(KERN_WARNING "EXT3-fs: Ignoring "
+			       "journal_async_commit option - the journal "
+			       "does not support it\n");
+	} else if (test_opt(sb, JOURNAL_CHECKSUM)) {
+		if (!journal_set_features(journal, JFS_FEATURE_COMPAT_CHECKSUM,
+				0, 0))
+			printk(KERN_WARNING "EXT3-fs: Ignoring "
+			       "journal_checksum option - the journal "
+			       "does not support it\n");
+		journal_clear_features(journal, 0, 0,
+				JFS_FEATURE_INCOMPAT_ASYNC_COMMIT);
+	} else
+		journal_clear_features(journal, JFS_FEATURE_COMPAT_CHECKSUM,
+				0, JFS_FEATURE_INCOMPAT_ASYNC_COMMIT);
+
+	if (jsb->s_feature_compat != compat ||
+	    jsb->s_feature_incompat != incompat)
+		journal_update_superblock(journal, 1);
+}
+
 static journal_t *ext3_get_journal(struct super_block *sb, int journal_inum)
 {
 	struct inode *journal_inode;
@@ -2239,6 +2332,27 @@ static int ext3_remount (struct super_block * sb, int * flags, char * data)
 	if (sbi->s_mount_opt & EXT3_MOUNT_ABORT)
 		ext3_abort(sb, __FUNCTION__, "Abort forced by user");
 
+	/* The aops of inodes in core depend on it */
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) & EXT3_MOUNT_DELALLOC) {
+		printk(KERN_WARNING "EXT3-fs: delalloc cannot be changed "
+			"on remount\n");
+		sbi->s_mount_opt ^= EXT3_MOUNT_DELALLOC;
+	}
+	/* Commits may be in flight: only switch over on a read-only one */
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) &
+	    (EXT3_MOUNT_JOURNAL_CHECKSUM | EXT3_MOUNT_JOURNAL_ASYNC_COMMIT) &&
+	    !(sb->s_flags & MS_RDONLY)) {
+		printk(KERN_WARNING "EXT3-fs: journal_checksum and "
+			"journal_async_commit cannot be changed on a "
+			"read-write remount\n");
+		sbi->s_mount_opt = (sbi->s_mount_opt &
+			~(EXT3_MOUNT_JOURNAL_CHECKSUM |
+			  EXT3_MOUNT_JOURNAL_ASYNC_COMMIT)) |
+			(old_opts.s_mount_opt &
+			 (EXT3_MOUNT_JOURNAL_CHECKSUM |
+			  EXT3_MOUNT_JOURNAL_ASYNC_COMMIT));
+	}
+
 	sb->s_flags = (sb->s_flags & ~MS_POSIXACL) |
 		((sbi->s_mount_opt & EXT3_MOUNT_POSIX_ACL) ? MS_POSIXACL : 0);
 
@@ -2293,8 +2407,10 @@ static int ext3_remount (struct super_block * sb, int * flags, char * data)
 				err = ret;
 				goto restore_opts;
 			}
-			if (!ext3_setup_super (sb, es, 0))
+			if (!ext3_setup_super (sb, es, 0)) {
 				sb->s_flags &= ~MS_RDONLY;
+				ext3_set_journal_features(sb);
+			}
 		}
 	}
 #ifdef CONFIG_QUOTA
@@ -2327,6 +2443,7 @@ static int ext3_statfs (struct super_block * sb, struct kstatfs * buf)
 {
 	struct ext3_super_block *es = EXT3_SB(sb)->s_es;
 	unsigned long overhead;
+	long dirty;
 	int i;
 
 	if (test_opt (sb, MINIX_DF))
@@ -2368,6 +2485,10 @@ static int ext3_statfs (struct super_block * sb, struct kstatfs * buf)
 	buf->f_bsize = sb->s_blocksize;
 	buf->f_blocks = le32_to_cpu(es->s_blocks_count) - overhead;
 	buf->f_bfree = ext3_count_free_blocks (sb);
+	/* blocks reserved for delayed allocation are as good as used */
+	dirty = percpu_counter_read(&EXT3_SB(sb)->s_dirtyblocks_counter);
+	if (dirty > 0)
+		buf->f_bfree = buf->f_bfree > dirty ? buf->f_bfree - dirty : 0;
 	buf->f_bavail = buf->f_bfree - le32_to_cpu(es->s_r_blocks_count);
 	if (buf->f_bfree < le32_to_cpu(es->s_r_blocks_count))
 		buf->f_bavail = 0;
@@ -27,9 +27,21 @@ struct files_stat_struct files_stat = {
 
 EXPORT_SYMBOL(files_stat); /* Needed by unix.o */
 
-/* public. Not pretty! */
+/* public. Not pretty!  Now only protects the tty_files lists. */
  __cacheline_aligned_in_smp DEFINE_SPINLOCK(files_lock);
 
+/*
+ * On SMP sb->s_files is an array of per-cpu lists.  A file is put on
+ * the list of the CPU that opened it, under that CPU's files_cpu_lock,
+ * and remembers the CPU in f_sb_list_cpu so that the final fput can
+ * take it off again from anywhere.  Open and close therefore never
+ * touch a global cacheline; the rare walkers (remount ro, quota on,
+ * proc and selinuxfs revoke) take every CPU's lock instead.
+ */
+#ifdef CONFIG_SMP
+static DEFINE_PER_CPU(spinlock_t, files_cpu_lock) = SPIN_LOCK_UNLOCKED;
+#endif
+
 static DEFINE_SPINLOCK(filp_count_lock);
 
 /* slab constructors and destructors are called from arbitrary
@@ -151,7 +163,7 @@ void fastcall __fput(struct file *file)
 	fops_put(file->f_op);
 	if (file->f_mode & FMODE_WRITE)
 		put_write_access(inode);
-	file_kill(file);
+	file_sb_list_del(file);
 	file->f_dentry = NULL;
 	file->f_vfsmnt = NULL;
 	file_free(file);
@@ -216,17 +228,88 @@ void put_filp(struct file *file)
 {
 	if (atomic_dec_and_test(&file->f_count)) {
 		security_file_free(file);
-		file_kill(file);
+		file_sb_list_del(file);
 		file_free(file);
 	}
 }
 
+void file_sb_list_add(struct file *file, struct super_block *sb)
+{
+#ifdef CONFIG_SMP
+	int cpu = get_cpu();
+	spinlock_t *lock = &per_cpu(files_cpu_lock, cpu);
+
+	spin_lock(lock);
+	file->f_sb_list_cpu = cpu;
+	list_add(&file->f_u.fu_list, per_cpu_ptr(sb->s_files, cpu));
+	spin_unlock(lock);
+	put_cpu();
+#else
+	file_list_lock();
+	list_add(&file->f_u.fu_list, &sb->s_files);
+	file_list_unlock();
+#endif
+}
+
+void file_sb_list_del(struct file *file)
+{
+	if (!list_empty(&file->f_u.fu_list)) {
+#ifdef CONFIG_SMP
+		spinlock_t *lock = &per_cpu(files_cpu_lock, file->f_sb_list_cpu);
+
+		spin_lock(lock);
+		list_del_init(&file->f_u.fu_list);
+		spin_unlock(lock);
+#else
+		file_list_lock();
+		list_del_init(&file->f_u.fu_list);
+		file_list_unlock();
+#endif
+	}
+}
+
+/*
+ * Take every CPU's list lock, in cpu order.  Only one preempt count is
+ * taken for the lot so that large NR_CPUS cannot overflow it.
+ */
+void file_sb_list_lock_all(void)
+{
+#ifdef CONFIG_SMP
+	int cpu;
+
+	preempt_disable();
+	for_each_cpu(cpu)
+		_raw_spin_lock(&per_cpu(files_cpu_lock, cpu));
+#else
+	file_list_lock();
+#endif
+}
+
+void file_sb_list_unlock_all(void)
+{
+#ifdef CONFIG_SMP
+	int cpu;
+
+	for_each_cpu(cpu)
+		_raw_spin_unlock(&per_cpu(files_cpu_lock, cpu));
+	preempt_enable();
+#else
+	file_list_unlock();
+#endif
+}
+
+/*
+ * file_move/file_kill move a file from its superblock list onto a
+ * private list protected by files_lock, and off it again.  Only the
+ * tty layer does this, for tty->tty_files.
+ */
 void file_move(struct file *file, struct list_head *list)
 {
 	if (!list)
 		return;
+	file_sb_list_del(file);
 	file_list_lock();
-	list_move(&file->f_u.fu_list, list);
+	list_add(&file->f_u.fu_list, list);
 	file_list_unlock();
 }
 
@@ -241,12 +324,11 @@ void file_kill(struct file *file)
 
 int fs_may_remount_ro(struct super_block *sb)
 {
-	struct list_head *p;
+	struct file *file;
 
 	/* Check that no files are currently opened for writing. */
-	file_list_lock();
-	list_for_each(p, &sb->s_files) {
-		struct file *file = list_entry(p, struct file, f_u.fu_list);
+	file_sb_list_lock_all();
+	do_file_list_for_each_entry(sb, file) {
 		struct inode *inode = file->f_dentry->d_inode;
 
 		/* File with pending delete? */
@@ -256,11 +338,11 @@ int fs_may_remount_ro(struct super_block *sb)
 		/* Writeable file? */
 		if (S_ISREG(inode->i_mode) && (file->f_mode & FMODE_WRITE))
 			goto too_bad;
-	}
-	file_list_unlock();
+	} while_file_list_for_each_entry;
+	file_sb_list_unlock_all();
 	return 1; /* Tis' cool bro. */
 too_bad:
-	file_list_unlock();
+	file_sb_list_unlock_all();
 	return 0;
 }
 
@@ -4,9 +4,9 @@
  * Copyright (C) 2002, Linus Torvalds.
  *
  * Contains all the functions related to writing back and waiting
- * upon dirty inodes against superblocks, and writing back dirty
- * pages against inodes.  ie: data writeback.  Writeout of the
- * inode itself is not handled here.
+ * upon dirty inodes against backing devices and superblocks, and
+ * writing back dirty pages against inodes.  ie: data writeback.
+ * Writeout of the inode itself is not handled here.
  *
  * 10Apr2002	akpm@zip.com.au
  *		Split out of fs/inode.c
@@ -25,6 +25,23 @@
 
 extern struct super_block *blockdev_superblock;
 
+/*
+ * The list a dirty inode waits on for its device's flusher thread.  Devices
+ * which never called bdi_init() share the default device's lists.  Inodes
+ * whose pages are never written back (ramfs and friends) are not queued at
+ * all.  Called under inode_lock.
+ */
+static struct list_head *dirty_list(struct inode *inode)
+{
+	struct backing_dev_info *bdi = inode->i_mapping->backing_dev_info;
+
+	if (!bdi_cap_writeback_dirty(bdi))
+		return NULL;
+	if (!bdi_registered(bdi))
+		bdi = &default_backing_dev_info;
+	return &bdi->b_dirty;
+}
+
 /**
  *	__mark_inode_dirty -	internal function
  *	@inode: inode to mark
@@ -32,7 +49,7 @@ extern struct super_block *blockdev_superblock;
  *	Mark an inode as dirty. Callers should use mark_inode_dirty or
  *  	mark_inode_dirty_sync.
  *
- * Put the inode on the super block's dirty list.
+ * Put the inode on its backing device's dirty list.
  *
  * CAREFUL! We mark it dirty unconditionally, but move it onto the
  * dirty list only if it is hashed or if it refers to a blockdev.
@@ -102,13 +119,13 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 		/*
 		 * If the inode is locked, just update its dirty state. 
 		 * The unlocker will place the inode on the appropriate
-		 * superblock list, based upon its state.
+		 * list, based upon its state.
 		 */
 		if (inode->i_state & I_LOCK)
 			goto out;
 
 		/*
-		 * Only add valid (hashed) inodes to the superblock's
+		 * Only add valid (hashed) inodes to the device's
 		 * dirty list.  Add blockdev inodes as well.
 		 */
 		if (!S_ISBLK(inode->i_mode)) {
@@ -119,12 +136,16 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 			goto out;
 
 		/*
-		 * If the inode was already on s_dirty or s_io, don't
-		 * reposition it (that would break s_dirty time-ordering).
+		 * If the inode was already on b_dirty or b_io, don't
+		 * reposition it (that would break b_dirty time-ordering).
 		 */
 		if (!was_dirty) {
-			inode->dirtied_when = jiffies;
-			list_move(&inode->i_list, &sb->s_dirty);
+			struct list_head *head = dirty_list(inode);
+
+			if (head) {
+				inode->dirtied_when = jiffies;
+				list_move(&inode->i_list, head);
+			}
 		}
 	}
 out:
@@ -155,7 +176,7 @@ __sync_single_inode(struct inode *inode, struct writeback_control *wbc)
 {
 	unsigned dirty;
 	struct address_space *mapping = inode->i_mapping;
-	struct super_block *sb = inode->i_sb;
+	struct list_head *head;
 	int wait = wbc->sync_mode == WB_SYNC_ALL;
 	int ret;
 
@@ -186,40 +207,43 @@ __sync_single_inode(struct inode *inode, struct writeback_control *wbc)
 	spin_lock(&inode_lock);
 	inode->i_state &= ~I_LOCK;
 	if (!(inode->i_state & I_FREEING)) {
+		head = dirty_list(inode);
 		if (!(inode->i_state & I_DIRTY) &&
 		    mapping_tagged(mapping, PAGECACHE_TAG_DIRTY)) {
 			/*
 			 * We didn't write back all the pages.  nfs_writepages()
 			 * sometimes bales out without doing anything. Redirty
-			 * the inode.  It is still on sb->s_io.
+			 * the inode.  It is still on bdi->b_io.
 			 */
-			if (wbc->for_kupdate) {
+			inode->i_state |= I_DIRTY_PAGES;
+			if (!head) {
+				/* not written back; leave it where it is */
+			} else if (wbc->for_kupdate) {
 				/*
 				 * For the kupdate function we leave the inode
-				 * at the head of sb_dirty so it will get more
+				 * at the head of b_dirty so it will get more
 				 * writeout as soon as the queue becomes
 				 * uncongested.
 				 */
-				inode->i_state |= I_DIRTY_PAGES;
-				list_move_tail(&inode->i_list, &sb->s_dirty);
+				list_move_tail(&inode->i_list, head);
 			} else {
 				/*
 				 * Otherwise fully redirty the inode so that
-				 * other inodes on this superblock will get some
+				 * other inodes on this device will get some
 				 * writeout.  Otherwise heavy writing to one
 				 * file would indefinitely suspend writeout of
 				 * all the other files.
 				 */
-				inode->i_state |= I_DIRTY_PAGES;
 				inode->dirtied_when = jiffies;
-				list_move(&inode->i_list, &sb->s_dirty);
+				list_move(&inode->i_list, head);
 			}
 		} else if (inode->i_state & I_DIRTY) {
 			/*
 			 * Someone redirtied the inode while were writing back
 			 * the pages.
 			 */
-			list_move(&inode->i_list, &sb->s_dirty);
+			if (head)
+				list_move(&inode->i_list, head);
 		} else if (atomic_read(&inode->i_count)) {
 			/*
 			 * The inode is clean, inuse
@@ -252,7 +276,10 @@ __writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
 		WARN_ON(inode->i_state & I_WILL_FREE);
 
 	if ((wbc->sync_mode != WB_SYNC_ALL) && (inode->i_state & I_LOCK)) {
-		list_move(&inode->i_list, &inode->i_sb->s_dirty);
+		struct list_head *head = dirty_list(inode);
+
+		if (head)
+			list_move(&inode->i_list, head);
 		return 0;
 	}
 
@@ -274,83 +301,74 @@ __writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
 }
 
 /*
- * Write out a superblock's list of dirty inodes.  A wait will be performed
- * upon no inodes, all inodes or the final one, depending upon sync_mode.
+ * Pin the superblock of an inode the flusher is about to write, so that it
+ * cannot be unmounted under us.  If we can't get the readlock, there's no
+ * sense in waiting around, most of the time the FS is going to be unmounted
+ * by the time it is released.  Called under inode_lock.
+ */
+static int pin_sb_for_writeback(struct super_block *sb)
+{
+	spin_lock(&sb_lock);
+	sb->s_count++;
+	spin_unlock(&sb_lock);
+	if (down_read_trylock(&sb->s_umount)) {
+		if (sb->s_root)
+			return 1;
+		up_read(&sb->s_umount);
+	}
+	spin_lock(&sb_lock);
+	__put_super(sb);
+	spin_unlock(&sb_lock);
+	return 0;
+}
+
+/*
+ * Write out a device's list of dirty inodes.  There is one flusher thread
+ * per device, so unlike the old per-superblock walk there is no need to
+ * keep several threads off one queue; a throttled writer may still work
+ * the same lists alongside the flusher.
  *
  * If older_than_this is non-NULL, then only write out inodes which
  * had their first dirtying at a time earlier than *older_than_this.
  *
- * If we're a pdlfush thread, then implement pdflush collision avoidance
- * against the entire list.
- *
- * WB_SYNC_HOLD is a hack for sys_sync(): reattach the inode to sb->s_dirty so
- * that it can be located for waiting on in __writeback_single_inode().
- *
- * Called under inode_lock.
- *
- * If `bdi' is non-zero then we're being asked to writeback a specific queue.
- * This function assumes that the blockdev superblock's inodes are backed by
- * a variety of queues, so all inodes are searched.  For other superblocks,
- * assume that all inodes are backed by the same queue.
- *
- * FIXME: this linear search could get expensive with many fileystems.  But
- * how to fix?  We need to go from an address_space to all inodes which share
- * a queue with that address_space.  (Easy: have a global "dirty superblocks"
- * list).
- *
- * The inodes to be written are parked on sb->s_io.  They are moved back onto
- * sb->s_dirty as they are selected for writing.  This way, none can be missed
+ * The inodes to be written are parked on bdi->b_io.  They are moved back onto
+ * bdi->b_dirty as they are selected for writing.  This way, none can be missed
  * on the writer throttling path, and we get decent balancing between many
  * throttled threads: we don't want them all piling up on __wait_on_inode.
+ *
+ * Called under inode_lock.
  */
 static void
-sync_sb_inodes(struct super_block *sb, struct writeback_control *wbc)
+writeback_bdi_inodes(struct backing_dev_info *bdi,
+		     struct writeback_control *wbc)
 {
 	const unsigned long start = jiffies;	/* livelock avoidance */
+	struct super_block *pinned = NULL;
 
-	if (!wbc->for_kupdate || list_empty(&sb->s_io))
-		list_splice_init(&sb->s_dirty, &sb->s_io);
+	if (!wbc->for_kupdate || list_empty(&bdi->b_io))
+		list_splice_init(&bdi->b_dirty, &bdi->b_io);
 
-	while (!list_empty(&sb->s_io)) {
-		struct inode *inode = list_entry(sb->s_io.prev,
+	while (!list_empty(&bdi->b_io)) {
+		struct inode *inode = list_entry(bdi->b_io.prev,
 						struct inode, i_list);
-		struct address_space *mapping = inode->i_mapping;
-		struct backing_dev_info *bdi = mapping->backing_dev_info;
 		long pages_skipped;
 
-		if (!bdi_cap_writeback_dirty(bdi)) {
-			list_move(&inode->i_list, &sb->s_dirty);
-			if (sb == blockdev_superblock) {
-				/*
-				 * Dirty memory-backed blockdev: the ramdisk
-				 * driver does this.  Skip just this inode
-				 */
-				continue;
-			}
+		if (!mapping_cap_writeback_dirty(inode->i_mapping)) {
 			/*
-			 * Dirty memory-backed inode against a filesystem other
-			 * than the kernel-internal bdev filesystem.  Skip the
-			 * entire superblock.
+			 * The mapping moved to a memory-backed device (the
+			 * ramdisk driver does this) after the inode was
+			 * queued.  It is never written back.
 			 */
-			break;
+			list_move(&inode->i_list, &inode_in_use);
+			continue;
 		}
 
 		if (wbc->nonblocking && bdi_write_congested(bdi)) {
 			wbc->encountered_congestion = 1;
-			if (sb != blockdev_superblock)
-				break;		/* Skip a congested fs */
-			list_move(&inode->i_list, &sb->s_dirty);
-			continue;		/* Skip a congested blockdev */
-		}
-
-		if (wbc->bdi && bdi != wbc->bdi) {
-			if (sb != blockdev_superblock)
-				break;		/* fs has the wrong queue */
-			list_move(&inode->i_list, &sb->s_dirty);
-			continue;		/* blockdev has wrong queue */
+			break;
 		}
 
-		/* Was this inode dirtied after sync_sb_inodes was called? */
+		/* Was this inode dirtied after writeback_bdi_inodes was called? */
 		if (time_after(inode->dirtied_when, start))
 			break;
 
@@ -359,26 +377,28 @@ sync_sb_inodes(struct super_block *sb, struct writeback_control *wbc)
 						*wbc->older_than_this))
 			break;
 
-		/* Is another pdflush already flushing this queue? */
-		if (current_is_pdflush() && !writeback_acquire(bdi))
-			break;
+		if (inode->i_sb != pinned) {
+			if (pinned)
+				drop_super(pinned);
+			pinned = NULL;
+			if (!pin_sb_for_writeback(inode->i_sb)) {
+				/* Being unmounted, which writes it anyway */
+				list_move(&inode->i_list, &bdi->b_dirty);
+				continue;
+			}
+			pinned = inode->i_sb;
+		}
 
 		BUG_ON(inode->i_state & I_FREEING);
 		__iget(inode);
 		pages_skipped = wbc->pages_skipped;
 		__writeback_single_inode(inode, wbc);
-		if (wbc->sync_mode == WB_SYNC_HOLD) {
-			inode->dirtied_when = jiffies;
-			list_move(&inode->i_list, &sb->s_dirty);
-		}
-		if (current_is_pdflush())
-			writeback_release(bdi);
 		if (wbc->pages_skipped != pages_skipped) {
 			/*
 			 * writeback is not making progress due to locked
 			 * buffers.  Skip this inode for now.
 			 */
-			list_move(&inode->i_list, &sb->s_dirty);
+			list_move(&inode->i_list, &bdi->b_dirty);
 		}
 		spin_unlock(&inode_lock);
 		cond_resched();
@@ -387,69 +407,39 @@ sync_sb_inodes(struct super_block *sb, struct writeback_control *wbc)
 		if (wbc->nr_to_write <= 0)
 			break;
 	}
-	return;		/* Leave any unwritten inodes on s_io */
+	if (pinned)
+		drop_super(pinned);
+	return;		/* Leave any unwritten inodes on b_io */
 }
 
-/*
- * Start writeback of dirty pagecache data against all unlocked inodes.
- *
- * Note:
- * We don't need to grab a reference to superblock here. If it has non-empty
- * ->s_dirty it's hadn't been killed yet and kill_super() won't proceed
- * past sync_inodes_sb() until both the ->s_dirty and ->s_io lists are
- * empty. Since __sync_single_inode() regains inode_lock before it finally moves
- * inode from superblock lists we are OK.
- *
- * If `older_than_this' is non-zero then only flush inodes which have a
- * flushtime older than *older_than_this.
+/**
+ * writeback_inodes_bdi - start writeback against one device
+ * @bdi: the device
+ * @wbc: how much to write, and how
  *
- * If `bdi' is non-zero then we will scan the first inode against each
- * superblock until we find the matching ones.  One group will be the dirty
- * inodes against a filesystem.  Then when we hit the dummy blockdev superblock,
- * sync_sb_inodes will seekout the blockdev which matches `bdi'.  Maybe not
- * super-efficient but we're about to do a ton of I/O...
+ * Start writeback of dirty pagecache data against the unlocked inodes on
+ * @bdi's dirty list, up to wbc->nr_to_write pages.  Used by the device's
+ * flusher thread and by writers throttled in balance_dirty_pages().
  */
-void
-writeback_inodes(struct writeback_control *wbc)
+void writeback_inodes_bdi(struct backing_dev_info *bdi,
+			  struct writeback_control *wbc)
 {
-	struct super_block *sb;
+	if (!bdi_registered(bdi))
+		bdi = &default_backing_dev_info;
 
 	might_sleep();
-	spin_lock(&sb_lock);
-restart:
-	sb = sb_entry(super_blocks.prev);
-	for (; sb != sb_entry(&super_blocks); sb = sb_entry(sb->s_list.prev)) {
-		if (!list_empty(&sb->s_dirty) || !list_empty(&sb->s_io)) {
-			/* we're making our own get_super here */
-			sb->s_count++;
-			spin_unlock(&sb_lock);
-			/*
-			 * If we can't get the readlock, there's no sense in
-			 * waiting around, most of the time the FS is going to
-			 * be unmounted by the time it is released.
-			 */
-			if (down_read_trylock(&sb->s_umount)) {
-				if (sb->s_root) {
-					spin_lock(&inode_lock);
-					sync_sb_inodes(sb, wbc);
-					spin_unlock(&inode_lock);
-				}
-				up_read(&sb->s_umount);
-			}
-			spin_lock(&sb_lock);
-			if (__put_super_and_need_restart(sb))
-				goto restart;
-		}
-		if (wbc->nr_to_write <= 0)
-			break;
-	}
-	spin_unlock(&sb_lock);
+	spin_lock(&inode_lock);
+	writeback_bdi_inodes(bdi, wbc);
+	spin_unlock(&inode_lock);
 }
 
 /*
  * writeback and wait upon the filesystem's dirty inodes.  The caller will
- * do this in two passes - one to write, and one to wait.  WB_SYNC_HOLD is
- * used to park the written inodes on sb->s_dirty for the wait pass.
+ * do this in two passes - one to write, and one to wait.  The inodes of one
+ * filesystem can be spread over several devices' dirty lists (the blockdev
+ * superblock always is), so walk the superblock's own inode list.  The wait
+ * pass also waits on inodes which the first pass left clean but under
+ * writeback.
  *
  * A finite limit is set on the number of pages which will be written.
  * To prevent infinite livelock of sys_sync().
@@ -460,20 +450,79 @@ restart:
 void sync_inodes_sb(struct super_block *sb, int wait)
 {
 	struct writeback_control wbc = {
-		.sync_mode	= wait ? WB_SYNC_ALL : WB_SYNC_HOLD,
+		.sync_mode	= wait ? WB_SYNC_ALL : WB_SYNC_NONE,
 	};
 	unsigned long nr_dirty = read_page_state(nr_dirty);
 	unsigned long nr_unstable = read_page_state(nr_unstable);
+	struct inode *inode, *old_inode = NULL;
 
 	wbc.nr_to_write = nr_dirty + nr_unstable +
 			(inodes_stat.nr_inodes - inodes_stat.nr_unused) +
 			nr_dirty + nr_unstable;
 	wbc.nr_to_write += wbc.nr_to_write / 2;		/* Bit more for luck */
+
 	spin_lock(&inode_lock);
-	sync_sb_inodes(sb, &wbc);
+	spin_lock(&sb->s_inodes_lock);
+	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+		struct address_space *mapping = inode->i_mapping;
+
+		if (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE|I_NEW))
+			continue;
+		if (!mapping_cap_writeback_dirty(mapping))
+			continue;
+		if (!(inode->i_state & I_DIRTY) && (!wait ||
+		    !mapping_tagged(mapping, PAGECACHE_TAG_WRITEBACK)))
+			continue;
+
+		/*
+		 * The reference keeps the inode on s_inodes while the locks
+		 * are dropped, so the walk can carry on from it.  It is
+		 * released only after the next inode has been pinned.
+		 */
+		__iget(inode);
+		spin_unlock(&sb->s_inodes_lock);
+		if (inode->i_state & I_DIRTY) {
+			__writeback_single_inode(inode, &wbc);
+			spin_unlock(&inode_lock);
+		} else {
+			spin_unlock(&inode_lock);
+			filemap_fdatawait(mapping);
+		}
+		iput(old_inode);
+		old_inode = inode;
+		cond_resched();
+		spin_lock(&inode_lock);
+		spin_lock(&sb->s_inodes_lock);
+		if (wbc.nr_to_write <= 0)
+			break;
+	}
+	spin_unlock(&sb->s_inodes_lock);
 	spin_unlock(&inode_lock);
+	iput(old_inode);
 }
 
+/*
+ * Does the filesystem have any dirty inodes left?
+ */
+int sb_has_dirty_inodes(struct super_block *sb)
+{
+	struct inode *inode;
+	int ret = 0;
+
+	spin_lock(&inode_lock);
+	spin_lock(&sb->s_inodes_lock);
+	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+		if (inode->i_state & I_DIRTY) {
+			ret = 1;
+			break;
+		}
+	}
+	spin_unlock(&sb->s_inodes_lock);
+	spin_unlock(&inode_lock);
+	return ret;
+}
+EXPORT_SYMBOL(sb_has_dirty_inodes);
+
 /*
  * Rather lame livelock avoidance.
  */
@@ -492,8 +541,8 @@ static void set_sb_syncing(int val)
  * sync_inodes - writes all inodes to disk
  * @wait: wait for completion
  *
- * sync_inodes() goes through each super block's dirty inode list, writes the
- * inodes out, waits on the writeout and puts the inodes back on the normal
+ * sync_inodes() goes through each super block's inodes, writes the dirty
+ * ones out, waits on the writeout and puts the inodes back on the normal
  * list.
  *
  * This is for sys_sync().  fsync_dev() uses the same algorithm.  The subtle
@@ -580,7 +629,7 @@ EXPORT_SYMBOL(write_inode_now);
  * @wbc: controls the writeback mode
  *
  * sync_inode() will write an inode and its pages to disk.  It will also
- * correctly update the inode on its superblock's dirty inode lists and will
+ * correctly update the inode on its device's dirty inode lists and will
  * update inode->i_state.
  *
  * The caller must have a ref on the inode.
@@ -652,41 +701,3 @@ int generic_osync_inode(struct inode *inode, struct address_space *mapping, int
 }
 
 EXPORT_SYMBOL(generic_osync_inode);
-
-/**
- * writeback_acquire: attempt to get exclusive writeback access to a device
- * @bdi: the device's backing_dev_info structure
- *
- * It is a waste of resources to have more than one pdflush thread blocked on
- * a single request queue.  Exclusion at the request_queue level is obtained
- * via a flag in the request_queue's backing_dev_info.state.
- *
- * Non-request_queue-backed address_spaces will share default_backing_dev_info,
- * unless they implement their own.  Which is somewhat inefficient, as this
- * may prevent concurrent writeback against multiple devices.
- */
-int writeback_acquire(struct backing_dev_info *bdi)
-{
-	return !test_and_set_bit(BDI_pdflush, &bdi->state);
-}
-
-/**
- * writeback_in_progress: determine whether there is writeback in progress
- * @bdi: the device's backing_dev_info structure.
- *
- * Determine whether there is writeback in progress against a backing device.
- */
-int writeback_in_progress(struct backing_dev_info *bdi)
-{
-	return test_bit(BDI_pdflush, &bdi->state);
-}
-
-/**
- * writeback_release: relinquish exclusive writeback access against a device.
- * @bdi: the device's backing_dev_info structure
- */
-void writeback_release(struct backing_dev_info *bdi)
-{
-	BUG_ON(!writeback_in_progress(bdi));
-	clear_bit(BDI_pdflush, &bdi->state);
-}
@@ -377,6 +377,7 @@ static void fuse_conn_release(struct kobject *kobj)
 		list_del(&req->list);
 		fuse_request_free(req);
 	}
+	bdi_destroy(&fc->bdi);
 	kfree(fc);
 }
 
@@ -408,6 +409,8 @@ static struct fuse_conn *new_conn(void)
 		}
 		fc->bdi.ra_pages = (VM_MAX_READAHEAD * 1024) / PAGE_CACHE_SIZE;
 		fc->bdi.unplug_io_fn = default_unplug_io_fn;
+		strcpy(fc->bdi.name, "fuse");
+		bdi_init(&fc->bdi);
 		fc->reqctr = 0;
 	}
 	return fc;
@@ -289,10 +289,12 @@ static void hugetlbfs_forget_inode(struct inode *inode)
 		spin_lock(&inode_lock);
 		inode->i_state &= ~I_WILL_FREE;
 		inodes_stat.nr_unused--;
-		hlist_del_init(&inode->i_hash);
+		remove_inode_hash(inode);
 	}
 	list_del_init(&inode->i_list);
+	spin_lock(&inode->i_sb->s_inodes_lock);
 	list_del_init(&inode->i_sb_list);
+	spin_unlock(&inode->i_sb->s_inodes_lock);
 	inode->i_state |= I_FREEING;
 	inodes_stat.nr_inodes--;
 	spin_unlock(&inode_lock);
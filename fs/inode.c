@@ -69,6 +69,10 @@ static unsigned int i_hash_shift;
  *
  * A "dirty" list is maintained for each super block,
  * allowing for low-overhead inode sync() operations.
+ *
+ * The "unused" list is maintained lazily: an inode that
+ * picks up a reference again stays where it is until
+ * prune_icache() finds it and moves it to "in_use".
  */
 
 LIST_HEAD(inode_in_use);
@@ -80,9 +84,38 @@ static struct hlist_head *inode_hashtable;
  *
  * NOTE! You also have to own the lock if you change
  * the i_state of an inode while it is in use..
+ *
+ * The hash chains and the per-sb s_inodes lists have
+ * their own locks, which nest inside inode_lock:
+ *
+ *   inode_lock
+ *     inode_hash_locks[]	(inode->i_hash)
+ *     sb->s_inodes_lock	(inode->i_sb_list)
  */
 DEFINE_SPINLOCK(inode_lock);
 
+/*
+ * Hash chains are protected by an array of spinlocks hashed on the
+ * chain head.  A hashed inode records its chain in i_hash_head, so it
+ * can be unhashed without knowing its hash value.
+ *
+ * An inode which already has users can be found and grabbed with only
+ * the chain lock held.  Taking the first reference on an unused inode,
+ * or waiting for one that is being freed, still needs inode_lock.
+ * i_count is only ever raised from zero under inode_lock, so an inode
+ * that inode_lock holders see unused stays unused.
+ */
+#define I_HASH_LOCK_BITS	8
+
+static struct inode_hash_lock {
+	spinlock_t lock;
+} ____cacheline_aligned_in_smp inode_hash_locks[1 << I_HASH_LOCK_BITS];
+
+static inline spinlock_t *inode_hash_lock(struct hlist_head *head)
+{
+	return &inode_hash_locks[hash_ptr(head, I_HASH_LOCK_BITS)].lock;
+}
+
 /*
  * iprune_sem provides exclusion between the kswapd or try_to_free_pages
  * icache shrinking path, and the umount path.  Without this exclusion,
@@ -223,6 +256,9 @@ static void init_once(void * foo, kmem_cache_t * cachep, unsigned long flags)
 
 /*
  * inode_lock must be held
+ *
+ * An unused inode is left on inode_unused; prune_icache() moves
+ * it to inode_in_use when it comes across it.
  */
 void __iget(struct inode * inode)
 {
@@ -231,11 +267,39 @@ void __iget(struct inode * inode)
 		return;
 	}
 	atomic_inc(&inode->i_count);
-	if (!(inode->i_state & (I_DIRTY|I_LOCK)))
-		list_move(&inode->i_list, &inode_in_use);
 	inodes_stat.nr_unused--;
 }
 
+/*
+ * Grab a reference to a hashed inode with only its hash chain lock held.
+ * This fails, and the caller has to retry under inode_lock, if the inode
+ * is unused or on its way out.
+ */
+static inline int __iget_hashed(struct inode *inode)
+{
+	if (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE))
+		return 0;
+	return atomic_inc_not_zero(&inode->i_count);
+}
+
+static inline void inode_sb_list_add(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	spin_lock(&sb->s_inodes_lock);
+	list_add(&inode->i_sb_list, &sb->s_inodes);
+	spin_unlock(&sb->s_inodes_lock);
+}
+
+static inline void inode_sb_list_del(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	spin_lock(&sb->s_inodes_lock);
+	list_del_init(&inode->i_sb_list);
+	spin_unlock(&sb->s_inodes_lock);
+}
+
 /**
  * clear_inode - clear an inode
  * @inode: inode to clear
@@ -289,10 +353,8 @@ static void dispose_list(struct list_head *head)
 			truncate_inode_pages(&inode->i_data, 0);
 		clear_inode(inode);
 
-		spin_lock(&inode_lock);
-		hlist_del_init(&inode->i_hash);
-		list_del_init(&inode->i_sb_list);
-		spin_unlock(&inode_lock);
+		remove_inode_hash(inode);
+		inode_sb_list_del(inode);
 
 		wake_up_inode(inode);
 		destroy_inode(inode);
@@ -305,9 +367,11 @@ static void dispose_list(struct list_head *head)
 
 /*
  * Invalidate all inodes for a device.
+ * Called with inode_lock and sb->s_inodes_lock held.
  */
-static int invalidate_list(struct list_head *head, struct list_head *dispose)
+static int invalidate_list(struct super_block *sb, struct list_head *dispose)
 {
+	struct list_head *head = &sb->s_inodes;
 	struct list_head *next;
 	int busy = 0, count = 0;
 
@@ -322,7 +386,11 @@ static int invalidate_list(struct list_head *head, struct list_head *dispose)
 		 * change during umount anymore, and because iprune_sem keeps
 		 * shrink_icache_memory() away.
 		 */
-		cond_resched_lock(&inode_lock);
+		if (need_resched()) {
+			spin_unlock(&sb->s_inodes_lock);
+			cond_resched_lock(&inode_lock);
+			spin_lock(&sb->s_inodes_lock);
+		}
 
 		next = next->next;
 		if (tmp == head)
@@ -357,8 +425,10 @@ int invalidate_inodes(struct super_block * sb)
 
 	down(&iprune_sem);
 	spin_lock(&inode_lock);
-	inotify_unmount_inodes(&sb->s_inodes);
-	busy = invalidate_list(&sb->s_inodes, &throw_away);
+	spin_lock(&sb->s_inodes_lock);
+	inotify_unmount_inodes(sb);
+	busy = invalidate_list(sb, &throw_away);
+	spin_unlock(&sb->s_inodes_lock);
 	spin_unlock(&inode_lock);
 
 	dispose_list(&throw_away);
@@ -433,7 +503,12 @@ static void prune_icache(int nr_to_scan)
 
 		inode = list_entry(inode_unused.prev, struct inode, i_list);
 
-		if (inode->i_state || atomic_read(&inode->i_count)) {
+		if (atomic_read(&inode->i_count)) {
+			/* picked up again since it was put here, see __iget() */
+			list_move(&inode->i_list, &inode_in_use);
+			continue;
+		}
+		if (inode->i_state) {
 			list_move(&inode->i_list, &inode_unused);
 			continue;
 		}
@@ -491,57 +566,79 @@ static int shrink_icache_memory(int nr, gfp_t gfp_mask)
 	return (inodes_stat.nr_unused / 100) * sysctl_vfs_cache_pressure;
 }
 
-static void __wait_on_freeing_inode(struct inode *inode);
+static void __wait_on_freeing_inode(struct inode *inode,
+				    struct hlist_head *head);
+
 /*
- * Called with the inode lock held.
- * NOTE: we are not increasing the inode-refcount, you must call __iget()
- * by hand after calling find_inode now! This simplifies iunique and won't
- * add any additional branch in the common code.
+ * Called with the hash chain lock held.  The inode returned may be
+ * on its way out; the caller has to check i_state.
  */
-static struct inode * find_inode(struct super_block * sb, struct hlist_head *head, int (*test)(struct inode *, void *), void *data)
+static struct inode * __find_inode(struct super_block * sb, struct hlist_head *head, int (*test)(struct inode *, void *), void *data)
 {
 	struct hlist_node *node;
-	struct inode * inode = NULL;
+	struct inode * inode;
 
-repeat:
-	hlist_for_each (node, head) { 
-		inode = hlist_entry(node, struct inode, i_hash);
+	hlist_for_each_entry (inode, node, head, i_hash) {
 		if (inode->i_sb != sb)
 			continue;
 		if (!test(inode, data))
 			continue;
-		if (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE)) {
-			__wait_on_freeing_inode(inode);
-			goto repeat;
-		}
-		break;
+		return inode;
 	}
-	return node ? inode : NULL;
+	return NULL;
 }
 
-/*
- * find_inode_fast is the fast path version of find_inode, see the comment at
- * iget_locked for details.
- */
-static struct inode * find_inode_fast(struct super_block * sb, struct hlist_head *head, unsigned long ino)
+static struct inode * __find_inode_fast(struct super_block * sb, struct hlist_head *head, unsigned long ino)
 {
 	struct hlist_node *node;
-	struct inode * inode = NULL;
+	struct inode * inode;
 
-repeat:
-	hlist_for_each (node, head) {
-		inode = hlist_entry(node, struct inode, i_hash);
+	hlist_for_each_entry (inode, node, head, i_hash) {
 		if (inode->i_ino != ino)
 			continue;
 		if (inode->i_sb != sb)
 			continue;
-		if (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE)) {
-			__wait_on_freeing_inode(inode);
-			goto repeat;
-		}
-		break;
+		return inode;
 	}
-	return node ? inode : NULL;
+	return NULL;
+}
+
+/*
+ * Called with the inode lock and the hash chain lock held.
+ * NOTE: we are not increasing the inode-refcount, you must call __iget()
+ * by hand after calling find_inode now! This simplifies iunique and won't
+ * add any additional branch in the common code.
+ */
+static struct inode * find_inode(struct super_block * sb, struct hlist_head *head, int (*test)(struct inode *, void *), void *data)
+{
+	struct inode * inode;
+
+	while ((inode = __find_inode(sb, head, test, data)) != NULL &&
+	       (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE)))
+		__wait_on_freeing_inode(inode, head);
+	return inode;
+}
+
+/*
+ * find_inode_fast is the fast path version of find_inode, see the comment at
+ * iget_locked for details.
+ */
+static struct inode * find_inode_fast(struct super_block * sb, struct hlist_head *head, unsigned long ino)
+{
+	struct inode * inode;
+
+	while ((inode = __find_inode_fast(sb, head, ino)) != NULL &&
+	       (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE)))
+		__wait_on_freeing_inode(inode, head);
+	return inode;
+}
+
+/* Caller holds the hash chain lock */
+static inline void __insert_inode_hash_locked(struct inode *inode,
+					      struct hlist_head *head)
+{
+	inode->i_hash_head = head;
+	hlist_add_head(&inode->i_hash, head);
 }
 
 /**
@@ -562,7 +659,7 @@ struct inode *new_inode(struct super_block *sb)
 		spin_lock(&inode_lock);
 		inodes_stat.nr_inodes++;
 		list_add(&inode->i_list, &inode_in_use);
-		list_add(&inode->i_sb_list, &sb->s_inodes);
+		inode_sb_list_add(inode);
 		inode->i_ino = ++last_ino;
 		inode->i_state = 0;
 		spin_unlock(&inode_lock);
@@ -596,6 +693,7 @@ EXPORT_SYMBOL(unlock_new_inode);
  */
 static struct inode * get_new_inode(struct super_block *sb, struct hlist_head *head, int (*test)(struct inode *, void *), int (*set)(struct inode *, void *), void *data)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode * inode;
 
 	inode = alloc_inode(sb);
@@ -603,6 +701,7 @@ static struct inode * get_new_inode(struct super_block *sb, struct hlist_head *h
 		struct inode * old;
 
 		spin_lock(&inode_lock);
+		spin_lock(lock);
 		/* We released the lock, so.. */
 		old = find_inode(sb, head, test, data);
 		if (!old) {
@@ -611,9 +710,10 @@ static struct inode * get_new_inode(struct super_block *sb, struct hlist_head *h
 
 			inodes_stat.nr_inodes++;
 			list_add(&inode->i_list, &inode_in_use);
-			list_add(&inode->i_sb_list, &sb->s_inodes);
-			hlist_add_head(&inode->i_hash, head);
+			inode_sb_list_add(inode);
 			inode->i_state = I_LOCK|I_NEW;
+			__insert_inode_hash_locked(inode, head);
+			spin_unlock(lock);
 			spin_unlock(&inode_lock);
 
 			/* Return the locked inode with I_NEW set, the
@@ -628,6 +728,7 @@ static struct inode * get_new_inode(struct super_block *sb, struct hlist_head *h
 		 * allocated.
 		 */
 		__iget(old);
+		spin_unlock(lock);
 		spin_unlock(&inode_lock);
 		destroy_inode(inode);
 		inode = old;
@@ -636,6 +737,7 @@ static struct inode * get_new_inode(struct super_block *sb, struct hlist_head *h
 	return inode;
 
 set_failed:
+	spin_unlock(lock);
 	spin_unlock(&inode_lock);
 	destroy_inode(inode);
 	return NULL;
@@ -647,6 +749,7 @@ set_failed:
  */
 static struct inode * get_new_inode_fast(struct super_block *sb, struct hlist_head *head, unsigned long ino)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode * inode;
 
 	inode = alloc_inode(sb);
@@ -654,15 +757,17 @@ static struct inode * get_new_inode_fast(struct super_block *sb, struct hlist_he
 		struct inode * old;
 
 		spin_lock(&inode_lock);
+		spin_lock(lock);
 		/* We released the lock, so.. */
 		old = find_inode_fast(sb, head, ino);
 		if (!old) {
 			inode->i_ino = ino;
 			inodes_stat.nr_inodes++;
 			list_add(&inode->i_list, &inode_in_use);
-			list_add(&inode->i_sb_list, &sb->s_inodes);
-			hlist_add_head(&inode->i_hash, head);
+			inode_sb_list_add(inode);
 			inode->i_state = I_LOCK|I_NEW;
+			__insert_inode_hash_locked(inode, head);
+			spin_unlock(lock);
 			spin_unlock(&inode_lock);
 
 			/* Return the locked inode with I_NEW set, the
@@ -677,6 +782,7 @@ static struct inode * get_new_inode_fast(struct super_block *sb, struct hlist_he
 		 * allocated.
 		 */
 		__iget(old);
+		spin_unlock(lock);
 		spin_unlock(&inode_lock);
 		destroy_inode(inode);
 		inode = old;
@@ -714,13 +820,17 @@ ino_t iunique(struct super_block *sb, ino_t max_reserved)
 	static ino_t counter;
 	struct inode *inode;
 	struct hlist_head * head;
+	spinlock_t *lock;
 	ino_t res;
 	spin_lock(&inode_lock);
 retry:
 	if (counter > max_reserved) {
 		head = inode_hashtable + hash(sb,counter);
+		lock = inode_hash_lock(head);
 		res = counter++;
+		spin_lock(lock);
 		inode = find_inode_fast(sb, head, res);
+		spin_unlock(lock);
 		if (!inode) {
 			spin_unlock(&inode_lock);
 			return res;
@@ -769,25 +879,42 @@ EXPORT_SYMBOL(igrab);
  *
  * Otherwise NULL is returned.
  *
- * Note, @test is called with the inode_lock held, so can't sleep.
+ * An inode that is already in use is grabbed under its hash chain lock
+ * alone; inode_lock is only taken to revive an unused inode or to wait
+ * for one that is being freed.
+ *
+ * Note, @test is called with a spinlock held, so can't sleep.
  */
 static struct inode *ifind(struct super_block *sb,
 		struct hlist_head *head, int (*test)(struct inode *, void *),
 		void *data, const int wait)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode *inode;
 
+	spin_lock(lock);
+	inode = __find_inode(sb, head, test, data);
+	if (inode && __iget_hashed(inode)) {
+		spin_unlock(lock);
+		goto found;
+	}
+	spin_unlock(lock);
+	if (!inode)
+		return NULL;
+
 	spin_lock(&inode_lock);
+	spin_lock(lock);
 	inode = find_inode(sb, head, test, data);
-	if (inode) {
+	if (inode)
 		__iget(inode);
-		spin_unlock(&inode_lock);
-		if (likely(wait))
-			wait_on_inode(inode);
-		return inode;
-	}
+	spin_unlock(lock);
 	spin_unlock(&inode_lock);
-	return NULL;
+	if (!inode)
+		return NULL;
+found:
+	if (likely(wait))
+		wait_on_inode(inode);
+	return inode;
 }
 
 /**
@@ -808,18 +935,31 @@ static struct inode *ifind(struct super_block *sb,
 static struct inode *ifind_fast(struct super_block *sb,
 		struct hlist_head *head, unsigned long ino)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode *inode;
 
+	spin_lock(lock);
+	inode = __find_inode_fast(sb, head, ino);
+	if (inode && __iget_hashed(inode)) {
+		spin_unlock(lock);
+		goto found;
+	}
+	spin_unlock(lock);
+	if (!inode)
+		return NULL;
+
 	spin_lock(&inode_lock);
+	spin_lock(lock);
 	inode = find_inode_fast(sb, head, ino);
-	if (inode) {
+	if (inode)
 		__iget(inode);
-		spin_unlock(&inode_lock);
-		wait_on_inode(inode);
-		return inode;
-	}
+	spin_unlock(lock);
 	spin_unlock(&inode_lock);
-	return NULL;
+	if (!inode)
+		return NULL;
+found:
+	wait_on_inode(inode);
+	return inode;
 }
 
 /**
@@ -841,7 +981,7 @@ static struct inode *ifind_fast(struct super_block *sb,
  *
  * Otherwise NULL is returned.
  *
- * Note, @test is called with the inode_lock held, so can't sleep.
+ * Note, @test is called with a spinlock held, so can't sleep.
  */
 struct inode *ilookup5_nowait(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
@@ -870,7 +1010,7 @@ EXPORT_SYMBOL(ilookup5_nowait);
  *
  * Otherwise NULL is returned.
  *
- * Note, @test is called with the inode_lock held, so can't sleep.
+ * Note, @test is called with a spinlock held, so can't sleep.
  */
 struct inode *ilookup5(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
@@ -925,7 +1065,7 @@ EXPORT_SYMBOL(ilookup);
  * inode and this is returned locked, hashed, and with the I_NEW flag set. The
  * file system gets to fill it in before unlocking it via unlock_new_inode().
  *
- * Note both @test and @set are called with the inode_lock held, so can't sleep.
+ * Note both @test and @set are called with spinlocks held, so can't sleep.
  */
 struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *),
@@ -991,9 +1131,11 @@ EXPORT_SYMBOL(iget_locked);
 void __insert_inode_hash(struct inode *inode, unsigned long hashval)
 {
 	struct hlist_head *head = inode_hashtable + hash(inode->i_sb, hashval);
-	spin_lock(&inode_lock);
-	hlist_add_head(&inode->i_hash, head);
-	spin_unlock(&inode_lock);
+	spinlock_t *lock = inode_hash_lock(head);
+
+	spin_lock(lock);
+	__insert_inode_hash_locked(inode, head);
+	spin_unlock(lock);
 }
 
 EXPORT_SYMBOL(__insert_inode_hash);
@@ -1003,12 +1145,16 @@ EXPORT_SYMBOL(__insert_inode_hash);
  *	@inode: inode to unhash
  *
  *	Remove an inode from the superblock.
+ *
+ *	May be called with or without inode_lock held.
  */
 void remove_inode_hash(struct inode *inode)
 {
-	spin_lock(&inode_lock);
+	spinlock_t *lock = inode_hash_lock(inode->i_hash_head);
+
+	spin_lock(lock);
 	hlist_del_init(&inode->i_hash);
-	spin_unlock(&inode_lock);
+	spin_unlock(lock);
 }
 
 EXPORT_SYMBOL(remove_inode_hash);
@@ -1030,7 +1176,7 @@ void generic_delete_inode(struct inode *inode)
 	struct super_operations *op = inode->i_sb->s_op;
 
 	list_del_init(&inode->i_list);
-	list_del_init(&inode->i_sb_list);
+	inode_sb_list_del(inode);
 	inode->i_state|=I_FREEING;
 	inodes_stat.nr_inodes--;
 	spin_unlock(&inode_lock);
@@ -1050,9 +1196,7 @@ void generic_delete_inode(struct inode *inode)
 		truncate_inode_pages(&inode->i_data, 0);
 		clear_inode(inode);
 	}
-	spin_lock(&inode_lock);
-	hlist_del_init(&inode->i_hash);
-	spin_unlock(&inode_lock);
+	remove_inode_hash(inode);
 	wake_up_inode(inode);
 	if (inode->i_state != I_CLEAR)
 		BUG();
@@ -1079,10 +1223,10 @@ static void generic_forget_inode(struct inode *inode)
 		spin_lock(&inode_lock);
 		inode->i_state &= ~I_WILL_FREE;
 		inodes_stat.nr_unused--;
-		hlist_del_init(&inode->i_hash);
+		remove_inode_hash(inode);
 	}
 	list_del_init(&inode->i_list);
-	list_del_init(&inode->i_sb_list);
+	inode_sb_list_del(inode);
 	inode->i_state |= I_FREEING;
 	inodes_stat.nr_inodes--;
 	spin_unlock(&inode_lock);
@@ -1280,6 +1424,7 @@ void remove_dquot_ref(struct super_block *sb, int type,
 	if (!sb->dq_op)
 		return;	/* nothing to do */
 	spin_lock(&inode_lock);	/* This lock is for inodes code */
+	spin_lock(&sb->s_inodes_lock);
 
 	/*
 	 * We don't have to lock against quota code - test IS_QUOTAINIT is
@@ -1289,6 +1434,7 @@ void remove_dquot_ref(struct super_block *sb, int type,
 		if (!IS_NOQUOTA(inode))
 			remove_inode_dquot_ref(inode, type, tofree_head);
 
+	spin_unlock(&sb->s_inodes_lock);
 	spin_unlock(&inode_lock);
 }
 
@@ -1310,18 +1456,22 @@ int inode_wait(void *word)
  * It doesn't matter if I_LOCK is not set initially, a call to
  * wake_up_inode() after removing from the hash list will DTRT.
  *
- * This is called with inode_lock held.
+ * This is called with inode_lock and the lock for @head held.
  */
-static void __wait_on_freeing_inode(struct inode *inode)
+static void __wait_on_freeing_inode(struct inode *inode,
+				    struct hlist_head *head)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	wait_queue_head_t *wq;
 	DEFINE_WAIT_BIT(wait, &inode->i_state, __I_LOCK);
 	wq = bit_waitqueue(&inode->i_state, __I_LOCK);
 	prepare_to_wait(wq, &wait.wait, TASK_UNINTERRUPTIBLE);
+	spin_unlock(lock);
 	spin_unlock(&inode_lock);
 	schedule();
 	finish_wait(wq, &wait.wait);
 	spin_lock(&inode_lock);
+	spin_lock(lock);
 }
 
 void wake_up_inode(struct inode *inode)
@@ -1350,6 +1500,9 @@ void __init inode_init_early(void)
 {
 	int loop;
 
+	for (loop = 0; loop < (1 << I_HASH_LOCK_BITS); loop++)
+		spin_lock_init(&inode_hash_locks[loop].lock);
+
 	/* If hashes are distributed across NUMA nodes, defer
 	 * hash allocation until vmalloc space is available.
 	 */
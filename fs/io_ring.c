@@ -0,0 +1,1496 @@
+/*
+ *  fs/io_ring.c
+ *
+ *  Asynchronous I/O through a pair of rings shared with user space.
+ *
+ *  User space fills in submission queue entries (sqes) and advances the
+ *  tail of the submission ring; io_ring_enter() (or the sq thread, with
+ *  IORING_SETUP_SQPOLL) consumes them and posts one completion queue
+ *  entry (cqe) per request on the completion ring.  Many requests cost
+ *  one system call, or none at all with the sq thread.
+ *
+ *  A request never blocks the submitter:
+ *
+ *  - reads of regular files whose pages are all cached run inline
+ *  - sockets, pipes and other pollable files are polled: the request
+ *    waits on the file's wait queue and runs once the file is ready,
+ *    without waiting where the file allows it, and goes back to the
+ *    wait queue if the file has nothing for it after all
+ *  - everything else (uncached and O_DIRECT reads, writes, fsync) is
+ *    handed to the ring's worker threads, which run it in the mm of
+ *    the task that set the ring up
+ *
+ *  The ring areas count against the owner's RLIMIT_MEMLOCK and its
+ *  kernel threads against RLIMIT_NPROC.
+ *
+ *  See Documentation/io_ring.txt for the interface.
+ */
+
+#include <linux/config.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
+#include <linux/pagemap.h>
+#include <linux/uio.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/net.h>
+#include <linux/socket.h>
+#include <linux/mount.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/aio.h>
+#include <linux/workqueue.h>
+#include <linux/syscalls.h>
+#include <linux/security.h>
+#include <linux/fsnotify.h>
+#include <linux/io_ring.h>
+#include <asm/uaccess.h>
+#include <asm/mmu_context.h>
+#include <asm/io.h>
+
+#define IORINGFS_MAGIC		0x10a1b2c3
+
+#define IORING_MAX_ENTRIES	4096
+#define IORING_MAX_WORKERS	16
+#define IORING_CACHED_PAGES	16	/* longest read probed for inline */
+
+struct io_sq_ring {
+	u32			head;		/* written by the kernel */
+	u32			tail;		/* written by user space */
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			flags;		/* IORING_SQ_* */
+	u32			dropped;	/* invalid sqe indexes */
+	u32			array[0];	/* indexes into the sqes */
+};
+
+struct io_cq_ring {
+	u32			head;		/* written by user space */
+	u32			tail;		/* written by the kernel */
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			overflow;	/* completions lost */
+	u32			resv;
+	struct io_ring_cqe	cqes[0];
+};
+
+struct io_ring_ctx {
+	struct io_sq_ring	*sq_ring;
+	struct io_ring_sqe	*sq_sqes;
+	unsigned int		sq_entries;
+	unsigned int		sq_mask;
+	unsigned int		cached_sq_head;
+	struct mutex		submit_lock;	/* one consumer of the sq */
+
+	struct io_cq_ring	*cq_ring;
+	unsigned int		cq_entries;
+	unsigned int		cq_mask;
+	unsigned int		cached_cq_tail;
+	spinlock_t		completion_lock;
+	wait_queue_head_t	cq_wait;	/* io_ring_enter(GETEVENTS) */
+	wait_queue_head_t	poll_wait;	/* poll() on the ring fd */
+	atomic_t		inflight;
+
+	unsigned int		flags;		/* IORING_SETUP_* */
+	struct mm_struct	*mm;		/* mm_count reference */
+	struct task_struct	*task;		/* owner, whose files the sq
+						   thread looks fds up in */
+	struct user_struct	*user;		/* charged for the following */
+	size_t			locked;		/* bytes against RLIMIT_MEMLOCK */
+	unsigned int		nr_threads;	/* against RLIMIT_NPROC */
+	uid_t			uid, euid, fsuid;
+	gid_t			gid, egid, fsgid;
+	kernel_cap_t		cap_effective;
+	struct group_info	*group_info;
+
+	struct task_struct	*sq_thread;
+	wait_queue_head_t	sq_wait;
+	unsigned long		sq_thread_idle;	/* jiffies */
+	int			sq_thread_gone;	/* the owner exited, so
+						   io_ring_enter submits */
+
+	spinlock_t		lock;		/* work_list and poll_list */
+	struct list_head	work_list;	/* for the workers */
+	struct list_head	poll_list;	/* waiting for their file */
+	wait_queue_head_t	worker_wait;
+	unsigned int		nr_workers;
+	struct task_struct	**workers;
+	int			dead;		/* workers are being stopped */
+
+	struct work_struct	free_work;
+};
+
+/*
+ * One request: a copy of its sqe, so the slot can be reused as soon as
+ * the sq head has moved past it
+ */
+struct io_kiocb {
+	struct list_head	list;		/* on work_list or poll_list */
+	struct io_ring_ctx	*ctx;
+	struct file		*file;
+	struct io_ring_sqe	sqe;
+
+	wait_queue_head_t	*head;		/* polled: the file's queue */
+	wait_queue_t		wait;
+	unsigned int		events;
+	int			poll_state;	/* REQ_POLL_*, under head->lock */
+
+	size_t			done;		/* stream WRITEV: bytes so far */
+	size_t			total;		/* ... out of */
+};
+
+enum {
+	REQ_POLL_ARMING,	/* io_ring_arm_poll() is still looking */
+	REQ_POLL_WOKEN,		/* ... and the file became ready meanwhile */
+	REQ_POLL_ARMED,		/* on poll_list, the wakeup queues it */
+};
+
+struct io_poll_table {
+	poll_table		pt;
+	struct io_kiocb		*req;
+	int			error;
+};
+
+static kmem_cache_t *req_cachep;
+static struct vfsmount *io_ring_mnt;
+static struct workqueue_struct *io_ring_wq;
+static struct file_operations io_ring_fops;
+
+static void io_ring_arm_poll(struct io_kiocb *req, int can_block);
+
+/*
+ * Fields user space writes to may change under us: read them once
+ */
+static inline u32 io_ring_read(u32 *p)
+{
+	return *(volatile u32 *) p;
+}
+
+static inline unsigned int io_cqring_events(struct io_ring_ctx *ctx)
+{
+	return ctx->cached_cq_tail - io_ring_read(&ctx->cq_ring->head);
+}
+
+static inline int io_sqring_pending(struct io_ring_ctx *ctx)
+{
+	return io_ring_read(&ctx->sq_ring->tail) != ctx->cached_sq_head;
+}
+
+/*
+ * Post a completion.  Callable from any context.
+ */
+static void io_ring_post(struct io_ring_ctx *ctx, u64 user_data, long res)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	struct io_ring_cqe *cqe;
+	unsigned long flags;
+	unsigned int tail;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	tail = ctx->cached_cq_tail;
+	if (tail - io_ring_read(&ring->head) == ctx->cq_entries) {
+		ring->overflow++;
+	} else {
+		cqe = &ring->cqes[tail & ctx->cq_mask];
+		cqe->user_data = user_data;
+		cqe->res = res;
+		cqe->flags = 0;
+		/* the cqe must be visible before the tail that covers it */
+		smp_wmb();
+		ring->tail = ctx->cached_cq_tail = tail + 1;
+	}
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	/* pairs with the waiter queueing itself before checking the tail */
+	smp_mb();
+	if (waitqueue_active(&ctx->cq_wait))
+		wake_up(&ctx->cq_wait);
+	if (waitqueue_active(&ctx->poll_wait))
+		wake_up(&ctx->poll_wait);
+}
+
+static void io_ring_free_req(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+
+	if (req->file)
+		fput(req->file);
+	kmem_cache_free(req_cachep, req);
+	atomic_dec(&ctx->inflight);
+}
+
+static void io_ring_complete(struct io_kiocb *req, long res)
+{
+	io_ring_post(req->ctx, req->sqe.user_data, res);
+	io_ring_free_req(req);
+}
+
+/*
+ * Hand a request that may block to the workers
+ */
+static void io_ring_punt(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+
+	spin_lock_irq(&ctx->lock);
+	list_add_tail(&req->list, &ctx->work_list);
+	spin_unlock_irq(&ctx->lock);
+	wake_up(&ctx->worker_wait);
+}
+
+/*
+ * Files that can make a request wait indefinitely, and say when they
+ * won't through ->poll
+ */
+static inline int io_ring_is_stream(struct file *file)
+{
+	umode_t mode = file->f_dentry->d_inode->i_mode;
+
+	return file->f_op && file->f_op->poll &&
+	       !S_ISREG(mode) && !S_ISBLK(mode);
+}
+
+/*
+ * Streams that READV and WRITEV can be run on without waiting: sockets
+ * and pipes whatever their O_NONBLOCK, anything else only with it
+ */
+static inline int io_ring_can_nonblock(struct file *file)
+{
+	struct inode *inode = file->f_dentry->d_inode;
+
+	return S_ISSOCK(inode->i_mode) || inode->i_pipe ||
+	       (file->f_flags & O_NONBLOCK);
+}
+
+/*
+ * Is the whole range of a buffered read in the page cache?  Then it can
+ * be done inline without waiting for I/O.
+ */
+static int io_ring_cached(struct io_kiocb *req)
+{
+	struct file *file = req->file;
+	struct address_space *mapping = file->f_mapping;
+	struct iovec iov[UIO_FASTIOV];
+	loff_t pos = req->sqe.off;
+	pgoff_t index, end;
+	size_t len = 0;
+	int i;
+
+	if (file->f_flags & O_DIRECT)
+		return 0;
+	if (!req->sqe.len || req->sqe.len > UIO_FASTIOV || pos < 0)
+		return 0;
+	if (copy_from_user(iov, (void __user *) (unsigned long) req->sqe.addr,
+			   req->sqe.len * sizeof(struct iovec)))
+		return 0;
+	for (i = 0; i < req->sqe.len; i++)
+		len += iov[i].iov_len;
+	if (!len)
+		return 0;
+
+	index = pos >> PAGE_CACHE_SHIFT;
+	end = (pos + len - 1) >> PAGE_CACHE_SHIFT;
+	if (end - index >= IORING_CACHED_PAGES)
+		return 0;
+
+	for (; index <= end; index++) {
+		struct page *page = find_get_page(mapping, index);
+		int uptodate = page && PageUptodate(page);
+
+		if (page)
+			page_cache_release(page);
+		if (!uptodate)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Run the operation itself.  With nonblock, socket operations return
+ * -EAGAIN rather than wait.
+ */
+static long io_ring_do_op(struct io_kiocb *req, int nonblock)
+{
+	struct io_ring_sqe *sqe = &req->sqe;
+	void __user *addr = (void __user *) (unsigned long) sqe->addr;
+	struct socket *sock;
+	loff_t pos = sqe->off;
+	unsigned int flags;
+	int err;
+
+	switch (sqe->opcode) {
+	case IORING_OP_READV:
+		return vfs_readv(req->file, addr, sqe->len, &pos);
+	case IORING_OP_WRITEV:
+		return vfs_writev(req->file, addr, sqe->len, &pos);
+	case IORING_OP_FSYNC:
+		if (sqe->fsync_flags & ~IORING_FSYNC_DATASYNC)
+			return -EINVAL;
+		return vfs_fsync(req->file,
+				 sqe->fsync_flags & IORING_FSYNC_DATASYNC);
+	case IORING_OP_SENDMSG:
+	case IORING_OP_RECVMSG:
+		sock = sock_from_file(req->file, &err);
+		if (!sock)
+			return err;
+		flags = sqe->msg_flags & ~MSG_CMSG_COMPAT;
+		if (nonblock)
+			flags |= MSG_DONTWAIT;
+		if (sqe->opcode == IORING_OP_SENDMSG)
+			return __sys_sendmsg(sock, addr, flags);
+		return __sys_recvmsg(sock, addr, flags);
+	}
+	return -EINVAL;
+}
+
+/*
+ * READV or WRITEV on a stream, without waiting, from req->done bytes
+ * into the iovecs on.  Returns -EAGAIN if the file has nothing for us.
+ */
+static long io_ring_stream_rw(struct io_kiocb *req)
+{
+	typedef ssize_t (*io_fn_t)(struct file *, char __user *, size_t, loff_t *);
+	typedef ssize_t (*iov_fn_t)(struct file *, const struct iovec *, unsigned long, loff_t *);
+
+	struct io_ring_sqe *sqe = &req->sqe;
+	struct iovec __user *uvector =
+		(struct iovec __user *) (unsigned long) sqe->addr;
+	struct iovec iovstack[UIO_FASTIOV], *iov = iovstack, *vector;
+	struct file *file = req->file;
+	struct inode *inode = file->f_dentry->d_inode;
+	unsigned long nr_segs = sqe->len;
+	int type = sqe->opcode == IORING_OP_READV ? READ : WRITE;
+	size_t skip = req->done;
+	loff_t pos = 0;
+	io_fn_t fn;
+	iov_fn_t fnv;
+	long ret;
+	int seg;
+
+	if (!(file->f_mode & (type == READ ? FMODE_READ : FMODE_WRITE)))
+		return -EBADF;
+	if (!nr_segs)
+		return 0;
+	if (nr_segs > UIO_MAXIOV)
+		return -EINVAL;
+	if (nr_segs > UIO_FASTIOV) {
+		iov = kmalloc(nr_segs * sizeof(struct iovec), GFP_KERNEL);
+		if (!iov)
+			return -ENOMEM;
+	}
+	ret = -EFAULT;
+	if (copy_from_user(iov, uvector, nr_segs * sizeof(*uvector)))
+		goto out;
+
+	/* as do_readv_writev(), and step over what is done already */
+	req->total = 0;
+	vector = iov;
+	for (seg = 0; seg < nr_segs; seg++) {
+		ssize_t len = (ssize_t) iov[seg].iov_len;
+
+		ret = -EINVAL;
+		if (len < 0)
+			goto out;
+		ret = -EFAULT;
+		if (!access_ok(type == READ ? VERIFY_WRITE : VERIFY_READ,
+			       iov[seg].iov_base, len))
+			goto out;
+		req->total += len;
+		ret = -EINVAL;
+		if ((ssize_t) req->total < 0)
+			goto out;
+		if (skip && skip >= len) {
+			skip -= len;
+			vector++;
+			continue;
+		}
+		iov[seg].iov_base += skip;
+		iov[seg].iov_len -= skip;
+		skip = 0;
+	}
+	nr_segs -= vector - iov;
+	ret = 0;
+	if (req->done >= req->total)
+		goto out;
+
+	if (S_ISSOCK(inode->i_mode)) {
+		struct socket *sock;
+		struct msghdr msg;
+		int err;
+
+		sock = sock_from_file(file, &err);
+		if (!sock) {
+			ret = err;
+			goto out;
+		}
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = vector;
+		msg.msg_iovlen = nr_segs;
+		msg.msg_flags = MSG_DONTWAIT;
+		if (type == READ)
+			ret = sock_recvmsg(sock, &msg, req->total - req->done,
+					   MSG_DONTWAIT);
+		else
+			ret = sock_sendmsg(sock, &msg, req->total - req->done);
+		goto out;
+	}
+
+	ret = rw_verify_area(type, file, &pos, req->total - req->done);
+	if (ret < 0)
+		goto out;
+	ret = security_file_permission(file, type == READ ? MAY_READ : MAY_WRITE);
+	if (ret)
+		goto out;
+
+	if (inode->i_pipe) {
+		if (type == READ)
+			ret = pipe_readv_nonblock(file, vector, nr_segs);
+		else
+			ret = pipe_writev_nonblock(file, vector, nr_segs);
+		goto out_notify;
+	}
+
+	/* O_NONBLOCK is set: the file's own methods won't wait */
+	if (type == READ) {
+		fn = file->f_op->read;
+		fnv = file->f_op->readv;
+	} else {
+		fn = (io_fn_t) file->f_op->write;
+		fnv = file->f_op->writev;
+	}
+	if (fnv) {
+		ret = fnv(file, vector, nr_segs, &pos);
+		goto out_notify;
+	}
+	ret = -EINVAL;
+	if (!fn)
+		goto out;
+	for (ret = 0; nr_segs > 0; vector++, nr_segs--) {
+		ssize_t nr = fn(file, vector->iov_base, vector->iov_len, &pos);
+
+		if (nr < 0) {
+			if (!ret)
+				ret = nr;
+			break;
+		}
+		ret += nr;
+		if (nr != vector->iov_len)
+			break;
+	}
+
+out_notify:
+	if (ret > 0) {
+		if (type == READ)
+			fsnotify_access(file->f_dentry);
+		else
+			fsnotify_modify(file->f_dentry);
+	}
+out:
+	if (iov != iovstack)
+		kfree(iov);
+	return ret;
+}
+
+/*
+ * Wait for the request's file again.  polled is set when called back
+ * from io_ring_arm_poll(), which found the file ready: the request then
+ * goes to the workers instead of being polled again from in there, so a
+ * file which keeps saying it is ready can't recurse on the stack.
+ */
+static void io_ring_wait_file(struct io_kiocb *req, int can_block, int polled)
+{
+	if (polled)
+		io_ring_punt(req);
+	else
+		io_ring_arm_poll(req, can_block);
+}
+
+/*
+ * Issue a request that needs no more waiting for its file, or that
+ * never did.  can_block is set in the workers only: elsewhere anything
+ * that might sleep for long is punted to them.
+ */
+static void io_ring_issue(struct io_kiocb *req, int can_block, int polled)
+{
+	long ret;
+
+	switch (req->sqe.opcode) {
+	case IORING_OP_POLL_ADD:
+		/* as io_ring_arm_poll(): errors and hangups always count */
+		ret = req->file->f_op->poll(req->file, NULL) &
+		      (req->events | POLLERR | POLLHUP);
+		if (!ret) {
+			io_ring_wait_file(req, can_block, polled);
+			return;
+		}
+		break;
+	case IORING_OP_SENDMSG:
+	case IORING_OP_RECVMSG:
+		ret = io_ring_do_op(req, 1);
+		if (ret == -EAGAIN && io_ring_is_stream(req->file)) {
+			io_ring_wait_file(req, can_block, polled);
+			return;
+		}
+		break;
+	case IORING_OP_READV:
+	case IORING_OP_WRITEV:
+		if (!io_ring_is_stream(req->file) ||
+		    !io_ring_can_nonblock(req->file))
+			goto may_block;
+		ret = io_ring_stream_rw(req);
+		if (ret == -EAGAIN) {
+			io_ring_wait_file(req, can_block, polled);
+			return;
+		}
+		/* a stream write is done when all of it is written */
+		if (req->sqe.opcode == IORING_OP_WRITEV && ret > 0) {
+			req->done += ret;
+			if (req->done < req->total) {
+				io_ring_wait_file(req, can_block, polled);
+				return;
+			}
+		}
+		if (req->done)
+			ret = req->done;
+		break;
+	default:
+	may_block:
+		if (!can_block) {
+			io_ring_punt(req);
+			return;
+		}
+		ret = io_ring_do_op(req, 0);
+		if (ret == -EAGAIN && io_ring_is_stream(req->file)) {
+			io_ring_wait_file(req, can_block, polled);
+			return;
+		}
+		break;
+	}
+	io_ring_complete(req, ret);
+}
+
+/*
+ * The file of a polled request became ready.  Called with the file's
+ * wait queue lock held, so only queue it for a worker, or leave it to
+ * io_ring_arm_poll() if that has not finished yet.
+ */
+static int io_ring_poll_wake(wait_queue_t *wait, unsigned mode, int sync,
+			     void *key)
+{
+	struct io_kiocb *req = container_of(wait, struct io_kiocb, wait);
+	struct io_ring_ctx *ctx = req->ctx;
+
+	list_del_init(&wait->task_list);
+	if (req->poll_state == REQ_POLL_ARMING) {
+		req->poll_state = REQ_POLL_WOKEN;
+		return 1;
+	}
+
+	spin_lock(&ctx->lock);
+	list_move_tail(&req->list, &ctx->work_list);
+	spin_unlock(&ctx->lock);
+	wake_up(&ctx->worker_wait);
+	return 1;
+}
+
+static void io_ring_poll_queue(struct file *file, wait_queue_head_t *head,
+			       poll_table *p)
+{
+	struct io_poll_table *pt = container_of(p, struct io_poll_table, pt);
+	struct io_kiocb *req = pt->req;
+
+	/* a single wait queue per request */
+	if (req->head) {
+		pt->error = -EINVAL;
+		return;
+	}
+	req->head = head;
+	add_wait_queue(head, &req->wait);
+}
+
+/*
+ * Take an armed request off its file's wait queue, when tearing down
+ * the ring.  Returns 0 if the wakeup got there first: the request is
+ * then on the work list.
+ */
+static int io_ring_poll_detach(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	unsigned long flags;
+	int detached = 0;
+
+	spin_lock_irqsave(&req->head->lock, flags);
+	if (!list_empty(&req->wait.task_list)) {
+		list_del_init(&req->wait.task_list);
+		detached = 1;
+	}
+	spin_unlock_irqrestore(&req->head->lock, flags);
+
+	if (detached) {
+		spin_lock_irq(&ctx->lock);
+		list_del_init(&req->list);
+		spin_unlock_irq(&ctx->lock);
+	}
+	return detached;
+}
+
+/*
+ * Wait for req->events on the request's file, or issue it right away
+ * if the file is ready already
+ */
+static void io_ring_arm_poll(struct io_kiocb *req, int can_block)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_poll_table pt;
+	unsigned long flags;
+	unsigned int mask;
+
+	pt.req = req;
+	pt.error = 0;
+	init_poll_funcptr(&pt.pt, io_ring_poll_queue);
+	req->head = NULL;
+	req->poll_state = REQ_POLL_ARMING;
+	init_waitqueue_func_entry(&req->wait, io_ring_poll_wake);
+	INIT_LIST_HEAD(&req->wait.task_list);
+
+	mask = req->file->f_op->poll(req->file, &pt.pt);
+	mask &= req->events | POLLERR | POLLHUP;
+
+	if (req->head) {
+		spin_lock_irqsave(&req->head->lock, flags);
+		if (!mask && !pt.error && req->poll_state == REQ_POLL_ARMING) {
+			req->poll_state = REQ_POLL_ARMED;
+			spin_lock(&ctx->lock);
+			list_add_tail(&req->list, &ctx->poll_list);
+			spin_unlock(&ctx->lock);
+			spin_unlock_irqrestore(&req->head->lock, flags);
+			return;
+		}
+		list_del_init(&req->wait.task_list);
+		spin_unlock_irqrestore(&req->head->lock, flags);
+	}
+
+	if (pt.error)
+		io_ring_complete(req, pt.error);
+	else if (!mask && !req->head)
+		io_ring_complete(req, -EINVAL);		/* can't be waited for */
+	else
+		io_ring_issue(req, can_block, 1);
+}
+
+static void io_ring_submit_one(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	struct io_ring_sqe *sqe = &req->sqe;
+
+	req->ctx = ctx;
+	req->file = NULL;
+	req->head = NULL;
+	req->done = 0;
+	INIT_LIST_HEAD(&req->list);
+
+	if (sqe->flags || sqe->opcode >= IORING_OP_LAST) {
+		io_ring_complete(req, -EINVAL);
+		return;
+	}
+	if (sqe->opcode == IORING_OP_NOP) {
+		io_ring_complete(req, 0);
+		return;
+	}
+
+	req->file = fget(sqe->fd);
+	if (!req->file) {
+		io_ring_complete(req, -EBADF);
+		return;
+	}
+	/* a ring holding a reference to itself would never be freed */
+	if (req->file->f_op == &io_ring_fops) {
+		io_ring_complete(req, -EBADF);
+		return;
+	}
+
+	switch (sqe->opcode) {
+	case IORING_OP_POLL_ADD:
+		if (!req->file->f_op || !req->file->f_op->poll) {
+			io_ring_complete(req, -EINVAL);
+			return;
+		}
+		req->events = sqe->poll_events & 0xffff;
+		io_ring_arm_poll(req, 0);
+		return;
+	case IORING_OP_READV:
+	case IORING_OP_RECVMSG:
+		req->events = POLLIN | POLLRDNORM;
+		break;
+	default:
+		req->events = POLLOUT | POLLWRNORM;
+		break;
+	}
+
+	if (sqe->opcode != IORING_OP_FSYNC && io_ring_is_stream(req->file))
+		io_ring_arm_poll(req, 0);
+	else if (sqe->opcode == IORING_OP_READV && io_ring_cached(req))
+		io_ring_complete(req, io_ring_do_op(req, 0));
+	else
+		io_ring_issue(req, 0, 0);
+}
+
+/*
+ * Consume up to to_submit sqes.  The caller holds ctx->submit_lock.
+ * Stops early if the cq could not take the completions.
+ */
+static int io_ring_submit(struct io_ring_ctx *ctx, unsigned int to_submit)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+	unsigned int head, tail;
+	int submitted = 0;
+
+	head = ctx->cached_sq_head;
+	tail = io_ring_read(&ring->tail);
+	/* read the sqes only after the tail that published them */
+	smp_rmb();
+
+	while (submitted < to_submit && head != tail) {
+		struct io_kiocb *req;
+		unsigned int idx;
+
+		if (atomic_read(&ctx->inflight) + io_cqring_events(ctx) >=
+		    ctx->cq_entries) {
+			if (!submitted)
+				submitted = -EBUSY;
+			break;
+		}
+
+		idx = io_ring_read(&ring->array[head & ctx->sq_mask]);
+		if (idx >= ctx->sq_entries) {
+			ring->dropped++;
+			head++;
+			continue;
+		}
+
+		req = kmem_cache_alloc(req_cachep, SLAB_KERNEL);
+		if (!req) {
+			if (!submitted)
+				submitted = -EAGAIN;
+			break;
+		}
+		memcpy(&req->sqe, &ctx->sq_sqes[idx], sizeof(req->sqe));
+		head++;
+
+		atomic_inc(&ctx->inflight);
+		io_ring_submit_one(ctx, req);
+		submitted++;
+	}
+
+	ctx->cached_sq_head = head;
+	/* done with the sqes before user space may reuse them */
+	smp_mb();
+	ring->head = head;
+	return submitted;
+}
+
+/*
+ * Workers and the sq thread act on behalf of the ring's owner
+ */
+static void io_ring_set_creds(struct io_ring_ctx *ctx)
+{
+	current->uid = ctx->uid;
+	current->euid = ctx->euid;
+	current->fsuid = ctx->fsuid;
+	current->gid = ctx->gid;
+	current->egid = ctx->egid;
+	current->fsgid = ctx->fsgid;
+	current->cap_effective = ctx->cap_effective;
+	set_current_groups(ctx->group_info);
+}
+
+static int io_ring_use_mm(struct io_ring_ctx *ctx, struct mm_struct **mm)
+{
+	if (*mm)
+		return 1;
+	if (!atomic_inc_not_zero(&ctx->mm->mm_users))
+		return 0;
+	*mm = ctx->mm;
+	use_mm(*mm);
+	return 1;
+}
+
+static void io_ring_unuse_mm(struct mm_struct **mm)
+{
+	if (*mm) {
+		unuse_mm(*mm);
+		mmput(*mm);
+		*mm = NULL;
+	}
+}
+
+static int io_ring_worker(void *data)
+{
+	struct io_ring_ctx *ctx = data;
+	struct mm_struct *mm = NULL;
+	mm_segment_t old_fs = get_fs();
+	struct io_kiocb *req;
+	DEFINE_WAIT(wait);
+
+	io_ring_set_creds(ctx);
+	set_fs(USER_DS);
+	/* SIGKILL interrupts a request waiting on a file that can't be polled */
+	allow_signal(SIGKILL);
+
+	while (!kthread_should_stop()) {
+		spin_lock_irq(&ctx->lock);
+		if (ctx->dead || list_empty(&ctx->work_list)) {
+			/* the SIGKILL of the teardown stays pending */
+			if (ctx->dead)
+				prepare_to_wait_exclusive(&ctx->worker_wait,
+						&wait, TASK_UNINTERRUPTIBLE);
+			else {
+				flush_signals(current);
+				prepare_to_wait_exclusive(&ctx->worker_wait,
+						&wait, TASK_INTERRUPTIBLE);
+			}
+			spin_unlock_irq(&ctx->lock);
+			/* don't pin the owner's mm while idle */
+			io_ring_unuse_mm(&mm);
+			if (!kthread_should_stop())
+				schedule();
+			finish_wait(&ctx->worker_wait, &wait);
+			continue;
+		}
+		req = list_entry(ctx->work_list.next, struct io_kiocb, list);
+		list_del_init(&req->list);
+		spin_unlock_irq(&ctx->lock);
+
+		if (io_ring_use_mm(ctx, &mm))
+			io_ring_issue(req, 1, 0);
+		else
+			io_ring_complete(req, -EFAULT);
+		cond_resched();
+	}
+
+	io_ring_unuse_mm(&mm);
+	set_fs(old_fs);
+	return 0;
+}
+
+/*
+ * Poll the sq for IORING_SETUP_SQPOLL, sleeping after sq_thread_idle
+ * without work.  fds are looked up in the owner's file table; once the
+ * owner has exited there is none, and the thread leaves submitting to
+ * io_ring_enter() with IORING_SQ_NEED_WAKEUP set for good.
+ */
+static int io_ring_sq_thread(void *data)
+{
+	struct io_ring_ctx *ctx = data;
+	struct files_struct *files = NULL, *old_files = current->files;
+	struct mm_struct *mm = NULL;
+	mm_segment_t old_fs = get_fs();
+	unsigned long timeout = jiffies + ctx->sq_thread_idle;
+	DEFINE_WAIT(wait);
+
+	io_ring_set_creds(ctx);
+	set_fs(USER_DS);
+
+	while (!kthread_should_stop()) {
+		int ret;
+
+		if (!io_sqring_pending(ctx)) {
+			if (time_before(jiffies, timeout)) {
+				cond_resched();
+				cpu_relax();
+				continue;
+			}
+
+			prepare_to_wait(&ctx->sq_wait, &wait, TASK_INTERRUPTIBLE);
+			ctx->sq_ring->flags |= IORING_SQ_NEED_WAKEUP;
+			/* publish the flag before looking at the tail again */
+			smp_mb();
+			if (!io_sqring_pending(ctx) && !kthread_should_stop()) {
+				io_ring_unuse_mm(&mm);
+				if (files) {
+					task_lock(current);
+					current->files = old_files;
+					task_unlock(current);
+					put_files_struct(files);
+					files = NULL;
+				}
+				schedule();
+			}
+			finish_wait(&ctx->sq_wait, &wait);
+			ctx->sq_ring->flags &= ~IORING_SQ_NEED_WAKEUP;
+			timeout = jiffies + ctx->sq_thread_idle;
+			continue;
+		}
+
+		if (!files) {
+			files = get_files_struct(ctx->task);
+			if (files) {
+				task_lock(current);
+				current->files = files;
+				task_unlock(current);
+			}
+		}
+		if (!files || !io_ring_use_mm(ctx, &mm)) {
+			ctx->sq_thread_gone = 1;
+			smp_wmb();
+			ctx->sq_ring->flags |= IORING_SQ_NEED_WAKEUP;
+			break;
+		}
+
+		mutex_lock(&ctx->submit_lock);
+		ret = io_ring_submit(ctx, ctx->sq_entries);
+		mutex_unlock(&ctx->submit_lock);
+		/* the cq is full: give user space time to reap it */
+		if (ret <= 0)
+			schedule_timeout_interruptible(1);
+		timeout = jiffies + ctx->sq_thread_idle;
+	}
+
+	/* wait for io_ring_ctx_free() to stop us */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	io_ring_unuse_mm(&mm);
+	if (files) {
+		task_lock(current);
+		current->files = old_files;
+		task_unlock(current);
+		put_files_struct(files);
+	}
+	set_fs(old_fs);
+	return 0;
+}
+
+static size_t io_sq_ring_size(struct io_ring_ctx *ctx)
+{
+	return sizeof(struct io_sq_ring) + ctx->sq_entries * sizeof(u32);
+}
+
+static size_t io_cq_ring_size(struct io_ring_ctx *ctx)
+{
+	return sizeof(struct io_cq_ring) +
+	       ctx->cq_entries * sizeof(struct io_ring_cqe);
+}
+
+static size_t io_sqes_size(struct io_ring_ctx *ctx)
+{
+	return ctx->sq_entries * sizeof(struct io_ring_sqe);
+}
+
+static void *io_ring_alloc_area(size_t size)
+{
+	return (void *) __get_free_pages(GFP_KERNEL | __GFP_ZERO,
+					 get_order(size));
+}
+
+static void io_ring_free_area(void *ptr, size_t size)
+{
+	if (ptr)
+		free_pages((unsigned long) ptr, get_order(size));
+}
+
+/*
+ * Pinned ring memory, charged against RLIMIT_MEMLOCK
+ */
+static size_t io_ring_locked_size(struct io_ring_ctx *ctx)
+{
+	return (PAGE_SIZE << get_order(io_sq_ring_size(ctx))) +
+	       (PAGE_SIZE << get_order(io_cq_ring_size(ctx))) +
+	       (PAGE_SIZE << get_order(io_sqes_size(ctx)));
+}
+
+/*
+ * Take down a ring.  Run from io_ring_wq rather than from ->release():
+ * the final fput of the ring can come from a worker's mmput(), and the
+ * workers are stopped here.  A worker may still be waiting in a request
+ * on a file that can't be polled: SIGKILL gets it out of there.
+ */
+static void io_ring_ctx_free(void *data)
+{
+	struct io_ring_ctx *ctx = data;
+	struct io_kiocb *req;
+	int i;
+
+	if (ctx->sq_thread)
+		kthread_stop(ctx->sq_thread);
+
+	spin_lock_irq(&ctx->lock);
+	ctx->dead = 1;
+	spin_unlock_irq(&ctx->lock);
+	for (i = 0; i < ctx->nr_workers; i++)
+		if (ctx->workers[i])
+			send_sig(SIGKILL, ctx->workers[i], 1);
+	for (i = 0; i < ctx->nr_workers; i++)
+		if (ctx->workers[i])
+			kthread_stop(ctx->workers[i]);
+
+	/*
+	 * Nothing runs the work list any more.  A wakeup racing with the
+	 * detach moves its request there, where it is freed below.
+	 */
+	spin_lock_irq(&ctx->lock);
+	while (!list_empty(&ctx->poll_list)) {
+		req = list_entry(ctx->poll_list.next, struct io_kiocb, list);
+		spin_unlock_irq(&ctx->lock);
+		if (io_ring_poll_detach(req))
+			io_ring_free_req(req);
+		spin_lock_irq(&ctx->lock);
+	}
+	while (!list_empty(&ctx->work_list)) {
+		req = list_entry(ctx->work_list.next, struct io_kiocb, list);
+		list_del(&req->list);
+		spin_unlock_irq(&ctx->lock);
+		io_ring_free_req(req);
+		spin_lock_irq(&ctx->lock);
+	}
+	spin_unlock_irq(&ctx->lock);
+
+	io_ring_free_area(ctx->sq_ring, io_sq_ring_size(ctx));
+	io_ring_free_area(ctx->cq_ring, io_cq_ring_size(ctx));
+	io_ring_free_area(ctx->sq_sqes, io_sqes_size(ctx));
+	if (ctx->locked)
+		user_shm_unlock(ctx->locked, ctx->user);
+	atomic_sub(ctx->nr_threads, &ctx->user->processes);
+	free_uid(ctx->user);
+	kfree(ctx->workers);
+	put_group_info(ctx->group_info);
+	put_task_struct(ctx->task);
+	mmdrop(ctx->mm);
+	kfree(ctx);
+}
+
+static int io_ring_release(struct inode *inode, struct file *file)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	INIT_WORK(&ctx->free_work, io_ring_ctx_free, ctx);
+	queue_work(io_ring_wq, &ctx->free_work);
+	return 0;
+}
+
+static unsigned int io_ring_poll(struct file *file, poll_table *wait)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	poll_wait(file, &ctx->poll_wait, wait);
+	smp_rmb();
+	if (io_cqring_events(ctx))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static int io_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+	loff_t offset = (loff_t) vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	void *ptr;
+	size_t len;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	switch (offset) {
+	case IORING_OFF_SQ_RING:
+		ptr = ctx->sq_ring;
+		len = io_sq_ring_size(ctx);
+		break;
+	case IORING_OFF_CQ_RING:
+		ptr = ctx->cq_ring;
+		len = io_cq_ring_size(ctx);
+		break;
+	case IORING_OFF_SQES:
+		ptr = ctx->sq_sqes;
+		len = io_sqes_size(ctx);
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (size > PAGE_ALIGN(len))
+		return -EINVAL;
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       virt_to_phys(ptr) >> PAGE_SHIFT, size,
+			       vma->vm_page_prot);
+}
+
+static struct file_operations io_ring_fops = {
+	.release	= io_ring_release,
+	.poll		= io_ring_poll,
+	.mmap		= io_ring_mmap,
+};
+
+static int io_ringfs_delete_dentry(struct dentry *dentry)
+{
+	return 1;
+}
+
+static struct dentry_operations io_ringfs_dentry_operations = {
+	.d_delete	= io_ringfs_delete_dentry,
+};
+
+/*
+ * Make the file for a ring.  The fd is reserved but not installed, so
+ * the caller can still back out.
+ */
+static int io_ring_getfd(struct io_ring_ctx *ctx, int *pfd,
+			 struct file **pfile)
+{
+	struct qstr this;
+	char name[32];
+	struct dentry *dentry;
+	struct inode *inode;
+	struct file *file;
+	int error, fd;
+
+	error = -ENFILE;
+	file = get_empty_filp();
+	if (!file)
+		goto out;
+
+	error = -ENOMEM;
+	inode = new_inode(io_ring_mnt->mnt_sb);
+	if (!inode)
+		goto out_filp;
+	inode->i_fop = &io_ring_fops;
+	/* never put it on the dirty list, see ep_eventpoll_inode() */
+	inode->i_state = I_DIRTY;
+	inode->i_mode = S_IRUSR | S_IWUSR;
+	inode->i_uid = current->fsuid;
+	inode->i_gid = current->fsgid;
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	inode->i_blksize = PAGE_SIZE;
+
+	error = get_unused_fd();
+	if (error < 0)
+		goto out_inode;
+	fd = error;
+
+	error = -ENOMEM;
+	sprintf(name, "[%lu]", inode->i_ino);
+	this.name = name;
+	this.len = strlen(name);
+	this.hash = inode->i_ino;
+	dentry = d_alloc(io_ring_mnt->mnt_sb->s_root, &this);
+	if (!dentry)
+		goto out_fd;
+	dentry->d_op = &io_ringfs_dentry_operations;
+	d_add(dentry, inode);
+
+	file->f_vfsmnt = mntget(io_ring_mnt);
+	file->f_dentry = dentry;
+	file->f_mapping = inode->i_mapping;
+	file->f_pos = 0;
+	file->f_flags = O_RDWR;
+	file->f_op = &io_ring_fops;
+	file->f_mode = FMODE_READ | FMODE_WRITE;
+	file->f_version = 0;
+	file->private_data = ctx;
+
+	*pfd = fd;
+	*pfile = file;
+	return 0;
+
+out_fd:
+	put_unused_fd(fd);
+out_inode:
+	iput(inode);
+out_filp:
+	put_filp(file);
+out:
+	return error;
+}
+
+/*
+ * Charge the ring's kernel threads to its owner as if it had forked
+ * them, see copy_process()
+ */
+static int io_ring_charge_threads(struct io_ring_ctx *ctx, unsigned int nr)
+{
+	if (atomic_read(&ctx->user->processes) + nr >
+			current->signal->rlim[RLIMIT_NPROC].rlim_cur) {
+		if (!capable(CAP_SYS_ADMIN) && !capable(CAP_SYS_RESOURCE) &&
+				ctx->user != &root_user)
+			return -EAGAIN;
+	}
+	atomic_add(nr, &ctx->user->processes);
+	ctx->nr_threads = nr;
+	return 0;
+}
+
+static struct io_ring_ctx *io_ring_ctx_alloc(unsigned int entries,
+					     struct io_ring_params *p)
+{
+	struct io_ring_ctx *ctx;
+	struct task_struct *t;
+	int i, err;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+
+	ctx->sq_entries = roundup_pow_of_two(entries);
+	ctx->sq_mask = ctx->sq_entries - 1;
+	ctx->cq_entries = 2 * ctx->sq_entries;
+	ctx->cq_mask = ctx->cq_entries - 1;
+	ctx->flags = p->flags;
+	mutex_init(&ctx->submit_lock);
+	spin_lock_init(&ctx->completion_lock);
+	init_waitqueue_head(&ctx->cq_wait);
+	init_waitqueue_head(&ctx->poll_wait);
+	init_waitqueue_head(&ctx->sq_wait);
+	init_waitqueue_head(&ctx->worker_wait);
+	spin_lock_init(&ctx->lock);
+	INIT_LIST_HEAD(&ctx->work_list);
+	INIT_LIST_HEAD(&ctx->poll_list);
+	atomic_set(&ctx->inflight, 0);
+
+	ctx->mm = current->mm;
+	atomic_inc(&ctx->mm->mm_count);
+	get_task_struct(current);
+	ctx->task = current;
+	ctx->uid = current->uid;
+	ctx->euid = current->euid;
+	ctx->fsuid = current->fsuid;
+	ctx->gid = current->gid;
+	ctx->egid = current->egid;
+	ctx->fsgid = current->fsgid;
+	ctx->cap_effective = current->cap_effective;
+	task_lock(current);
+	ctx->group_info = current->group_info;
+	get_group_info(ctx->group_info);
+	task_unlock(current);
+	ctx->user = get_uid(current->user);
+
+	err = -EAGAIN;
+	if (!user_shm_lock(io_ring_locked_size(ctx), ctx->user))
+		goto err;
+	ctx->locked = io_ring_locked_size(ctx);
+
+	err = -ENOMEM;
+	ctx->sq_ring = io_ring_alloc_area(io_sq_ring_size(ctx));
+	ctx->cq_ring = io_ring_alloc_area(io_cq_ring_size(ctx));
+	ctx->sq_sqes = io_ring_alloc_area(io_sqes_size(ctx));
+	ctx->workers = kzalloc(IORING_MAX_WORKERS * sizeof(*ctx->workers),
+			       GFP_KERNEL);
+	if (!ctx->sq_ring || !ctx->cq_ring || !ctx->sq_sqes || !ctx->workers)
+		goto err;
+
+	ctx->sq_ring->ring_mask = ctx->sq_mask;
+	ctx->sq_ring->ring_entries = ctx->sq_entries;
+	ctx->cq_ring->ring_mask = ctx->cq_mask;
+	ctx->cq_ring->ring_entries = ctx->cq_entries;
+
+	ctx->nr_workers = min_t(unsigned int, ctx->sq_entries,
+				2 * num_online_cpus());
+	ctx->nr_workers = min_t(unsigned int, ctx->nr_workers,
+				IORING_MAX_WORKERS);
+	err = io_ring_charge_threads(ctx, ctx->nr_workers +
+				     !!(ctx->flags & IORING_SETUP_SQPOLL));
+	if (err)
+		goto err;
+
+	for (i = 0; i < ctx->nr_workers; i++) {
+		t = kthread_run(io_ring_worker, ctx, "io_ring/%d",
+				current->pid);
+		if (IS_ERR(t)) {
+			err = PTR_ERR(t);
+			goto err;
+		}
+		ctx->workers[i] = t;
+	}
+
+	if (ctx->flags & IORING_SETUP_SQPOLL) {
+		ctx->sq_thread_idle = msecs_to_jiffies(p->sq_thread_idle);
+		if (!ctx->sq_thread_idle)
+			ctx->sq_thread_idle = HZ;
+		t = kthread_create(io_ring_sq_thread, ctx, "io_ring_sq/%d",
+				   current->pid);
+		if (IS_ERR(t)) {
+			err = PTR_ERR(t);
+			goto err;
+		}
+		if (ctx->flags & IORING_SETUP_SQ_AFF)
+			kthread_bind(t, p->sq_thread_cpu);
+		ctx->sq_thread = t;
+		wake_up_process(t);
+	}
+	return ctx;
+
+err:
+	io_ring_ctx_free(ctx);
+	return ERR_PTR(err);
+}
+
+asmlinkage long sys_io_ring_setup(u32 entries,
+				  struct io_ring_params __user *params)
+{
+	struct io_ring_params p;
+	struct io_ring_ctx *ctx;
+	struct file *file;
+	int i, fd, ret;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+	for (i = 0; i < ARRAY_SIZE(p.resv); i++)
+		if (p.resv[i])
+			return -EINVAL;
+	if (p.flags & ~(IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF))
+		return -EINVAL;
+	if (!entries || entries > IORING_MAX_ENTRIES)
+		return -EINVAL;
+	if (p.flags & IORING_SETUP_SQPOLL) {
+		/* the sq thread spins on a cpu of its own */
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		if ((p.flags & IORING_SETUP_SQ_AFF) &&
+		    (p.sq_thread_cpu >= NR_CPUS ||
+		     !cpu_online(p.sq_thread_cpu)))
+			return -EINVAL;
+	} else if (p.flags & IORING_SETUP_SQ_AFF)
+		return -EINVAL;
+	if (!current->mm)
+		return -EINVAL;
+
+	ctx = io_ring_ctx_alloc(entries, &p);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+
+	ret = io_ring_getfd(ctx, &fd, &file);
+	if (ret) {
+		io_ring_ctx_free(ctx);
+		return ret;
+	}
+
+	memset(&p.sq_off, 0, sizeof(p.sq_off));
+	p.sq_entries = ctx->sq_entries;
+	p.sq_off.head = offsetof(struct io_sq_ring, head);
+	p.sq_off.tail = offsetof(struct io_sq_ring, tail);
+	p.sq_off.ring_mask = offsetof(struct io_sq_ring, ring_mask);
+	p.sq_off.ring_entries = offsetof(struct io_sq_ring, ring_entries);
+	p.sq_off.flags = offsetof(struct io_sq_ring, flags);
+	p.sq_off.dropped = offsetof(struct io_sq_ring, dropped);
+	p.sq_off.array = offsetof(struct io_sq_ring, array);
+
+	memset(&p.cq_off, 0, sizeof(p.cq_off));
+	p.cq_entries = ctx->cq_entries;
+	p.cq_off.head = offsetof(struct io_cq_ring, head);
+	p.cq_off.tail = offsetof(struct io_cq_ring, tail);
+	p.cq_off.ring_mask = offsetof(struct io_cq_ring, ring_mask);
+	p.cq_off.ring_entries = offsetof(struct io_cq_ring, ring_entries);
+	p.cq_off.overflow = offsetof(struct io_cq_ring, overflow);
+	p.cq_off.cqes = offsetof(struct io_cq_ring, cqes);
+
+	if (copy_to_user(params, &p, sizeof(p))) {
+		put_unused_fd(fd);
+		fput(file);
+		return -EFAULT;
+	}
+	fd_install(fd, file);
+	return fd;
+}
+
+asmlinkage long sys_io_ring_enter(unsigned int fd, u32 to_submit,
+				  u32 min_complete, u32 flags)
+{
+	struct io_ring_ctx *ctx;
+	struct file *file;
+	int submitted = 0;
+	long ret = 0;
+
+	if (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP))
+		return -EINVAL;
+
+	file = fget(fd);
+	if (!file)
+		return -EBADF;
+	ret = -EOPNOTSUPP;
+	if (file->f_op != &io_ring_fops)
+		goto out;
+	ctx = file->private_data;
+	ret = 0;
+
+	if (ctx->flags & IORING_SETUP_SQPOLL) {
+		/* seen after the sq flag that sent us here */
+		smp_rmb();
+		if (ctx->sq_thread_gone)
+			to_submit = ctx->sq_entries;
+	}
+
+	if ((ctx->flags & IORING_SETUP_SQPOLL) && !ctx->sq_thread_gone) {
+		/* the sq thread does the submitting */
+		if (flags & IORING_ENTER_SQ_WAKEUP)
+			wake_up(&ctx->sq_wait);
+		submitted = to_submit;
+	} else if (to_submit) {
+		mutex_lock(&ctx->submit_lock);
+		submitted = io_ring_submit(ctx, to_submit);
+		mutex_unlock(&ctx->submit_lock);
+		if (submitted < 0) {
+			ret = submitted;
+			goto out;
+		}
+	}
+
+	if (flags & IORING_ENTER_GETEVENTS) {
+		if (min_complete > ctx->cq_entries)
+			min_complete = ctx->cq_entries;
+		ret = wait_event_interruptible(ctx->cq_wait,
+				io_cqring_events(ctx) >= min_complete);
+	}
+	if (submitted)
+		ret = submitted;
+out:
+	fput(file);
+	return ret;
+}
+
+static struct super_block *io_ringfs_get_sb(struct file_system_type *fs_type,
+					    int flags, const char *dev_name,
+					    void *data)
+{
+	return get_sb_pseudo(fs_type, "io_ring:", NULL, IORINGFS_MAGIC);
+}
+
+static struct file_system_type io_ring_fs_type = {
+	.name		= "io_ringfs",
+	.get_sb		= io_ringfs_get_sb,
+	.kill_sb	= kill_anon_super,
+};
+
+static int __init io_ring_init(void)
+{
+	int error;
+
+	req_cachep = kmem_cache_create("io_kiocb", sizeof(struct io_kiocb),
+				       0, SLAB_HWCACHE_ALIGN | SLAB_PANIC,
+				       NULL, NULL);
+
+	error = -ENOMEM;
+	io_ring_wq = create_singlethread_workqueue("io_ring");
+	if (!io_ring_wq)
+		goto err;
+
+	error = register_filesystem(&io_ring_fs_type);
+	if (error)
+		goto err;
+	io_ring_mnt = kern_mount(&io_ring_fs_type);
+	error = PTR_ERR(io_ring_mnt);
+	if (IS_ERR(io_ring_mnt))
+		goto err;
+	return 0;
+
+err:
+	panic("io_ring_init() failed\n");
+}
+
+fs_initcall(io_ring_init);
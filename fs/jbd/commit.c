@@ -21,6 +21,9 @@
 #include <linux/mm.h>
 #include <linux/pagemap.h>
 #include <linux/smp_lock.h>
+#include <linux/highmem.h>
+#include <linux/blkdev.h>
+#include <linux/crc32.h>
 
 /*
  * Default IO end handler for temporary BJ_IO buffer_heads.
@@ -98,15 +101,23 @@ static int inverted_lock(journal_t *journal, struct buffer_head *bh)
  * mode we can now just skip the rest of the journal write
  * entirely.
  *
+ * The commit block is only submitted here; journal_wait_on_commit_record()
+ * waits for it.  With an asynchronous commit this happens before the rest
+ * of the transaction has reached the log, so no barrier is asked for: the
+ * checksum lets recovery tell whether everything made it to disk.
+ *
  * Returns 1 if the journal needs to be aborted or 0 on success
  */
-static int journal_write_commit_record(journal_t *journal,
-					transaction_t *commit_transaction)
+static int journal_submit_commit_record(journal_t *journal,
+					transaction_t *commit_transaction,
+					struct buffer_head **cbh,
+					__u32 crc32_sum)
 {
 	struct journal_head *descriptor;
+	struct commit_header *tmp;
 	struct buffer_head *bh;
-	int i, ret;
-	int barrier_done = 0;
+
+	*cbh = NULL;
 
 	if (is_journal_aborted(journal))
 		return 0;
@@ -117,27 +128,50 @@ static int journal_write_commit_record(journal_t *journal,
 
 	bh = jh2bh(descriptor);
 
-	/* AKPM: buglet - add `i' to tmp! */
-	for (i = 0; i < bh->b_size; i += 512) {
-		journal_header_t *tmp = (journal_header_t*)bh->b_data;
-		tmp->h_magic = cpu_to_be32(JFS_MAGIC_NUMBER);
-		tmp->h_blocktype = cpu_to_be32(JFS_COMMIT_BLOCK);
-		tmp->h_sequence = cpu_to_be32(commit_transaction->t_tid);
+	tmp = (struct commit_header *)bh->b_data;
+	tmp->h_magic = cpu_to_be32(JFS_MAGIC_NUMBER);
+	tmp->h_blocktype = cpu_to_be32(JFS_COMMIT_BLOCK);
+	tmp->h_sequence = cpu_to_be32(commit_transaction->t_tid);
+
+	if (JFS_HAS_COMPAT_FEATURE(journal, JFS_FEATURE_COMPAT_CHECKSUM)) {
+		tmp->h_chksum_type = JFS_CRC32_CHKSUM;
+		tmp->h_chksum_size = JFS_CRC32_CHKSUM_SIZE;
+		tmp->h_chksum[0] = cpu_to_be32(crc32_sum);
 	}
 
-	JBUFFER_TRACE(descriptor, "write commit block");
-	set_buffer_dirty(bh);
-	if (journal->j_flags & JFS_BARRIER) {
+	JBUFFER_TRACE(descriptor, "submit commit block");
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	bh->b_end_io = journal_end_buffer_io_sync;
+
+	if (journal->j_flags & JFS_BARRIER &&
+	    !JFS_HAS_INCOMPAT_FEATURE(journal,
+				      JFS_FEATURE_INCOMPAT_ASYNC_COMMIT))
 		set_buffer_ordered(bh);
-		barrier_done = 1;
-	}
-	ret = sync_dirty_buffer(bh);
+	submit_bh(WRITE, bh);
+
+	*cbh = bh;
+	return 0;
+}
+
+/*
+ * Wait for the commit block written by journal_submit_commit_record().
+ * Returns 1 if the journal needs to be aborted or 0 on success
+ */
+static int journal_wait_on_commit_record(journal_t *journal,
+					 struct buffer_head *bh)
+{
+	struct journal_head *descriptor = bh2jh(bh);
+	int ret = 0;
+
+	wait_on_buffer(bh);
 	/* is it possible for another commit to fail at roughly
 	 * the same time as this one?  If so, we don't want to
 	 * trust the barrier flag in the super, but instead want
 	 * to remember if we sent a barrier request
 	 */
-	if (ret == -EOPNOTSUPP && barrier_done) {
+	if (buffer_eopnotsupp(bh) && buffer_ordered(bh)) {
 		char b[BDEVNAME_SIZE];
 
 		printk(KERN_WARNING
@@ -149,10 +183,15 @@ static int journal_write_commit_record(journal_t *journal,
 		spin_unlock(&journal->j_state_lock);
 
 		/* And try again, without the barrier */
+		clear_buffer_eopnotsupp(bh);
 		clear_buffer_ordered(bh);
 		set_buffer_uptodate(bh);
 		set_buffer_dirty(bh);
 		ret = sync_dirty_buffer(bh);
+	} else {
+		clear_buffer_ordered(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			ret = -EIO;
 	}
 	put_bh(bh);		/* One for getblk() */
 	journal_put_journal_head(descriptor);
@@ -160,6 +199,22 @@ static int journal_write_commit_record(journal_t *journal,
 	return (ret == -EIO);
 }
 
+/*
+ * Add a block written to the log to the running checksum of the
+ * transaction which goes into its commit block.
+ */
+static __u32 journal_checksum_data(__u32 crc32_sum, struct buffer_head *bh)
+{
+	char *addr;
+
+	addr = kmap_atomic(bh->b_page, KM_USER0);
+	crc32_sum = crc32_be(crc32_sum,
+			     (unsigned char *)(addr + bh_offset(bh)),
+			     bh->b_size);
+	kunmap_atomic(addr, KM_USER0);
+	return crc32_sum;
+}
+
 /*
  * journal_commit_transaction
  *
@@ -171,6 +226,10 @@ void journal_commit_transaction(journal_t *journal)
 	transaction_t *commit_transaction;
 	struct journal_head *jh, *new_jh, *descriptor;
 	struct buffer_head **wbuf = journal->j_wbuf;
+	struct buffer_head *cbh = NULL;
+	__u32 crc32_sum = ~0;
+	struct transaction_stats_s stats;
+	unsigned long start_time;
 	int bufs;
 	int flags;
 	int err;
@@ -214,24 +273,28 @@ void journal_commit_transaction(journal_t *journal)
 	spin_lock(&journal->j_state_lock);
 	commit_transaction->t_state = T_LOCKED;
 
-	spin_lock(&commit_transaction->t_handle_lock);
-	while (commit_transaction->t_updates) {
+	start_time = jiffies;
+	stats.ts_running = start_time - commit_transaction->t_start;
+
+	while (atomic_read(&commit_transaction->t_updates)) {
 		DEFINE_WAIT(wait);
 
 		prepare_to_wait(&journal->j_wait_updates, &wait,
 					TASK_UNINTERRUPTIBLE);
-		if (commit_transaction->t_updates) {
-			spin_unlock(&commit_transaction->t_handle_lock);
+		if (atomic_read(&commit_transaction->t_updates)) {
 			spin_unlock(&journal->j_state_lock);
 			schedule();
 			spin_lock(&journal->j_state_lock);
-			spin_lock(&commit_transaction->t_handle_lock);
 		}
 		finish_wait(&journal->j_wait_updates, &wait);
 	}
-	spin_unlock(&commit_transaction->t_handle_lock);
+	stats.ts_wait = commit_transaction->t_max_wait;
+	stats.ts_handle_count = atomic_read(&commit_transaction->t_handle_count);
 
-	J_ASSERT (commit_transaction->t_outstanding_credits <=
+	stats.ts_locked = jiffies - start_time;
+	start_time = jiffies;
+
+	J_ASSERT (atomic_read(&commit_transaction->t_outstanding_credits) <=
 			journal->j_max_transaction_buffers);
 
 	/*
@@ -433,6 +496,10 @@ write_out_data:
 	 */
 	J_ASSERT (commit_transaction->t_sync_datalist == NULL);
 
+	stats.ts_flushing = jiffies - start_time;
+	start_time = jiffies;
+	stats.ts_blocks = commit_transaction->t_nr_buffers;
+
 	jbd_debug (3, "JBD: commit phase 3\n");
 
 	/*
@@ -519,7 +586,7 @@ write_out_data:
 		 * the free space in the log, but this counter is changed
 		 * by journal_next_log_block() also.
 		 */
-		commit_transaction->t_outstanding_credits--;
+		atomic_dec(&commit_transaction->t_outstanding_credits);
 
 		/* Bump b_count to prevent truncate from stumbling over
                    the shadowed buffer!  @@@ This can go if we ever get
@@ -583,6 +650,10 @@ write_out_data:
 start_journal_io:
 			for (i = 0; i < bufs; i++) {
 				struct buffer_head *bh = wbuf[i];
+				if (JFS_HAS_COMPAT_FEATURE(journal,
+						JFS_FEATURE_COMPAT_CHECKSUM))
+					crc32_sum = journal_checksum_data(
+							crc32_sum, bh);
 				lock_buffer(bh);
 				clear_buffer_dirty(bh);
 				set_buffer_uptodate(bh);
@@ -598,6 +669,19 @@ start_journal_io:
 		}
 	}
 
+	/*
+	 * With an asynchronous commit the commit block goes out right
+	 * behind the rest of the transaction instead of waiting for it:
+	 * recovery checks the checksum in it to tell whether the whole
+	 * transaction reached the log.
+	 */
+	if (JFS_HAS_INCOMPAT_FEATURE(journal,
+				     JFS_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
+		if (journal_submit_commit_record(journal, commit_transaction,
+						 &cbh, crc32_sum))
+			err = -EIO;
+	}
+
 	/* Lo and behold: we have just managed to send a transaction to
            the log.  Before we can commit it, wait for the IO so far to
            complete.  Control buffers being written are on the
@@ -697,12 +781,38 @@ wait_for_iobuf:
 
 	jbd_debug(3, "JBD: commit phase 6\n");
 
-	if (journal_write_commit_record(journal, commit_transaction))
+	if (!JFS_HAS_INCOMPAT_FEATURE(journal,
+				      JFS_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
+		if (journal_submit_commit_record(journal, commit_transaction,
+						 &cbh, crc32_sum))
+			err = -EIO;
+	}
+	if (cbh && journal_wait_on_commit_record(journal, cbh))
 		err = -EIO;
 
+	/*
+	 * The asynchronous commit block was written without a barrier, so
+	 * flush the drive's cache once now that the whole transaction is in
+	 * it.  That single flush replaces the barrier's flush before and
+	 * after the commit block.
+	 */
+	if (JFS_HAS_INCOMPAT_FEATURE(journal,
+				     JFS_FEATURE_INCOMPAT_ASYNC_COMMIT) &&
+	    journal->j_flags & JFS_BARRIER && !err)
+		blkdev_issue_flush(journal->j_dev, NULL);
+
 	if (err)
 		__journal_abort_hard(journal);
 
+	stats.ts_logging = jiffies - start_time;
+	if (journal->j_head >= commit_transaction->t_log_start)
+		stats.ts_blocks_logged = journal->j_head -
+					 commit_transaction->t_log_start;
+	else
+		stats.ts_blocks_logged = journal->j_head +
+					 journal->j_last - journal->j_first -
+					 commit_transaction->t_log_start;
+
 	/* End of a transaction!  Finally, we can do checkpoint
            processing: any buffers committed as a result of this
            transaction can be removed from any checkpoint list it was on
@@ -853,5 +963,17 @@ restart_loop:
 	jbd_debug(1, "JBD: commit %d complete, head %d\n",
 		  journal->j_commit_sequence, journal->j_tail_sequence);
 
+	spin_lock(&journal->j_history_lock);
+	journal->j_stats.ts_tid++;
+	journal->j_stats.ts_wait += stats.ts_wait;
+	journal->j_stats.ts_running += stats.ts_running;
+	journal->j_stats.ts_locked += stats.ts_locked;
+	journal->j_stats.ts_flushing += stats.ts_flushing;
+	journal->j_stats.ts_logging += stats.ts_logging;
+	journal->j_stats.ts_handle_count += stats.ts_handle_count;
+	journal->j_stats.ts_blocks += stats.ts_blocks;
+	journal->j_stats.ts_blocks_logged += stats.ts_blocks_logged;
+	spin_unlock(&journal->j_history_lock);
+
 	wake_up(&journal->j_wait_done_commit);
 }
@@ -36,6 +36,7 @@
 #include <asm/uaccess.h>
 #include <asm/page.h>
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 EXPORT_SYMBOL(journal_start);
 EXPORT_SYMBOL(journal_restart);
@@ -62,6 +63,7 @@ EXPORT_SYMBOL(journal_update_format);
 EXPORT_SYMBOL(journal_check_used_features);
 EXPORT_SYMBOL(journal_check_available_features);
 EXPORT_SYMBOL(journal_set_features);
+EXPORT_SYMBOL(journal_clear_features);
 EXPORT_SYMBOL(journal_create);
 EXPORT_SYMBOL(journal_load);
 EXPORT_SYMBOL(journal_destroy);
@@ -664,6 +666,7 @@ static journal_t * journal_init_common (void)
 	spin_lock_init(&journal->j_revoke_lock);
 	spin_lock_init(&journal->j_list_lock);
 	spin_lock_init(&journal->j_state_lock);
+	spin_lock_init(&journal->j_history_lock);
 
 	journal->j_commit_interval = (HZ * JBD_DEFAULT_MAX_COMMIT_AGE);
 
@@ -681,6 +684,119 @@ fail:
 	return NULL;
 }
 
+/*
+ * Transaction statistics: /proc/fs/jbd/<dev>/info shows averages over the
+ * transactions the journal has committed.  A journal in an inode is named
+ * after the device and the inode number, as a filesystem can hold several.
+ */
+#ifdef CONFIG_PROC_FS
+
+#define JBD_STATS_PROC_NAME "fs/jbd"
+
+static struct proc_dir_entry *proc_jbd_stats;
+
+static int jbd_seq_info_show(struct seq_file *seq, void *v)
+{
+	journal_t *journal = seq->private;
+	struct transaction_stats_s s;
+
+	spin_lock(&journal->j_history_lock);
+	s = journal->j_stats;
+	spin_unlock(&journal->j_history_lock);
+
+	seq_printf(seq, "%lu transactions, each up to %u blocks\n",
+		   s.ts_tid, journal->j_max_transaction_buffers);
+	if (!s.ts_tid)
+		return 0;
+	seq_printf(seq, "average: \n  %ums longest wait for a handle\n",
+		   jiffies_to_msecs(s.ts_wait / s.ts_tid));
+	seq_printf(seq, "  %ums running transaction\n",
+		   jiffies_to_msecs(s.ts_running / s.ts_tid));
+	seq_printf(seq, "  %ums committing transaction\n",
+		   jiffies_to_msecs((s.ts_locked + s.ts_flushing +
+				     s.ts_logging) / s.ts_tid));
+	seq_printf(seq, "    %ums waiting for handles to stop\n",
+		   jiffies_to_msecs(s.ts_locked / s.ts_tid));
+	seq_printf(seq, "    %ums flushing data (in ordered mode)\n",
+		   jiffies_to_msecs(s.ts_flushing / s.ts_tid));
+	seq_printf(seq, "    %ums logging transaction\n",
+		   jiffies_to_msecs(s.ts_logging / s.ts_tid));
+	seq_printf(seq, "  %lu handles per transaction\n",
+		   s.ts_handle_count / s.ts_tid);
+	seq_printf(seq, "  %lu blocks per transaction\n",
+		   s.ts_blocks / s.ts_tid);
+	seq_printf(seq, "  %lu logged blocks per transaction\n",
+		   s.ts_blocks_logged / s.ts_tid);
+	return 0;
+}
+
+static int jbd_seq_info_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jbd_seq_info_show, PDE(inode)->data);
+}
+
+static struct file_operations jbd_seq_info_fops = {
+	.owner		= THIS_MODULE,
+	.open		= jbd_seq_info_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void journal_stats_proc_init(journal_t *journal)
+{
+	char name[BDEVNAME_SIZE + 16];
+	struct proc_dir_entry *p;
+	char *cp;
+
+	if (!proc_jbd_stats)
+		return;
+
+	bdevname(journal->j_dev, name);
+	if (journal->j_inode)
+		sprintf(name + strlen(name), "-%lu", journal->j_inode->i_ino);
+	for (cp = name; *cp; cp++)
+		if (*cp == '/')
+			*cp = '!';
+
+	journal->j_proc_entry = proc_mkdir(name, proc_jbd_stats);
+	if (!journal->j_proc_entry)
+		return;
+	p = create_proc_entry("info", S_IRUGO, journal->j_proc_entry);
+	if (p) {
+		p->proc_fops = &jbd_seq_info_fops;
+		p->data = journal;
+	}
+}
+
+static void journal_stats_proc_exit(journal_t *journal)
+{
+	if (!journal->j_proc_entry)
+		return;
+	remove_proc_entry("info", journal->j_proc_entry);
+	remove_proc_entry(journal->j_proc_entry->name, proc_jbd_stats);
+}
+
+static void __init journal_create_stats_proc_root(void)
+{
+	proc_jbd_stats = proc_mkdir(JBD_STATS_PROC_NAME, NULL);
+}
+
+static void __exit journal_remove_stats_proc_root(void)
+{
+	if (proc_jbd_stats)
+		remove_proc_entry(JBD_STATS_PROC_NAME, NULL);
+}
+
+#else
+
+#define journal_stats_proc_init(journal) do {} while (0)
+#define journal_stats_proc_exit(journal) do {} while (0)
+#define journal_create_stats_proc_root() do {} while (0)
+#define journal_remove_stats_proc_root() do {} while (0)
+
+#endif
+
 /* journal_init_dev and journal_init_inode:
  *
  * Create a journal structure assigned some fixed set of disk blocks to
@@ -734,7 +850,8 @@ journal_t * journal_init_dev(struct block_device *bdev,
 			__FUNCTION__);
 		kfree(journal);
 		journal = NULL;
-	}
+	} else
+		journal_stats_proc_init(journal);
 
 	return journal;
 }
@@ -794,6 +911,7 @@ journal_t * journal_init_inode (struct inode *inode)
 	journal->j_sb_buffer = bh;
 	journal->j_superblock = (journal_superblock_t *)bh->b_data;
 
+	journal_stats_proc_init(journal);
 	return journal;
 }
 
@@ -1153,6 +1271,7 @@ void journal_destroy(journal_t *journal)
 		iput(journal->j_inode);
 	if (journal->j_revoke)
 		journal_destroy_revoke(journal);
+	journal_stats_proc_exit(journal);
 	kfree(journal->j_wbuf);
 	kfree(journal);
 }
@@ -1260,6 +1379,31 @@ int journal_set_features (journal_t *journal, unsigned long compat,
 	return 1;
 }
 
+/**
+ * void journal_clear_features () - Clear a given journal feature in the superblock
+ * @journal: Journal to act on.
+ * @compat: bitmask of compatible features
+ * @ro: bitmask of features that force read-only mount
+ * @incompat: bitmask of incompatible features
+ *
+ * Clear a given journal feature as present on the
+ * superblock.
+ */
+void journal_clear_features(journal_t *journal, unsigned long compat,
+			    unsigned long ro, unsigned long incompat)
+{
+	journal_superblock_t *sb;
+
+	jbd_debug(1, "Clear features 0x%lx/0x%lx/0x%lx\n",
+		  compat, ro, incompat);
+
+	sb = journal->j_superblock;
+
+	sb->s_feature_compat    &= ~cpu_to_be32(compat);
+	sb->s_feature_ro_compat &= ~cpu_to_be32(ro);
+	sb->s_feature_incompat  &= ~cpu_to_be32(incompat);
+}
+
 
 /**
  * int journal_update_format () - Update on-disk journal structure.
@@ -1979,6 +2123,7 @@ static int __init journal_init(void)
 	if (ret != 0)
 		journal_destroy_caches();
 	create_jbd_proc_entry();
+	journal_create_stats_proc_root();
 	return ret;
 }
 
@@ -1990,6 +2135,7 @@ static void __exit journal_exit(void)
 		printk(KERN_EMERG "JBD: leaked %d journal_heads!\n", n);
 #endif
 	remove_jbd_proc_entry();
+	journal_remove_stats_proc_root();
 	journal_destroy_caches();
 }
 
@@ -21,6 +21,7 @@
 #include <linux/jbd.h>
 #include <linux/errno.h>
 #include <linux/slab.h>
+#include <linux/crc32.h>
 #endif
 
 /*
@@ -209,6 +210,52 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Add a descriptor block and the blocks it describes to the checksum of
+ * their transaction.  Returns 0 or an error.
+ */
+static int calc_chksums(journal_t *journal, struct buffer_head *bh,
+			unsigned long *next_log_block, __u32 *crc32_sum)
+{
+	char *			tagp;
+	journal_block_tag_t *	tag;
+	struct buffer_head *	obh;
+	unsigned long		io_block;
+	unsigned int		flags;
+	int			err;
+
+	*crc32_sum = crc32_be(*crc32_sum, (unsigned char *)bh->b_data,
+			      bh->b_size);
+
+	tagp = &bh->b_data[sizeof(journal_header_t)];
+	while ((tagp - bh->b_data + sizeof(journal_block_tag_t))
+	       <= journal->j_blocksize) {
+		tag = (journal_block_tag_t *) tagp;
+		flags = be32_to_cpu(tag->t_flags);
+
+		io_block = (*next_log_block)++;
+		wrap(journal, *next_log_block);
+		err = jread(&obh, journal, io_block);
+		if (err) {
+			printk(KERN_ERR "JBD: IO error %d recovering block "
+			       "%lu in log\n", err, io_block);
+			return err;
+		}
+		*crc32_sum = crc32_be(*crc32_sum, (unsigned char *)obh->b_data,
+				      obh->b_size);
+		brelse(obh);
+
+		tagp += sizeof(journal_block_tag_t);
+		if (!(flags & JFS_FLAG_SAME_UUID))
+			tagp += 16;
+
+		if (flags & JFS_FLAG_LAST_TAG)
+			break;
+	}
+
+	return 0;
+}
+
 /**
  * journal_recover - recovers a on-disk journal
  * @journal: the journal to recover
@@ -318,6 +365,7 @@ static int do_one_pass(journal_t *journal,
 	struct buffer_head *	bh;
 	unsigned int		sequence;
 	int			blocktype;
+	__u32			crc32_sum = ~0;	/* Transaction checksum */
 
 	/* Precompute the maximum metadata descriptors in a descriptor block */
 	int			MAX_BLOCKS_PER_DESC;
@@ -411,6 +459,16 @@ static int do_one_pass(journal_t *journal,
 			/* If it is a valid descriptor block, replay it
 			 * in pass REPLAY; otherwise, just skip over the
 			 * blocks it describes. */
+			if (pass == PASS_SCAN &&
+			    JFS_HAS_COMPAT_FEATURE(journal,
+					JFS_FEATURE_COMPAT_CHECKSUM)) {
+				err = calc_chksums(journal, bh,
+						   &next_log_block, &crc32_sum);
+				brelse(bh);
+				if (err)
+					goto failed;
+				continue;
+			}
 			if (pass != PASS_REPLAY) {
 				next_log_block +=
 					count_tags(bh, journal->j_blocksize);
@@ -506,9 +564,42 @@ static int do_one_pass(journal_t *journal,
 			continue;
 
 		case JFS_COMMIT_BLOCK:
-			/* Found an expected commit block: not much to
-			 * do other than move on to the next sequence
-			 * number. */
+			/* Found an expected commit block: check the
+			 * transaction's checksum if it has one, and move
+			 * on to the next sequence number. */
+			if (pass == PASS_SCAN &&
+			    JFS_HAS_COMPAT_FEATURE(journal,
+					JFS_FEATURE_COMPAT_CHECKSUM)) {
+				struct commit_header *cbh =
+					(struct commit_header *)bh->b_data;
+
+				/* A commit without a checksum was written
+				 * before the feature was turned on. */
+				if (cbh->h_chksum_type == JFS_CRC32_CHKSUM &&
+				    cbh->h_chksum_size ==
+						JFS_CRC32_CHKSUM_SIZE &&
+				    be32_to_cpu(cbh->h_chksum[0]) != crc32_sum) {
+					/* An asynchronous commit block can
+					 * reach the disk before the rest of
+					 * its transaction: that transaction
+					 * simply did not commit.  Otherwise
+					 * the log has been damaged. */
+					if (!JFS_HAS_INCOMPAT_FEATURE(journal,
+					    JFS_FEATURE_INCOMPAT_ASYNC_COMMIT))
+						printk(KERN_ERR "JBD: checksum "
+						       "error in transaction "
+						       "%u, ignoring the rest "
+						       "of the log\n",
+						       next_commit_ID);
+					else
+						jbd_debug(1, "JBD: transaction "
+							  "%u incomplete\n",
+							  next_commit_ID);
+					brelse(bh);
+					goto done;
+				}
+				crc32_sum = ~0;
+			}
 			brelse(bh);
 			next_commit_ID++;
 			continue;
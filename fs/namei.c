@@ -705,14 +705,11 @@ static __always_inline void follow_dotdot(struct nameidata *nd)
 			break;
 		}
                 read_unlock(&current->fs->lock);
-		spin_lock(&dcache_lock);
 		if (nd->dentry != nd->mnt->mnt_root) {
-			nd->dentry = dget(nd->dentry->d_parent);
-			spin_unlock(&dcache_lock);
+			nd->dentry = dget_parent(nd->dentry);
 			dput(old);
 			break;
 		}
-		spin_unlock(&dcache_lock);
 		spin_lock(&vfsmount_lock);
 		parent = nd->mnt->mnt_parent;
 		if (parent == nd->mnt) {
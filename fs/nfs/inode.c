@@ -335,6 +335,10 @@ nfs_sb_init(struct super_block *sb, rpc_authflavor_t authflavor)
 		sb->s_flags |= MS_SYNCHRONOUS;
 	}
 	server->backing_dev_info.ra_pages = server->rpages * NFS_MAX_READAHEAD;
+	snprintf(server->backing_dev_info.name,
+		 sizeof(server->backing_dev_info.name), "nfs-%u:%u",
+		 MAJOR(sb->s_dev), MINOR(sb->s_dev));
+	bdi_init(&server->backing_dev_info);
 
 	sb->s_maxbytes = fsinfo.maxfilesize;
 	if (sb->s_maxbytes > MAX_LFS_FILESIZE) 
@@ -1699,6 +1703,7 @@ static void nfs_kill_super(struct super_block *s)
 	struct nfs_server *server = NFS_SB(s);
 
 	kill_anon_super(s);
+	bdi_destroy(&server->backing_dev_info);
 
 	if (!IS_ERR(server->client))
 		rpc_shutdown_client(server->client);
@@ -2019,6 +2024,7 @@ static void nfs4_kill_super(struct super_block *sb)
 
 	nfs_return_all_delegations(sb);
 	kill_anon_super(sb);
+	bdi_destroy(&server->backing_dev_info);
 
 	nfs4_renewd_prepare_shutdown(server);
 
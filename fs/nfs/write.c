@@ -462,6 +462,7 @@ nfs_mark_request_dirty(struct nfs_page *req)
 	nfsi->ndirty++;
 	spin_unlock(&nfsi->req_lock);
 	inc_page_state(nr_dirty);
+	inc_bdi_stat(inode->i_mapping->backing_dev_info, BDI_RECLAIMABLE);
 	mark_inode_dirty(inode);
 }
 
@@ -490,6 +491,7 @@ nfs_mark_request_commit(struct nfs_page *req)
 	nfsi->ncommit++;
 	spin_unlock(&nfsi->req_lock);
 	inc_page_state(nr_unstable);
+	inc_bdi_stat(inode->i_mapping->backing_dev_info, BDI_RECLAIMABLE);
 	mark_inode_dirty(inode);
 }
 #endif
@@ -555,6 +557,8 @@ nfs_scan_dirty(struct inode *inode, struct list_head *dst, unsigned long idx_sta
 		res = nfs_scan_lock_dirty(nfsi, dst, idx_start, npages);
 		nfsi->ndirty -= res;
 		sub_page_state(nr_dirty,res);
+		add_bdi_stat(inode->i_mapping->backing_dev_info,
+				BDI_RECLAIMABLE, -res);
 		if ((nfsi->ndirty == 0) != list_empty(&nfsi->dirty))
 			printk(KERN_ERR "NFS: desynchronized value of nfs_i.ndirty.\n");
 	}
@@ -1325,6 +1329,8 @@ void nfs_commit_done(struct rpc_task *task, void *calldata)
 		res++;
 	}
 	sub_page_state(nr_unstable,res);
+	add_bdi_stat(data->inode->i_mapping->backing_dev_info,
+			BDI_RECLAIMABLE, -res);
 }
 #endif
 
@@ -803,7 +803,7 @@ static struct file *__dentry_open(struct dentry *dentry, struct vfsmount *mnt,
 	f->f_vfsmnt = mnt;
 	f->f_pos = 0;
 	f->f_op = fops_get(inode->i_fop);
-	file_move(f, &inode->i_sb->s_files);
+	file_sb_list_add(f, inode->i_sb);
 
 	if (!open && f->f_op)
 		open = f->f_op->open;
@@ -833,7 +833,7 @@ cleanup_all:
 	fops_put(f->f_op);
 	if (f->f_mode & FMODE_WRITE)
 		put_write_access(inode);
-	file_kill(f);
+	file_sb_list_del(f);
 	f->f_dentry = NULL;
 	f->f_vfsmnt = NULL;
 cleanup_file:
@@ -15,6 +15,7 @@
 #include <linux/pipe_fs_i.h>
 #include <linux/uio.h>
 #include <linux/highmem.h>
+#include <linux/pagemap.h>
 
 #include <asm/uaccess.h>
 #include <asm/ioctls.h>
@@ -94,11 +95,15 @@ static void anon_pipe_buf_release(struct pipe_inode_info *info, struct pipe_buff
 {
 	struct page *page = buf->page;
 
-	if (info->tmp_page) {
-		__free_page(page);
+	/*
+	 * Only recycle the page if nobody else holds it: tee() may have
+	 * put the same page into another pipe.
+	 */
+	if (page_count(page) == 1 && !info->tmp_page) {
+		info->tmp_page = page;
 		return;
 	}
-	info->tmp_page = page;
+	page_cache_release(page);
 }
 
 static void *anon_pipe_buf_map(struct file *file, struct pipe_inode_info *info, struct pipe_buffer *buf)
@@ -111,16 +116,22 @@ static void anon_pipe_buf_unmap(struct pipe_inode_info *info, struct pipe_buffer
 	kunmap(buf->page);
 }
 
+void generic_pipe_buf_get(struct pipe_inode_info *info, struct pipe_buffer *buf)
+{
+	page_cache_get(buf->page);
+}
+
 static struct pipe_buf_operations anon_pipe_buf_ops = {
 	.can_merge = 1,
 	.map = anon_pipe_buf_map,
 	.unmap = anon_pipe_buf_unmap,
 	.release = anon_pipe_buf_release,
+	.get = generic_pipe_buf_get,
 };
 
 static ssize_t
-pipe_readv(struct file *filp, const struct iovec *_iov,
-	   unsigned long nr_segs, loff_t *ppos)
+do_pipe_readv(struct file *filp, const struct iovec *_iov,
+	      unsigned long nr_segs, int nonblock)
 {
 	struct inode *inode = filp->f_dentry->d_inode;
 	struct pipe_inode_info *info;
@@ -185,7 +196,7 @@ pipe_readv(struct file *filp, const struct iovec *_iov,
 			 */
 			if (ret)
 				break;
-			if (filp->f_flags & O_NONBLOCK) {
+			if (nonblock) {
 				ret = -EAGAIN;
 				break;
 			}
@@ -211,6 +222,13 @@ pipe_readv(struct file *filp, const struct iovec *_iov,
 	return ret;
 }
 
+static ssize_t
+pipe_readv(struct file *filp, const struct iovec *iov,
+	   unsigned long nr_segs, loff_t *ppos)
+{
+	return do_pipe_readv(filp, iov, nr_segs, filp->f_flags & O_NONBLOCK);
+}
+
 static ssize_t
 pipe_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos)
 {
@@ -219,8 +237,8 @@ pipe_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos)
 }
 
 static ssize_t
-pipe_writev(struct file *filp, const struct iovec *_iov,
-	    unsigned long nr_segs, loff_t *ppos)
+do_pipe_writev(struct file *filp, const struct iovec *_iov,
+	       unsigned long nr_segs, int nonblock)
 {
 	struct inode *inode = filp->f_dentry->d_inode;
 	struct pipe_inode_info *info;
@@ -253,7 +271,9 @@ pipe_writev(struct file *filp, const struct iovec *_iov,
 		struct pipe_buffer *buf = info->bufs + lastbuf;
 		struct pipe_buf_operations *ops = buf->ops;
 		int offset = buf->offset + buf->len;
-		if (ops->can_merge && offset + chars <= PAGE_SIZE) {
+		/* a page shared by tee() must not change under the other pipe */
+		if (ops->can_merge && offset + chars <= PAGE_SIZE &&
+		    page_count(buf->page) == 1) {
 			void *addr = ops->map(filp, info, buf);
 			int error = pipe_iov_copy_from_user(offset + addr, iov, chars);
 			ops->unmap(info, buf);
@@ -323,7 +343,7 @@ pipe_writev(struct file *filp, const struct iovec *_iov,
 		}
 		if (bufs < PIPE_BUFFERS)
 			continue;
-		if (filp->f_flags & O_NONBLOCK) {
+		if (nonblock) {
 			if (!ret) ret = -EAGAIN;
 			break;
 		}
@@ -351,6 +371,30 @@ out:
 	return ret;
 }
 
+static ssize_t
+pipe_writev(struct file *filp, const struct iovec *iov,
+	    unsigned long nr_segs, loff_t *ppos)
+{
+	return do_pipe_writev(filp, iov, nr_segs, filp->f_flags & O_NONBLOCK);
+}
+
+/*
+ * readv() and writev() that never wait for the pipe, whatever the
+ * file's O_NONBLOCK, for io_ring.  iov is a kernel array of user
+ * buffers; the caller has checked the file's mode.
+ */
+ssize_t pipe_readv_nonblock(struct file *filp, const struct iovec *iov,
+			    unsigned long nr_segs)
+{
+	return do_pipe_readv(filp, iov, nr_segs, 1);
+}
+
+ssize_t pipe_writev_nonblock(struct file *filp, const struct iovec *iov,
+			     unsigned long nr_segs)
+{
+	return do_pipe_writev(filp, iov, nr_segs, 1);
+}
+
 static ssize_t
 pipe_write(struct file *filp, const char __user *buf,
 	   size_t count, loff_t *ppos)
@@ -642,12 +686,28 @@ struct file_operations rdwr_pipe_fops = {
 	.fasync		= pipe_rdwr_fasync,
 };
 
-void free_pipe_info(struct inode *inode)
+/*
+ * A pipe_inode_info with no inode is private to its user, see
+ * do_splice_direct(), and is never waited on.
+ */
+struct pipe_inode_info *alloc_pipe_info(struct inode *inode)
+{
+	struct pipe_inode_info *info;
+
+	info = kmalloc(sizeof(struct pipe_inode_info), GFP_KERNEL);
+	if (!info)
+		return NULL;
+	memset(info, 0, sizeof(*info));
+	init_waitqueue_head(&info->wait);
+	info->r_counter = info->w_counter = 1;
+	info->inode = inode;
+	return info;
+}
+
+void __free_pipe_info(struct pipe_inode_info *info)
 {
 	int i;
-	struct pipe_inode_info *info = inode->i_pipe;
 
-	inode->i_pipe = NULL;
 	for (i = 0; i < PIPE_BUFFERS; i++) {
 		struct pipe_buffer *buf = info->bufs + i;
 		if (buf->ops)
@@ -658,22 +718,21 @@ void free_pipe_info(struct inode *inode)
 	kfree(info);
 }
 
+void free_pipe_info(struct inode *inode)
+{
+	__free_pipe_info(inode->i_pipe);
+	inode->i_pipe = NULL;
+}
+
 struct inode* pipe_new(struct inode* inode)
 {
 	struct pipe_inode_info *info;
 
-	info = kmalloc(sizeof(struct pipe_inode_info), GFP_KERNEL);
+	info = alloc_pipe_info(inode);
 	if (!info)
-		goto fail_page;
-	memset(info, 0, sizeof(*info));
+		return NULL;
 	inode->i_pipe = info;
-
-	init_waitqueue_head(PIPE_WAIT(*inode));
-	PIPE_RCOUNTER(*inode) = PIPE_WCOUNTER(*inode) = 1;
-
 	return inode;
-fail_page:
-	return NULL;
 }
 
 static struct vfsmount *pipe_mnt;
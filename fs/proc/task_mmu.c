@@ -116,6 +116,7 @@ struct mem_size_stats
 	unsigned long shared_dirty;
 	unsigned long private_clean;
 	unsigned long private_dirty;
+	unsigned long anon_huge;
 };
 
 static int show_map_internal(struct seq_file *m, void *v, struct mem_size_stats *mss)
@@ -180,13 +181,15 @@ static int show_map_internal(struct seq_file *m, void *v, struct mem_size_stats
 			   "Shared_Clean:  %8lu kB\n"
 			   "Shared_Dirty:  %8lu kB\n"
 			   "Private_Clean: %8lu kB\n"
-			   "Private_Dirty: %8lu kB\n",
+			   "Private_Dirty: %8lu kB\n"
+			   "AnonHugePages: %8lu kB\n",
 			   (vma->vm_end - vma->vm_start) >> 10,
 			   mss->resident >> 10,
 			   mss->shared_clean  >> 10,
 			   mss->shared_dirty  >> 10,
 			   mss->private_clean >> 10,
-			   mss->private_dirty >> 10);
+			   mss->private_dirty >> 10,
+			   mss->anon_huge >> 10);
 
 	if (m->count < m->size)  /* vma is copied successfully */
 		m->version = (vma != get_gate_vma(task))? vma->vm_start: 0;
@@ -235,6 +238,26 @@ static void smaps_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
 	cond_resched();
 }
 
+/*
+ * A transparent huge page is private to this mm and always dirty.
+ */
+static int smaps_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+				struct mem_size_stats *mss)
+{
+	spinlock_t *ptl = &vma->vm_mm->page_table_lock;
+	int huge;
+
+	spin_lock(ptl);
+	huge = pmd_trans_huge(*pmd);
+	if (huge) {
+		mss->resident += HPAGE_PMD_SIZE;
+		mss->private_dirty += HPAGE_PMD_SIZE;
+		mss->anon_huge += HPAGE_PMD_SIZE;
+	}
+	spin_unlock(ptl);
+	return huge;
+}
+
 static inline void smaps_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 				unsigned long addr, unsigned long end,
 				struct mem_size_stats *mss)
@@ -245,7 +268,9 @@ static inline void smaps_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd))
+		if (pmd_trans_huge(*pmd) && smaps_huge_pmd(vma, pmd, mss))
+			continue;
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
 		smaps_pte_range(vma, pmd, addr, next, mss);
 	} while (pmd++, addr = next, addr != end);
@@ -289,7 +314,7 @@ static int show_smap(struct seq_file *m, void *v)
 	struct mem_size_stats mss;
 
 	memset(&mss, 0, sizeof mss);
-	if (vma->vm_mm)
+	if (vma->vm_mm && !is_vm_hugetlb_page(vma))
 		smaps_pgd_range(vma, vma->vm_start, vma->vm_end, &mss);
 	return show_map_internal(m, v, &mss);
 }
@@ -69,6 +69,8 @@ struct inode *ramfs_get_inode(struct super_block *sb, int mode, dev_t dev)
 		case S_IFREG:
 			inode->i_op = &ramfs_file_inode_operations;
 			inode->i_fop = &ramfs_file_operations;
+			/* There is nowhere to write ramfs pages back to */
+			mapping_set_unevictable(inode->i_mapping);
 			break;
 		case S_IFDIR:
 			inode->i_op = &ramfs_dir_inode_operations;
@@ -658,7 +658,8 @@ static ssize_t do_sendfile(int out_fd, int in_fd, loff_t *ppos,
 	in_inode = in_file->f_dentry->d_inode;
 	if (!in_inode)
 		goto fput_in;
-	if (!in_file->f_op || !in_file->f_op->sendfile)
+	if (!in_file->f_op ||
+	    (!in_file->f_op->sendfile && !in_file->f_op->splice_read))
 		goto fput_in;
 	retval = -ESPIPE;
 	if (!ppos)
@@ -685,7 +686,8 @@ static ssize_t do_sendfile(int out_fd, int in_fd, loff_t *ppos,
 	if (!(out_file->f_mode & FMODE_WRITE))
 		goto fput_out;
 	retval = -EINVAL;
-	if (!out_file->f_op || !out_file->f_op->sendpage)
+	if (!out_file->f_op ||
+	    (!out_file->f_op->sendpage && !out_file->f_op->splice_write))
 		goto fput_out;
 	out_inode = out_file->f_dentry->d_inode;
 	retval = rw_verify_area(WRITE, out_file, &out_file->f_pos, count);
@@ -711,7 +713,17 @@ static ssize_t do_sendfile(int out_fd, int in_fd, loff_t *ppos,
 		count = max - pos;
 	}
 
-	retval = in_file->f_op->sendfile(in_file, ppos, count, file_send_actor, out_file);
+	/*
+	 * Go through a pipe when both ends can splice; that also lets
+	 * sendfile() write to files that have no ->sendpage.
+	 */
+	if (in_file->f_op->splice_read && out_file->f_op->splice_write)
+		retval = do_splice_direct(in_file, ppos, out_file, count, 0);
+	else if (in_file->f_op->sendfile && out_file->f_op->sendpage)
+		retval = in_file->f_op->sendfile(in_file, ppos, count,
+						 file_send_actor, out_file);
+	else
+		retval = -EINVAL;
 
 	if (retval > 0) {
 		current->rchar += retval;
@@ -0,0 +1,1096 @@
+/*
+ *  linux/fs/splice.c
+ *
+ * splice(), tee() and vmsplice(): move data between files, sockets and
+ * pipes without copying it through user space.
+ *
+ * A pipe is a ring of up to PIPE_BUFFERS page references (struct
+ * pipe_buffer, see fs/pipe.c).  Splicing from a file fills the ring with
+ * references to page cache pages, vmsplice() fills it with references to
+ * user pages, and tee() duplicates references from one pipe into another.
+ * Splicing to a socket hands the pages to ->sendpage(); splicing to a
+ * file copies them into its page cache.
+ *
+ * sendfile() is built on the same two halves, with a pipe private to the
+ * task in between (do_splice_direct()).
+ */
+
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/pagemap.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/swap.h>
+#include <linux/writeback.h>
+#include <linux/buffer_head.h>
+#include <linux/module.h>
+#include <linux/syscalls.h>
+#include <linux/security.h>
+#include <linux/highmem.h>
+#include <linux/uio.h>
+
+#include <asm/uaccess.h>
+
+/*
+ * What splice_to_pipe() puts into a pipe: nr_pages page references and
+ * the part of each page that holds data
+ */
+struct partial_page {
+	unsigned int offset;
+	unsigned int len;
+};
+
+struct splice_pipe_desc {
+	struct page **pages;
+	struct partial_page *partial;
+	int nr_pages;
+	unsigned int flags;
+	struct pipe_buf_operations *ops;
+};
+
+/*
+ * The internal pipe of do_splice_direct() has no inode, nobody else can
+ * see it and it needs no locking.
+ */
+static inline void pipe_lock(struct pipe_inode_info *pipe)
+{
+	if (pipe->inode)
+		mutex_lock(&pipe->inode->i_mutex);
+}
+
+static inline void pipe_unlock(struct pipe_inode_info *pipe)
+{
+	if (pipe->inode)
+		mutex_unlock(&pipe->inode->i_mutex);
+}
+
+/* tee() locks two pipes; take them in address order */
+static void pipe_double_lock(struct pipe_inode_info *pipe1,
+			     struct pipe_inode_info *pipe2)
+{
+	if (pipe1 < pipe2) {
+		pipe_lock(pipe1);
+		pipe_lock(pipe2);
+	} else {
+		pipe_lock(pipe2);
+		pipe_lock(pipe1);
+	}
+}
+
+static void pipe_wakeup_readers(struct pipe_inode_info *pipe)
+{
+	smp_mb();
+	if (waitqueue_active(&pipe->wait))
+		wake_up_interruptible_sync(&pipe->wait);
+	kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
+}
+
+static void pipe_wakeup_writers(struct pipe_inode_info *pipe)
+{
+	smp_mb();
+	if (waitqueue_active(&pipe->wait))
+		wake_up_interruptible_sync(&pipe->wait);
+	kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
+}
+
+/*
+ * Buffers that hold a reference to a page cache page or, for vmsplice(),
+ * a user page.  The page is only borrowed: it is never written through
+ * the pipe, so these buffers can't be merged into.
+ */
+static void page_ref_pipe_buf_release(struct pipe_inode_info *pipe,
+				      struct pipe_buffer *buf)
+{
+	page_cache_release(buf->page);
+}
+
+static void *page_ref_pipe_buf_map(struct file *file,
+				   struct pipe_inode_info *pipe,
+				   struct pipe_buffer *buf)
+{
+	return kmap(buf->page);
+}
+
+static void page_ref_pipe_buf_unmap(struct pipe_inode_info *pipe,
+				    struct pipe_buffer *buf)
+{
+	kunmap(buf->page);
+}
+
+static struct pipe_buf_operations page_cache_pipe_buf_ops = {
+	.can_merge = 0,
+	.map = page_ref_pipe_buf_map,
+	.unmap = page_ref_pipe_buf_unmap,
+	.release = page_ref_pipe_buf_release,
+	.get = generic_pipe_buf_get,
+};
+
+static struct pipe_buf_operations user_page_pipe_buf_ops = {
+	.can_merge = 0,
+	.map = page_ref_pipe_buf_map,
+	.unmap = page_ref_pipe_buf_unmap,
+	.release = page_ref_pipe_buf_release,
+	.get = generic_pipe_buf_get,
+};
+
+/*
+ * Put the pages of spd into the pipe.  Waits for room only while
+ * nothing has been added yet, so a full pipe gives a short count.  The
+ * references to pages that did not fit are dropped.
+ */
+static ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
+			      struct splice_pipe_desc *spd)
+{
+	int do_wakeup = 0, page_nr = 0;
+	ssize_t ret = 0;
+
+	pipe_lock(pipe);
+
+	for (;;) {
+		if (!pipe->readers) {
+			send_sig(SIGPIPE, current, 0);
+			if (!ret)
+				ret = -EPIPE;
+			break;
+		}
+
+		if (pipe->nrbufs < PIPE_BUFFERS) {
+			int newbuf = (pipe->curbuf + pipe->nrbufs) &
+				     (PIPE_BUFFERS - 1);
+			struct pipe_buffer *buf = pipe->bufs + newbuf;
+
+			buf->page = spd->pages[page_nr];
+			buf->offset = spd->partial[page_nr].offset;
+			buf->len = spd->partial[page_nr].len;
+			buf->ops = spd->ops;
+			pipe->nrbufs++;
+			ret += buf->len;
+			if (pipe->inode)
+				do_wakeup = 1;
+
+			if (++page_nr == spd->nr_pages)
+				break;
+			continue;
+		}
+
+		if (ret)
+			break;
+		if (!pipe->inode || (spd->flags & SPLICE_F_NONBLOCK)) {
+			ret = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+
+		pipe->waiting_writers++;
+		pipe_wait(pipe->inode);
+		pipe->waiting_writers--;
+	}
+
+	pipe_unlock(pipe);
+
+	if (do_wakeup)
+		pipe_wakeup_readers(pipe);
+
+	while (page_nr < spd->nr_pages)
+		page_cache_release(spd->pages[page_nr++]);
+
+	return ret;
+}
+
+/**
+ * generic_file_splice_read - splice data from a file into a pipe
+ * @in:		file to read from
+ * @ppos:	position in @in
+ * @pipe:	pipe to fill
+ * @len:	number of bytes to splice
+ * @flags:	SPLICE_F_* flags
+ *
+ * Puts references to the page cache pages of @in into @pipe, reading
+ * them in first where needed.  At most PIPE_BUFFERS pages are spliced
+ * per call.  For filesystems whose page cache is filled by ->readpage.
+ */
+ssize_t generic_file_splice_read(struct file *in, loff_t *ppos,
+				 struct pipe_inode_info *pipe, size_t len,
+				 unsigned int flags)
+{
+	struct address_space *mapping = in->f_mapping;
+	struct inode *inode = mapping->host;
+	struct page *pages[PIPE_BUFFERS];
+	struct partial_page partial[PIPE_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.flags = flags,
+		.ops = &page_cache_pipe_buf_ops,
+	};
+	unsigned int loff, req_pages;
+	pgoff_t index;
+	ssize_t ret;
+	int error = 0;
+
+	index = *ppos >> PAGE_CACHE_SHIFT;
+	loff = *ppos & ~PAGE_CACHE_MASK;
+	req_pages = (len + loff + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	if (req_pages > PIPE_BUFFERS)
+		req_pages = PIPE_BUFFERS;
+
+	while (spd.nr_pages < req_pages && len) {
+		unsigned int this_len, plen;
+		pgoff_t end_index;
+		struct page *page;
+		loff_t isize;
+
+		isize = i_size_read(inode);
+		if (!isize || index > ((isize - 1) >> PAGE_CACHE_SHIFT))
+			break;
+
+		page = find_get_page(mapping, index);
+		if (!page) {
+			page_cache_sync_readahead(mapping, &in->f_ra, in, index,
+						  req_pages - spd.nr_pages);
+			page = find_get_page(mapping, index);
+		}
+		if (!page) {
+			page = page_cache_alloc_cold(mapping);
+			if (!page) {
+				error = -ENOMEM;
+				break;
+			}
+			error = add_to_page_cache_lru(page, mapping, index,
+						      GFP_KERNEL);
+			if (unlikely(error)) {
+				page_cache_release(page);
+				if (error == -EEXIST) {
+					error = 0;
+					continue;
+				}
+				break;
+			}
+			goto readpage;
+		}
+
+		if (PageReadahead(page))
+			page_cache_async_readahead(mapping, &in->f_ra, in, page,
+						   index, req_pages - spd.nr_pages);
+
+		if (!PageUptodate(page)) {
+			lock_page(page);
+			if (!page->mapping) {
+				/* truncated under us */
+				unlock_page(page);
+				page_cache_release(page);
+				break;
+			}
+			if (PageUptodate(page)) {
+				unlock_page(page);
+				goto fill;
+			}
+readpage:
+			error = mapping->a_ops->readpage(in, page);
+			if (unlikely(error)) {
+				page_cache_release(page);
+				if (error == AOP_TRUNCATED_PAGE) {
+					error = 0;
+					continue;
+				}
+				break;
+			}
+			wait_on_page_locked(page);
+			if (!PageUptodate(page)) {
+				page_cache_release(page);
+				error = -EIO;
+				break;
+			}
+		}
+fill:
+		/* i_size must be checked after the page is uptodate */
+		isize = i_size_read(inode);
+		end_index = (isize - 1) >> PAGE_CACHE_SHIFT;
+		if (unlikely(!isize || index > end_index)) {
+			page_cache_release(page);
+			break;
+		}
+		plen = PAGE_CACHE_SIZE;
+		if (index == end_index) {
+			plen = ((isize - 1) & ~PAGE_CACHE_MASK) + 1;
+			if (plen <= loff) {
+				page_cache_release(page);
+				break;
+			}
+		}
+		this_len = min_t(size_t, len, plen - loff);
+
+		mark_page_accessed(page);
+		pages[spd.nr_pages] = page;
+		partial[spd.nr_pages].offset = loff;
+		partial[spd.nr_pages].len = this_len;
+		spd.nr_pages++;
+		in->f_ra.prev_index = index;
+
+		len -= this_len;
+		loff = 0;
+		index++;
+
+		/* a short last page means end of file */
+		if (plen < PAGE_CACHE_SIZE)
+			break;
+	}
+
+	if (!spd.nr_pages)
+		return error;
+
+	ret = splice_to_pipe(pipe, &spd);
+	if (ret > 0) {
+		*ppos += ret;
+		file_accessed(in);
+	}
+	return ret;
+}
+
+EXPORT_SYMBOL(generic_file_splice_read);
+
+/*
+ * Feed the buffers of pipe to actor until sd->total_len bytes are done,
+ * the pipe runs dry or actor fails.  Like a pipe read, this waits for
+ * more data only while nothing has been spliced yet or a writer is
+ * waiting.  Called with the pipe locked.
+ */
+static ssize_t __splice_from_pipe(struct pipe_inode_info *pipe,
+				  struct splice_desc *sd, splice_actor *actor)
+{
+	int do_wakeup = 0;
+	ssize_t ret = 0;
+
+	for (;;) {
+		if (pipe->nrbufs) {
+			struct pipe_buffer *buf = pipe->bufs + pipe->curbuf;
+			struct pipe_buf_operations *ops = buf->ops;
+			int err;
+
+			sd->len = buf->len;
+			if (sd->len > sd->total_len)
+				sd->len = sd->total_len;
+
+			err = actor(pipe, buf, sd);
+			if (err <= 0) {
+				if (!ret)
+					ret = err;
+				break;
+			}
+
+			ret += err;
+			buf->offset += err;
+			buf->len -= err;
+			sd->pos += err;
+			sd->total_len -= err;
+
+			if (!buf->len) {
+				buf->ops = NULL;
+				ops->release(pipe, buf);
+				pipe->curbuf = (pipe->curbuf + 1) &
+					       (PIPE_BUFFERS - 1);
+				pipe->nrbufs--;
+				if (pipe->inode)
+					do_wakeup = 1;
+			}
+
+			if (!sd->total_len)
+				break;
+			continue;
+		}
+
+		if (!pipe->writers || !pipe->inode)
+			break;
+		if (!pipe->waiting_writers && ret)
+			break;
+		if (sd->flags & SPLICE_F_NONBLOCK) {
+			if (!ret)
+				ret = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			if (!ret)
+				ret = -ERESTARTSYS;
+			break;
+		}
+
+		if (do_wakeup) {
+			pipe_wakeup_writers(pipe);
+			do_wakeup = 0;
+		}
+		pipe_wait(pipe->inode);
+	}
+
+	if (do_wakeup)
+		pipe_wakeup_writers(pipe);
+
+	return ret;
+}
+
+/**
+ * splice_from_pipe - feed the contents of a pipe to an actor
+ * @pipe:	pipe to drain
+ * @out:	file the actor writes to
+ * @ppos:	position in @out, advanced by the bytes spliced
+ * @len:	maximum number of bytes to splice
+ * @flags:	SPLICE_F_* flags
+ * @actor:	consumes part of one pipe buffer, returns bytes consumed
+ */
+ssize_t splice_from_pipe(struct pipe_inode_info *pipe, struct file *out,
+			 loff_t *ppos, size_t len, unsigned int flags,
+			 splice_actor *actor)
+{
+	struct splice_desc sd = {
+		.total_len = len,
+		.flags = flags,
+		.file = out,
+		.pos = *ppos,
+	};
+	ssize_t ret;
+
+	pipe_lock(pipe);
+	ret = __splice_from_pipe(pipe, &sd, actor);
+	pipe_unlock(pipe);
+
+	*ppos = sd.pos;
+	return ret;
+}
+
+EXPORT_SYMBOL(splice_from_pipe);
+
+/*
+ * Copy a pipe buffer into the page cache of sd->file, at most up to the
+ * end of the page at sd->pos
+ */
+static int pipe_to_file(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
+			struct splice_desc *sd)
+{
+	struct file *file = sd->file;
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	unsigned int offset, this_len;
+	struct page *page;
+	char *src, *dst;
+	pgoff_t index;
+	int ret;
+
+	index = sd->pos >> PAGE_CACHE_SHIFT;
+	offset = sd->pos & ~PAGE_CACHE_MASK;
+	this_len = sd->len;
+	if (this_len + offset > PAGE_CACHE_SIZE)
+		this_len = PAGE_CACHE_SIZE - offset;
+
+find_page:
+	page = find_or_create_page(mapping, index, mapping_gfp_mask(mapping));
+	if (!page)
+		return -ENOMEM;
+
+	ret = mapping->a_ops->prepare_write(file, page, offset,
+					    offset + this_len);
+	if (unlikely(ret)) {
+		loff_t isize = i_size_read(inode);
+
+		if (ret != AOP_TRUNCATED_PAGE)
+			unlock_page(page);
+		page_cache_release(page);
+		if (ret == AOP_TRUNCATED_PAGE)
+			goto find_page;
+		/*
+		 * prepare_write() may have instantiated a few blocks
+		 * outside i_size.  Trim these off again.
+		 */
+		if (sd->pos + this_len > isize)
+			vmtruncate(inode, isize);
+		return ret;
+	}
+
+	src = buf->ops->map(file, pipe, buf);
+	dst = kmap_atomic(page, KM_USER0);
+	memcpy(dst + offset, src + buf->offset, this_len);
+	flush_dcache_page(page);
+	kunmap_atomic(dst, KM_USER0);
+	buf->ops->unmap(pipe, buf);
+
+	ret = mapping->a_ops->commit_write(file, page, offset,
+					   offset + this_len);
+	if (ret == AOP_TRUNCATED_PAGE) {
+		page_cache_release(page);
+		goto find_page;
+	}
+	if (!ret)
+		ret = this_len;
+
+	mark_page_accessed(page);
+	unlock_page(page);
+	page_cache_release(page);
+
+	balance_dirty_pages_ratelimited(mapping);
+	return ret;
+}
+
+/**
+ * generic_file_splice_write - splice data from a pipe into a file
+ * @pipe:	pipe to drain
+ * @out:	file to write to
+ * @ppos:	position in @out
+ * @len:	number of bytes to splice
+ * @flags:	SPLICE_F_* flags
+ *
+ * Copies the pipe buffers into the page cache of @out through
+ * ->prepare_write and ->commit_write, like a buffered write.
+ */
+ssize_t generic_file_splice_write(struct pipe_inode_info *pipe,
+				  struct file *out, loff_t *ppos, size_t len,
+				  unsigned int flags)
+{
+	struct address_space *mapping = out->f_mapping;
+	struct inode *inode = mapping->host;
+	loff_t pos = *ppos;
+	size_t count = len;
+	ssize_t ret;
+
+	mutex_lock(&inode->i_mutex);
+
+	ret = generic_write_checks(out, &pos, &count, S_ISBLK(inode->i_mode));
+	if (ret || !count)
+		goto out;
+	ret = remove_suid(out->f_dentry);
+	if (ret)
+		goto out;
+	file_update_time(out);
+
+	ret = splice_from_pipe(pipe, out, &pos, count, flags, pipe_to_file);
+out:
+	mutex_unlock(&inode->i_mutex);
+
+	if (ret > 0) {
+		*ppos = pos;
+		if (unlikely((out->f_flags & O_SYNC) || IS_SYNC(inode))) {
+			int err = generic_osync_inode(inode, mapping,
+						      OSYNC_METADATA | OSYNC_DATA);
+			if (err)
+				ret = err;
+		}
+	}
+	return ret;
+}
+
+EXPORT_SYMBOL(generic_file_splice_write);
+
+/* hand a pipe buffer to ->sendpage(), which takes its own reference */
+static int pipe_to_sendpage(struct pipe_inode_info *pipe,
+			    struct pipe_buffer *buf, struct splice_desc *sd)
+{
+	struct file *file = sd->file;
+	loff_t pos = sd->pos;
+	int more = (sd->flags & SPLICE_F_MORE) || sd->len < sd->total_len;
+
+	return file->f_op->sendpage(file, buf->page, buf->offset, sd->len,
+				    &pos, more);
+}
+
+/**
+ * generic_splice_sendpage - splice data from a pipe into a socket
+ * @pipe:	pipe to drain
+ * @out:	socket file to send to
+ * @ppos:	position in @out
+ * @len:	number of bytes to splice
+ * @flags:	SPLICE_F_* flags
+ *
+ * Sends the pipe buffers with ->sendpage, without copying them.
+ */
+ssize_t generic_splice_sendpage(struct pipe_inode_info *pipe,
+				struct file *out, loff_t *ppos, size_t len,
+				unsigned int flags)
+{
+	return splice_from_pipe(pipe, out, ppos, len, flags, pipe_to_sendpage);
+}
+
+EXPORT_SYMBOL(generic_splice_sendpage);
+
+static long do_splice_from(struct pipe_inode_info *pipe, struct file *out,
+			   loff_t *ppos, size_t len, unsigned int flags)
+{
+	int ret;
+
+	if (unlikely(!out->f_op || !out->f_op->splice_write))
+		return -EINVAL;
+	if (unlikely(!(out->f_mode & FMODE_WRITE)))
+		return -EBADF;
+
+	ret = rw_verify_area(WRITE, out, ppos, len);
+	if (unlikely(ret < 0))
+		return ret;
+	len = ret;
+
+	ret = security_file_permission(out, MAY_WRITE);
+	if (unlikely(ret))
+		return ret;
+
+	return out->f_op->splice_write(pipe, out, ppos, len, flags);
+}
+
+static long do_splice_to(struct file *in, loff_t *ppos,
+			 struct pipe_inode_info *pipe, size_t len,
+			 unsigned int flags)
+{
+	int ret;
+
+	if (unlikely(!in->f_op || !in->f_op->splice_read))
+		return -EINVAL;
+	if (unlikely(!(in->f_mode & FMODE_READ)))
+		return -EBADF;
+
+	ret = rw_verify_area(READ, in, ppos, len);
+	if (unlikely(ret < 0))
+		return ret;
+	len = ret;
+
+	ret = security_file_permission(in, MAY_READ);
+	if (unlikely(ret))
+		return ret;
+
+	return in->f_op->splice_read(in, ppos, pipe, len, flags);
+}
+
+/**
+ * do_splice_direct - splice from one file to another, for sendfile()
+ * @in:		file to read from
+ * @ppos:	position in @in
+ * @out:	file to write to, at its f_pos
+ * @len:	number of bytes to move
+ * @flags:	SPLICE_F_* flags
+ *
+ * Goes through current->splice_pipe, a pipe that belongs to the task and
+ * is emptied again before returning.
+ */
+long do_splice_direct(struct file *in, loff_t *ppos, struct file *out,
+		      size_t len, unsigned int flags)
+{
+	struct pipe_inode_info *pipe = current->splice_pipe;
+	long ret = 0, bytes = 0;
+	int i;
+
+	if (unlikely(!pipe)) {
+		pipe = alloc_pipe_info(NULL);
+		if (!pipe)
+			return -ENOMEM;
+		pipe->readers = pipe->writers = 1;
+		current->splice_pipe = pipe;
+	}
+
+	while (len) {
+		size_t read_len, max_read_len;
+		unsigned int out_flags = flags;
+
+		max_read_len = min(len, (size_t) (PIPE_BUFFERS * PAGE_SIZE));
+		ret = do_splice_to(in, ppos, pipe, max_read_len, flags);
+		if (unlikely(ret <= 0))
+			break;
+		read_len = ret;
+
+		if (read_len < len)
+			out_flags |= SPLICE_F_MORE;
+		ret = do_splice_from(pipe, out, &out->f_pos, read_len,
+				     out_flags);
+		if (unlikely(ret <= 0))
+			break;
+
+		bytes += ret;
+		len -= ret;
+		if (ret < read_len) {
+			/* put back what the output did not take */
+			*ppos -= read_len - ret;
+			break;
+		}
+	}
+
+	for (i = 0; i < PIPE_BUFFERS; i++) {
+		struct pipe_buffer *buf = pipe->bufs + i;
+
+		if (buf->ops) {
+			buf->ops->release(pipe, buf);
+			buf->ops = NULL;
+		}
+	}
+	pipe->nrbufs = pipe->curbuf = 0;
+
+	return bytes ? bytes : ret;
+}
+
+EXPORT_SYMBOL(do_splice_direct);
+
+static inline struct pipe_inode_info *pipe_info(struct inode *inode)
+{
+	if (S_ISFIFO(inode->i_mode))
+		return inode->i_pipe;
+	return NULL;
+}
+
+/*
+ * One side of a splice must be a pipe.  The offset pointer of the other
+ * side is used instead of its f_pos if given.
+ */
+static long do_splice(struct file *in, loff_t __user *off_in,
+		      struct file *out, loff_t __user *off_out,
+		      size_t len, unsigned int flags)
+{
+	struct pipe_inode_info *pipe;
+	loff_t offset, *off;
+	long ret;
+
+	pipe = pipe_info(in->f_dentry->d_inode);
+	if (pipe) {
+		if (off_in)
+			return -ESPIPE;
+		off = &out->f_pos;
+		if (off_out) {
+			if (!(out->f_mode & FMODE_PWRITE))
+				return -EINVAL;
+			if (copy_from_user(&offset, off_out, sizeof(loff_t)))
+				return -EFAULT;
+			off = &offset;
+		}
+
+		ret = do_splice_from(pipe, out, off, len, flags);
+
+		if (off_out && copy_to_user(off_out, off, sizeof(loff_t)))
+			ret = -EFAULT;
+		return ret;
+	}
+
+	pipe = pipe_info(out->f_dentry->d_inode);
+	if (pipe) {
+		if (off_out)
+			return -ESPIPE;
+		off = &in->f_pos;
+		if (off_in) {
+			if (!(in->f_mode & FMODE_PREAD))
+				return -EINVAL;
+			if (copy_from_user(&offset, off_in, sizeof(loff_t)))
+				return -EFAULT;
+			off = &offset;
+		}
+
+		ret = do_splice_to(in, off, pipe, len, flags);
+
+		if (off_in && copy_to_user(off_in, off, sizeof(loff_t)))
+			ret = -EFAULT;
+		return ret;
+	}
+
+	return -EINVAL;
+}
+
+asmlinkage long sys_splice(int fd_in, loff_t __user *off_in,
+			   int fd_out, loff_t __user *off_out,
+			   size_t len, unsigned int flags)
+{
+	struct file *in, *out;
+	int fput_in, fput_out;
+	long error;
+
+	if (unlikely(!len))
+		return 0;
+
+	error = -EBADF;
+	in = fget_light(fd_in, &fput_in);
+	if (in) {
+		if (in->f_mode & FMODE_READ) {
+			out = fget_light(fd_out, &fput_out);
+			if (out) {
+				if (out->f_mode & FMODE_WRITE)
+					error = do_splice(in, off_in,
+							  out, off_out,
+							  len, flags);
+				fput_light(out, fput_out);
+			}
+		}
+		fput_light(in, fput_in);
+	}
+
+	return error;
+}
+
+/*
+ * Pin the user pages of an iovec, at most PIPE_BUFFERS of them.  Stops
+ * at the first segment that could not be pinned completely.
+ */
+static int get_iovec_page_array(const struct iovec __user *iov,
+				unsigned long nr_vecs, struct page **pages,
+				struct partial_page *partial)
+{
+	int buffers = 0, error = 0;
+
+	while (nr_vecs) {
+		unsigned long off, npages;
+		struct iovec entry;
+		void __user *base;
+		size_t len;
+		int i;
+
+		/* not under mmap_sem, the copy may fault */
+		error = -EFAULT;
+		if (copy_from_user(&entry, iov, sizeof(entry)))
+			break;
+		base = entry.iov_base;
+		len = entry.iov_len;
+
+		error = 0;
+		if (unlikely(!len))
+			goto next;
+		error = -EFAULT;
+		if (unlikely(!base || !access_ok(VERIFY_READ, base, len)))
+			break;
+
+		off = (unsigned long) base & ~PAGE_MASK;
+		npages = (off + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+		if (npages > PIPE_BUFFERS - buffers)
+			npages = PIPE_BUFFERS - buffers;
+
+		down_read(&current->mm->mmap_sem);
+		error = get_user_pages(current, current->mm,
+				       (unsigned long) base, npages, 0, 0,
+				       &pages[buffers], NULL);
+		up_read(&current->mm->mmap_sem);
+
+		if (unlikely(error <= 0))
+			break;
+
+		for (i = 0; i < error; i++) {
+			unsigned int plen = min_t(size_t, len, PAGE_SIZE - off);
+
+			partial[buffers].offset = off;
+			partial[buffers].len = plen;
+			off = 0;
+			len -= plen;
+			buffers++;
+		}
+
+		if (len || buffers == PIPE_BUFFERS)
+			break;
+next:
+		nr_vecs--;
+		iov++;
+	}
+
+	if (buffers)
+		return buffers;
+	return error;
+}
+
+/*
+ * vmsplice() puts references to user pages into a pipe.  Unless
+ * SPLICE_F_GIFT says otherwise, the caller must leave the memory alone
+ * until the data has been consumed from the pipe.
+ */
+static long do_vmsplice(struct file *file, const struct iovec __user *iov,
+			unsigned long nr_segs, unsigned int flags)
+{
+	struct pipe_inode_info *pipe = pipe_info(file->f_dentry->d_inode);
+	struct page *pages[PIPE_BUFFERS];
+	struct partial_page partial[PIPE_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.flags = flags,
+		.ops = &user_page_pipe_buf_ops,
+	};
+
+	if (unlikely(!pipe))
+		return -EBADF;
+	if (unlikely(nr_segs > UIO_MAXIOV))
+		return -EINVAL;
+	if (unlikely(!nr_segs))
+		return 0;
+
+	spd.nr_pages = get_iovec_page_array(iov, nr_segs, pages, partial);
+	if (spd.nr_pages <= 0)
+		return spd.nr_pages;
+
+	return splice_to_pipe(pipe, &spd);
+}
+
+asmlinkage long sys_vmsplice(int fd, const struct iovec __user *iov,
+			     unsigned long nr_segs, unsigned int flags)
+{
+	struct file *file;
+	int fput;
+	long error;
+
+	error = -EBADF;
+	file = fget_light(fd, &fput);
+	if (file) {
+		if (file->f_mode & FMODE_WRITE)
+			error = do_vmsplice(file, iov, nr_segs, flags);
+		fput_light(file, fput);
+	}
+
+	return error;
+}
+
+/*
+ * tee() needs data in the input pipe and room in the output pipe; wait
+ * for each with only that pipe locked.  Returns 0 when ready, or at end
+ * of input.
+ */
+static int link_ipipe_prep(struct pipe_inode_info *pipe, unsigned int flags)
+{
+	int ret = 0;
+
+	if (pipe->nrbufs)
+		return 0;
+
+	pipe_lock(pipe);
+	while (!pipe->nrbufs) {
+		if (!pipe->writers)
+			break;
+		if (flags & SPLICE_F_NONBLOCK) {
+			ret = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+		pipe_wait(pipe->inode);
+	}
+	pipe_unlock(pipe);
+
+	return ret;
+}
+
+static int link_opipe_prep(struct pipe_inode_info *pipe, unsigned int flags)
+{
+	int ret = 0;
+
+	if (pipe->nrbufs < PIPE_BUFFERS)
+		return 0;
+
+	pipe_lock(pipe);
+	while (pipe->nrbufs >= PIPE_BUFFERS) {
+		if (!pipe->readers) {
+			send_sig(SIGPIPE, current, 0);
+			ret = -EPIPE;
+			break;
+		}
+		if (flags & SPLICE_F_NONBLOCK) {
+			ret = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+		pipe->waiting_writers++;
+		pipe_wait(pipe->inode);
+		pipe->waiting_writers--;
+	}
+	pipe_unlock(pipe);
+
+	return ret;
+}
+
+/*
+ * Duplicate up to len bytes of buffers from ipipe into opipe, taking a
+ * new reference to each page.  ipipe is left as it was.
+ */
+static long link_pipe(struct pipe_inode_info *ipipe,
+		      struct pipe_inode_info *opipe,
+		      size_t len, unsigned int flags)
+{
+	unsigned int i = 0;
+	long ret = 0;
+
+	pipe_double_lock(ipipe, opipe);
+
+	while (len) {
+		struct pipe_buffer *ibuf, *obuf;
+		int nbuf;
+
+		if (!opipe->readers) {
+			send_sig(SIGPIPE, current, 0);
+			if (!ret)
+				ret = -EPIPE;
+			break;
+		}
+		if (i >= ipipe->nrbufs || opipe->nrbufs >= PIPE_BUFFERS)
+			break;
+
+		ibuf = ipipe->bufs + ((ipipe->curbuf + i) & (PIPE_BUFFERS - 1));
+		nbuf = (opipe->curbuf + opipe->nrbufs) & (PIPE_BUFFERS - 1);
+		obuf = opipe->bufs + nbuf;
+
+		ibuf->ops->get(ipipe, ibuf);
+		*obuf = *ibuf;
+		if (obuf->len > len)
+			obuf->len = len;
+
+		opipe->nrbufs++;
+		ret += obuf->len;
+		len -= obuf->len;
+		i++;
+	}
+
+	pipe_unlock(ipipe);
+	pipe_unlock(opipe);
+
+	if (ret > 0)
+		pipe_wakeup_readers(opipe);
+
+	return ret;
+}
+
+static long do_tee(struct file *in, struct file *out, size_t len,
+		   unsigned int flags)
+{
+	struct pipe_inode_info *ipipe = pipe_info(in->f_dentry->d_inode);
+	struct pipe_inode_info *opipe = pipe_info(out->f_dentry->d_inode);
+	long ret;
+
+	if (!ipipe || !opipe || ipipe == opipe)
+		return -EINVAL;
+
+	/*
+	 * The pipes can change between the waits and link_pipe(); if
+	 * nothing could be linked while the input still has data, wait
+	 * again.
+	 */
+	do {
+		ret = link_ipipe_prep(ipipe, flags);
+		if (!ret)
+			ret = link_opipe_prep(opipe, flags);
+		if (!ret)
+			ret = link_pipe(ipipe, opipe, len, flags);
+	} while (!ret && ipipe->nrbufs);
+
+	return ret;
+}
+
+asmlinkage long sys_tee(int fdin, int fdout, size_t len, unsigned int flags)
+{
+	struct file *in, *out;
+	int fput_in, fput_out;
+	long error;
+
+	if (unlikely(!len))
+		return 0;
+
+	error = -EBADF;
+	in = fget_light(fdin, &fput_in);
+	if (in) {
+		if (in->f_mode & FMODE_READ) {
+			out = fget_light(fdout, &fput_out);
+			if (out) {
+				if (out->f_mode & FMODE_WRITE)
+					error = do_tee(in, out, len, flags);
+				fput_light(out, fput_out);
+			}
+		}
+		fput_light(in, fput_in);
+	}
+
+	return error;
+}
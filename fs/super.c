@@ -34,7 +34,7 @@
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/vfs.h>
-#include <linux/writeback.h>		/* for the emergency remount stuff */
+#include <linux/workqueue.h>		/* for the emergency remount stuff */
 #include <linux/idr.h>
 #include <linux/kobject.h>
 #include <asm/uaccess.h>
@@ -65,11 +65,25 @@ static struct super_block *alloc_super(void)
 			s = NULL;
 			goto out;
 		}
-		INIT_LIST_HEAD(&s->s_dirty);
-		INIT_LIST_HEAD(&s->s_io);
+#ifdef CONFIG_SMP
+		s->s_files = alloc_percpu(struct list_head);
+		if (!s->s_files) {
+			security_sb_free(s);
+			kfree(s);
+			s = NULL;
+			goto out;
+		} else {
+			int i;
+
+			for_each_cpu(i)
+				INIT_LIST_HEAD(per_cpu_ptr(s->s_files, i));
+		}
+#else
 		INIT_LIST_HEAD(&s->s_files);
+#endif
 		INIT_LIST_HEAD(&s->s_instances);
 		INIT_HLIST_HEAD(&s->s_anon);
+		spin_lock_init(&s->s_inodes_lock);
 		INIT_LIST_HEAD(&s->s_inodes);
 		init_rwsem(&s->s_umount);
 		mutex_init(&s->s_lock);
@@ -99,6 +113,9 @@ out:
  */
 static inline void destroy_super(struct super_block *s)
 {
+#ifdef CONFIG_SMP
+	free_percpu(s->s_files);
+#endif
 	security_sb_free(s);
 	kfree(s);
 }
@@ -511,12 +528,12 @@ static void mark_files_ro(struct super_block *sb)
 {
 	struct file *f;
 
-	file_list_lock();
-	list_for_each_entry(f, &sb->s_files, f_u.fu_list) {
+	file_sb_list_lock_all();
+	do_file_list_for_each_entry(sb, f) {
 		if (S_ISREG(f->f_dentry->d_inode->i_mode) && file_count(f))
 			f->f_mode &= ~FMODE_WRITE;
-	}
-	file_list_unlock();
+	} while_file_list_for_each_entry;
+	file_sb_list_unlock_all();
 }
 
 /**
@@ -559,7 +576,7 @@ int do_remount_sb(struct super_block *sb, int flags, void *data, int force)
 	return 0;
 }
 
-static void do_emergency_remount(unsigned long foo)
+static void do_emergency_remount(void *unused)
 {
 	struct super_block *sb;
 
@@ -585,9 +602,11 @@ static void do_emergency_remount(unsigned long foo)
 	printk("Emergency Remount complete\n");
 }
 
+static DECLARE_WORK(emergency_remount_work, do_emergency_remount, NULL);
+
 void emergency_remount(void)
 {
-	pdflush_operation(do_emergency_remount, 0);
+	schedule_work(&emergency_remount_work);
 }
 
 /*
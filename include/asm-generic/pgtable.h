@@ -239,6 +239,28 @@ static inline int pmd_none_or_clear_bad(pmd_t *pmd)
 	}
 	return 0;
 }
+
+#ifndef __HAVE_ARCH_PMD_TRANS_HUGE
+#define pmd_trans_huge(pmd)	0
+#endif
+
+/*
+ * For walkers which may race with a fault installing a huge pmd
+ * (see mm/huge_memory.c): the pmd is read only once, so that a huge
+ * pmd appearing under us is skipped rather than cleared as bad.
+ */
+static inline int pmd_none_or_trans_huge_or_clear_bad(pmd_t *pmd)
+{
+	pmd_t pmdval = *pmd;
+
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval))
+		return 1;
+	if (unlikely(pmd_bad(pmdval))) {
+		pmd_clear_bad(pmd);
+		return 1;
+	}
+	return 0;
+}
 #endif /* !__ASSEMBLY__ */
 
 #endif /* _ASM_GENERIC_PGTABLE_H */
@@ -121,6 +121,7 @@ extern void nmi_watchdog_tick (struct pt_regs * regs);
 extern int APIC_init_uniprocessor (void);
 extern void disable_APIC_timer(void);
 extern void enable_APIC_timer(void);
+extern unsigned int reprogram_APIC_timer(unsigned int ticks);
 
 extern void enable_NMI_through_LVT0 (void * dummy);
 
@@ -329,6 +329,16 @@ static inline pte_t pte_modify(pte_t pte, pgprot_t newprot)
 #define pmd_large(pmd) \
 ((pmd_val(pmd) & (_PAGE_PSE|_PAGE_PRESENT)) == (_PAGE_PSE|_PAGE_PRESENT))
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * A user pmd with _PAGE_PSE set maps a transparent huge page: like a
+ * hugetlb entry it then has the layout of a large pte.
+ */
+#define __HAVE_ARCH_PMD_TRANS_HUGE
+#define pmd_trans_huge(pmd)		(pmd_val(pmd) & _PAGE_PSE)
+#define has_transparent_hugepage()	cpu_has_pse
+#endif
+
 /*
  * the pgd page can be thought of an array like this: pgd_t[PTRS_PER_PGD]
  *
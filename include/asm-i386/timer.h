@@ -67,4 +67,13 @@ extern unsigned long calibrate_tsc_hpet(unsigned long *tsc_hpet_quotient_ptr);
 #ifdef CONFIG_X86_PM_TIMER
 extern struct init_timer_opts timer_pmtmr_init;
 #endif
+
+#ifdef CONFIG_NO_IDLE_HZ
+struct pt_regs;
+extern void stop_hz_timer(void);
+extern void start_hz_timer(struct pt_regs *regs, int irq);
+#else
+static inline void stop_hz_timer(void) { }
+#define start_hz_timer(regs, irq) do { } while (0)
+#endif
 #endif
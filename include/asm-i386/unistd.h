@@ -315,8 +315,13 @@
 #define __NR_faccessat		307
 #define __NR_pselect6		308
 #define __NR_ppoll		309
+#define __NR_io_ring_setup	310
+#define __NR_io_ring_enter	311
+#define __NR_splice		312
+#define __NR_tee		313
+#define __NR_vmsplice		314
 
-#define NR_syscalls 310
+#define NR_syscalls 315
 
 /*
  * user-visible error numbers are in the range -1 - -128: see
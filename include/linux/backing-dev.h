@@ -8,20 +8,42 @@
 #ifndef _LINUX_BACKING_DEV_H
 #define _LINUX_BACKING_DEV_H
 
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/percpu_counter.h>
 #include <asm/atomic.h>
+#include <asm/system.h>
+
+struct page;
+struct task_struct;
 
 /*
  * Bits in backing_dev_info.state
  */
 enum bdi_state {
-	BDI_pdflush,		/* A pdflush thread is working this device */
+	BDI_writeback_running,	/* The flusher thread is writing this device */
 	BDI_write_congested,	/* The write queue is getting full */
 	BDI_read_congested,	/* The read queue is getting full */
+	BDI_registered,		/* bdi_init() done, on bdi_list */
+	BDI_pending,		/* A flusher thread is being started */
 	BDI_unused,		/* Available bits start here */
 };
 
+/*
+ * Per-device page counts, kept in percpu_counters.  BDI_WRITTEN only
+ * ever goes up.
+ */
+enum bdi_stat_item {
+	BDI_RECLAIMABLE,	/* dirty and unstable pages */
+	BDI_WRITEBACK,		/* pages under writeback */
+	BDI_WRITTEN,		/* pages whose writeback has completed */
+	NR_BDI_STAT_ITEMS
+};
+
 typedef int (congested_fn)(void *, int);
 
+#define BDI_NAME_LEN	16
+
 struct backing_dev_info {
 	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
 	unsigned long state;	/* Always use atomic bitops on this */
@@ -30,6 +52,27 @@ struct backing_dev_info {
 	void *congested_data;	/* Pointer to aux data for congested func */
 	void (*unplug_io_fn)(struct backing_dev_info *, struct page *);
 	void *unplug_io_data;
+
+	/*
+	 * Writeback state, set up by bdi_init().  b_dirty and b_io are
+	 * protected by inode_lock; bdi_list and task by bdi_lock.
+	 */
+	char name[BDI_NAME_LEN];	/* flusher thread is "flush-<name>" */
+	struct list_head bdi_list;	/* on bdi_list */
+	struct list_head b_dirty;	/* dirty inodes, newest first */
+	struct list_head b_io;		/* parked for writeback */
+	struct task_struct *task;	/* the flusher thread, or NULL */
+	long wb_pages;			/* pages asked of the flusher */
+	struct percpu_counter bdi_stat[NR_BDI_STAT_ITEMS];
+
+	/*
+	 * Recent writeback completions, which decide this device's share of
+	 * the dirty limit.  See bdi_writeout_inc() in mm/page-writeback.c.
+	 */
+	struct percpu_counter completions;
+	unsigned long completions_period; /* period completions was aged to */
+	spinlock_t completions_lock;	/* protects the aging */
+	int dirty_exceeded;		/* over its dirty limit, check often */
 };
 
 
@@ -61,9 +104,67 @@ struct backing_dev_info {
 extern struct backing_dev_info default_backing_dev_info;
 void default_unplug_io_fn(struct backing_dev_info *bdi, struct page *page);
 
-int writeback_acquire(struct backing_dev_info *bdi);
-int writeback_in_progress(struct backing_dev_info *bdi);
-void writeback_release(struct backing_dev_info *bdi);
+/*
+ * mm/backing-dev.c
+ */
+extern spinlock_t bdi_lock;
+extern struct list_head bdi_list;
+
+void bdi_init(struct backing_dev_info *bdi);
+void bdi_destroy(struct backing_dev_info *bdi);
+void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages);
+void bdi_wakeup_all(void);
+void bdi_laptop_flush(void);
+
+static inline int bdi_registered(struct backing_dev_info *bdi)
+{
+	return test_bit(BDI_registered, &bdi->state);
+}
+
+static inline int writeback_in_progress(struct backing_dev_info *bdi)
+{
+	return test_bit(BDI_writeback_running, &bdi->state);
+}
+
+/*
+ * The counters are updated from I/O completion, so every update runs
+ * with interrupts off.  Devices which never called bdi_init() are not
+ * counted.
+ */
+static inline void add_bdi_stat(struct backing_dev_info *bdi,
+				enum bdi_stat_item item, long amount)
+{
+	unsigned long flags;
+
+	if (!bdi_registered(bdi))
+		return;
+	local_irq_save(flags);
+	percpu_counter_mod(&bdi->bdi_stat[item], amount);
+	local_irq_restore(flags);
+}
+
+static inline void inc_bdi_stat(struct backing_dev_info *bdi,
+				enum bdi_stat_item item)
+{
+	add_bdi_stat(bdi, item, 1);
+}
+
+static inline void dec_bdi_stat(struct backing_dev_info *bdi,
+				enum bdi_stat_item item)
+{
+	add_bdi_stat(bdi, item, -1);
+}
+
+static inline unsigned long bdi_stat(struct backing_dev_info *bdi,
+				     enum bdi_stat_item item)
+{
+	long ret;
+
+	if (!bdi_registered(bdi))
+		return 0;
+	ret = percpu_counter_read(&bdi->bdi_stat[item]);
+	return ret > 0 ? ret : 0;
+}
 
 static inline int bdi_congested(struct backing_dev_info *bdi, int bdi_bits)
 {
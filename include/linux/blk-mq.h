@@ -0,0 +1,128 @@
+#ifndef _LINUX_BLK_MQ_H
+#define _LINUX_BLK_MQ_H
+
+/*
+ * Multi-queue block layer, see block/blk-mq.c and
+ * Documentation/block/blk-mq.txt
+ */
+
+#include <linux/blkdev.h>
+#include <linux/cpumask.h>
+
+/*
+ * Per-cpu software submission queue.  Requests are queued here by the
+ * submitting cpu and moved to the driver by the hardware queue the cpu
+ * is mapped to.
+ */
+struct blk_mq_ctx {
+	spinlock_t		lock;
+	struct list_head	rq_list;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* index in hctx->ctxs */
+
+	struct request_queue	*queue;
+} ____cacheline_aligned_in_smp;
+
+/*
+ * One hardware dispatch queue.  Each carries its own tag space: a tag
+ * is the index of a preallocated request, so the driver can find the
+ * request again from the tag the hardware completes.
+ */
+struct blk_mq_hw_ctx {
+	spinlock_t		lock;		/* protects dispatch */
+	struct list_head	dispatch;	/* requests the driver bounced */
+	unsigned long		state;		/* BLK_MQ_S_* */
+
+	struct work_struct	run_work;
+	cpumask_t		cpumask;	/* cpus mapped to this queue */
+
+	void			*driver_data;
+	struct request_queue	*queue;
+	unsigned int		queue_num;
+
+	unsigned int		nr_ctx;
+	struct blk_mq_ctx	**ctxs;
+	unsigned long		*ctx_map;	/* ctxs with queued requests */
+
+	unsigned int		queue_depth;
+	unsigned long		*tag_map;
+	struct request		**rqs;		/* indexed by tag */
+	wait_queue_head_t	tag_wait;
+};
+
+typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, struct request *);
+typedef struct blk_mq_hw_ctx *(map_queue_fn)(struct request_queue *, const int);
+typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
+typedef void (exit_hctx_fn)(struct blk_mq_hw_ctx *, unsigned int);
+
+struct blk_mq_ops {
+	/*
+	 * Start a request on the hardware, returns BLK_MQ_RQ_QUEUE_*.
+	 * May be called on several cpus at once for the same hctx.
+	 */
+	queue_rq_fn		*queue_rq;
+
+	/*
+	 * cpu to hardware queue mapping, usually blk_mq_map_queue()
+	 */
+	map_queue_fn		*map_queue;
+
+	/*
+	 * Called in BLOCK_SOFTIRQ for requests passed to
+	 * blk_mq_complete_request(), should end them with blk_mq_end_io()
+	 */
+	softirq_done_fn		*complete;
+
+	init_hctx_fn		*init_hctx;
+	exit_hctx_fn		*exit_hctx;
+};
+
+struct blk_mq_reg {
+	struct blk_mq_ops	*ops;
+	unsigned int		nr_hw_queues;
+	unsigned int		queue_depth;	/* tags per hardware queue */
+	unsigned int		cmd_size;	/* driver data after each request */
+	int			numa_node;
+};
+
+enum {
+	BLK_MQ_RQ_QUEUE_OK	= 0,	/* queued to the hardware */
+	BLK_MQ_RQ_QUEUE_BUSY	= 1,	/* try again later */
+	BLK_MQ_RQ_QUEUE_ERROR	= 2,	/* end the request with an error */
+
+	BLK_MQ_S_STOPPED	= 0,
+
+	BLK_MQ_MAX_DEPTH	= 2048,
+};
+
+request_queue_t *blk_mq_init_queue(struct blk_mq_reg *, void *);
+struct blk_mq_hw_ctx *blk_mq_map_queue(request_queue_t *, const int);
+
+void blk_mq_end_io(struct request *, int);
+void blk_mq_complete_request(struct request *);
+
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *, int);
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *);
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *);
+void blk_mq_start_stopped_hw_queues(request_queue_t *, int);
+
+static inline struct request *blk_mq_tag_to_rq(struct blk_mq_hw_ctx *hctx,
+					       unsigned int tag)
+{
+	return hctx->rqs[tag];
+}
+
+/*
+ * The driver's per-request data, reg->cmd_size bytes
+ */
+static inline void *blk_mq_rq_to_pdu(struct request *rq)
+{
+	return (void *) (rq + 1);
+}
+
+#define queue_for_each_hw_ctx(q, hctx, i)				\
+	for ((i) = 0; (i) < (q)->nr_hw_queues &&			\
+	     ({ hctx = (q)->queue_hw_ctx[i]; 1; }); (i)++)
+
+#endif
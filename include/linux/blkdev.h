@@ -22,6 +22,9 @@ typedef struct request_queue request_queue_t;
 struct elevator_queue;
 typedef struct elevator_queue elevator_t;
 struct request_pm_state;
+struct blk_mq_ops;
+struct blk_mq_ctx;
+struct blk_mq_hw_ctx;
 
 #define BLKDEV_MIN_RQ	4
 #define BLKDEV_MAX_RQ	128	/* Default maximum */
@@ -197,6 +200,11 @@ struct request {
 	 */
 	rq_end_io_fn *end_io;
 	void *end_io_data;
+
+	/*
+	 * software queue this request was submitted on, for blk-mq queues
+	 */
+	struct blk_mq_ctx *mq_ctx;
 };
 
 /*
@@ -424,6 +432,16 @@ struct request_queue
 	struct request		pre_flush_rq, bar_rq, post_flush_rq;
 	struct request		*orig_bar_rq;
 	unsigned int		bi_size;
+
+	/*
+	 * multi-queue mode, see block/blk-mq.c.  Only set for queues
+	 * created with blk_mq_init_queue().
+	 */
+	struct blk_mq_ops	*mq_ops;
+	unsigned int		*mq_map;	/* cpu -> hardware queue */
+	struct blk_mq_ctx	*queue_ctx;	/* per-cpu software queues */
+	struct blk_mq_hw_ctx	**queue_hw_ctx;
+	unsigned int		nr_hw_queues;
 };
 
 #define RQ_INACTIVE		(-1)
@@ -0,0 +1,91 @@
+/*
+ *  include/linux/clockchips.h
+ *
+ *  Clock event devices: timer hardware which can be programmed to
+ *  raise an interrupt at a given time, used by the high-resolution
+ *  mode of hrtimers (CONFIG_HIGH_RES_TIMERS).
+ *
+ *  For licencing details see kernel-base/COPYING
+ */
+#ifndef _LINUX_CLOCKCHIPS_H
+#define _LINUX_CLOCKCHIPS_H
+
+#include <linux/config.h>
+
+#ifdef CONFIG_HIGH_RES_TIMERS
+
+#include <linux/ktime.h>
+
+struct pt_regs;
+struct clock_event_device;
+
+/* Clock event mode commands */
+enum clock_event_mode {
+	CLOCK_EVT_MODE_UNUSED = 0,
+	CLOCK_EVT_MODE_SHUTDOWN,
+	CLOCK_EVT_MODE_PERIODIC,
+	CLOCK_EVT_MODE_ONESHOT,
+};
+
+/* Clock event features */
+#define CLOCK_EVT_FEAT_PERIODIC		0x01
+#define CLOCK_EVT_FEAT_ONESHOT		0x02
+
+/**
+ * struct clock_event_device - clock event device descriptor
+ *
+ * @name:		name of the device
+ * @features:		CLOCK_EVT_FEAT_* flags
+ * @max_delta_ns:	maximum delta value in ns
+ * @min_delta_ns:	minimum delta value in ns
+ * @mult:		nanosecond to cycles multiplier
+ * @shift:		nanoseconds to cycles divisor (power of two)
+ * @rating:		the higher the better, when a cpu has several devices
+ * @set_next_event:	program the next event in oneshot mode, @evt device
+ *			cycles from now; returns 0 on success
+ * @set_mode:		switch between periodic and oneshot mode
+ * @event_handler:	called from the interrupt of the device. The
+ *			architecture sets up its periodic tick handler,
+ *			which the high-resolution mode replaces and then
+ *			calls from its tick emulation.
+ * @mode:		current mode
+ * @next_event:		time of the programmed event (CLOCK_MONOTONIC)
+ */
+struct clock_event_device {
+	const char		*name;
+	unsigned int		features;
+	unsigned long		max_delta_ns;
+	unsigned long		min_delta_ns;
+	unsigned long		mult;
+	int			shift;
+	int			rating;
+	int			(*set_next_event)(unsigned long evt,
+						  struct clock_event_device *);
+	void			(*set_mode)(enum clock_event_mode mode,
+					    struct clock_event_device *);
+	void			(*event_handler)(struct pt_regs *regs);
+	enum clock_event_mode	mode;
+	ktime_t			next_event;
+};
+
+/*
+ * Calculate a multiplication factor for scaled math, which is used to
+ * convert nanoseconds based values to clock ticks:
+ *
+ * clock_ticks = (nanoseconds * factor) >> shift.
+ */
+extern unsigned long div_sc(unsigned long ticks, unsigned long nsec,
+			    int shift);
+extern unsigned long clockevent_delta2ns(unsigned long latch,
+					 struct clock_event_device *evt);
+
+extern void clockevents_register_device(struct clock_event_device *dev);
+extern struct clock_event_device *clockevents_get_local_device(void);
+extern void clockevents_set_mode(struct clock_event_device *dev,
+				 enum clock_event_mode mode);
+extern int clockevents_program_event(struct clock_event_device *dev,
+				     ktime_t expires, ktime_t now);
+
+#endif /* CONFIG_HIGH_RES_TIMERS */
+
+#endif /* _LINUX_CLOCKCHIPS_H */
@@ -0,0 +1,127 @@
+/*
+ *  linux/include/linux/ext3_extents.h
+ *
+ * On-disk format of extent-mapped ext3 files.
+ *
+ * A file with EXT3_EXTENTS_FL set maps its blocks with a tree of extents
+ * rooted in i_block[] instead of with direct and indirect block pointers.
+ * Every node, the root in the inode as well as the tree blocks, starts
+ * with an ext3_extent_header.  Leaves (eh_depth == 0) then hold
+ * ext3_extents sorted by logical block; index nodes hold ext3_extent_idxs,
+ * each pointing at the node which covers logical blocks from ei_block on.
+ *
+ * The layout is the one ext4 uses, so the _hi fields are kept for 48-bit
+ * block numbers although ext3 only has 32 bits and always stores zero.
+ */
+
+#ifndef _LINUX_EXT3_EXTENTS
+#define _LINUX_EXT3_EXTENTS
+
+#include <linux/types.h>
+
+struct ext3_extent {
+	__le32	ee_block;	/* first logical block extent covers */
+	__le16	ee_len;		/* number of blocks covered by extent */
+	__le16	ee_start_hi;	/* high 16 bits of physical block */
+	__le32	ee_start;	/* low 32 bits of physical block */
+};
+
+struct ext3_extent_idx {
+	__le32	ei_block;	/* index covers logical blocks from 'block' */
+	__le32	ei_leaf;	/* pointer to the physical block of the next
+				 * level. leaf or next index could be there */
+	__le16	ei_leaf_hi;	/* high 16 bits of physical block */
+	__u16	ei_unused;
+};
+
+struct ext3_extent_header {
+	__le16	eh_magic;	/* probably will support different formats */
+	__le16	eh_entries;	/* number of valid entries */
+	__le16	eh_max;		/* capacity of store in entries */
+	__le16	eh_depth;	/* has tree real underlying blocks? */
+	__le32	eh_generation;	/* generation of the tree */
+};
+
+#define EXT3_EXT_MAGIC		0xf30a
+
+/*
+ * The longest extent.  ee_len is 16 bits but ext4 keeps the top bit for
+ * uninitialized extents, so stick to what both can read.
+ */
+#define EXT3_EXT_MAX_LEN	32768
+
+/* Deepest tree we accept: five levels map far more than 2^32 blocks */
+#define EXT3_EXT_MAX_DEPTH	5
+
+#define EXT_FIRST_EXTENT(__hdr__) \
+	((struct ext3_extent *) (((char *) (__hdr__)) +		\
+				 sizeof(struct ext3_extent_header)))
+#define EXT_FIRST_INDEX(__hdr__) \
+	((struct ext3_extent_idx *) (((char *) (__hdr__)) +	\
+				     sizeof(struct ext3_extent_header)))
+#define EXT_LAST_EXTENT(__hdr__) \
+	(EXT_FIRST_EXTENT((__hdr__)) + le16_to_cpu((__hdr__)->eh_entries) - 1)
+#define EXT_LAST_INDEX(__hdr__) \
+	(EXT_FIRST_INDEX((__hdr__)) + le16_to_cpu((__hdr__)->eh_entries) - 1)
+#define EXT_MAX_EXTENT(__hdr__) \
+	(EXT_FIRST_EXTENT((__hdr__)) + le16_to_cpu((__hdr__)->eh_max) - 1)
+#define EXT_MAX_INDEX(__hdr__) \
+	(EXT_FIRST_INDEX((__hdr__)) + le16_to_cpu((__hdr__)->eh_max) - 1)
+
+#ifdef __KERNEL__
+
+/*
+ * One level of a lookup: the node's buffer (NULL for the root in the
+ * inode), its header, and the entry the lookup went through.
+ */
+struct ext3_ext_path {
+	unsigned long			p_block;
+	__u16				p_depth;
+	struct ext3_extent		*p_ext;
+	struct ext3_extent_idx		*p_idx;
+	struct ext3_extent_header	*p_hdr;
+	struct buffer_head		*p_bh;
+};
+
+static inline struct ext3_extent_header *ext_inode_hdr(struct inode *inode)
+{
+	return (struct ext3_extent_header *) EXT3_I(inode)->i_data;
+}
+
+static inline struct ext3_extent_header *ext_block_hdr(struct buffer_head *bh)
+{
+	return (struct ext3_extent_header *) bh->b_data;
+}
+
+static inline unsigned short ext_depth(struct inode *inode)
+{
+	return le16_to_cpu(ext_inode_hdr(inode)->eh_depth);
+}
+
+static inline unsigned long ext_pblock(struct ext3_extent *ex)
+{
+	return le32_to_cpu(ex->ee_start);
+}
+
+static inline unsigned long idx_pblock(struct ext3_extent_idx *ix)
+{
+	return le32_to_cpu(ix->ei_leaf);
+}
+
+static inline void ext3_ext_store_pblock(struct ext3_extent *ex,
+					 unsigned long pb)
+{
+	ex->ee_start = cpu_to_le32(pb);
+	ex->ee_start_hi = 0;
+}
+
+static inline void ext3_idx_store_pblock(struct ext3_extent_idx *ix,
+					 unsigned long pb)
+{
+	ix->ei_leaf = cpu_to_le32(pb);
+	ix->ei_leaf_hi = 0;
+}
+
+#endif	/* __KERNEL__ */
+
+#endif	/* _LINUX_EXT3_EXTENTS */
@@ -20,6 +20,8 @@
 #include <linux/rbtree.h>
 #include <linux/seqlock.h>
 
+struct ext3_dx_cache;
+
 struct ext3_reserve_window {
 	__u32			_rsv_start;	/* First byte reserved */
 	__u32			_rsv_end;	/* Last byte reserved or 0 */
@@ -84,6 +86,15 @@ struct ext3_inode_info {
 	struct ext3_block_alloc_info *i_block_alloc_info;
 
 	__u32	i_dir_start_lookup;
+
+	/*
+	 * The leaf blocks of an htree directory which recent lookups ended
+	 * in, indexed by hash so that the next lookup of a nearby name need
+	 * not walk the index.  NULL until the first indexed lookup.
+	 * i_dx_gen counts the times it was dropped.  [i_lock]
+	 */
+	struct ext3_dx_cache *i_dx_cache;
+	unsigned int i_dx_gen;
 #ifdef CONFIG_EXT3_FS_XATTR
 	/*
 	 * Extended attributes can be read independently of the main file
@@ -132,6 +143,17 @@ struct ext3_inode_info {
 	 * by other means, so we have truncate_sem.
 	 */
 	struct semaphore truncate_sem;
+
+	/*
+	 * The extent last looked up or allocated in an extent-mapped file,
+	 * so that sequential get_block calls need not walk the tree.
+	 * i_cached_len == 0 means nothing is cached.
+	 */
+	spinlock_t i_cached_lock;
+	__u32	i_cached_block;		/* first logical block */
+	__u32	i_cached_len;
+	__u32	i_cached_start;		/* first physical block */
+
 	struct inode vfs_inode;
 };
 
@@ -57,6 +57,7 @@ struct ext3_sb_info {
 	struct percpu_counter s_freeblocks_counter;
 	struct percpu_counter s_freeinodes_counter;
 	struct percpu_counter s_dirs_counter;
+	struct percpu_counter s_dirtyblocks_counter;	/* delalloc reserved */
 	struct blockgroup_lock s_blockgroup_lock;
 
 	/* root of the per fs reservation window tree */
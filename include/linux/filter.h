@@ -9,6 +9,8 @@
 #include <linux/types.h>
 
 #ifdef __KERNEL__
+#include <linux/config.h>
+#include <linux/linkage.h>
 #include <asm/atomic.h>
 #endif
 
@@ -38,10 +40,15 @@ struct sock_fprog	/* Required for SO_ATTACH_FILTER. */
 };
 
 #ifdef __KERNEL__
+struct sk_buff;
+
 struct sk_filter
 {
 	atomic_t		refcnt;
         unsigned int         	len;	/* Number of filter blocks */
+	unsigned int		(*bpf_func)(struct sk_buff *skb,
+					    struct sock_filter *filter,
+					    int flen);
         struct sock_filter     	insns[0];
 };
 
@@ -140,12 +147,33 @@ static inline unsigned int sk_filter_len(struct sk_filter *fp)
 #define SKF_LL_OFF    (-0x200000)
 
 #ifdef __KERNEL__
-struct sk_buff;
 struct sock;
 
 extern unsigned int sk_run_filter(struct sk_buff *skb, struct sock_filter *filter, int flen);
 extern int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk);
 extern int sk_chk_filter(struct sock_filter *filter, int flen);
+
+/*
+ * Run an attached filter: the interpreter, or the code bpf_jit_compile()
+ * made of it.
+ */
+#define SK_RUN_FILTER(FILTER, SKB) \
+	(*(FILTER)->bpf_func)(SKB, (FILTER)->insns, (FILTER)->len)
+
+#ifdef CONFIG_BPF_JIT
+extern int bpf_jit_enable;
+extern asmlinkage int bpf_jit_load(struct sk_buff *skb, int k,
+				   unsigned int size, u32 *res);
+extern void bpf_jit_compile(struct sk_filter *fp);
+extern void bpf_jit_free(struct sk_filter *fp);
+#else
+static inline void bpf_jit_compile(struct sk_filter *fp)
+{
+}
+static inline void bpf_jit_free(struct sk_filter *fp)
+{
+}
+#endif
 #endif /* __KERNEL__ */
 
 #endif /* __LINUX_FILTER_H__ */
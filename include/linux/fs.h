@@ -461,6 +461,7 @@ static inline int mapping_writably_mapped(struct address_space *mapping)
 
 struct inode {
 	struct hlist_node	i_hash;
+	struct hlist_head	*i_hash_head;	/* chain i_hash is on */
 	struct list_head	i_list;
 	struct list_head	i_sb_list;
 	struct list_head	i_dentry;
@@ -599,19 +600,17 @@ struct fown_struct {
  * Track a single file's readahead state
  */
 struct file_ra_state {
-	unsigned long start;		/* Current window */
-	unsigned long size;
-	unsigned long flags;		/* ra flags RA_FLAG_xxx*/
-	unsigned long cache_hit;	/* cache hit count*/
-	unsigned long prev_page;	/* Cache last read() position */
-	unsigned long ahead_start;	/* Ahead window */
-	unsigned long ahead_size;
+	pgoff_t start;			/* Where the last readahead started */
+	unsigned long size;		/* # of pages it read */
+	unsigned long async_size;	/* Read ahead again when only this
+					   many of them are left ahead */
+	unsigned long flags;		/* ra flags RA_FLAG_xxx */
+	unsigned long prev_index;	/* Cache last read() position */
 	unsigned long ra_pages;		/* Maximum readahead window */
 	unsigned long mmap_hit;		/* Cache hit stat for mmap accesses */
 	unsigned long mmap_miss;	/* Cache miss stat for mmap accesses */
 };
-#define RA_FLAG_MISS 0x01	/* a cache miss occured against this file */
-#define RA_FLAG_INCACHE 0x02	/* file is already in cache */
+#define RA_FLAG_BACKWARD 0x01	/* the last readahead went backward */
 
 struct file {
 	/*
@@ -622,6 +621,9 @@ struct file {
 		struct list_head	fu_list;
 		struct rcu_head 	fu_rcuhead;
 	} f_u;
+#ifdef CONFIG_SMP
+	int			f_sb_list_cpu;	/* which sb->s_files list */
+#endif
 	struct dentry		*f_dentry;
 	struct vfsmount         *f_vfsmnt;
 	struct file_operations	*f_op;
@@ -650,6 +652,34 @@ extern spinlock_t files_lock;
 #define file_list_lock() spin_lock(&files_lock);
 #define file_list_unlock() spin_unlock(&files_lock);
 
+/*
+ * sb->s_files is split per CPU on SMP.  Walkers must hold
+ * file_sb_list_lock_all() and iterate with the helpers below.
+ */
+extern void file_sb_list_lock_all(void);
+extern void file_sb_list_unlock_all(void);
+
+#ifdef CONFIG_SMP
+#define do_file_list_for_each_entry(__sb, __file)			\
+{									\
+	int __cpu;							\
+	for_each_cpu(__cpu) {						\
+		struct list_head *__list;				\
+		__list = per_cpu_ptr((__sb)->s_files, __cpu);		\
+		list_for_each_entry((__file), __list, f_u.fu_list)
+
+#define while_file_list_for_each_entry					\
+	}								\
+}
+#else
+#define do_file_list_for_each_entry(__sb, __file)			\
+{									\
+	list_for_each_entry((__file), &(__sb)->s_files, f_u.fu_list)
+
+#define while_file_list_for_each_entry					\
+}
+#endif
+
 #define get_file(x)	atomic_inc(&(x)->f_count)
 #define file_count(x)	atomic_read(&(x)->f_count)
 
@@ -825,11 +855,14 @@ struct super_block {
 	void                    *s_security;
 	struct xattr_handler	**s_xattr;
 
+	spinlock_t		s_inodes_lock;	/* protects s_inodes */
 	struct list_head	s_inodes;	/* all inodes */
-	struct list_head	s_dirty;	/* dirty inodes */
-	struct list_head	s_io;		/* parked for writeback */
 	struct hlist_head	s_anon;		/* anonymous dentries for (nfs) exporting */
+#ifdef CONFIG_SMP
+	struct list_head	*s_files;	/* per-cpu, see file_table.c */
+#else
 	struct list_head	s_files;
+#endif
 
 	struct block_device	*s_bdev;
 	struct list_head	s_instances;
@@ -1019,6 +1052,8 @@ struct file_operations {
 	ssize_t (*writev) (struct file *, const struct iovec *, unsigned long, loff_t *);
 	ssize_t (*sendfile) (struct file *, loff_t *, size_t, read_actor_t, void *);
 	ssize_t (*sendpage) (struct file *, struct page *, int, size_t, loff_t *, int);
+	ssize_t (*splice_read) (struct file *, loff_t *, struct pipe_inode_info *, size_t, unsigned int);
+	ssize_t (*splice_write) (struct pipe_inode_info *, struct file *, loff_t *, size_t, unsigned int);
 	unsigned long (*get_unmapped_area)(struct file *, unsigned long, unsigned long, unsigned long, unsigned long);
 	int (*check_flags)(int);
 	int (*dir_notify)(struct file *filp, unsigned long arg);
@@ -1058,6 +1093,7 @@ extern ssize_t vfs_readv(struct file *, const struct iovec __user *,
 		unsigned long, loff_t *);
 extern ssize_t vfs_writev(struct file *, const struct iovec __user *,
 		unsigned long, loff_t *);
+extern long vfs_fsync(struct file *, int);
 
 /*
  * NOTE: write_inode, delete_inode, clear_inode, put_inode can be called
@@ -1547,6 +1583,8 @@ static inline void insert_inode_hash(struct inode *inode) {
 extern struct file * get_empty_filp(void);
 extern void file_move(struct file *f, struct list_head *list);
 extern void file_kill(struct file *f);
+extern void file_sb_list_add(struct file *f, struct super_block *sb);
+extern void file_sb_list_del(struct file *f);
 struct bio;
 extern void submit_bio(int, struct bio *);
 extern int bdev_read_only(struct block_device *);
@@ -1575,6 +1613,14 @@ extern ssize_t do_sync_write(struct file *filp, const char __user *buf, size_t l
 ssize_t generic_file_write_nolock(struct file *file, const struct iovec *iov,
 				unsigned long nr_segs, loff_t *ppos);
 extern ssize_t generic_file_sendfile(struct file *, loff_t *, size_t, read_actor_t, void *);
+extern ssize_t generic_file_splice_read(struct file *, loff_t *,
+		struct pipe_inode_info *, size_t, unsigned int);
+extern ssize_t generic_file_splice_write(struct pipe_inode_info *,
+		struct file *, loff_t *, size_t, unsigned int);
+extern ssize_t generic_splice_sendpage(struct pipe_inode_info *,
+		struct file *, loff_t *, size_t, unsigned int);
+extern long do_splice_direct(struct file *, loff_t *, struct file *,
+		size_t, unsigned int);
 extern void do_generic_mapping_read(struct address_space *mapping,
 				    struct file_ra_state *, struct file *,
 				    loff_t *, read_descriptor_t *, read_actor_t);
@@ -91,6 +91,19 @@ struct hrtimer_base {
 	struct hrtimer		*curr_timer;
 };
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+struct pt_regs;
+
+/*
+ * In high-resolution mode the clock event devices are programmed for
+ * the first expiring timer; clock_was_set() reprograms them after the
+ * realtime clock was set.
+ */
+extern void clock_was_set(void);
+extern void hrtimer_interrupt(struct pt_regs *regs);
+extern int hrtimer_stop_sched_tick(unsigned long ticks);
+extern int hrtimer_restart_sched_tick(void);
+#else
 /*
  * clock_was_set() is a NOP for non- high-resolution systems. The
  * time-sorted order guarantees that a timer does not expire early and
@@ -98,6 +111,17 @@ struct hrtimer_base {
  */
 #define clock_was_set()		do { } while (0)
 
+static inline int hrtimer_stop_sched_tick(unsigned long ticks)
+{
+	return 0;
+}
+
+static inline int hrtimer_restart_sched_tick(void)
+{
+	return 0;
+}
+#endif
+
 /* Exported timer functions: */
 
 /* Initialize timers: */
@@ -116,6 +140,10 @@ extern int hrtimer_try_to_cancel(struct hrtimer *timer);
 extern ktime_t hrtimer_get_remaining(const struct hrtimer *timer);
 extern int hrtimer_get_res(const clockid_t which_clock, struct timespec *tp);
 
+#ifdef CONFIG_NO_IDLE_HZ
+extern ktime_t hrtimer_get_next_event(void);
+#endif
+
 static inline int hrtimer_active(const struct hrtimer *timer)
 {
 	return timer->state == HRTIMER_PENDING;
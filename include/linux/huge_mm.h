@@ -0,0 +1,88 @@
+#ifndef _LINUX_HUGE_MM_H
+#define _LINUX_HUGE_MM_H
+
+/*
+ * Transparent huge pages: anonymous memory mapped by a single pmd,
+ * see mm/huge_memory.c and Documentation/vm/transhuge.txt.
+ */
+
+#include <linux/config.h>
+
+struct mmu_gather;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+
+#define HPAGE_PMD_SHIFT	PMD_SHIFT
+#define HPAGE_PMD_SIZE	(1UL << HPAGE_PMD_SHIFT)
+#define HPAGE_PMD_MASK	(~(HPAGE_PMD_SIZE - 1))
+#define HPAGE_PMD_ORDER	(HPAGE_PMD_SHIFT - PAGE_SHIFT)
+#define HPAGE_PMD_NR	(1 << HPAGE_PMD_ORDER)
+
+extern int transparent_hugepage_enabled;
+extern int khugepaged_pages_to_scan;
+extern int khugepaged_scan_sleep_millisecs;
+
+/*
+ * Only valid on a head page, which is all the LRU and rmap ever see:
+ * hugetlbfs and slab compound pages are never anonymous.
+ */
+static inline int PageTransHuge(struct page *page)
+{
+	return PageCompound(page) &&
+		page_private(page) == (unsigned long)page && PageAnon(page);
+}
+
+static inline int hpage_nr_pages(struct page *page)
+{
+	if (unlikely(PageTransHuge(page)))
+		return HPAGE_PMD_NR;
+	return 1;
+}
+
+extern int transparent_hugepage_vma(struct vm_area_struct *vma,
+				    unsigned long address);
+extern void khugepaged_exit(struct mm_struct *mm);
+
+#define split_huge_page_pmd(__mm, __pmd)				\
+	do {								\
+		if (unlikely(pmd_trans_huge(*(__pmd))))			\
+			__split_huge_page_pmd(__mm, __pmd);		\
+	} while (0)
+
+#else /* !CONFIG_TRANSPARENT_HUGEPAGE */
+
+#define HPAGE_PMD_SIZE	({ BUG(); 0; })
+
+#define PageTransHuge(page)		0
+#define hpage_nr_pages(page)		1
+
+#define transparent_hugepage_vma(vma, address)	0
+static inline void khugepaged_exit(struct mm_struct *mm)
+{
+}
+
+#define split_huge_page_pmd(__mm, __pmd)	do { } while (0)
+
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+/*
+ * The callers below are all guarded by one of the tests above, which
+ * are constant 0 without CONFIG_TRANSPARENT_HUGEPAGE.
+ */
+extern int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+				      struct vm_area_struct *vma,
+				      unsigned long address, pmd_t *pmd);
+extern int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+			pmd_t *pmd, unsigned long addr);
+extern struct page *follow_trans_huge_pmd(struct mm_struct *mm,
+					  unsigned long address, pmd_t *pmd,
+					  unsigned int flags);
+extern pmd_t *page_check_address_pmd(struct page *page,
+				     struct mm_struct *mm,
+				     unsigned long address);
+extern int pmdp_clear_flush_young(struct vm_area_struct *vma,
+				  unsigned long address, pmd_t *pmd);
+extern int split_huge_page(struct page *page);
+extern void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd);
+
+#endif /* _LINUX_HUGE_MM_H */
@@ -0,0 +1,108 @@
+#ifndef _LINUX_IO_RING_H
+#define _LINUX_IO_RING_H
+
+/*
+ * io_ring: submission and completion rings shared between user space
+ * and the kernel, see fs/io_ring.c and Documentation/io_ring.txt
+ */
+
+#include <linux/types.h>
+
+/*
+ * One submission queue entry, 64 bytes
+ */
+struct io_ring_sqe {
+	__u8	opcode;		/* IORING_OP_* */
+	__u8	flags;		/* reserved, must be 0 */
+	__u16	resv1;
+	__s32	fd;		/* file to operate on */
+	__u64	off;		/* file offset, ignored for streams */
+	__u64	addr;		/* iovec array or msghdr */
+	__u32	len;		/* number of iovecs */
+	union {
+		__u32	fsync_flags;	/* IORING_FSYNC_* */
+		__u32	poll_events;	/* POLLIN etc. */
+		__u32	msg_flags;	/* MSG_* */
+		__u32	op_flags;
+	};
+	__u64	user_data;	/* passed back in the completion */
+	__u64	resv2[3];
+};
+
+enum {
+	IORING_OP_NOP,
+	IORING_OP_READV,
+	IORING_OP_WRITEV,
+	IORING_OP_FSYNC,
+	IORING_OP_POLL_ADD,
+	IORING_OP_SENDMSG,
+	IORING_OP_RECVMSG,
+	IORING_OP_LAST,
+};
+
+#define IORING_FSYNC_DATASYNC	(1U << 0)
+
+/*
+ * One completion queue entry
+ */
+struct io_ring_cqe {
+	__u64	user_data;	/* sqe->user_data */
+	__s32	res;		/* result, as the syscall would return it */
+	__u32	flags;
+};
+
+/*
+ * mmap offsets of the three areas of a ring
+ */
+#define IORING_OFF_SQ_RING	0ULL
+#define IORING_OFF_CQ_RING	0x8000000ULL
+#define IORING_OFF_SQES		0x10000000ULL
+
+/*
+ * Where the fields of the rings are, relative to their mmap offset
+ */
+struct io_sqring_offsets {
+	__u32	head;
+	__u32	tail;
+	__u32	ring_mask;
+	__u32	ring_entries;
+	__u32	flags;
+	__u32	dropped;
+	__u32	array;
+	__u32	resv1;
+	__u64	resv2;
+};
+
+/* sq_ring->flags */
+#define IORING_SQ_NEED_WAKEUP	(1U << 0)	/* sq thread is asleep */
+
+struct io_cqring_offsets {
+	__u32	head;
+	__u32	tail;
+	__u32	ring_mask;
+	__u32	ring_entries;
+	__u32	overflow;
+	__u32	cqes;
+	__u64	resv[2];
+};
+
+/* io_ring_setup() flags */
+#define IORING_SETUP_SQPOLL	(1U << 0)	/* kernel thread polls the sq */
+#define IORING_SETUP_SQ_AFF	(1U << 1)	/* ... bound to sq_thread_cpu */
+
+/* io_ring_enter() flags */
+#define IORING_ENTER_GETEVENTS	(1U << 0)
+#define IORING_ENTER_SQ_WAKEUP	(1U << 1)
+
+struct io_ring_params {
+	__u32	sq_entries;		/* out */
+	__u32	cq_entries;		/* out */
+	__u32	flags;			/* in: IORING_SETUP_* */
+	__u32	sq_thread_cpu;		/* in */
+	__u32	sq_thread_idle;		/* in: msecs before it sleeps */
+	__u32	resv[5];
+	struct io_sqring_offsets sq_off;	/* out */
+	struct io_cqring_offsets cq_off;	/* out */
+};
+
+#endif /* _LINUX_IO_RING_H */
@@ -142,6 +142,33 @@ typedef struct journal_header_s
 } journal_header_t;
 
 
+/*
+ * Checksum types.
+ */
+#define JFS_CRC32_CHKSUM	1
+
+#define JFS_CRC32_CHKSUM_SIZE	4
+
+#define JFS_CHECKSUM_BYTES	(32 / sizeof(__u32))
+
+/*
+ * The commit block.  With JFS_FEATURE_COMPAT_CHECKSUM it carries a
+ * crc32 of each descriptor block of the transaction followed by the
+ * blocks it describes, in log order; revoke blocks are not covered.
+ * This is the same checksum, in the same place, as jbd2 writes with
+ * that feature, so e2fsck and jbd2 can check and replay the journal.
+ */
+struct commit_header
+{
+	__be32		h_magic;
+	__be32		h_blocktype;
+	__be32		h_sequence;
+	unsigned char	h_chksum_type;
+	unsigned char	h_chksum_size;
+	unsigned char	h_padding[2];
+	__be32		h_chksum[JFS_CHECKSUM_BYTES];
+};
+
 /* 
  * The block tag: used to describe a single buffer in the journal 
  */
@@ -227,17 +254,22 @@ typedef struct journal_superblock_s
 	((j)->j_format_version >= 2 &&					\
 	 ((j)->j_superblock->s_feature_incompat & cpu_to_be32((mask))))
 
+#define JFS_FEATURE_COMPAT_CHECKSUM	0x00000001
+
 #define JFS_FEATURE_INCOMPAT_REVOKE	0x00000001
+#define JFS_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 
 /* Features known to this kernel version: */
-#define JFS_KNOWN_COMPAT_FEATURES	0
+#define JFS_KNOWN_COMPAT_FEATURES	JFS_FEATURE_COMPAT_CHECKSUM
 #define JFS_KNOWN_ROCOMPAT_FEATURES	0
-#define JFS_KNOWN_INCOMPAT_FEATURES	JFS_FEATURE_INCOMPAT_REVOKE
+#define JFS_KNOWN_INCOMPAT_FEATURES	(JFS_FEATURE_INCOMPAT_REVOKE | \
+					 JFS_FEATURE_INCOMPAT_ASYNC_COMMIT)
 
 #ifdef __KERNEL__
 
 #include <linux/fs.h>
 #include <linux/sched.h>
+#include <linux/crc32.h>
 #include <asm/bug.h>
 
 #define JBD_ASSERTIONS
@@ -422,11 +454,12 @@ struct handle_s
  *    ->j_list_lock
  *
  *    j_state_lock
- *    ->t_handle_lock
- *
- *    j_state_lock
  *    ->j_list_lock			(journal_unmap_buffer)
  *
+ * Starting a handle takes j_state_lock only for as long as it takes to
+ * check the transaction state and count the handle in; stopping one takes
+ * no lock at all.  The per-handle counters of a transaction are atomic_t
+ * for that reason.
  */
 
 struct transaction_s 
@@ -523,21 +556,22 @@ struct transaction_s
 	struct journal_head	*t_log_list;
 
 	/*
-	 * Protects info related to handles
+	 * Number of outstanding updates running on this transaction.
+	 * Every handle changes it, so keep it clear of the fields above.
+	 * [no locking]
 	 */
-	spinlock_t		t_handle_lock;
+	atomic_t		t_updates ____cacheline_aligned_in_smp;
 
 	/*
-	 * Number of outstanding updates running on this transaction
-	 * [t_handle_lock]
+	 * Number of buffers reserved for use by all handles in this transaction
+	 * handle but not yet modified. [no locking]
 	 */
-	int			t_updates;
+	atomic_t		t_outstanding_credits;
 
 	/*
-	 * Number of buffers reserved for use by all handles in this transaction
-	 * handle but not yet modified. [t_handle_lock]
+	 * How many handles used this transaction? [no locking]
 	 */
-	int			t_outstanding_credits;
+	atomic_t		t_handle_count;
 
 	/*
 	 * Forward and backward links for the circular list of all transactions
@@ -552,12 +586,31 @@ struct transaction_s
 	unsigned long		t_expires;
 
 	/*
-	 * How many handles used this transaction? [t_handle_lock]
+	 * When the transaction was created, in jiffies, and the longest any
+	 * handle waited to join it. [j_state_lock]
 	 */
-	int t_handle_count;
+	unsigned long		t_start;
+	unsigned long		t_max_wait;
 
 };
 
+/*
+ * Totals over the transactions a journal has committed, reported in
+ * /proc/fs/jbd/<dev>/info.  Times are in jiffies.
+ */
+struct transaction_stats_s
+{
+	unsigned long		ts_tid;		/* transactions committed */
+	unsigned long		ts_wait;	/* longest handle wait */
+	unsigned long		ts_running;	/* open for new handles */
+	unsigned long		ts_locked;	/* waiting for handles to stop */
+	unsigned long		ts_flushing;	/* writing ordered data */
+	unsigned long		ts_logging;	/* writing to the log */
+	unsigned long		ts_handle_count;
+	unsigned long		ts_blocks;	/* metadata buffers */
+	unsigned long		ts_blocks_logged; /* all blocks written to log */
+};
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -619,6 +672,9 @@ struct transaction_s
  * @j_wbufsize: maximum number of buffer_heads allowed in j_wbuf, the
  *	number that will fit in j_blocksize
  * @j_private: An opaque pointer to fs-private information.
+ * @j_history_lock: Protect the transaction statistics
+ * @j_stats: Totals over the committed transactions
+ * @j_proc_entry: The journal's directory in /proc/fs/jbd
  */
 
 struct journal_s
@@ -640,9 +696,10 @@ struct journal_s
 	int			j_format_version;
 
 	/*
-	 * Protect the various scalars in the journal
+	 * Protect the various scalars in the journal.  Taken by every
+	 * handle start, so it gets a cacheline of its own.
 	 */
-	spinlock_t		j_state_lock;
+	spinlock_t		j_state_lock ____cacheline_aligned_in_smp;
 
 	/*
 	 * Number of processes waiting to create a barrier lock [j_state_lock]
@@ -739,7 +796,7 @@ struct journal_s
 	/*
 	 * Protects the buffer lists and internal buffer state.
 	 */
-	spinlock_t		j_list_lock;
+	spinlock_t		j_list_lock ____cacheline_aligned_in_smp;
 
 	/* Optional inode where we store the journal.  If present, all */
 	/* journal block numbers are mapped into this inode via */
@@ -797,7 +854,7 @@ struct journal_s
 	 * The revoke table: maintains the list of revoked blocks in the
 	 * current transaction.  [j_revoke_lock]
 	 */
-	spinlock_t		j_revoke_lock;
+	spinlock_t		j_revoke_lock ____cacheline_aligned_in_smp;
 	struct jbd_revoke_table_s *j_revoke;
 	struct jbd_revoke_table_s *j_revoke_table[2];
 
@@ -812,6 +869,11 @@ struct journal_s
 	 * superblock pointer here
 	 */
 	void *j_private;
+
+	/* Transaction statistics [j_history_lock] */
+	spinlock_t		j_history_lock;
+	struct transaction_stats_s j_stats;
+	struct proc_dir_entry	*j_proc_entry;
 };
 
 /* 
@@ -914,6 +976,8 @@ extern int	   journal_check_available_features
 		   (journal_t *, unsigned long, unsigned long, unsigned long);
 extern int	   journal_set_features 
 		   (journal_t *, unsigned long, unsigned long, unsigned long);
+extern void	   journal_clear_features
+		   (journal_t *, unsigned long, unsigned long, unsigned long);
 extern int	   journal_create     (journal_t *);
 extern int	   journal_load       (journal_t *journal);
 extern void	   journal_destroy    (journal_t *);
@@ -1053,8 +1117,8 @@ static inline int jbd_space_needed(journal_t *journal)
 {
 	int nblocks = journal->j_max_transaction_buffers;
 	if (journal->j_committing_transaction)
-		nblocks += journal->j_committing_transaction->
-					t_outstanding_credits;
+		nblocks += atomic_read(&journal->j_committing_transaction->
+					t_outstanding_credits);
 	return nblocks;
 }
 
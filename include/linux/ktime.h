@@ -281,6 +281,9 @@ static inline u64 ktime_to_ns(const ktime_t kt)
 #define KTIME_REALTIME_RES	(ktime_t){ .tv64 = TICK_NSEC }
 #define KTIME_MONOTONIC_RES	(ktime_t){ .tv64 = TICK_NSEC }
 
+/* Resolution of the clocks in high-resolution timer mode */
+#define KTIME_HIGH_RES		(ktime_t){ .tv64 = 1 }
+
 /* Get the monotonic time in timespec format: */
 extern void ktime_get_ts(struct timespec *ts);
 
@@ -1,41 +1,72 @@
 
-static inline void
-add_page_to_active_list(struct zone *zone, struct page *page)
+/*
+ * Anonymous and shmem pages can only be reclaimed by swapping them out,
+ * everything else is page cache which may simply be dropped or written
+ * back to its file: the two are kept on separate LRU lists.
+ */
+static inline int page_is_file_cache(struct page *page)
 {
-	list_add(&page->lru, &zone->active_list);
-	zone->nr_active++;
+	return !PageSwapBacked(page);
 }
 
 static inline void
-add_page_to_inactive_list(struct zone *zone, struct page *page)
+add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
-	list_add(&page->lru, &zone->inactive_list);
-	zone->nr_inactive++;
+	list_add(&page->lru, &zone->lru[l].list);
+	zone->lru[l].nr++;
 }
 
 static inline void
-del_page_from_active_list(struct zone *zone, struct page *page)
+del_page_from_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
 	list_del(&page->lru);
-	zone->nr_active--;
+	zone->lru[l].nr--;
+}
+
+/* The inactive list of the page's kind, LRU_ACTIVE is added to it */
+static inline enum lru_list page_lru_base_type(struct page *page)
+{
+	if (page_is_file_cache(page))
+		return LRU_INACTIVE_FILE;
+	return LRU_INACTIVE_ANON;
+}
+
+/* Which list a page on the LRU is on, going by its flags */
+static inline enum lru_list page_lru(struct page *page)
+{
+	enum lru_list l;
+
+	if (PageUnevictable(page))
+		return LRU_UNEVICTABLE;
+	l = page_lru_base_type(page);
+	if (PageActive(page))
+		l += LRU_ACTIVE;
+	return l;
 }
 
 static inline void
-del_page_from_inactive_list(struct zone *zone, struct page *page)
+add_page_to_active_list(struct zone *zone, struct page *page)
 {
-	list_del(&page->lru);
-	zone->nr_inactive--;
+	add_page_to_lru_list(zone, page, page_lru_base_type(page) + LRU_ACTIVE);
+}
+
+static inline void
+add_page_to_inactive_list(struct zone *zone, struct page *page)
+{
+	add_page_to_lru_list(zone, page, page_lru_base_type(page));
 }
 
 static inline void
 del_page_from_lru(struct zone *zone, struct page *page)
 {
-	list_del(&page->lru);
-	if (PageActive(page)) {
-		ClearPageActive(page);
-		zone->nr_active--;
-	} else {
-		zone->nr_inactive--;
-	}
+	del_page_from_lru_list(zone, page, page_lru(page));
+	ClearPageActive(page);
+	ClearPageUnevictable(page);
 }
 
+/* Pages on the LRU lists which reclaim may look at */
+static inline unsigned long zone_lru_pages(struct zone *zone)
+{
+	return zone->lru[LRU_ACTIVE_ANON].nr + zone->lru[LRU_INACTIVE_ANON].nr +
+		zone->lru[LRU_ACTIVE_FILE].nr + zone->lru[LRU_INACTIVE_FILE].nr;
+}
@@ -27,6 +27,39 @@ struct free_area {
 	unsigned long		nr_free;
 };
 
+/*
+ * Each zone keeps its pages on five LRU lists: anonymous (swap-backed)
+ * and file-backed pages are aged and reclaimed separately, and pages
+ * which cannot be reclaimed at all are kept out of reclaim's way.
+ * The order lets LRU_ACTIVE and LRU_FILE be added to the base list.
+ */
+#define LRU_BASE	0
+#define LRU_ACTIVE	1
+#define LRU_FILE	2
+
+enum lru_list {
+	LRU_INACTIVE_ANON = LRU_BASE,
+	LRU_ACTIVE_ANON = LRU_BASE + LRU_ACTIVE,
+	LRU_INACTIVE_FILE = LRU_BASE + LRU_FILE,
+	LRU_ACTIVE_FILE = LRU_BASE + LRU_FILE + LRU_ACTIVE,
+	LRU_UNEVICTABLE,
+	NR_LRU_LISTS
+};
+
+#define for_each_lru(l) for (l = 0; l < NR_LRU_LISTS; l++)
+
+#define for_each_evictable_lru(l) for (l = 0; l <= LRU_ACTIVE_FILE; l++)
+
+static inline int is_file_lru(enum lru_list l)
+{
+	return (l == LRU_INACTIVE_FILE || l == LRU_ACTIVE_FILE);
+}
+
+static inline int is_active_lru(enum lru_list l)
+{
+	return (l == LRU_ACTIVE_ANON || l == LRU_ACTIVE_FILE);
+}
+
 struct pglist_data;
 
 /*
@@ -151,12 +184,25 @@ struct zone {
 
 	/* Fields commonly accessed by the page reclaim scanner */
 	spinlock_t		lru_lock;	
-	struct list_head	active_list;
-	struct list_head	inactive_list;
-	unsigned long		nr_scan_active;
-	unsigned long		nr_scan_inactive;
-	unsigned long		nr_active;
-	unsigned long		nr_inactive;
+	struct {
+		struct list_head list;
+		unsigned long nr;
+		unsigned long nr_scan;	/* pages owed to the next scan */
+	} lru[NR_LRU_LISTS];
+
+	/*
+	 * Pages recently scanned on the anon [0] and file [1] lists, and
+	 * those of them which were found referenced and kept or moved back
+	 * to the active list.  The fewer pages rotate, the cheaper a list
+	 * is to reclaim from: this drives the anon/file scan balance.
+	 * Both are halved now and then so that they track recent behaviour.
+	 */
+	unsigned long		recent_rotated[2];
+	unsigned long		recent_scanned[2];
+
+	/* active anon pages allowed per inactive one, by zone size */
+	unsigned int		inactive_ratio;
+
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	int			all_unreclaimable; /* All pages pinned */
 
@@ -177,8 +223,7 @@ struct zone {
 	 * invokation.
 	 *
 	 * We use prev_priority as a measure of how much stress page reclaim is
-	 * under - it drives the swappiness decision: whether to unmap mapped
-	 * pages.
+	 * under.
 	 *
 	 * temp_priority is used to remember the scanning priority at which
 	 * this zone was successfully refilled to free_pages == pages_high.
@@ -330,6 +375,7 @@ void __get_zone_counts(unsigned long *active, unsigned long *inactive,
 			unsigned long *free, struct pglist_data *pgdat);
 void get_zone_counts(unsigned long *active, unsigned long *inactive,
 			unsigned long *free);
+void get_lru_counts(unsigned long *nr);
 void build_all_zonelists(void);
 void wakeup_kswapd(struct zone *zone, int order);
 int zone_watermark_ok(struct zone *z, int order, unsigned long mark,
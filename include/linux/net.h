@@ -190,7 +190,12 @@ extern int	     sock_recvmsg(struct socket *sock, struct msghdr *msg,
 				  size_t size, int flags);
 extern int 	     sock_map_fd(struct socket *sock);
 extern struct socket *sockfd_lookup(int fd, int *err);
+extern struct socket *sock_from_file(struct file *file, int *err);
 #define		     sockfd_put(sock) fput(sock->file)
+extern long	     __sys_sendmsg(struct socket *sock,
+				   struct msghdr __user *msg, unsigned flags);
+extern long	     __sys_recvmsg(struct socket *sock,
+				   struct msghdr __user *msg, unsigned int flags);
 extern int	     net_ratelimit(void);
 extern unsigned long net_random(void);
 extern void	     net_srandom(unsigned long);
@@ -37,6 +37,7 @@
 #include <linux/config.h>
 #include <linux/device.h>
 #include <linux/percpu.h>
+#include <linux/rcupdate.h>
 
 struct divert_blk;
 struct vlan_group;
@@ -230,7 +231,8 @@ enum netdev_state_t
 	__LINK_STATE_SCHED,
 	__LINK_STATE_NOCARRIER,
 	__LINK_STATE_RX_SCHED,
-	__LINK_STATE_LINKWATCH_PENDING
+	__LINK_STATE_LINKWATCH_PENDING,
+	__LINK_STATE_QUEUE0_XOFF
 };
 
 
@@ -246,6 +248,85 @@ struct netdev_boot_setup {
 
 extern int __init netdev_boot_setup(char *str);
 
+/*
+ * A transmit queue of a multiqueue device other than the first.  Queue 0
+ * is the device itself: dev->qdisc, dev->queue_lock and dev->xmit_lock.
+ * Every further queue has a qdisc and locks of its own, so that CPUs
+ * sending on different queues do not contend.  lock and xmit_lock play
+ * the parts of dev->queue_lock and dev->xmit_lock for the queue, and
+ * __LINK_STATE_XOFF in state stops it.  Queue 0 is stopped on its own by
+ * __LINK_STATE_QUEUE0_XOFF in dev->state, __LINK_STATE_XOFF there being
+ * the whole device's.
+ */
+struct netdev_queue
+{
+	spinlock_t		lock;
+	struct Qdisc		*qdisc;
+	struct Qdisc		*qdisc_sleeping;
+	unsigned long		state;
+
+	spinlock_t		xmit_lock ____cacheline_aligned_in_smp;
+	int			xmit_lock_owner;
+} ____cacheline_aligned_in_smp;
+
+#ifdef CONFIG_RPS
+/*
+ * Receive packet steering.  A device's rps_map lists the CPUs its received
+ * packets are spread over by flow hash.  rps_flow_table remembers, per
+ * hash bucket, the CPU a flow is being steered to and how far that CPU's
+ * backlog had got when the last packet was queued, so that a flow only
+ * follows its socket to another CPU once the packets already queued for
+ * it have been processed.  Both are replaced under RCU.
+ */
+struct rps_map {
+	unsigned int		len;
+	struct rcu_head		rcu;
+	u16			cpus[0];
+};
+
+struct rps_dev_flow {
+	u16			cpu;
+	unsigned int		last_qtail;
+};
+
+struct rps_dev_flow_table {
+	unsigned int		mask;
+	struct rcu_head		rcu;
+	struct rps_dev_flow	flows[0];
+};
+
+/*
+ * The CPU that last read from or wrote to the socket of each flow, indexed
+ * by flow hash.  Set by net.core.rps_sock_flow_entries.
+ */
+struct rps_sock_flow_table {
+	unsigned int		mask;
+	u16			ents[0];
+};
+
+#define RPS_NO_CPU		0xffff
+
+extern struct rps_sock_flow_table *rps_sock_flow_table;
+
+static inline void rps_record_sock_flow(u32 hash)
+{
+	struct rps_sock_flow_table *table;
+
+	if (!hash)
+		return;
+	rcu_read_lock();
+	table = rcu_dereference(rps_sock_flow_table);
+	if (table) {
+		unsigned int index = hash & table->mask;
+		u16 cpu = raw_smp_processor_id();
+
+		if (table->ents[index] != cpu)
+			table->ents[index] = cpu;
+	}
+	rcu_read_unlock();
+}
+#endif
+
 /*
  *	The DEVICE structure.
  *	Actually, this whole structure is a big mistake.  It mixes I/O
@@ -309,6 +390,7 @@ struct net_device
 #define NETIF_F_TSO		2048	/* Can offload TCP/IP segmentation */
 #define NETIF_F_LLTX		4096	/* LockLess TX */
 #define NETIF_F_UFO             8192    /* Can offload UDP Large Send*/
+#define NETIF_F_GRO		16384	/* Generic receive offload */
 
 	struct net_device	*next_sched;
 
@@ -378,6 +460,11 @@ struct net_device
 	int			quota;
 	int			weight;
 	unsigned long		last_rx;	/* Time of last Rx	*/
+#ifdef CONFIG_RPS
+	/* Receive packet steering, see net-sysfs.c */
+	struct rps_map		*rps_map;
+	struct rps_dev_flow_table *rps_flow_table;
+#endif
 	/* Interface address info used in eth_type_trans() */
 	unsigned char		dev_addr[MAX_ADDR_LEN];	/* hw address, (before bcast 
 							because most packets are unicast) */
@@ -394,6 +481,13 @@ struct net_device
 	struct list_head	qdisc_list;
 	unsigned long		tx_queue_len;	/* Max frames per queue allowed */
 
+	/* Transmit queues 1 .. num_tx_queues - 1, see alloc_netdev_mq() */
+	struct netdev_queue	*tx_queues;
+	unsigned int		num_tx_queues;
+	/* Queue for skb, if the default flow hash will not do */
+	u16			(*select_queue)(struct net_device *dev,
+						struct sk_buff *skb);
+
 	/* ingress path synchronizer */
 	spinlock_t		ingress_lock;
 	struct Qdisc		*qdisc_ingress;
@@ -529,8 +623,30 @@ struct packet_type {
 					 struct net_device *);
 	void			*af_packet_priv;
 	struct list_head	list;
+	/* GRO: merge skb into a packet held on head, see dev_gro_receive() */
+	int			(*gro_receive)(struct sk_buff **head,
+					       struct sk_buff *skb);
+};
+
+/* What gro_receive() did with a packet */
+enum {
+	GRO_NORMAL,	/* nothing, pass it up now */
+	GRO_HELD,	/* hold it for later packets to be merged into */
+	GRO_MERGED,	/* appended it to a held packet */
+};
+
+/* State of a packet held for GRO, kept in its cb */
+struct gro_cb {
+	struct sk_buff		*last;		/* last skb of frag_list */
+	unsigned int		seg_len;	/* payload of first segment */
+	unsigned short		count;		/* segments merged */
+	unsigned char		same_flow;	/* same device and link header
+						   as the packet offered */
+	unsigned char		flush;		/* deliver before that packet */
 };
 
+#define GRO_CB(skb)	((struct gro_cb *)(skb)->cb)
+
 #include <linux/interrupt.h>
 #include <linux/notifier.h>
 
@@ -577,7 +693,9 @@ static inline int unregister_gifconf(unsigned int family)
 
 /*
  * Incoming packets are placed on per-cpu queues so that
- * no locking is needed.
+ * no locking is needed.  Receive packet steering queues packets on
+ * other CPUs' input_pkt_queue too, so that takes its lock;
+ * input_queue_head counts the packets dequeued from it.
  */
 
 struct softnet_data
@@ -587,6 +705,16 @@ struct softnet_data
 	struct list_head	poll_list;
 	struct sk_buff		*completion_queue;
 
+	/* Packets held for GRO while gro_dev is polled */
+	struct sk_buff		*gro_list;
+	int			gro_count;
+	struct net_device	*gro_dev;
+#ifdef CONFIG_RPS
+	unsigned int		input_queue_head;
+	int			rps_kick;
+	struct task_struct	*rps_task;
+#endif
+
 	struct net_device	backlog_dev;	/* Sorry. 8) */
 };
 
@@ -644,6 +772,118 @@ static inline int netif_queue_stopped(const struct net_device *dev)
 	return test_bit(__LINK_STATE_XOFF, &dev->state);
 }
 
+/*
+ * Multiqueue devices start, stop and wake each transmit queue with these.
+ * Stopping one queue leaves the others running, queue 0 included, while
+ * stopping the device with netif_stop_queue() stops them all.
+ */
+static inline struct netdev_queue *netdev_get_tx_queue(struct net_device *dev,
+						       u16 index)
+{
+	return &dev->tx_queues[index - 1];
+}
+
+/* The state word holding a queue's stop bit, and the bit */
+static inline unsigned long *netif_subqueue_state(struct net_device *dev,
+						  u16 index)
+{
+	return index ? &netdev_get_tx_queue(dev, index)->state : &dev->state;
+}
+
+static inline int netif_subqueue_xoff(u16 index)
+{
+	return index ? __LINK_STATE_XOFF : __LINK_STATE_QUEUE0_XOFF;
+}
+
+static inline void netif_start_subqueue(struct net_device *dev, u16 index)
+{
+	clear_bit(netif_subqueue_xoff(index), netif_subqueue_state(dev, index));
+}
+
+static inline void netif_stop_subqueue(struct net_device *dev, u16 index)
+{
+#ifdef CONFIG_NETPOLL_TRAP
+	if (netpoll_trap())
+		return;
+#endif
+	set_bit(netif_subqueue_xoff(index), netif_subqueue_state(dev, index));
+}
+
+static inline int netif_subqueue_stopped(struct net_device *dev, u16 index)
+{
+	if (netif_queue_stopped(dev))
+		return 1;
+	return test_bit(netif_subqueue_xoff(index),
+			netif_subqueue_state(dev, index));
+}
+
+/* net_tx_action runs all the queues of a device it finds scheduled */
+static inline void netif_schedule_subqueue(struct net_device *dev, u16 index)
+{
+	if (!netif_subqueue_stopped(dev, index))
+		__netif_schedule(dev);
+}
+
+static inline void netif_wake_subqueue(struct net_device *dev, u16 index)
+{
+#ifdef CONFIG_NETPOLL_TRAP
+	if (netpoll_trap())
+		return;
+#endif
+	if (test_and_clear_bit(netif_subqueue_xoff(index),
+			       netif_subqueue_state(dev, index)))
+		__netif_schedule(dev);
+}
+
+/* The lock serializing hard_start_xmit on a queue, and its owner cpu */
+static inline spinlock_t *netif_tx_queue_lock(struct net_device *dev,
+					      u16 index)
+{
+	return index ? &netdev_get_tx_queue(dev, index)->xmit_lock :
+		       &dev->xmit_lock;
+}
+
+static inline int *netif_tx_queue_owner(struct net_device *dev, u16 index)
+{
+	return index ? &netdev_get_tx_queue(dev, index)->xmit_lock_owner :
+		       &dev->xmit_lock_owner;
+}
+
+/*
+ * Take the xmit_lock of every transmit queue, queue 0 first, to keep
+ * hard_start_xmit off all of them: dev->xmit_lock alone only holds off
+ * queue 0.
+ */
+static inline void netif_tx_lock(struct net_device *dev)
+{
+	unsigned int i;
+
+	spin_lock(&dev->xmit_lock);
+	for (i = 1; i < dev->num_tx_queues; i++)
+		spin_lock(&netdev_get_tx_queue(dev, i)->xmit_lock);
+}
+
+static inline void netif_tx_unlock(struct net_device *dev)
+{
+	unsigned int i;
+
+	for (i = dev->num_tx_queues; i-- > 1; )
+		spin_unlock(&netdev_get_tx_queue(dev, i)->xmit_lock);
+	spin_unlock(&dev->xmit_lock);
+}
+
+static inline void netif_tx_lock_bh(struct net_device *dev)
+{
+	local_bh_disable();
+	netif_tx_lock(dev);
+}
+
+static inline void netif_tx_unlock_bh(struct net_device *dev)
+{
+	netif_tx_unlock(dev);
+	local_bh_enable();
+}
+
 static inline int netif_running(const struct net_device *dev)
 {
 	return test_bit(__LINK_STATE_START, &dev->state);
@@ -684,6 +924,7 @@ extern int		netif_rx(struct sk_buff *skb);
 extern int		netif_rx_ni(struct sk_buff *skb);
 #define HAVE_NETIF_RECEIVE_SKB 1
 extern int		netif_receive_skb(struct sk_buff *skb);
+extern void		skb_gro_receive(struct sk_buff *p, struct sk_buff *skb);
 extern int		dev_valid_name(const char *name);
 extern int		dev_ioctl(unsigned int cmd, void __user *);
 extern int		dev_ethtool(struct ifreq *);
@@ -902,9 +1143,9 @@ static inline void __netif_rx_complete(struct net_device *dev)
 
 static inline void netif_tx_disable(struct net_device *dev)
 {
-	spin_lock_bh(&dev->xmit_lock);
+	netif_tx_lock_bh(dev);
 	netif_stop_queue(dev);
-	spin_unlock_bh(&dev->xmit_lock);
+	netif_tx_unlock_bh(dev);
 }
 
 /* These functions live elsewhere (drivers/net/net_init.c, but related) */
@@ -912,8 +1153,11 @@ static inline void netif_tx_disable(struct net_device *dev)
 extern void		ether_setup(struct net_device *dev);
 
 /* Support for loadable net-drivers */
-extern struct net_device *alloc_netdev(int sizeof_priv, const char *name,
-				       void (*setup)(struct net_device *));
+extern struct net_device *alloc_netdev_mq(int sizeof_priv, const char *name,
+					  void (*setup)(struct net_device *),
+					  unsigned int queue_count);
+#define alloc_netdev(sizeof_priv, name, setup) \
+	alloc_netdev_mq(sizeof_priv, name, setup, 1)
 extern int		register_netdev(struct net_device *dev);
 extern void		unregister_netdev(struct net_device *dev);
 /* Functions used for multicast support */
@@ -34,6 +34,15 @@
  * inactive_dirty and inactive_clean lists are protected by the
  * zone->lru_lock, and *NOT* by the usual PG_locked bit!
  *
+ * PG_swapbacked marks anonymous and shmem pages, which only swap can
+ * reclaim: they live on the anon LRU lists, everything else on the file
+ * LRU lists.  The bit is set before the page first goes on the LRU.
+ * PG_unevictable pages (mlocked, ramfs, SHM_LOCKed) sit on a list of
+ * their own which reclaim does not scan.
+ *
+ * PG_readahead marks the page of a readahead window at which the next
+ * readahead is started, when a reader gets to it, see mm/readahead.c.
+ *
  * PG_error is set to indicate that an I/O error occurred on this page.
  *
  * PG_arch_1 is an architecture specific page state bit.  The generic code
@@ -76,6 +85,10 @@
 #define PG_nosave_free		18	/* Free, should not be written */
 #define PG_uncached		19	/* Page has been mapped as uncached */
 
+#define PG_swapbacked		20	/* Anon or shmem: on the anon LRU lists */
+#define PG_unevictable		21	/* On the unevictable LRU list */
+#define PG_readahead		22	/* Reader got here: read ahead more */
+
 /*
  * Global page accounting.  One instance per CPU.  Only unsigned longs are
  * allowed.
@@ -148,7 +161,15 @@ struct page_state {
 	unsigned long allocstall;	/* direct reclaim calls */
 
 	unsigned long pgrotated;	/* pages rotated to tail of the LRU */
+	unsigned long unevictable_pgs_culled;	/* moved to unevictable list */
+	unsigned long unevictable_pgs_rescued;	/* ... and back again */
 	unsigned long nr_bounce;	/* pages for bounce buffers */
+
+	unsigned long thp_fault_alloc;	/* huge pages mapped at fault time */
+	unsigned long thp_fault_fallback;/* ... or small pages instead */
+	unsigned long thp_collapse_alloc;/* collapsed by khugepaged */
+	unsigned long thp_collapse_alloc_failed;
+	unsigned long thp_split;	/* huge pages split into small ones */
 };
 
 extern void get_page_state(struct page_state *ret);
@@ -344,6 +365,18 @@ extern void __mod_page_state_offset(unsigned long offset, unsigned long delta);
 #define SetPageUncached(page)	set_bit(PG_uncached, &(page)->flags)
 #define ClearPageUncached(page)	clear_bit(PG_uncached, &(page)->flags)
 
+#define PageSwapBacked(page)	test_bit(PG_swapbacked, &(page)->flags)
+#define SetPageSwapBacked(page)	set_bit(PG_swapbacked, &(page)->flags)
+#define __ClearPageSwapBacked(page) __clear_bit(PG_swapbacked, &(page)->flags)
+
+#define PageUnevictable(page)	test_bit(PG_unevictable, &(page)->flags)
+#define SetPageUnevictable(page) set_bit(PG_unevictable, &(page)->flags)
+#define ClearPageUnevictable(page) clear_bit(PG_unevictable, &(page)->flags)
+
+#define PageReadahead(page)	test_bit(PG_readahead, &(page)->flags)
+#define SetPageReadahead(page)	set_bit(PG_readahead, &(page)->flags)
+#define ClearPageReadahead(page) clear_bit(PG_readahead, &(page)->flags)
+
 struct page;	/* forward declaration */
 
 int test_clear_page_dirty(struct page *page);
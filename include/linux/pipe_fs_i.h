@@ -16,6 +16,8 @@ struct pipe_buf_operations {
 	void * (*map)(struct file *, struct pipe_inode_info *, struct pipe_buffer *);
 	void (*unmap)(struct pipe_inode_info *, struct pipe_buffer *);
 	void (*release)(struct pipe_inode_info *, struct pipe_buffer *);
+	/* take another reference to the buffer's page, for tee() */
+	void (*get)(struct pipe_inode_info *, struct pipe_buffer *);
 };
 
 struct pipe_inode_info {
@@ -31,6 +33,7 @@ struct pipe_inode_info {
 	unsigned int w_counter;
 	struct fasync_struct *fasync_readers;
 	struct fasync_struct *fasync_writers;
+	struct inode *inode;	/* NULL for an internal splice pipe */
 };
 
 /* Differs from PIPE_BUF in that PIPE_SIZE is the length of the actual
@@ -52,5 +55,33 @@ void pipe_wait(struct inode * inode);
 
 struct inode* pipe_new(struct inode* inode);
 void free_pipe_info(struct inode* inode);
+struct pipe_inode_info *alloc_pipe_info(struct inode *inode);
+void __free_pipe_info(struct pipe_inode_info *info);
+void generic_pipe_buf_get(struct pipe_inode_info *info, struct pipe_buffer *buf);
+
+ssize_t pipe_readv_nonblock(struct file *, const struct iovec *, unsigned long);
+ssize_t pipe_writev_nonblock(struct file *, const struct iovec *, unsigned long);
+
+/*
+ * splice(2), tee(2) and vmsplice(2), see fs/splice.c
+ */
+#define SPLICE_F_MOVE		(0x01)	/* move pages instead of copying */
+#define SPLICE_F_NONBLOCK	(0x02)	/* don't block on the pipe */
+#define SPLICE_F_MORE		(0x04)	/* more data will follow */
+#define SPLICE_F_GIFT		(0x08)	/* vmsplice: pages are handed over */
+
+struct splice_desc {
+	unsigned int len, total_len;	/* current and remaining length */
+	unsigned int flags;		/* SPLICE_F_* */
+	struct file *file;		/* file to write to */
+	loff_t pos;			/* file position */
+};
+
+typedef int (splice_actor)(struct pipe_inode_info *, struct pipe_buffer *,
+			   struct splice_desc *);
+
+extern ssize_t splice_from_pipe(struct pipe_inode_info *, struct file *,
+				loff_t *, size_t, unsigned int,
+				splice_actor *);
 
 #endif
@@ -90,7 +90,7 @@ static inline void page_dup_rmap(struct page *page)
 /*
  * Called from mm/vmscan.c to handle paging out
  */
-int page_referenced(struct page *, int is_locked);
+int page_referenced(struct page *, int is_locked, unsigned long *vm_flags);
 int try_to_unmap(struct page *, int ignore_refs);
 void remove_from_swap(struct page *page);
 
@@ -105,13 +105,18 @@ pte_t *page_check_address(struct page *, struct mm_struct *,
  */
 unsigned long page_address_in_vma(struct page *, struct vm_area_struct *);
 
+/*
+ * Used by mm/huge_memory.c to walk the mappings of a huge page.
+ */
+struct anon_vma *page_lock_anon_vma(struct page *page);
+
 #else	/* !CONFIG_MMU */
 
 #define anon_vma_init()		do {} while (0)
 #define anon_vma_prepare(vma)	(0)
 #define anon_vma_link(vma)	do {} while (0)
 
-#define page_referenced(page,l) TestClearPageReferenced(page)
+#define page_referenced(page,l,v) ({ *(v) = 0; TestClearPageReferenced(page); })
 #define try_to_unmap(page, refs) SWAP_FAIL
 
 #endif	/* CONFIG_MMU */
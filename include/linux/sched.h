@@ -347,6 +347,13 @@ struct mm_struct {
 	/* aio bits */
 	rwlock_t		ioctx_list_lock;
 	struct kioctx		*ioctx_list;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	/* page tables set aside for splitting huge pmds, page_table_lock */
+	struct list_head	pmd_huge_pte;
+	/* on the khugepaged scan list, khugepaged_mm_lock */
+	struct list_head	khugepaged_list;
+#endif
 };
 
 struct sighand_struct {
@@ -521,6 +528,7 @@ extern struct user_struct root_user;
 #define INIT_USER (&root_user)
 
 typedef struct prio_array prio_array_t;
+struct sched_class;
 struct backing_dev_info;
 struct reclaim_state;
 
@@ -706,6 +714,13 @@ struct task_struct {
 	int prio, static_prio;
 	struct list_head run_list;
 	prio_array_t *array;
+	struct sched_class *sched_class;
+	int on_rq;
+
+	/* virtual runtime bookkeeping of the fair class */
+	struct rb_node run_node;
+	unsigned long long vruntime, exec_start;
+	unsigned long long sum_exec_runtime, prev_sum_exec_runtime;
 
 	unsigned short ioprio;
 
@@ -846,6 +861,9 @@ struct task_struct {
 
 	struct io_context *io_context;
 
+	/* internal pipe of do_splice_direct(), allocated on first use */
+	struct pipe_inode_info *splice_pipe;
+
 	unsigned long ptrace_message;
 	siginfo_t *last_siginfo; /* For ptrace use.  */
 /*
@@ -970,6 +988,7 @@ static inline int set_cpus_allowed(task_t *p, cpumask_t new_mask)
 
 extern unsigned long long sched_clock(void);
 extern unsigned long long current_sched_time(const task_t *current_task);
+extern struct sched_class prio_sched_class;
 
 /* sched_exec is called by processes performing an exec */
 #ifdef CONFIG_SMP
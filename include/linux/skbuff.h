@@ -139,6 +139,7 @@ struct skb_shared_info {
 	unsigned short  ufo_size;
 	unsigned int    ip6_frag_id;
 	struct sk_buff	*frag_list;
+	void		*destructor_arg;	/* for the owner's destructor */
 	skb_frag_t	frags[MAX_SKB_FRAGS];
 };
 
@@ -195,6 +196,8 @@ enum {
  *	@priority: Packet queueing priority
  *	@users: User count - see {datagram,tcp}.c
  *	@protocol: Packet protocol from driver
+ *	@queue_mapping: Transmit queue of a multiqueue device
+ *	@rxhash: Flow hash used to steer received packets, 0 if none
  *	@truesize: Buffer size 
  *	@head: Head of buffer
  *	@data: Data head pointer
@@ -267,6 +270,8 @@ struct sk_buff {
 				fclone:2,
 				ipvs_property:1;
 	__be16			protocol;
+	__u16			queue_mapping;
+	__u32			rxhash;
 
 	void			(*destructor)(struct sk_buff *skb);
 #ifdef CONFIG_NETFILTER
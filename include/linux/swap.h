@@ -175,6 +175,9 @@ extern void swap_setup(void);
 extern int try_to_free_pages(struct zone **, gfp_t);
 extern int shrink_all_memory(int);
 extern int vm_swappiness;
+extern int page_evictable(struct page *page);
+extern void rescue_unevictable_page(struct page *page);
+extern void scan_mapping_unevictable_pages(struct address_space *mapping);
 
 #ifdef CONFIG_NUMA
 extern int zone_reclaim_mode;
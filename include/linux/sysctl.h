@@ -184,6 +184,9 @@ enum
 	VM_PERCPU_PAGELIST_FRACTION=30,/* int: fraction of pages in each percpu_pagelist */
 	VM_ZONE_RECLAIM_MODE=31, /* reclaim local zone memory before going off node */
 	VM_ZONE_RECLAIM_INTERVAL=32, /* time period to wait after reclaim failure */
+	VM_TRANSPARENT_HUGEPAGE=33, /* int: use huge pages for anonymous memory */
+	VM_KHUGEPAGED_PAGES=34,	/* int: pages khugepaged scans per pass */
+	VM_KHUGEPAGED_SLEEP=35,	/* int: msecs khugepaged sleeps between passes */
 };
 
 
@@ -259,6 +262,8 @@ enum
 	NET_CORE_DEV_WEIGHT=17,
 	NET_CORE_SOMAXCONN=18,
 	NET_CORE_BUDGET=19,
+	NET_CORE_RPS_SOCK_FLOW_ENTRIES=20,
+	NET_CORE_BPF_JIT_ENABLE=21,
 };
 
 /* /proc/sys/net/ethernet */
@@ -5,6 +5,7 @@
 #include <linux/list.h>
 #include <linux/spinlock.h>
 #include <linux/stddef.h>
+#include <asm/percpu.h>
 
 struct timer_base_s;
 
@@ -64,6 +65,21 @@ extern int mod_timer(struct timer_list *timer, unsigned long expires);
 
 extern unsigned long next_timer_interrupt(void);
 
+#ifdef CONFIG_NO_IDLE_HZ
+/*
+ * Tick suppression statistics of one cpu, see /proc/dyntick.
+ */
+struct dyntick_stat {
+	unsigned long idle_calls;	/* tried to stop the tick in idle */
+	unsigned long idle_sleeps;	/* ... and did */
+	unsigned long ticks_skipped;	/* jiffies passed with the tick off */
+	unsigned long stop_jiffies;	/* jiffies when it was stopped */
+};
+
+DECLARE_PER_CPU(struct dyntick_stat, dyntick_stats);
+extern struct file_operations proc_dyntick_operations;
+#endif
+
 /***
  * add_timer - start a timer
  * @timer: the timer to be added
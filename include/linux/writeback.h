@@ -27,7 +27,6 @@ static inline int task_is_pdflush(struct task_struct *task)
 enum writeback_sync_modes {
 	WB_SYNC_NONE,	/* Don't wait on anything */
 	WB_SYNC_ALL,	/* Wait on every mapping */
-	WB_SYNC_HOLD,	/* Hold the inode on sb_dirty for sys_sync() */
 };
 
 /*
@@ -63,11 +62,13 @@ struct writeback_control {
 /*
  * fs/fs-writeback.c
  */	
-void writeback_inodes(struct writeback_control *wbc);
+void writeback_inodes_bdi(struct backing_dev_info *bdi,
+			  struct writeback_control *wbc);
 void wake_up_inode(struct inode *inode);
 int inode_wait(void *);
 void sync_inodes_sb(struct super_block *, int wait);
 void sync_inodes(int wait);
+int sb_has_dirty_inodes(struct super_block *sb);
 
 /* writeback.h requires fs.h; it, too, is not included from here. */
 static inline void wait_on_inode(struct inode *inode)
@@ -80,7 +81,9 @@ static inline void wait_on_inode(struct inode *inode)
 /*
  * mm/page-writeback.c
  */
-int wakeup_pdflush(long nr_pages);
+void bdi_background_writeout(struct backing_dev_info *bdi, long min_pages);
+void bdi_kupdate(struct backing_dev_info *bdi);
+unsigned long bdi_dirty_thresh(struct backing_dev_info *bdi);
 void laptop_io_completion(void);
 void laptop_sync_completion(void);
 void throttle_vm_writeout(void);
@@ -97,19 +100,24 @@ struct ctl_table;
 struct file;
 int dirty_writeback_centisecs_handler(struct ctl_table *, int, struct file *,
 				      void __user *, size_t *, loff_t *);
+int dirty_ratio_handler(struct ctl_table *, int, struct file *,
+			void __user *, size_t *, loff_t *);
+int dirty_ratio_strategy(struct ctl_table *, int __user *, int,
+			 void __user *, size_t __user *,
+			 void __user *, size_t, void **);
 
 void page_writeback_init(void);
 void balance_dirty_pages_ratelimited(struct address_space *mapping);
-int pdflush_operation(void (*fn)(unsigned long), unsigned long arg0);
 int do_writepages(struct address_space *mapping, struct writeback_control *wbc);
 int sync_page_range(struct inode *inode, struct address_space *mapping,
 			loff_t pos, loff_t count);
 int sync_page_range_nolock(struct inode *inode, struct address_space *mapping,
 			   loff_t pos, loff_t count);
 
-/* pdflush.c */
-extern int nr_pdflush_threads;	/* Global so it can be exported to sysctl
-				   read-only. */
+/* backing-dev.c */
+void wakeup_flusher_threads(long nr_pages);
+extern int nr_pdflush_threads;	/* Flusher threads running.  Global so it
+				   can be exported to sysctl read-only. */
 
 
 #endif		/* WRITEBACK_H */
@@ -219,6 +219,7 @@ extern struct qdisc_rate_table *qdisc_get_rtab(struct tc_ratespec *r,
 extern void qdisc_put_rtab(struct qdisc_rate_table *tab);
 
 extern int qdisc_restart(struct net_device *dev);
+extern int qdisc_restart_queue(struct net_device *dev, u16 index);
 
 static inline void qdisc_run(struct net_device *dev)
 {
@@ -226,6 +227,14 @@ static inline void qdisc_run(struct net_device *dev)
 		/* NOTHING */;
 }
 
+/* Like qdisc_run, for transmit queue index of a multiqueue device */
+static inline void qdisc_run_queue(struct net_device *dev, u16 index)
+{
+	while (!netif_subqueue_stopped(dev, index) &&
+	       qdisc_restart_queue(dev, index) < 0)
+		/* NOTHING */;
+}
+
 extern int tc_classify(struct sk_buff *skb, struct tcf_proto *tp,
 	struct tcf_result *res);
 
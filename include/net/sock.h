@@ -150,6 +150,7 @@ struct sock_common {
   *	@sk_ack_backlog: current listen backlog
   *	@sk_max_ack_backlog: listen backlog set in listen()
   *	@sk_priority: %SO_PRIORITY setting
+  *	@sk_rxhash: flow hash of the last packet received, for receive steering
   *	@sk_type: socket type (%SOCK_STREAM, etc)
   *	@sk_protocol: which protocol this socket belongs in this network family
   *	@sk_peercred: %SO_PEERCRED setting
@@ -229,6 +230,9 @@ struct sock {
 	unsigned short		sk_ack_backlog;
 	unsigned short		sk_max_ack_backlog;
 	__u32			sk_priority;
+#ifdef CONFIG_RPS
+	__u32			sk_rxhash;
+#endif
 	struct ucred		sk_peercred;
 	int			sk_rcvlowat;
 	long			sk_rcvtimeo;
@@ -856,8 +860,7 @@ static inline int sk_filter(struct sock *sk, struct sk_buff *skb, int needlock)
 		
 		filter = sk->sk_filter;
 		if (filter) {
-			unsigned int pkt_len = sk_run_filter(skb, filter->insns,
-							     filter->len);
+			unsigned int pkt_len = SK_RUN_FILTER(filter, skb);
 			if (!pkt_len)
 				err = -EPERM;
 			else
@@ -884,8 +887,10 @@ static inline void sk_filter_release(struct sock *sk, struct sk_filter *fp)
 
 	atomic_sub(size, &sk->sk_omem_alloc);
 
-	if (atomic_dec_and_test(&fp->refcnt))
+	if (atomic_dec_and_test(&fp->refcnt)) {
+		bpf_jit_free(fp);
 		kfree(fp);
+	}
 }
 
 static inline void sk_filter_charge(struct sock *sk, struct sk_filter *fp)
@@ -1128,6 +1133,27 @@ extern void sk_reset_timer(struct sock *sk, struct timer_list* timer,
 
 extern void sk_stop_timer(struct sock *sk, struct timer_list* timer);
 
+/*
+ * Receive steering: the socket remembers its flow's hash from the packets
+ * it receives, and the CPU it is read and written from is recorded under
+ * that hash so its packets get processed there.
+ */
+static inline void sock_rps_save_rxhash(struct sock *sk,
+					const struct sk_buff *skb)
+{
+#ifdef CONFIG_RPS
+	if (unlikely(sk->sk_rxhash != skb->rxhash))
+		sk->sk_rxhash = skb->rxhash;
+#endif
+}
+
+static inline void sock_rps_record_flow(const struct sock *sk)
+{
+#ifdef CONFIG_RPS
+	rps_record_sock_flow(sk->sk_rxhash);
+#endif
+}
+
 static inline int sock_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 {
 	int err = 0;
@@ -1150,6 +1176,7 @@ static inline int sock_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 	if (err)
 		goto out;
 
+	sock_rps_save_rxhash(sk, skb);
 	skb->dev = NULL;
 	skb_set_owner_r(skb, sk);
 
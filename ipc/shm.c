@@ -30,6 +30,7 @@
 #include <linux/capability.h>
 #include <linux/ptrace.h>
 #include <linux/seq_file.h>
+#include <linux/swap.h>
 
 #include <asm/uaccess.h>
 
@@ -564,9 +565,17 @@ asmlinkage long sys_shmctl (int shmid, int cmd, struct shmid_ds __user *buf)
 				}
 			}
 		} else if (!is_file_hugepages(shp->shm_file)) {
-			shmem_lock(shp->shm_file, 0, shp->mlock_user);
+			struct file *shm_file = shp->shm_file;
+
+			shmem_lock(shm_file, 0, shp->mlock_user);
 			shp->shm_perm.mode &= ~SHM_LOCKED;
 			shp->mlock_user = NULL;
+			/* Let reclaim have the pages again, without the lock */
+			get_file(shm_file);
+			shm_unlock(shp);
+			scan_mapping_unevictable_pages(shm_file->f_mapping);
+			fput(shm_file);
+			goto out;
 		}
 		shm_unlock(shp);
 		goto out;
@@ -0,0 +1,138 @@
+/*
+ *  linux/kernel/clockevents.c
+ *
+ *  Clock event devices: per cpu timer hardware which can raise an
+ *  interrupt at a programmed time. The architecture registers one
+ *  device per cpu, on the cpu it belongs to; the high-resolution mode
+ *  of hrtimers (kernel/hrtimer.c) switches it to oneshot mode and
+ *  programs it for the next hrtimer expiry.
+ *
+ *  For licencing details see kernel-base/COPYING
+ */
+
+#include <linux/clockchips.h>
+#include <linux/percpu.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+
+#include <asm/div64.h>
+
+static DEFINE_PER_CPU(struct clock_event_device *, local_clockevent);
+
+/**
+ * div_sc - calculate a nanoseconds to device cycles multiplier
+ *
+ * @ticks:	device cycles in @nsec nanoseconds
+ * @nsec:	the period
+ * @shift:	the shift of the resulting factor
+ */
+unsigned long div_sc(unsigned long ticks, unsigned long nsec, int shift)
+{
+	u64 tmp = ((u64)ticks) << shift;
+
+	do_div(tmp, nsec);
+	return (unsigned long) tmp;
+}
+
+/**
+ * clockevent_delta2ns - convert a latch value (device cycles) to nanoseconds
+ *
+ * @latch:	value to convert
+ * @evt:	the device, with mult and shift set up
+ *
+ * Math helper, returns latch value converted to nanoseconds (bound
+ * checked to at least 1us and at most LONG_MAX)
+ */
+unsigned long clockevent_delta2ns(unsigned long latch,
+				  struct clock_event_device *evt)
+{
+	u64 clc = ((u64) latch << evt->shift);
+
+	do_div(clc, evt->mult);
+	if (clc < 1000)
+		clc = 1000;
+	if (clc > LONG_MAX)
+		clc = LONG_MAX;
+
+	return (unsigned long) clc;
+}
+
+/**
+ * clockevents_register_device - register the clock event device of this cpu
+ *
+ * @dev:	device to register
+ *
+ * Must be called on the cpu the device belongs to, with the periodic
+ * tick handler of the architecture in @dev->event_handler. Of several
+ * devices the one with the highest rating is used.
+ */
+void clockevents_register_device(struct clock_event_device *dev)
+{
+	struct clock_event_device **cur = &__get_cpu_var(local_clockevent);
+
+	if (*cur && (*cur)->rating >= dev->rating)
+		return;
+	*cur = dev;
+}
+
+/**
+ * clockevents_get_local_device - the clock event device of this cpu
+ *
+ * Returns NULL if the architecture did not register one.
+ */
+struct clock_event_device *clockevents_get_local_device(void)
+{
+	return __get_cpu_var(local_clockevent);
+}
+
+/**
+ * clockevents_set_mode - set the operating mode of a clock event device
+ *
+ * @dev:	device to modify
+ * @mode:	new mode
+ *
+ * Must be called with interrupts disabled.
+ */
+void clockevents_set_mode(struct clock_event_device *dev,
+			  enum clock_event_mode mode)
+{
+	if (dev->mode != mode) {
+		dev->set_mode(mode, dev);
+		dev->mode = mode;
+	}
+}
+
+/**
+ * clockevents_program_event - reprogram the clock event device
+ *
+ * @dev:	device to program
+ * @expires:	absolute expiry time (CLOCK_MONOTONIC)
+ * @now:	current time (CLOCK_MONOTONIC)
+ *
+ * Returns -ETIME when @expires is not in the future; otherwise the
+ * delta is clamped to what the device can do and it is programmed.
+ * Must be called with interrupts disabled.
+ */
+int clockevents_program_event(struct clock_event_device *dev,
+			      ktime_t expires, ktime_t now)
+{
+	unsigned long long clc;
+	s64 delta;
+
+	delta = ktime_to_ns(ktime_sub(expires, now));
+	if (delta <= 0)
+		return -ETIME;
+
+	dev->next_event = expires;
+
+	if (delta > dev->max_delta_ns)
+		delta = dev->max_delta_ns;
+	if (delta < dev->min_delta_ns)
+		delta = dev->min_delta_ns;
+
+	clc = delta * dev->mult;
+	clc >>= dev->shift;
+
+	return dev->set_next_event((unsigned long) clc, dev);
+}
@@ -37,6 +37,7 @@
 #include <linux/notifier.h>
 #include <linux/syscalls.h>
 #include <linux/interrupt.h>
+#include <linux/clockchips.h>
 
 #include <asm/uaccess.h>
 
@@ -392,6 +393,148 @@ remove_hrtimer(struct hrtimer *timer, struct hrtimer_base *base)
 	return 0;
 }
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+/*
+ * High-resolution mode: instead of expiring the hrtimers from the
+ * timer softirq every jiffy, each cpu programs its clock event device
+ * (see kernel/clockevents.c) in oneshot mode for the first expiring
+ * hrtimer and expires them from its interrupt. The periodic tick the
+ * device used to deliver is emulated by a per-cpu hrtimer, sched_timer,
+ * which calls the tick handler of the architecture every jiffy.
+ *
+ * The switch is done per cpu from the timer softirq, once the cpu has
+ * a oneshot capable clock event device. "highres=off" on the kernel
+ * command line keeps the jiffy based expiry.
+ */
+struct hrtimer_hres {
+	int			hres_active;
+	int			in_interrupt;	/* hrtimer_interrupt() runs */
+	ktime_t			expires_next;	/* programmed event */
+	struct clock_event_device *dev;
+	void			(*tick_handler)(struct pt_regs *regs);
+	struct pt_regs		*regs;		/* of the current interrupt */
+	struct hrtimer		sched_timer;	/* tick emulation */
+	ktime_t			tick_stopped_at;
+	unsigned long		nr_events;
+	unsigned long		nr_retries;
+};
+
+static DEFINE_PER_CPU(struct hrtimer_hres, hrtimer_hres);
+
+static int hrtimer_hres_enabled = 1;
+
+static int __init setup_hrtimer_hres(char *str)
+{
+	if (!strcmp(str, "off"))
+		hrtimer_hres_enabled = 0;
+	else if (!strcmp(str, "on"))
+		hrtimer_hres_enabled = 1;
+	else
+		return 0;
+	return 1;
+}
+__setup("highres=", setup_hrtimer_hres);
+
+/*
+ * Expiry time of the timer in CLOCK_MONOTONIC terms
+ */
+static inline ktime_t hrtimer_expires_mono(struct hrtimer *timer,
+					   ktime_t now)
+{
+	struct hrtimer_base *base = timer->base;
+
+	if (base->index == CLOCK_MONOTONIC)
+		return timer->expires;
+	return ktime_sub(timer->expires, ktime_sub(base->get_time(), now));
+}
+
+/*
+ * Program the clock event device for @expires; if that is already in
+ * the past, let it fire as soon as possible. Interrupts disabled.
+ */
+static void hrtimer_program_event(struct hrtimer_hres *hres, ktime_t expires,
+				  ktime_t now)
+{
+	hres->expires_next = expires;
+	if (clockevents_program_event(hres->dev, expires, now))
+		clockevents_program_event(hres->dev,
+			ktime_add_ns(now, hres->dev->min_delta_ns), now);
+}
+
+/*
+ * A timer became the first one of its base: program the event earlier
+ * if necessary. Called with the base lock held and interrupts disabled.
+ */
+static void hrtimer_reprogram(struct hrtimer *timer, struct hrtimer_base *base)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+	ktime_t now, expires;
+
+	/*
+	 * A timer which stays on another cpu is only re-armed from its
+	 * own callback; hrtimer_interrupt() programs the next event when
+	 * it is done.
+	 */
+	if (!hres->hres_active || hres->in_interrupt ||
+	    base != &__get_cpu_var(hrtimer_bases[base->index]))
+		return;
+
+	now = ktime_get();
+	expires = hrtimer_expires_mono(timer, now);
+	if (expires.tv64 >= hres->expires_next.tv64)
+		return;
+	hrtimer_program_event(hres, expires, now);
+}
+
+/*
+ * Program the event for the first timer of all bases of this cpu.
+ * Interrupts disabled.
+ */
+static void hrtimer_force_reprogram(void)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+	struct hrtimer_base *base = __get_cpu_var(hrtimer_bases);
+	ktime_t now, expires, expires_next;
+	int i;
+
+	if (!hres->hres_active)
+		return;
+
+	now = ktime_get();
+	expires_next.tv64 = KTIME_MAX;
+	for (i = 0; i < MAX_HRTIMER_BASES; i++, base++) {
+		spin_lock(&base->lock);
+		if (base->first) {
+			expires = hrtimer_expires_mono(rb_entry(base->first,
+						struct hrtimer, node), now);
+			if (expires.tv64 < expires_next.tv64)
+				expires_next = expires;
+		}
+		spin_unlock(&base->lock);
+	}
+	hres->expires_next = expires_next;
+	if (expires_next.tv64 != KTIME_MAX)
+		hrtimer_program_event(hres, expires_next, now);
+}
+
+static void retrigger_next_event(void *arg)
+{
+	hrtimer_force_reprogram();
+}
+
+/*
+ * The realtime clock was set: the events programmed for CLOCK_REALTIME
+ * timers are wrong now.
+ */
+void clock_was_set(void)
+{
+	on_each_cpu(retrigger_next_event, NULL, 0, 1);
+}
+
+#else
+# define hrtimer_reprogram(t, b)	do { } while (0)
+#endif /* CONFIG_HIGH_RES_TIMERS */
+
 /**
  * hrtimer_start - (re)start an relative timer on the current CPU
  *
@@ -423,6 +566,8 @@ hrtimer_start(struct hrtimer *timer, ktime_t tim, const enum hrtimer_mode mode)
 	timer->expires = tim;
 
 	enqueue_hrtimer(timer, new_base);
+	if (new_base->first == &timer->node)
+		hrtimer_reprogram(timer, new_base);
 
 	unlock_hrtimer_base(timer, &flags);
 
@@ -587,6 +732,247 @@ static inline void run_hrtimer_queue(struct hrtimer_base *base)
 	spin_unlock_irq(&base->lock);
 }
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+/*
+ * High-resolution timer interrupt, the event handler of the clock event
+ * device in oneshot mode. Expires the timers of all bases and programs
+ * the next event.
+ */
+void hrtimer_interrupt(struct pt_regs *regs)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+	struct hrtimer_base *base;
+	ktime_t expires, expires_next, now;
+	int i, retries = 0;
+
+	hres->nr_events++;
+	hres->regs = regs;
+	hres->in_interrupt = 1;
+retry:
+	now = ktime_get();
+	expires_next.tv64 = KTIME_MAX;
+
+	base = __get_cpu_var(hrtimer_bases);
+	for (i = 0; i < MAX_HRTIMER_BASES; i++, base++) {
+		ktime_t basenow = base->get_time();
+		struct rb_node *node;
+
+		spin_lock(&base->lock);
+
+		while ((node = base->first)) {
+			struct hrtimer *timer;
+			int (*fn)(void *);
+			int restart;
+			void *data;
+
+			timer = rb_entry(node, struct hrtimer, node);
+			if (basenow.tv64 < timer->expires.tv64) {
+				expires = ktime_sub(timer->expires,
+						    ktime_sub(basenow, now));
+				if (expires.tv64 < expires_next.tv64)
+					expires_next = expires;
+				break;
+			}
+
+			fn = timer->function;
+			data = timer->data;
+			set_curr_timer(base, timer);
+			timer->state = HRTIMER_RUNNING;
+			__remove_hrtimer(timer, base);
+			spin_unlock(&base->lock);
+
+			if (!fn) {
+				wake_up_process(data);
+				restart = HRTIMER_NORESTART;
+			} else
+				restart = fn(data);
+
+			spin_lock(&base->lock);
+
+			/* Another CPU has added back the timer */
+			if (timer->state != HRTIMER_RUNNING)
+				continue;
+
+			if (restart == HRTIMER_RESTART)
+				enqueue_hrtimer(timer, base);
+			else
+				timer->state = HRTIMER_EXPIRED;
+		}
+		set_curr_timer(base, NULL);
+		spin_unlock(&base->lock);
+	}
+
+	hres->expires_next = expires_next;
+	if (expires_next.tv64 != KTIME_MAX &&
+	    clockevents_program_event(hres->dev, expires_next, ktime_get())) {
+		/* The next timer expired while we were busy: */
+		hres->nr_retries++;
+		if (++retries < 3)
+			goto retry;
+		now = ktime_get();
+		hrtimer_program_event(hres, ktime_add_ns(now,
+				      hres->dev->min_delta_ns), now);
+	}
+
+	hres->in_interrupt = 0;
+	hres->regs = NULL;
+}
+
+/*
+ * Tick emulation: the clock event device no longer delivers the
+ * periodic tick, so run its old handler every jiffy.
+ */
+static int hrtimer_sched_tick(void *data)
+{
+	struct hrtimer_hres *hres = data;
+
+	hres->tick_handler(hres->regs);
+	hrtimer_forward(&hres->sched_timer, ktime_set(0, TICK_NSEC));
+
+	return HRTIMER_RESTART;
+}
+
+/*
+ * Switch this cpu to high-resolution mode, called from the timer
+ * softirq. Returns 1 if successful.
+ */
+static int hrtimer_switch_to_hres(void)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+	struct hrtimer_base *base = __get_cpu_var(hrtimer_bases);
+	struct clock_event_device *dev = clockevents_get_local_device();
+	unsigned long flags;
+	int i;
+
+	if (!dev || !(dev->features & CLOCK_EVT_FEAT_ONESHOT))
+		return 0;
+
+	local_irq_save(flags);
+
+	hres->dev = dev;
+	hres->tick_handler = dev->event_handler;
+	dev->event_handler = hrtimer_interrupt;
+	clockevents_set_mode(dev, CLOCK_EVT_MODE_ONESHOT);
+
+	for (i = 0; i < MAX_HRTIMER_BASES; i++)
+		base[i].resolution = KTIME_HIGH_RES;
+	hres->expires_next.tv64 = KTIME_MAX;
+	hres->hres_active = 1;
+
+	hrtimer_init(&hres->sched_timer, CLOCK_MONOTONIC, HRTIMER_ABS);
+	hres->sched_timer.function = hrtimer_sched_tick;
+	hres->sched_timer.data = hres;
+	hrtimer_start(&hres->sched_timer,
+		      ktime_add_ns(ktime_get(), TICK_NSEC), HRTIMER_ABS);
+	hrtimer_force_reprogram();
+
+	local_irq_restore(flags);
+
+	printk(KERN_INFO "Switched to high resolution mode on CPU %d\n",
+	       smp_processor_id());
+	return 1;
+}
+
+/**
+ * hrtimer_stop_sched_tick - stop the tick emulation of an idle cpu
+ *
+ * @ticks:	jiffies until the next timer event of the cpu
+ *
+ * Moves the next tick @ticks - 1 jiffies further. Returns 0 if the cpu
+ * is not in high-resolution mode. Called with interrupts disabled.
+ */
+int hrtimer_stop_sched_tick(unsigned long ticks)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+	struct hrtimer *timer = &hres->sched_timer;
+	struct hrtimer_base *base = timer->base;
+
+	if (!hres->hres_active)
+		return 0;
+
+	spin_lock(&base->lock);
+	if (hrtimer_active(timer)) {
+		hres->tick_stopped_at = timer->expires;
+		__remove_hrtimer(timer, base);
+		timer->expires = ktime_add_ns(timer->expires,
+					      (u64)(ticks - 1) * TICK_NSEC);
+		enqueue_hrtimer(timer, base);
+	}
+	spin_unlock(&base->lock);
+	hrtimer_force_reprogram();
+	return 1;
+}
+
+/**
+ * hrtimer_restart_sched_tick - restart the tick emulation
+ *
+ * Returns 0 if the cpu is not in high-resolution mode. Called with
+ * interrupts disabled.
+ */
+int hrtimer_restart_sched_tick(void)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+	struct hrtimer *timer = &hres->sched_timer;
+	struct hrtimer_base *base = timer->base;
+
+	if (!hres->hres_active)
+		return 0;
+
+	spin_lock(&base->lock);
+	if (hrtimer_active(timer)) {
+		__remove_hrtimer(timer, base);
+		timer->expires = hres->tick_stopped_at;
+		hrtimer_forward(timer, ktime_set(0, TICK_NSEC));
+		enqueue_hrtimer(timer, base);
+	}
+	spin_unlock(&base->lock);
+	hrtimer_force_reprogram();
+	return 1;
+}
+#endif /* CONFIG_HIGH_RES_TIMERS */
+
+#ifdef CONFIG_NO_IDLE_HZ
+/**
+ * hrtimer_get_next_event - get the time until next expiry event
+ *
+ * Returns the delta to the next expiry event or KTIME_MAX if no timer
+ * is pending.
+ */
+ktime_t hrtimer_get_next_event(void)
+{
+	struct hrtimer_base *base = __get_cpu_var(hrtimer_bases);
+	ktime_t delta, mindelta = { .tv64 = KTIME_MAX };
+	unsigned long flags;
+	int i;
+
+	for (i = 0; i < MAX_HRTIMER_BASES; i++, base++) {
+		struct rb_node *node;
+		struct hrtimer *timer;
+
+		spin_lock_irqsave(&base->lock, flags);
+		node = base->first;
+#ifdef CONFIG_HIGH_RES_TIMERS
+		/* the tick emulation is what we are about to stop */
+		if (node == &__get_cpu_var(hrtimer_hres).sched_timer.node)
+			node = rb_next(node);
+#endif
+		if (!node) {
+			spin_unlock_irqrestore(&base->lock, flags);
+			continue;
+		}
+		timer = rb_entry(node, struct hrtimer, node);
+		delta.tv64 = timer->expires.tv64;
+		spin_unlock_irqrestore(&base->lock, flags);
+		delta = ktime_sub(delta, base->get_time());
+		if (delta.tv64 < mindelta.tv64)
+			mindelta.tv64 = delta.tv64;
+	}
+	if (mindelta.tv64 < 0)
+		mindelta.tv64 = 0;
+	return mindelta;
+}
+#endif
+
 /*
  * Called from timer softirq every jiffy, expire hrtimers:
  */
@@ -595,6 +981,13 @@ void hrtimer_run_queues(void)
 	struct hrtimer_base *base = __get_cpu_var(hrtimer_bases);
 	int i;
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+	if (__get_cpu_var(hrtimer_hres).hres_active)
+		return;
+	if (hrtimer_hres_enabled && hrtimer_switch_to_hres())
+		return;
+#endif
+
 	for (i = 0; i < MAX_HRTIMER_BASES; i++)
 		run_hrtimer_queue(&base[i]);
 }
@@ -738,8 +1131,16 @@ static void __devinit init_hrtimers_cpu(int cpu)
 	struct hrtimer_base *base = per_cpu(hrtimer_bases, cpu);
 	int i;
 
-	for (i = 0; i < MAX_HRTIMER_BASES; i++, base++)
+	for (i = 0; i < MAX_HRTIMER_BASES; i++, base++) {
 		spin_lock_init(&base->lock);
+#ifdef CONFIG_HIGH_RES_TIMERS
+		base->resolution = base->index == CLOCK_REALTIME ?
+			KTIME_REALTIME_RES : KTIME_MONOTONIC_RES;
+#endif
+	}
+#ifdef CONFIG_HIGH_RES_TIMERS
+	per_cpu(hrtimer_hres, cpu).hres_active = 0;
+#endif
 }
 
 #ifdef CONFIG_HOTPLUG_CPU
@@ -764,6 +1165,11 @@ static void migrate_hrtimers(int cpu)
 	int i;
 
 	BUG_ON(cpu_online(cpu));
+#ifdef CONFIG_HIGH_RES_TIMERS
+	/* The tick emulation of the dead cpu is not needed elsewhere */
+	if (per_cpu(hrtimer_hres, cpu).hres_active)
+		hrtimer_cancel(&per_cpu(hrtimer_hres, cpu).sched_timer);
+#endif
 	old_base = per_cpu(hrtimer_bases, cpu);
 	new_base = get_cpu_var(hrtimer_bases);
 
@@ -783,6 +1189,9 @@ static void migrate_hrtimers(int cpu)
 		old_base++;
 		new_base++;
 	}
+#ifdef CONFIG_HIGH_RES_TIMERS
+	hrtimer_force_reprogram();
+#endif
 
 	local_irq_enable();
 	put_cpu_var(hrtimer_bases);
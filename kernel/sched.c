@@ -16,6 +16,8 @@
  *		by Davide Libenzi, preemptible kernel bits by Robert Love.
  *  2003-09-03	Interactivity tuning by Con Kolivas.
  *  2004-04-02	Scheduler domains code by Nick Piggin
+ *  2006-01-20	Scheduling classes, and the virtual-runtime based
+ *		fair class in kernel/sched_fair.c
  */
 
 #include <linux/mm.h>
@@ -49,7 +51,9 @@
 #include <linux/syscalls.h>
 #include <linux/times.h>
 #include <linux/acct.h>
+#include <linux/rbtree.h>
 #include <asm/tlb.h>
+#include <asm/div64.h>
 
 #include <asm/unistd.h>
 
@@ -199,6 +203,90 @@ struct prio_array {
 	struct list_head queue[MAX_PRIO];
 };
 
+/*
+ * The fair class keeps its runnable tasks in a red-black tree sorted by
+ * virtual runtime. The running task is taken out of the tree while it
+ * runs and is tracked in ->curr instead.
+ */
+struct cfs_rq {
+	unsigned long nr_running;
+	unsigned long load;		/* sum of the queued tasks' weights */
+	unsigned long long min_vruntime;
+	struct rb_root tasks_timeline;
+	struct rb_node *rb_leftmost;	/* cached rb_first() */
+	task_t *curr;
+};
+
+/*
+ * A scheduling class implements the policy for the tasks attached to it
+ * through p->sched_class. All methods are called with the runqueue lock
+ * held. The classes form a list in order of precedence: schedule() runs
+ * a task from the first class that has one queued.
+ *
+ *  enqueue_task:	add a runnable task. @wakeup is set when the task
+ *			comes back from a sleep that should be credited.
+ *  dequeue_task:	remove a task that stops being runnable or moves.
+ *  yield_task:		sys_sched_yield() for the running task.
+ *  check_preempt_curr:	reschedule rq->curr if the newly queued task of
+ *			the same class should run instead.
+ *  pick_next_task:	choose (and start accounting) the next task to
+ *			run, or return NULL if the class has none.
+ *  put_prev_task:	the running task is being switched out.
+ *  task_tick:		timer tick while a task of the class runs.
+ *  task_new:		queue a freshly forked task.
+ *  load_balance:	pull up to max_nr_move tasks from busiest.
+ */
+struct sched_class {
+	struct sched_class *next;
+
+	void (*enqueue_task)(runqueue_t *rq, task_t *p, int wakeup);
+	void (*dequeue_task)(runqueue_t *rq, task_t *p);
+	void (*yield_task)(runqueue_t *rq, task_t *p);
+	void (*check_preempt_curr)(runqueue_t *rq, task_t *p);
+
+	task_t *(*pick_next_task)(runqueue_t *rq, unsigned long long now);
+	void (*put_prev_task)(runqueue_t *rq, task_t *p);
+
+	void (*task_tick)(runqueue_t *rq, task_t *p);
+	void (*task_new)(runqueue_t *rq, task_t *p, unsigned long clone_flags);
+
+#ifdef CONFIG_SMP
+	int (*load_balance)(runqueue_t *this_rq, int this_cpu,
+			runqueue_t *busiest, unsigned long max_nr_move,
+			struct sched_domain *sd, enum idle_type idle,
+			int *all_pinned);
+#endif
+};
+
+#define sched_class_highest	(&prio_sched_class)
+
+static struct sched_class fair_sched_class;
+
+/*
+ * RT tasks always belong to the priority-array (O(1)) class. SCHED_NORMAL
+ * and SCHED_BATCH tasks go there as well unless "sched=fair" was given
+ * on the command line, in which case the fair class runs them.
+ */
+static struct sched_class *normal_sched_class = &prio_sched_class;
+
+static int __init sched_class_setup(char *str)
+{
+	if (!strcmp(str, "fair") || !strcmp(str, "cfs"))
+		normal_sched_class = &fair_sched_class;
+	else if (strcmp(str, "o1"))
+		printk(KERN_WARNING "sched: unknown class \"%s\"\n", str);
+	return 1;
+}
+
+__setup("sched=", sched_class_setup);
+
+static inline struct sched_class *policy_sched_class(unsigned long policy)
+{
+	if (policy == SCHED_NORMAL || policy == SCHED_BATCH)
+		return normal_sched_class;
+	return &prio_sched_class;
+}
+
 /*
  * This is the main, per-CPU runqueue data structure.
  *
@@ -234,6 +322,7 @@ struct runqueue {
 	struct mm_struct *prev_mm;
 	prio_array_t *active, *expired, arrays[2];
 	int best_expired_prio;
+	struct cfs_rq cfs;
 	atomic_t nr_iowait;
 
 #ifdef CONFIG_SMP
@@ -382,6 +471,24 @@ static inline void task_rq_unlock(runqueue_t *rq, unsigned long *flags)
 	spin_unlock_irqrestore(&rq->lock, *flags);
 }
 
+/*
+ * rq_clock - sched_clock() in the timebase of a given runqueue.
+ * Compensates for drifting sched_clock between CPUs when @rq is not
+ * the local runqueue.
+ */
+static inline unsigned long long rq_clock(runqueue_t *rq)
+{
+	unsigned long long now = sched_clock();
+#ifdef CONFIG_SMP
+	runqueue_t *this_rq = this_rq();
+
+	if (rq != this_rq)
+		now = (now - this_rq->timestamp_last_tick)
+			+ rq->timestamp_last_tick;
+#endif
+	return now;
+}
+
 #ifdef CONFIG_SCHEDSTATS
 /*
  * bump this up when changing the output format or the meaning of an existing
@@ -729,7 +836,8 @@ static inline void dec_nr_running(task_t *p, runqueue_t *rq)
  */
 static inline void __activate_task(task_t *p, runqueue_t *rq)
 {
-	enqueue_task(p, rq->active);
+	p->sched_class->enqueue_task(rq, p, 0);
+	p->on_rq = 1;
 	inc_nr_running(p, rq);
 }
 
@@ -739,6 +847,7 @@ static inline void __activate_task(task_t *p, runqueue_t *rq)
 static inline void __activate_idle_task(task_t *p, runqueue_t *rq)
 {
 	enqueue_task_head(p, rq->active);
+	p->on_rq = 1;
 	inc_nr_running(p, rq);
 }
 
@@ -809,24 +918,20 @@ static int recalc_task_prio(task_t *p, unsigned long long now)
 }
 
 /*
- * activate_task - move a task to the runqueue and do priority recalculation
+ * enqueue_task_prio - put a task on the active array. A task coming
+ * back from sleep gets its priority recalculated first.
  *
  * Update all the scheduling statistics stuff. (sleep average
  * calculation, priority modifiers, etc.)
  */
-static void activate_task(task_t *p, runqueue_t *rq, int local)
+static void enqueue_task_prio(runqueue_t *rq, task_t *p, int wakeup)
 {
 	unsigned long long now;
 
-	now = sched_clock();
-#ifdef CONFIG_SMP
-	if (!local) {
-		/* Compensate for drifting sched_clock */
-		runqueue_t *this_rq = this_rq();
-		now = (now - this_rq->timestamp_last_tick)
-			+ rq->timestamp_last_tick;
-	}
-#endif
+	if (!wakeup)
+		goto enqueue;
+
+	now = rq_clock(rq);
 
 	if (!rt_task(p))
 		p->prio = recalc_task_prio(p, now);
@@ -854,8 +959,24 @@ static void activate_task(task_t *p, runqueue_t *rq, int local)
 		}
 	}
 	p->timestamp = now;
+enqueue:
+	enqueue_task(p, rq->active);
+}
 
-	__activate_task(p, rq);
+static void dequeue_task_prio(runqueue_t *rq, task_t *p)
+{
+	dequeue_task(p, p->array);
+	p->array = NULL;
+}
+
+/*
+ * activate_task - move a task that woke up to the runqueue
+ */
+static void activate_task(task_t *p, runqueue_t *rq)
+{
+	p->sched_class->enqueue_task(rq, p, 1);
+	p->on_rq = 1;
+	inc_nr_running(p, rq);
 }
 
 /*
@@ -864,8 +985,8 @@ static void activate_task(task_t *p, runqueue_t *rq, int local)
 static void deactivate_task(struct task_struct *p, runqueue_t *rq)
 {
 	dec_nr_running(p, rq);
-	dequeue_task(p, p->array);
-	p->array = NULL;
+	p->sched_class->dequeue_task(rq, p);
+	p->on_rq = 0;
 }
 
 /*
@@ -913,6 +1034,28 @@ inline int task_curr(const task_t *p)
 	return cpu_curr(task_cpu(p)) == p;
 }
 
+/*
+ * check_preempt_curr - reschedule rq->curr if @p, which has just been
+ * queued on @rq, should run instead. Within one class the class decides;
+ * across classes (and against the idle task) the priority bands decide:
+ * RT tasks sit below MAX_RT_PRIO, all others above it.
+ */
+static inline void check_preempt_curr(runqueue_t *rq, task_t *p)
+{
+	task_t *curr = rq->curr;
+
+	if (p->sched_class == curr->sched_class && curr != rq->idle)
+		p->sched_class->check_preempt_curr(rq, p);
+	else if (TASK_PREEMPTS_CURR(p, rq))
+		resched_task(curr);
+}
+
+static void check_preempt_curr_prio(runqueue_t *rq, task_t *p)
+{
+	if (TASK_PREEMPTS_CURR(p, rq))
+		resched_task(rq->curr);
+}
+
 #ifdef CONFIG_SMP
 typedef struct {
 	struct list_head list;
@@ -935,7 +1078,7 @@ static int migrate_task(task_t *p, int dest_cpu, migration_req_t *req)
 	 * If the task is not on a runqueue (and not running), then
 	 * it is sufficient to simply update the task's cpu field.
 	 */
-	if (!p->array && !task_running(rq, p)) {
+	if (!p->on_rq && !task_running(rq, p)) {
 		set_task_cpu(p, dest_cpu);
 		return 0;
 	}
@@ -965,7 +1108,7 @@ void wait_task_inactive(task_t *p)
 repeat:
 	rq = task_rq_lock(p, &flags);
 	/* Must be off runqueue entirely, not preempted. */
-	if (unlikely(p->array || task_running(rq, p))) {
+	if (unlikely(p->on_rq || task_running(rq, p))) {
 		/* If it's preempted, we yield.  It could be a while. */
 		preempted = !task_running(rq, p);
 		task_rq_unlock(rq, &flags);
@@ -1268,7 +1411,7 @@ static int try_to_wake_up(task_t *p, unsigned int state, int sync)
 	if (!(old_state & state))
 		goto out;
 
-	if (p->array)
+	if (p->on_rq)
 		goto out_running;
 
 	cpu = task_cpu(p);
@@ -1360,7 +1503,7 @@ out_set_cpu:
 		old_state = p->state;
 		if (!(old_state & state))
 			goto out;
-		if (p->array)
+		if (p->on_rq)
 			goto out_running;
 
 		this_cpu = smp_processor_id();
@@ -1389,7 +1532,7 @@ out_activate:
 	if (old_state & TASK_NONINTERACTIVE)
 		__activate_task(p, rq);
 	else
-		activate_task(p, rq, cpu == this_cpu);
+		activate_task(p, rq);
 	/*
 	 * Sync wakeups (i.e. those types of wakeups where the waker
 	 * has indicated that it will leave the CPU in short order)
@@ -1398,10 +1541,8 @@ out_activate:
 	 * the waker guarantees that the freshly woken up task is going
 	 * to be considered on this CPU.)
 	 */
-	if (!sync || cpu != this_cpu) {
-		if (TASK_PREEMPTS_CURR(p, rq))
-			resched_task(rq->curr);
-	}
+	if (!sync || cpu != this_cpu)
+		check_preempt_curr(rq, p);
 	success = 1;
 
 out_running:
@@ -1447,6 +1588,10 @@ void fastcall sched_fork(task_t *p, int clone_flags)
 	p->state = TASK_RUNNING;
 	INIT_LIST_HEAD(&p->run_list);
 	p->array = NULL;
+	p->sched_class = policy_sched_class(p->policy);
+	p->on_rq = 0;
+	p->vruntime = 0;
+	p->sum_exec_runtime = p->prev_sum_exec_runtime = 0;
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->sched_info, 0, sizeof(p->sched_info));
 #endif
@@ -1487,6 +1632,49 @@ void fastcall sched_fork(task_t *p, int clone_flags)
 	put_cpu();
 }
 
+/*
+ * task_new_prio - queue a new task on the priority arrays.
+ *
+ * We decrease the sleep average of forking parents and children as
+ * well, to keep max-interactive tasks from forking tasks that are
+ * max-interactive. The parent is done by wake_up_new_task(), under
+ * its own runqueue lock.
+ */
+static void task_new_prio(runqueue_t *rq, task_t *p, unsigned long clone_flags)
+{
+	p->sleep_avg = JIFFIES_TO_NS(CURRENT_BONUS(p) *
+		CHILD_PENALTY / 100 * MAX_SLEEP_AVG / MAX_BONUS);
+
+	p->prio = effective_prio(p);
+
+	if (rq != this_rq()) {
+		__activate_task(p, rq);
+		check_preempt_curr(rq, p);
+		return;
+	}
+
+	if (!(clone_flags & CLONE_VM)) {
+		/*
+		 * The VM isn't cloned, so we're in a good position to
+		 * do child-runs-first in anticipation of an exec. This
+		 * usually avoids a lot of COW overhead.
+		 */
+		if (unlikely(!current->array))
+			__activate_task(p, rq);
+		else {
+			p->prio = current->prio;
+			list_add_tail(&p->run_list, &current->run_list);
+			p->array = current->array;
+			p->array->nr_active++;
+			p->on_rq = 1;
+			inc_nr_running(p, rq);
+		}
+		set_need_resched();
+	} else
+		/* Run child last */
+		__activate_task(p, rq);
+}
+
 /*
  * wake_up_new_task - wake up a newly created task for the first time.
  *
@@ -1505,37 +1693,8 @@ void fastcall wake_up_new_task(task_t *p, unsigned long clone_flags)
 	this_cpu = smp_processor_id();
 	cpu = task_cpu(p);
 
-	/*
-	 * We decrease the sleep average of forking parents
-	 * and children as well, to keep max-interactive tasks
-	 * from forking tasks that are max-interactive. The parent
-	 * (current) is done further down, under its lock.
-	 */
-	p->sleep_avg = JIFFIES_TO_NS(CURRENT_BONUS(p) *
-		CHILD_PENALTY / 100 * MAX_SLEEP_AVG / MAX_BONUS);
-
-	p->prio = effective_prio(p);
-
 	if (likely(cpu == this_cpu)) {
-		if (!(clone_flags & CLONE_VM)) {
-			/*
-			 * The VM isn't cloned, so we're in a good position to
-			 * do child-runs-first in anticipation of an exec. This
-			 * usually avoids a lot of COW overhead.
-			 */
-			if (unlikely(!current->array))
-				__activate_task(p, rq);
-			else {
-				p->prio = current->prio;
-				list_add_tail(&p->run_list, &current->run_list);
-				p->array = current->array;
-				p->array->nr_active++;
-				inc_nr_running(p, rq);
-			}
-			set_need_resched();
-		} else
-			/* Run child last */
-			__activate_task(p, rq);
+		p->sched_class->task_new(rq, p, clone_flags);
 		/*
 		 * We skip the following code due to cpu == this_cpu
 	 	 *
@@ -1552,9 +1711,7 @@ void fastcall wake_up_new_task(task_t *p, unsigned long clone_flags)
 		 */
 		p->timestamp = (p->timestamp - this_rq->timestamp_last_tick)
 					+ rq->timestamp_last_tick;
-		__activate_task(p, rq);
-		if (TASK_PREEMPTS_CURR(p, rq))
-			resched_task(rq->curr);
+		p->sched_class->task_new(rq, p, clone_flags);
 
 		/*
 		 * Parent and child are on different CPUs, now get the
@@ -1885,8 +2042,7 @@ void pull_task(runqueue_t *src_rq, prio_array_t *src_array, task_t *p,
 	 * Note that idle threads have a prio of MAX_PRIO, for this test
 	 * to be always true for them.
 	 */
-	if (TASK_PREEMPTS_CURR(p, this_rq))
-		resched_task(this_rq->curr);
+	check_preempt_curr(this_rq, p);
 }
 
 /*
@@ -1925,26 +2081,19 @@ int can_migrate_task(task_t *p, runqueue_t *rq, int this_cpu,
 }
 
 /*
- * move_tasks tries to move up to max_nr_move tasks from busiest to this_rq,
- * as part of a balancing operation within "domain". Returns the number of
- * tasks moved.
- *
- * Called with both runqueues locked.
+ * load_balance_prio - move up to max_nr_move tasks of the priority arrays
+ * from busiest to this_rq. Returns the number of tasks moved.
  */
-static int move_tasks(runqueue_t *this_rq, int this_cpu, runqueue_t *busiest,
-		      unsigned long max_nr_move, struct sched_domain *sd,
-		      enum idle_type idle, int *all_pinned)
+static int load_balance_prio(runqueue_t *this_rq, int this_cpu,
+			     runqueue_t *busiest, unsigned long max_nr_move,
+			     struct sched_domain *sd, enum idle_type idle,
+			     int *all_pinned)
 {
 	prio_array_t *array, *dst_array;
 	struct list_head *head, *curr;
-	int idx, pulled = 0, pinned = 0;
+	int idx, pulled = 0;
 	task_t *tmp;
 
-	if (max_nr_move == 0)
-		goto out;
-
-	pinned = 1;
-
 	/*
 	 * We first consider expired tasks. Those will likely not be
 	 * executed in the near future, and they are most likely to
@@ -1983,7 +2132,7 @@ skip_queue:
 
 	curr = curr->prev;
 
-	if (!can_migrate_task(tmp, busiest, this_cpu, sd, idle, &pinned)) {
+	if (!can_migrate_task(tmp, busiest, this_cpu, sd, idle, all_pinned)) {
 		if (curr != head)
 			goto skip_queue;
 		idx++;
@@ -2005,6 +2154,34 @@ skip_queue:
 		idx++;
 		goto skip_bitmap;
 	}
+out:
+	return pulled;
+}
+
+/*
+ * move_tasks tries to move up to max_nr_move tasks from busiest to this_rq,
+ * as part of a balancing operation within "domain". Returns the number of
+ * tasks moved. The scheduling classes are asked in order of precedence.
+ *
+ * Called with both runqueues locked.
+ */
+static int move_tasks(runqueue_t *this_rq, int this_cpu, runqueue_t *busiest,
+		      unsigned long max_nr_move, struct sched_domain *sd,
+		      enum idle_type idle, int *all_pinned)
+{
+	struct sched_class *class = sched_class_highest;
+	int pulled = 0, pinned = 0;
+
+	if (max_nr_move == 0)
+		goto out;
+
+	pinned = 1;
+
+	do {
+		pulled += class->load_balance(this_rq, this_cpu, busiest,
+				max_nr_move - pulled, sd, idle, &pinned);
+		class = class->next;
+	} while (class && pulled < max_nr_move);
 out:
 	/*
 	 * Right now, this is the only place pull_task() is called,
@@ -2655,36 +2832,15 @@ void account_steal_time(struct task_struct *p, cputime_t steal)
 }
 
 /*
- * This function gets called by the timer code, with HZ frequency.
- * We call it with interrupts disabled.
- *
- * It also gets called by the fork code, when changing the parent's
- * timeslices.
+ * task_tick_prio - timeslice handling of the priority-array class.
  */
-void scheduler_tick(void)
+static void task_tick_prio(runqueue_t *rq, task_t *p)
 {
-	int cpu = smp_processor_id();
-	runqueue_t *rq = this_rq();
-	task_t *p = current;
-	unsigned long long now = sched_clock();
-
-	update_cpu_clock(p, rq, now);
-
-	rq->timestamp_last_tick = now;
-
-	if (p == rq->idle) {
-		if (wake_priority_sleeper(rq))
-			goto out;
-		rebalance_tick(cpu, rq, SCHED_IDLE);
-		return;
-	}
-
 	/* Task might have expired already, but not scheduled off yet */
 	if (p->array != rq->active) {
 		set_tsk_need_resched(p);
-		goto out;
+		return;
 	}
-	spin_lock(&rq->lock);
 	/*
 	 * The task was running during this tick - update the
 	 * time slice counter. Note: we do not update a thread's
@@ -2705,7 +2861,7 @@ void scheduler_tick(void)
 			/* put it at the end of the queue: */
 			requeue_task(p, rq->active);
 		}
-		goto out_unlock;
+		return;
 	}
 	if (!--p->time_slice) {
 		dequeue_task(p, rq->active);
@@ -2748,7 +2904,35 @@ void scheduler_tick(void)
 			set_tsk_need_resched(p);
 		}
 	}
-out_unlock:
+}
+
+/*
+ * This function gets called by the timer code, with HZ frequency.
+ * We call it with interrupts disabled.
+ *
+ * It also gets called by the fork code, when changing the parent's
+ * timeslices.
+ */
+void scheduler_tick(void)
+{
+	int cpu = smp_processor_id();
+	runqueue_t *rq = this_rq();
+	task_t *p = current;
+	unsigned long long now = sched_clock();
+
+	update_cpu_clock(p, rq, now);
+
+	rq->timestamp_last_tick = now;
+
+	if (p == rq->idle) {
+		if (wake_priority_sleeper(rq))
+			goto out;
+		rebalance_tick(cpu, rq, SCHED_IDLE);
+		return;
+	}
+
+	spin_lock(&rq->lock);
+	p->sched_class->task_tick(rq, p);
 	spin_unlock(&rq->lock);
 out:
 	rebalance_tick(cpu, rq, NOT_IDLE);
@@ -2850,7 +3034,9 @@ static int dependent_sleeper(int this_cpu, runqueue_t *this_rq)
 	array = this_rq->active;
 	if (!array->nr_active)
 		array = this_rq->expired;
-	BUG_ON(!array->nr_active);
+	/* Only tasks on the priority arrays take part in SMT nice */
+	if (!array->nr_active)
+		goto out_unlock;
 
 	p = list_entry(array->queue[sched_find_first_bit(array->bitmap)].next,
 		task_t, run_list);
@@ -2959,6 +3145,84 @@ EXPORT_SYMBOL(sub_preempt_count);
 
 #endif
 
+/*
+ * pick_next_task_prio - take the highest priority task off the active
+ * array, switching arrays when the active one ran empty.
+ */
+static task_t *pick_next_task_prio(runqueue_t *rq, unsigned long long now)
+{
+	prio_array_t *array = rq->active;
+	struct list_head *queue;
+	int idx, new_prio;
+	task_t *next;
+
+	if (unlikely(!array->nr_active)) {
+		if (!rq->expired->nr_active)
+			return NULL;
+		/*
+		 * Switch the active and expired arrays.
+		 */
+		schedstat_inc(rq, sched_switch);
+		rq->active = rq->expired;
+		rq->expired = array;
+		array = rq->active;
+		rq->expired_timestamp = 0;
+		rq->best_expired_prio = MAX_PRIO;
+	}
+
+	idx = sched_find_first_bit(array->bitmap);
+	queue = array->queue + idx;
+	next = list_entry(queue->next, task_t, run_list);
+
+	if (!rt_task(next) && next->activated > 0) {
+		unsigned long long delta = now - next->timestamp;
+		if (unlikely((long long)(now - next->timestamp) < 0))
+			delta = 0;
+
+		if (next->activated == 1)
+			delta = delta * (ON_RUNQUEUE_WEIGHT * 128 / 100) / 128;
+
+		array = next->array;
+		new_prio = recalc_task_prio(next, next->timestamp + delta);
+
+		if (unlikely(next->prio != new_prio)) {
+			dequeue_task(next, array);
+			next->prio = new_prio;
+			enqueue_task(next, array);
+		} else
+			requeue_task(next, array);
+	}
+	next->activated = 0;
+
+	return next;
+}
+
+/*
+ * The running task of the priority arrays stays queued, so there is
+ * nothing to do when it is switched out.
+ */
+static void put_prev_task_prio(runqueue_t *rq, task_t *p)
+{
+}
+
+/*
+ * pick_next_task - ask the scheduling classes, in order, for a task.
+ * The caller has made sure that rq->nr_running is not zero.
+ */
+static inline task_t *pick_next_task(runqueue_t *rq, unsigned long long now)
+{
+	struct sched_class *class;
+	task_t *p;
+
+	for (class = sched_class_highest; class; class = class->next) {
+		p = class->pick_next_task(rq, now);
+		if (p)
+			return p;
+	}
+	BUG();
+	return NULL;
+}
+
 /*
  * schedule() is the main scheduler function.
  */
@@ -2967,11 +3231,9 @@ asmlinkage void __sched schedule(void)
 	long *switch_count;
 	task_t *prev, *next;
 	runqueue_t *rq;
-	prio_array_t *array;
-	struct list_head *queue;
 	unsigned long long now;
 	unsigned long run_time;
-	int cpu, idx, new_prio;
+	int cpu;
 
 	/*
 	 * Test if we are atomic.  Since do_exit() needs to call into
@@ -3036,6 +3298,7 @@ need_resched_nonpreemptible:
 			deactivate_task(prev, rq);
 		}
 	}
+	prev->sched_class->put_prev_task(rq, prev);
 
 	cpu = smp_processor_id();
 	if (unlikely(!rq->nr_running)) {
@@ -3067,42 +3330,7 @@ go_idle:
 			goto go_idle;
 	}
 
-	array = rq->active;
-	if (unlikely(!array->nr_active)) {
-		/*
-		 * Switch the active and expired arrays.
-		 */
-		schedstat_inc(rq, sched_switch);
-		rq->active = rq->expired;
-		rq->expired = array;
-		array = rq->active;
-		rq->expired_timestamp = 0;
-		rq->best_expired_prio = MAX_PRIO;
-	}
-
-	idx = sched_find_first_bit(array->bitmap);
-	queue = array->queue + idx;
-	next = list_entry(queue->next, task_t, run_list);
-
-	if (!rt_task(next) && next->activated > 0) {
-		unsigned long long delta = now - next->timestamp;
-		if (unlikely((long long)(now - next->timestamp) < 0))
-			delta = 0;
-
-		if (next->activated == 1)
-			delta = delta * (ON_RUNQUEUE_WEIGHT * 128 / 100) / 128;
-
-		array = next->array;
-		new_prio = recalc_task_prio(next, next->timestamp + delta);
-
-		if (unlikely(next->prio != new_prio)) {
-			dequeue_task(next, array);
-			next->prio = new_prio;
-			enqueue_task(next, array);
-		} else
-			requeue_task(next, array);
-	}
-	next->activated = 0;
+	next = pick_next_task(rq, now);
 switch_tasks:
 	if (next == rq->idle)
 		schedstat_inc(rq, sched_goidle);
@@ -3549,9 +3777,8 @@ EXPORT_SYMBOL(sleep_on_timeout);
 void set_user_nice(task_t *p, long nice)
 {
 	unsigned long flags;
-	prio_array_t *array;
 	runqueue_t *rq;
-	int old_prio, new_prio, delta;
+	int old_prio, new_prio, delta, on_rq;
 
 	if (TASK_NICE(p) == nice || nice < -20 || nice > 19)
 		return;
@@ -3570,9 +3797,9 @@ void set_user_nice(task_t *p, long nice)
 		p->static_prio = NICE_TO_PRIO(nice);
 		goto out_unlock;
 	}
-	array = p->array;
-	if (array) {
-		dequeue_task(p, array);
+	on_rq = p->on_rq;
+	if (on_rq) {
+		p->sched_class->dequeue_task(rq, p);
 		dec_prio_bias(rq, p->static_prio);
 	}
 
@@ -3582,8 +3809,8 @@ void set_user_nice(task_t *p, long nice)
 	p->static_prio = NICE_TO_PRIO(nice);
 	p->prio += delta;
 
-	if (array) {
-		enqueue_task(p, array);
+	if (on_rq) {
+		p->sched_class->enqueue_task(rq, p, 0);
 		inc_prio_bias(rq, p->static_prio);
 		/*
 		 * If the task increased its priority or is running and
@@ -3707,9 +3934,10 @@ static inline task_t *find_process_by_pid(pid_t pid)
 /* Actually do priority change: must hold rq lock. */
 static void __setscheduler(struct task_struct *p, int policy, int prio)
 {
-	BUG_ON(p->array);
+	BUG_ON(p->on_rq);
 	p->policy = policy;
 	p->rt_priority = prio;
+	p->sched_class = policy_sched_class(policy);
 	if (policy != SCHED_NORMAL && policy != SCHED_BATCH) {
 		p->prio = MAX_RT_PRIO-1 - p->rt_priority;
 	} else {
@@ -3733,8 +3961,7 @@ int sched_setscheduler(struct task_struct *p, int policy,
 		       struct sched_param *param)
 {
 	int retval;
-	int oldprio, oldpolicy = -1;
-	prio_array_t *array;
+	int oldprio, oldpolicy = -1, on_rq;
 	unsigned long flags;
 	runqueue_t *rq;
 
@@ -3796,12 +4023,12 @@ recheck:
 		task_rq_unlock(rq, &flags);
 		goto recheck;
 	}
-	array = p->array;
-	if (array)
+	on_rq = p->on_rq;
+	if (on_rq)
 		deactivate_task(p, rq);
 	oldprio = p->prio;
 	__setscheduler(p, policy, param->sched_priority);
-	if (array) {
+	if (on_rq) {
 		__activate_task(p, rq);
 		/*
 		 * Reschedule if we are currently running on this runqueue and
@@ -3811,8 +4038,8 @@ recheck:
 		if (task_running(rq, p)) {
 			if (p->prio > oldprio)
 				resched_task(rq->curr);
-		} else if (TASK_PREEMPTS_CURR(p, rq))
-			resched_task(rq->curr);
+		} else
+			check_preempt_curr(rq, p);
 	}
 	task_rq_unlock(rq, &flags);
 	return 0;
@@ -4067,28 +4294,16 @@ asmlinkage long sys_sched_getaffinity(pid_t pid, unsigned int len,
 	return sizeof(cpumask_t);
 }
 
-/**
- * sys_sched_yield - yield the current processor to other threads.
- *
- * this function yields the current CPU by moving the calling thread
- * to the expired array. If there are no other threads running on this
- * CPU then this function will return.
+/*
+ * yield_task_prio - move the task to the expired array.
+ * (special rule: RT tasks will just roundrobin in the active array.)
  */
-asmlinkage long sys_sched_yield(void)
+static void yield_task_prio(runqueue_t *rq, task_t *p)
 {
-	runqueue_t *rq = this_rq_lock();
-	prio_array_t *array = current->array;
+	prio_array_t *array = p->array;
 	prio_array_t *target = rq->expired;
 
-	schedstat_inc(rq, yld_cnt);
-	/*
-	 * We implement yielding by moving the task into the expired
-	 * queue.
-	 *
-	 * (special rule: RT tasks will just roundrobin in the active
-	 *  array.)
-	 */
-	if (rt_task(current))
+	if (rt_task(p))
 		target = rq->active;
 
 	if (array->nr_active == 1) {
@@ -4099,13 +4314,29 @@ asmlinkage long sys_sched_yield(void)
 		schedstat_inc(rq, yld_exp_empty);
 
 	if (array != target) {
-		dequeue_task(current, array);
-		enqueue_task(current, target);
+		dequeue_task(p, array);
+		enqueue_task(p, target);
 	} else
 		/*
 		 * requeue_task is cheaper so perform that if possible.
 		 */
-		requeue_task(current, array);
+		requeue_task(p, array);
+}
+
+/**
+ * sys_sched_yield - yield the current processor to other threads.
+ *
+ * this function yields the current CPU by letting the scheduling class
+ * queue the calling thread behind the other runnable threads (for the
+ * priority arrays: move it to the expired array). If there are no other
+ * threads running on this CPU then this function will return.
+ */
+asmlinkage long sys_sched_yield(void)
+{
+	runqueue_t *rq = this_rq_lock();
+
+	schedstat_inc(rq, yld_cnt);
+	current->sched_class->yield_task(rq, current);
 
 	/*
 	 * Since we are going to call schedule() anyway, there's
@@ -4436,6 +4667,8 @@ void __devinit init_idle(task_t *idle, int cpu)
 
 	idle->sleep_avg = 0;
 	idle->array = NULL;
+	idle->on_rq = 0;
+	idle->sched_class = &prio_sched_class;
 	idle->prio = MAX_PRIO;
 	idle->state = TASK_RUNNING;
 	idle->cpus_allowed = cpumask_of_cpu(cpu);
@@ -4552,7 +4785,7 @@ static void __migrate_task(struct task_struct *p, int src_cpu, int dest_cpu)
 		goto out;
 
 	set_task_cpu(p, dest_cpu);
-	if (p->array) {
+	if (p->on_rq) {
 		/*
 		 * Sync timestamp with rq_dest's before activating.
 		 * The same thing could be achieved by doing this step
@@ -4562,9 +4795,8 @@ static void __migrate_task(struct task_struct *p, int src_cpu, int dest_cpu)
 		p->timestamp = p->timestamp - rq_src->timestamp_last_tick
 				+ rq_dest->timestamp_last_tick;
 		deactivate_task(p, rq_src);
-		activate_task(p, rq_dest, 0);
-		if (TASK_PREEMPTS_CURR(p, rq_dest))
-			resched_task(rq_dest->curr);
+		activate_task(p, rq_dest);
+		check_preempt_curr(rq_dest, p);
 	}
 
 out:
@@ -4773,17 +5005,17 @@ static void migrate_dead(unsigned int dead_cpu, task_t *tsk)
 /* release_task() removes task from tasklist, so we won't find dead tasks. */
 static void migrate_dead_tasks(unsigned int dead_cpu)
 {
-	unsigned arr, i;
 	struct runqueue *rq = cpu_rq(dead_cpu);
+	task_t *next;
 
-	for (arr = 0; arr < 2; arr++) {
-		for (i = 0; i < MAX_PRIO; i++) {
-			struct list_head *list = &rq->arrays[arr].queue[i];
-			while (!list_empty(list))
-				migrate_dead(dead_cpu,
-					     list_entry(list->next, task_t,
-							run_list));
-		}
+	while (rq->nr_running) {
+		/*
+		 * Let the classes hand out their tasks; put_prev_task()
+		 * leaves each one queued so that migration dequeues it.
+		 */
+		next = pick_next_task(rq, rq->timestamp_last_tick);
+		next->sched_class->put_prev_task(rq, next);
+		migrate_dead(dead_cpu, next);
 	}
 }
 #endif /* CONFIG_HOTPLUG_CPU */
@@ -4835,6 +5067,7 @@ static int migration_call(struct notifier_block *nfb, unsigned long action,
 		deactivate_task(rq->idle, rq);
 		rq->idle->static_prio = MAX_PRIO;
 		__setscheduler(rq->idle, SCHED_NORMAL, 0);
+		rq->idle->sched_class = &prio_sched_class;
 		migrate_dead_tasks(cpu);
 		task_rq_unlock(rq, &flags);
 		migrate_nr_uninterruptible(rq);
@@ -6104,6 +6337,28 @@ int in_sched_functions(unsigned long addr)
 		&& addr < (unsigned long)__sched_text_end);
 }
 
+/*
+ * The priority-array class: the O(1) scheduler with its active/expired
+ * arrays, timeslices and interactivity estimator. It runs the RT tasks,
+ * so it has to come first.
+ */
+struct sched_class prio_sched_class = {
+	.next			= &fair_sched_class,
+	.enqueue_task		= enqueue_task_prio,
+	.dequeue_task		= dequeue_task_prio,
+	.yield_task		= yield_task_prio,
+	.check_preempt_curr	= check_preempt_curr_prio,
+	.pick_next_task		= pick_next_task_prio,
+	.put_prev_task		= put_prev_task_prio,
+	.task_tick		= task_tick_prio,
+	.task_new		= task_new_prio,
+#ifdef CONFIG_SMP
+	.load_balance		= load_balance_prio,
+#endif
+};
+
+#include "sched_fair.c"
+
 void __init sched_init(void)
 {
 	runqueue_t *rq;
@@ -6118,6 +6373,7 @@ void __init sched_init(void)
 		rq->active = rq->arrays;
 		rq->expired = rq->arrays + 1;
 		rq->best_expired_prio = MAX_PRIO;
+		init_cfs_rq(&rq->cfs);
 
 #ifdef CONFIG_SMP
 		rq->sd = NULL;
@@ -6182,9 +6438,9 @@ EXPORT_SYMBOL(__might_sleep);
 void normalize_rt_tasks(void)
 {
 	struct task_struct *p;
-	prio_array_t *array;
 	unsigned long flags;
 	runqueue_t *rq;
+	int on_rq;
 
 	read_lock_irq(&tasklist_lock);
 	for_each_process (p) {
@@ -6193,11 +6449,11 @@ void normalize_rt_tasks(void)
 
 		rq = task_rq_lock(p, &flags);
 
-		array = p->array;
-		if (array)
+		on_rq = p->on_rq;
+		if (on_rq)
 			deactivate_task(p, task_rq(p));
 		__setscheduler(p, SCHED_NORMAL, 0);
-		if (array) {
+		if (on_rq) {
 			__activate_task(p, task_rq(p));
 			resched_task(rq->curr);
 		}
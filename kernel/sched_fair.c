@@ -0,0 +1,434 @@
+/*
+ * kernel/sched_fair.c
+ *
+ * Completely fair scheduling class, #included from kernel/sched.c
+ *
+ * Runnable tasks are kept in a per-runqueue red-black tree, sorted by
+ * their virtual runtime: the CPU time they have received, scaled by the
+ * inverse of their nice-level weight. The leftmost task has received the
+ * least service and is the one that runs next. There are no timeslices
+ * that expire into another array and no interactivity estimator: a task
+ * that sleeps simply falls behind the others and gets to run first when
+ * it wakes up.
+ *
+ * Each runqueue's virtual clock (min_vruntime) only ever moves forward.
+ * While a task is off the runqueue its ->vruntime is kept relative to
+ * that clock, so that it can be queued on any CPU again.
+ */
+
+/*
+ * Targeted preemption latency: every runnable task gets to run once
+ * within this period (in ns). With more than SCHED_NR_LATENCY tasks the
+ * period is stretched so that nobody runs for less than
+ * SCHED_MIN_GRANULARITY at a time.
+ */
+#define SCHED_LATENCY			20000000ULL
+#define SCHED_MIN_GRANULARITY		4000000ULL
+#define SCHED_NR_LATENCY		(SCHED_LATENCY / SCHED_MIN_GRANULARITY)
+
+/*
+ * A woken task preempts the running one only if it is at least this
+ * much virtual time behind it, to bound the wakeup overscheduling:
+ */
+#define SCHED_WAKEUP_GRANULARITY	5000000ULL
+
+/*
+ * Maximum credit (in ns of virtual time) that a sleeper gets on wakeup:
+ */
+#define SCHED_SLEEPER_CREDIT		(SCHED_LATENCY / 2)
+
+#define NICE_0_LOAD			1024
+
+/*
+ * Nice levels are multiplicative, with a gentle 10% change for every
+ * nice level changed: a CPU-bound task at nice N gets ~10% more CPU
+ * time than one at nice N+1. The weights are 1024 / 1.25^nice.
+ */
+static const unsigned int prio_to_weight[40] = {
+ /* -20 */     88761,     71755,     56483,     46273,     36291,
+ /* -15 */     29154,     23254,     18705,     14949,     11916,
+ /* -10 */      9548,      7620,      6100,      4904,      3906,
+ /*  -5 */      3121,      2501,      1991,      1586,      1277,
+ /*   0 */      1024,       820,       655,       526,       423,
+ /*   5 */       335,       272,       215,       172,       137,
+ /*  10 */       110,        87,        70,        56,        45,
+ /*  15 */        36,        29,        23,        18,        15,
+};
+
+static inline unsigned long task_weight(task_t *p)
+{
+	return prio_to_weight[TASK_USER_PRIO(p)];
+}
+
+/*
+ * Convert @delta ns of real time into virtual time for @p.
+ */
+static inline unsigned long long
+calc_delta_fair(unsigned long long delta, task_t *p)
+{
+	unsigned long weight = task_weight(p);
+
+	if (unlikely(weight != NICE_0_LOAD)) {
+		delta *= NICE_0_LOAD;
+		do_div(delta, weight);
+	}
+	return delta;
+}
+
+static void init_cfs_rq(struct cfs_rq *cfs_rq)
+{
+	cfs_rq->nr_running = 0;
+	cfs_rq->load = 0;
+	cfs_rq->min_vruntime = 0;
+	cfs_rq->tasks_timeline = RB_ROOT;
+	cfs_rq->rb_leftmost = NULL;
+	cfs_rq->curr = NULL;
+}
+
+/*
+ * Keys are compared relative to min_vruntime, so that the wrapping of
+ * the 64-bit virtual clock does not matter.
+ */
+static inline long long task_key(struct cfs_rq *cfs_rq, task_t *p)
+{
+	return (long long)(p->vruntime - cfs_rq->min_vruntime);
+}
+
+static void __enqueue_timeline(struct cfs_rq *cfs_rq, task_t *p)
+{
+	struct rb_node **link = &cfs_rq->tasks_timeline.rb_node;
+	struct rb_node *parent = NULL;
+	long long key = task_key(cfs_rq, p);
+	int leftmost = 1;
+	task_t *entry;
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, task_t, run_node);
+		/*
+		 * Tasks with equal keys go to the right, so that they run
+		 * in the order they were queued:
+		 */
+		if (key < task_key(cfs_rq, entry))
+			link = &parent->rb_left;
+		else {
+			link = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+
+	if (leftmost)
+		cfs_rq->rb_leftmost = &p->run_node;
+
+	rb_link_node(&p->run_node, parent, link);
+	rb_insert_color(&p->run_node, &cfs_rq->tasks_timeline);
+}
+
+static void __dequeue_timeline(struct cfs_rq *cfs_rq, task_t *p)
+{
+	if (cfs_rq->rb_leftmost == &p->run_node)
+		cfs_rq->rb_leftmost = rb_next(&p->run_node);
+
+	rb_erase(&p->run_node, &cfs_rq->tasks_timeline);
+}
+
+static inline task_t *__first_timeline(struct cfs_rq *cfs_rq)
+{
+	if (!cfs_rq->rb_leftmost)
+		return NULL;
+
+	return rb_entry(cfs_rq->rb_leftmost, task_t, run_node);
+}
+
+/*
+ * min_vruntime follows the smallest virtual runtime of the running and
+ * the queued tasks, but never goes backwards.
+ */
+static void update_min_vruntime(struct cfs_rq *cfs_rq)
+{
+	task_t *curr = cfs_rq->curr, *first = __first_timeline(cfs_rq);
+	unsigned long long vruntime;
+
+	if (curr)
+		vruntime = curr->vruntime;
+	else if (first)
+		vruntime = first->vruntime;
+	else
+		return;
+
+	if (curr && first && (long long)(first->vruntime - vruntime) < 0)
+		vruntime = first->vruntime;
+
+	if ((long long)(vruntime - cfs_rq->min_vruntime) > 0)
+		cfs_rq->min_vruntime = vruntime;
+}
+
+/*
+ * Charge the running task for the time it ran since the last update.
+ */
+static void update_curr(runqueue_t *rq)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	task_t *curr = cfs_rq->curr;
+	unsigned long long now, delta_exec;
+
+	if (unlikely(!curr))
+		return;
+
+	now = rq_clock(rq);
+	delta_exec = now - curr->exec_start;
+	if (unlikely((long long)delta_exec <= 0))
+		return;
+
+	curr->exec_start = now;
+	curr->sum_exec_runtime += delta_exec;
+	curr->vruntime += calc_delta_fair(delta_exec, curr);
+	update_min_vruntime(cfs_rq);
+}
+
+/*
+ * The real-time slice of @p: its weighted share of the latency period.
+ */
+static unsigned long long sched_slice(struct cfs_rq *cfs_rq, task_t *p)
+{
+	unsigned long long slice = SCHED_LATENCY;
+
+	if (cfs_rq->nr_running > SCHED_NR_LATENCY)
+		slice = SCHED_MIN_GRANULARITY * cfs_rq->nr_running;
+
+	slice *= task_weight(p);
+	do_div(slice, cfs_rq->load);
+	return slice;
+}
+
+static void enqueue_task_fair(runqueue_t *rq, task_t *p, int wakeup)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	long long lag = (long long)p->vruntime;
+	unsigned long long now = rq_clock(rq);
+
+	update_curr(rq);
+	sched_info_queued(p);
+
+	if (wakeup && p->policy != SCHED_BATCH) {
+		/*
+		 * Credit the time slept, but never more than
+		 * SCHED_SLEEPER_CREDIT: long sleepers end up a bit ahead
+		 * of min_vruntime and so preempt the CPU hogs, without
+		 * being able to starve them.
+		 */
+		long long slept = (long long)(now - p->exec_start);
+
+		if (slept > 0)
+			lag -= slept;
+		if (lag < -(long long)SCHED_SLEEPER_CREDIT)
+			lag = -(long long)SCHED_SLEEPER_CREDIT;
+	}
+	p->vruntime = cfs_rq->min_vruntime + lag;
+
+	if (p == rq->curr) {
+		/* queued back while it runs (wakeup race, nice, policy) */
+		if (cfs_rq->curr != p) {
+			cfs_rq->curr = p;
+			p->exec_start = now;
+			p->prev_sum_exec_runtime = p->sum_exec_runtime;
+		}
+	} else
+		__enqueue_timeline(cfs_rq, p);
+
+	cfs_rq->nr_running++;
+	cfs_rq->load += task_weight(p);
+}
+
+static void dequeue_task_fair(runqueue_t *rq, task_t *p)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
+
+	update_curr(rq);
+
+	if (p == cfs_rq->curr)
+		cfs_rq->curr = NULL;
+	else
+		__dequeue_timeline(cfs_rq, p);
+
+	cfs_rq->nr_running--;
+	cfs_rq->load -= task_weight(p);
+
+	/* Only the lag relative to this runqueue is carried along: */
+	p->vruntime -= cfs_rq->min_vruntime;
+}
+
+/*
+ * sched_yield() puts the task behind all other queued tasks.
+ */
+static void yield_task_fair(runqueue_t *rq, task_t *p)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	struct rb_node *last = rb_last(&cfs_rq->tasks_timeline);
+	task_t *rightmost;
+
+	if (!last || cfs_rq->curr != p)
+		return;
+
+	update_curr(rq);
+	rightmost = rb_entry(last, task_t, run_node);
+	if (task_key(cfs_rq, rightmost) > task_key(cfs_rq, p))
+		p->vruntime = rightmost->vruntime;
+}
+
+static void check_preempt_curr_fair(runqueue_t *rq, task_t *p)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	task_t *curr = rq->curr;
+
+	/* Batch tasks do not preempt on wakeup */
+	if (unlikely(p->policy == SCHED_BATCH))
+		return;
+
+	/* curr is on its way out of the CPU already */
+	if (cfs_rq->curr != curr) {
+		resched_task(curr);
+		return;
+	}
+
+	update_curr(rq);
+	if ((long long)(curr->vruntime - p->vruntime) >
+			(long long)SCHED_WAKEUP_GRANULARITY)
+		resched_task(curr);
+}
+
+static task_t *pick_next_task_fair(runqueue_t *rq, unsigned long long now)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	task_t *p = __first_timeline(cfs_rq);
+
+	if (!p)
+		return NULL;
+
+	__dequeue_timeline(cfs_rq, p);
+	cfs_rq->curr = p;
+	p->exec_start = now;
+	p->prev_sum_exec_runtime = p->sum_exec_runtime;
+
+	return p;
+}
+
+static void put_prev_task_fair(runqueue_t *rq, task_t *prev)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
+
+	if (cfs_rq->curr != prev)
+		return;
+
+	update_curr(rq);
+	__enqueue_timeline(cfs_rq, prev);
+	cfs_rq->curr = NULL;
+}
+
+/*
+ * Preempt the running task once it used up its share of the period.
+ */
+static void task_tick_fair(runqueue_t *rq, task_t *p)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	unsigned long long delta_exec;
+
+	if (unlikely(cfs_rq->curr != p)) {
+		set_tsk_need_resched(p);
+		return;
+	}
+
+	update_curr(rq);
+	if (cfs_rq->nr_running < 2)
+		return;
+
+	delta_exec = p->sum_exec_runtime - p->prev_sum_exec_runtime;
+	if (delta_exec > sched_slice(cfs_rq, p))
+		set_tsk_need_resched(p);
+}
+
+/*
+ * A new task starts one slice behind min_vruntime, so that forking
+ * cannot be used to grab more than a fair share of the CPU.
+ */
+static void task_new_fair(runqueue_t *rq, task_t *p, unsigned long clone_flags)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
+	unsigned long long slice;
+
+	update_curr(rq);
+
+	cfs_rq->load += task_weight(p);
+	cfs_rq->nr_running++;
+	slice = sched_slice(cfs_rq, p);
+	cfs_rq->load -= task_weight(p);
+	cfs_rq->nr_running--;
+
+	p->vruntime = calc_delta_fair(slice, p);
+	p->exec_start = rq_clock(rq);
+
+	__activate_task(p, rq);
+	check_preempt_curr(rq, p);
+}
+
+#ifdef CONFIG_SMP
+static void pull_task_fair(runqueue_t *src_rq, task_t *p,
+			   runqueue_t *this_rq, int this_cpu)
+{
+	deactivate_task(p, src_rq);
+	set_task_cpu(p, this_cpu);
+	__activate_task(p, this_rq);
+	p->timestamp = (p->timestamp - src_rq->timestamp_last_tick)
+				+ this_rq->timestamp_last_tick;
+	check_preempt_curr(this_rq, p);
+}
+
+/*
+ * Pull tasks starting from the right end of the tree: those are the
+ * ones that would have to wait longest before running on busiest.
+ */
+static int load_balance_fair(runqueue_t *this_rq, int this_cpu,
+			     runqueue_t *busiest, unsigned long max_nr_move,
+			     struct sched_domain *sd, enum idle_type idle,
+			     int *all_pinned)
+{
+	struct rb_node *node, *prev;
+	int pulled = 0;
+	task_t *p;
+
+	node = rb_last(&busiest->cfs.tasks_timeline);
+	for (; node && pulled < max_nr_move; node = prev) {
+		prev = rb_prev(node);
+		p = rb_entry(node, task_t, run_node);
+
+		if (!can_migrate_task(p, busiest, this_cpu, sd, idle,
+				      all_pinned))
+			continue;
+
+#ifdef CONFIG_SCHEDSTATS
+		if (task_hot(p, busiest->timestamp_last_tick, sd))
+			schedstat_inc(sd, lb_hot_gained[idle]);
+#endif
+
+		pull_task_fair(busiest, p, this_rq, this_cpu);
+		pulled++;
+	}
+
+	return pulled;
+}
+#endif
+
+static struct sched_class fair_sched_class = {
+	.next			= NULL,
+	.enqueue_task		= enqueue_task_fair,
+	.dequeue_task		= dequeue_task_fair,
+	.yield_task		= yield_task_fair,
+	.check_preempt_curr	= check_preempt_curr_fair,
+	.pick_next_task		= pick_next_task_fair,
+	.put_prev_task		= put_prev_task_fair,
+	.task_tick		= task_tick_fair,
+	.task_new		= task_new_fair,
+#ifdef CONFIG_SMP
+	.load_balance		= load_balance_fair,
+#endif
+};
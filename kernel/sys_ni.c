@@ -45,6 +45,8 @@ cond_syscall(compat_sys_futex);
 cond_syscall(sys_epoll_create);
 cond_syscall(sys_epoll_ctl);
 cond_syscall(sys_epoll_wait);
+cond_syscall(sys_io_ring_setup);
+cond_syscall(sys_io_ring_enter);
 cond_syscall(sys_semget);
 cond_syscall(sys_semop);
 cond_syscall(sys_semtimedop);
@@ -709,8 +709,8 @@ static ctl_table vm_table[] = {
 		.data		= &vm_dirty_ratio,
 		.maxlen		= sizeof(vm_dirty_ratio),
 		.mode		= 0644,
-		.proc_handler	= &proc_dointvec_minmax,
-		.strategy	= &sysctl_intvec,
+		.proc_handler	= &dirty_ratio_handler,
+		.strategy	= &dirty_ratio_strategy,
 		.extra1		= &zero,
 		.extra2		= &one_hundred,
 	},
@@ -890,6 +890,38 @@ static ctl_table vm_table[] = {
 		.proc_handler	= &proc_dointvec_jiffies,
 		.strategy	= &sysctl_jiffies,
 	},
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	{
+		.ctl_name	= VM_TRANSPARENT_HUGEPAGE,
+		.procname	= "transparent_hugepage",
+		.data		= &transparent_hugepage_enabled,
+		.maxlen		= sizeof(transparent_hugepage_enabled),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+	},
+	{
+		.ctl_name	= VM_KHUGEPAGED_PAGES,
+		.procname	= "khugepaged_pages_to_scan",
+		.data		= &khugepaged_pages_to_scan,
+		.maxlen		= sizeof(khugepaged_pages_to_scan),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+	},
+	{
+		.ctl_name	= VM_KHUGEPAGED_SLEEP,
+		.procname	= "khugepaged_scan_sleep_millisecs",
+		.data		= &khugepaged_scan_sleep_millisecs,
+		.maxlen		= sizeof(khugepaged_scan_sleep_millisecs),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+	},
 #endif
 	{ .ctl_name = 0 }
 };
@@ -34,6 +34,8 @@
 #include <linux/cpu.h>
 #include <linux/syscalls.h>
 #include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/seq_file.h>
 
 #include <asm/uaccess.h>
 #include <asm/unistd.h>
@@ -266,6 +268,15 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	timer->base = &base->t_base;
 	internal_add_timer(base, timer);
 	spin_unlock_irqrestore(&base->t_base.lock, flags);
+#if defined(CONFIG_NO_IDLE_HZ) && defined(CONFIG_SMP)
+	/*
+	 * A cpu with its tick stopped only looks at its timer wheel
+	 * again when its programmed event fires; kick it so that it
+	 * notices the new timer.
+	 */
+	if (cpu_isset(cpu, nohz_cpu_mask))
+		smp_send_reschedule(cpu);
+#endif
 }
 
 
@@ -480,7 +491,9 @@ static inline void __run_timers(tvec_base_t *base)
 #ifdef CONFIG_NO_IDLE_HZ
 /*
  * Find out when the next timer event is due to happen. This
- * is used on S/390 to stop all activity when a cpus is idle.
+ * is used to stop the tick when a cpu is idle, see
+ * Documentation/dyntick.txt. This takes pending hrtimers into
+ * account, which are expired from the timer softirq too.
  * This functions needs to be called disabled.
  */
 unsigned long next_timer_interrupt(void)
@@ -489,9 +502,22 @@ unsigned long next_timer_interrupt(void)
 	struct list_head *list;
 	struct timer_list *nte;
 	unsigned long expires;
+	unsigned long hr_expires = MAX_JIFFY_OFFSET;
+	ktime_t hr_delta;
 	tvec_t *varray[4];
 	int i, j;
 
+	hr_delta = hrtimer_get_next_event();
+	if (hr_delta.tv64 != KTIME_MAX) {
+		struct timespec tsdelta;
+
+		tsdelta = ktime_to_timespec(hr_delta);
+		hr_expires = timespec_to_jiffies(&tsdelta);
+		if (hr_expires < 3)
+			return hr_expires + jiffies;
+	}
+	hr_expires += jiffies;
+
 	base = &__get_cpu_var(tvec_bases);
 	spin_lock(&base->t_base.lock);
 	expires = base->timer_jiffies + (LONG_MAX >> 1);
@@ -542,8 +568,55 @@ found:
 		}
 	}
 	spin_unlock(&base->t_base.lock);
+
+	if (time_before(hr_expires, expires))
+		return hr_expires;
 	return expires;
 }
+
+/*
+ * Per-cpu tick suppression statistics, kept up to date by the
+ * architecture code that stops the tick (stop_hz_timer() and
+ * start_hz_timer()) and reported in /proc/dyntick.
+ */
+DEFINE_PER_CPU(struct dyntick_stat, dyntick_stats);
+
+#ifdef CONFIG_PROC_FS
+/*
+ * bump this up when changing the output format or the meaning of an
+ * existing field
+ */
+#define DYNTICK_VERSION 1
+
+static int show_dyntick(struct seq_file *seq, void *v)
+{
+	int cpu;
+
+	seq_printf(seq, "version %d\n", DYNTICK_VERSION);
+	seq_printf(seq, "timestamp %lu\n", jiffies);
+	for_each_online_cpu(cpu) {
+		struct dyntick_stat *ds = &per_cpu(dyntick_stats, cpu);
+
+		/* idle calls, tick stopped, ticks skipped, stopped now */
+		seq_printf(seq, "cpu%d %lu %lu %lu %d\n", cpu,
+			   ds->idle_calls, ds->idle_sleeps, ds->ticks_skipped,
+			   cpu_isset(cpu, nohz_cpu_mask) ? 1 : 0);
+	}
+	return 0;
+}
+
+static int dyntick_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_dyntick, NULL);
+}
+
+struct file_operations proc_dyntick_operations = {
+	.open    = dyntick_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+#endif
 #endif
 
 /******************************************************************/
@@ -0,0 +1,419 @@
+/*
+ * mm/backing-dev.c
+ *
+ * Per-device writeback.  Every backing_dev_info which writes back dirty
+ * pages keeps its own lists of dirty inodes and, while it has any, its own
+ * flusher thread, "flush-<name>".  This replaces the shared pool of pdflush
+ * threads, where one congested queue could hold up writeback against all
+ * the other devices.
+ *
+ * Flusher threads are started on demand by the "bdi-default" thread and
+ * exit again after five idle minutes.  bdi-default also writes back the
+ * superblocks every dirty_writeback_centisecs, and does the laptop mode
+ * sync.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/init.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/cpuset.h>
+#include <linux/syscalls.h>
+#include <linux/backing-dev.h>
+#include <linux/writeback.h>
+#include <asm/div64.h>
+
+/*
+ * All the registered devices.  bdi_lock also protects their ->task
+ * pointers.  b_dirty and b_io are under inode_lock.
+ */
+DEFINE_SPINLOCK(bdi_lock);
+LIST_HEAD(bdi_list);
+
+/*
+ * The number of flusher threads, published to userspace at
+ * /proc/sys/vm/nr_pdflush_threads.  Protected by bdi_lock.
+ */
+int nr_pdflush_threads;
+
+#define BDI_IDLE_EXIT	(300 * HZ)	/* idle flusher threads exit */
+
+static struct task_struct *bdi_default_task;
+static unsigned long bdi_default_flags;
+#define BDI_DEFAULT_LAPTOP_FLUSH	0
+
+static atomic_t bdi_seq = ATOMIC_INIT(0);
+
+/**
+ * bdi_init - set up a backing device for writeback
+ * @bdi: the device
+ *
+ * Gives @bdi its dirty inode lists and page counters, and puts it on
+ * bdi_list so that it gets a flusher thread once it has dirty inodes.
+ * Devices which never call this have their dirty inodes written back by
+ * the default device's flusher, and are not counted.  bdi->name may be set
+ * before or after; it is only used to name the flusher thread.
+ */
+void bdi_init(struct backing_dev_info *bdi)
+{
+	int i;
+
+	INIT_LIST_HEAD(&bdi->b_dirty);
+	INIT_LIST_HEAD(&bdi->b_io);
+	bdi->task = NULL;
+	bdi->wb_pages = 0;
+	for (i = 0; i < NR_BDI_STAT_ITEMS; i++)
+		percpu_counter_init(&bdi->bdi_stat[i]);
+	percpu_counter_init(&bdi->completions);
+	bdi->completions_period = 0;
+	spin_lock_init(&bdi->completions_lock);
+	bdi->dirty_exceeded = 0;
+	if (!bdi->name[0])
+		snprintf(bdi->name, sizeof(bdi->name), "%d",
+			 atomic_inc_return(&bdi_seq));
+
+	spin_lock(&bdi_lock);
+	list_add_tail(&bdi->bdi_list, &bdi_list);
+	set_bit(BDI_registered, &bdi->state);
+	spin_unlock(&bdi_lock);
+}
+EXPORT_SYMBOL(bdi_init);
+
+static int bdi_sched_wait(void *word)
+{
+	schedule();
+	return 0;
+}
+
+/**
+ * bdi_destroy - tear down a backing device's writeback state
+ * @bdi: the device
+ *
+ * Stops the flusher thread.  Inodes still dirty against @bdi are handed to
+ * the default device, so that they are not lost.  Does nothing if
+ * bdi_init() was never called.  May sleep.
+ */
+void bdi_destroy(struct backing_dev_info *bdi)
+{
+	struct task_struct *task;
+	int i;
+
+	if (!bdi_registered(bdi))
+		return;
+
+	spin_lock(&bdi_lock);
+	list_del(&bdi->bdi_list);
+	spin_unlock(&bdi_lock);
+
+	/* bdi-default may be in the middle of starting our thread */
+	wait_on_bit(&bdi->state, BDI_pending, bdi_sched_wait,
+			TASK_UNINTERRUPTIBLE);
+
+	spin_lock(&bdi_lock);
+	task = bdi->task;
+	bdi->task = NULL;
+	if (task)
+		nr_pdflush_threads--;
+	spin_unlock(&bdi_lock);
+	if (task)
+		kthread_stop(task);
+
+	clear_bit(BDI_registered, &bdi->state);
+	spin_lock(&inode_lock);
+	list_splice_init(&bdi->b_dirty, &default_backing_dev_info.b_dirty);
+	list_splice_init(&bdi->b_io, &default_backing_dev_info.b_dirty);
+	spin_unlock(&inode_lock);
+
+	for (i = 0; i < NR_BDI_STAT_ITEMS; i++)
+		percpu_counter_destroy(&bdi->bdi_stat[i]);
+	percpu_counter_destroy(&bdi->completions);
+}
+EXPORT_SYMBOL(bdi_destroy);
+
+static int bdi_has_dirty_io(struct backing_dev_info *bdi)
+{
+	/* unlocked list_empty() tests are OK here */
+	return !list_empty(&bdi->b_dirty) || !list_empty(&bdi->b_io);
+}
+
+static void __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages)
+{
+	bdi->wb_pages += nr_pages;
+	if (bdi->task)
+		wake_up_process(bdi->task);
+	else if (bdi_default_task)
+		wake_up_process(bdi_default_task);
+}
+
+/**
+ * bdi_start_writeback - kick a device's flusher thread
+ * @bdi: the device
+ * @nr_pages: how many pages to write at least
+ *
+ * The flusher writes back @nr_pages, and keeps going for as long as the
+ * system is over the background dirty threshold and @bdi is over its share
+ * of it.  The thread is started if @bdi has none.
+ */
+void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages)
+{
+	if (!bdi_registered(bdi))
+		bdi = &default_backing_dev_info;
+
+	spin_lock(&bdi_lock);
+	__bdi_start_writeback(bdi, nr_pages);
+	spin_unlock(&bdi_lock);
+}
+
+/**
+ * wakeup_flusher_threads - start writeback on all devices
+ * @nr_pages: how many pages to write, in total
+ *
+ * The pages are spread over the devices in proportion to how many dirty
+ * pages each has.  If @nr_pages is zero, write back the whole world.
+ */
+void wakeup_flusher_threads(long nr_pages)
+{
+	struct backing_dev_info *bdi;
+	unsigned long total = 0;
+
+	spin_lock(&bdi_lock);
+	if (nr_pages) {
+		list_for_each_entry(bdi, &bdi_list, bdi_list)
+			total += bdi_stat(bdi, BDI_RECLAIMABLE);
+	}
+	list_for_each_entry(bdi, &bdi_list, bdi_list) {
+		unsigned long reclaimable = bdi_stat(bdi, BDI_RECLAIMABLE);
+		u64 pages = reclaimable;
+
+		if (!reclaimable && !bdi_has_dirty_io(bdi))
+			continue;
+		if (nr_pages && total) {
+			pages = (u64)nr_pages * reclaimable;
+			do_div(pages, total);
+		}
+		__bdi_start_writeback(bdi, (long)pages);
+	}
+	spin_unlock(&bdi_lock);
+}
+
+/*
+ * Wake every flusher thread, and bdi-default, so that they pick up a new
+ * dirty_writeback_centisecs.
+ */
+void bdi_wakeup_all(void)
+{
+	struct backing_dev_info *bdi;
+
+	spin_lock(&bdi_lock);
+	list_for_each_entry(bdi, &bdi_list, bdi_list) {
+		if (bdi->task)
+			wake_up_process(bdi->task);
+	}
+	spin_unlock(&bdi_lock);
+	if (bdi_default_task)
+		wake_up_process(bdi_default_task);
+}
+
+/*
+ * The laptop mode timer: have bdi-default sync everything.  Called from
+ * timer context, so bdi_lock is not taken.
+ */
+void bdi_laptop_flush(void)
+{
+	set_bit(BDI_DEFAULT_LAPTOP_FLUSH, &bdi_default_flags);
+	if (bdi_default_task)
+		wake_up_process(bdi_default_task);
+}
+
+/*
+ * When the next periodic writeback is due.  With dirty_writeback_centisecs
+ * at zero it is disabled, and due at once when it gets switched back on.
+ */
+static unsigned long next_writeback(void)
+{
+	return jiffies + (dirty_writeback_centisecs * HZ) / 100;
+}
+
+/*
+ * An idle flusher thread exits, unless bdi_destroy() has already claimed
+ * it, in which case it must wait for kthread_stop().
+ */
+static int bdi_flusher_may_exit(struct backing_dev_info *bdi)
+{
+	int ret = 0;
+
+	spin_lock(&bdi_lock);
+	if (bdi->task == current && !bdi->wb_pages && !bdi_has_dirty_io(bdi)) {
+		bdi->task = NULL;
+		nr_pdflush_threads--;
+		ret = 1;
+	}
+	spin_unlock(&bdi_lock);
+	return ret;
+}
+
+/*
+ * The flusher thread of one device.  It does the work which used to be
+ * handed to pdflush for all devices at once: background writeout when
+ * asked by bdi_start_writeback() or when the device is over its share of
+ * the background threshold, and kupdate-style writeback of old data every
+ * dirty_writeback_centisecs.
+ */
+static int bdi_flusher(void *data)
+{
+	struct backing_dev_info *bdi = data;
+	unsigned long last_active = jiffies;
+	unsigned long next_kupdate = next_writeback();
+
+	current->flags |= PF_FLUSHER | PF_SWAPWRITE;
+	/*
+	 * The flusher can spend a lot of time doing encryption via dm-crypt.
+	 * We don't want to do that at keventd's priority.
+	 */
+	set_user_nice(current, 0);
+	set_cpus_allowed(current, cpuset_cpus_allowed(current));
+
+	while (!kthread_should_stop()) {
+		long nr_pages;
+
+		spin_lock(&bdi_lock);
+		nr_pages = bdi->wb_pages;
+		bdi->wb_pages = 0;
+		spin_unlock(&bdi_lock);
+
+		set_bit(BDI_writeback_running, &bdi->state);
+		bdi_background_writeout(bdi, nr_pages);
+		if (dirty_writeback_centisecs &&
+		    time_after_eq(jiffies, next_kupdate)) {
+			bdi_kupdate(bdi);
+			next_kupdate = next_writeback();
+			if (time_before(next_kupdate, jiffies + HZ))
+				next_kupdate = jiffies + HZ;
+		}
+		clear_bit(BDI_writeback_running, &bdi->state);
+
+		if (nr_pages || bdi_has_dirty_io(bdi))
+			last_active = jiffies;
+		else if (time_after(jiffies, last_active + BDI_IDLE_EXIT) &&
+			 bdi_flusher_may_exit(bdi))
+			return 0;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!bdi->wb_pages && !kthread_should_stop()) {
+			long timeout = MAX_SCHEDULE_TIMEOUT;
+
+			if (dirty_writeback_centisecs) {
+				timeout = next_kupdate - jiffies;
+				if (timeout < 0)
+					timeout = 0;
+			} else if (!bdi_has_dirty_io(bdi)) {
+				timeout = BDI_IDLE_EXIT;
+			}
+			schedule_timeout(timeout);
+		}
+		__set_current_state(TASK_RUNNING);
+		try_to_freeze();
+	}
+	return 0;
+}
+
+/*
+ * Find a device which has dirty inodes, or has been asked to write, but
+ * has no flusher thread, and start one for it.  Returns 1 if it should be
+ * called again.
+ */
+static int bdi_fork_one(void)
+{
+	struct backing_dev_info *bdi, *found = NULL;
+	struct task_struct *task;
+
+	spin_lock(&bdi_lock);
+	list_for_each_entry(bdi, &bdi_list, bdi_list) {
+		if (bdi->task || test_bit(BDI_pending, &bdi->state))
+			continue;
+		if (!bdi->wb_pages && !bdi_has_dirty_io(bdi))
+			continue;
+		set_bit(BDI_pending, &bdi->state);
+		found = bdi;
+		break;
+	}
+	spin_unlock(&bdi_lock);
+	if (!found)
+		return 0;
+
+	/*
+	 * BDI_pending keeps bdi_destroy() from freeing the device until its
+	 * thread is in place.
+	 */
+	task = kthread_run(bdi_flusher, found, "flush-%s", found->name);
+	spin_lock(&bdi_lock);
+	if (!IS_ERR(task)) {
+		found->task = task;
+		nr_pdflush_threads++;
+	}
+	spin_unlock(&bdi_lock);
+	clear_bit(BDI_pending, &found->state);
+	smp_mb__after_clear_bit();
+	wake_up_bit(&found->state, BDI_pending);
+
+	/* try again on the next tick if we are short of memory */
+	return !IS_ERR(task);
+}
+
+/*
+ * bdi-default: starts flusher threads, and does the periodic and laptop mode
+ * work which is not tied to any one device.
+ */
+static int bdi_default_thread(void *unused)
+{
+	unsigned long next_sync = next_writeback();
+
+	set_user_nice(current, 0);
+
+	for ( ; ; ) {
+		long timeout;
+
+		if (test_and_clear_bit(BDI_DEFAULT_LAPTOP_FLUSH,
+					&bdi_default_flags))
+			sys_sync();
+
+		if (dirty_writeback_centisecs &&
+		    time_after_eq(jiffies, next_sync)) {
+			sync_supers();
+			next_sync = next_writeback();
+		}
+
+		while (bdi_fork_one())
+			cond_resched();
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		timeout = MAX_SCHEDULE_TIMEOUT;
+		if (dirty_writeback_centisecs) {
+			timeout = next_sync - jiffies;
+			if (timeout < 0)
+				timeout = 0;
+		}
+		if (!test_bit(BDI_DEFAULT_LAPTOP_FLUSH, &bdi_default_flags))
+			schedule_timeout(timeout);
+		__set_current_state(TASK_RUNNING);
+		try_to_freeze();
+	}
+	return 0;
+}
+
+static int __init bdi_default_init(void)
+{
+	struct task_struct *task;
+
+	task = kthread_run(bdi_default_thread, NULL, "bdi-default");
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	bdi_default_task = task;
+	return 0;
+}
+module_init(bdi_default_init);
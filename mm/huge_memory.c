@@ -0,0 +1,756 @@
+/*
+ * mm/huge_memory.c - transparent huge pages for anonymous memory
+ *
+ * Private anonymous mappings covering a whole pmd-aligned range are
+ * faulted in as one compound page mapped by a single huge pmd, without
+ * the application asking for it.  Whatever cannot cope with a huge pmd
+ * (fork, mprotect, partial munmap, mremap, swapping out) splits it back
+ * into a normal page table of small pages first; khugepaged collapses
+ * such ranges back into huge pages in the background.
+ *
+ * Lock ordering, on top of the one documented in mm/rmap.c:
+ *
+ * mmap_sem
+ *   anon_vma->lock
+ *     mm->page_table_lock	(protects the huge pmd and mm->pmd_huge_pte)
+ *       zone->lru_lock		(in lru_cache_add while splitting)
+ *
+ * A huge page is only ever mapped by one pmd of one mm: fork splits it,
+ * and get_user_pages splits it before taking a reference, so a split
+ * never has to account for extra references on the tail pages.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/swap.h>
+#include <linux/mm_inline.h>
+#include <linux/rmap.h>
+#include <linux/kthread.h>
+#include <linux/init.h>
+
+#include <asm/tlb.h>
+#include <asm/tlbflush.h>
+#include <asm/pgalloc.h>
+
+int transparent_hugepage_enabled = 1;
+int khugepaged_pages_to_scan = HPAGE_PMD_NR * 8;
+int khugepaged_scan_sleep_millisecs = 10000;
+
+/* empty ptes khugepaged is willing to fill with zeroes when collapsing */
+static int khugepaged_max_ptes_none = HPAGE_PMD_NR - 1;
+
+static int __init setup_transparent_hugepage(char *str)
+{
+	if (!strcmp(str, "always"))
+		transparent_hugepage_enabled = 1;
+	else if (!strcmp(str, "never"))
+		transparent_hugepage_enabled = 0;
+	else
+		return 0;
+	return 1;
+}
+__setup("transparent_hugepage=", setup_transparent_hugepage);
+
+/*
+ * The huge pmd is handled through the pte accessors, as hugetlbfs does:
+ * on i386 a PSE pmd has the same layout as a pte.
+ */
+static inline pte_t *huge_pmd_pte(pmd_t *pmd)
+{
+	return (pte_t *)pmd;
+}
+
+/*
+ * Can the pmd covering @address of @vma map a huge page?  Only private
+ * writable anonymous memory qualifies, and the vma has to cover the
+ * whole aligned range.
+ */
+int transparent_hugepage_vma(struct vm_area_struct *vma, unsigned long address)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+
+	if (!transparent_hugepage_enabled || !has_transparent_hugepage())
+		return 0;
+	if (vma->vm_file || vma->vm_ops)
+		return 0;
+	if ((vma->vm_flags & (VM_WRITE | VM_SHARED | VM_MAYSHARE |
+			      VM_GROWSDOWN | VM_GROWSUP | VM_HUGETLB |
+			      VM_IO | VM_RESERVED | VM_PFNMAP |
+			      VM_NONLINEAR | VM_INSERTPAGE)) != VM_WRITE)
+		return 0;
+	return haddr >= vma->vm_start && haddr + HPAGE_PMD_SIZE <= vma->vm_end;
+}
+
+/*
+ * Splitting a huge pmd must not fail for lack of memory, so every huge
+ * pmd keeps a page table in reserve on mm->pmd_huge_pte.
+ * Called with mm->page_table_lock held.
+ */
+static void pgtable_deposit(struct mm_struct *mm, struct page *pgtable)
+{
+	list_add(&pgtable->lru, &mm->pmd_huge_pte);
+}
+
+static struct page *pgtable_withdraw(struct mm_struct *mm)
+{
+	struct page *pgtable;
+
+	BUG_ON(list_empty(&mm->pmd_huge_pte));
+	pgtable = list_entry(mm->pmd_huge_pte.next, struct page, lru);
+	list_del(&pgtable->lru);
+	return pgtable;
+}
+
+/*
+ * Compound page destructor: the head page sits on the LRU for the
+ * whole huge page until it is split.
+ */
+static void free_trans_huge_page(struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long flags;
+
+	spin_lock_irqsave(&zone->lru_lock, flags);
+	if (TestClearPageLRU(page))
+		del_page_from_lru(zone, page);
+	spin_unlock_irqrestore(&zone->lru_lock, flags);
+
+	page->mapping = NULL;
+	page[1].mapping = NULL;
+	set_page_count(page, 1);
+	__free_pages(page, HPAGE_PMD_ORDER);
+}
+
+static struct page *alloc_hugepage(gfp_t gfp_mask)
+{
+	struct page *page;
+
+	page = alloc_pages(gfp_mask | __GFP_COMP | __GFP_NOWARN,
+			   HPAGE_PMD_ORDER);
+	if (page)
+		page[1].mapping = (void *)free_trans_huge_page;
+	return page;
+}
+
+static void clear_huge_page(struct page *page, unsigned long haddr)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		cond_resched();
+		clear_user_highpage(page + i, haddr + i * PAGE_SIZE);
+	}
+}
+
+static pte_t mk_huge_entry(struct page *page, struct vm_area_struct *vma)
+{
+	pte_t entry = mk_pte(page, vma->vm_page_prot);
+
+	return pte_mkhuge(pte_mkyoung(pte_mkdirty(pte_mkwrite(entry))));
+}
+
+static void khugepaged_enter(struct vm_area_struct *vma);
+
+/*
+ * Fault in a huge page for the empty pmd covering @address.  Returns 0
+ * when the pmd is populated, by us or by a racing fault; anything else
+ * means the caller has to fall back to small pages.
+ */
+int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long address, pmd_t *pmd)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page, *pgtable;
+
+	khugepaged_enter(vma);
+	if (unlikely(anon_vma_prepare(vma)))
+		return -ENOMEM;
+	page = alloc_hugepage(GFP_HIGHUSER | __GFP_NORETRY);
+	if (unlikely(!page))
+		goto fallback;
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable)) {
+		put_page(page);
+		goto fallback;
+	}
+	pte_lock_init(pgtable);
+	clear_huge_page(page, haddr);
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		pte_lock_deinit(pgtable);
+		pte_free(pgtable);
+		put_page(page);
+		return 0;
+	}
+	page_add_new_anon_rmap(page, vma, haddr);
+	set_pte_at(mm, haddr, huge_pmd_pte(pmd), mk_huge_entry(page, vma));
+	pgtable_deposit(mm, pgtable);
+	mm->nr_ptes++;
+	add_mm_counter(mm, anon_rss, HPAGE_PMD_NR);
+	/* on the LRU before a racing zap can drop the last reference */
+	lru_cache_add_active(page);
+	spin_unlock(&mm->page_table_lock);
+
+	inc_page_state(nr_page_table_pages);
+	inc_page_state(thp_fault_alloc);
+	return 0;
+
+fallback:
+	inc_page_state(thp_fault_fallback);
+	return -ENOMEM;
+}
+
+/*
+ * Unmap the huge page at @pmd, which zap_pmd_range has found to cover
+ * exactly the range being zapped.  Returns 0 if the pmd is no longer
+ * huge.
+ */
+int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+		 pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = tlb->mm;
+	struct page *page, *pgtable;
+	pte_t entry;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return 0;
+	}
+	entry = ptep_get_and_clear(mm, addr, huge_pmd_pte(pmd));
+	tlb_remove_tlb_entry(tlb, huge_pmd_pte(pmd), addr);
+	page = pte_page(entry);
+	page_remove_rmap(page);
+	add_mm_counter(mm, anon_rss, -HPAGE_PMD_NR);
+	pgtable = pgtable_withdraw(mm);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+
+	tlb_remove_page(tlb, page);
+	pte_lock_deinit(pgtable);
+	pte_free_tlb(tlb, pgtable);
+	dec_page_state(nr_page_table_pages);
+	return 1;
+}
+
+/*
+ * follow_page() without FOLL_GET on a huge pmd: returns the small page
+ * at @address, or NULL if the pmd was split meanwhile.
+ */
+struct page *follow_trans_huge_pmd(struct mm_struct *mm,
+				   unsigned long address, pmd_t *pmd,
+				   unsigned int flags)
+{
+	struct page *page = NULL;
+
+	BUG_ON(flags & FOLL_GET);
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd))) {
+		page = pte_page(*huge_pmd_pte(pmd));
+		if (flags & FOLL_TOUCH)
+			mark_page_accessed(page);
+		page += (address & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
+	}
+	spin_unlock(&mm->page_table_lock);
+	return page;
+}
+
+static pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+	return pmd_offset(pud, address);
+}
+
+/*
+ * The huge pmd counterpart of page_check_address(): returns the pmd
+ * mapping the huge @page at @address in @mm, with mm->page_table_lock
+ * held, or NULL.
+ */
+pmd_t *page_check_address_pmd(struct page *page, struct mm_struct *mm,
+			      unsigned long address)
+{
+	pmd_t *pmd;
+
+	if (address & ~HPAGE_PMD_MASK)
+		return NULL;
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd)
+		return NULL;
+	spin_lock(&mm->page_table_lock);
+	if (pmd_trans_huge(*pmd) && pte_page(*huge_pmd_pte(pmd)) == page)
+		return pmd;
+	spin_unlock(&mm->page_table_lock);
+	return NULL;
+}
+
+int pmdp_clear_flush_young(struct vm_area_struct *vma,
+			   unsigned long address, pmd_t *pmd)
+{
+	return ptep_clear_flush_young(vma, address, huge_pmd_pte(pmd));
+}
+
+/*
+ * Turn the compound page into HPAGE_PMD_NR normal pages, each with the
+ * single reference and mapping of the pte about to map it.  The head
+ * keeps the reference and mapcount of the huge pmd.
+ */
+static void __split_huge_page_refcount(struct page *page)
+{
+	int i;
+
+	for (i = 1; i < HPAGE_PMD_NR; i++) {
+		struct page *tail = page + i;
+
+		ClearPageCompound(tail);
+		set_page_private(tail, 0);
+		tail->mapping = page->mapping;
+		tail->index = page->index + i;
+		set_page_count(tail, 1);
+		atomic_set(&tail->_mapcount, 0);
+		SetPageSwapBacked(tail);
+		if (PageActive(page))
+			lru_cache_add_active(tail);
+		else
+			lru_cache_add(tail);
+	}
+	/*
+	 * page_private(page) still points at the page itself, so that a
+	 * racing put_page() which saw PageCompound still finds the head.
+	 */
+	ClearPageCompound(page);
+}
+
+/*
+ * Replace the huge pmd mapping @page at @address by the deposited page
+ * table filled with small ptes.  Returns 0 if @page is not mapped there.
+ */
+static int __split_huge_page_map(struct page *page,
+				 struct vm_area_struct *vma,
+				 unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *pgtable;
+	pmd_t *pmd, _pmd;
+	pte_t orig, *pte;
+	int i;
+
+	pmd = page_check_address_pmd(page, mm, address);
+	if (!pmd)
+		return 0;
+	BUG_ON(page_mapcount(page) != 1);
+
+	orig = ptep_get_and_clear(mm, address, huge_pmd_pte(pmd));
+	flush_tlb_range(vma, address, address + HPAGE_PMD_SIZE);
+
+	__split_huge_page_refcount(page);
+
+	/* fill the table through a private pmd, it is not visible yet */
+	pgtable = pgtable_withdraw(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+	pte = pte_offset_map(&_pmd, address);
+	for (i = 0; i < HPAGE_PMD_NR; i++, address += PAGE_SIZE) {
+		pte_t entry = mk_pte(page + i, vma->vm_page_prot);
+
+		if (pte_write(orig))
+			entry = pte_mkwrite(entry);
+		if (pte_dirty(orig))
+			entry = pte_mkdirty(entry);
+		if (pte_young(orig))
+			entry = pte_mkyoung(entry);
+		set_pte_at(mm, address, pte + i, entry);
+	}
+	pte_unmap(pte);
+	pmd_populate(mm, pmd, pgtable);
+	spin_unlock(&mm->page_table_lock);
+	return 1;
+}
+
+/*
+ * Split the huge @page into small pages mapped by small ptes.  Returns 0
+ * on success or if the page is not huge (any more), 1 if the page is not
+ * mapped.  The caller holds a reference on @page.
+ */
+int split_huge_page(struct page *page)
+{
+	struct anon_vma *anon_vma;
+	struct vm_area_struct *vma;
+	int mapped = 0;
+
+	anon_vma = page_lock_anon_vma(page);
+	if (!anon_vma)
+		return 1;
+	if (!PageTransHuge(page)) {
+		/* split by somebody else */
+		spin_unlock(&anon_vma->lock);
+		return 0;
+	}
+	list_for_each_entry(vma, &anon_vma->head, anon_vma_node) {
+		unsigned long address = page_address_in_vma(page, vma);
+
+		if (address == -EFAULT)
+			continue;
+		if (__split_huge_page_map(page, vma, address)) {
+			mapped = 1;
+			break;
+		}
+	}
+	spin_unlock(&anon_vma->lock);
+
+	if (!mapped)
+		return 1;
+	inc_page_state(thp_split);
+	return 0;
+}
+
+void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+{
+	struct page *page;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
+	page = pte_page(*huge_pmd_pte(pmd));
+	get_page(page);
+	spin_unlock(&mm->page_table_lock);
+
+	split_huge_page(page);
+	put_page(page);
+}
+
+/*
+ * khugepaged walks the mms which ever faulted on a vma suitable for
+ * huge pages, and collapses ranges of small pages back into huge pages
+ * where that can be done without sharing or copying on write getting
+ * in the way.
+ */
+static DEFINE_SPINLOCK(khugepaged_mm_lock);
+static LIST_HEAD(khugepaged_scan_list);
+static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
+
+/* where the scan stopped, protected by khugepaged_mm_lock */
+static struct {
+	struct mm_struct *mm;
+	unsigned long address;
+} khugepaged_scan;
+
+static void khugepaged_enter(struct vm_area_struct *vma)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	int wakeup;
+
+	if (likely(!list_empty(&mm->khugepaged_list)))
+		return;
+	spin_lock(&khugepaged_mm_lock);
+	wakeup = list_empty(&khugepaged_scan_list);
+	if (list_empty(&mm->khugepaged_list))
+		list_add_tail(&mm->khugepaged_list, &khugepaged_scan_list);
+	spin_unlock(&khugepaged_mm_lock);
+	if (wakeup)
+		wake_up_interruptible(&khugepaged_wait);
+}
+
+/* Called with khugepaged_mm_lock held */
+static void khugepaged_next_mm(void)
+{
+	struct list_head *next = khugepaged_scan.mm->khugepaged_list.next;
+
+	if (next == &khugepaged_scan_list)
+		khugepaged_scan.mm = NULL;
+	else
+		khugepaged_scan.mm = list_entry(next, struct mm_struct,
+						khugepaged_list);
+	khugepaged_scan.address = 0;
+}
+
+void khugepaged_exit(struct mm_struct *mm)
+{
+	if (list_empty(&mm->khugepaged_list))
+		return;
+	spin_lock(&khugepaged_mm_lock);
+	if (khugepaged_scan.mm == mm)
+		khugepaged_next_mm();
+	list_del_init(&mm->khugepaged_list);
+	spin_unlock(&khugepaged_mm_lock);
+}
+
+/*
+ * Can the page table at @pte, mapping @address onwards, be replaced by
+ * a huge page?  Every present pte must map a writable small anonymous
+ * page nobody else holds on to; up to khugepaged_max_ptes_none may be
+ * empty.  Called with the pte lock held.
+ */
+static int khugepaged_ptes_ok(struct vm_area_struct *vma,
+			      unsigned long address, pte_t *pte)
+{
+	int i, none = 0;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++, pte++, address += PAGE_SIZE) {
+		pte_t pteval = *pte;
+		struct page *page;
+
+		if (pte_none(pteval)) {
+			if (++none > khugepaged_max_ptes_none)
+				return 0;
+			continue;
+		}
+		if (!pte_present(pteval) || !pte_write(pteval))
+			return 0;
+		page = vm_normal_page(vma, address, pteval);
+		if (!page || !PageAnon(page) || PageCompound(page) ||
+		    PageSwapCache(page))
+			return 0;
+		if (page_mapcount(page) != 1 || page_count(page) != 1)
+			return 0;
+	}
+	return 1;
+}
+
+static int khugepaged_scan_pmd(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long address)
+{
+	pmd_t *pmd;
+	pte_t *pte;
+	spinlock_t *ptl;
+	int ret;
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || pmd_none_or_trans_huge_or_clear_bad(pmd))
+		return 0;
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	ret = khugepaged_ptes_ok(vma, address, pte);
+	pte_unmap_unlock(pte, ptl);
+	return ret;
+}
+
+/*
+ * Copy the small pages into @page, which replaces them, and drop them.
+ * Returns the number of small pages there were.
+ */
+static int __collapse_huge_page_copy(pte_t *pte, struct page *page,
+				     struct vm_area_struct *vma,
+				     unsigned long address, spinlock_t *ptl)
+{
+	int i, present = 0;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++, pte++, page++,
+	     address += PAGE_SIZE) {
+		pte_t pteval = *pte;
+		struct page *src_page;
+
+		if (pte_none(pteval)) {
+			clear_user_highpage(page, address);
+			continue;
+		}
+		src_page = pte_page(pteval);
+		copy_user_highpage(page, src_page, address);
+		spin_lock(ptl);
+		pte_clear(vma->vm_mm, address, pte);
+		page_remove_rmap(src_page);
+		spin_unlock(ptl);
+		put_page(src_page);
+		present++;
+	}
+	return present;
+}
+
+/*
+ * Replace the page table at the aligned @address by a huge page.  With
+ * mmap_sem held for writing no fault or get_user_pages can get at the
+ * range; the anon_vma lock keeps the pageout code away while the pmd
+ * is cleared.
+ */
+static void collapse_huge_page(struct mm_struct *mm, unsigned long address)
+{
+	struct vm_area_struct *vma;
+	struct page *new_page, *pgtable;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	spinlock_t *ptl;
+	int isolated, present;
+
+	new_page = alloc_hugepage(GFP_HIGHUSER);
+	if (unlikely(!new_page)) {
+		inc_page_state(thp_collapse_alloc_failed);
+		return;
+	}
+
+	down_write(&mm->mmap_sem);
+	vma = find_vma(mm, address);
+	if (!vma || !vma->anon_vma || !transparent_hugepage_vma(vma, address))
+		goto out;
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || pmd_none_or_trans_huge_or_clear_bad(pmd))
+		goto out;
+
+	spin_lock(&vma->anon_vma->lock);
+	pte = pte_offset_map(pmd, address);
+	ptl = pte_lockptr(mm, pmd);
+
+	spin_lock(&mm->page_table_lock);
+	_pmd = *pmd;
+	pmd_clear(pmd);
+	spin_unlock(&mm->page_table_lock);
+	flush_tlb_range(vma, address, address + HPAGE_PMD_SIZE);
+
+	spin_lock(ptl);
+	isolated = khugepaged_ptes_ok(vma, address, pte);
+	spin_unlock(ptl);
+	if (unlikely(!isolated)) {
+		pte_unmap(pte);
+		spin_lock(&mm->page_table_lock);
+		set_pmd(pmd, _pmd);
+		spin_unlock(&mm->page_table_lock);
+		spin_unlock(&vma->anon_vma->lock);
+		goto out;
+	}
+	spin_unlock(&vma->anon_vma->lock);
+
+	present = __collapse_huge_page_copy(pte, new_page, vma, address, ptl);
+	pte_unmap(pte);
+
+	/* the emptied page table becomes the deposit for splitting */
+	pgtable = pmd_page(_pmd);
+
+	spin_lock(&mm->page_table_lock);
+	BUG_ON(!pmd_none(*pmd));
+	page_add_new_anon_rmap(new_page, vma, address);
+	set_pte_at(mm, address, huge_pmd_pte(pmd), mk_huge_entry(new_page, vma));
+	pgtable_deposit(mm, pgtable);
+	add_mm_counter(mm, anon_rss, HPAGE_PMD_NR - present);
+	lru_cache_add_active(new_page);
+	spin_unlock(&mm->page_table_lock);
+
+	inc_page_state(thp_collapse_alloc);
+	new_page = NULL;
+out:
+	up_write(&mm->mmap_sem);
+	if (new_page)
+		put_page(new_page);
+}
+
+/*
+ * Scan the current mm from where we left off, looking at up to @pages
+ * pages.  Returns the number of pages looked at, 0 if there was no mm.
+ */
+static int khugepaged_scan_mm(int pages)
+{
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	unsigned long address;
+	int progress = 0;
+
+	spin_lock(&khugepaged_mm_lock);
+	if (!khugepaged_scan.mm) {
+		if (list_empty(&khugepaged_scan_list)) {
+			spin_unlock(&khugepaged_mm_lock);
+			return 0;
+		}
+		khugepaged_scan.mm = list_entry(khugepaged_scan_list.next,
+						struct mm_struct, khugepaged_list);
+		khugepaged_scan.address = 0;
+	}
+	mm = khugepaged_scan.mm;
+	address = khugepaged_scan.address;
+	if (!atomic_inc_not_zero(&mm->mm_users)) {
+		/* on its way out, khugepaged_exit() unlinks it */
+		khugepaged_next_mm();
+		spin_unlock(&khugepaged_mm_lock);
+		return 1;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	down_read(&mm->mmap_sem);
+	for (vma = find_vma(mm, address); vma; vma = vma->vm_next) {
+		unsigned long hstart, hend;
+
+		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+		hend = vma->vm_end & HPAGE_PMD_MASK;
+		if (hstart >= hend || !vma->anon_vma ||
+		    !transparent_hugepage_vma(vma, hstart)) {
+			progress++;
+			continue;
+		}
+		if (address < hstart)
+			address = hstart;
+		for (; address < hend; address += HPAGE_PMD_SIZE) {
+			progress += HPAGE_PMD_NR;
+			if (khugepaged_scan_pmd(mm, vma, address)) {
+				up_read(&mm->mmap_sem);
+				collapse_huge_page(mm, address);
+				address += HPAGE_PMD_SIZE;
+				goto out;
+			}
+			if (progress >= pages)
+				goto breakouterloop;
+		}
+	}
+	/* the whole mm is done, on to the next one */
+	address = -1UL;
+breakouterloop:
+	up_read(&mm->mmap_sem);
+out:
+	spin_lock(&khugepaged_mm_lock);
+	if (khugepaged_scan.mm == mm) {
+		khugepaged_scan.address = address;
+		if (address == -1UL)
+			khugepaged_next_mm();
+	}
+	spin_unlock(&khugepaged_mm_lock);
+	mmput(mm);
+	return progress;
+}
+
+static void khugepaged_do_scan(void)
+{
+	int progress = 0, pass;
+
+	while (progress < khugepaged_pages_to_scan) {
+		pass = khugepaged_scan_mm(khugepaged_pages_to_scan - progress);
+		if (!pass)
+			break;
+		progress += pass;
+		cond_resched();
+	}
+}
+
+static int khugepaged(void *none)
+{
+	set_user_nice(current, 19);
+	for ( ; ; ) {
+		try_to_freeze();
+		khugepaged_do_scan();
+		if (list_empty(&khugepaged_scan_list))
+			wait_event_interruptible(khugepaged_wait,
+					!list_empty(&khugepaged_scan_list));
+		else
+			schedule_timeout_interruptible(
+				msecs_to_jiffies(khugepaged_scan_sleep_millisecs));
+	}
+	return 0;
+}
+
+static int __init khugepaged_init(void)
+{
+	if (!has_transparent_hugepage()) {
+		transparent_hugepage_enabled = 0;
+		return 0;
+	}
+	kthread_run(khugepaged, NULL, "khugepaged");
+	return 0;
+}
+module_init(khugepaged_init)
@@ -28,3 +28,7 @@ static inline void set_page_refs(struct page *page, int order)
 
 extern void fastcall __init __free_pages_bootmem(struct page *page,
 						unsigned int order);
+
+extern void munlock_vma_pages_range(struct vm_area_struct *vma,
+			unsigned long start, unsigned long end);
+extern void munlock_vma_pages_all(struct vm_area_struct *vma);
@@ -10,7 +10,47 @@
 #include <linux/mm.h>
 #include <linux/mempolicy.h>
 #include <linux/syscalls.h>
+#include <linux/swap.h>
+#include <linux/hugetlb.h>
+#include "internal.h"
 
+/*
+ * Reclaim moves the pages it finds in VM_LOCKED vmas to the unevictable
+ * list.  When a range stops being locked, give its pages back to the
+ * normal LRU lists: if they are still mlocked elsewhere, reclaim will
+ * simply move them again.  vm_flags must no longer contain VM_LOCKED.
+ */
+void munlock_vma_pages_range(struct vm_area_struct *vma,
+			     unsigned long start, unsigned long end)
+{
+	unsigned long addr;
+
+	/* Neither hugetlbfs nor VM_IO pages are on the LRU */
+	if (is_vm_hugetlb_page(vma) || (vma->vm_flags & VM_IO))
+		return;
+
+	lru_add_drain();
+	for (addr = start; addr < end; addr += PAGE_SIZE) {
+		struct page *page = follow_page(vma, addr, FOLL_GET);
+
+		if (page) {
+			rescue_unevictable_page(page);
+			put_page(page);
+		}
+		cond_resched();
+	}
+}
+
+/*
+ * The vma is going away: take it out of mlock first.  remove_vma_list()
+ * won't see VM_LOCKED any more, so uncharge locked_vm here.
+ */
+void munlock_vma_pages_all(struct vm_area_struct *vma)
+{
+	vma->vm_flags &= ~VM_LOCKED;
+	vma->vm_mm->locked_vm -= vma_pages(vma);
+	munlock_vma_pages_range(vma, vma->vm_start, vma->vm_end);
+}
 
 static int mlock_fixup(struct vm_area_struct *vma, struct vm_area_struct **prev,
 	unsigned long start, unsigned long end, unsigned int newflags)
@@ -63,7 +103,8 @@ success:
 		pages = -pages;
 		if (!(newflags & VM_IO))
 			ret = make_pages_present(start, end);
-	}
+	} else
+		munlock_vma_pages_range(vma, start, end);
 
 	vma->vm_mm->locked_vm -= pages;
 out:
@@ -222,7 +263,7 @@ asmlinkage long sys_munlockall(void)
 
 /*
  * Objects with different lifetime than processes (SHM_LOCK and SHM_HUGETLB
- * shm segments) get accounted against the user_struct instead.
+ * shm segments, io_ring rings) get accounted against the user_struct instead.
  */
 static DEFINE_SPINLOCK(shmlock_user_lock);
 
@@ -30,6 +30,8 @@
 #include <asm/cacheflush.h>
 #include <asm/tlb.h>
 
+#include "internal.h"
+
 static void unmap_region(struct mm_struct *mm,
 		struct vm_area_struct *vma, struct vm_area_struct *prev,
 		unsigned long start, unsigned long end);
@@ -1797,6 +1799,20 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	}
 	vma = prev? prev->vm_next: mm->mmap;
 
+	/*
+	 * Put mlocked pages back on the evictable LRU lists while they
+	 * can still be found through the page tables.
+	 */
+	if (mm->locked_vm) {
+		struct vm_area_struct *tmp = vma;
+
+		while (tmp && tmp->vm_start < end) {
+			if (tmp->vm_flags & VM_LOCKED)
+				munlock_vma_pages_all(tmp);
+			tmp = tmp->vm_next;
+		}
+	}
+
 	/*
 	 * Remove the vma's, and unmap the actual pages
 	 */
@@ -1937,6 +1953,14 @@ void exit_mmap(struct mm_struct *mm)
 	unsigned long nr_accounted = 0;
 	unsigned long end;
 
+	/* mlocked pages which outlive the mm must become evictable */
+	if (mm->locked_vm) {
+		for (; vma; vma = vma->vm_next)
+			if (vma->vm_flags & VM_LOCKED)
+				munlock_vma_pages_all(vma);
+		vma = mm->mmap;
+	}
+
 	lru_add_drain();
 	flush_cache_mm(mm);
 	tlb = tlb_gather_mmu(mm, 1);
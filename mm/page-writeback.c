@@ -46,7 +46,6 @@
 static long ratelimit_pages = 32;
 
 static long total_pages;	/* The total number of pages in the machine. */
-static int dirty_exceeded __cacheline_aligned_in_smp;	/* Dirty mem may be over limit */
 
 /*
  * When balance_dirty_pages decides that the caller needs to perform some
@@ -62,7 +61,7 @@ static inline long sync_writeback_pages(void)
 /* The following parameters are exported via /proc/sys/vm */
 
 /*
- * Start background writeback (via pdflush) at this percentage
+ * Start background writeback (via the flusher threads) at this percentage
  */
 int dirty_background_ratio = 10;
 
@@ -96,9 +95,6 @@ EXPORT_SYMBOL(laptop_mode);
 
 /* End of sysctl-exported parameters */
 
-
-static void background_writeout(unsigned long _min_pages);
-
 struct writeback_state
 {
 	unsigned long nr_dirty;
@@ -180,19 +176,184 @@ get_dirty_limits(struct writeback_state *wbs, long *pbackground, long *pdirty,
 	*pdirty = dirty;
 }
 
+/*
+ * Each device gets a share of the dirty limit in proportion to how fast it
+ * has been completing writeback lately, so that a slow device only holds
+ * a small part of the dirty memory and cannot stall writers to the fast
+ * ones.
+ *
+ * vm_completions counts every completed page writeback on a registered
+ * device.  Time is measured in periods of 2^period_shift completions.  A
+ * device's completions count is halved at the end of each period, so it
+ * adds up to about 2^period_shift plus the completions of the current
+ * period over all devices, and the device's share is its count over that.
+ * The halving is done lazily, the next time the device's count is used.
+ *
+ * A period is about four times the dirty limit, so a device which starts
+ * writing gets its share within a few dirty limits' worth of writeback.
+ */
+static struct percpu_counter vm_completions;
+static int period_shift;
+
+static int calc_period_shift(void)
+{
+	long dirty_total;
+
+	dirty_total = (vm_dirty_ratio * total_pages) / 100;
+	if (dirty_total < 2)
+		dirty_total = 2;
+	return 2 + long_log2(dirty_total - 1);
+}
+
+static unsigned long completions_period(void)
+{
+	return percpu_counter_read_positive(&vm_completions) >> period_shift;
+}
+
+/*
+ * Bring @bdi's completions count up to @period, halving it once for each
+ * period that ended since it was last looked at.  After a change of
+ * period_shift the period can go backwards; the count is then left alone.
+ */
+static void bdi_age_completions(struct backing_dev_info *bdi,
+				unsigned long period)
+{
+	unsigned long flags;
+	long missed;
+	long val;
+
+	if (bdi->completions_period == period)
+		return;
+
+	spin_lock_irqsave(&bdi->completions_lock, flags);
+	missed = period - bdi->completions_period;
+	if (missed > 0) {
+		val = percpu_counter_read(&bdi->completions);
+		if (val > 0) {
+			if (missed < BITS_PER_LONG)
+				val -= val >> missed;
+			percpu_counter_mod(&bdi->completions, -val);
+		}
+	}
+	bdi->completions_period = period;
+	spin_unlock_irqrestore(&bdi->completions_lock, flags);
+}
+
+/*
+ * A page's writeback completed on @bdi.  Called with interrupts off.
+ */
+static void bdi_writeout_inc(struct backing_dev_info *bdi)
+{
+	if (!bdi_registered(bdi))
+		return;
+	percpu_counter_mod(&vm_completions, 1);
+	bdi_age_completions(bdi, completions_period());
+	percpu_counter_mod(&bdi->completions, 1);
+}
+
+/*
+ * A device's share of a dirty threshold, in proportion to its part in the
+ * recent writeback completions.  Devices which never called bdi_init() are
+ * not counted, and are held to the whole threshold against the global
+ * page counts instead; see bdi_dirty_pages().
+ */
+static long bdi_share(struct backing_dev_info *bdi, long thresh)
+{
+	unsigned long events;
+	unsigned long long share;
+	long numerator;
+	unsigned long denominator;
+
+	if (!bdi_registered(bdi))
+		return thresh;
+
+	events = percpu_counter_read_positive(&vm_completions);
+	bdi_age_completions(bdi, events >> period_shift);
+	numerator = percpu_counter_read(&bdi->completions);
+	if (numerator <= 0)
+		return 0;
+	denominator = (1UL << period_shift) +
+			(events & ((1UL << period_shift) - 1));
+	if (numerator >= denominator)
+		return thresh;
+
+	share = (unsigned long long)thresh * numerator;
+	do_div(share, denominator);
+	return share;
+}
+
+/*
+ * The dirty and writeback pages which count against @bdi's share of the
+ * limits.
+ */
+static void bdi_dirty_pages(struct backing_dev_info *bdi,
+		struct writeback_state *wbs, long *preclaimable, long *pwriteback)
+{
+	if (bdi_registered(bdi)) {
+		*preclaimable = bdi_stat(bdi, BDI_RECLAIMABLE);
+		*pwriteback = bdi_stat(bdi, BDI_WRITEBACK);
+	} else {
+		*preclaimable = wbs->nr_dirty + wbs->nr_unstable;
+		*pwriteback = wbs->nr_writeback;
+	}
+}
+
+/*
+ * @bdi's share of the dirty threshold.  The shares add up to about the
+ * whole threshold, but a device whose share grew while the others still
+ * hold their old dirty pages could take the system over it.  So a share is
+ * also limited to what the device already has plus what is left of the
+ * global threshold.
+ */
+static long bdi_dirty_limit(struct backing_dev_info *bdi,
+		struct writeback_state *wbs, long dirty_thresh)
+{
+	long bdi_thresh = bdi_share(bdi, dirty_thresh);
+	long bdi_reclaimable;
+	long bdi_writeback;
+	long avail;
+
+	bdi_dirty_pages(bdi, wbs, &bdi_reclaimable, &bdi_writeback);
+	avail = dirty_thresh - (wbs->nr_dirty + wbs->nr_unstable +
+				wbs->nr_writeback);
+	if (avail < 0)
+		avail = 0;
+	avail += bdi_reclaimable + bdi_writeback;
+	return min(bdi_thresh, avail);
+}
+
+/*
+ * @bdi's current share of the dirty threshold, in pages.
+ */
+unsigned long bdi_dirty_thresh(struct backing_dev_info *bdi)
+{
+	struct writeback_state wbs;
+	long background_thresh;
+	long dirty_thresh;
+
+	get_dirty_limits(&wbs, &background_thresh, &dirty_thresh, NULL);
+	return bdi_share(bdi, dirty_thresh);
+}
+
 /*
  * balance_dirty_pages() must be called by processes which are generating dirty
- * data.  It looks at the number of dirty pages in the machine and will force
- * the caller to perform writeback if the system is over `vm_dirty_ratio'.
- * If we're over `background_thresh' then pdflush is woken to perform some
- * writeout.
+ * data.  It looks at the number of dirty pages on the caller's device and
+ * will force the caller to perform writeback if the device is over its
+ * share of `vm_dirty_ratio'.  If we're over `background_thresh' then the
+ * device's flusher is woken to perform some writeout.
+ *
+ * Only the caller's device is looked at, so that one slow or congested disk
+ * does not stall the writers to all the others: the slow disk's share is
+ * small, and it is its own writers which wait for it.
  */
 static void balance_dirty_pages(struct address_space *mapping)
 {
 	struct writeback_state wbs;
-	long nr_reclaimable;
+	long bdi_nr_reclaimable;
+	long bdi_nr_writeback;
 	long background_thresh;
 	long dirty_thresh;
+	long bdi_thresh;
 	unsigned long pages_written = 0;
 	unsigned long write_chunk = sync_writeback_pages();
 
@@ -208,12 +369,14 @@ static void balance_dirty_pages(struct address_space *mapping)
 
 		get_dirty_limits(&wbs, &background_thresh,
 					&dirty_thresh, mapping);
-		nr_reclaimable = wbs.nr_dirty + wbs.nr_unstable;
-		if (nr_reclaimable + wbs.nr_writeback <= dirty_thresh)
+		bdi_thresh = bdi_dirty_limit(bdi, &wbs, dirty_thresh);
+		bdi_dirty_pages(bdi, &wbs, &bdi_nr_reclaimable,
+					&bdi_nr_writeback);
+		if (bdi_nr_reclaimable + bdi_nr_writeback <= bdi_thresh)
 			break;
 
-		if (!dirty_exceeded)
-			dirty_exceeded = 1;
+		if (!bdi->dirty_exceeded)
+			bdi->dirty_exceeded = 1;
 
 		/* Note: nr_reclaimable denotes nr_dirty + nr_unstable.
 		 * Unstable writes are a feature of certain networked
@@ -221,12 +384,14 @@ static void balance_dirty_pages(struct address_space *mapping)
 		 * written to the server's write cache, but has not yet
 		 * been flushed to permanent storage.
 		 */
-		if (nr_reclaimable) {
-			writeback_inodes(&wbc);
+		if (bdi_nr_reclaimable) {
+			writeback_inodes_bdi(bdi, &wbc);
 			get_dirty_limits(&wbs, &background_thresh,
 					&dirty_thresh, mapping);
-			nr_reclaimable = wbs.nr_dirty + wbs.nr_unstable;
-			if (nr_reclaimable + wbs.nr_writeback <= dirty_thresh)
+			bdi_thresh = bdi_dirty_limit(bdi, &wbs, dirty_thresh);
+			bdi_dirty_pages(bdi, &wbs, &bdi_nr_reclaimable,
+						&bdi_nr_writeback);
+			if (bdi_nr_reclaimable + bdi_nr_writeback <= bdi_thresh)
 				break;
 			pages_written += write_chunk - wbc.nr_to_write;
 			if (pages_written >= write_chunk)
@@ -235,11 +400,12 @@ static void balance_dirty_pages(struct address_space *mapping)
 		blk_congestion_wait(WRITE, HZ/10);
 	}
 
-	if (nr_reclaimable + wbs.nr_writeback <= dirty_thresh && dirty_exceeded)
-		dirty_exceeded = 0;
+	if (bdi_nr_reclaimable + bdi_nr_writeback <= bdi_thresh &&
+	    bdi->dirty_exceeded)
+		bdi->dirty_exceeded = 0;
 
 	if (writeback_in_progress(bdi))
-		return;		/* pdflush is already working this queue */
+		return;		/* the flusher is already working this queue */
 
 	/*
 	 * In laptop mode, we wait until hitting the higher threshold before
@@ -250,8 +416,9 @@ static void balance_dirty_pages(struct address_space *mapping)
 	 * background_thresh, to keep the amount of dirty memory low.
 	 */
 	if ((laptop_mode && pages_written) ||
-	     (!laptop_mode && (nr_reclaimable > background_thresh)))
-		pdflush_operation(background_writeout, 0);
+	     (!laptop_mode && (wbs.nr_dirty + wbs.nr_unstable >
+				background_thresh)))
+		bdi_start_writeback(bdi, 0);
 }
 
 /**
@@ -273,7 +440,7 @@ void balance_dirty_pages_ratelimited(struct address_space *mapping)
 	long ratelimit;
 
 	ratelimit = ratelimit_pages;
-	if (dirty_exceeded)
+	if (mapping->backing_dev_info->dirty_exceeded)
 		ratelimit = 8;
 
 	/*
@@ -313,14 +480,15 @@ void throttle_vm_writeout(void)
 
 
 /*
- * writeback at least _min_pages, and keep writing until the amount of dirty
- * memory is less than the background threshold, or until we're all clean.
+ * Write back at least min_pages of @bdi's pages, and keep writing while the
+ * amount of dirty memory is over the background threshold and this device
+ * is over its share of it, or until the device is all clean.  Run by the
+ * device's flusher thread.
  */
-static void background_writeout(unsigned long _min_pages)
+void bdi_background_writeout(struct backing_dev_info *bdi, long min_pages)
 {
-	long min_pages = _min_pages;
 	struct writeback_control wbc = {
-		.bdi		= NULL,
+		.bdi		= bdi,
 		.sync_mode	= WB_SYNC_NONE,
 		.older_than_this = NULL,
 		.nr_to_write	= 0,
@@ -333,13 +501,15 @@ static void background_writeout(unsigned long _min_pages)
 		long dirty_thresh;
 
 		get_dirty_limits(&wbs, &background_thresh, &dirty_thresh, NULL);
-		if (wbs.nr_dirty + wbs.nr_unstable < background_thresh
+		if ((wbs.nr_dirty + wbs.nr_unstable < background_thresh ||
+		     bdi_stat(bdi, BDI_RECLAIMABLE) <=
+				bdi_share(bdi, background_thresh))
 				&& min_pages <= 0)
 			break;
 		wbc.encountered_congestion = 0;
 		wbc.nr_to_write = MAX_WRITEBACK_PAGES;
 		wbc.pages_skipped = 0;
-		writeback_inodes(&wbc);
+		writeback_inodes_bdi(bdi, &wbc);
 		min_pages -= MAX_WRITEBACK_PAGES - wbc.nr_to_write;
 		if (wbc.nr_to_write > 0 || wbc.pages_skipped > 0) {
 			/* Wrote less than expected */
@@ -350,52 +520,31 @@ static void background_writeout(unsigned long _min_pages)
 	}
 }
 
-/*
- * Start writeback of `nr_pages' pages.  If `nr_pages' is zero, write back
- * the whole world.  Returns 0 if a pdflush thread was dispatched.  Returns
- * -1 if all pdflush threads were busy.
- */
-int wakeup_pdflush(long nr_pages)
-{
-	if (nr_pages == 0) {
-		struct writeback_state wbs;
-
-		get_writeback_state(&wbs);
-		nr_pages = wbs.nr_dirty + wbs.nr_unstable;
-	}
-	return pdflush_operation(background_writeout, nr_pages);
-}
-
-static void wb_timer_fn(unsigned long unused);
 static void laptop_timer_fn(unsigned long unused);
 
-static DEFINE_TIMER(wb_timer, wb_timer_fn, 0, 0);
 static DEFINE_TIMER(laptop_mode_wb_timer, laptop_timer_fn, 0, 0);
 
 /*
- * Periodic writeback of "old" data.
+ * Periodic writeback of "old" data on one device.
  *
  * Define "old": the first time one of an inode's pages is dirtied, we mark the
  * dirtying-time in the inode's address_space.  So this periodic writeback code
- * just walks the superblock inode list, writing back any inodes which are
+ * just walks the device's dirty inode list, writing back any inodes which are
  * older than a specific point in time.
  *
- * Try to run once per dirty_writeback_centisecs.  But if a writeback event
- * takes longer than a dirty_writeback_centisecs interval, then leave a
- * one-second gap.
+ * The flusher thread runs this once per dirty_writeback_centisecs.  But if a
+ * writeback event takes longer than a dirty_writeback_centisecs interval,
+ * then it leaves a one-second gap.
  *
  * older_than_this takes precedence over nr_to_write.  So we'll only write back
  * all dirty pages if they are all attached to "old" mappings.
  */
-static void wb_kupdate(unsigned long arg)
+void bdi_kupdate(struct backing_dev_info *bdi)
 {
 	unsigned long oldest_jif;
-	unsigned long start_jif;
-	unsigned long next_jif;
 	long nr_to_write;
-	struct writeback_state wbs;
 	struct writeback_control wbc = {
-		.bdi		= NULL,
+		.bdi		= bdi,
 		.sync_mode	= WB_SYNC_NONE,
 		.older_than_this = &oldest_jif,
 		.nr_to_write	= 0,
@@ -403,18 +552,13 @@ static void wb_kupdate(unsigned long arg)
 		.for_kupdate	= 1,
 	};
 
-	sync_supers();
-
-	get_writeback_state(&wbs);
 	oldest_jif = jiffies - (dirty_expire_centisecs * HZ) / 100;
-	start_jif = jiffies;
-	next_jif = start_jif + (dirty_writeback_centisecs * HZ) / 100;
-	nr_to_write = wbs.nr_dirty + wbs.nr_unstable +
+	nr_to_write = bdi_stat(bdi, BDI_RECLAIMABLE) +
 			(inodes_stat.nr_inodes - inodes_stat.nr_unused);
 	while (nr_to_write > 0) {
 		wbc.encountered_congestion = 0;
 		wbc.nr_to_write = MAX_WRITEBACK_PAGES;
-		writeback_inodes(&wbc);
+		writeback_inodes_bdi(bdi, &wbc);
 		if (wbc.nr_to_write > 0) {
 			if (wbc.encountered_congestion)
 				blk_congestion_wait(WRITE, HZ/10);
@@ -423,10 +567,6 @@ static void wb_kupdate(unsigned long arg)
 		}
 		nr_to_write -= MAX_WRITEBACK_PAGES - wbc.nr_to_write;
 	}
-	if (time_before(next_jif, jiffies + HZ))
-		next_jif = jiffies + HZ;
-	if (dirty_writeback_centisecs)
-		mod_timer(&wb_timer, next_jif);
 }
 
 /*
@@ -436,29 +576,69 @@ int dirty_writeback_centisecs_handler(ctl_table *table, int write,
 		struct file *file, void __user *buffer, size_t *length, loff_t *ppos)
 {
 	proc_dointvec(table, write, file, buffer, length, ppos);
-	if (dirty_writeback_centisecs) {
-		mod_timer(&wb_timer,
-			jiffies + (dirty_writeback_centisecs * HZ) / 100);
-	} else {
-		del_timer(&wb_timer);
-	}
+	if (write)
+		bdi_wakeup_all();	/* to pick up the new interval */
 	return 0;
 }
 
-static void wb_timer_fn(unsigned long unused)
+/*
+ * sysctl handler for /proc/sys/vm/dirty_ratio
+ */
+int dirty_ratio_handler(ctl_table *table, int write,
+		struct file *file, void __user *buffer, size_t *length, loff_t *ppos)
 {
-	if (pdflush_operation(wb_kupdate, 0) < 0)
-		mod_timer(&wb_timer, jiffies + HZ); /* delay 1 second */
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, file, buffer, length, ppos);
+	if (ret == 0 && write)
+		period_shift = calc_period_shift();
+	return ret;
 }
 
-static void laptop_flush(unsigned long unused)
+/*
+ * sysctl(2) strategy for vm.dirty_ratio: does the range check of
+ * sysctl_intvec(), then stores the value and recomputes period_shift as
+ * dirty_ratio_handler() does.
+ */
+int dirty_ratio_strategy(ctl_table *table, int __user *name, int nlen,
+		void __user *oldval, size_t __user *oldlenp,
+		void __user *newval, size_t newlen, void **context)
 {
-	sys_sync();
+	int new, ret;
+
+	ret = sysctl_intvec(table, name, nlen, oldval, oldlenp,
+			    newval, newlen, context);
+	if (ret || !newval || !newlen)
+		return ret;
+
+	if (newlen != sizeof(int))
+		return -EINVAL;
+	if (get_user(new, (int __user *)newval))
+		return -EFAULT;
+
+	if (oldval && oldlenp) {
+		size_t len;
+
+		if (get_user(len, oldlenp))
+			return -EFAULT;
+		if (len) {
+			if (len > sizeof(int))
+				len = sizeof(int);
+			if (copy_to_user(oldval, &vm_dirty_ratio, len))
+				return -EFAULT;
+			if (put_user(len, oldlenp))
+				return -EFAULT;
+		}
+	}
+
+	vm_dirty_ratio = new;
+	period_shift = calc_period_shift();
+	return 1;
 }
 
 static void laptop_timer_fn(unsigned long unused)
 {
-	pdflush_operation(laptop_flush, 0);
+	bdi_laptop_flush();
 }
 
 /*
@@ -544,7 +724,9 @@ void __init page_writeback_init(void)
 		if (vm_dirty_ratio <= 0)
 			vm_dirty_ratio = 1;
 	}
-	mod_timer(&wb_timer, jiffies + (dirty_writeback_centisecs * HZ) / 100);
+	percpu_counter_init(&vm_completions);
+	period_shift = calc_period_shift();
+	bdi_init(&default_backing_dev_info);
 	set_ratelimit();
 	register_cpu_notifier(&ratelimit_nb);
 }
@@ -632,8 +814,11 @@ int __set_page_dirty_nobuffers(struct page *page)
 			mapping2 = page_mapping(page);
 			if (mapping2) { /* Race with truncate? */
 				BUG_ON(mapping2 != mapping);
-				if (mapping_cap_account_dirty(mapping))
+				if (mapping_cap_account_dirty(mapping)) {
 					inc_page_state(nr_dirty);
+					inc_bdi_stat(mapping->backing_dev_info,
+							BDI_RECLAIMABLE);
+				}
 				radix_tree_tag_set(&mapping->page_tree,
 					page_index(page), PAGECACHE_TAG_DIRTY);
 			}
@@ -718,8 +903,11 @@ int test_clear_page_dirty(struct page *page)
 						page_index(page),
 						PAGECACHE_TAG_DIRTY);
 			write_unlock_irqrestore(&mapping->tree_lock, flags);
-			if (mapping_cap_account_dirty(mapping))
+			if (mapping_cap_account_dirty(mapping)) {
 				dec_page_state(nr_dirty);
+				dec_bdi_stat(mapping->backing_dev_info,
+						BDI_RECLAIMABLE);
+			}
 			return 1;
 		}
 		write_unlock_irqrestore(&mapping->tree_lock, flags);
@@ -749,8 +937,11 @@ int clear_page_dirty_for_io(struct page *page)
 
 	if (mapping) {
 		if (TestClearPageDirty(page)) {
-			if (mapping_cap_account_dirty(mapping))
+			if (mapping_cap_account_dirty(mapping)) {
 				dec_page_state(nr_dirty);
+				dec_bdi_stat(mapping->backing_dev_info,
+						BDI_RECLAIMABLE);
+			}
 			return 1;
 		}
 		return 0;
@@ -769,10 +960,16 @@ int test_clear_page_writeback(struct page *page)
 
 		write_lock_irqsave(&mapping->tree_lock, flags);
 		ret = TestClearPageWriteback(page);
-		if (ret)
+		if (ret) {
+			struct backing_dev_info *bdi = mapping->backing_dev_info;
+
 			radix_tree_tag_clear(&mapping->page_tree,
 						page_index(page),
 						PAGECACHE_TAG_WRITEBACK);
+			dec_bdi_stat(bdi, BDI_WRITEBACK);
+			inc_bdi_stat(bdi, BDI_WRITTEN);
+			bdi_writeout_inc(bdi);
+		}
 		write_unlock_irqrestore(&mapping->tree_lock, flags);
 	} else {
 		ret = TestClearPageWriteback(page);
@@ -790,10 +987,12 @@ int test_set_page_writeback(struct page *page)
 
 		write_lock_irqsave(&mapping->tree_lock, flags);
 		ret = TestSetPageWriteback(page);
-		if (!ret)
+		if (!ret) {
 			radix_tree_tag_set(&mapping->page_tree,
 						page_index(page),
 						PAGECACHE_TAG_WRITEBACK);
+			inc_bdi_stat(mapping->backing_dev_info, BDI_WRITEBACK);
+		}
 		if (!PageDirty(page))
 			radix_tree_tag_clear(&mapping->page_tree,
 						page_index(page),
@@ -152,7 +152,8 @@ static void bad_page(struct page *page)
 			1 << PG_reclaim |
 			1 << PG_slab    |
 			1 << PG_swapcache |
-			1 << PG_writeback );
+			1 << PG_writeback |
+			1 << PG_unevictable );
 	set_page_count(page, 0);
 	reset_page_mapcount(page);
 	page->mapping = NULL;
@@ -360,10 +361,13 @@ static inline int free_pages_check(struct page *page)
 			1 << PG_slab	|
 			1 << PG_swapcache |
 			1 << PG_writeback |
+			1 << PG_unevictable |
 			1 << PG_reserved ))))
 		bad_page(page);
 	if (PageDirty(page))
 		__ClearPageDirty(page);
+	if (PageSwapBacked(page))
+		__ClearPageSwapBacked(page);
 	/*
 	 * For now, we report if PG_reserved was found set, but do not
 	 * clear it, and do not free the page.  But we shall soon need
@@ -518,6 +522,7 @@ static int prep_new_page(struct page *page, int order)
 			1 << PG_slab    |
 			1 << PG_swapcache |
 			1 << PG_writeback |
+			1 << PG_unevictable |
 			1 << PG_reserved ))))
 		bad_page(page);
 
@@ -530,7 +535,8 @@ static int prep_new_page(struct page *page, int order)
 
 	page->flags &= ~(1 << PG_uptodate | 1 << PG_error |
 			1 << PG_referenced | 1 << PG_arch_1 |
-			1 << PG_checked | 1 << PG_mappedtodisk);
+			1 << PG_checked | 1 << PG_mappedtodisk |
+			1 << PG_readahead);
 	set_page_private(page, 0);
 	set_page_refs(page, order);
 	kernel_map_pages(page, 1 << order, 1);
@@ -1307,8 +1313,10 @@ void __get_zone_counts(unsigned long *active, unsigned long *inactive,
 	*inactive = 0;
 	*free = 0;
 	for (i = 0; i < MAX_NR_ZONES; i++) {
-		*active += zones[i].nr_active;
-		*inactive += zones[i].nr_inactive;
+		*active += zones[i].lru[LRU_ACTIVE_ANON].nr +
+			   zones[i].lru[LRU_ACTIVE_FILE].nr;
+		*inactive += zones[i].lru[LRU_INACTIVE_ANON].nr +
+			     zones[i].lru[LRU_INACTIVE_FILE].nr;
 		*free += zones[i].free_pages;
 	}
 }
@@ -1330,6 +1338,21 @@ void get_zone_counts(unsigned long *active,
 	}
 }
 
+/* The number of pages on each of the LRU lists, over all zones */
+void get_lru_counts(unsigned long *nr)
+{
+	struct pglist_data *pgdat;
+	enum lru_list l;
+	int i;
+
+	for_each_lru(l)
+		nr[l] = 0;
+	for_each_pgdat(pgdat)
+		for (i = 0; i < MAX_NR_ZONES; i++)
+			for_each_lru(l)
+				nr[l] += pgdat->node_zones[i].lru[l].nr;
+}
+
 void si_meminfo(struct sysinfo *val)
 {
 	val->totalram = totalram_pages;
@@ -1430,8 +1453,11 @@ void show_free_areas(void)
 			" min:%lukB"
 			" low:%lukB"
 			" high:%lukB"
-			" active:%lukB"
-			" inactive:%lukB"
+			" active_anon:%lukB"
+			" inactive_anon:%lukB"
+			" active_file:%lukB"
+			" inactive_file:%lukB"
+			" unevictable:%lukB"
 			" present:%lukB"
 			" pages_scanned:%lu"
 			" all_unreclaimable? %s"
@@ -1441,8 +1467,11 @@ void show_free_areas(void)
 			K(zone->pages_min),
 			K(zone->pages_low),
 			K(zone->pages_high),
-			K(zone->nr_active),
-			K(zone->nr_inactive),
+			K(zone->lru[LRU_ACTIVE_ANON].nr),
+			K(zone->lru[LRU_INACTIVE_ANON].nr),
+			K(zone->lru[LRU_ACTIVE_FILE].nr),
+			K(zone->lru[LRU_INACTIVE_FILE].nr),
+			K(zone->lru[LRU_UNEVICTABLE].nr),
 			K(zone->present_pages),
 			zone->pages_scanned,
 			(zone->all_unreclaimable ? "yes" : "no")
@@ -2048,7 +2077,8 @@ static void __init free_area_init_core(struct pglist_data *pgdat,
 	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
 		struct zone *zone = pgdat->node_zones + j;
-		unsigned long size, realsize;
+		unsigned long size, realsize, gb;
+		enum lru_list l;
 
 		realsize = size = zones_size[j];
 		if (zholes_size)
@@ -2070,12 +2100,20 @@ static void __init free_area_init_core(struct pglist_data *pgdat,
 		zone->temp_priority = zone->prev_priority = DEF_PRIORITY;
 
 		zone_pcp_init(zone);
-		INIT_LIST_HEAD(&zone->active_list);
-		INIT_LIST_HEAD(&zone->inactive_list);
-		zone->nr_scan_active = 0;
-		zone->nr_scan_inactive = 0;
-		zone->nr_active = 0;
-		zone->nr_inactive = 0;
+		for_each_lru(l) {
+			INIT_LIST_HEAD(&zone->lru[l].list);
+			zone->lru[l].nr = 0;
+			zone->lru[l].nr_scan = 0;
+		}
+		zone->recent_rotated[0] = zone->recent_rotated[1] = 0;
+		zone->recent_scanned[0] = zone->recent_scanned[1] = 0;
+		/*
+		 * Keep more of the anon pages active in larger zones: the
+		 * inactive list only has to be long enough to give pages a
+		 * chance to be referenced before they are swapped out.
+		 */
+		gb = realsize >> (30 - PAGE_SHIFT);
+		zone->inactive_ratio = gb ? int_sqrt(10 * gb) : 1;
 		atomic_set(&zone->reclaim_in_progress, 0);
 		if (!size)
 			continue;
@@ -2222,19 +2260,33 @@ static int zoneinfo_show(struct seq_file *m, void *arg)
 			   "\n        min      %lu"
 			   "\n        low      %lu"
 			   "\n        high     %lu"
-			   "\n        active   %lu"
-			   "\n        inactive %lu"
-			   "\n        scanned  %lu (a: %lu i: %lu)"
+			   "\n        active_anon   %lu"
+			   "\n        inactive_anon %lu"
+			   "\n        active_file   %lu"
+			   "\n        inactive_file %lu"
+			   "\n        unevictable   %lu"
+			   "\n        scanned  %lu (aa: %lu ia: %lu af: %lu if: %lu)"
+			   "\n        rotated  %lu/%lu (anon) %lu/%lu (file)"
+			   "\n        inactive_ratio %u"
 			   "\n        spanned  %lu"
 			   "\n        present  %lu",
 			   zone->free_pages,
 			   zone->pages_min,
 			   zone->pages_low,
 			   zone->pages_high,
-			   zone->nr_active,
-			   zone->nr_inactive,
+			   zone->lru[LRU_ACTIVE_ANON].nr,
+			   zone->lru[LRU_INACTIVE_ANON].nr,
+			   zone->lru[LRU_ACTIVE_FILE].nr,
+			   zone->lru[LRU_INACTIVE_FILE].nr,
+			   zone->lru[LRU_UNEVICTABLE].nr,
 			   zone->pages_scanned,
-			   zone->nr_scan_active, zone->nr_scan_inactive,
+			   zone->lru[LRU_ACTIVE_ANON].nr_scan,
+			   zone->lru[LRU_INACTIVE_ANON].nr_scan,
+			   zone->lru[LRU_ACTIVE_FILE].nr_scan,
+			   zone->lru[LRU_INACTIVE_FILE].nr_scan,
+			   zone->recent_rotated[0], zone->recent_scanned[0],
+			   zone->recent_rotated[1], zone->recent_scanned[1],
+			   zone->inactive_ratio,
 			   zone->spanned_pages,
 			   zone->present_pages);
 		seq_printf(m,
@@ -2359,7 +2411,15 @@ static char *vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"unevictable_pgs_culled",
+	"unevictable_pgs_rescued",
 	"nr_bounce",
+
+	"thp_fault_alloc",
+	"thp_fault_fallback",
+	"thp_collapse_alloc",
+	"thp_collapse_alloc_failed",
+	"thp_split",
 };
 
 static void *vmstat_start(struct seq_file *m, loff_t *pos)
@@ -25,6 +25,7 @@ struct backing_dev_info default_backing_dev_info = {
 	.state		= 0,
 	.capabilities	= BDI_CAP_MAP_COPY,
 	.unplug_io_fn	= default_unplug_io_fn,
+	.name		= "default",
 };
 EXPORT_SYMBOL_GPL(default_backing_dev_info);
 
@@ -36,71 +37,41 @@ void
 file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping)
 {
 	ra->ra_pages = mapping->backing_dev_info->ra_pages;
-	ra->prev_page = -1;
+	ra->prev_index = -1;
 }
 
 /*
- * Return max readahead size for this inode in number-of-pages.
- */
-static inline unsigned long get_max_readahead(struct file_ra_state *ra)
-{
-	return ra->ra_pages;
-}
-
-static inline unsigned long get_min_readahead(struct file_ra_state *ra)
-{
-	return (VM_MIN_READAHEAD * 1024) / PAGE_CACHE_SIZE;
-}
-
-static inline void ra_off(struct file_ra_state *ra)
-{
-	ra->start = 0;
-	ra->flags = 0;
-	ra->size = 0;
-	ra->ahead_start = 0;
-	ra->ahead_size = 0;
-	return;
-}
-
-/*
- * Set the initial window size, round to next power of 2 and square
- * for small size, x 4 for medium, and x 2 for large
- * for 128k (32 page) max ra
- * 1-8 page = 32k initial, > 8 page = 128k initial
+ * Set the initial window size: round up to the next power of 2, then
+ * x 4 for small sizes, x 2 for medium ones and the max for large ones.
+ * For 128k (32 page) max ra: 1 page = 16k, 2-8 pages = 2x, > 8 = 128k
  */
 static unsigned long get_init_ra_size(unsigned long size, unsigned long max)
 {
 	unsigned long newsize = roundup_pow_of_two(size);
 
-	if (newsize <= max / 64)
-		newsize = newsize * newsize;
+	if (newsize <= max / 32)
+		newsize = newsize * 4;
 	else if (newsize <= max / 4)
-		newsize = max / 4;
+		newsize = newsize * 2;
 	else
 		newsize = max;
 	return newsize;
 }
 
 /*
- * Set the new window size, this is called only when I/O is to be submitted,
- * not for each call to readahead.  If a cache miss occured, reduce next I/O
- * size, else increase depending on how close to max we are.
+ * Get the previous window size, ramp it up, and
+ * return it as the new window size.
  */
-static inline unsigned long get_next_ra_size(struct file_ra_state *ra)
+static unsigned long get_next_ra_size(struct file_ra_state *ra,
+				      unsigned long max)
 {
-	unsigned long max = get_max_readahead(ra);
-	unsigned long min = get_min_readahead(ra);
 	unsigned long cur = ra->size;
 	unsigned long newsize;
 
-	if (ra->flags & RA_FLAG_MISS) {
-		ra->flags &= ~RA_FLAG_MISS;
-		newsize = max((cur - 2), min);
-	} else if (cur < max / 16) {
+	if (cur < max / 16)
 		newsize = 4 * cur;
-	} else {
+	else
 		newsize = 2 * cur;
-	}
 	return min(newsize, max);
 }
 
@@ -186,70 +157,15 @@ out:
 	return ret;
 }
 
-/*
- * Readahead design.
- *
- * The fields in struct file_ra_state represent the most-recently-executed
- * readahead attempt:
- *
- * start:	Page index at which we started the readahead
- * size:	Number of pages in that read
- *              Together, these form the "current window".
- *              Together, start and size represent the `readahead window'.
- * prev_page:   The page which the readahead algorithm most-recently inspected.
- *              It is mainly used to detect sequential file reading.
- *              If page_cache_readahead sees that it is again being called for
- *              a page which it just looked at, it can return immediately without
- *              making any state changes.
- * ahead_start,
- * ahead_size:  Together, these form the "ahead window".
- * ra_pages:	The externally controlled max readahead for this fd.
- *
- * When readahead is in the off state (size == 0), readahead is disabled.
- * In this state, prev_page is used to detect the resumption of sequential I/O.
- *
- * The readahead code manages two windows - the "current" and the "ahead"
- * windows.  The intent is that while the application is walking the pages
- * in the current window, I/O is underway on the ahead window.  When the
- * current window is fully traversed, it is replaced by the ahead window
- * and the ahead window is invalidated.  When this copying happens, the
- * new current window's pages are probably still locked.  So
- * we submit a new batch of I/O immediately, creating a new ahead window.
- *
- * So:
- *
- *   ----|----------------|----------------|-----
- *       ^start           ^start+size
- *                        ^ahead_start     ^ahead_start+ahead_size
- *
- *         ^ When this page is read, we submit I/O for the
- *           ahead window.
- *
- * A `readahead hit' occurs when a read request is made against a page which is
- * the next sequential page. Ahead window calculations are done only when it
- * is time to submit a new IO.  The code ramps up the size agressively at first,
- * but slow down as it approaches max_readhead.
- *
- * Any seek/ramdom IO will result in readahead being turned off.  It will resume
- * at the first sequential access.
- *
- * There is a special-case: if the first page which the application tries to
- * read happens to be the first page of the file, it is assumed that a linear
- * read is about to happen and the window is immediately set to the initial size
- * based on I/O request size and the max_readahead.
- *
- * This function is to be called for every read request, rather than when
- * it is time to perform readahead.  It is called only once for the entire I/O
- * regardless of size unless readahead is unable to start enough I/O to satisfy
- * the request (I/O request > max_readahead).
- */
-
 /*
  * do_page_cache_readahead actually reads a chunk of disk.  It allocates all
  * the pages first, then submits them all for I/O. This avoids the very bad
  * behaviour which would occur if page allocations are causing VM writeback.
  * We really don't want to intermingle reads and writes like that.
  *
+ * The page lookahead_size pages before the end of the chunk is marked
+ * PG_readahead: a reader that gets to it starts the next readahead.
+ *
  * Returns the number of pages requested, or the maximum amount of I/O allowed.
  *
  * do_page_cache_readahead() returns -1 if it encountered request queue
@@ -257,7 +173,8 @@ out:
  */
 static int
 __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
-			pgoff_t offset, unsigned long nr_to_read)
+			pgoff_t offset, unsigned long nr_to_read,
+			unsigned long lookahead_size)
 {
 	struct inode *inode = mapping->host;
 	struct page *page;
@@ -293,6 +210,8 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 			break;
 		page->index = page_offset;
 		list_add(&page->lru, &page_pool);
+		if (page_idx == nr_to_read - lookahead_size)
+			SetPageReadahead(page);
 		ret++;
 	}
 	read_unlock_irq(&mapping->tree_lock);
@@ -329,7 +248,7 @@ int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (this_chunk > nr_to_read)
 			this_chunk = nr_to_read;
 		err = __do_page_cache_readahead(mapping, filp,
-						offset, this_chunk);
+						offset, this_chunk, 0);
 		if (err < 0) {
 			ret = err;
 			break;
@@ -341,28 +260,6 @@ int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	return ret;
 }
 
-/*
- * Check how effective readahead is being.  If the amount of started IO is
- * less than expected then the file is partly or fully in pagecache and
- * readahead isn't helping.
- *
- */
-static inline int check_ra_success(struct file_ra_state *ra,
-			unsigned long nr_to_read, unsigned long actual)
-{
-	if (actual == 0) {
-		ra->cache_hit += nr_to_read;
-		if (ra->cache_hit >= VM_MAX_CACHE_HIT) {
-			ra_off(ra);
-			ra->flags |= RA_FLAG_INCACHE;
-			return 0;
-		}
-	} else {
-		ra->cache_hit=0;
-	}
-	return 1;
-}
-
 /*
  * This version skips the IO if the queue is read-congested, and will tell the
  * block layer to abandon the readahead if request allocation would block.
@@ -376,188 +273,317 @@ int do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	if (bdi_read_congested(mapping->backing_dev_info))
 		return -1;
 
-	return __do_page_cache_readahead(mapping, filp, offset, nr_to_read);
+	return __do_page_cache_readahead(mapping, filp, offset, nr_to_read, 0);
 }
 
 /*
- * Read 'nr_to_read' pages starting at page 'offset'. If the flag 'block'
- * is set wait till the read completes.  Otherwise attempt to read without
- * blocking.
- * Returns 1 meaning 'success' if read is succesfull without switching off
- * readhaead mode. Otherwise return failure.
+ * Readahead design.
+ *
+ * Readahead is started on demand, from two places:
+ *
+ *  - page_cache_sync_readahead(), when a read finds a page missing.  The
+ *    reader has to wait for this I/O.
+ *  - page_cache_async_readahead(), when a read finds a page marked
+ *    PG_readahead.  The marker sits async_size pages before the end of
+ *    the last readahead, so the next chunk is on its way before the
+ *    reader runs out of cached pages.
+ *
+ * The fields in struct file_ra_state describe the most recent readahead:
+ *
+ * start:	page index at which it started
+ * size:	number of pages it covered
+ * async_size:	the marker was put on page start + size - async_size
+ * prev_index:	the last page a read() looked at, to tell sequential from
+ *		random reads
+ * flags:	RA_FLAG_BACKWARD if it went backward from start + size
+ * ra_pages:	the externally controlled max readahead for this fd
+ *
+ *   ----|------------------------------|-----
+ *       ^start                         ^start + size
+ *                         ^start + size - async_size
+ *                           (PG_readahead)
+ *
+ * A reader that arrives at the marker, or misses right at the end of the
+ * window, is the stream the window was made for: the window moves on and
+ * grows, up to ra_pages.  Nothing else needs to be right in file_ra_state,
+ * which matters because the state is per struct file, and one file is
+ * often read by several streams at once: interleaved reads on one fd,
+ * many readers of one file, or nfsd, which opens a file for each request.
+ * Instead of trusting the state, the page cache is asked:
+ *
+ *  - A marker found by a stream the state does not describe still means
+ *    that someone read ahead here.  The cached run of pages after the
+ *    marker gives the size of that readahead, which is ramped up and
+ *    continued.
+ *  - A miss not adjacent to the previous read is looked up in the page
+ *    cache history: if the pages just before it are cached, some stream
+ *    has read up to here, and readahead starts in proportion to how
+ *    much it read.
+ *
+ * A miss with no history is a random read: only the requested pages are
+ * read and the state is left alone.  A read that ends just below the
+ * previous one starts reading backward instead, with no marker; the next
+ * miss below a backward window grows it.
  */
-static int
-blockable_page_cache_readahead(struct address_space *mapping, struct file *filp,
-			pgoff_t offset, unsigned long nr_to_read,
-			struct file_ra_state *ra, int block)
+
+/*
+ * Submit I/O for the readahead window in ra
+ */
+static unsigned long ra_submit(struct file_ra_state *ra,
+			       struct address_space *mapping,
+			       struct file *filp)
 {
-	int actual;
+	return __do_page_cache_readahead(mapping, filp, ra->start, ra->size,
+					 ra->async_size);
+}
 
-	if (!block && bdi_read_congested(mapping->backing_dev_info))
-		return 0;
+/*
+ * Count the cached pages just before offset, at most max of them
+ */
+static unsigned long count_history_pages(struct address_space *mapping,
+					 pgoff_t offset, unsigned long max)
+{
+	unsigned long count = 0;
 
-	actual = __do_page_cache_readahead(mapping, filp, offset, nr_to_read);
+	read_lock_irq(&mapping->tree_lock);
+	while (count < max && count < offset &&
+	       radix_tree_lookup(&mapping->page_tree, offset - count - 1))
+		count++;
+	read_unlock_irq(&mapping->tree_lock);
 
-	return check_ra_success(ra, nr_to_read, actual);
+	return count;
 }
 
-static int make_ahead_window(struct address_space *mapping, struct file *filp,
-				struct file_ra_state *ra, int force)
+/*
+ * Count the cached pages from offset on, at most max of them
+ */
+static unsigned long count_cached_pages(struct address_space *mapping,
+					pgoff_t offset, unsigned long max)
 {
-	int block, ret;
-
-	ra->ahead_size = get_next_ra_size(ra);
-	ra->ahead_start = ra->start + ra->size;
-
-	block = force || (ra->prev_page >= ra->ahead_start);
-	ret = blockable_page_cache_readahead(mapping, filp,
-			ra->ahead_start, ra->ahead_size, ra, block);
-
-	if (!ret && !force) {
-		/* A read failure in blocking mode, implies pages are
-		 * all cached. So we can safely assume we have taken
-		 * care of all the pages requested in this call.
-		 * A read failure in non-blocking mode, implies we are
-		 * reading more pages than requested in this call.  So
-		 * we safely assume we have taken care of all the pages
-		 * requested in this call.
-		 *
-		 * Just reset the ahead window in case we failed due to
-		 * congestion.  The ahead window will any way be closed
-		 * in case we failed due to excessive page cache hits.
-		 */
-		ra->ahead_start = 0;
-		ra->ahead_size = 0;
-	}
+	unsigned long count = 0;
 
-	return ret;
+	read_lock_irq(&mapping->tree_lock);
+	while (count < max &&
+	       radix_tree_lookup(&mapping->page_tree, offset + count))
+		count++;
+	read_unlock_irq(&mapping->tree_lock);
+
+	return count;
 }
 
-/**
- * page_cache_readahead - generic adaptive readahead
- * @mapping: address_space which holds the pagecache and I/O vectors
- * @ra: file_ra_state which holds the readahead state
- * @filp: passed on to ->readpage() and ->readpages()
- * @offset: start offset into @mapping, in PAGE_CACHE_SIZE units
- * @req_size: hint: total size of the read which the caller is performing in
- *            PAGE_CACHE_SIZE units
- *
- * page_cache_readahead() is the main function.  If performs the adaptive
- * readahead window size management and submits the readahead I/O.
- *
- * Note that @filp is purely used for passing on to the ->readpage[s]()
- * handler: it may refer to a different file from @mapping (so we may not use
- * @filp->f_mapping or @filp->f_dentry->d_inode here).
- * Also, @ra may not be equal to &@filp->f_ra.
- *
+/*
+ * A miss with pages cached just before it: some stream got here reading
+ * sequentially, even if this file's readahead state was not following it
  */
-unsigned long
-page_cache_readahead(struct address_space *mapping, struct file_ra_state *ra,
-		     struct file *filp, pgoff_t offset, unsigned long req_size)
+static int try_context_readahead(struct address_space *mapping,
+				 struct file_ra_state *ra, pgoff_t offset,
+				 unsigned long req_size, unsigned long max)
 {
-	unsigned long max, newsize;
-	int sequential;
+	unsigned long size;
+
+	size = count_history_pages(mapping, offset, max);
+
+	/* no history pages: it could be a random read */
+	if (!size)
+		return 0;
 
 	/*
-	 * We avoid doing extra work and bogusly perturbing the readahead
-	 * window expansion logic.
+	 * starts from the beginning of the file: a strong indication of a
+	 * long-run stream, or of a whole-file read
 	 */
-	if (offset == ra->prev_page && --req_size)
-		++offset;
+	if (size >= offset)
+		size *= 2;
 
-	/* Note that prev_page == -1 if it is a first read */
-	sequential = (offset == ra->prev_page + 1);
-	ra->prev_page = offset;
+	ra->start = offset;
+	ra->size = get_init_ra_size(size + req_size, max);
+	ra->async_size = ra->size;
+	ra->flags = 0;
 
-	max = get_max_readahead(ra);
-	newsize = min(req_size, max);
+	return 1;
+}
 
-	/* No readahead or sub-page sized read or file already in cache */
-	if (newsize == 0 || (ra->flags & RA_FLAG_INCACHE))
-		goto out;
+/*
+ * A read that ends just below the previous one, or a miss just below a
+ * backward window: read the pages below offset + req_size.  No marker,
+ * the next miss brings us back here.
+ */
+static int try_backward_readahead(struct file_ra_state *ra, pgoff_t offset,
+				  unsigned long req_size, unsigned long max)
+{
+	pgoff_t end = offset + req_size;
+	unsigned long size;
+
+	if ((ra->flags & RA_FLAG_BACKWARD) &&
+	    offset < ra->start && end >= ra->start) {
+		size = get_next_ra_size(ra, max);
+		end = ra->start;
+	} else if (offset < ra->prev_index && end <= ra->prev_index + 1 &&
+		   ra->prev_index - offset <= 2 * req_size) {
+		size = get_init_ra_size(req_size, max);
+	} else
+		return 0;
+
+	if (size > end)
+		size = end;
+	if (end - size > offset)
+		size = end - offset;
+
+	ra->start = end - size;
+	ra->size = size;
+	ra->async_size = 0;
+	ra->flags = RA_FLAG_BACKWARD;
+
+	return 1;
+}
 
-	ra->prev_page += newsize - 1;
+/*
+ * Decide where and how much to read ahead, see "Readahead design" above
+ */
+static unsigned long
+ondemand_readahead(struct address_space *mapping,
+		   struct file_ra_state *ra, struct file *filp,
+		   int hit_readahead_marker, pgoff_t offset,
+		   unsigned long req_size)
+{
+	unsigned long max = max_sane_readahead(ra->ra_pages);
 
 	/*
-	 * Special case - first read at start of file. We'll assume it's
-	 * a whole-file read and grow the window fast.  Or detect first
-	 * sequential access
+	 * It's the expected callback offset, assume sequential access.
+	 * Ramp up sizes, and push forward the readahead window.
 	 */
-	if (sequential && ra->size == 0) {
-		ra->size = get_init_ra_size(newsize, max);
-		ra->start = offset;
-		if (!blockable_page_cache_readahead(mapping, filp, offset,
-							 ra->size, ra, 1))
-			goto out;
-
-		/*
-		 * If the request size is larger than our max readahead, we
-		 * at least want to be sure that we get 2 IOs in flight and
-		 * we know that we will definitly need the new I/O.
-		 * once we do this, subsequent calls should be able to overlap
-		 * IOs,* thus preventing stalls. so issue the ahead window
-		 * immediately.
-		 */
-		if (req_size >= max)
-			make_ahead_window(mapping, filp, ra, 1);
+	if (!(ra->flags & RA_FLAG_BACKWARD) && ra->size &&
+	    (offset == ra->start + ra->size - ra->async_size ||
+	     offset == ra->start + ra->size)) {
+		ra->start += ra->size;
+		ra->size = get_next_ra_size(ra, max);
+		ra->async_size = ra->size;
+		goto readit;
+	}
 
-		goto out;
+	/*
+	 * Hit a marked page without valid readahead state.
+	 * E.g. interleaved reads.
+	 * Query the pagecache for async_size, which normally equals to
+	 * readahead size. Ramp it up and use it as the new readahead size.
+	 */
+	if (hit_readahead_marker) {
+		unsigned long cached;
+
+		cached = count_cached_pages(mapping, offset, max + 1);
+		if (cached > max)
+			return 0;
+
+		ra->start = offset + cached;
+		ra->size = cached;	/* old async_size */
+		ra->size = get_next_ra_size(ra, max);
+		ra->async_size = ra->size;
+		ra->flags = 0;
+		goto readit;
 	}
 
 	/*
-	 * Now handle the random case:
-	 * partial page reads and first access were handled above,
-	 * so this must be the next page otherwise it is random
+	 * It may be one of
+	 * 	- first read on start of file
+	 * 	- sequential cache miss
+	 * 	- oversize random read
+	 * Start readahead for it.
 	 */
-	if (!sequential) {
-		ra_off(ra);
-		blockable_page_cache_readahead(mapping, filp, offset,
-				 newsize, ra, 1);
-		goto out;
+	if (offset - ra->prev_index <= 1UL || req_size > max) {
+		ra->start = offset;
+		ra->size = get_init_ra_size(req_size, max);
+		ra->async_size = ra->size > req_size ?
+				 ra->size - req_size : ra->size;
+		ra->flags = 0;
+		goto readit;
 	}
 
+	if (try_backward_readahead(ra, offset, req_size, max))
+		goto readit;
+
 	/*
-	 * If we get here we are doing sequential IO and this was not the first
-	 * occurence (ie we have an existing window)
+	 * Query the page cache and look for the traces (cached history
+	 * pages) that a sequential stream would leave behind.
 	 */
+	if (try_context_readahead(mapping, ra, offset, req_size, max))
+		goto readit;
 
-	if (ra->ahead_start == 0) {	 /* no ahead window yet */
-		if (!make_ahead_window(mapping, filp, ra, 0))
-			goto out;
-	}
 	/*
-	 * Already have an ahead window, check if we crossed into it.
-	 * If so, shift windows and issue a new ahead window.
-	 * Only return the #pages that are in the current window, so that
-	 * we get called back on the first page of the ahead window which
-	 * will allow us to submit more IO.
+	 * Standalone, small random read.
+	 * Read as is, and do not pollute the readahead state.
 	 */
-	if (ra->prev_page >= ra->ahead_start) {
-		ra->start = ra->ahead_start;
-		ra->size = ra->ahead_size;
-		make_ahead_window(mapping, filp, ra, 0);
-	}
+	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
-out:
-	return ra->prev_page + 1;
+readit:
+	return ra_submit(ra, mapping, filp);
 }
 
-/*
- * handle_ra_miss() is called when it is known that a page which should have
- * been present in the pagecache (we just did some readahead there) was in fact
- * not found.  This will happen if it was evicted by the VM (readahead
- * thrashing)
+/**
+ * page_cache_sync_readahead - generic file readahead
+ * @mapping: address_space which holds the pagecache and I/O vectors
+ * @ra: file_ra_state which holds the readahead state
+ * @filp: passed on to ->readpage() and ->readpages()
+ * @offset: start offset into @mapping, in PAGE_CACHE_SIZE units
+ * @req_size: hint: total size of the read which the caller is performing in
+ *            PAGE_CACHE_SIZE units
  *
- * Turn on the cache miss flag in the RA struct, this will cause the RA code
- * to reduce the RA size on the next read.
+ * page_cache_sync_readahead() should be called when a cache miss happened:
+ * it will submit the read.  The readahead logic may decide to piggyback more
+ * pages onto the read request if access patterns suggest it will improve
+ * performance.
+ *
+ * Note that @filp is purely used for passing on to the ->readpage[s]()
+ * handler: it may refer to a different file from @mapping (so we may not use
+ * @filp->f_mapping or @filp->f_dentry->d_inode here).
+ * Also, @ra may not be equal to &@filp->f_ra.
  */
-void handle_ra_miss(struct address_space *mapping,
-		struct file_ra_state *ra, pgoff_t offset)
+void page_cache_sync_readahead(struct address_space *mapping,
+			       struct file_ra_state *ra, struct file *filp,
+			       pgoff_t offset, unsigned long req_size)
 {
-	ra->flags |= RA_FLAG_MISS;
-	ra->flags &= ~RA_FLAG_INCACHE;
-	ra->cache_hit = 0;
+	/* no read-ahead */
+	if (!ra->ra_pages)
+		return;
+
+	ondemand_readahead(mapping, ra, filp, 0, offset, req_size);
+}
+EXPORT_SYMBOL_GPL(page_cache_sync_readahead);
+
+/**
+ * page_cache_async_readahead - file readahead for marked pages
+ * @mapping: address_space which holds the pagecache and I/O vectors
+ * @ra: file_ra_state which holds the readahead state
+ * @filp: passed on to ->readpage() and ->readpages()
+ * @page: the page at @offset which has the PG_readahead flag set
+ * @offset: start offset into @mapping, in PAGE_CACHE_SIZE units
+ * @req_size: hint: total size of the read which the caller is performing in
+ *            PAGE_CACHE_SIZE units
+ *
+ * page_cache_async_readahead() should be called when a page is used which
+ * has the PG_readahead flag: this is a marker to suggest that the application
+ * has used up enough of the readahead window that we should start pulling in
+ * more pages.
+ */
+void page_cache_async_readahead(struct address_space *mapping,
+				struct file_ra_state *ra, struct file *filp,
+				struct page *page, pgoff_t offset,
+				unsigned long req_size)
+{
+	/* no read-ahead */
+	if (!ra->ra_pages)
+		return;
+
+	ClearPageReadahead(page);
+
+	/*
+	 * Defer asynchronous read-ahead on IO congestion.
+	 */
+	if (bdi_read_congested(mapping->backing_dev_info))
+		return;
+
+	/* do read-ahead */
+	ondemand_readahead(mapping, ra, filp, 1, offset, req_size);
 }
+EXPORT_SYMBOL_GPL(page_cache_async_readahead);
 
 /*
  * Given a desired number of PAGE_CACHE_SIZE readahead pages, return a
@@ -0,0 +1,1502 @@
+/*
+ * linux/mm/slub.c
+ *
+ * SLUB: An unqueued slab allocator.
+ *
+ * The allocator keeps no per-cpu object queues, no shared or alien
+ * arrays and no per-node lists of full slabs.  Each cpu instead owns a
+ * whole slab page (the "cpu slab") and allocates from and frees to that
+ * page's freelist with interrupts disabled and without taking any lock.
+ * Objects are chained through a free pointer stored inside the object
+ * itself, so no slab management structure is needed either: the few
+ * fields that are required live in the page struct of the slab.
+ *
+ * Locking:
+ *
+ *   1. slab_lock(page)		(bit spinlock on PG_locked)
+ *   2. node->list_lock		(protects the partial list)
+ *
+ *   The slab lock serializes page->freelist and page->inuse.  A cpu slab
+ *   is "frozen" (PG_active set): it is on no list, and objects freed to
+ *   it from other cpus go onto page->freelist under the slab lock while
+ *   the owning cpu allocates from page->lockless_freelist.  When the cpu
+ *   slab is exhausted the two lists are merged again.
+ *
+ *   Slabs that are neither frozen, full nor empty are kept on the
+ *   per-node partial list.  Full slabs are not tracked at all; a free
+ *   into a full slab puts it back on the partial list.  Empty slabs are
+ *   returned to the page allocator right away unless the node is short
+ *   of partial slabs, so there is nothing for a periodic reaper to do.
+ *
+ *   cache_chain_mutex protects the list of caches and is only taken
+ *   when caches are created, destroyed, shrunk or listed.
+ *
+ * Page struct usage (see include/linux/mm.h):
+ *
+ *   page->slab			cache the slab belongs to
+ *   page->freelist		first free object, requires slab lock
+ *   page->lockless_freelist	cpu slab freelist, owned by that cpu
+ *   page->inuse		objects allocated (or on the lockless list)
+ *   page->lru			partial list linkage or RCU head
+ *
+ * Higher order slabs are not compound pages: the tail pages carry
+ * page->slab == NULL and point to the head page through page->private.
+ */
+
+#include	<linux/config.h>
+#include	<linux/slab.h>
+#include	<linux/mm.h>
+#include	<linux/swap.h>
+#include	<linux/bit_spinlock.h>
+#include	<linux/interrupt.h>
+#include	<linux/init.h>
+#include	<linux/seq_file.h>
+#include	<linux/notifier.h>
+#include	<linux/cpu.h>
+#include	<linux/module.h>
+#include	<linux/rcupdate.h>
+#include	<linux/string.h>
+#include	<linux/nodemask.h>
+#include	<linux/mutex.h>
+
+#include	<asm/uaccess.h>
+#include	<asm/page.h>
+
+/* Shouldn't this be in a header file somewhere? */
+#define	BYTES_PER_WORD		sizeof(void *)
+
+#ifndef cache_line_size
+#define cache_line_size()	L1_CACHE_BYTES
+#endif
+
+#ifndef ARCH_KMALLOC_MINALIGN
+#define ARCH_KMALLOC_MINALIGN 0
+#endif
+
+#ifndef ARCH_SLAB_MINALIGN
+#define ARCH_SLAB_MINALIGN 0
+#endif
+
+#ifndef ARCH_KMALLOC_FLAGS
+#define ARCH_KMALLOC_FLAGS SLAB_HWCACHE_ALIGN
+#endif
+
+/*
+ * Keep this many empty slabs on a node's partial list instead of freeing
+ * them, so that alloc/free cycling on a slab boundary does not go to the
+ * page allocator every time.
+ */
+#define MIN_PARTIAL	2
+
+/*
+ * Slab sizing.  A slab holds at least slub_min_objects objects if that
+ * is possible without exceeding slub_max_order, and wastes no more than
+ * an eighth of its size.  Objects that do not fit slub_max_order get the
+ * smallest order they fit in.
+ */
+static int slub_min_order;
+static int slub_max_order = 1;
+static int slub_min_objects = 4;
+
+struct kmem_cache_node {
+	spinlock_t list_lock;		/* Protect partial list and nr_partial */
+	unsigned long nr_partial;
+	atomic_t nr_slabs;
+	struct list_head partial;
+};
+
+struct kmem_cache {
+	unsigned long flags;
+	int size;		/* The size of an object including meta data */
+	int objsize;		/* The size of an object without meta data */
+	int offset;		/* Free pointer offset */
+	int order;		/* Allocation order of a slab */
+	int objects;		/* Number of objects in a slab */
+	gfp_t gfpflags;		/* Extra allocation flags, e.g. GFP_DMA */
+	void (*ctor)(void *, struct kmem_cache *, unsigned long);
+	void (*dtor)(void *, struct kmem_cache *, unsigned long);
+	const char *name;
+	struct list_head next;	/* List of slab caches */
+#ifdef CONFIG_NUMA
+	struct kmem_cache_node *node[MAX_NUMNODES];
+#else
+	struct kmem_cache_node local_node;
+#endif
+	struct page *cpu_slab[NR_CPUS];
+};
+
+/*
+ * Bootstrap state.  Until the kmem_cache_node cache exists on NUMA the
+ * node structures have to be carved out of freshly allocated slabs by
+ * hand.
+ */
+static enum {
+	DOWN,		/* No caches at all */
+	PARTIAL,	/* kmem_cache_node cache is available */
+	UP		/* Everything works */
+} slab_state = DOWN;
+
+/* internal cache of cache description objs */
+static struct kmem_cache cache_cache;
+
+#ifdef CONFIG_NUMA
+/* internal cache of per-node list heads */
+static struct kmem_cache cache_node_cache;
+#endif
+
+/* Guard access to the cache-chain. */
+static DEFINE_MUTEX(cache_chain_mutex);
+static LIST_HEAD(cache_chain);
+
+/*
+ * vm_enough_memory() looks at this to determine how many
+ * slab-allocated pages are possibly freeable under pressure
+ *
+ * SLAB_RECLAIM_ACCOUNT turns this on per-slab
+ */
+atomic_t slab_reclaim_pages;
+
+/* These are the default caches for kmalloc. Custom caches can have other sizes. */
+struct cache_sizes malloc_sizes[] = {
+#define CACHE(x) { .cs_size = (x) },
+#include <linux/kmalloc_sizes.h>
+	CACHE(ULONG_MAX)
+#undef CACHE
+};
+EXPORT_SYMBOL(malloc_sizes);
+
+/* Must match cache_sizes above. Out of line to keep cache footprint low. */
+struct cache_names {
+	char *name;
+	char *name_dma;
+};
+
+static struct cache_names __initdata cache_names[] = {
+#define CACHE(x) { .name = "size-" #x, .name_dma = "size-" #x "(DMA)" },
+#include <linux/kmalloc_sizes.h>
+	{NULL,}
+#undef CACHE
+};
+
+/*
+ * Per slab locking using the page lock bit.
+ */
+static inline void slab_lock(struct page *page)
+{
+	bit_spin_lock(PG_locked, &page->flags);
+}
+
+static inline void slab_unlock(struct page *page)
+{
+	bit_spin_unlock(PG_locked, &page->flags);
+}
+
+static inline int slab_trylock(struct page *page)
+{
+	return bit_spin_trylock(PG_locked, &page->flags);
+}
+
+/* A frozen slab is some cpu's cpu slab and is on no list. */
+#define SlabFrozen(page)	PageActive(page)
+#define SetSlabFrozen(page)	SetPageActive(page)
+#define ClearSlabFrozen(page)	ClearPageActive(page)
+
+static inline struct kmem_cache_node *get_node(struct kmem_cache *s, int node)
+{
+#ifdef CONFIG_NUMA
+	return s->node[node];
+#else
+	return &s->local_node;
+#endif
+}
+
+static inline void *get_freepointer(struct kmem_cache *s, void *object)
+{
+	return *(void **)(object + s->offset);
+}
+
+static inline void set_freepointer(struct kmem_cache *s, void *object, void *fp)
+{
+	*(void **)(object + s->offset) = fp;
+}
+
+#define for_each_object(__p, __s, __addr) \
+	for (__p = (__addr); __p < (__addr) + (__s)->objects * (__s)->size;\
+			__p += (__s)->size)
+
+static inline struct page *virt_to_head_page(const void *x)
+{
+	struct page *page = virt_to_page(x);
+
+	if (unlikely(!page->slab))
+		page = (struct page *)page_private(page);
+	return page;
+}
+
+/*
+ * Interface to system's page allocator.
+ */
+static struct page *allocate_slab(struct kmem_cache *s, gfp_t flags, int node)
+{
+	struct page *page;
+	int pages = 1 << s->order;
+	int i;
+
+	flags |= s->gfpflags;
+	if (node == -1)
+		page = alloc_pages(flags, s->order);
+	else
+		page = alloc_pages_node(node, flags, s->order);
+	if (!page)
+		return NULL;
+
+	if (s->flags & SLAB_RECLAIM_ACCOUNT)
+		atomic_add(pages, &slab_reclaim_pages);
+	add_page_state(nr_slab, pages);
+	for (i = 0; i < pages; i++) {
+		SetPageSlab(page + i);
+		if (i)
+			set_page_private(page + i, (unsigned long)page);
+	}
+	return page;
+}
+
+static void __free_slab(struct kmem_cache *s, struct page *page)
+{
+	int pages = 1 << s->order;
+	int i;
+
+	if (s->dtor) {
+		void *p, *start = page_address(page);
+
+		for_each_object(p, s, start)
+			s->dtor(p, s, 0);
+	}
+
+	for (i = 0; i < pages; i++) {
+		if (!TestClearPageSlab(page + i))
+			BUG();
+		set_page_private(page + i, 0);
+	}
+	page->mapping = NULL;
+	reset_page_mapcount(page);
+	sub_page_state(nr_slab, pages);
+	if (current->reclaim_state)
+		current->reclaim_state->reclaimed_slab += pages;
+	__free_pages(page, s->order);
+	if (s->flags & SLAB_RECLAIM_ACCOUNT)
+		atomic_sub(pages, &slab_reclaim_pages);
+}
+
+static void rcu_free_slab(struct rcu_head *h)
+{
+	struct page *page;
+
+	page = container_of((struct list_head *)h, struct page, lru);
+	__free_slab(page->slab, page);
+}
+
+static void free_slab(struct kmem_cache *s, struct page *page)
+{
+	if (unlikely(s->flags & SLAB_DESTROY_BY_RCU)) {
+		/*
+		 * RCU free overloads the RCU head over the LRU
+		 */
+		struct rcu_head *head = (void *)&page->lru;
+
+		call_rcu(head, rcu_free_slab);
+	} else
+		__free_slab(s, page);
+}
+
+static void discard_slab(struct kmem_cache *s, struct page *page)
+{
+	struct kmem_cache_node *n = get_node(s, page_to_nid(page));
+
+	atomic_dec(&n->nr_slabs);
+	free_slab(s, page);
+}
+
+/*
+ * Allocate a new slab and thread all of its objects onto page->freelist.
+ * Called with interrupts disabled; they are enabled around the page
+ * allocation if the caller may sleep.
+ */
+static struct page *new_slab(struct kmem_cache *s, gfp_t flags, int node)
+{
+	struct kmem_cache_node *n;
+	unsigned long ctor_flags;
+	struct page *page;
+	void *start, *last, *p;
+
+	if (flags & __GFP_NO_GROW)
+		return NULL;
+
+	ctor_flags = SLAB_CTOR_CONSTRUCTOR;
+	if (!(flags & __GFP_WAIT))
+		ctor_flags |= SLAB_CTOR_ATOMIC;
+
+	if (flags & __GFP_WAIT)
+		local_irq_enable();
+
+	page = allocate_slab(s, flags & GFP_LEVEL_MASK, node);
+	if (!page)
+		goto out;
+
+	n = get_node(s, page_to_nid(page));
+	if (n)
+		atomic_inc(&n->nr_slabs);
+	page->slab = s;
+
+	start = page_address(page);
+	last = start;
+	for_each_object(p, s, start) {
+		if (s->ctor)
+			s->ctor(p, s, ctor_flags);
+		if (p != start)
+			set_freepointer(s, last, p);
+		last = p;
+	}
+	set_freepointer(s, last, NULL);
+
+	page->freelist = start;
+	page->lockless_freelist = NULL;
+	page->inuse = 0;
+out:
+	if (flags & __GFP_WAIT)
+		local_irq_disable();
+	return page;
+}
+
+/*
+ * Management of partially allocated slabs
+ */
+static void add_partial(struct kmem_cache_node *n, struct page *page)
+{
+	spin_lock(&n->list_lock);
+	n->nr_partial++;
+	list_add(&page->lru, &n->partial);
+	spin_unlock(&n->list_lock);
+}
+
+static void remove_partial(struct kmem_cache *s, struct page *page)
+{
+	struct kmem_cache_node *n = get_node(s, page_to_nid(page));
+
+	spin_lock(&n->list_lock);
+	list_del(&page->lru);
+	n->nr_partial--;
+	spin_unlock(&n->list_lock);
+}
+
+/*
+ * Lock a partial slab and take it off the list.  The list_lock is held,
+ * so only a trylock is allowed here (slab_lock nests outside list_lock).
+ */
+static inline int lock_and_freeze_slab(struct kmem_cache_node *n,
+							struct page *page)
+{
+	if (slab_trylock(page)) {
+		list_del(&page->lru);
+		n->nr_partial--;
+		SetSlabFrozen(page);
+		return 1;
+	}
+	return 0;
+}
+
+static struct page *get_partial_node(struct kmem_cache_node *n)
+{
+	struct page *page;
+
+	/*
+	 * Racy check.  If we mistakenly see no partial slabs then we just
+	 * allocate a new slab; no need to take the list_lock for that.
+	 */
+	if (!n || !n->nr_partial)
+		return NULL;
+
+	spin_lock(&n->list_lock);
+	list_for_each_entry(page, &n->partial, lru)
+		if (lock_and_freeze_slab(n, page))
+			goto out;
+	page = NULL;
+out:
+	spin_unlock(&n->list_lock);
+	return page;
+}
+
+/*
+ * Get a locked and frozen partial slab, from the requested node if one
+ * was given, otherwise preferably from the local node.
+ */
+static struct page *get_partial(struct kmem_cache *s, int node)
+{
+	struct page *page;
+	int searchnode = (node == -1) ? numa_node_id() : node;
+
+	page = get_partial_node(get_node(s, searchnode));
+	if (page || node != -1)
+		return page;
+
+#ifdef CONFIG_NUMA
+	for_each_online_node(searchnode) {
+		page = get_partial_node(get_node(s, searchnode));
+		if (page)
+			return page;
+	}
+#endif
+	return NULL;
+}
+
+/*
+ * Move a slab that is no longer frozen to the list it belongs on, or
+ * free it.  Called with the slab locked; drops the lock.
+ */
+static void unfreeze_slab(struct kmem_cache *s, struct page *page)
+{
+	struct kmem_cache_node *n = get_node(s, page_to_nid(page));
+
+	ClearSlabFrozen(page);
+	if (page->inuse) {
+		if (page->freelist)
+			add_partial(n, page);
+		slab_unlock(page);
+	} else if (n->nr_partial < MIN_PARTIAL) {
+		add_partial(n, page);
+		slab_unlock(page);
+	} else {
+		slab_unlock(page);
+		discard_slab(s, page);
+	}
+}
+
+/*
+ * Stop using a slab as cpu slab: merge the lockless freelist back into
+ * the regular freelist and unfreeze it.  Called with the slab locked
+ * and interrupts disabled.
+ */
+static void deactivate_slab(struct kmem_cache *s, struct page *page, int cpu)
+{
+	s->cpu_slab[cpu] = NULL;
+
+	while (unlikely(page->lockless_freelist)) {
+		void *object = page->lockless_freelist;
+
+		page->lockless_freelist = get_freepointer(s, object);
+		set_freepointer(s, object, page->freelist);
+		page->freelist = object;
+		page->inuse--;
+	}
+	unfreeze_slab(s, page);
+}
+
+static void __flush_cpu_slab(struct kmem_cache *s, int cpu)
+{
+	struct page *page = s->cpu_slab[cpu];
+
+	if (likely(page)) {
+		slab_lock(page);
+		deactivate_slab(s, page, cpu);
+	}
+}
+
+static void flush_cpu_slab(void *d)
+{
+	struct kmem_cache *s = d;
+
+	__flush_cpu_slab(s, smp_processor_id());
+}
+
+static void flush_all(struct kmem_cache *s)
+{
+	on_each_cpu(flush_cpu_slab, s, 1, 1);
+}
+
+/*
+ * Slow path of the allocator.  The cpu slab is missing, exhausted or on
+ * the wrong node: first look for objects freed to it by other cpus, then
+ * for a partial slab, and only then allocate a new slab.
+ *
+ * Interrupts are disabled on entry and exit.
+ */
+static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
+						struct page *page)
+{
+	void *object;
+	int cpu = smp_processor_id();
+
+	if (!page)
+		goto new_slab;
+
+	slab_lock(page);
+	if (unlikely(node != -1 && page_to_nid(page) != node))
+		goto another_slab;
+load_freelist:
+	object = page->freelist;
+	if (unlikely(!object))
+		goto another_slab;
+
+	page->lockless_freelist = get_freepointer(s, object);
+	page->inuse = s->objects;
+	page->freelist = NULL;
+	slab_unlock(page);
+	return object;
+
+another_slab:
+	deactivate_slab(s, page, cpu);
+
+new_slab:
+	page = get_partial(s, node);
+	if (page) {
+		s->cpu_slab[cpu] = page;
+		goto load_freelist;
+	}
+
+	page = new_slab(s, gfpflags, node);
+	if (page) {
+		/*
+		 * Interrupts may have been enabled: we could be on another
+		 * cpu now, and that cpu may have got a cpu slab meanwhile.
+		 */
+		cpu = smp_processor_id();
+		if (s->cpu_slab[cpu])
+			__flush_cpu_slab(s, cpu);
+		slab_lock(page);
+		SetSlabFrozen(page);
+		s->cpu_slab[cpu] = page;
+		goto load_freelist;
+	}
+	return NULL;
+}
+
+/*
+ * The fast path: pop an object off the cpu slab's lockless freelist
+ * with interrupts disabled.  No atomic operations, no locks.
+ */
+static __always_inline void *slab_alloc(struct kmem_cache *s,
+						gfp_t gfpflags, int node)
+{
+	struct page *page;
+	void **object;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	page = s->cpu_slab[smp_processor_id()];
+	if (unlikely(!page || !page->lockless_freelist ||
+			(node != -1 && page_to_nid(page) != node)))
+		object = __slab_alloc(s, gfpflags, node, page);
+	else {
+		object = page->lockless_freelist;
+		page->lockless_freelist = get_freepointer(s, object);
+	}
+	local_irq_restore(flags);
+	return object;
+}
+
+/*
+ * Slow path of free: the object does not belong to this cpu's cpu slab.
+ * Put it on the slab's freelist under the slab lock and fix up the
+ * partial list if the slab went from full to partial or became empty.
+ */
+static void __slab_free(struct kmem_cache *s, struct page *page, void *x)
+{
+	void *prior;
+
+	slab_lock(page);
+	prior = page->freelist;
+	set_freepointer(s, x, prior);
+	page->freelist = x;
+	page->inuse--;
+
+	if (unlikely(SlabFrozen(page)))
+		goto out_unlock;
+
+	if (unlikely(!page->inuse))
+		goto slab_empty;
+
+	/*
+	 * Objects left in the slab.  If it was full before then we have to
+	 * put it on the partial list.
+	 */
+	if (unlikely(!prior))
+		add_partial(get_node(s, page_to_nid(page)), page);
+
+out_unlock:
+	slab_unlock(page);
+	return;
+
+slab_empty:
+	if (prior) {
+		struct kmem_cache_node *n = get_node(s, page_to_nid(page));
+
+		/* Keep a few empty slabs around, see MIN_PARTIAL */
+		if (n->nr_partial <= MIN_PARTIAL)
+			goto out_unlock;
+		remove_partial(s, page);
+	}
+	slab_unlock(page);
+	discard_slab(s, page);
+}
+
+static __always_inline void slab_free(struct kmem_cache *s,
+					struct page *page, void *x)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	if (likely(page == s->cpu_slab[smp_processor_id()])) {
+		set_freepointer(s, x, page->lockless_freelist);
+		page->lockless_freelist = x;
+	} else
+		__slab_free(s, page, x);
+	local_irq_restore(flags);
+}
+
+/**
+ * kmem_cache_alloc - Allocate an object
+ * @cachep: The cache to allocate from.
+ * @flags: See kmalloc().
+ *
+ * Allocate an object from this cache.  The flags are only relevant
+ * if the cache has no available objects.
+ */
+void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
+{
+	return slab_alloc(cachep, flags, -1);
+}
+EXPORT_SYMBOL(kmem_cache_alloc);
+
+#ifdef CONFIG_NUMA
+/**
+ * kmem_cache_alloc_node - Allocate an object on the specified node
+ * @cachep: The cache to allocate from.
+ * @flags: See kmalloc().
+ * @nodeid: node number of the target node.
+ *
+ * Identical to kmem_cache_alloc, except that the object comes from a
+ * slab on the given node.
+ */
+void *kmem_cache_alloc_node(struct kmem_cache *cachep, gfp_t flags, int nodeid)
+{
+	if (nodeid != -1 && !get_node(cachep, nodeid))
+		nodeid = -1;
+	return slab_alloc(cachep, flags, nodeid);
+}
+EXPORT_SYMBOL(kmem_cache_alloc_node);
+#endif
+
+/**
+ * kmem_cache_free - Deallocate an object
+ * @cachep: The cache the allocation was from.
+ * @objp: The previously allocated object.
+ *
+ * Free an object which was previously allocated from this
+ * cache.
+ */
+void kmem_cache_free(struct kmem_cache *cachep, void *objp)
+{
+	slab_free(cachep, virt_to_head_page(objp), objp);
+}
+EXPORT_SYMBOL(kmem_cache_free);
+
+/*
+ * Object sizing
+ */
+static unsigned long calculate_alignment(unsigned long flags,
+					unsigned long align, unsigned long size)
+{
+	/*
+	 * If the user wants hardware cache aligned objects then follow
+	 * that suggestion if the object is sufficiently large.  Small
+	 * objects are packed several to a line instead.
+	 */
+	if (flags & (SLAB_HWCACHE_ALIGN | SLAB_MUST_HWCACHE_ALIGN)) {
+		unsigned long ralign = cache_line_size();
+
+		while (size <= ralign / 2)
+			ralign /= 2;
+		align = max(align, ralign);
+	}
+
+	if (align < ARCH_SLAB_MINALIGN)
+		align = ARCH_SLAB_MINALIGN;
+	if (align < BYTES_PER_WORD)
+		align = BYTES_PER_WORD;
+
+	return ALIGN(align, BYTES_PER_WORD);
+}
+
+static int calculate_order(unsigned long size, unsigned long flags)
+{
+	int order;
+
+	/*
+	 * A VFS-reclaimable slab tends to have most allocations as
+	 * GFP_NOFS and we really don't want to have to be allocating
+	 * higher-order pages when we are unable to shrink dcache.
+	 */
+	if ((flags & SLAB_RECLAIM_ACCOUNT) && size <= PAGE_SIZE)
+		return 0;
+
+	order = get_order(size);
+	if (order < slub_min_order)
+		order = slub_min_order;
+	for (; order < slub_max_order; order++) {
+		unsigned long slab_size = PAGE_SIZE << order;
+
+		if (slab_size / size >= slub_min_objects &&
+				(slab_size % size) * 8 <= slab_size)
+			break;
+	}
+	if (order >= MAX_ORDER)
+		return -1;
+	return order;
+}
+
+static int calculate_sizes(struct kmem_cache *s, unsigned long align)
+{
+	unsigned long size = ALIGN(s->objsize, BYTES_PER_WORD);
+
+	/*
+	 * The free pointer overlays the first word of a free object,
+	 * unless the object has to keep its contents while free: objects
+	 * with a constructor are handed out already initialised, and
+	 * SLAB_DESTROY_BY_RCU objects may still be read by RCU walkers
+	 * after they have been freed.  Those get the pointer after the
+	 * object.
+	 */
+	if ((s->flags & SLAB_DESTROY_BY_RCU) || s->ctor || s->dtor) {
+		s->offset = size;
+		size += BYTES_PER_WORD;
+	} else
+		s->offset = 0;
+
+	size = ALIGN(size, calculate_alignment(s->flags, align, s->objsize));
+	s->size = size;
+
+	s->order = calculate_order(size, s->flags);
+	if (s->order < 0)
+		return 0;
+	s->objects = (PAGE_SIZE << s->order) / size;
+	return !!s->objects;
+}
+
+static void init_kmem_cache_node(struct kmem_cache_node *n)
+{
+	n->nr_partial = 0;
+	atomic_set(&n->nr_slabs, 0);
+	spin_lock_init(&n->list_lock);
+	INIT_LIST_HEAD(&n->partial);
+}
+
+#ifdef CONFIG_NUMA
+/*
+ * The first slab of the kmem_cache_node cache on each node has to hold
+ * that node's own kmem_cache_node, so carve it out by hand.
+ */
+static void __init early_kmem_cache_node_alloc(gfp_t gfpflags, int node)
+{
+	struct kmem_cache *s = &cache_node_cache;
+	struct kmem_cache_node *n;
+	struct page *page;
+
+	local_irq_disable();
+	page = new_slab(s, gfpflags, node);
+	local_irq_enable();
+	BUG_ON(!page);
+	if (page_to_nid(page) != node)
+		printk(KERN_ERR "SLUB: Unable to allocate memory from "
+				"node %d\n", node);
+
+	n = page->freelist;
+	page->freelist = get_freepointer(s, n);
+	page->inuse++;
+	s->node[node] = n;
+	init_kmem_cache_node(n);
+	atomic_inc(&n->nr_slabs);
+	add_partial(n, page);
+}
+
+static void free_kmem_cache_nodes(struct kmem_cache *s)
+{
+	int node;
+
+	for_each_online_node(node) {
+		struct kmem_cache_node *n = s->node[node];
+
+		if (n)
+			kmem_cache_free(&cache_node_cache, n);
+		s->node[node] = NULL;
+	}
+}
+
+static int init_kmem_cache_nodes(struct kmem_cache *s, gfp_t gfpflags)
+{
+	int node;
+
+	for_each_online_node(node) {
+		struct kmem_cache_node *n;
+
+		if (slab_state == DOWN) {
+			early_kmem_cache_node_alloc(gfpflags, node);
+			continue;
+		}
+		n = kmem_cache_alloc_node(&cache_node_cache, gfpflags, node);
+		if (!n) {
+			free_kmem_cache_nodes(s);
+			return 0;
+		}
+		s->node[node] = n;
+		init_kmem_cache_node(n);
+	}
+	return 1;
+}
+#else
+static void free_kmem_cache_nodes(struct kmem_cache *s)
+{
+}
+
+static int init_kmem_cache_nodes(struct kmem_cache *s, gfp_t gfpflags)
+{
+	init_kmem_cache_node(&s->local_node);
+	return 1;
+}
+#endif
+
+static int kmem_cache_open(struct kmem_cache *s, gfp_t gfpflags,
+		const char *name, size_t size, size_t align,
+		unsigned long flags,
+		void (*ctor)(void *, struct kmem_cache *, unsigned long),
+		void (*dtor)(void *, struct kmem_cache *, unsigned long))
+{
+	memset(s, 0, sizeof(struct kmem_cache));
+	s->name = name;
+	s->ctor = ctor;
+	s->dtor = dtor;
+	s->objsize = size;
+	s->flags = flags;
+	if (flags & SLAB_CACHE_DMA)
+		s->gfpflags |= GFP_DMA;
+
+	if (!calculate_sizes(s, align))
+		return 0;
+	return init_kmem_cache_nodes(s, gfpflags);
+}
+
+/*
+ * Release all partial slabs that have no objects in use.  Returns the
+ * number of slabs left in the cache.
+ */
+static int free_empty_partials(struct kmem_cache *s)
+{
+	int node, left = 0;
+
+	for_each_online_node(node) {
+		struct kmem_cache_node *n = get_node(s, node);
+		struct page *page, *t;
+		unsigned long flags;
+		LIST_HEAD(empty);
+
+		if (!n)
+			continue;
+
+		spin_lock_irqsave(&n->list_lock, flags);
+		list_for_each_entry_safe(page, t, &n->partial, lru) {
+			if (page->inuse || !slab_trylock(page))
+				continue;
+			if (!page->inuse) {
+				list_move(&page->lru, &empty);
+				n->nr_partial--;
+			}
+			slab_unlock(page);
+		}
+		spin_unlock_irqrestore(&n->list_lock, flags);
+
+		list_for_each_entry_safe(page, t, &empty, lru)
+			discard_slab(s, page);
+
+		left += atomic_read(&n->nr_slabs);
+	}
+	return left;
+}
+
+/**
+ * kmem_cache_create - Create a cache.
+ * @name: A string which is used in /proc/slabinfo to identify this cache.
+ * @size: The size of objects to be created in this cache.
+ * @align: The required alignment for the objects.
+ * @flags: SLAB flags
+ * @ctor: A constructor for the objects.
+ * @dtor: A destructor for the objects.
+ *
+ * Returns a ptr to the cache on success, NULL on failure.
+ * Cannot be called within a int, but can be interrupted.
+ * The @ctor is run when new pages are allocated by the cache
+ * and the @dtor is run before the pages are handed back.
+ *
+ * @name must be valid until the cache is destroyed. This implies that
+ * the module calling this has to destroy the cache before getting
+ * unloaded.
+ *
+ * The debugging flags (%SLAB_POISON, %SLAB_RED_ZONE, %SLAB_STORE_USER)
+ * are accepted and ignored.  %SLAB_NO_REAP has no meaning here since
+ * nothing is reaped in the background.
+ *
+ * %SLAB_HWCACHE_ALIGN - Align the objects in this cache to a hardware
+ * cacheline.  This can be beneficial if you're counting cycles as closely
+ * as davem.
+ */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, size_t align,
+	unsigned long flags, void (*ctor)(void*, struct kmem_cache *, unsigned long),
+	void (*dtor)(void*, struct kmem_cache *, unsigned long))
+{
+	struct kmem_cache *s = NULL, *pc;
+
+	/*
+	 * Sanity checks... these are all serious usage bugs.
+	 */
+	if ((!name) ||
+	    in_interrupt() ||
+	    (size < BYTES_PER_WORD) || (dtor && !ctor)) {
+		printk(KERN_ERR "%s: Early error in slab %s\n",
+		       __FUNCTION__, name);
+		BUG();
+	}
+
+	mutex_lock(&cache_chain_mutex);
+
+	list_for_each_entry(pc, &cache_chain, next) {
+		mm_segment_t old_fs = get_fs();
+		int res;
+
+		/*
+		 * This happens when the module gets unloaded and doesn't
+		 * destroy its slab cache and no-one else reuses the vmalloc
+		 * area of the module.  Print a warning.  Only whether the
+		 * name can be read matters, not what it reads.
+		 */
+		set_fs(KERNEL_DS);
+		res = __get_user(res, pc->name);
+		set_fs(old_fs);
+		if (res) {
+			printk("SLUB: cache with size %d has lost its name\n",
+			       pc->size);
+			continue;
+		}
+
+		if (!strcmp(pc->name, name)) {
+			printk("kmem_cache_create: duplicate cache %s\n", name);
+			dump_stack();
+			goto oops;
+		}
+	}
+
+	s = kmem_cache_alloc(&cache_cache, GFP_KERNEL);
+	if (!s)
+		goto oops;
+	if (!kmem_cache_open(s, GFP_KERNEL, name, size, align, flags,
+			     ctor, dtor)) {
+		printk("kmem_cache_create: couldn't create cache %s.\n", name);
+		kmem_cache_free(&cache_cache, s);
+		s = NULL;
+		goto oops;
+	}
+	list_add(&s->next, &cache_chain);
+oops:
+	if (!s && (flags & SLAB_PANIC))
+		panic("kmem_cache_create(): failed to create slab `%s'\n",
+		      name);
+	mutex_unlock(&cache_chain_mutex);
+	return s;
+}
+EXPORT_SYMBOL(kmem_cache_create);
+
+/**
+ * kmem_cache_shrink - Shrink a cache.
+ * @cachep: The cache to shrink.
+ *
+ * Releases as many slabs as possible for a cache.
+ * To help debugging, a zero exit status indicates all slabs were released.
+ */
+int kmem_cache_shrink(struct kmem_cache *cachep)
+{
+	if (!cachep || in_interrupt())
+		BUG();
+
+	flush_all(cachep);
+	return free_empty_partials(cachep);
+}
+EXPORT_SYMBOL(kmem_cache_shrink);
+
+/**
+ * kmem_cache_destroy - delete a cache
+ * @cachep: the cache to destroy
+ *
+ * Remove a struct kmem_cache object from the slab cache.
+ * Returns 0 on success.
+ *
+ * The cache must be empty before calling this function.
+ *
+ * The caller must guarantee that noone will allocate memory from the cache
+ * during the kmem_cache_destroy().
+ */
+int kmem_cache_destroy(struct kmem_cache *cachep)
+{
+	if (!cachep || in_interrupt())
+		BUG();
+
+	mutex_lock(&cache_chain_mutex);
+	list_del(&cachep->next);
+	mutex_unlock(&cache_chain_mutex);
+
+	if (kmem_cache_shrink(cachep)) {
+		printk(KERN_ERR "slab error in %s(): cache `%s': "
+		       "Can't free all objects\n", __FUNCTION__, cachep->name);
+		dump_stack();
+		mutex_lock(&cache_chain_mutex);
+		list_add(&cachep->next, &cache_chain);
+		mutex_unlock(&cache_chain_mutex);
+		return 1;
+	}
+
+	/* rcu_free_slab() still needs the cache */
+	if (unlikely(cachep->flags & SLAB_DESTROY_BY_RCU))
+		rcu_barrier();
+
+	free_kmem_cache_nodes(cachep);
+	kmem_cache_free(&cache_cache, cachep);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_destroy);
+
+unsigned int kmem_cache_size(struct kmem_cache *cachep)
+{
+	return cachep->objsize;
+}
+EXPORT_SYMBOL(kmem_cache_size);
+
+const char *kmem_cache_name(struct kmem_cache *cachep)
+{
+	return cachep->name;
+}
+EXPORT_SYMBOL_GPL(kmem_cache_name);
+
+/**
+ * kmem_ptr_validate - check if an untrusted pointer might
+ *	be a slab entry.
+ * @cachep: the cache we're checking against
+ * @ptr: pointer to validate
+ *
+ * This verifies that the untrusted pointer looks sane:
+ * it is _not_ a guarantee that the pointer is actually
+ * part of the slab cache in question, but it at least
+ * validates that the pointer can be dereferenced and
+ * looks half-way sane.
+ *
+ * Currently only used for dentry validation.
+ */
+int fastcall kmem_ptr_validate(struct kmem_cache *cachep, void *ptr)
+{
+	unsigned long addr = (unsigned long)ptr;
+	unsigned long min_addr = PAGE_OFFSET;
+	unsigned long align_mask = BYTES_PER_WORD - 1;
+	unsigned long size = cachep->size;
+	struct page *page;
+
+	if (unlikely(addr < min_addr))
+		goto out;
+	if (unlikely(addr > (unsigned long)high_memory - size))
+		goto out;
+	if (unlikely(addr & align_mask))
+		goto out;
+	if (unlikely(!kern_addr_valid(addr)))
+		goto out;
+	if (unlikely(!kern_addr_valid(addr + size - 1)))
+		goto out;
+	page = virt_to_page(ptr);
+	if (unlikely(!PageSlab(page)))
+		goto out;
+	if (unlikely(virt_to_head_page(ptr)->slab != cachep))
+		goto out;
+	return 1;
+      out:
+	return 0;
+}
+
+/*
+ * Generic kmalloc caches
+ */
+static inline struct kmem_cache *__find_general_cachep(size_t size,
+							gfp_t gfpflags)
+{
+	struct cache_sizes *csizep = malloc_sizes;
+
+	while (size > csizep->cs_size)
+		csizep++;
+
+	/*
+	 * Really subtle: The last entry with cs->cs_size==ULONG_MAX
+	 * has cs_{dma,}cachep==NULL. Thus no special case
+	 * for large kmalloc calls required.
+	 */
+	if (unlikely(gfpflags & GFP_DMA))
+		return csizep->cs_dmacachep;
+	return csizep->cs_cachep;
+}
+
+struct kmem_cache *kmem_find_general_cachep(size_t size, gfp_t gfpflags)
+{
+	return __find_general_cachep(size, gfpflags);
+}
+EXPORT_SYMBOL(kmem_find_general_cachep);
+
+/**
+ * kmalloc - allocate memory
+ * @size: how many bytes of memory are required.
+ * @flags: the type of memory to allocate.
+ *
+ * See the kmalloc() in mm/slab.c for the meaning of @flags.
+ */
+void *__kmalloc(size_t size, gfp_t flags)
+{
+	struct kmem_cache *cachep = __find_general_cachep(size, flags);
+
+	if (unlikely(cachep == NULL))
+		return NULL;
+	return slab_alloc(cachep, flags, -1);
+}
+EXPORT_SYMBOL(__kmalloc);
+
+#ifdef CONFIG_NUMA
+void *kmalloc_node(size_t size, gfp_t flags, int node)
+{
+	struct kmem_cache *cachep = __find_general_cachep(size, flags);
+
+	if (unlikely(cachep == NULL))
+		return NULL;
+	return kmem_cache_alloc_node(cachep, flags, node);
+}
+EXPORT_SYMBOL(kmalloc_node);
+#endif
+
+/**
+ * kfree - free previously allocated memory
+ * @objp: pointer returned by kmalloc.
+ *
+ * If @objp is NULL, no operation is performed.
+ *
+ * Don't free memory not originally allocated by kmalloc()
+ * or you will run into trouble.
+ */
+void kfree(const void *objp)
+{
+	struct page *page;
+
+	if (unlikely(!objp))
+		return;
+	page = virt_to_head_page(objp);
+	mutex_debug_check_no_locks_freed(objp, page->slab->objsize);
+	slab_free(page->slab, page, (void *)objp);
+}
+EXPORT_SYMBOL(kfree);
+
+/**
+ * ksize - get the actual amount of memory allocated for a given object
+ * @objp: Pointer to the object
+ *
+ * kmalloc may internally round up allocations and return more memory
+ * than requested. ksize() can be used to determine the actual amount of
+ * memory allocated. The caller may use this additional memory, even though
+ * a smaller amount of memory was initially specified with the kmalloc call.
+ * The caller must guarantee that objp points to a valid object previously
+ * allocated with either kmalloc() or kmem_cache_alloc(). The object
+ * must not be freed during the duration of the call.
+ */
+unsigned int ksize(const void *objp)
+{
+	if (unlikely(objp == NULL))
+		return 0;
+
+	return virt_to_head_page(objp)->slab->objsize;
+}
+
+#ifdef CONFIG_SMP
+/**
+ * __alloc_percpu - allocate one copy of the object for every present
+ * cpu in the system, zeroing them.
+ * Objects should be dereferenced using the per_cpu_ptr macro only.
+ *
+ * @size: how many bytes of memory are required.
+ */
+void *__alloc_percpu(size_t size)
+{
+	int i;
+	struct percpu_data *pdata = kmalloc(sizeof(*pdata), GFP_KERNEL);
+
+	if (!pdata)
+		return NULL;
+
+	/*
+	 * Cannot use for_each_online_cpu since a cpu may come online
+	 * and we have no way of figuring out how to fix the array
+	 * that we have allocated then....
+	 */
+	for_each_cpu(i) {
+		int node = cpu_to_node(i);
+
+		if (node_online(node))
+			pdata->ptrs[i] = kmalloc_node(size, GFP_KERNEL, node);
+		else
+			pdata->ptrs[i] = kmalloc(size, GFP_KERNEL);
+
+		if (!pdata->ptrs[i])
+			goto unwind_oom;
+		memset(pdata->ptrs[i], 0, size);
+	}
+
+	/* Catch derefs w/o wrappers */
+	return (void *)(~(unsigned long)pdata);
+
+      unwind_oom:
+	while (--i >= 0) {
+		if (!cpu_possible(i))
+			continue;
+		kfree(pdata->ptrs[i]);
+	}
+	kfree(pdata);
+	return NULL;
+}
+EXPORT_SYMBOL(__alloc_percpu);
+
+/**
+ * free_percpu - free previously allocated percpu memory
+ * @objp: pointer returned by alloc_percpu.
+ *
+ * Don't free memory not originally allocated by alloc_percpu()
+ * The complemented objp is to check for that.
+ */
+void free_percpu(const void *objp)
+{
+	int i;
+	struct percpu_data *p = (struct percpu_data *)(~(unsigned long)objp);
+
+	/*
+	 * We allocate for all cpus so we cannot use for online cpu here.
+	 */
+	for_each_cpu(i)
+	    kfree(p->ptrs[i]);
+	kfree(p);
+}
+EXPORT_SYMBOL(free_percpu);
+#endif
+
+#ifdef CONFIG_HOTPLUG_CPU
+/*
+ * A dead cpu's slab would otherwise stay frozen forever.
+ */
+static int __devinit slab_cpuup_callback(struct notifier_block *nfb,
+				    unsigned long action, void *hcpu)
+{
+	long cpu = (long)hcpu;
+	struct kmem_cache *s;
+	unsigned long flags;
+
+	switch (action) {
+	case CPU_UP_CANCELED:
+	case CPU_DEAD:
+		mutex_lock(&cache_chain_mutex);
+		list_for_each_entry(s, &cache_chain, next) {
+			local_irq_save(flags);
+			__flush_cpu_slab(s, cpu);
+			local_irq_restore(flags);
+		}
+		mutex_unlock(&cache_chain_mutex);
+		break;
+	default:
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block slab_notifier = { &slab_cpuup_callback, NULL, 0 };
+#endif
+
+static int __init setup_slub_min_order(char *str)
+{
+	get_option(&str, &slub_min_order);
+	return 1;
+}
+__setup("slub_min_order=", setup_slub_min_order);
+
+static int __init setup_slub_max_order(char *str)
+{
+	get_option(&str, &slub_max_order);
+	return 1;
+}
+__setup("slub_max_order=", setup_slub_max_order);
+
+static int __init setup_slub_min_objects(char *str)
+{
+	get_option(&str, &slub_min_objects);
+	return 1;
+}
+__setup("slub_min_objects=", setup_slub_min_objects);
+
+static void __init create_boot_cache(struct kmem_cache *s, const char *name,
+				     size_t size, size_t align)
+{
+	if (!kmem_cache_open(s, GFP_KERNEL, name, size, align,
+			     SLAB_PANIC, NULL, NULL))
+		panic("SLUB: unable to create boot cache %s\n", name);
+	list_add(&s->next, &cache_chain);
+}
+
+void __init kmem_cache_init(void)
+{
+	struct cache_sizes *sizes = malloc_sizes;
+	struct cache_names *names = cache_names;
+
+	if (slub_max_order < slub_min_order)
+		slub_max_order = slub_min_order;
+
+#ifdef CONFIG_NUMA
+	/*
+	 * Must come first: every other cache allocates its per-node
+	 * structures from it.
+	 */
+	create_boot_cache(&cache_node_cache, "kmem_cache_node",
+			  sizeof(struct kmem_cache_node), 0);
+#endif
+	slab_state = PARTIAL;
+
+	create_boot_cache(&cache_cache, "kmem_cache",
+			  sizeof(struct kmem_cache), 0);
+
+	while (sizes->cs_size != ULONG_MAX) {
+		sizes->cs_cachep = kmem_cache_create(names->name,
+					sizes->cs_size, ARCH_KMALLOC_MINALIGN,
+					(ARCH_KMALLOC_FLAGS | SLAB_PANIC),
+					NULL, NULL);
+		sizes->cs_dmacachep = kmem_cache_create(names->name_dma,
+					sizes->cs_size, ARCH_KMALLOC_MINALIGN,
+					(ARCH_KMALLOC_FLAGS | SLAB_CACHE_DMA |
+					 SLAB_PANIC),
+					NULL, NULL);
+		sizes++;
+		names++;
+	}
+
+	slab_state = UP;
+
+#ifdef CONFIG_HOTPLUG_CPU
+	register_cpu_notifier(&slab_notifier);
+#endif
+}
+
+#ifdef CONFIG_PROC_FS
+
+static void print_slabinfo_header(struct seq_file *m)
+{
+	/*
+	 * Output format version, so at least we can change it
+	 * without _too_ many complaints.  The tunables are always 0:
+	 * there are no queues to tune.
+	 */
+	seq_puts(m, "slabinfo - version: 2.1\n");
+	seq_puts(m, "# name            <active_objs> <num_objs> <objsize> "
+		 "<objperslab> <pagesperslab>");
+	seq_puts(m, " : tunables <limit> <batchcount> <sharedfactor>");
+	seq_puts(m, " : slabdata <active_slabs> <num_slabs> <sharedavail>");
+	seq_putc(m, '\n');
+}
+
+static void *s_start(struct seq_file *m, loff_t *pos)
+{
+	loff_t n = *pos;
+	struct list_head *p;
+
+	mutex_lock(&cache_chain_mutex);
+	if (!n)
+		print_slabinfo_header(m);
+	p = cache_chain.next;
+	while (n--) {
+		p = p->next;
+		if (p == &cache_chain)
+			return NULL;
+	}
+	return list_entry(p, struct kmem_cache, next);
+}
+
+static void *s_next(struct seq_file *m, void *p, loff_t *pos)
+{
+	struct kmem_cache *cachep = p;
+	++*pos;
+	return cachep->next.next == &cache_chain ? NULL
+	    : list_entry(cachep->next.next, struct kmem_cache, next);
+}
+
+static void s_stop(struct seq_file *m, void *p)
+{
+	mutex_unlock(&cache_chain_mutex);
+}
+
+static int s_show(struct seq_file *m, void *p)
+{
+	struct kmem_cache *s = p;
+	unsigned long nr_slabs = 0, nr_partial = 0, nr_inuse = 0;
+	unsigned long nr_objs;
+	int node;
+
+	for_each_online_node(node) {
+		struct kmem_cache_node *n = get_node(s, node);
+		struct page *page;
+		unsigned long flags;
+
+		if (!n)
+			continue;
+
+		spin_lock_irqsave(&n->list_lock, flags);
+		list_for_each_entry(page, &n->partial, lru)
+			nr_inuse += page->inuse;
+		nr_partial += n->nr_partial;
+		spin_unlock_irqrestore(&n->list_lock, flags);
+		nr_slabs += atomic_read(&n->nr_slabs);
+	}
+
+	/* Full slabs and cpu slabs are counted as completely in use */
+	nr_objs = nr_slabs * s->objects;
+	nr_inuse += (nr_slabs - nr_partial) * s->objects;
+
+	seq_printf(m, "%-17s %6lu %6lu %6d %4d %4d",
+		   s->name, nr_inuse, nr_objs, s->size, s->objects,
+		   (1 << s->order));
+	seq_printf(m, " : tunables %4u %4u %4u", 0, 0, 0);
+	seq_printf(m, " : slabdata %6lu %6lu %6lu", nr_slabs, nr_slabs, 0UL);
+	seq_putc(m, '\n');
+	return 0;
+}
+
+struct seq_operations slabinfo_op = {
+	.start = s_start,
+	.next = s_next,
+	.stop = s_stop,
+	.show = s_show,
+};
+
+/**
+ * slabinfo_write - Tuning for the slab allocator
+ * @file: unused
+ * @buffer: user buffer
+ * @count: data length
+ * @ppos: unused
+ *
+ * SLUB has no per-cpu queues, so there is nothing to tune.
+ */
+ssize_t slabinfo_write(struct file *file, const char __user * buffer,
+		       size_t count, loff_t *ppos)
+{
+	return -EINVAL;
+}
+#endif
@@ -75,16 +75,16 @@ int rotate_reclaimable_page(struct page *page)
 		return 1;
 	if (PageDirty(page))
 		return 1;
-	if (PageActive(page))
+	if (PageActive(page) || PageUnevictable(page))
 		return 1;
 	if (!PageLRU(page))
 		return 1;
 
 	zone = page_zone(page);
 	spin_lock_irqsave(&zone->lru_lock, flags);
-	if (PageLRU(page) && !PageActive(page)) {
-		list_del(&page->lru);
-		list_add_tail(&page->lru, &zone->inactive_list);
+	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
+		list_move_tail(&page->lru,
+			       &zone->lru[page_lru_base_type(page)].list);
 		inc_page_state(pgrotated);
 	}
 	if (!test_clear_page_writeback(page))
@@ -101,10 +101,13 @@ void fastcall activate_page(struct page *page)
 	struct zone *zone = page_zone(page);
 
 	spin_lock_irq(&zone->lru_lock);
-	if (PageLRU(page) && !PageActive(page)) {
-		del_page_from_inactive_list(zone, page);
+	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
+		enum lru_list l = page_lru_base_type(page);
+
+		del_page_from_lru_list(zone, page, l);
 		SetPageActive(page);
-		add_page_to_active_list(zone, page);
+		add_page_to_lru_list(zone, page, l + LRU_ACTIVE);
+		zone->recent_rotated[is_file_lru(l)]++;
 		inc_page_state(pgactivate);
 	}
 	spin_unlock_irq(&zone->lru_lock);
@@ -333,7 +336,11 @@ void __pagevec_lru_add(struct pagevec *pvec)
 		}
 		if (TestSetPageLRU(page))
 			BUG();
-		add_page_to_inactive_list(zone, page);
+		if (unlikely(!page_evictable(page))) {
+			SetPageUnevictable(page);
+			add_page_to_lru_list(zone, page, LRU_UNEVICTABLE);
+		} else
+			add_page_to_inactive_list(zone, page);
 	}
 	if (zone)
 		spin_unlock_irq(&zone->lru_lock);
@@ -360,6 +367,11 @@ void __pagevec_lru_add_active(struct pagevec *pvec)
 		}
 		if (TestSetPageLRU(page))
 			BUG();
+		if (unlikely(!page_evictable(page))) {
+			SetPageUnevictable(page);
+			add_page_to_lru_list(zone, page, LRU_UNEVICTABLE);
+			continue;
+		}
 		if (TestSetPageActive(page))
 			BUG();
 		add_page_to_active_list(zone, page);
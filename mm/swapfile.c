@@ -473,7 +473,8 @@ static inline int unuse_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd))
+		/* a huge pmd maps no swap entries */
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
 		if (unuse_pte_range(vma, pmd, addr, next, entry, page))
 			return 1;
@@ -527,7 +528,7 @@ static int unuse_vma(struct vm_area_struct *vma,
 	return 0;
 }
 
-static int unuse_mm(struct mm_struct *mm,
+static int unuse_mm_swap(struct mm_struct *mm,
 				swp_entry_t entry, struct page *page)
 {
 	struct vm_area_struct *vma;
@@ -548,7 +549,7 @@ static int unuse_mm(struct mm_struct *mm,
 	}
 	up_read(&mm->mmap_sem);
 	/*
-	 * Currently unuse_mm cannot fail, but leave error handling
+	 * Currently unuse_mm_swap cannot fail, but leave error handling
 	 * at call sites for now, since we change it from time to time.
 	 */
 	return 0;
@@ -709,7 +710,7 @@ again:
 			if (start_mm == &init_mm)
 				shmem = shmem_unuse(entry, page);
 			else
-				retval = unuse_mm(start_mm, entry, page);
+				retval = unuse_mm_swap(start_mm, entry, page);
 		}
 		if (*swap_map > 1) {
 			int set_start_mm = (*swap_map >= swcount);
@@ -741,7 +742,7 @@ again:
 					set_start_mm = 1;
 					shmem = shmem_unuse(entry, page);
 				} else
-					retval = unuse_mm(mm, entry, page);
+					retval = unuse_mm_swap(mm, entry, page);
 				if (set_start_mm && *swap_map < swcount) {
 					mmput(new_start_mm);
 					atomic_inc(&mm->mm_users);
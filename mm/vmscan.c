@@ -61,8 +61,6 @@ struct scan_control {
 	/* Incremented by the number of pages reclaimed */
 	unsigned long nr_reclaimed;
 
-	unsigned long nr_mapped;	/* From page_state */
-
 	/* Ask shrink_caches, or shrink_zone to scan at this priority */
 	unsigned int priority;
 
@@ -126,7 +124,6 @@ struct shrinker {
  * From 0 .. 100.  Higher means more swappy.
  */
 int vm_swappiness = 60;
-static long total_memory;
 
 static LIST_HEAD(shrinker_list);
 static DECLARE_RWSEM(shrinker_rwsem);
@@ -387,25 +384,31 @@ static int remove_mapping(struct address_space *mapping, struct page *page)
 	 * The non-racy check for busy page.  It is critical to check
 	 * PageDirty _after_ making sure that the page is freeable and
 	 * not in use by anybody. 	(pagecache + us == 2)
+	 *
+	 * find_get_page() takes references without the tree_lock, so the
+	 * count is frozen at zero rather than just checked: lockless
+	 * lookups then back off until the page is gone from the tree.
 	 */
-	if (unlikely(page_count(page) != 2))
+	if (!page_freeze_refs(page, 2))
 		goto cannot_free;
-	smp_rmb();
-	if (unlikely(PageDirty(page)))
+	/* note: atomic_cmpxchg in page_freeze_refs provides the smp_rmb */
+	if (unlikely(PageDirty(page))) {
+		page_unfreeze_refs(page, 2);
 		goto cannot_free;
+	}
 
 	if (PageSwapCache(page)) {
 		swp_entry_t swap = { .val = page_private(page) };
 		__delete_from_swap_cache(page);
 		write_unlock_irq(&mapping->tree_lock);
 		swap_free(swap);
-		__put_page(page);	/* The pagecache ref */
+		page_unfreeze_refs(page, 1);	/* drop the pagecache ref */
 		return 1;
 	}
 
 	__remove_from_page_cache(page);
 	write_unlock_irq(&mapping->tree_lock);
-	__put_page(page);
+	page_unfreeze_refs(page, 1);	/* drop the pagecache ref */
 	return 1;
 
 cannot_free:
@@ -421,6 +424,7 @@ static int shrink_list(struct list_head *page_list, struct scan_control *sc)
 	LIST_HEAD(ret_pages);
 	struct pagevec freed_pvec;
 	int pgactivate = 0;
+	int pgculled = 0;
 	int reclaimed = 0;
 
 	cond_resched();
@@ -431,6 +435,7 @@ static int shrink_list(struct list_head *page_list, struct scan_control *sc)
 		struct page *page;
 		int may_enter_fs;
 		int referenced;
+		unsigned long vm_flags;
 
 		cond_resched();
 
@@ -447,10 +452,17 @@ static int shrink_list(struct list_head *page_list, struct scan_control *sc)
 		if (page_mapped(page) || PageSwapCache(page))
 			sc->nr_scanned++;
 
+		if (unlikely(!page_evictable(page)))
+			goto cull_mlocked;
+
 		if (PageWriteback(page))
 			goto keep_locked;
 
-		referenced = page_referenced(page, 1);
+		referenced = page_referenced(page, 1, &vm_flags);
+		/* Mlocked somewhere: park it on the unevictable list */
+		if (vm_flags & VM_LOCKED)
+			goto cull_mlocked;
+
 		/* In active use or really unfreeable?  Activate it. */
 		if (referenced && page_mapping_inuse(page))
 			goto activate_locked;
@@ -463,6 +475,9 @@ static int shrink_list(struct list_head *page_list, struct scan_control *sc)
 		if (PageAnon(page) && !PageSwapCache(page)) {
 			if (!sc->may_swap)
 				goto keep_locked;
+			/* A huge page is swapped out as small pages */
+			if (PageTransHuge(page) && split_huge_page(page))
+				goto activate_locked;
 			if (!add_to_swap(page, GFP_ATOMIC))
 				goto activate_locked;
 		}
@@ -562,6 +577,11 @@ free_it:
 			__pagevec_release_nonlru(&freed_pvec);
 		continue;
 
+cull_mlocked:
+		SetPageUnevictable(page);
+		pgculled++;
+		goto keep_locked;
+
 activate_locked:
 		SetPageActive(page);
 		pgactivate++;
@@ -575,10 +595,72 @@ keep:
 	if (pagevec_count(&freed_pvec))
 		__pagevec_release_nonlru(&freed_pvec);
 	mod_page_state(pgactivate, pgactivate);
+	mod_page_state(unevictable_pgs_culled, pgculled);
 	sc->nr_reclaimed += reclaimed;
 	return reclaimed;
 }
 
+/*
+ * Pages which reclaim cannot do anything about are moved to the
+ * unevictable list, so that they are not scanned over and over again:
+ * pages of mappings marked unevictable (ramfs, SHM_LOCKed segments) are
+ * recognised when they are added to the LRU, mlocked pages are culled by
+ * shrink_list() when page_referenced() finds them in a VM_LOCKED vma.
+ * Both are put back on the normal lists once the lock goes away.
+ */
+int page_evictable(struct page *page)
+{
+	return !mapping_unevictable(page_mapping(page));
+}
+
+/*
+ * Move a page from the unevictable list back to the LRU list of its
+ * kind, if nothing keeps it there any more.  Should it be mlocked in
+ * another vma as well, reclaim will simply cull it again.
+ */
+void rescue_unevictable_page(struct page *page)
+{
+	struct zone *zone = page_zone(page);
+
+	spin_lock_irq(&zone->lru_lock);
+	if (PageUnevictable(page) && page_evictable(page)) {
+		if (PageLRU(page)) {
+			del_page_from_lru_list(zone, page, LRU_UNEVICTABLE);
+			ClearPageUnevictable(page);
+			add_page_to_lru_list(zone, page, page_lru(page));
+			__inc_page_state(unevictable_pgs_rescued);
+		} else {
+			/* Isolated: whoever has it puts it back by its flags */
+			ClearPageUnevictable(page);
+		}
+	}
+	spin_unlock_irq(&zone->lru_lock);
+}
+
+/*
+ * Rescue the pages of a mapping which has just stopped being unevictable.
+ */
+void scan_mapping_unevictable_pages(struct address_space *mapping)
+{
+	struct pagevec pvec;
+	pgoff_t next = 0;
+	int i;
+
+	pagevec_init(&pvec, 0);
+	while (pagevec_lookup(&pvec, mapping, next, PAGEVEC_SIZE)) {
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+
+			if (page->index > next)
+				next = page->index;
+			next++;
+			rescue_unevictable_page(page);
+		}
+		pagevec_release(&pvec);
+		cond_resched();
+	}
+}
+
 #ifdef CONFIG_MIGRATION
 static inline void move_to_lru(struct page *page)
 {
@@ -703,8 +785,10 @@ int migrate_page_remove_references(struct page *newpage,
 	 * maps for files.
 	 *
 	 * In order to reestablish file backed mappings the fault handlers
-	 * will take the radix tree_lock which may then be used to stop
-  	 * processses from accessing this page until the new page is ready.
+	 * will look up the page in the radix tree. The slot is switched to
+	 * the new page, which stays locked and !PageUptodate until it is
+	 * ready, while the old page's count is frozen so that lockless
+	 * lookups cannot take new references to it.
 	 *
 	 * A process accessing via a swap pte (an anonymous page) will take a
 	 * page_lock on the old page which will block the process until the
@@ -731,8 +815,8 @@ int migrate_page_remove_references(struct page *newpage,
 						&mapping->page_tree,
 						page_index(page));
 
-	if (!page_mapping(page) || page_count(page) != nr_refs ||
-			*radix_pointer != page) {
+	if (!page_mapping(page) || *radix_pointer != page ||
+			!page_freeze_refs(page, nr_refs)) {
 		write_unlock_irq(&mapping->tree_lock);
 		return 1;
 	}
@@ -753,8 +837,8 @@ int migrate_page_remove_references(struct page *newpage,
 		set_page_private(newpage, page_private(page));
 	}
 
-	*radix_pointer = newpage;
-	__put_page(page);
+	radix_tree_replace_slot((void **)radix_pointer, newpage);
+	page_unfreeze_refs(page, nr_refs - 1);
 	write_unlock_irq(&mapping->tree_lock);
 
 	return 0;
@@ -780,6 +864,8 @@ void migrate_page_copy(struct page *newpage, struct page *page)
 		SetPageChecked(newpage);
 	if (PageMappedToDisk(page))
 		SetPageMappedToDisk(newpage);
+	if (PageSwapBacked(page))
+		SetPageSwapBacked(newpage);
 
 	if (PageDirty(page)) {
 		clear_page_dirty_for_io(page);
@@ -1020,10 +1106,9 @@ int isolate_lru_page(struct page *page)
 		if (TestClearPageLRU(page)) {
 			ret = 1;
 			get_page(page);
-			if (PageActive(page))
-				del_page_from_active_list(zone, page);
-			else
-				del_page_from_inactive_list(zone, page);
+			del_page_from_lru_list(zone, page, page_lru(page));
+			/* Evictability is looked at again when it is put back */
+			ClearPageUnevictable(page);
 		}
 		spin_unlock_irq(&zone->lru_lock);
 	}
@@ -1084,11 +1169,12 @@ static int isolate_lru_pages(int nr_to_scan, struct list_head *src,
 /*
  * shrink_cache() adds the number of pages reclaimed to sc->nr_reclaimed
  */
-static void shrink_cache(struct zone *zone, struct scan_control *sc)
+static void shrink_cache(struct zone *zone, struct scan_control *sc, int file)
 {
 	LIST_HEAD(page_list);
 	struct pagevec pvec;
 	int max_scan = sc->nr_to_scan;
+	enum lru_list lru = LRU_BASE + file * LRU_FILE;
 
 	pagevec_init(&pvec, 1);
 
@@ -1101,9 +1187,10 @@ static void shrink_cache(struct zone *zone, struct scan_control *sc)
 		int nr_freed;
 
 		nr_taken = isolate_lru_pages(sc->swap_cluster_max,
-					     &zone->inactive_list,
+					     &zone->lru[lru].list,
 					     &page_list, &nr_scan);
-		zone->nr_inactive -= nr_taken;
+		zone->lru[lru].nr -= nr_taken;
+		zone->recent_scanned[file] += nr_taken;
 		zone->pages_scanned += nr_scan;
 		spin_unlock_irq(&zone->lru_lock);
 
@@ -1131,9 +1218,8 @@ static void shrink_cache(struct zone *zone, struct scan_control *sc)
 				BUG();
 			list_del(&page->lru);
 			if (PageActive(page))
-				add_page_to_active_list(zone, page);
-			else
-				add_page_to_inactive_list(zone, page);
+				zone->recent_rotated[file]++;
+			add_page_to_lru_list(zone, page, page_lru(page));
 			if (!pagevec_add(&pvec, page)) {
 				spin_unlock_irq(&zone->lru_lock);
 				__pagevec_release(&pvec);
@@ -1147,10 +1233,15 @@ done:
 }
 
 /*
- * This moves pages from the active list to the inactive list.
+ * This moves pages from the active list to the inactive list, of the anon
+ * or the file LRU as selected by @file.
  *
- * We move them the other way if the page is referenced by one or more
- * processes, from rmap.
+ * Pages referenced since they were last looked at are counted as rotated,
+ * which makes the list more expensive to scan in get_scan_ratio(), but
+ * only executable file pages actually stay on the active list: everything
+ * else gets its chance on the inactive list, where a further reference
+ * activates it again.  That keeps program text from being pushed out by
+ * streaming I/O without letting the active list grow stale.
  *
  * If the pages are mostly unmapped, the processing is fast and it is
  * appropriate to hold zone->lru_lock across the whole operation.  But if
@@ -1164,69 +1255,38 @@ done:
  * But we had to alter page->flags anyway.
  */
 static void
-refill_inactive_zone(struct zone *zone, struct scan_control *sc)
+refill_inactive_zone(struct zone *zone, struct scan_control *sc, int file)
 {
 	int pgmoved;
 	int pgdeactivate = 0;
 	int pgscanned;
 	int nr_pages = sc->nr_to_scan;
+	unsigned long rotated = 0;
+	unsigned long vm_flags;
 	LIST_HEAD(l_hold);	/* The pages which were snipped off */
 	LIST_HEAD(l_inactive);	/* Pages to go onto the inactive_list */
 	LIST_HEAD(l_active);	/* Pages to go onto the active_list */
 	struct page *page;
 	struct pagevec pvec;
-	int reclaim_mapped = 0;
-	long mapped_ratio;
-	long distress;
-	long swap_tendency;
+	enum lru_list lru = LRU_BASE + file * LRU_FILE;
 
 	lru_add_drain();
 	spin_lock_irq(&zone->lru_lock);
-	pgmoved = isolate_lru_pages(nr_pages, &zone->active_list,
+	pgmoved = isolate_lru_pages(nr_pages, &zone->lru[lru + LRU_ACTIVE].list,
 				    &l_hold, &pgscanned);
 	zone->pages_scanned += pgscanned;
-	zone->nr_active -= pgmoved;
+	zone->lru[lru + LRU_ACTIVE].nr -= pgmoved;
+	zone->recent_scanned[file] += pgmoved;
 	spin_unlock_irq(&zone->lru_lock);
 
-	/*
-	 * `distress' is a measure of how much trouble we're having reclaiming
-	 * pages.  0 -> no problems.  100 -> great trouble.
-	 */
-	distress = 100 >> zone->prev_priority;
-
-	/*
-	 * The point of this algorithm is to decide when to start reclaiming
-	 * mapped memory instead of just pagecache.  Work out how much memory
-	 * is mapped.
-	 */
-	mapped_ratio = (sc->nr_mapped * 100) / total_memory;
-
-	/*
-	 * Now decide how much we really want to unmap some pages.  The mapped
-	 * ratio is downgraded - just because there's a lot of mapped memory
-	 * doesn't necessarily mean that page reclaim isn't succeeding.
-	 *
-	 * The distress ratio is important - we don't want to start going oom.
-	 *
-	 * A 100% value of vm_swappiness overrides this algorithm altogether.
-	 */
-	swap_tendency = mapped_ratio / 2 + distress + vm_swappiness;
-
-	/*
-	 * Now use this metric to decide whether to start moving mapped memory
-	 * onto the inactive list.
-	 */
-	if (swap_tendency >= 100)
-		reclaim_mapped = 1;
-
 	while (!list_empty(&l_hold)) {
 		cond_resched();
 		page = lru_to_page(&l_hold);
 		list_del(&page->lru);
-		if (page_mapped(page)) {
-			if (!reclaim_mapped ||
-			    (total_swap_pages == 0 && PageAnon(page)) ||
-			    page_referenced(page, 0)) {
+		if (page_mapping_inuse(page) &&
+		    page_referenced(page, 0, &vm_flags)) {
+			rotated++;
+			if (file && (vm_flags & VM_EXEC)) {
 				list_add(&page->lru, &l_active);
 				continue;
 			}
@@ -1237,6 +1297,8 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 	pagevec_init(&pvec, 1);
 	pgmoved = 0;
 	spin_lock_irq(&zone->lru_lock);
+	/* Pages which stayed active count as rotated in get_scan_ratio() */
+	zone->recent_rotated[file] += rotated;
 	while (!list_empty(&l_inactive)) {
 		page = lru_to_page(&l_inactive);
 		prefetchw_prev_lru_page(page, &l_inactive, flags);
@@ -1244,10 +1306,10 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 			BUG();
 		if (!TestClearPageActive(page))
 			BUG();
-		list_move(&page->lru, &zone->inactive_list);
+		list_move(&page->lru, &zone->lru[lru].list);
 		pgmoved++;
 		if (!pagevec_add(&pvec, page)) {
-			zone->nr_inactive += pgmoved;
+			zone->lru[lru].nr += pgmoved;
 			spin_unlock_irq(&zone->lru_lock);
 			pgdeactivate += pgmoved;
 			pgmoved = 0;
@@ -1257,7 +1319,7 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 			spin_lock_irq(&zone->lru_lock);
 		}
 	}
-	zone->nr_inactive += pgmoved;
+	zone->lru[lru].nr += pgmoved;
 	pgdeactivate += pgmoved;
 	if (buffer_heads_over_limit) {
 		spin_unlock_irq(&zone->lru_lock);
@@ -1272,17 +1334,17 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 		if (TestSetPageLRU(page))
 			BUG();
 		BUG_ON(!PageActive(page));
-		list_move(&page->lru, &zone->active_list);
+		list_move(&page->lru, &zone->lru[lru + LRU_ACTIVE].list);
 		pgmoved++;
 		if (!pagevec_add(&pvec, page)) {
-			zone->nr_active += pgmoved;
+			zone->lru[lru + LRU_ACTIVE].nr += pgmoved;
 			pgmoved = 0;
 			spin_unlock_irq(&zone->lru_lock);
 			__pagevec_release(&pvec);
 			spin_lock_irq(&zone->lru_lock);
 		}
 	}
-	zone->nr_active += pgmoved;
+	zone->lru[lru + LRU_ACTIVE].nr += pgmoved;
 	spin_unlock(&zone->lru_lock);
 
 	__mod_page_state_zone(zone, pgrefill, pgscanned);
@@ -1292,51 +1354,159 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 	pagevec_release(&pvec);
 }
 
+/*
+ * The inactive anon list should be large enough that pages on it get a
+ * fair chance of being referenced again before they are swapped out;
+ * zone->inactive_ratio is larger on big zones, see free_area_init_core().
+ */
+static inline int inactive_anon_is_low(struct zone *zone)
+{
+	return zone->lru[LRU_INACTIVE_ANON].nr * zone->inactive_ratio <
+		zone->lru[LRU_ACTIVE_ANON].nr;
+}
+
+/*
+ * Work out how to split the scanning between the anon and the file LRU
+ * lists: percent[0] is the share of the anon lists, percent[1] that of the
+ * file lists.
+ *
+ * vm_swappiness sets the base cost of swapping anon pages against that of
+ * dropping page cache.  On top of that, each kind of page is made more
+ * expensive to scan by the fraction of the pages scanned recently which
+ * turned out to be in use and were rotated back onto the active list.
+ */
+static void get_scan_ratio(struct zone *zone, struct scan_control *sc,
+			   unsigned long *percent)
+{
+	unsigned long anon, file;
+	unsigned long anon_prio, file_prio;
+	unsigned long ap, fp;
+	u64 tmp;
+
+	/* Without swap there is no point in scanning the anon lists */
+	if (!sc->may_swap || nr_swap_pages <= 0) {
+		percent[0] = 0;
+		percent[1] = 100;
+		return;
+	}
+
+	anon = zone->lru[LRU_ACTIVE_ANON].nr + zone->lru[LRU_INACTIVE_ANON].nr;
+	file = zone->lru[LRU_ACTIVE_FILE].nr + zone->lru[LRU_INACTIVE_FILE].nr;
+
+	/* Too little page cache left to get the zone back to pages_high */
+	if (file + zone->free_pages <= zone->pages_high) {
+		percent[0] = 100;
+		percent[1] = 0;
+		return;
+	}
+
+	/*
+	 * Decay the statistics now and then, so that they follow the
+	 * workload instead of accumulating forever.
+	 */
+	if (unlikely(zone->recent_scanned[0] > anon / 4)) {
+		spin_lock_irq(&zone->lru_lock);
+		zone->recent_scanned[0] /= 2;
+		zone->recent_rotated[0] /= 2;
+		spin_unlock_irq(&zone->lru_lock);
+	}
+
+	if (unlikely(zone->recent_scanned[1] > file / 4)) {
+		spin_lock_irq(&zone->lru_lock);
+		zone->recent_scanned[1] /= 2;
+		zone->recent_rotated[1] /= 2;
+		spin_unlock_irq(&zone->lru_lock);
+	}
+
+	anon_prio = vm_swappiness;
+	file_prio = 200 - vm_swappiness;
+
+	ap = (anon_prio + 1) * (zone->recent_scanned[0] + 1);
+	ap /= zone->recent_rotated[0] + 1;
+
+	fp = (file_prio + 1) * (zone->recent_scanned[1] + 1);
+	fp /= zone->recent_rotated[1] + 1;
+
+	tmp = (u64)ap * 100;
+	do_div(tmp, ap + fp + 1);
+	percent[0] = tmp;
+	percent[1] = 100 - percent[0];
+}
+
+static void shrink_lru_list(enum lru_list l, struct zone *zone,
+			    struct scan_control *sc)
+{
+	int file = is_file_lru(l);
+
+	if (is_active_lru(l)) {
+		/* Only deactivate anon pages if the inactive list needs them */
+		if (file || inactive_anon_is_low(zone))
+			refill_inactive_zone(zone, sc, file);
+		return;
+	}
+	shrink_cache(zone, sc, file);
+}
+
 /*
  * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
  */
 static void
 shrink_zone(struct zone *zone, struct scan_control *sc)
 {
-	unsigned long nr_active;
-	unsigned long nr_inactive;
+	unsigned long nr[NR_LRU_LISTS];
+	unsigned long percent[2];
+	enum lru_list l;
 
 	atomic_inc(&zone->reclaim_in_progress);
 
-	/*
-	 * Add one to `nr_to_scan' just to make sure that the kernel will
-	 * slowly sift through the active list.
-	 */
-	zone->nr_scan_active += (zone->nr_active >> sc->priority) + 1;
-	nr_active = zone->nr_scan_active;
-	if (nr_active >= sc->swap_cluster_max)
-		zone->nr_scan_active = 0;
-	else
-		nr_active = 0;
+	get_scan_ratio(zone, sc, percent);
 
-	zone->nr_scan_inactive += (zone->nr_inactive >> sc->priority) + 1;
-	nr_inactive = zone->nr_scan_inactive;
-	if (nr_inactive >= sc->swap_cluster_max)
-		zone->nr_scan_inactive = 0;
-	else
-		nr_inactive = 0;
+	for_each_evictable_lru(l) {
+		int file = is_file_lru(l);
+		unsigned long scan;
 
-	while (nr_active || nr_inactive) {
-		if (nr_active) {
-			sc->nr_to_scan = min(nr_active,
-					(unsigned long)sc->swap_cluster_max);
-			nr_active -= sc->nr_to_scan;
-			refill_inactive_zone(zone, sc);
+		if (!percent[file]) {
+			nr[l] = 0;
+			continue;
 		}
 
-		if (nr_inactive) {
-			sc->nr_to_scan = min(nr_inactive,
+		/*
+		 * Add one to `nr_to_scan' just to make sure that the kernel
+		 * will slowly sift through each list.
+		 */
+		scan = zone->lru[l].nr >> sc->priority;
+		if (sc->priority)
+			scan = (scan * percent[file]) / 100;
+		zone->lru[l].nr_scan += scan + 1;
+		nr[l] = zone->lru[l].nr_scan;
+		if (nr[l] >= sc->swap_cluster_max)
+			zone->lru[l].nr_scan = 0;
+		else
+			nr[l] = 0;
+	}
+
+	while (nr[LRU_INACTIVE_ANON] || nr[LRU_ACTIVE_FILE] ||
+	       nr[LRU_INACTIVE_FILE]) {
+		for_each_evictable_lru(l) {
+			if (nr[l]) {
+				sc->nr_to_scan = min(nr[l],
 					(unsigned long)sc->swap_cluster_max);
-			nr_inactive -= sc->nr_to_scan;
-			shrink_cache(zone, sc);
+				nr[l] -= sc->nr_to_scan;
+				shrink_lru_list(l, zone, sc);
+			}
 		}
 	}
 
+	/*
+	 * Keep some anon pages aging on the inactive list even while the
+	 * file lists take all the pressure, so that there is something to
+	 * choose from once swapping starts.
+	 */
+	if (sc->may_swap && nr_swap_pages > 0 && inactive_anon_is_low(zone)) {
+		sc->nr_to_scan = sc->swap_cluster_max;
+		refill_inactive_zone(zone, sc, 0);
+	}
+
 	throttle_vm_writeout();
 
 	atomic_dec(&zone->reclaim_in_progress);
@@ -1391,8 +1561,8 @@ shrink_caches(struct zone **zones, struct scan_control *sc)
  *
  * If the caller is !__GFP_FS then the probability of a failure is reasonably
  * high - the zone may be full of dirty or under-writeback pages, which this
- * caller can't do much about.  We kick pdflush and take explicit naps in the
- * hope that some of these pages can be written.  But if the allocating task
+ * caller can't do much about.  We kick the flusher threads and take explicit
+ * naps in the hope that some of these pages can be written.  But if the allocating task
  * holds filesystem locks which prevent writeout this might not work, and the
  * allocation attempt will fail.
  */
@@ -1419,11 +1589,10 @@ int try_to_free_pages(struct zone **zones, gfp_t gfp_mask)
 			continue;
 
 		zone->temp_priority = DEF_PRIORITY;
-		lru_pages += zone->nr_active + zone->nr_inactive;
+		lru_pages += zone_lru_pages(zone);
 	}
 
 	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
-		sc.nr_mapped = read_page_state(nr_mapped);
 		sc.nr_scanned = 0;
 		sc.nr_reclaimed = 0;
 		sc.priority = priority;
@@ -1451,7 +1620,7 @@ int try_to_free_pages(struct zone **zones, gfp_t gfp_mask)
 		 * writeout.  So in laptop mode, write out the whole world.
 		 */
 		if (total_scanned > sc.swap_cluster_max + sc.swap_cluster_max/2) {
-			wakeup_pdflush(laptop_mode ? 0 : total_scanned);
+			wakeup_flusher_threads(laptop_mode ? 0 : total_scanned);
 			sc.may_writepage = 1;
 		}
 
@@ -1512,7 +1681,6 @@ loop_again:
 	sc.gfp_mask = GFP_KERNEL;
 	sc.may_writepage = !laptop_mode;
 	sc.may_swap = 1;
-	sc.nr_mapped = read_page_state(nr_mapped);
 
 	inc_page_state(pageoutrun);
 
@@ -1561,7 +1729,7 @@ scan:
 		for (i = 0; i <= end_zone; i++) {
 			struct zone *zone = pgdat->node_zones + i;
 
-			lru_pages += zone->nr_active + zone->nr_inactive;
+			lru_pages += zone_lru_pages(zone);
 		}
 
 		/*
@@ -1607,7 +1775,7 @@ scan:
 			if (zone->all_unreclaimable)
 				continue;
 			if (nr_slab == 0 && zone->pages_scanned >=
-				    (zone->nr_active + zone->nr_inactive) * 4)
+				    zone_lru_pages(zone) * 4)
 				zone->all_unreclaimable = 1;
 			/*
 			 * If we've done a decent amount of scanning and
@@ -1803,7 +1971,6 @@ static int __init kswapd_init(void)
 	for_each_pgdat(pgdat)
 		pgdat->kswapd
 		= find_task_by_pid(kernel_thread(kswapd, pgdat, CLONE_KERNEL));
-	total_memory = nr_free_pagecache_pages();
 	hotcpu_notifier(cpu_callback, 0);
 	return 0;
 }
@@ -1872,7 +2039,6 @@ int zone_reclaim(struct zone *zone, gfp_t gfp_mask, unsigned int order)
 	sc.nr_scanned = 0;
 	sc.nr_reclaimed = 0;
 	sc.priority = ZONE_RECLAIM_PRIORITY + 1;
-	sc.nr_mapped = read_page_state(nr_mapped);
 	sc.gfp_mask = gfp_mask;
 
 	disable_swap_token();
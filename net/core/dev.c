@@ -110,6 +110,14 @@
 #include <linux/netpoll.h>
 #include <linux/rcupdate.h>
 #include <linux/delay.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/in.h>
+#include <net/ip.h>
+#include <linux/kthread.h>
+#include <linux/cpu.h>
 #ifdef CONFIG_NET_RADIO
 #include <linux/wireless.h>		/* Note : will define WIRELESS_EXT */
 #include <net/iw_handler.h>
@@ -1175,6 +1183,7 @@ int __skb_linearize(struct sk_buff *skb, gfp_t gfp_mask)
 	ninfo->tso_segs = skb_shinfo(skb)->tso_segs;
 	ninfo->nr_frags = 0;
 	ninfo->frag_list = NULL;
+	ninfo->destructor_arg = skb_shinfo(skb)->destructor_arg;
 
 	/* Offset between the two in bytes */
 	offset = data - skb->head;
@@ -1200,18 +1209,101 @@ int __skb_linearize(struct sk_buff *skb, gfp_t gfp_mask)
 	return 0;
 }
 
-#define HARD_TX_LOCK(dev, cpu) {			\
-	if ((dev->features & NETIF_F_LLTX) == 0) {	\
-		spin_lock(&dev->xmit_lock);		\
-		dev->xmit_lock_owner = cpu;		\
-	}						\
+#define HARD_TX_LOCK(dev, index, cpu) {				\
+	if ((dev->features & NETIF_F_LLTX) == 0) {			\
+		spin_lock(netif_tx_queue_lock(dev, index));		\
+		*netif_tx_queue_owner(dev, index) = cpu;		\
+	}								\
 }
 
-#define HARD_TX_UNLOCK(dev) {				\
-	if ((dev->features & NETIF_F_LLTX) == 0) {	\
-		dev->xmit_lock_owner = -1;		\
-		spin_unlock(&dev->xmit_lock);		\
-	}						\
+#define HARD_TX_UNLOCK(dev, index) {					\
+	if ((dev->features & NETIF_F_LLTX) == 0) {			\
+		*netif_tx_queue_owner(dev, index) = -1;			\
+		spin_unlock(netif_tx_queue_lock(dev, index));		\
+	}								\
+}
+
+static u32 dev_flow_hashrnd;
+
+/*
+ * Hash the addresses and ports of an IPv4 or IPv6 packet whose network
+ * header is at nh, so that all the packets of a flow go out through the
+ * same queue, or are received on the same CPU, and stay in order.
+ * Returns 0 for other packets.
+ */
+static int dev_flow_hash(struct sk_buff *skb, unsigned char *nh, u32 *hash)
+{
+	u32 addr1, addr2, ports = 0;
+	int hlen = 0;
+	u8 proto;
+
+	if (nh < skb->data)
+		return 0;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP): {
+		struct iphdr *iph = (struct iphdr *) nh;
+
+		if (nh + sizeof(struct iphdr) > skb->tail)
+			return 0;
+		proto = iph->protocol;
+		addr1 = iph->saddr;
+		addr2 = iph->daddr;
+		if (!(iph->frag_off & htons(IP_MF | IP_OFFSET)))
+			hlen = iph->ihl * 4;
+		break;
+	}
+	case __constant_htons(ETH_P_IPV6): {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *) nh;
+
+		if (nh + sizeof(struct ipv6hdr) > skb->tail)
+			return 0;
+		proto = ip6h->nexthdr;
+		addr1 = ip6h->saddr.s6_addr32[3];
+		addr2 = ip6h->daddr.s6_addr32[3];
+		hlen = sizeof(struct ipv6hdr);
+		break;
+	}
+	default:
+		return 0;
+	}
+
+	switch (proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_DCCP:
+	case IPPROTO_SCTP:
+		if (hlen && nh + hlen + 4 <= skb->tail)
+			ports = *(u32 *)(nh + hlen);
+		break;
+	}
+
+	*hash = jhash_3words(addr1, addr2, ports, dev_flow_hashrnd);
+	return 1;
+}
+
+/*
+ * Pick the transmit queue of a multiqueue device for skb: the driver's
+ * choice if it has one, else by a hash of the flow, else by the sending
+ * cpu.  A queue without a qdisc of its own, because the device is down
+ * or has one configured on the root, sends through queue 0.
+ */
+static u16 dev_pick_tx(struct net_device *dev, struct sk_buff *skb)
+{
+	u32 hash;
+	u16 index;
+
+	if (dev->select_queue)
+		index = dev->select_queue(dev, skb);
+	else if (dev_flow_hash(skb, skb->nh.raw, &hash))
+		index = ((u64) hash * dev->num_tx_queues) >> 32;
+	else
+		index = smp_processor_id() % dev->num_tx_queues;
+
+	if (index >= dev->num_tx_queues ||
+	    (index && netdev_get_tx_queue(dev, index)->qdisc == &noop_qdisc))
+		index = 0;
+	return index;
 }
 
 /**
@@ -1244,6 +1336,8 @@ int dev_queue_xmit(struct sk_buff *skb)
 {
 	struct net_device *dev = skb->dev;
 	struct Qdisc *q;
+	spinlock_t *queue_lock;
+	u16 index = 0;
 	int rc = -ENOMEM;
 
 	if (skb_shinfo(skb)->frag_list &&
@@ -1270,13 +1364,16 @@ int dev_queue_xmit(struct sk_buff *skb)
 	      	if (skb_checksum_help(skb, 0))
 	      		goto out_kfree_skb;
 
-	spin_lock_prefetch(&dev->queue_lock);
-
 	/* Disable soft irqs for various locks below. Also 
 	 * stops preemption for RCU. 
 	 */
 	local_bh_disable(); 
 
+	/* A multiqueue device has a qdisc and locks per transmit queue */
+	if (dev->num_tx_queues > 1)
+		index = dev_pick_tx(dev, skb);
+	skb->queue_mapping = index;
+
 	/* Updates of qdisc are serialized by queue_lock. 
 	 * The struct Qdisc which is pointed to by qdisc is now a 
 	 * rcu structure - it may be accessed without acquiring 
@@ -1289,19 +1386,27 @@ int dev_queue_xmit(struct sk_buff *skb)
 	 * also serializes access to the device queue.
 	 */
 
-	q = rcu_dereference(dev->qdisc);
+	if (index) {
+		struct netdev_queue *txq = netdev_get_tx_queue(dev, index);
+
+		q = rcu_dereference(txq->qdisc);
+		queue_lock = &txq->lock;
+	} else {
+		q = rcu_dereference(dev->qdisc);
+		queue_lock = &dev->queue_lock;
+	}
 #ifdef CONFIG_NET_CLS_ACT
 	skb->tc_verd = SET_TC_AT(skb->tc_verd,AT_EGRESS);
 #endif
 	if (q->enqueue) {
 		/* Grab device queue */
-		spin_lock(&dev->queue_lock);
+		spin_lock(queue_lock);
 
 		rc = q->enqueue(skb, q);
 
-		qdisc_run(dev);
+		qdisc_run_queue(dev, index);
 
-		spin_unlock(&dev->queue_lock);
+		spin_unlock(queue_lock);
 		rc = rc == NET_XMIT_BYPASS ? NET_XMIT_SUCCESS : rc;
 		goto out;
 	}
@@ -1321,21 +1426,21 @@ int dev_queue_xmit(struct sk_buff *skb)
 	if (dev->flags & IFF_UP) {
 		int cpu = smp_processor_id(); /* ok because BHs are off */
 
-		if (dev->xmit_lock_owner != cpu) {
+		if (*netif_tx_queue_owner(dev, index) != cpu) {
 
-			HARD_TX_LOCK(dev, cpu);
+			HARD_TX_LOCK(dev, index, cpu);
 
-			if (!netif_queue_stopped(dev)) {
+			if (!netif_subqueue_stopped(dev, index)) {
 				if (netdev_nit)
 					dev_queue_xmit_nit(skb, dev);
 
 				rc = 0;
 				if (!dev->hard_start_xmit(skb, dev)) {
-					HARD_TX_UNLOCK(dev);
+					HARD_TX_UNLOCK(dev, index);
 					goto out;
 				}
 			}
-			HARD_TX_UNLOCK(dev);
+			HARD_TX_UNLOCK(dev, index);
 			if (net_ratelimit())
 				printk(KERN_CRIT "Virtual device %s asks to "
 				       "queue packet!\n", dev->name);
@@ -1371,6 +1476,244 @@ int weight_p = 64;            /* old backlog weight */
 DEFINE_PER_CPU(struct netif_rx_stats, netdev_rx_stat) = { 0, };
 
 
+#ifdef CONFIG_RPS
+/*
+ * Receive packet steering spreads the protocol processing of packets
+ * received on a device over the CPUs in its rps_map, by flow hash, or
+ * hands each flow to the CPU its socket was last used on when the device
+ * has an rps_flow_table.  The packet is queued on that CPU's backlog, and
+ * its krpsd thread is woken to get the backlog going if it was empty.
+ */
+struct rps_sock_flow_table *rps_sock_flow_table;
+EXPORT_SYMBOL(rps_sock_flow_table);
+
+static inline void rps_lock(struct softnet_data *queue)
+{
+	spin_lock(&queue->input_pkt_queue.lock);
+}
+
+static inline void rps_unlock(struct softnet_data *queue)
+{
+	spin_unlock(&queue->input_pkt_queue.lock);
+}
+
+/*
+ * The CPU skb should be processed on, or -1 for this one.  Called under
+ * rcu_read_lock(); *rflowp is set to the flow table entry to update if
+ * the packet was steered by it.
+ */
+static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
+		       struct rps_dev_flow **rflowp)
+{
+	struct rps_sock_flow_table *sock_flow_table;
+	struct rps_dev_flow_table *flow_table;
+	struct rps_map *map;
+	u16 tcpu;
+
+	map = rcu_dereference(dev->rps_map);
+	flow_table = rcu_dereference(dev->rps_flow_table);
+	if (!map && !flow_table)
+		return -1;
+
+	if (!skb->rxhash) {
+		if (!dev_flow_hash(skb, skb->data, &skb->rxhash))
+			return -1;
+		if (!skb->rxhash)
+			skb->rxhash = 1;
+	}
+
+	sock_flow_table = rcu_dereference(rps_sock_flow_table);
+	if (flow_table && sock_flow_table) {
+		struct rps_dev_flow *rflow;
+		u16 next_cpu;
+
+		rflow = &flow_table->flows[skb->rxhash & flow_table->mask];
+		tcpu = rflow->cpu;
+		next_cpu = sock_flow_table->ents[skb->rxhash &
+						 sock_flow_table->mask];
+
+		/*
+		 * Follow the socket to the CPU it was last used on, but not
+		 * before the packets already queued for the flow on the old
+		 * CPU have been processed, or the new ones would overtake
+		 * them.
+		 */
+		if (unlikely(tcpu != next_cpu) &&
+		    (tcpu == RPS_NO_CPU || !cpu_online(tcpu) ||
+		     (int)(per_cpu(softnet_data, tcpu).input_queue_head -
+			   rflow->last_qtail) >= 0)) {
+			tcpu = rflow->cpu = next_cpu;
+			if (tcpu != RPS_NO_CPU)
+				rflow->last_qtail = per_cpu(softnet_data,
+							tcpu).input_queue_head;
+		}
+		if (tcpu != RPS_NO_CPU && cpu_online(tcpu)) {
+			*rflowp = rflow;
+			return tcpu;
+		}
+	}
+
+	if (map) {
+		tcpu = map->cpus[((u64) skb->rxhash * map->len) >> 32];
+		if (cpu_online(tcpu))
+			return tcpu;
+	}
+	return -1;
+}
+
+/* Get the backlog of another CPU going, from its krpsd thread */
+static void rps_kick(struct softnet_data *queue)
+{
+	queue->rps_kick = 1;
+	smp_mb();
+	if (queue->rps_task)
+		wake_up_process(queue->rps_task);
+}
+
+static int rps_thread(void *data)
+{
+	struct softnet_data *queue = data;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		if (!queue->rps_kick) {
+			schedule();
+			set_current_state(TASK_INTERRUPTIBLE);
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+		queue->rps_kick = 0;
+		smp_mb();
+
+		/* The backlog runs when local_bh_enable() does softirqs */
+		local_bh_disable();
+		local_irq_disable();
+		if (queue == &__get_cpu_var(softnet_data))
+			netif_rx_schedule(&queue->backlog_dev);
+		local_irq_enable();
+		local_bh_enable();
+
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int __devinit rps_cpu_callback(struct notifier_block *nfb,
+				      unsigned long action,
+				      void *hcpu)
+{
+	int cpu = (unsigned long)hcpu;
+	struct softnet_data *queue = &per_cpu(softnet_data, cpu);
+	struct task_struct *p;
+
+	switch (action) {
+	case CPU_UP_PREPARE:
+		p = kthread_create(rps_thread, queue, "krpsd/%d", cpu);
+		if (IS_ERR(p)) {
+			printk(KERN_ERR "krpsd for %i failed\n", cpu);
+			return NOTIFY_BAD;
+		}
+		kthread_bind(p, cpu);
+		queue->rps_task = p;
+		break;
+	case CPU_ONLINE:
+		wake_up_process(queue->rps_task);
+		break;
+#ifdef CONFIG_HOTPLUG_CPU
+	case CPU_UP_CANCELED:
+		/* Unbind so it can run.  Fall thru. */
+		kthread_bind(queue->rps_task, any_online_cpu(cpu_online_map));
+	case CPU_DEAD:
+		p = queue->rps_task;
+		queue->rps_task = NULL;
+		kthread_stop(p);
+		break;
+#endif /* CONFIG_HOTPLUG_CPU */
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __devinitdata rps_cpu_nfb = {
+	.notifier_call = rps_cpu_callback
+};
+
+static void __init rps_init(void)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		void *hcpu = (void *)(long)cpu;
+
+		rps_cpu_callback(&rps_cpu_nfb, CPU_UP_PREPARE, hcpu);
+		rps_cpu_callback(&rps_cpu_nfb, CPU_ONLINE, hcpu);
+	}
+	register_cpu_notifier(&rps_cpu_nfb);
+}
+#else
+static inline void rps_lock(struct softnet_data *queue)
+{
+}
+
+static inline void rps_unlock(struct softnet_data *queue)
+{
+}
+
+static inline void rps_kick(struct softnet_data *queue)
+{
+}
+#endif /* CONFIG_RPS */
+
+/*
+ * Queue skb on cpu's backlog, and get the backlog going if it was empty.
+ * With qtail, remember how far down the backlog skb went.
+ */
+static int enqueue_to_backlog(struct sk_buff *skb, int cpu,
+			      unsigned int *qtail)
+{
+	struct softnet_data *queue;
+	unsigned long flags;
+	int kick = 0;
+
+	/*
+	 * The code is rearranged so that the path is the most
+	 * short when CPU is congested, but is still operating.
+	 */
+	local_irq_save(flags);
+	queue = &per_cpu(softnet_data, cpu);
+
+	__get_cpu_var(netdev_rx_stat).total++;
+	rps_lock(queue);
+	if (queue->input_pkt_queue.qlen <= netdev_max_backlog) {
+		if (!queue->input_pkt_queue.qlen) {
+			if (cpu == smp_processor_id())
+				netif_rx_schedule(&queue->backlog_dev);
+			else
+				kick = 1;
+		}
+
+		dev_hold(skb->dev);
+		__skb_queue_tail(&queue->input_pkt_queue, skb);
+#ifdef CONFIG_RPS
+		if (qtail)
+			*qtail = queue->input_queue_head +
+				 queue->input_pkt_queue.qlen;
+#endif
+		rps_unlock(queue);
+		if (kick)
+			rps_kick(queue);
+		local_irq_restore(flags);
+		return NET_RX_SUCCESS;
+	}
+	rps_unlock(queue);
+
+	__get_cpu_var(netdev_rx_stat).dropped++;
+	local_irq_restore(flags);
+
+	kfree_skb(skb);
+	return NET_RX_DROP;
+}
+
 /**
  *	netif_rx	-	post buffer to the network code
  *	@skb: buffer to post
@@ -1391,8 +1734,10 @@ DEFINE_PER_CPU(struct netif_rx_stats, netdev_rx_stat) = { 0, };
 
 int netif_rx(struct sk_buff *skb)
 {
-	struct softnet_data *queue;
-	unsigned long flags;
+	int cpu, ret;
+#ifdef CONFIG_RPS
+	struct rps_dev_flow *rflow = NULL;
+#endif
 
 	/* if netpoll wants it, pretend we never saw it */
 	if (netpoll_rx(skb))
@@ -1401,32 +1746,20 @@ int netif_rx(struct sk_buff *skb)
 	if (!skb->tstamp.off_sec)
 		net_timestamp(skb);
 
-	/*
-	 * The code is rearranged so that the path is the most
-	 * short when CPU is congested, but is still operating.
-	 */
-	local_irq_save(flags);
-	queue = &__get_cpu_var(softnet_data);
-
-	__get_cpu_var(netdev_rx_stat).total++;
-	if (queue->input_pkt_queue.qlen <= netdev_max_backlog) {
-		if (queue->input_pkt_queue.qlen) {
-enqueue:
-			dev_hold(skb->dev);
-			__skb_queue_tail(&queue->input_pkt_queue, skb);
-			local_irq_restore(flags);
-			return NET_RX_SUCCESS;
-		}
-
-		netif_rx_schedule(&queue->backlog_dev);
-		goto enqueue;
-	}
-
-	__get_cpu_var(netdev_rx_stat).dropped++;
-	local_irq_restore(flags);
-
-	kfree_skb(skb);
-	return NET_RX_DROP;
+	preempt_disable();
+#ifdef CONFIG_RPS
+	rcu_read_lock();
+	cpu = get_rps_cpu(skb->dev, skb, &rflow);
+	if (cpu < 0)
+		cpu = smp_processor_id();
+	ret = enqueue_to_backlog(skb, cpu, rflow ? &rflow->last_qtail : NULL);
+	rcu_read_unlock();
+#else
+	cpu = smp_processor_id();
+	ret = enqueue_to_backlog(skb, cpu, NULL);
+#endif
+	preempt_enable();
+	return ret;
 }
 
 int netif_rx_ni(struct sk_buff *skb)
@@ -1454,6 +1787,25 @@ static inline struct net_device *skb_bond(struct sk_buff *skb)
 	return dev;
 }
 
+/* Run the further transmit queues of a scheduled multiqueue device */
+static void net_tx_action_queues(struct net_device *dev)
+{
+	unsigned int i;
+
+	for (i = 1; i < dev->num_tx_queues; i++) {
+		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
+
+		if (!txq->qdisc->q.qlen)
+			continue;
+		if (spin_trylock(&txq->lock)) {
+			qdisc_run_queue(dev, i);
+			spin_unlock(&txq->lock);
+		} else {
+			netif_schedule_subqueue(dev, i);
+		}
+	}
+}
+
 static void net_tx_action(struct softirq_action *h)
 {
 	struct softnet_data *sd = &__get_cpu_var(softnet_data);
@@ -1496,6 +1848,8 @@ static void net_tx_action(struct softirq_action *h)
 			} else {
 				netif_schedule(dev);
 			}
+			if (dev->num_tx_queues > 1)
+				net_tx_action_queues(dev);
 		}
 	}
 }
@@ -1574,7 +1928,7 @@ static int ing_filter(struct sk_buff *skb)
 }
 #endif
 
-int netif_receive_skb(struct sk_buff *skb)
+static int __netif_receive_skb(struct sk_buff *skb)
 {
 	struct packet_type *ptype, *pt_prev;
 	struct net_device *orig_dev;
@@ -1666,6 +2020,194 @@ out:
 	return ret;
 }
 
+static int netif_receive_skb_finish(struct sk_buff *skb)
+{
+#ifdef CONFIG_RPS
+	struct rps_dev_flow *rflow = NULL;
+	int cpu, ret;
+
+	rcu_read_lock();
+	cpu = get_rps_cpu(skb->dev, skb, &rflow);
+	if (cpu >= 0) {
+		/*
+		 * Even when cpu is this one, go through the backlog so
+		 * the packet cannot overtake ones of its flow queued there.
+		 */
+		if (!skb->tstamp.off_sec)
+			net_timestamp(skb);
+		ret = enqueue_to_backlog(skb, cpu,
+					 rflow ? &rflow->last_qtail : NULL);
+		rcu_read_unlock();
+		return ret;
+	}
+	rcu_read_unlock();
+#endif
+	return __netif_receive_skb(skb);
+}
+
+/*
+ * Generic receive offload.  While a device with NETIF_F_GRO is polled,
+ * packets it passes to netif_receive_skb() are offered to the
+ * gro_receive() of their packet_type, which may hold them on the CPU's
+ * gro_list or append their data to a held packet of the same flow.  The
+ * held packets go up the stack as they complete and when the poll
+ * returns, so the stack sees fewer, larger packets.
+ */
+#define GRO_MAX_HELD	8
+
+/**
+ *	skb_gro_receive - append a packet's data to a held packet
+ *	@p: packet held for GRO
+ *	@skb: packet whose headers have been pulled off
+ *
+ *	For gro_receive() handlers, once they have found skb continues @p.
+ *	The caller fixes up the headers of @p.
+ */
+void skb_gro_receive(struct sk_buff *p, struct sk_buff *skb)
+{
+	struct gro_cb *cb = GRO_CB(p);
+
+	if (cb->last == p)
+		skb_shinfo(p)->frag_list = skb;
+	else
+		cb->last->next = skb;
+	cb->last = skb;
+	skb->next = NULL;
+	cb->count++;
+
+	p->len += skb->len;
+	p->data_len += skb->len;
+	p->truesize += skb->truesize;
+}
+
+static void dev_gro_complete(struct sk_buff *p)
+{
+	struct gro_cb *cb = GRO_CB(p);
+
+	p->next = NULL;
+	if (cb->count > 1) {
+		/* The stack wants the size of the segments, see TCP's
+		 * tcp_measure_rcv_mss() */
+		skb_shinfo(p)->tso_size = cb->seg_len;
+		skb_shinfo(p)->tso_segs = cb->count;
+	}
+	memset(p->cb, 0, sizeof(p->cb));
+	netif_receive_skb_finish(p);
+}
+
+static void dev_gro_flush(struct softnet_data *queue)
+{
+	struct sk_buff *p;
+
+	while ((p = queue->gro_list) != NULL) {
+		queue->gro_list = p->next;
+		dev_gro_complete(p);
+	}
+	queue->gro_count = 0;
+}
+
+static int dev_gro_receive(struct softnet_data *queue, struct sk_buff *skb)
+{
+	struct packet_type *ptype;
+	struct sk_buff **pp, *p;
+	unsigned int maclen;
+	int ret = GRO_NORMAL;
+
+	if (skb_shinfo(skb)->frag_list || skb_cloned(skb)) {
+		dev_gro_flush(queue);
+		return GRO_NORMAL;
+	}
+
+	maclen = skb->data - skb->mac.raw;
+	for (p = queue->gro_list; p; p = p->next) {
+		GRO_CB(p)->same_flow = p->dev == skb->dev &&
+				       p->data - p->mac.raw == maclen &&
+				       !memcmp(p->mac.raw, skb->mac.raw, maclen);
+		GRO_CB(p)->flush = 0;
+	}
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ptype, &ptype_base[ntohs(skb->protocol)&15],
+				list) {
+		if (ptype->type == skb->protocol && !ptype->dev &&
+		    ptype->gro_receive) {
+			ret = ptype->gro_receive(&queue->gro_list, skb);
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	/* Deliver the held packets that are complete or must precede skb */
+	pp = &queue->gro_list;
+	while ((p = *pp) != NULL) {
+		if (GRO_CB(p)->flush) {
+			*pp = p->next;
+			queue->gro_count--;
+			dev_gro_complete(p);
+		} else
+			pp = &p->next;
+	}
+
+	if (ret == GRO_HELD) {
+		if (queue->gro_count >= GRO_MAX_HELD) {
+			/* Make room by delivering the oldest */
+			for (pp = &queue->gro_list; (*pp)->next; pp = &(*pp)->next)
+				;
+			p = *pp;
+			*pp = NULL;
+			queue->gro_count--;
+			dev_gro_complete(p);
+		}
+		GRO_CB(skb)->last = skb;
+		GRO_CB(skb)->count = 1;
+		GRO_CB(skb)->flush = 0;
+		skb->next = queue->gro_list;
+		queue->gro_list = skb;
+		queue->gro_count++;
+	}
+	return ret;
+}
+
+/* Poll dev, merging what it receives if it does GRO */
+static int dev_gro_poll(struct net_device *dev, int *budget)
+{
+	struct softnet_data *queue = &__get_cpu_var(softnet_data);
+	int ret;
+
+	/* A bridge port must pass packets on the size they came in */
+	if (!(dev->features & NETIF_F_GRO) || dev->br_port)
+		return dev->poll(dev, budget);
+
+	queue->gro_dev = dev;
+	ret = dev->poll(dev, budget);
+	queue->gro_dev = NULL;
+	dev_gro_flush(queue);
+	return ret;
+}
+
+/**
+ *	netif_receive_skb - process receive buffer from network
+ *	@skb: buffer to process
+ *
+ *	The receive routine for NAPI drivers, called from their poll
+ *	routine: the packet is passed up the protocol layers right away,
+ *	unless GRO holds it to merge with the next packets of its flow or
+ *	receive packet steering sends it to another CPU's backlog.
+ *	Takes the same return values as netif_rx().
+ */
+int netif_receive_skb(struct sk_buff *skb)
+{
+	struct softnet_data *queue = &__get_cpu_var(softnet_data);
+
+	if (queue->gro_dev == skb->dev) {
+		if (!skb->tstamp.off_sec)
+			net_timestamp(skb);
+		if (dev_gro_receive(queue, skb) != GRO_NORMAL)
+			return NET_RX_SUCCESS;
+	}
+	return netif_receive_skb_finish(skb);
+}
+
 static int process_backlog(struct net_device *backlog_dev, int *budget)
 {
 	int work = 0;
@@ -1679,14 +2221,21 @@ static int process_backlog(struct net_device *backlog_dev, int *budget)
 		struct net_device *dev;
 
 		local_irq_disable();
+		rps_lock(queue);
 		skb = __skb_dequeue(&queue->input_pkt_queue);
-		if (!skb)
+		if (!skb) {
+			rps_unlock(queue);
 			goto job_done;
+		}
+#ifdef CONFIG_RPS
+		queue->input_queue_head++;
+#endif
+		rps_unlock(queue);
 		local_irq_enable();
 
 		dev = skb->dev;
 
-		netif_receive_skb(skb);
+		__netif_receive_skb(skb);
 
 		dev_put(dev);
 
@@ -1734,7 +2283,7 @@ static void net_rx_action(struct softirq_action *h)
 				 struct net_device, poll_list);
 		have = netpoll_poll_lock(dev);
 
-		if (dev->quota <= 0 || dev->poll(dev, &budget)) {
+		if (dev->quota <= 0 || dev_gro_poll(dev, &budget)) {
 			netpoll_poll_unlock(have);
 			local_irq_disable();
 			list_del(&dev->poll_list);
@@ -2971,24 +3520,41 @@ out:
 }
 
 /**
- *	alloc_netdev - allocate network device
+ *	alloc_netdev_mq - allocate network device
  *	@sizeof_priv:	size of private data to allocate space for
  *	@name:		device name format string
  *	@setup:		callback to initialize device
+ *	@queue_count:	the number of transmit queues
  *
  *	Allocates a struct net_device with private data area for driver use
- *	and performs basic initialization.
+ *	and performs basic initialization.  A device with more than one
+ *	transmit queue gets queue_count - 1 struct netdev_queue after the
+ *	private area; alloc_netdev() allocates a device with one.
  */
-struct net_device *alloc_netdev(int sizeof_priv, const char *name,
-		void (*setup)(struct net_device *))
+struct net_device *alloc_netdev_mq(int sizeof_priv, const char *name,
+		void (*setup)(struct net_device *), unsigned int queue_count)
 {
 	void *p;
 	struct net_device *dev;
-	int alloc_size;
+	int alloc_size, queue_offset;
+	long align = NETDEV_ALIGN_CONST;
+	unsigned int i;
+
+	BUG_ON(queue_count < 1);
 
 	/* ensure 32-byte alignment of both the device and private area */
 	alloc_size = (sizeof(*dev) + NETDEV_ALIGN_CONST) & ~NETDEV_ALIGN_CONST;
-	alloc_size += sizeof_priv + NETDEV_ALIGN_CONST;
+	alloc_size += (sizeof_priv + NETDEV_ALIGN_CONST) & ~NETDEV_ALIGN_CONST;
+	queue_offset = alloc_size;
+	if (queue_count > 1) {
+		/* the queues are cacheline aligned, so is the device */
+		if (L1_CACHE_BYTES - 1 > align)
+			align = L1_CACHE_BYTES - 1;
+		queue_offset = ALIGN(queue_offset, L1_CACHE_BYTES);
+		alloc_size = queue_offset +
+			     (queue_count - 1) * sizeof(struct netdev_queue);
+	}
+	alloc_size += align;
 
 	p = kmalloc(alloc_size, GFP_KERNEL);
 	if (!p) {
@@ -2997,18 +3563,29 @@ struct net_device *alloc_netdev(int sizeof_priv, const char *name,
 	}
 	memset(p, 0, alloc_size);
 
-	dev = (struct net_device *)
-		(((long)p + NETDEV_ALIGN_CONST) & ~NETDEV_ALIGN_CONST);
+	dev = (struct net_device *) (((long)p + align) & ~align);
 	dev->padded = (char *)dev - (char *)p;
 
 	if (sizeof_priv)
 		dev->priv = netdev_priv(dev);
 
+	dev->num_tx_queues = queue_count;
+	if (queue_count > 1)
+		dev->tx_queues = (struct netdev_queue *)
+			((char *)dev + queue_offset);
+	for (i = 1; i < queue_count; i++) {
+		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
+
+		spin_lock_init(&txq->lock);
+		spin_lock_init(&txq->xmit_lock);
+		txq->xmit_lock_owner = -1;
+	}
+
 	setup(dev);
 	strcpy(dev->name, name);
 	return dev;
 }
-EXPORT_SYMBOL(alloc_netdev);
+EXPORT_SYMBOL(alloc_netdev_mq);
 
 /**
  *	free_netdev - free network device
@@ -3216,6 +3793,7 @@ static int __init net_dev_init(void)
 	BUG_ON(!dev_boot_phase);
 
 	net_random_init();
+	get_random_bytes(&dev_flow_hashrnd, sizeof(dev_flow_hashrnd));
 
 	if (dev_proc_init())
 		goto out;
@@ -3256,6 +3834,9 @@ static int __init net_dev_init(void)
 	open_softirq(NET_RX_SOFTIRQ, net_rx_action, NULL);
 
 	hotcpu_notifier(dev_cpu_callback, 0);
+#ifdef CONFIG_RPS
+	rps_init();
+#endif
 	dst_init();
 	dev_mcast_init();
 	rc = 0;
@@ -3289,6 +3870,7 @@ EXPORT_SYMBOL(netdev_boot_setup_check);
 EXPORT_SYMBOL(netdev_set_master);
 EXPORT_SYMBOL(netdev_state_change);
 EXPORT_SYMBOL(netif_receive_skb);
+EXPORT_SYMBOL(skb_gro_receive);
 EXPORT_SYMBOL(netif_rx);
 EXPORT_SYMBOL(register_gifconf);
 EXPORT_SYMBOL(register_netdevice);
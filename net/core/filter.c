@@ -276,6 +276,51 @@ load_b:
 	return 0;
 }
 
+#ifdef CONFIG_BPF_JIT
+/**
+ *	bpf_jit_load - load packet data for JIT compiled filter code
+ *	@skb: buffer the filter runs on
+ *	@k: offset to load from, as sk_run_filter computes it
+ *	@size: bytes to load, 1, 2 or 4
+ *	@res: where to store the loaded value
+ *
+ * Slow path of the packet loads in code made by bpf_jit_compile(), for
+ * data outside the linear part of the skb, negative offsets and
+ * ancillary data.  Loads exactly what sk_run_filter would.  Returns 0,
+ * or -1 if the filter must return 0.
+ */
+asmlinkage int bpf_jit_load(struct sk_buff *skb, int k, unsigned int size,
+			    u32 *res)
+{
+	void *ptr;
+	u32 tmp;
+
+	ptr = load_pointer(skb, k, size, &tmp);
+	if (ptr != NULL) {
+		if (size == 4)
+			*res = ntohl(*(u32 *)ptr);
+		else if (size == 2)
+			*res = ntohs(*(u16 *)ptr);
+		else
+			*res = *(u8 *)ptr;
+		return 0;
+	}
+
+	switch (k-SKF_AD_OFF) {
+	case SKF_AD_PROTOCOL:
+		*res = htons(skb->protocol);
+		return 0;
+	case SKF_AD_PKTTYPE:
+		*res = skb->pkt_type;
+		return 0;
+	case SKF_AD_IFINDEX:
+		*res = skb->dev->ifindex;
+		return 0;
+	}
+	return -1;
+}
+#endif
+
 /**
  *	sk_chk_filter - verify socket filter code
  *	@filter: filter to verify
@@ -394,7 +439,8 @@ int sk_chk_filter(struct sock_filter *filter, int flen)
  * Attach the user's filter code. We first run some sanity checks on
  * it to make sure it does not explode on us later. If an error
  * occurs or there is insufficient memory for the filter a negative
- * errno code is returned. On success the return is zero.
+ * errno code is returned. On success the return is zero.  The filter
+ * is compiled to native code if the architecture has a JIT for it.
  */
 int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 {
@@ -416,11 +462,14 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 
 	atomic_set(&fp->refcnt, 1);
 	fp->len = fprog->len;
+	fp->bpf_func = sk_run_filter;
 
 	err = sk_chk_filter(fp->insns, fp->len);
 	if (!err) {
 		struct sk_filter *old_fp;
 
+		bpf_jit_compile(fp);
+
 		spin_lock_bh(&sk->sk_lock.slock);
 		old_fp = sk->sk_filter;
 		sk->sk_filter = fp;
@@ -17,6 +17,7 @@
 #include <net/sock.h>
 #include <linux/rtnetlink.h>
 #include <linux/wireless.h>
+#include <linux/vmalloc.h>
 #include <net/iw_handler.h>
 
 #define to_class_dev(obj) container_of(obj,struct class_device,kobj)
@@ -184,6 +185,145 @@ static ssize_t store_weight(struct class_device *dev, const char *buf, size_t le
 	return netdev_store(dev, buf, len, change_weight);
 }
 
+#ifdef CONFIG_RPS
+/*
+ * rps_cpus: the CPUs received packets are spread over, as a list like
+ * "0-3,6"; empty turns receive packet steering off.
+ */
+static ssize_t show_rps_cpus(struct class_device *dev, char *buf)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_map *map;
+	cpumask_t mask;
+	int i, len;
+
+	cpus_clear(mask);
+	rcu_read_lock();
+	map = rcu_dereference(net->rps_map);
+	if (map)
+		for (i = 0; i < map->len; i++)
+			cpu_set(map->cpus[i], mask);
+	rcu_read_unlock();
+
+	len = cpulist_scnprintf(buf, PAGE_SIZE - 1, mask);
+	buf[len++] = '\n';
+	return len;
+}
+
+static ssize_t store_rps_cpus(struct class_device *dev, const char *buf,
+			      size_t len)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_map *map, *old_map;
+	cpumask_t mask;
+	int cpu, i, err;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (*buf == '\0' || *buf == '\n')
+		cpus_clear(mask);
+	else if ((err = cpulist_parse(buf, mask)))
+		return err;
+	cpus_and(mask, mask, cpu_possible_map);
+
+	map = NULL;
+	if (!cpus_empty(mask)) {
+		map = kmalloc(sizeof(*map) + cpus_weight(mask) * sizeof(u16),
+			      GFP_KERNEL);
+		if (!map)
+			return -ENOMEM;
+		i = 0;
+		for_each_cpu_mask(cpu, mask)
+			map->cpus[i++] = cpu;
+		map->len = i;
+	}
+
+	rtnl_lock();
+	if (!dev_isalive(net)) {
+		rtnl_unlock();
+		kfree(map);
+		return -EINVAL;
+	}
+	old_map = net->rps_map;
+	rcu_assign_pointer(net->rps_map, map);
+	rtnl_unlock();
+
+	if (old_map) {
+		synchronize_rcu();
+		kfree(old_map);
+	}
+	return len;
+}
+
+/*
+ * rps_flow_cnt: buckets in the table that steers flows to the CPU their
+ * socket is used on, rounded up to a power of two; 0 turns it off.
+ */
+static ssize_t show_rps_flow_cnt(struct class_device *dev, char *buf)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_dev_flow_table *table;
+	unsigned long count = 0;
+
+	rcu_read_lock();
+	table = rcu_dereference(net->rps_flow_table);
+	if (table)
+		count = table->mask + 1;
+	rcu_read_unlock();
+
+	return sprintf(buf, fmt_ulong, count);
+}
+
+static ssize_t store_rps_flow_cnt(struct class_device *dev, const char *buf,
+				  size_t len)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_dev_flow_table *table, *old_table;
+	unsigned long count, i;
+	char *endp;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	count = simple_strtoul(buf, &endp, 0);
+	if (endp == buf)
+		return -EINVAL;
+
+	table = NULL;
+	if (count) {
+		if (count > 1UL << 24)
+			return -EINVAL;
+		count = roundup_pow_of_two(count);
+		table = vmalloc(sizeof(*table) +
+				count * sizeof(struct rps_dev_flow));
+		if (!table)
+			return -ENOMEM;
+		table->mask = count - 1;
+		for (i = 0; i < count; i++) {
+			table->flows[i].cpu = RPS_NO_CPU;
+			table->flows[i].last_qtail = 0;
+		}
+	}
+
+	rtnl_lock();
+	if (!dev_isalive(net)) {
+		rtnl_unlock();
+		vfree(table);
+		return -EINVAL;
+	}
+	old_table = net->rps_flow_table;
+	rcu_assign_pointer(net->rps_flow_table, table);
+	rtnl_unlock();
+
+	if (old_table) {
+		synchronize_rcu();
+		vfree(old_table);
+	}
+	return len;
+}
+#endif /* CONFIG_RPS */
+
 static struct class_device_attribute net_class_attributes[] = {
 	__ATTR(addr_len, S_IRUGO, show_addr_len, NULL),
 	__ATTR(iflink, S_IRUGO, show_iflink, NULL),
@@ -198,6 +338,11 @@ static struct class_device_attribute net_class_attributes[] = {
 	__ATTR(tx_queue_len, S_IRUGO | S_IWUSR, show_tx_queue_len,
 	       store_tx_queue_len),
 	__ATTR(weight, S_IRUGO | S_IWUSR, show_weight, store_weight),
+#ifdef CONFIG_RPS
+	__ATTR(rps_cpus, S_IRUGO | S_IWUSR, show_rps_cpus, store_rps_cpus),
+	__ATTR(rps_flow_cnt, S_IRUGO | S_IWUSR, show_rps_flow_cnt,
+	       store_rps_flow_cnt),
+#endif
 	{}
 };
 
@@ -390,6 +535,10 @@ static void netdev_release(struct class_device *cd)
 
 	BUG_ON(dev->reg_state != NETREG_RELEASED);
 
+#ifdef CONFIG_RPS
+	kfree(dev->rps_map);
+	vfree(dev->rps_flow_table);
+#endif
 	kfree((char *)dev - dev->padded);
 }
 
@@ -171,6 +171,8 @@
 #define F_MACDST_RND  (1<<5)  /* MAC-Dst Random */
 #define F_TXSIZE_RND  (1<<6)  /* Transmit size is random */
 #define F_IPV6        (1<<7)  /* Interface in IPV6 Mode */
+#define F_QUEUE_MAP_RND (1<<8)  /* Transmit queue is random */
+#define F_QUEUE_MAP_CPU (1<<9)  /* Transmit queue is the thread's cpu */
 
 /* Thread control flag bits */
 #define T_TERMINATE   (1<<0)  
@@ -291,6 +293,9 @@ struct pktgen_dev {
         __u32 cur_daddr;
         __u16 cur_udp_dst;
         __u16 cur_udp_src;
+        __u16 queue_map_min; /* inclusive, transmit queue */
+        __u16 queue_map_max; /* inclusive, transmit queue */
+        __u16 cur_queue_map;
         __u32 cur_pkt_size;
         
         __u8 hh[14];
@@ -481,7 +486,6 @@ static void pktgen_stop_all_threads_ifs(void);
 static int pktgen_stop_device(struct pktgen_dev *pkt_dev);
 static void pktgen_stop(struct pktgen_thread* t);
 static void pktgen_clear_counters(struct pktgen_dev *pkt_dev);
-static struct pktgen_dev *pktgen_NN_threads(const char* dev_name, int remove);
 static unsigned int scan_ip6(const char *s,char ip[16]);
 static unsigned int fmt_ip6(char *s,const char ip[16]);
 
@@ -610,6 +614,9 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 		   pkt_dev->udp_src_min, pkt_dev->udp_src_max, pkt_dev->udp_dst_min,
 		   pkt_dev->udp_dst_max);
 
+        seq_printf(seq,  "     queue_map_min: %u  queue_map_max: %u\n",
+		   pkt_dev->queue_map_min, pkt_dev->queue_map_max);
+
         seq_printf(seq,  "     src_mac_count: %d  dst_mac_count: %d \n     Flags: ",
 		   pkt_dev->src_mac_count, pkt_dev->dst_mac_count);
 
@@ -638,6 +645,12 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
         if (pkt_dev->flags & F_MACDST_RND) 
                 seq_printf(seq,  "MACDST_RND  ");
 
+        if (pkt_dev->flags & F_QUEUE_MAP_RND) 
+                seq_printf(seq,  "QUEUE_MAP_RND  ");
+
+        if (pkt_dev->flags & F_QUEUE_MAP_CPU) 
+                seq_printf(seq,  "QUEUE_MAP_CPU  ");
+
         
         seq_puts(seq,  "\n");
         
@@ -922,6 +935,22 @@ static ssize_t pktgen_if_write(struct file *file, const char __user *user_buffer
 		sprintf(pg_result, "OK: udp_dst_max=%u", pkt_dev->udp_dst_max);
 		return count;
 	}
+	if (!strcmp(name, "queue_map_min")) {
+		len = num_arg(&user_buffer[i], 5, &value);
+                if (len < 0) { return len; }
+		i += len;
+		pkt_dev->queue_map_min = value;
+		sprintf(pg_result, "OK: queue_map_min=%u", pkt_dev->queue_map_min);
+		return count;
+	}
+	if (!strcmp(name, "queue_map_max")) {
+		len = num_arg(&user_buffer[i], 5, &value);
+                if (len < 0) { return len; }
+		i += len;
+		pkt_dev->queue_map_max = value;
+		sprintf(pg_result, "OK: queue_map_max=%u", pkt_dev->queue_map_max);
+		return count;
+	}
 	if (!strcmp(name, "clone_skb")) {
 		len = num_arg(&user_buffer[i], 10, &value);
                 if (len < 0) { return len; }
@@ -1012,10 +1041,22 @@ static ssize_t pktgen_if_write(struct file *file, const char __user *user_buffer
                 else if (strcmp(f, "!MACDST_RND") == 0) 
                         pkt_dev->flags &= ~F_MACDST_RND;
                 
+                else if (strcmp(f, "QUEUE_MAP_RND") == 0) 
+                        pkt_dev->flags |= F_QUEUE_MAP_RND;
+                
+                else if (strcmp(f, "!QUEUE_MAP_RND") == 0) 
+                        pkt_dev->flags &= ~F_QUEUE_MAP_RND;
+                
+                else if (strcmp(f, "QUEUE_MAP_CPU") == 0) 
+                        pkt_dev->flags |= F_QUEUE_MAP_CPU;
+                
+                else if (strcmp(f, "!QUEUE_MAP_CPU") == 0) 
+                        pkt_dev->flags &= ~F_QUEUE_MAP_CPU;
+                
                 else {
                         sprintf(pg_result, "Flag -:%s:- unknown\nAvailable flags, (prepend ! to un-set flag):\n%s",
                                 f,
-                                "IPSRC_RND, IPDST_RND, TXSIZE_RND, UDPSRC_RND, UDPDST_RND, MACSRC_RND, MACDST_RND\n");
+                                "IPSRC_RND, IPDST_RND, TXSIZE_RND, UDPSRC_RND, UDPDST_RND, MACSRC_RND, MACDST_RND, QUEUE_MAP_RND, QUEUE_MAP_CPU\n");
                         return count;
                 }
 		sprintf(pg_result, "OK: flags=0x%x", pkt_dev->flags);
@@ -1467,13 +1508,26 @@ static struct pktgen_dev *__pktgen_NN_threads(const char* ifname, int remove)
         return pkt_dev;
 }
 
-static struct pktgen_dev *pktgen_NN_threads(const char* ifname, int remove) 
+/* Remove all the pktgen_devs sending on dev, "eth0" as well as "eth0@1" */
+static void pktgen_remove_odev(struct net_device *dev)
 {
-	struct pktgen_dev *pkt_dev = NULL;
+	struct pktgen_thread *t;
+	struct pktgen_dev *pkt_dev;
+
 	thread_lock();
-	pkt_dev = __pktgen_NN_threads(ifname, remove);
-        thread_unlock();
-	return pkt_dev;
+restart:
+	for (t = pktgen_threads; t; t = t->next) {
+		if_lock(t);
+		for (pkt_dev = t->if_list; pkt_dev; pkt_dev = pkt_dev->next) {
+			if (pkt_dev->odev == dev) {
+				pktgen_remove_device(t, pkt_dev);
+				if_unlock(t);
+				goto restart;
+			}
+		}
+		if_unlock(t);
+	}
+	thread_unlock();
 }
 
 static int pktgen_device_event(struct notifier_block *unused, unsigned long event, void *ptr) 
@@ -1493,7 +1547,7 @@ static int pktgen_device_event(struct notifier_block *unused, unsigned long even
 		break;
 		
 	case NETDEV_UNREGISTER:
-                pktgen_NN_threads(dev->name, REMOVE);
+		pktgen_remove_odev(dev);
 		break;
 	};
 
@@ -1504,6 +1558,8 @@ static int pktgen_device_event(struct notifier_block *unused, unsigned long even
 
 static struct net_device* pktgen_setup_dev(struct pktgen_dev *pkt_dev) {
 	struct net_device *odev;
+	char b[IFNAMSIZ];
+	int i;
 
 	/* Clean old setups */
 
@@ -1512,7 +1568,13 @@ static struct net_device* pktgen_setup_dev(struct pktgen_dev *pkt_dev) {
                 pkt_dev->odev = NULL;
         }
 
-	odev = dev_get_by_name(pkt_dev->ifname);
+	/* Several threads may send on one device as "eth0@0", "eth0@1" ... */
+	for (i = 0; i < IFNAMSIZ - 1 && pkt_dev->ifname[i] &&
+		    pkt_dev->ifname[i] != '@'; i++)
+		b[i] = pkt_dev->ifname[i];
+	b[i] = '\0';
+
+	odev = dev_get_by_name(b);
 
 	if (!odev) {
 		printk("pktgen: no such netdevice: \"%s\"\n", pkt_dev->ifname);
@@ -1841,6 +1903,30 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev) {
                 pkt_dev->cur_pkt_size = t;
         }
 
+	/* Transmit queue of a multiqueue device */
+	if (pkt_dev->flags & F_QUEUE_MAP_CPU)
+		pkt_dev->cur_queue_map = smp_processor_id();
+	else if (pkt_dev->queue_map_min < pkt_dev->queue_map_max) {
+		__u16 t;
+		if (pkt_dev->flags & F_QUEUE_MAP_RND) {
+			t = ((pktgen_random() % (pkt_dev->queue_map_max - pkt_dev->queue_map_min + 1))
+			     + pkt_dev->queue_map_min);
+		}
+		else {
+			t = pkt_dev->cur_queue_map + 1;
+			if (t > pkt_dev->queue_map_max)
+				t = pkt_dev->queue_map_min;
+		}
+		pkt_dev->cur_queue_map = t;
+	}
+	else
+		pkt_dev->cur_queue_map = pkt_dev->queue_map_min;
+
+	if (pkt_dev->odev->num_tx_queues > 1)
+		pkt_dev->cur_queue_map %= pkt_dev->odev->num_tx_queues;
+	else
+		pkt_dev->cur_queue_map = 0;
+
 	pkt_dev->flows[flow].count++;
 }
 
@@ -1902,6 +1988,7 @@ static struct sk_buff *fill_packet_ipv4(struct net_device *odev,
 	skb->mac.raw = ((u8 *)iph) - 14;
 	skb->dev = odev;
 	skb->pkt_type = PACKET_HOST;
+	skb->queue_mapping = pkt_dev->cur_queue_map;
 
 	if (pkt_dev->nfrags <= 0) 
                 pgh = (struct pktgen_hdr *)skb_put(skb, datalen);
@@ -2177,6 +2264,7 @@ static struct sk_buff *fill_packet_ipv6(struct net_device *odev,
 	skb->protocol = __constant_htons(ETH_P_IPV6);
 	skb->dev = odev;
 	skb->pkt_type = PACKET_HOST;
+	skb->queue_mapping = pkt_dev->cur_queue_map;
 
 	if (pkt_dev->nfrags <= 0) 
                 pgh = (struct pktgen_hdr *)skb_put(skb, datalen);
@@ -2523,7 +2611,9 @@ static void pktgen_rem_thread(struct pktgen_thread *t)
 static __inline__ void pktgen_xmit(struct pktgen_dev *pkt_dev)
 {
 	struct net_device *odev = NULL;
+	spinlock_t *xmit_lock;
 	__u64 idle_start = 0;
+	__u16 queue_map;
 	int ret;
 
 	odev = pkt_dev->odev;
@@ -2545,7 +2635,8 @@ static __inline__ void pktgen_xmit(struct pktgen_dev *pkt_dev)
 		}
 	}
 	
-	if (netif_queue_stopped(odev) || need_resched()) {
+	queue_map = pkt_dev->cur_queue_map;
+	if (netif_subqueue_stopped(odev, queue_map) || need_resched()) {
 		idle_start = getCurUs();
 		
 		if (!netif_running(odev)) {
@@ -2557,7 +2648,7 @@ static __inline__ void pktgen_xmit(struct pktgen_dev *pkt_dev)
 		
 		pkt_dev->idle_acc += getCurUs() - idle_start;
 		
-		if (netif_queue_stopped(odev)) {
+		if (netif_subqueue_stopped(odev, queue_map)) {
 			pkt_dev->next_tx_us = getCurUs(); /* TODO */
 			pkt_dev->next_tx_ns = 0;
 			goto out; /* Try the next interface */
@@ -2582,8 +2673,10 @@ static __inline__ void pktgen_xmit(struct pktgen_dev *pkt_dev)
 		}
 	}
 	
-	spin_lock_bh(&odev->xmit_lock);
-	if (!netif_queue_stopped(odev)) {
+	queue_map = pkt_dev->skb->queue_mapping;
+	xmit_lock = netif_tx_queue_lock(odev, queue_map);
+	spin_lock_bh(xmit_lock);
+	if (!netif_subqueue_stopped(odev, queue_map)) {
 
 		atomic_inc(&(pkt_dev->skb->users));
 retry_now:
@@ -2627,7 +2720,7 @@ retry_now:
 		pkt_dev->next_tx_ns = 0;
         }
 
-	spin_unlock_bh(&odev->xmit_lock);
+	spin_unlock_bh(xmit_lock);
 	
 	/* If pkt_dev->count is zero, then run forever */
 	if ((pkt_dev->count != 0) && (pkt_dev->sofar >= pkt_dev->count)) {
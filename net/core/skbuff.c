@@ -169,6 +169,7 @@ struct sk_buff *__alloc_skb(unsigned int size, gfp_t gfp_mask,
 	shinfo->ufo_size = 0;
 	shinfo->ip6_frag_id = 0;
 	shinfo->frag_list = NULL;
+	shinfo->destructor_arg = NULL;
 
 	if (fclone) {
 		struct sk_buff *child = skb + 1;
@@ -233,6 +234,7 @@ struct sk_buff *alloc_skb_from_cache(kmem_cache_t *cp,
 	skb_shinfo(skb)->tso_size = 0;
 	skb_shinfo(skb)->tso_segs = 0;
 	skb_shinfo(skb)->frag_list = NULL;
+	skb_shinfo(skb)->destructor_arg = NULL;
 out:
 	return skb;
 nodata:
@@ -412,6 +414,8 @@ struct sk_buff *skb_clone(struct sk_buff *skb, gfp_t gfp_mask)
 	C(ip_summed);
 	C(priority);
 	C(protocol);
+	C(queue_mapping);
+	C(rxhash);
 	n->destructor = NULL;
 #ifdef CONFIG_NETFILTER
 	C(nfmark);
@@ -468,6 +472,8 @@ static void copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 	new->dev	= old->dev;
 	new->priority	= old->priority;
 	new->protocol	= old->protocol;
+	new->queue_mapping = old->queue_mapping;
+	new->rxhash	= old->rxhash;
 	new->dst	= dst_clone(old->dst);
 #ifdef CONFIG_INET
 	new->sp		= secpath_get(old->sp);
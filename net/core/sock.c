@@ -1392,6 +1392,7 @@ int sock_common_recvmsg(struct kiocb *iocb, struct socket *sock,
 	int addr_len = 0;
 	int err;
 
+	sock_rps_record_flow(sk);
 	err = sk->sk_prot->recvmsg(iocb, sk, msg, size, flags & MSG_DONTWAIT,
 				   flags & ~MSG_DONTWAIT, &addr_len);
 	if (err >= 0)
@@ -10,6 +10,9 @@
 #include <linux/config.h>
 #include <linux/module.h>
 #include <linux/socket.h>
+#include <linux/netdevice.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
 #include <net/sock.h>
 
 #ifdef CONFIG_SYSCTL
@@ -26,6 +29,67 @@ extern int sysctl_core_destroy_delay;
 extern char sysctl_divert_version[];
 #endif /* CONFIG_NET_DIVERT */
 
+#ifdef CONFIG_RPS
+/*
+ * Size rps_sock_flow_table, rounding up to a power of two; 0 frees it,
+ * which stops flows being steered to the CPU their socket is used on.
+ */
+static int rps_sock_flow_sysctl(ctl_table *table, int write,
+				struct file *filp, void __user *buffer,
+				size_t *lenp, loff_t *ppos)
+{
+	static DEFINE_MUTEX(sock_flow_mutex);
+	struct rps_sock_flow_table *orig_sock_table, *sock_table;
+	int size, orig_size, ret, i;
+	ctl_table tmp = {
+		.data		= &size,
+		.maxlen		= sizeof(size),
+		.mode		= table->mode
+	};
+
+	mutex_lock(&sock_flow_mutex);
+
+	orig_sock_table = rps_sock_flow_table;
+	size = orig_size = orig_sock_table ? orig_sock_table->mask + 1 : 0;
+
+	ret = proc_dointvec(&tmp, write, filp, buffer, lenp, ppos);
+	if (!write || ret)
+		goto out;
+
+	if (size < 0 || size > 1 << 24) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	sock_table = NULL;
+	if (size) {
+		size = roundup_pow_of_two(size);
+		if (size != orig_size) {
+			sock_table = vmalloc(sizeof(*sock_table) +
+					     size * sizeof(u16));
+			if (!sock_table) {
+				ret = -ENOMEM;
+				goto out;
+			}
+			sock_table->mask = size - 1;
+		} else
+			sock_table = orig_sock_table;
+
+		for (i = 0; i < size; i++)
+			sock_table->ents[i] = RPS_NO_CPU;
+	}
+
+	if (sock_table != orig_sock_table) {
+		rcu_assign_pointer(rps_sock_flow_table, sock_table);
+		synchronize_rcu();
+		vfree(orig_sock_table);
+	}
+out:
+	mutex_unlock(&sock_flow_mutex);
+	return ret;
+}
+#endif /* CONFIG_RPS */
+
 ctl_table core_table[] = {
 #ifdef CONFIG_NET
 	{
@@ -128,6 +192,25 @@ ctl_table core_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dointvec
 	},
+#ifdef CONFIG_RPS
+	{
+		.ctl_name	= NET_CORE_RPS_SOCK_FLOW_ENTRIES,
+		.procname	= "rps_sock_flow_entries",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &rps_sock_flow_sysctl
+	},
+#endif
+#ifdef CONFIG_BPF_JIT
+	{
+		.ctl_name	= NET_CORE_BPF_JIT_ENABLE,
+		.procname	= "bpf_jit_enable",
+		.data		= &bpf_jit_enable,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec
+	},
+#endif
 	{ .ctl_name = 0 }
 };
 
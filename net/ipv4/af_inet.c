@@ -659,6 +659,8 @@ int inet_sendmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *msg,
 {
 	struct sock *sk = sock->sk;
 
+	sock_rps_record_flow(sk);
+
 	/* We may need to bind the socket. */
 	if (!inet_sk(sk)->num && inet_autobind(sk))
 		return -EAGAIN;
@@ -1135,9 +1137,46 @@ static int ipv4_proc_init(void);
  *	IP protocol layer initialiser
  */
 
+/*
+ * GRO for IPv4: only unfragmented TCP without IP options, whose checksum
+ * the device has checked, is merged.  Not while forwarding, as forwarded
+ * packets must leave in the sizes they came in.
+ */
+static int inet_gro_receive(struct sk_buff **head, struct sk_buff *skb)
+{
+	struct in_device *in_dev;
+	struct iphdr *iph, *iph2;
+	struct sk_buff *p;
+
+	if (skb_headlen(skb) < sizeof(struct iphdr))
+		return GRO_NORMAL;
+	iph = (struct iphdr *) skb->data;
+
+	in_dev = __in_dev_get_rcu(skb->dev);
+	if (in_dev && !IN_DEV_FORWARD(in_dev) &&
+	    skb->ip_summed == CHECKSUM_UNNECESSARY &&
+	    iph->version == 4 && iph->ihl == 5 &&
+	    iph->protocol == IPPROTO_TCP &&
+	    !(iph->frag_off & htons(IP_MF | IP_OFFSET)) &&
+	    ntohs(iph->tot_len) == skb->len &&
+	    skb_headlen(skb) >= sizeof(struct iphdr) + sizeof(struct tcphdr) &&
+	    !ip_fast_csum((u8 *) iph, 5))
+		return tcp4_gro_receive(head, skb);
+
+	/* Held packets between the same hosts go up before skb */
+	for (p = *head; p; p = p->next) {
+		iph2 = (struct iphdr *) p->data;
+		if (GRO_CB(p)->same_flow && iph->saddr == iph2->saddr &&
+		    iph->daddr == iph2->daddr)
+			GRO_CB(p)->flush = 1;
+	}
+	return GRO_NORMAL;
+}
+
 static struct packet_type ip_packet_type = {
 	.type = __constant_htons(ETH_P_IP),
 	.func = ip_rcv,
+	.gro_receive = inet_gro_receive,
 };
 
 static int __init inet_init(void)
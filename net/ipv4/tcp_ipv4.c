@@ -980,6 +980,7 @@ static int tcp_v4_checksum_init(struct sk_buff *skb)
 int tcp_v4_do_rcv(struct sock *sk, struct sk_buff *skb)
 {
 	if (sk->sk_state == TCP_ESTABLISHED) { /* Fast path */
+		sock_rps_save_rxhash(sk, skb);
 		TCP_CHECK_TIMER(sk);
 		if (tcp_rcv_established(sk, skb, skb->h.th, skb->len))
 			goto reset;
@@ -1024,6 +1025,77 @@ csum_err:
 	goto discard;
 }
 
+/*
+ * GRO for TCP, from inet_gro_receive() with the IPv4 header at skb->data
+ * checked and room for a TCP header behind it.  A segment that carries
+ * the next data of a held packet of its flow, and nothing else, has its
+ * data appended to it.  One that could start such a run is held.  Any
+ * other goes up the stack, after the held packet of its flow.
+ */
+int tcp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
+{
+	const u32 mask = TCP_FLAG_CWR | TCP_FLAG_ECE | TCP_FLAG_URG |
+			 TCP_FLAG_ACK | TCP_FLAG_PSH | TCP_FLAG_RST |
+			 TCP_FLAG_SYN | TCP_FLAG_FIN;
+	struct iphdr *iph = (struct iphdr *) skb->data, *iph2;
+	struct tcphdr *th = (struct tcphdr *) (iph + 1), *th2 = NULL;
+	unsigned int thlen = th->doff * 4, len, len2;
+	struct sk_buff *p;
+	u32 flags = tcp_flag_word(th) & mask;
+	int data;
+
+	for (p = *head; p; p = p->next) {
+		if (!GRO_CB(p)->same_flow)
+			continue;
+		iph2 = (struct iphdr *) p->data;
+		th2 = (struct tcphdr *) (iph2 + 1);
+		if (iph->saddr == iph2->saddr && iph->daddr == iph2->daddr &&
+		    th->source == th2->source && th->dest == th2->dest)
+			break;
+	}
+
+	len = skb->len - sizeof(struct iphdr) - thlen;
+	data = thlen >= sizeof(struct tcphdr) &&
+	       skb_headlen(skb) >= sizeof(struct iphdr) + thlen &&
+	       skb->len > sizeof(struct iphdr) + thlen &&
+	       (flags & ~TCP_FLAG_PSH) == TCP_FLAG_ACK;
+
+	if (p) {
+		iph2 = (struct iphdr *) p->data;
+		len2 = p->len - sizeof(struct iphdr) - th2->doff * 4;
+
+		if (data && th->doff == th2->doff &&
+		    ntohl(th->seq) == ntohl(th2->seq) + len2 &&
+		    th->ack_seq == th2->ack_seq &&
+		    th->window == th2->window &&
+		    !memcmp(th + 1, th2 + 1, thlen - sizeof(struct tcphdr)) &&
+		    iph->tos == iph2->tos && iph->ttl == iph2->ttl &&
+		    iph->frag_off == iph2->frag_off &&
+		    len <= GRO_CB(p)->seg_len && p->len + len <= 65535) {
+			skb_pull(skb, sizeof(struct iphdr) + thlen);
+			skb_gro_receive(p, skb);
+
+			iph2->tot_len = htons(p->len);
+			iph2->check = 0;
+			iph2->check = ip_fast_csum((u8 *) iph2, iph2->ihl);
+
+			/* A push or a short segment ends the run */
+			if (flags & TCP_FLAG_PSH) {
+				th2->psh = 1;
+				GRO_CB(p)->flush = 1;
+			} else if (len < GRO_CB(p)->seg_len)
+				GRO_CB(p)->flush = 1;
+			return GRO_MERGED;
+		}
+		GRO_CB(p)->flush = 1;
+	}
+
+	if (!data || (flags & TCP_FLAG_PSH))
+		return GRO_NORMAL;
+	GRO_CB(skb)->seg_len = len;
+	return GRO_HELD;
+}
+
 /*
  *	From tcp_input.c
  */
@@ -60,6 +60,7 @@
 #include <linux/inet.h>
 #include <linux/netdevice.h>
 #include <linux/if_packet.h>
+#include <linux/if_vlan.h>
 #include <linux/wireless.h>
 #include <linux/kmod.h>
 #include <net/ip.h>
@@ -181,7 +182,23 @@ struct packet_mreq_max
 };
 #endif
 #ifdef CONFIG_PACKET_MMAP
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing);
+static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
+			   int closing, int tx_ring);
+
+/* One mmap()ed ring of frames, for either direction. */
+struct packet_ring {
+	char *			*pg_vec;
+	unsigned int		head;
+	unsigned int		frames_per_block;
+	unsigned int		frame_size;
+	unsigned int		frame_max;
+
+	unsigned int		pg_vec_order;
+	unsigned int		pg_vec_pages;
+	unsigned int		pg_vec_len;
+
+	atomic_t		pending;	/* tx frames still in an skb */
+};
 #endif
 
 static void packet_flush_mclist(struct sock *sk);
@@ -191,11 +208,8 @@ struct packet_sock {
 	struct sock		sk;
 	struct tpacket_stats	stats;
 #ifdef CONFIG_PACKET_MMAP
-	char *			*pg_vec;
-	unsigned int		head;
-	unsigned int            frames_per_block;
-	unsigned int		frame_size;
-	unsigned int		frame_max;
+	struct packet_ring	rx_ring;
+	struct packet_ring	tx_ring;	/* mapped right after rx_ring */
 	int			copy_thresh;
 #endif
 	struct packet_type	prot_hook;
@@ -208,26 +222,76 @@ struct packet_sock {
 #endif
 #ifdef CONFIG_PACKET_MMAP
 	atomic_t		mapped;
-	unsigned int            pg_vec_order;
-	unsigned int		pg_vec_pages;
-	unsigned int		pg_vec_len;
+	enum tpacket_versions	tp_version;
+	unsigned int		tp_hdrlen;
 #endif
 };
 
 #ifdef CONFIG_PACKET_MMAP
 
-static inline char *packet_lookup_frame(struct packet_sock *po, unsigned int position)
+union tpacket_uhdr {
+	struct tpacket_hdr	*h1;
+	struct tpacket2_hdr	*h2;
+	void			*raw;
+};
+
+static void __packet_set_status(struct packet_sock *po, void *frame, int status)
+{
+	union tpacket_uhdr h;
+
+	h.raw = frame;
+	switch (po->tp_version) {
+	case TPACKET_V1:
+		h.h1->tp_status = status;
+		break;
+	case TPACKET_V2:
+		h.h2->tp_status = status;
+		break;
+	}
+	flush_dcache_page(virt_to_page(frame));
+}
+
+static int __packet_get_status(struct packet_sock *po, void *frame)
+{
+	union tpacket_uhdr h;
+
+	h.raw = frame;
+	flush_dcache_page(virt_to_page(frame));
+	switch (po->tp_version) {
+	case TPACKET_V2:
+		return h.h2->tp_status;
+	default:
+		return h.h1->tp_status;
+	}
+}
+
+/* The frame at position, or NULL if its status is not the one asked for. */
+static void *packet_lookup_frame(struct packet_sock *po, struct packet_ring *rb,
+				 unsigned int position, int status)
 {
 	unsigned int pg_vec_pos, frame_offset;
 	char *frame;
 
-	pg_vec_pos = position / po->frames_per_block;
-	frame_offset = position % po->frames_per_block;
+	pg_vec_pos = position / rb->frames_per_block;
+	frame_offset = position % rb->frames_per_block;
 
-	frame = po->pg_vec[pg_vec_pos] + (frame_offset * po->frame_size);
-	
+	frame = rb->pg_vec[pg_vec_pos] + (frame_offset * rb->frame_size);
+
+	if (__packet_get_status(po, frame) != status)
+		return NULL;
 	return frame;
 }
+
+static inline void *packet_current_frame(struct packet_sock *po,
+					 struct packet_ring *rb, int status)
+{
+	return packet_lookup_frame(po, rb, rb->head, status);
+}
+
+static inline void packet_increment_head(struct packet_ring *rb)
+{
+	rb->head = rb->head != rb->frame_max ? rb->head+1 : 0;
+}
 #endif
 
 static inline struct packet_sock *pkt_sk(struct sock *sk)
@@ -439,7 +503,7 @@ static inline unsigned run_filter(struct sk_buff *skb, struct sock *sk, unsigned
 	 * verify that under bh_lock_sock() to be safe
 	 */
 	if (likely(filter != NULL))
-		res = sk_run_filter(skb, filter->insns, filter->len);
+		res = SK_RUN_FILTER(filter, skb);
 	bh_unlock_sock(sk);
 
 	return res;
@@ -562,18 +626,33 @@ drop:
 }
 
 #ifdef CONFIG_PACKET_MMAP
+/*
+ * The 802.1Q tag of a frame whose tag is not in the frame data: either
+ * one the card will insert on the way out, or one already stripped off,
+ * by the card or by the VLAN code, when we see it on the VLAN device.
+ */
+static u16 packet_vlan_tci(struct sk_buff *skb, struct net_device *dev)
+{
+	if (skb->pkt_type == PACKET_OUTGOING && vlan_tx_tag_present(skb))
+		return vlan_tx_tag_get(skb);
+	if (dev->priv_flags & IFF_802_1Q_VLAN)
+		return VLAN_DEV_INFO(dev)->vlan_id;
+	return 0;
+}
+
 static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt, struct net_device *orig_dev)
 {
 	struct sock *sk;
 	struct packet_sock *po;
 	struct sockaddr_ll *sll;
-	struct tpacket_hdr *h;
+	union tpacket_uhdr h;
 	u8 * skb_head = skb->data;
 	int skb_len = skb->len;
-	unsigned snaplen;
+	unsigned snaplen, hdrlen;
 	unsigned long status = TP_STATUS_LOSING|TP_STATUS_USER;
 	unsigned short macoff, netoff;
 	struct sk_buff *copy_skb = NULL;
+	struct timespec ts;
 
 	if (skb->pkt_type == PACKET_LOOPBACK)
 		goto drop;
@@ -603,14 +682,14 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 	}
 
 	if (sk->sk_type == SOCK_DGRAM) {
-		macoff = netoff = TPACKET_ALIGN(TPACKET_HDRLEN) + 16;
+		macoff = netoff = TPACKET_ALIGN(po->tp_hdrlen) + 16;
 	} else {
 		unsigned maclen = skb->nh.raw - skb->data;
-		netoff = TPACKET_ALIGN(TPACKET_HDRLEN + (maclen < 16 ? 16 : maclen));
+		netoff = TPACKET_ALIGN(po->tp_hdrlen + (maclen < 16 ? 16 : maclen));
 		macoff = netoff - maclen;
 	}
 
-	if (macoff + snaplen > po->frame_size) {
+	if (macoff + snaplen > po->rx_ring.frame_size) {
 		if (po->copy_thresh &&
 		    atomic_read(&sk->sk_rmem_alloc) + skb->truesize <
 		    (unsigned)sk->sk_rcvbuf) {
@@ -623,7 +702,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 			if (copy_skb)
 				skb_set_owner_r(copy_skb, sk);
 		}
-		snaplen = po->frame_size - macoff;
+		snaplen = po->rx_ring.frame_size - macoff;
 		if ((int)snaplen < 0)
 			snaplen = 0;
 	}
@@ -631,11 +710,10 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 		snaplen = skb->len-skb->data_len;
 
 	spin_lock(&sk->sk_receive_queue.lock);
-	h = (struct tpacket_hdr *)packet_lookup_frame(po, po->head);
-	
-	if (h->tp_status)
+	h.raw = packet_current_frame(po, &po->rx_ring, TP_STATUS_KERNEL);
+	if (!h.raw)
 		goto ring_is_full;
-	po->head = po->head != po->frame_max ? po->head+1 : 0;
+	packet_increment_head(&po->rx_ring);
 	po->stats.tp_packets++;
 	if (copy_skb) {
 		status |= TP_STATUS_COPY;
@@ -645,20 +723,46 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 		status &= ~TP_STATUS_LOSING;
 	spin_unlock(&sk->sk_receive_queue.lock);
 
-	memcpy((u8*)h + macoff, skb->data, snaplen);
-
-	h->tp_len = skb->len;
-	h->tp_snaplen = snaplen;
-	h->tp_mac = macoff;
-	h->tp_net = netoff;
-	if (skb->tstamp.off_sec == 0) { 
-		__net_timestamp(skb);
-		sock_enable_timestamp(sk);
+	memcpy((u8*)h.raw + macoff, skb->data, snaplen);
+
+	switch (po->tp_version) {
+	case TPACKET_V1:
+		h.h1->tp_len = skb->len;
+		h.h1->tp_snaplen = snaplen;
+		h.h1->tp_mac = macoff;
+		h.h1->tp_net = netoff;
+		if (skb->tstamp.off_sec == 0) { 
+			__net_timestamp(skb);
+			sock_enable_timestamp(sk);
+		}
+		h.h1->tp_sec = skb->tstamp.off_sec;
+		h.h1->tp_usec = skb->tstamp.off_usec;
+		hdrlen = sizeof(*h.h1);
+		break;
+	case TPACKET_V2:
+		h.h2->tp_len = skb->len;
+		h.h2->tp_snaplen = snaplen;
+		h.h2->tp_mac = macoff;
+		h.h2->tp_net = netoff;
+		/* Rather than turn on the microsecond stamps netif_rx()
+		 * takes of every packet, stamp unstamped ones here.
+		 */
+		if (skb->tstamp.off_sec == 0)
+			getnstimeofday(&ts);
+		else {
+			ts.tv_sec = skb->tstamp.off_sec;
+			ts.tv_nsec = skb->tstamp.off_usec * NSEC_PER_USEC;
+		}
+		h.h2->tp_sec = ts.tv_sec;
+		h.h2->tp_nsec = ts.tv_nsec;
+		h.h2->tp_vlan_tci = packet_vlan_tci(skb, dev);
+		hdrlen = sizeof(*h.h2);
+		break;
+	default:
+		BUG();
 	}
-	h->tp_sec = skb->tstamp.off_sec;
-	h->tp_usec = skb->tstamp.off_usec;
 
-	sll = (struct sockaddr_ll*)((u8*)h + TPACKET_ALIGN(sizeof(*h)));
+	sll = (struct sockaddr_ll*)((u8*)h.raw + TPACKET_ALIGN(hdrlen));
 	sll->sll_halen = 0;
 	if (dev->hard_header_parse)
 		sll->sll_halen = dev->hard_header_parse(skb, sll->sll_addr);
@@ -668,14 +772,14 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 	sll->sll_pkttype = skb->pkt_type;
 	sll->sll_ifindex = dev->ifindex;
 
-	h->tp_status = status;
+	__packet_set_status(po, h.raw, status);
 	mb();
 
 	{
 		struct page *p_start, *p_end;
-		u8 *h_end = (u8 *)h + macoff + snaplen - 1;
+		u8 *h_end = (u8 *)h.raw + macoff + snaplen - 1;
 
-		p_start = virt_to_page(h);
+		p_start = virt_to_page(h.raw);
 		p_end = virt_to_page(h_end);
 		while (p_start <= p_end) {
 			flush_dcache_page(p_start);
@@ -704,6 +808,195 @@ ring_is_full:
 	goto drop_n_restore;
 }
 
+/*
+ * Frames up to this long are copied out of the tx ring rather than sent
+ * from it: that is cheaper than taking the page references, and keeps
+ * the short frames that drivers pad in the linear area.
+ */
+#define TPACKET_TX_COPYBREAK	256
+
+/* A zero-copy frame has left the device: hand it back to user space. */
+static void tpacket_destruct_skb(struct sk_buff *skb)
+{
+	struct packet_sock *po = pkt_sk(skb->sk);
+	void *frame = skb_shinfo(skb)->destructor_arg;
+
+	atomic_dec(&po->tx_ring.pending);
+	__packet_set_status(po, frame, TP_STATUS_AVAILABLE);
+	sock_wfree(skb);
+}
+
+static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
+			    char *data, int tp_len, int zerocopy,
+			    struct net_device *dev, unsigned short proto,
+			    unsigned char *addr)
+{
+	struct sock *sk = &po->sk;
+	int to_write = tp_len;
+
+	skb_reserve(skb, LL_RESERVED_SPACE(dev));
+	skb->nh.raw = skb->data;
+
+	if (dev->hard_header) {
+		int res;
+		res = dev->hard_header(skb, dev, ntohs(proto), addr, NULL, tp_len);
+		if (sk->sk_type != SOCK_DGRAM) {
+			skb->tail = skb->data;
+			skb->len = 0;
+		} else if (res < 0)
+			return -EINVAL;
+	}
+
+	skb->protocol = proto;
+	skb->dev = dev;
+	skb->priority = sk->sk_priority;
+
+	if (!zerocopy) {
+		memcpy(skb_put(skb, tp_len), data, tp_len);
+		return 0;
+	}
+
+	/* The link level header goes in the linear area, the rest is
+	 * attached page by page straight from the ring.
+	 */
+	if (sk->sk_type != SOCK_DGRAM) {
+		int hlen = min_t(int, tp_len, dev->hard_header_len);
+
+		memcpy(skb_put(skb, hlen), data, hlen);
+		data += hlen;
+		to_write -= hlen;
+	}
+
+	skb->data_len = to_write;
+	skb->len += to_write;
+	skb->truesize += to_write;
+	atomic_add(to_write, &sk->sk_wmem_alloc);
+
+	while (to_write) {
+		struct page *page = virt_to_page(data);
+		int offset = offset_in_page(data);
+		int len = min_t(int, PAGE_SIZE - offset, to_write);
+
+		get_page(page);
+		skb_fill_page_desc(skb, skb_shinfo(skb)->nr_frags, page,
+				   offset, len);
+		data += len;
+		to_write -= len;
+	}
+	return 0;
+}
+
+/*
+ * Send every frame user space has marked TP_STATUS_SEND_REQUEST, from
+ * the head of the tx ring on.  Returns the bytes queued, or an error if
+ * there were none.
+ */
+static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
+{
+	struct sock *sk = &po->sk;
+	struct sockaddr_ll *saddr=(struct sockaddr_ll *)msg->msg_name;
+	struct sk_buff *skb;
+	struct net_device *dev;
+	unsigned short proto;
+	unsigned char *addr;
+	int ifindex, err, reserve = 0;
+	int size_max, len_sum = 0;
+	void *frame;
+
+	lock_sock(sk);
+
+	err = -EINVAL;
+	if (unlikely(po->tx_ring.pg_vec == NULL))
+		goto out;
+
+	if (saddr == NULL) {
+		ifindex	= po->ifindex;
+		proto	= po->num;
+		addr	= NULL;
+	} else {
+		if (msg->msg_namelen < sizeof(struct sockaddr_ll))
+			goto out;
+		if (msg->msg_namelen < (saddr->sll_halen + offsetof(struct sockaddr_ll, sll_addr)))
+			goto out;
+		ifindex	= saddr->sll_ifindex;
+		proto	= saddr->sll_protocol;
+		addr	= saddr->sll_addr;
+	}
+
+	dev = dev_get_by_index(ifindex);
+	err = -ENXIO;
+	if (dev == NULL)
+		goto out;
+	err = -ENETDOWN;
+	if (!(dev->flags & IFF_UP))
+		goto out_put;
+	if (sk->sk_type == SOCK_RAW)
+		reserve = dev->hard_header_len;
+
+	/* Frame data starts where the rx ring puts struct sockaddr_ll. */
+	size_max = po->tx_ring.frame_size -
+		   (po->tp_hdrlen - sizeof(struct sockaddr_ll));
+	if (size_max > dev->mtu + reserve)
+		size_max = dev->mtu + reserve;
+
+	err = 0;
+	while ((frame = packet_current_frame(po, &po->tx_ring,
+					     TP_STATUS_SEND_REQUEST)) != NULL) {
+		union tpacket_uhdr h;
+		char *data;
+		int tp_len, zerocopy;
+
+		h.raw = frame;
+		tp_len = po->tp_version == TPACKET_V2 ?
+			 h.h2->tp_len : h.h1->tp_len;
+		data = (char *)frame + po->tp_hdrlen - sizeof(struct sockaddr_ll);
+
+		if (unlikely(tp_len < 0 || tp_len > size_max)) {
+			err = -EMSGSIZE;
+			goto wrong_format;
+		}
+		zerocopy = (dev->features & NETIF_F_SG) &&
+			   tp_len > TPACKET_TX_COPYBREAK;
+
+		skb = sock_alloc_send_skb(sk, LL_RESERVED_SPACE(dev) +
+					  (zerocopy ? reserve : tp_len),
+					  msg->msg_flags & MSG_DONTWAIT, &err);
+		if (skb == NULL)
+			break;
+
+		err = tpacket_fill_skb(po, skb, data, tp_len, zerocopy,
+				       dev, proto, addr);
+		if (unlikely(err)) {
+			kfree_skb(skb);
+			goto wrong_format;
+		}
+
+		if (zerocopy) {
+			skb_shinfo(skb)->destructor_arg = frame;
+			skb->destructor = tpacket_destruct_skb;
+			atomic_inc(&po->tx_ring.pending);
+			__packet_set_status(po, frame, TP_STATUS_SENDING);
+		} else
+			__packet_set_status(po, frame, TP_STATUS_AVAILABLE);
+		packet_increment_head(&po->tx_ring);
+
+		err = dev_queue_xmit(skb);
+		if (err > 0 && (err = net_xmit_errno(err)) != 0)
+			break;
+		len_sum += tp_len;
+	}
+
+out_put:
+	dev_put(dev);
+out:
+	release_sock(sk);
+	return len_sum ? len_sum : err;
+
+wrong_format:
+	__packet_set_status(po, frame, TP_STATUS_WRONG_FORMAT);
+	packet_increment_head(&po->tx_ring);
+	goto out_put;
+}
 #endif
 
 
@@ -718,6 +1011,11 @@ static int packet_sendmsg(struct kiocb *iocb, struct socket *sock,
 	unsigned char *addr;
 	int ifindex, err, reserve = 0;
 
+#ifdef CONFIG_PACKET_MMAP
+	if (pkt_sk(sk)->tx_ring.pg_vec)
+		return tpacket_snd(pkt_sk(sk), msg);
+#endif
+
 	/*
 	 *	Get and verify the address. 
 	 */
@@ -842,10 +1140,15 @@ static int packet_release(struct socket *sock)
 #endif
 
 #ifdef CONFIG_PACKET_MMAP
-	if (po->pg_vec) {
+	if (po->rx_ring.pg_vec) {
+		struct tpacket_req req;
+		memset(&req, 0, sizeof(req));
+		packet_set_ring(sk, &req, 1, 0);
+	}
+	if (po->tx_ring.pg_vec) {
 		struct tpacket_req req;
 		memset(&req, 0, sizeof(req));
-		packet_set_ring(sk, &req, 1);
+		packet_set_ring(sk, &req, 1, 1);
 	}
 #endif
 
@@ -1021,6 +1324,10 @@ static int packet_create(struct socket *sock, int protocol)
 	po = pkt_sk(sk);
 	sk->sk_family = PF_PACKET;
 	po->num = protocol;
+#ifdef CONFIG_PACKET_MMAP
+	po->tp_version = TPACKET_V1;
+	po->tp_hdrlen = TPACKET_HDRLEN;
+#endif
 
 	sk->sk_destruct = packet_sock_destruct;
 	atomic_inc(&packet_socks_nr);
@@ -1355,6 +1662,7 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 #endif
 #ifdef CONFIG_PACKET_MMAP
 	case PACKET_RX_RING:
+	case PACKET_TX_RING:
 	{
 		struct tpacket_req req;
 
@@ -1362,7 +1670,7 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 			return -EINVAL;
 		if (copy_from_user(&req,optval,sizeof(req)))
 			return -EFAULT;
-		return packet_set_ring(sk, &req, 0);
+		return packet_set_ring(sk, &req, 0, optname == PACKET_TX_RING);
 	}
 	case PACKET_COPY_THRESH:
 	{
@@ -1376,6 +1684,31 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		pkt_sk(sk)->copy_thresh = val;
 		return 0;
 	}
+	case PACKET_VERSION:
+	{
+		struct packet_sock *po = pkt_sk(sk);
+		int val;
+
+		if (optlen!=sizeof(val))
+			return -EINVAL;
+		if (copy_from_user(&val,optval,sizeof(val)))
+			return -EFAULT;
+		if (po->rx_ring.pg_vec || po->tx_ring.pg_vec)
+			return -EBUSY;
+
+		switch (val) {
+		case TPACKET_V1:
+			po->tp_hdrlen = TPACKET_HDRLEN;
+			break;
+		case TPACKET_V2:
+			po->tp_hdrlen = TPACKET2_HDRLEN;
+			break;
+		default:
+			return -EINVAL;
+		}
+		po->tp_version = val;
+		return 0;
+	}
 #endif
 	default:
 		return -ENOPROTOOPT;
@@ -1415,6 +1748,42 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 			return -EFAULT;
 		break;
 	}
+#ifdef CONFIG_PACKET_MMAP
+	case PACKET_VERSION:
+	{
+		int val = po->tp_version;
+
+		if (len > sizeof(int))
+			len = sizeof(int);
+		if (copy_to_user(optval, &val, len))
+			return -EFAULT;
+		break;
+	}
+	case PACKET_HDRLEN:
+	{
+		/* in: the version asked about, out: its header length */
+		int val;
+
+		if (len < sizeof(int))
+			return -EINVAL;
+		len = sizeof(int);
+		if (copy_from_user(&val, optval, len))
+			return -EFAULT;
+		switch (val) {
+		case TPACKET_V1:
+			val = sizeof(struct tpacket_hdr);
+			break;
+		case TPACKET_V2:
+			val = sizeof(struct tpacket2_hdr);
+			break;
+		default:
+			return -EINVAL;
+		}
+		if (copy_to_user(optval, &val, len))
+			return -EFAULT;
+		break;
+	}
+#endif
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1540,16 +1909,20 @@ static unsigned int packet_poll(struct file * file, struct socket *sock,
 	unsigned int mask = datagram_poll(file, sock, wait);
 
 	spin_lock_bh(&sk->sk_receive_queue.lock);
-	if (po->pg_vec) {
-		unsigned last = po->head ? po->head-1 : po->frame_max;
-		struct tpacket_hdr *h;
-
-		h = (struct tpacket_hdr *)packet_lookup_frame(po, last);
+	if (po->rx_ring.pg_vec) {
+		struct packet_ring *rb = &po->rx_ring;
+		unsigned last = rb->head ? rb->head-1 : rb->frame_max;
 
-		if (h->tp_status)
+		if (!packet_lookup_frame(po, rb, last, TP_STATUS_KERNEL))
 			mask |= POLLIN | POLLRDNORM;
 	}
 	spin_unlock_bh(&sk->sk_receive_queue.lock);
+	spin_lock_bh(&sk->sk_write_queue.lock);
+	if (po->tx_ring.pg_vec) {
+		if (packet_current_frame(po, &po->tx_ring, TP_STATUS_AVAILABLE))
+			mask |= POLLOUT | POLLWRNORM;
+	}
+	spin_unlock_bh(&sk->sk_write_queue.lock);
 	return mask;
 }
 
@@ -1630,34 +2003,40 @@ out_free_pgvec:
 	goto out;
 }
 
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing)
+static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
+			   int closing, int tx_ring)
 {
 	char **pg_vec = NULL;
 	struct packet_sock *po = pkt_sk(sk);
+	struct packet_ring *rb;
+	struct sk_buff_head *rb_queue;
 	int was_running, num, order = 0;
 	int err = 0;
-	
+
+	rb = tx_ring ? &po->tx_ring : &po->rx_ring;
+	rb_queue = tx_ring ? &sk->sk_write_queue : &sk->sk_receive_queue;
+
 	if (req->tp_block_nr) {
-		int i, l;
+		int i;
 
 		/* Sanity tests and some calculations */
 
-		if (unlikely(po->pg_vec))
+		if (unlikely(rb->pg_vec))
 			return -EBUSY;
 
 		if (unlikely((int)req->tp_block_size <= 0))
 			return -EINVAL;
 		if (unlikely(req->tp_block_size & (PAGE_SIZE - 1)))
 			return -EINVAL;
-		if (unlikely(req->tp_frame_size < TPACKET_HDRLEN))
+		if (unlikely(req->tp_frame_size < po->tp_hdrlen))
 			return -EINVAL;
 		if (unlikely(req->tp_frame_size & (TPACKET_ALIGNMENT - 1)))
 			return -EINVAL;
 
-		po->frames_per_block = req->tp_block_size/req->tp_frame_size;
-		if (unlikely(po->frames_per_block <= 0))
+		rb->frames_per_block = req->tp_block_size/req->tp_frame_size;
+		if (unlikely(rb->frames_per_block <= 0))
 			return -EINVAL;
-		if (unlikely((po->frames_per_block * req->tp_block_nr) !=
+		if (unlikely((rb->frames_per_block * req->tp_block_nr) !=
 			     req->tp_frame_nr))
 			return -EINVAL;
 
@@ -1667,15 +2046,14 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 		if (unlikely(!pg_vec))
 			goto out;
 
-		l = 0;
 		for (i = 0; i < req->tp_block_nr; i++) {
 			char *ptr = pg_vec[i];
-			struct tpacket_hdr *header;
 			int k;
 
-			for (k = 0; k < po->frames_per_block; k++) {
-				header = (struct tpacket_hdr *) ptr;
-				header->tp_status = TP_STATUS_KERNEL;
+			for (k = 0; k < rb->frames_per_block; k++) {
+				__packet_set_status(po, ptr, tx_ring ?
+						    TP_STATUS_AVAILABLE :
+						    TP_STATUS_KERNEL);
 				ptr += req->tp_frame_size;
 			}
 		}
@@ -1701,24 +2079,28 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 		
 	synchronize_net();
 
+	/* Frames still being sent from the tx ring hold a reference on its
+	 * pages, so closing may free it under them; nothing else may.
+	 */
 	err = -EBUSY;
-	if (closing || atomic_read(&po->mapped) == 0) {
+	if (closing || (atomic_read(&po->mapped) == 0 &&
+			atomic_read(&rb->pending) == 0)) {
 		err = 0;
 #define XC(a, b) ({ __typeof__ ((a)) __t; __t = (a); (a) = (b); __t; })
 
-		spin_lock_bh(&sk->sk_receive_queue.lock);
-		pg_vec = XC(po->pg_vec, pg_vec);
-		po->frame_max = (req->tp_frame_nr - 1);
-		po->head = 0;
-		po->frame_size = req->tp_frame_size;
-		spin_unlock_bh(&sk->sk_receive_queue.lock);
+		spin_lock_bh(&rb_queue->lock);
+		pg_vec = XC(rb->pg_vec, pg_vec);
+		rb->frame_max = (req->tp_frame_nr - 1);
+		rb->head = 0;
+		rb->frame_size = req->tp_frame_size;
+		spin_unlock_bh(&rb_queue->lock);
 
-		order = XC(po->pg_vec_order, order);
-		req->tp_block_nr = XC(po->pg_vec_len, req->tp_block_nr);
+		order = XC(rb->pg_vec_order, order);
+		req->tp_block_nr = XC(rb->pg_vec_len, req->tp_block_nr);
 
-		po->pg_vec_pages = req->tp_block_size/PAGE_SIZE;
-		po->prot_hook.func = po->pg_vec ? tpacket_rcv : packet_rcv;
-		skb_queue_purge(&sk->sk_receive_queue);
+		rb->pg_vec_pages = req->tp_block_size/PAGE_SIZE;
+		po->prot_hook.func = po->rx_ring.pg_vec ? tpacket_rcv : packet_rcv;
+		skb_queue_purge(rb_queue);
 #undef XC
 		if (atomic_read(&po->mapped))
 			printk(KERN_DEBUG "packet_mmap: vma is busy: %d\n", atomic_read(&po->mapped));
@@ -1745,7 +2127,8 @@ static int packet_mmap(struct file *file, struct socket *sock, struct vm_area_st
 {
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
-	unsigned long size;
+	struct packet_ring *rb;
+	unsigned long size, expected_size;
 	unsigned long start;
 	int err = -EINVAL;
 	int i;
@@ -1755,22 +2138,33 @@ static int packet_mmap(struct file *file, struct socket *sock, struct vm_area_st
 
 	size = vma->vm_end - vma->vm_start;
 
+	/* The rx ring, if any, is mapped first and the tx ring after it. */
 	lock_sock(sk);
-	if (po->pg_vec == NULL)
+	expected_size = 0;
+	for (rb = &po->rx_ring; rb <= &po->tx_ring; rb++) {
+		if (rb->pg_vec)
+			expected_size += rb->pg_vec_len*rb->pg_vec_pages*PAGE_SIZE;
+	}
+	if (expected_size == 0)
 		goto out;
-	if (size != po->pg_vec_len*po->pg_vec_pages*PAGE_SIZE)
+	if (size != expected_size)
 		goto out;
 
 	start = vma->vm_start;
-	for (i = 0; i < po->pg_vec_len; i++) {
-		struct page *page = virt_to_page(po->pg_vec[i]);
-		int pg_num;
-
-		for (pg_num = 0; pg_num < po->pg_vec_pages; pg_num++, page++) {
-			err = vm_insert_page(vma, start, page);
-			if (unlikely(err))
-				goto out;
-			start += PAGE_SIZE;
+	for (rb = &po->rx_ring; rb <= &po->tx_ring; rb++) {
+		if (rb->pg_vec == NULL)
+			continue;
+
+		for (i = 0; i < rb->pg_vec_len; i++) {
+			struct page *page = virt_to_page(rb->pg_vec[i]);
+			int pg_num;
+
+			for (pg_num = 0; pg_num < rb->pg_vec_pages; pg_num++, page++) {
+				err = vm_insert_page(vma, start, page);
+				if (unlikely(err))
+					goto out;
+				start += PAGE_SIZE;
+			}
 		}
 	}
 	atomic_inc(&po->mapped);
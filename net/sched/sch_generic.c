@@ -76,6 +76,12 @@ void qdisc_unlock_tree(struct net_device *dev)
 
    dev->queue_lock and dev->xmit_lock are mutually exclusive,
    if one is grabbed, another must be free.
+
+   The further transmit queues of a multiqueue device have a lock and
+   an xmit_lock of their own each, with the same rules.  They are only
+   used with the default qdisc: when one is configured on the root,
+   all packets go through dev->qdisc.  netif_tx_lock() takes every
+   xmit_lock, dev->xmit_lock first.
  */
 
 
@@ -87,12 +93,17 @@ void qdisc_unlock_tree(struct net_device *dev)
             >0  - queue is not empty, but throttled.
 	    <0  - queue is not empty. Device is throttled, if dev->tbusy != 0.
 
-   NOTE: Called under dev->queue_lock with locally disabled BH.
+   NOTE: Called under the queue's lock (dev->queue_lock for queue 0)
+   with locally disabled BH.
 */
 
-int qdisc_restart(struct net_device *dev)
+int qdisc_restart_queue(struct net_device *dev, u16 index)
 {
-	struct Qdisc *q = dev->qdisc;
+	struct netdev_queue *txq = index ? netdev_get_tx_queue(dev, index) : NULL;
+	spinlock_t *queue_lock = txq ? &txq->lock : &dev->queue_lock;
+	spinlock_t *xmit_lock = netif_tx_queue_lock(dev, index);
+	int *xmit_lock_owner = netif_tx_queue_owner(dev, index);
+	struct Qdisc *q = txq ? txq->qdisc : dev->qdisc;
 	struct sk_buff *skb;
 
 	/* Dequeue packet */
@@ -108,7 +119,7 @@ int qdisc_restart(struct net_device *dev)
 		 * will be requeued.
 		 */
 		if (!nolock) {
-			if (!spin_trylock(&dev->xmit_lock)) {
+			if (!spin_trylock(xmit_lock)) {
 			collision:
 				/* So, someone grabbed the driver. */
 				
@@ -117,7 +128,7 @@ int qdisc_restart(struct net_device *dev)
 				   it by checking xmit owner and drop the
 				   packet when deadloop is detected.
 				*/
-				if (dev->xmit_lock_owner == smp_processor_id()) {
+				if (*xmit_lock_owner == smp_processor_id()) {
 					kfree_skb(skb);
 					if (net_ratelimit())
 						printk(KERN_DEBUG "Dead loop on netdevice %s, fix it urgently!\n", dev->name);
@@ -127,14 +138,14 @@ int qdisc_restart(struct net_device *dev)
 				goto requeue;
 			}
 			/* Remember that the driver is grabbed by us. */
-			dev->xmit_lock_owner = smp_processor_id();
+			*xmit_lock_owner = smp_processor_id();
 		}
 		
 		{
 			/* And release queue */
-			spin_unlock(&dev->queue_lock);
+			spin_unlock(queue_lock);
 
-			if (!netif_queue_stopped(dev)) {
+			if (!netif_subqueue_stopped(dev, index)) {
 				int ret;
 				if (netdev_nit)
 					dev_queue_xmit_nit(skb, dev);
@@ -142,14 +153,14 @@ int qdisc_restart(struct net_device *dev)
 				ret = dev->hard_start_xmit(skb, dev);
 				if (ret == NETDEV_TX_OK) { 
 					if (!nolock) {
-						dev->xmit_lock_owner = -1;
-						spin_unlock(&dev->xmit_lock);
+						*xmit_lock_owner = -1;
+						spin_unlock(xmit_lock);
 					}
-					spin_lock(&dev->queue_lock);
+					spin_lock(queue_lock);
 					return -1;
 				}
 				if (ret == NETDEV_TX_LOCKED && nolock) {
-					spin_lock(&dev->queue_lock);
+					spin_lock(queue_lock);
 					goto collision; 
 				}
 			}
@@ -157,11 +168,11 @@ int qdisc_restart(struct net_device *dev)
 			/* NETDEV_TX_BUSY - we need to requeue */
 			/* Release the driver */
 			if (!nolock) { 
-				dev->xmit_lock_owner = -1;
-				spin_unlock(&dev->xmit_lock);
+				*xmit_lock_owner = -1;
+				spin_unlock(xmit_lock);
 			} 
-			spin_lock(&dev->queue_lock);
-			q = dev->qdisc;
+			spin_lock(queue_lock);
+			q = txq ? txq->qdisc : dev->qdisc;
 		}
 
 		/* Device kicked us out :(
@@ -176,23 +187,42 @@ int qdisc_restart(struct net_device *dev)
 
 requeue:
 		q->ops->requeue(skb, q);
-		netif_schedule(dev);
+		netif_schedule_subqueue(dev, index);
 		return 1;
 	}
 	BUG_ON((int) q->q.qlen < 0);
 	return q->q.qlen;
 }
 
+int qdisc_restart(struct net_device *dev)
+{
+	return qdisc_restart_queue(dev, 0);
+}
+
+/* Has the device or one of its transmit queues been stopped? */
+static int dev_tx_stopped(struct net_device *dev)
+{
+	unsigned int i;
+
+	if (netif_queue_stopped(dev))
+		return 1;
+	for (i = 0; i < dev->num_tx_queues; i++)
+		if (netif_subqueue_stopped(dev, i))
+			return 1;
+	return 0;
+}
+
 static void dev_watchdog(unsigned long arg)
 {
 	struct net_device *dev = (struct net_device *)arg;
 
-	spin_lock(&dev->xmit_lock);
+	/* ->tx_timeout() resets every queue */
+	netif_tx_lock(dev);
 	if (dev->qdisc != &noop_qdisc) {
 		if (netif_device_present(dev) &&
 		    netif_running(dev) &&
 		    netif_carrier_ok(dev)) {
-			if (netif_queue_stopped(dev) &&
+			if (dev_tx_stopped(dev) &&
 			    (jiffies - dev->trans_start) > dev->watchdog_timeo) {
 				printk(KERN_INFO "NETDEV WATCHDOG: %s: transmit timed out\n", dev->name);
 				dev->tx_timeout(dev);
@@ -201,7 +231,7 @@ static void dev_watchdog(unsigned long arg)
 				dev_hold(dev);
 		}
 	}
-	spin_unlock(&dev->xmit_lock);
+	netif_tx_unlock(dev);
 
 	dev_put(dev);
 }
@@ -523,6 +553,39 @@ void qdisc_destroy(struct Qdisc *qdisc)
 	call_rcu(&qdisc->q_rcu, __qdisc_destroy);
 }
 
+/* Give the further transmit queues of a multiqueue device qdiscs like
+   the default one of the device.  A qdisc configured on the root is not
+   copied: the queues get noop_qdisc then, and dev_queue_xmit sends all
+   packets through dev->qdisc.
+ */
+static void dev_activate_queues(struct net_device *dev)
+{
+	struct Qdisc *root = dev->qdisc_sleeping;
+	struct Qdisc *qdisc;
+	unsigned int i;
+
+	for (i = 1; i < dev->num_tx_queues; i++) {
+		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
+
+		if (root == &noqueue_qdisc)
+			qdisc = &noqueue_qdisc;
+		else if (root->ops != &pfifo_fast_ops)
+			qdisc = &noop_qdisc;
+		else {
+			if (txq->qdisc_sleeping == &noop_qdisc) {
+				qdisc = qdisc_create_dflt(dev, &pfifo_fast_ops);
+				if (qdisc)
+					txq->qdisc_sleeping = qdisc;
+			}
+			qdisc = txq->qdisc_sleeping;
+		}
+
+		spin_lock_bh(&txq->lock);
+		rcu_assign_pointer(txq->qdisc, qdisc);
+		spin_unlock_bh(&txq->lock);
+	}
+}
+
 void dev_activate(struct net_device *dev)
 {
 	/* No queueing discipline is attached to device;
@@ -554,6 +617,8 @@ void dev_activate(struct net_device *dev)
 		/* Delay activation until next carrier-on event */
 		return;
 
+	dev_activate_queues(dev);
+
 	spin_lock_bh(&dev->queue_lock);
 	rcu_assign_pointer(dev->qdisc, dev->qdisc_sleeping);
 	if (dev->qdisc != &noqueue_qdisc) {
@@ -566,6 +631,7 @@ void dev_activate(struct net_device *dev)
 void dev_deactivate(struct net_device *dev)
 {
 	struct Qdisc *qdisc;
+	unsigned int i;
 
 	spin_lock_bh(&dev->queue_lock);
 	qdisc = dev->qdisc;
@@ -575,20 +641,40 @@ void dev_deactivate(struct net_device *dev)
 
 	spin_unlock_bh(&dev->queue_lock);
 
+	for (i = 1; i < dev->num_tx_queues; i++) {
+		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
+
+		spin_lock_bh(&txq->lock);
+		qdisc = txq->qdisc;
+		txq->qdisc = &noop_qdisc;
+		qdisc_reset(qdisc);
+		spin_unlock_bh(&txq->lock);
+	}
+
 	dev_watchdog_down(dev);
 
 	while (test_bit(__LINK_STATE_SCHED, &dev->state))
 		yield();
 
 	spin_unlock_wait(&dev->xmit_lock);
+	for (i = 1; i < dev->num_tx_queues; i++)
+		spin_unlock_wait(&netdev_get_tx_queue(dev, i)->xmit_lock);
 }
 
 void dev_init_scheduler(struct net_device *dev)
 {
+	unsigned int i;
+
 	qdisc_lock_tree(dev);
 	dev->qdisc = &noop_qdisc;
 	dev->qdisc_sleeping = &noop_qdisc;
 	INIT_LIST_HEAD(&dev->qdisc_list);
+	for (i = 1; i < dev->num_tx_queues; i++) {
+		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
+
+		txq->qdisc = &noop_qdisc;
+		txq->qdisc_sleeping = &noop_qdisc;
+	}
 	qdisc_unlock_tree(dev);
 
 	dev_watchdog_init(dev);
@@ -597,12 +683,21 @@ void dev_init_scheduler(struct net_device *dev)
 void dev_shutdown(struct net_device *dev)
 {
 	struct Qdisc *qdisc;
+	unsigned int i;
 
 	qdisc_lock_tree(dev);
 	qdisc = dev->qdisc_sleeping;
 	dev->qdisc = &noop_qdisc;
 	dev->qdisc_sleeping = &noop_qdisc;
 	qdisc_destroy(qdisc);
+	for (i = 1; i < dev->num_tx_queues; i++) {
+		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
+
+		qdisc = txq->qdisc_sleeping;
+		txq->qdisc = &noop_qdisc;
+		txq->qdisc_sleeping = &noop_qdisc;
+		qdisc_destroy(qdisc);
+	}
 #if defined(CONFIG_NET_SCH_INGRESS) || defined(CONFIG_NET_SCH_INGRESS_MODULE)
         if ((qdisc = dev->qdisc_ingress) != NULL) {
 		dev->qdisc_ingress = NULL;
@@ -623,5 +718,6 @@ EXPORT_SYMBOL(qdisc_alloc);
 EXPORT_SYMBOL(qdisc_destroy);
 EXPORT_SYMBOL(qdisc_reset);
 EXPORT_SYMBOL(qdisc_restart);
+EXPORT_SYMBOL(qdisc_restart_queue);
 EXPORT_SYMBOL(qdisc_lock_tree);
 EXPORT_SYMBOL(qdisc_unlock_tree);
@@ -883,7 +883,8 @@ static struct file_operations sel_commit_bools_ops = {
  * fs/proc/generic.c proc_kill_inodes */
 static void sel_remove_bools(struct dentry *de)
 {
-	struct list_head *p, *node;
+	struct list_head *node;
+	struct file *filp;
 	struct super_block *sb = de->d_sb;
 
 	spin_lock(&dcache_lock);
@@ -905,17 +906,16 @@ static void sel_remove_bools(struct dentry *de)
 
 	spin_unlock(&dcache_lock);
 
-	file_list_lock();
-	list_for_each(p, &sb->s_files) {
-		struct file * filp = list_entry(p, struct file, f_u.fu_list);
+	file_sb_list_lock_all();
+	do_file_list_for_each_entry(sb, filp) {
 		struct dentry * dentry = filp->f_dentry;
 
 		if (dentry->d_parent != de) {
 			continue;
 		}
 		filp->f_op = NULL;
-	}
-	file_list_unlock();
+	} while_file_list_for_each_entry;
+	file_sb_list_unlock_all();
 }
 
 #define BOOL_DIR_NAME "booleans"